@@ -1,6 +1,7 @@
 #pragma once
 
 #include <animaMaskedImageToImageFilter.h>
+#include <animaVoxelMajorDWIData.h>
 #include <itkVectorImage.h>
 #include <itkImage.h>
 
@@ -46,11 +47,26 @@ public:
         vnl_diag_matrix <double> workEigenValues;
     };
 
+    typedef anima::VoxelMajorDWIData DWIDataType;
+
     void SetBValuesList(std::vector <double> bValuesList ) {m_BValuesList = bValuesList;}
 
+    /**
+     * Reads diffusion signals from a voxel major container instead of the indexed inputs. Input 0 then only provides
+     * the geometry (see VoxelMajorDWIData::CreateGeometryImage)
+     */
+    void SetDWIData(DWIDataType *data) {m_DWIData = data;}
+
     itkSetMacro(B0Threshold, double)
     itkGetMacro(B0Threshold, double)
 
+    /**
+     * Number of voxels whose linear initialization is computed together: masked voxels log-signals are loaded into a
+     * contiguous gradients x voxels buffer and multiplied once by the least squares solver matrix
+     */
+    itkSetMacro(TileSize, unsigned int)
+    itkGetMacro(TileSize, unsigned int)
+
     itkGetMacro(EstimatedB0Image, OutputB0ImageType *)
     itkGetMacro(EstimatedVarianceImage, OutputB0ImageType *)
 
@@ -63,6 +79,8 @@ protected:
         m_BValuesList.clear();
 
         m_B0Threshold = 0;
+        m_TileSize = 512;
+        m_DWIData = ITK_NULLPTR;
         m_EstimatedB0Image = NULL;
         m_EstimatedVarianceImage = NULL;
     }
@@ -71,6 +89,14 @@ protected:
 
     void CheckComputationMask() ITK_OVERRIDE;
 
+    unsigned int GetNumberOfDWIVolumes()
+    {
+        if (m_DWIData)
+            return m_DWIData->GetNumberOfVolumes();
+
+        return this->GetNumberOfIndexedInputs();
+    }
+
     void GenerateOutputInformation() ITK_OVERRIDE;
     void BeforeThreadedGenerateData() ITK_OVERRIDE;
     void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
@@ -89,6 +115,8 @@ private:
     std::vector< vnl_vector_fixed<double,3> > m_GradientDirections;
 
     double m_B0Threshold;
+    unsigned int m_TileSize;
+    DWIDataType *m_DWIData;
     typename OutputB0ImageType::Pointer m_EstimatedB0Image, m_EstimatedVarianceImage;
 
     static const unsigned int m_NumberOfComponents = 6;
@@ -10,6 +10,7 @@
 #include <vnl/algo/vnl_symmetric_eigensystem.h>
 
 #include <nlopt.hpp>
+#include <algorithm>
 
 #include <animaVectorOperations.h>
 #include <animaBaseTensorTools.h>
@@ -45,8 +46,6 @@ DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
     while (m_BValuesList[firstB0Index] > 10)
         ++firstB0Index;
     
-    B0IteratorType b0Itr(this->GetInput(firstB0Index),this->GetOutput()->GetLargestPossibleRegion());
-
     typename MaskImageType::Pointer maskImage = MaskImageType::New();
     maskImage->Initialize();
     maskImage->SetRegions(this->GetInput(0)->GetLargestPossibleRegion());
@@ -56,6 +55,24 @@ DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
     maskImage->Allocate();
 
     MaskIteratorType maskItr (maskImage,this->GetOutput()->GetLargestPossibleRegion());
+
+    if (m_DWIData)
+    {
+        for (size_t i = 0;!maskItr.IsAtEnd();++i)
+        {
+            if (m_DWIData->GetVoxelSignal(i,firstB0Index) > m_B0Threshold)
+                maskItr.Set(1);
+            else
+                maskItr.Set(0);
+
+            ++maskItr;
+        }
+
+        this->SetComputationMask(maskImage);
+        return;
+    }
+
+    B0IteratorType b0Itr(this->GetInput(firstB0Index),this->GetOutput()->GetLargestPossibleRegion());
     while (!b0Itr.IsAtEnd())
     {
         if (b0Itr.Get() > m_B0Threshold)
@@ -89,12 +106,12 @@ void
 DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
 ::BeforeThreadedGenerateData()
 {
-    if (m_BValuesList.size() != this->GetNumberOfIndexedInputs())
+    if (m_BValuesList.size() != this->GetNumberOfDWIVolumes())
     {
         std::string error("There should be the same number of input images and input b-values... ");
         error += std::to_string (m_BValuesList.size());
         error += " ";
-        error += std::to_string (this->GetNumberOfIndexedInputs());
+        error += std::to_string (this->GetNumberOfDWIVolumes());
 
         throw itk::ExceptionObject(__FILE__, __LINE__,error,ITK_LOCATION);
     }
@@ -129,9 +146,9 @@ DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
     m_EstimatedVarianceImage->Allocate();
     m_EstimatedVarianceImage->FillBuffer(0.0);
 
-    vnl_matrix <double> initSolverSystem(this->GetNumberOfIndexedInputs(),m_NumberOfComponents + 1);
+    vnl_matrix <double> initSolverSystem(this->GetNumberOfDWIVolumes(),m_NumberOfComponents + 1);
     initSolverSystem.fill(0.0);
-    for (unsigned int i = 0;i < this->GetNumberOfIndexedInputs();++i)
+    for (unsigned int i = 0;i < this->GetNumberOfDWIVolumes();++i)
     {
         initSolverSystem(i,0) = 1.0;
         unsigned int pos = 1;
@@ -161,10 +178,13 @@ DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
 {
     typedef itk::ImageRegionConstIterator <InputImageType> ImageIteratorType;
 
-    unsigned int numInputs = this->GetNumberOfIndexedInputs();
+    unsigned int numInputs = this->GetNumberOfDWIVolumes();
     std::vector <ImageIteratorType> inIterators;
-    for (unsigned int i = 0;i < numInputs;++i)
-        inIterators.push_back(ImageIteratorType(this->GetInput(i),outputRegionForThread));
+    if (!m_DWIData)
+    {
+        for (unsigned int i = 0;i < numInputs;++i)
+            inIterators.push_back(ImageIteratorType(this->GetInput(i),outputRegionForThread));
+    }
 
     typedef itk::ImageRegionConstIterator <MaskImageType> MaskIteratorType;
     MaskIteratorType maskIterator(this->GetComputationMask(),outputRegionForThread);
@@ -178,7 +198,6 @@ DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
 
     typedef typename OutputImageType::PixelType OutputPixelType;
     std::vector <double> dwi (numInputs,0);
-    std::vector <double> lnDwi (numInputs,0);
     OutputPixelType resVec(m_NumberOfComponents);
 
     std::vector <double> predictedValues(numInputs,0);
@@ -190,149 +209,211 @@ DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
     typedef itk::SymmetricEigenAnalysis < vnl_matrix <double>, vnl_diag_matrix<double>, vnl_matrix <double> > EigenAnalysisType;
     EigenAnalysisType eigen(3);
 
-    while (!outIterator.IsAtEnd())
+    // Masked voxels of a tile are stored in columns, one row per input image, so that the linear initialization of
+    // the whole tile is a single matrix product running along contiguous rows
+    unsigned int tileSize = std::max(m_TileSize,1U);
+    std::vector <bool> tileMask(tileSize);
+    std::vector <size_t> tileLinearIndexes(tileSize);
+    std::vector <double> dwiSignals(numInputs * tileSize);
+    std::vector <double> lnDwiSignals(numInputs * tileSize);
+    std::vector <double> initialTensors(m_NumberOfComponents * tileSize);
+
+    size_t numVoxels = outputRegionForThread.GetNumberOfPixels();
+    for (size_t tileStart = 0;tileStart < numVoxels;tileStart += tileSize)
     {
-        resVec.Fill(0.0);
-        
-        if (maskIterator.Get() == 0)
+        unsigned int numTileVoxels = std::min(static_cast <size_t> (tileSize), numVoxels - tileStart);
+        unsigned int numMaskedVoxels = 0;
+        for (unsigned int v = 0;v < numTileVoxels;++v)
         {
-            outIterator.Set(resVec);
-            outB0Iterator.Set(0);
-            outVarianceIterator.Set(0);
+            tileMask[v] = (maskIterator.Get() != 0);
+            if (tileMask[v] && m_DWIData)
+            {
+                tileLinearIndexes[numMaskedVoxels] = m_DWIData->GetLinearIndex(maskIterator.GetIndex());
+                tileMask[v] = m_DWIData->IsStored(tileLinearIndexes[numMaskedVoxels]);
+            }
 
-            for (unsigned int i = 0;i < numInputs;++i)
-                ++inIterators[i];
+            if (tileMask[v])
+                ++numMaskedVoxels;
 
             ++maskIterator;
-            ++outIterator;
-            ++outB0Iterator;
-            ++outVarianceIterator;
-            
-            continue;
         }
 
-        for (unsigned int i = 0;i < numInputs;++i)
+        if (m_DWIData)
+        {
+            // Load masked voxels signals, voxel by voxel
+            for (unsigned int v = 0;v < numMaskedVoxels;++v)
+            {
+                m_DWIData->GetVoxelSignals(tileLinearIndexes[v],&dwi[0]);
+                for (unsigned int i = 0;i < numInputs;++i)
+                {
+                    unsigned int pos = i * tileSize + v;
+                    dwiSignals[pos] = dwi[i];
+                    lnDwiSignals[pos] = std::log(std::max(1.0e-6,dwi[i]));
+                }
+            }
+        }
+
+        // Load masked voxels signals, image by image
+        for (unsigned int i = 0;i < inIterators.size();++i)
         {
-            dwi[i] = inIterators[i].Get();
-            lnDwi[i] = std::log(std::max(1.0e-6,dwi[i]));
+            unsigned int pos = i * tileSize;
+            for (unsigned int v = 0;v < numTileVoxels;++v)
+            {
+                if (tileMask[v])
+                {
+                    dwiSignals[pos] = inIterators[i].Get();
+                    lnDwiSignals[pos] = std::log(std::max(1.0e-6,dwiSignals[pos]));
+                    ++pos;
+                }
+
+                ++inIterators[i];
+            }
         }
 
+        // Linear initialization of the whole tile
         for (unsigned int i = 0;i < m_NumberOfComponents;++i)
         {
+            double *tensorRow = &initialTensors[i * tileSize];
+            std::fill(tensorRow,tensorRow + numMaskedVoxels,0.0);
+
             for (unsigned int j = 0;j < numInputs;++j)
-                resVec[i] += m_InitialMatrixSolver(i+1,j) * lnDwi[j];
+            {
+                double solverValue = m_InitialMatrixSolver(i+1,j);
+                const double *lnDwiRow = &lnDwiSignals[j * tileSize];
+                for (unsigned int v = 0;v < numMaskedVoxels;++v)
+                    tensorRow[v] += solverValue * lnDwiRow[v];
+            }
         }
 
-        anima::GetTensorFromVectorRepresentation(resVec,data.workTensor);
+        unsigned int maskedVoxelIndex = 0;
+        for (unsigned int v = 0;v < numTileVoxels;++v)
+        {
+            resVec.Fill(0.0);
 
-        eigen.ComputeEigenValuesAndVectors(data.workTensor,data.workEigenValues,data.rotationMatrix);
-        if (vnl_determinant (data.rotationMatrix) < 0)
-            data.rotationMatrix *= -1;
+            if (!tileMask[v])
+            {
+                outIterator.Set(resVec);
+                outB0Iterator.Set(0);
+                outVarianceIterator.Set(0);
 
-        std::vector <double> optimizedValue(m_NumberOfComponents, 0.0);
+                ++outIterator;
+                ++outB0Iterator;
+                ++outVarianceIterator;
 
-        double cThetaControl = 0;
-        for (unsigned int i = 0;i < 3;++i)
-            cThetaControl += data.rotationMatrix(i,i);
+                continue;
+            }
 
-        if (std::abs(cThetaControl + 1.0) > 1.0e-5)
-            anima::Get3DRotationLogarithm(data.rotationMatrix,optimizedValue);
+            for (unsigned int i = 0;i < numInputs;++i)
+                dwi[i] = dwiSignals[i * tileSize + maskedVoxelIndex];
 
-        double minValue = 1.0e-7;
-        double maxValue = 1.0e-2;
-        for (unsigned int i = 0;i < 3;++i)
-        {
-            optimizedValue[i] += M_PI;
-            int num2Pi = std::floor(optimizedValue[i] / (2.0 * M_PI));
-            optimizedValue[i] -= 2.0 * M_PI * num2Pi + M_PI;
+            for (unsigned int i = 0;i < m_NumberOfComponents;++i)
+                resVec[i] = initialTensors[i * tileSize + maskedVoxelIndex];
 
-            optimizedValue[i + 3] = std::min(maxValue, std::max(data.workEigenValues[i], minValue));
-        }
+            ++maskedVoxelIndex;
 
-        // NLOPT optimization
-        nlopt::opt opt(nlopt::LN_BOBYQA, m_NumberOfComponents);
+            anima::GetTensorFromVectorRepresentation(resVec,data.workTensor);
 
-        std::vector <double> lowerBounds(m_NumberOfComponents, - M_PI);
-        for (unsigned int i = 0;i < 3;++i)
-            lowerBounds[i + 3] = minValue;
+            eigen.ComputeEigenValuesAndVectors(data.workTensor,data.workEigenValues,data.rotationMatrix);
+            if (vnl_determinant (data.rotationMatrix) < 0)
+                data.rotationMatrix *= -1;
 
-        opt.set_lower_bounds(lowerBounds);
+            std::vector <double> optimizedValue(m_NumberOfComponents, 0.0);
 
-        std::vector <double> upperBounds(m_NumberOfComponents, M_PI);
-        for (unsigned int i = 0;i < 3;++i)
-            upperBounds[i + 3] = maxValue;
+            double cThetaControl = 0;
+            for (unsigned int i = 0;i < 3;++i)
+                cThetaControl += data.rotationMatrix(i,i);
 
-        opt.set_upper_bounds(upperBounds);
-        opt.set_xtol_rel(1e-4);
-        opt.set_ftol_rel(1e-4);
-        opt.set_maxeval(2500);
+            if (std::abs(cThetaControl + 1.0) > 1.0e-5)
+                anima::Get3DRotationLogarithm(data.rotationMatrix,optimizedValue);
 
-        double minf;
+            double minValue = 1.0e-7;
+            double maxValue = 1.0e-2;
+            for (unsigned int i = 0;i < 3;++i)
+            {
+                optimizedValue[i] += M_PI;
+                int num2Pi = std::floor(optimizedValue[i] / (2.0 * M_PI));
+                optimizedValue[i] -= 2.0 * M_PI * num2Pi + M_PI;
 
-        data.filter = this;
-        data.dwi = dwi;
-        data.predictedValues = predictedValues;
+                optimizedValue[i + 3] = std::min(maxValue, std::max(data.workEigenValues[i], minValue));
+            }
 
-        opt.set_min_objective(OptimizationFunction, &data);
+            // NLOPT optimization
+            nlopt::opt opt(nlopt::LN_BOBYQA, m_NumberOfComponents);
 
-        try
-        {
-            opt.optimize(optimizedValue, minf);
-        }
-        catch(nlopt::roundoff_limited& e)
-        {
-            bool failedOpt = false;
-            for (unsigned int i = 0;i < 6;++i)
+            std::vector <double> lowerBounds(m_NumberOfComponents, - M_PI);
+            for (unsigned int i = 0;i < 3;++i)
+                lowerBounds[i + 3] = minValue;
+
+            opt.set_lower_bounds(lowerBounds);
+
+            std::vector <double> upperBounds(m_NumberOfComponents, M_PI);
+            for (unsigned int i = 0;i < 3;++i)
+                upperBounds[i + 3] = maxValue;
+
+            opt.set_upper_bounds(upperBounds);
+            opt.set_xtol_rel(1e-4);
+            opt.set_ftol_rel(1e-4);
+            opt.set_maxeval(2500);
+
+            double minf;
+
+            data.filter = this;
+            data.dwi = dwi;
+            data.predictedValues = predictedValues;
+
+            opt.set_min_objective(OptimizationFunction, &data);
+
+            try
             {
-                if (!std::isfinite(optimizedValue[i]))
-                {
-                    failedOpt = true;
-                    break;
-                }
+                opt.optimize(optimizedValue, minf);
             }
-
-            if (failedOpt)
+            catch(nlopt::roundoff_limited& e)
             {
-                resVec.Fill(0.0);
-                outIterator.Set(resVec);
-                outB0Iterator.Set(0);
-                outVarianceIterator.Set(0);
+                bool failedOpt = false;
+                for (unsigned int i = 0;i < 6;++i)
+                {
+                    if (!std::isfinite(optimizedValue[i]))
+                    {
+                        failedOpt = true;
+                        break;
+                    }
+                }
 
-                for (unsigned int i = 0;i < numInputs;++i)
-                    ++inIterators[i];
+                if (failedOpt)
+                {
+                    resVec.Fill(0.0);
+                    outIterator.Set(resVec);
+                    outB0Iterator.Set(0);
+                    outVarianceIterator.Set(0);
 
-                ++maskIterator;
-                ++outIterator;
-                ++outB0Iterator;
-                ++outVarianceIterator;
-                this->IncrementNumberOfProcessedPoints();
+                    ++outIterator;
+                    ++outB0Iterator;
+                    ++outVarianceIterator;
+                    this->IncrementNumberOfProcessedPoints();
 
-                continue;
+                    continue;
+                }
             }
-        }
-
-        anima::Get3DRotationExponential(optimizedValue,data.rotationMatrix);
-        for (unsigned int i = 0;i < 3;++i)
-            data.workEigenValues[i] = optimizedValue[3 + i];
 
-        anima::RecomposeTensor(data.workEigenValues,data.rotationMatrix,data.workTensor);
-        anima::GetVectorRepresentation(data.workTensor,resVec);
+            anima::Get3DRotationExponential(optimizedValue,data.rotationMatrix);
+            for (unsigned int i = 0;i < 3;++i)
+                data.workEigenValues[i] = optimizedValue[3 + i];
 
-        double outVarianceValue;
-        double outB0Value = this->ComputeB0AndVarianceFromTensorVector(data.workTensor,dwi,outVarianceValue);
+            anima::RecomposeTensor(data.workEigenValues,data.rotationMatrix,data.workTensor);
+            anima::GetVectorRepresentation(data.workTensor,resVec);
 
-        outIterator.Set(resVec);
-        outB0Iterator.Set(outB0Value);
-        outVarianceIterator.Set(outVarianceValue);
+            double outVarianceValue;
+            double outB0Value = this->ComputeB0AndVarianceFromTensorVector(data.workTensor,dwi,outVarianceValue);
 
-        for (unsigned int i = 0;i < numInputs;++i)
-            ++inIterators[i];
+            outIterator.Set(resVec);
+            outB0Iterator.Set(outB0Value);
+            outVarianceIterator.Set(outVarianceValue);
 
-        this->IncrementNumberOfProcessedPoints();
-        ++maskIterator;
-        ++outIterator;
-        ++outB0Iterator;
-        ++outVarianceIterator;
+            this->IncrementNumberOfProcessedPoints();
+            ++outIterator;
+            ++outB0Iterator;
+            ++outVarianceIterator;
+        }
     }
 }
 
@@ -401,7 +482,8 @@ DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
     workTensor.set_size(3,3);
     anima::RecomposeTensor(workEigenValues,rotationMatrix,workTensor);
 
-    for (unsigned int i = 0;i < this->GetNumberOfIndexedInputs();++i)
+    unsigned int numInputs = observedData.size();
+    for (unsigned int i = 0;i < numInputs;++i)
     {
         predictedValues[i] = 0;
         double bValue = m_BValuesList[i];
@@ -424,7 +506,7 @@ DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
     double b0Val = 0;
     double normConstant = 0;
 
-    for (unsigned int i = 0;i < this->GetNumberOfIndexedInputs();++i)
+    for (unsigned int i = 0;i < numInputs;++i)
     {
         b0Val += predictedValues[i] * observedData[i];
         normConstant += predictedValues[i] * predictedValues[i];
@@ -433,7 +515,7 @@ DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
     b0Val /= normConstant;
 
     double costValue = 0;
-    for (unsigned int i = 0;i < this->GetNumberOfIndexedInputs();++i)
+    for (unsigned int i = 0;i < numInputs;++i)
     {
         double predVal = b0Val * predictedValues[i];
         costValue += (predVal - observedData[i]) * (predVal - observedData[i]);
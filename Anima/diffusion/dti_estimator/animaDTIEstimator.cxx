@@ -28,6 +28,7 @@ int main(int argc,  char **argv)
     TCLAP::ValueArg<std::string> bvalArg("b","bval","input_b-values",true,"","Input b-values",cmd);
     TCLAP::SwitchArg bvalueScaleArg("B","b-no-scale","Do not scale b-values according to gradient norm",cmd);
     TCLAP::ValueArg<std::string> computationMaskArg("m","mask","Computation mask", false,"","computation mask",cmd);
+    TCLAP::SwitchArg int16StorageArg("","int16","Store DWI signals in memory as 16 bits integers (integer valued signals only)",cmd,false);
 
     TCLAP::ValueArg<unsigned int> b0ThrArg("t","b0thr","bot_treshold",false,0,"B0 threshold (default : 0)",cmd);
     TCLAP::ValueArg<unsigned int> nbpArg("p","numberofthreads","nb_thread",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"Number of threads to run on (default: all cores)",cmd);
@@ -68,44 +69,55 @@ int main(int argc,  char **argv)
 
     std::string inputFile = inArg.getValue();
 
-    Image4DType::Pointer input = anima::readImage<Image4DType>(inArg.getValue());
-
-    if (reorientArg.getValue() != "")
+    if ((reorientArg.getValue() != "")||(reorientGradArg.getValue() != ""))
     {
-        input = anima::reorientImage<Image4DType>(input, itk::SpatialOrientation::ITK_COORDINATE_ORIENTATION_RAI);
-        anima::writeImage<Image4DType>(reorientArg.getValue(), input);
+        Image4DType::Pointer input = anima::readImage<Image4DType>(inArg.getValue());
 
-        inputFile = reorientArg.getValue();
-    }
+        if (reorientArg.getValue() != "")
+        {
+            input = anima::reorientImage<Image4DType>(input, itk::SpatialOrientation::ITK_COORDINATE_ORIENTATION_RAI);
+            anima::writeImage<Image4DType>(reorientArg.getValue(), input);
 
-    if(reorientGradArg.getValue() != "")
-    {
-        anima::reorientGradients <Image4DType, vnl_vector_fixed<double,3> > (input, directions);
+            inputFile = reorientArg.getValue();
+        }
 
-        std::ofstream outGrads(reorientGradArg.getValue().c_str());
-        outGrads.precision(15);
-        for (unsigned int i = 0;i < 3;++i)
+        if(reorientGradArg.getValue() != "")
         {
-            for (unsigned int j = 0;j < directions.size();++j)
-                outGrads << directions[j][i] << " ";
-            outGrads << std::endl;
+            anima::reorientGradients <Image4DType, vnl_vector_fixed<double,3> > (input, directions);
+
+            std::ofstream outGrads(reorientGradArg.getValue().c_str());
+            outGrads.precision(15);
+            for (unsigned int i = 0;i < 3;++i)
+            {
+                for (unsigned int j = 0;j < directions.size();++j)
+                    outGrads << directions[j][i] << " ";
+                outGrads << std::endl;
+            }
+
+            outGrads.close();
         }
-
-        outGrads.close();
     }
 
     mainFilter->SetBValuesList(mb);
     for(unsigned int i = 0;i < directions.size();++i)
         mainFilter->AddGradientDirection(i, directions[i]);
 
-    std::vector <InputImageType::Pointer> inputData;
-    inputData = anima::getImagesFromHigherDimensionImage<Image4DType,InputImageType>(input);
-
-    for (unsigned int i = 0;i < inputData.size();++i)
-        mainFilter->SetInput(i,inputData[i]);
+    // Voxel major loading of the DWI, restricted to the computation mask
+    FilterType::DWIDataType dwiData;
+    if (int16StorageArg.isSet())
+        dwiData.SetStorageType(FilterType::DWIDataType::Int16);
 
     if (computationMaskArg.getValue() != "")
-        mainFilter->SetComputationMask(anima::readImage<MaskImageType>(computationMaskArg.getValue()));
+    {
+        MaskImageType::Pointer maskImage = anima::readImage<MaskImageType>(computationMaskArg.getValue());
+        dwiData.SetComputationMask(maskImage);
+        mainFilter->SetComputationMask(maskImage);
+    }
+
+    dwiData.Read(inputFile);
+
+    mainFilter->SetInput(0,dwiData.CreateGeometryImage<InputImageType>());
+    mainFilter->SetDWIData(&dwiData);
 
     mainFilter->SetB0Threshold(b0ThrArg.getValue());
     mainFilter->SetNumberOfWorkUnits(nbpArg.getValue());
@@ -218,6 +218,7 @@ int main(int argc,  char **argv)
     TCLAP::ValueArg<std::string> mcmArg("m","mcm","multi compartments model (.mcm)",true,"","multi compartments model",cmd);
     TCLAP::ValueArg<std::string> outTrackArg("o","out-tracks","out tracks name (.vtp,.vtk,.fds)",true,"","output tracks",cmd);
 
+    TCLAP::SwitchArg cachedMatchingArg("","cached-matching","Match neighboring voxel fascicles once before interpolating, clustering only ambiguous voxels (default: no)",cmd,false);
     TCLAP::ValueArg<unsigned int> nbThreadsArg("T","nb-threads","Number of threads to run on (default: all available)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
     try
@@ -271,6 +272,7 @@ int main(int argc,  char **argv)
     mcmInterpolatorPointer mcmInterpolator = mcmInterpolatorType::New();
     mcmInterpolator->SetInputImage(inputImage);
     mcmInterpolator->SetReferenceOutputModel(mcm);
+    mcmInterpolator->SetUseCachedMatching(cachedMatchingArg.isSet());
 
     int nbOfComponents = 4;
     bool hasFW = false;
@@ -99,17 +99,18 @@ GaussianMCMVariableProjectionCost::PrepareDataForLLS()
     m_IndexesUsefulCompartments.resize(numCompartments);
     std::sort(m_IndexesUsefulCompartments.begin(),m_IndexesUsefulCompartments.end());
 
-    // Compute predicted signals and jacobian
+    // Compute predicted signals and jacobian, one batched call per compartment on the whole gradient table
+    this->UpdateGradientTable();
     m_PredictedSignalAttenuations.set_size(nbValues,numCompartments);
+    m_WorkAttenuations.resize(nbValues);
 
-    for (unsigned int i = 0;i < nbValues;++i)
+    for (unsigned int j = 0;j < numCompartments;++j)
     {
-        for (unsigned int j = 0;j < numCompartments;++j)
-        {
-            unsigned int indexComp = m_IndexesUsefulCompartments[j];
-            double predictedSignal = m_MCMStructure->GetCompartment(indexComp)->GetFourierTransformedDiffusionProfile(m_SmallDelta, m_BigDelta, m_GradientStrengths[i], m_Gradients[i]);
-            m_PredictedSignalAttenuations.put(i,j,predictedSignal);
-        }
+        unsigned int indexComp = m_IndexesUsefulCompartments[j];
+        m_MCMStructure->GetCompartment(indexComp)->GetFourierTransformedDiffusionProfiles(m_GradientTable, m_WorkAttenuations.data());
+
+        for (unsigned int i = 0;i < nbValues;++i)
+            m_PredictedSignalAttenuations.put(i,j,m_WorkAttenuations[i]);
     }
 
     m_CholeskyMatrix.set_size(numCompartments,numCompartments);
@@ -255,7 +256,6 @@ GaussianMCMVariableProjectionCost::PrepareDataForDerivative()
     vnl_matrix<double> zeroMatrix(nbValues,numCompartments,0.0);
     m_SignalAttenuationsJacobian.resize(nbParams);
     std::fill(m_SignalAttenuationsJacobian.begin(),m_SignalAttenuationsJacobian.end(),zeroMatrix);
-    ListType compartmentJacobian;
 
     m_GramMatrix.set_size(numOnCompartments,numOnCompartments);
     m_InverseGramMatrix.set_size(numOnCompartments,numOnCompartments);
@@ -308,23 +308,21 @@ GaussianMCMVariableProjectionCost::PrepareDataForDerivative()
         }
     }
 
-    for (unsigned int i = 0;i < nbValues;++i)
+    this->UpdateGradientTable();
+    unsigned int pos = 0;
+    for (unsigned int j = 0;j < numCompartments;++j)
     {
-        unsigned int pos = 0;
+        unsigned int indexComp = m_IndexesUsefulCompartments[j];
+        m_MCMStructure->GetCompartment(indexComp)->GetSignalAttenuationJacobians(m_GradientTable, m_WorkJacobians);
 
-        for (unsigned int j = 0;j < numCompartments;++j)
+        unsigned int compartmentSize = m_WorkJacobians.rows();
+        for (unsigned int k = 0;k < compartmentSize;++k)
         {
-            unsigned int indexComp = m_IndexesUsefulCompartments[j];
-
-            compartmentJacobian = m_MCMStructure->GetCompartment(indexComp)->GetSignalAttenuationJacobian(m_SmallDelta, m_BigDelta,
-                                                                                                          m_GradientStrengths[i], m_Gradients[i]);
-
-            unsigned int compartmentSize = compartmentJacobian.size();
-            for (unsigned int k = 0;k < compartmentSize;++k)
-                m_SignalAttenuationsJacobian[pos+k].put(i,j,compartmentJacobian[k]);
-
-            pos += compartmentSize;
+            for (unsigned int i = 0;i < nbValues;++i)
+                m_SignalAttenuationsJacobian[pos+k].put(i,j,m_WorkJacobians.get(k,i));
         }
+
+        pos += compartmentSize;
     }
 }
 
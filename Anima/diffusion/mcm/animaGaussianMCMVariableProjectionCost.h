@@ -81,6 +81,10 @@ private:
     vnl_matrix <double> m_PredictedSignalAttenuations, m_CholeskyMatrix;
     std::vector< vnl_matrix<double> > m_SignalAttenuationsJacobian;
 
+    // Work variables for batched compartment predictions
+    std::vector <double> m_WorkAttenuations;
+    vnl_matrix <double> m_WorkJacobians;
+
     CholeskyDecomposition m_CholeskySolver;
     LECalculatorPointer m_leCalculator;
 };
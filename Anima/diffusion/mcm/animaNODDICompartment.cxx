@@ -99,6 +99,80 @@ double NODDICompartment::GetFourierTransformedDiffusionProfile(double smallDelta
     return signal;
 }
     
+void NODDICompartment::GetFourierTransformedDiffusionProfiles(const GradientTableType &gradientTable, double *attenuations)
+{
+    this->UpdateKappaValues();
+
+    unsigned int numGradients = gradientTable.GetNumberOfGradients();
+    unsigned int numCoefficients = m_WatsonSHCoefficients.size();
+    const double *bValues = gradientTable.BValues.data();
+    const double *gradX = gradientTable.Directions[0].data();
+    const double *gradY = gradientTable.Directions[1].data();
+    const double *gradZ = gradientTable.Directions[2].data();
+
+    double nuec = this->GetExtraAxonalFraction();
+    double nuic = 1.0 - nuec;
+    double dpara = this->GetAxialDiffusivity();
+
+    Vector3DType compartmentOrientation(0.0);
+    anima::TransformSphericalToCartesianCoordinates(this->GetOrientationTheta(),this->GetOrientationPhi(),1.0,compartmentOrientation);
+
+    double appAxialDiff = dpara * (1.0 - nuic * (1.0 - m_Tau1));
+    double appRadialDiff = dpara * (1.0 - nuic * (1.0 + m_Tau1) / 2.0);
+
+    // The Kummer function terms of the intra-axonal series only depend on the b-value: compute them once
+    // per shell, premultiplied by the Watson SH coefficients, leaving only Legendre polynomials per gradient
+    m_ShellBValues.clear();
+    m_ShellIntraAxonalCoefficients.clear();
+    m_GradientShellIndexes.resize(numGradients);
+
+    for (unsigned int i = 0;i < numGradients;++i)
+    {
+        unsigned int shellIndex = 0;
+        while ((shellIndex < m_ShellBValues.size()) && (std::abs(bValues[i] - m_ShellBValues[shellIndex]) >= 1.0e-6))
+            ++shellIndex;
+
+        m_GradientShellIndexes[i] = shellIndex;
+        if (shellIndex < m_ShellBValues.size())
+            continue;
+
+        m_ShellBValues.push_back(bValues[i]);
+        double x = bValues[i] * dpara;
+        for (unsigned int k = 0;k < numCoefficients;++k)
+        {
+            double sqrtVal = std::sqrt((4.0 * k + 1.0) / (4.0 * M_PI));
+            double kummerVal = anima::GetKummerFunctionValue(-x, k + 0.5, 2.0 * k + 1.5) * std::tgamma(k + 0.5) / std::tgamma(2.0 * k + 1.5);
+            double cVal = std::pow(-x, (double)k) * kummerVal;
+
+            m_ShellIntraAxonalCoefficients.push_back(m_WatsonSHCoefficients[k] * sqrtVal * cVal / 2.0);
+        }
+    }
+
+    for (unsigned int i = 0;i < numGradients;++i)
+    {
+        double innerProd = gradX[i] * compartmentOrientation[0] + gradY[i] * compartmentOrientation[1] + gradZ[i] * compartmentOrientation[2];
+        const double *intraCoefficients = m_ShellIntraAxonalCoefficients.data() + m_GradientShellIndexes[i] * numCoefficients;
+
+        // Even order Legendre polynomials from the three term recurrence
+        double intraAxonalSignal = (numCoefficients > 0) ? intraCoefficients[0] : 0.0;
+        double legendrePrevious = 1.0;
+        double legendreCurrent = innerProd;
+        for (unsigned int k = 1;k < numCoefficients;++k)
+        {
+            double order = 2.0 * k - 1.0;
+            double legendreEven = ((2.0 * order + 1.0) * innerProd * legendreCurrent - order * legendrePrevious) / (order + 1.0);
+            intraAxonalSignal += intraCoefficients[k] * legendreEven;
+
+            order += 1.0;
+            legendreCurrent = ((2.0 * order + 1.0) * innerProd * legendreEven - order * legendreCurrent) / (order + 1.0);
+            legendrePrevious = legendreEven;
+        }
+
+        double extraAxonalSignal = std::exp(-bValues[i] * (appRadialDiff + (appAxialDiff - appRadialDiff) * innerProd * innerProd));
+        attenuations[i] = nuic * intraAxonalSignal + nuec * extraAxonalSignal;
+    }
+}
+
 NODDICompartment::ListType &NODDICompartment::GetSignalAttenuationJacobian(double smallDelta, double bigDelta, double gradientStrength, const Vector3DType &gradient)
 {
     itkExceptionMacro("As of now, derivative is not functional for NODDI, please use bobyqa optimizer");
@@ -29,6 +29,7 @@ public:
 
     virtual double GetFourierTransformedDiffusionProfile(double smallDelta, double bigDelta, double gradientStrength, const Vector3DType &gradient) ITK_OVERRIDE;
     virtual ListType &GetSignalAttenuationJacobian(double smallDelta, double bigDelta, double gradientStrength, const Vector3DType &gradient) ITK_OVERRIDE;
+    virtual void GetFourierTransformedDiffusionProfiles(const GradientTableType &gradientTable, double *attenuations) ITK_OVERRIDE;
     virtual double GetLogDiffusionProfile(const Vector3DType &sample) ITK_OVERRIDE;
 
     virtual void SetParametersFromVector(const ListType &params) ITK_OVERRIDE;
@@ -112,6 +113,10 @@ private:
     double m_Tau1, m_Tau1Deriv;
     double m_ExtraAxonalSignal, m_IntraAxonalSignal;
     double m_IntraAngleDerivative, m_IntraKappaDerivative, m_IntraAxialDerivative;
+
+    // Per shell work variables for batched signal predictions
+    std::vector <double> m_ShellBValues, m_ShellIntraAxonalCoefficients;
+    std::vector <unsigned int> m_GradientShellIndexes;
 };
 
 } //end namespace anima
@@ -69,6 +69,100 @@ TensorCompartment::ListType &TensorCompartment::GetSignalAttenuationJacobian(dou
     return m_JacobianVector;
 }
 
+void TensorCompartment::GetFourierTransformedDiffusionProfiles(const GradientTableType &gradientTable, double *attenuations)
+{
+    this->UpdateDiffusionTensor();
+
+    unsigned int numGradients = gradientTable.GetNumberOfGradients();
+    const double *bValues = gradientTable.BValues.data();
+    const double *gradX = gradientTable.Directions[0].data();
+    const double *gradY = gradientTable.Directions[1].data();
+    const double *gradZ = gradientTable.Directions[2].data();
+
+    double dxx = m_DiffusionTensor(0,0);
+    double dyy = m_DiffusionTensor(1,1);
+    double dzz = m_DiffusionTensor(2,2);
+    double dxy = 2.0 * m_DiffusionTensor(0,1);
+    double dxz = 2.0 * m_DiffusionTensor(0,2);
+    double dyz = 2.0 * m_DiffusionTensor(1,2);
+
+    for (unsigned int i = 0;i < numGradients;++i)
+    {
+        double quadForm = dxx * gradX[i] * gradX[i] + dyy * gradY[i] * gradY[i] + dzz * gradZ[i] * gradZ[i]
+                + dxy * gradX[i] * gradY[i] + dxz * gradX[i] * gradZ[i] + dyz * gradY[i] * gradZ[i];
+
+        attenuations[i] = std::exp(- bValues[i] * quadForm);
+    }
+}
+
+void TensorCompartment::GetSignalAttenuationJacobians(const GradientTableType &gradientTable, vnl_matrix <double> &jacobians)
+{
+    this->UpdateDiffusionTensor();
+
+    unsigned int numGradients = gradientTable.GetNumberOfGradients();
+    jacobians.set_size(this->GetNumberOfParameters(),numGradients);
+
+    const double *bValues = gradientTable.BValues.data();
+    const double *gradX = gradientTable.Directions[0].data();
+    const double *gradY = gradientTable.Directions[1].data();
+    const double *gradZ = gradientTable.Directions[2].data();
+
+    double dxx = m_DiffusionTensor(0,0);
+    double dyy = m_DiffusionTensor(1,1);
+    double dzz = m_DiffusionTensor(2,2);
+    double dxy = 2.0 * m_DiffusionTensor(0,1);
+    double dxz = 2.0 * m_DiffusionTensor(0,2);
+    double dyz = 2.0 * m_DiffusionTensor(1,2);
+
+    // Coefficients of the alpha and phi derivatives of g^T e2, linear in the gradient
+    double e2PhiX = m_CosTheta * m_SinPhi * m_SinAlpha - m_CosPhi * m_CosAlpha;
+    double e2PhiY = - (m_SinPhi * m_CosAlpha + m_CosTheta * m_CosPhi * m_SinAlpha);
+    double e2AlphaX = m_SinPhi * m_SinAlpha - m_CosTheta * m_CosPhi * m_CosAlpha;
+    double e2AlphaY = - (m_CosPhi * m_SinAlpha + m_CosTheta * m_SinPhi * m_CosAlpha);
+    double e2AlphaZ = m_SinTheta * m_CosAlpha;
+
+    double diffAxialRadial2 = this->GetAxialDiffusivity() - this->GetRadialDiffusivity2();
+    double diffRadialDiffusivities = this->GetRadialDiffusivity1() - this->GetRadialDiffusivity2();
+
+    double *thetaDerivatives = jacobians[0];
+    double *phiDerivatives = jacobians[1];
+    double *alphaDerivatives = jacobians[2];
+    bool estimateDiffusivities = m_EstimateDiffusivities;
+    double *axialDerivatives = estimateDiffusivities ? jacobians[3] : ITK_NULLPTR;
+    double *radialDerivatives1 = estimateDiffusivities ? jacobians[4] : ITK_NULLPTR;
+    double *radialDerivatives2 = estimateDiffusivities ? jacobians[5] : ITK_NULLPTR;
+
+    for (unsigned int i = 0;i < numGradients;++i)
+    {
+        double quadForm = dxx * gradX[i] * gradX[i] + dyy * gradY[i] * gradY[i] + dzz * gradZ[i] * gradZ[i]
+                + dxy * gradX[i] * gradY[i] + dxz * gradX[i] * gradZ[i] + dyz * gradY[i] * gradZ[i];
+        double signalAttenuation = std::exp(- bValues[i] * quadForm);
+
+        double innerProd1 = gradX[i] * m_EigenVector1[0] + gradY[i] * m_EigenVector1[1] + gradZ[i] * m_EigenVector1[2];
+        double innerProd2 = gradX[i] * m_EigenVector2[0] + gradY[i] * m_EigenVector2[1] + gradZ[i] * m_EigenVector2[2];
+
+        double DgTe1DTheta = m_CosTheta * (gradX[i] * m_CosPhi + gradY[i] * m_SinPhi) - gradZ[i] * m_SinTheta;
+        double DgTe1DPhi = m_SinTheta * (gradY[i] * m_CosPhi - gradX[i] * m_SinPhi);
+
+        double DgTe2DTheta = m_SinAlpha * innerProd1;
+        double DgTe2DPhi = gradX[i] * e2PhiX + gradY[i] * e2PhiY;
+        double DgTe2DAlpha = gradX[i] * e2AlphaX + gradY[i] * e2AlphaY + gradZ[i] * e2AlphaZ;
+
+        double factor = -2.0 * bValues[i] * signalAttenuation;
+        thetaDerivatives[i] = factor * (diffAxialRadial2 * innerProd1 * DgTe1DTheta + diffRadialDiffusivities * innerProd2 * DgTe2DTheta);
+        phiDerivatives[i] = factor * (diffAxialRadial2 * innerProd1 * DgTe1DPhi + diffRadialDiffusivities * innerProd2 * DgTe2DPhi);
+        alphaDerivatives[i] = factor * diffRadialDiffusivities * innerProd2 * DgTe2DAlpha;
+
+        if (estimateDiffusivities)
+        {
+            double bAttenuation = bValues[i] * signalAttenuation;
+            axialDerivatives[i] = - bAttenuation * innerProd1 * innerProd1;
+            radialDerivatives1[i] = - bAttenuation * (innerProd1 * innerProd1 + innerProd2 * innerProd2);
+            radialDerivatives2[i] = - bAttenuation;
+        }
+    }
+}
+
 double TensorCompartment::GetLogDiffusionProfile(const Vector3DType &sample)
 {
     this->UpdateInverseDiffusionTensor();
@@ -50,6 +50,71 @@ ZeppelinCompartment::ListType &ZeppelinCompartment::GetSignalAttenuationJacobian
     return m_JacobianVector;
 }
 
+void ZeppelinCompartment::GetFourierTransformedDiffusionProfiles(const GradientTableType &gradientTable, double *attenuations)
+{
+    unsigned int numGradients = gradientTable.GetNumberOfGradients();
+    const double *bValues = gradientTable.BValues.data();
+    const double *gradX = gradientTable.Directions[0].data();
+    const double *gradY = gradientTable.Directions[1].data();
+    const double *gradZ = gradientTable.Directions[2].data();
+
+    double sinTheta = std::sin(this->GetOrientationTheta());
+    double orientationX = sinTheta * std::cos(this->GetOrientationPhi());
+    double orientationY = sinTheta * std::sin(this->GetOrientationPhi());
+    double orientationZ = std::cos(this->GetOrientationTheta());
+
+    double radialDiff = this->GetRadialDiffusivity1();
+    double diffAxialRadial = this->GetAxialDiffusivity() - radialDiff;
+
+    for (unsigned int i = 0;i < numGradients;++i)
+    {
+        double innerProd = gradX[i] * orientationX + gradY[i] * orientationY + gradZ[i] * orientationZ;
+        attenuations[i] = std::exp(- bValues[i] * (radialDiff + diffAxialRadial * innerProd * innerProd));
+    }
+}
+
+void ZeppelinCompartment::GetSignalAttenuationJacobians(const GradientTableType &gradientTable, vnl_matrix <double> &jacobians)
+{
+    unsigned int numGradients = gradientTable.GetNumberOfGradients();
+    jacobians.set_size(this->GetNumberOfParameters(),numGradients);
+
+    const double *bValues = gradientTable.BValues.data();
+    const double *gradX = gradientTable.Directions[0].data();
+    const double *gradY = gradientTable.Directions[1].data();
+    const double *gradZ = gradientTable.Directions[2].data();
+
+    double sinTheta = std::sin(this->GetOrientationTheta());
+    double cosTheta = std::cos(this->GetOrientationTheta());
+    double sinPhi = std::sin(this->GetOrientationPhi());
+    double cosPhi = std::cos(this->GetOrientationPhi());
+
+    double radialDiff = this->GetRadialDiffusivity1();
+    double diffAxialRadial = this->GetAxialDiffusivity() - radialDiff;
+
+    double *thetaDerivatives = jacobians[0];
+    double *phiDerivatives = jacobians[1];
+    bool estimateDiffusivities = m_EstimateDiffusivities;
+    double *axialDerivatives = estimateDiffusivities ? jacobians[2] : ITK_NULLPTR;
+    double *radialDerivatives = estimateDiffusivities ? jacobians[3] : ITK_NULLPTR;
+
+    for (unsigned int i = 0;i < numGradients;++i)
+    {
+        double innerProd = sinTheta * (gradX[i] * cosPhi + gradY[i] * sinPhi) + gradZ[i] * cosTheta;
+        double signalAttenuation = std::exp(- bValues[i] * (radialDiff + diffAxialRadial * innerProd * innerProd));
+        double angleFactor = -2.0 * bValues[i] * diffAxialRadial * innerProd * signalAttenuation;
+
+        thetaDerivatives[i] = angleFactor * (cosTheta * (gradX[i] * cosPhi + gradY[i] * sinPhi) - gradZ[i] * sinTheta);
+        phiDerivatives[i] = angleFactor * sinTheta * (gradY[i] * cosPhi - gradX[i] * sinPhi);
+
+        if (estimateDiffusivities)
+        {
+            // Derivatives w.r.t. to d1 and d3
+            axialDerivatives[i] = - bValues[i] * innerProd * innerProd * signalAttenuation;
+            radialDerivatives[i] = - bValues[i] * signalAttenuation;
+        }
+    }
+}
+
 double ZeppelinCompartment::GetLogDiffusionProfile(const Vector3DType &sample)
 {
     Vector3DType compartmentOrientation(0.0);
@@ -37,6 +37,7 @@ int main(int argc,  char **argv)
 
     // Optional arguments
     TCLAP::ValueArg<std::string> computationMaskArg("m", "mask", "Computation mask", false, "", "computation mask", cmd);
+    TCLAP::SwitchArg int16StorageArg("", "int16", "Store DWI signals in memory as 16 bits integers (integer valued signals only)", cmd, false);
     TCLAP::ValueArg<double> b0thrArg("", "b0-thr", "Background threshold on B0 value (default: 10)", false, 10.0, "B0 theshold", cmd);
 
     TCLAP::ValueArg<unsigned int> nbFasciclesArg("n", "nb-fascicles", "Number of computed fascicles (default: 2)", false, 2, "number of fascicles", cmd);
@@ -75,6 +76,9 @@ int main(int argc,  char **argv)
     TCLAP::ValueArg<double> xTolArg("x", "x-tol", "Tolerance for relative position in optimization (default: 0 -> 1.0e-4 or 1.0e-7 for bobyqa)", false, 0, "position relative tolerance", cmd);
     TCLAP::ValueArg<double> fTolArg("", "f-tol", "Tolerance for relative cost in optimization (default: 0 -> function of position tolerance)", false, 0, "cost relative tolerance", cmd);
     TCLAP::ValueArg<unsigned int> maxEvalArg("e", "max-eval", "Maximum evaluations (default: 0 -> function of number of unknowns)", false, 0, "max evaluations", cmd);
+    TCLAP::SwitchArg warmStartArg("", "warm-start", "Estimate voxels along a space filling curve, warm starting them from already estimated neighbours", cmd, false);
+    TCLAP::ValueArg<double> warmStartRatioArg("", "warm-start-ratio", "Maximal ratio between relative residuals of a warm started voxel and of its neighbour before full initialization (default: 1.2)", false, 1.2, "warm start residual ratio", cmd);
+    TCLAP::SwitchArg noThreadWorkspacesArg("", "no-thread-workspaces", "Create models, costs and optimizers for each voxel instead of reusing them in each thread", cmd, false);
 
     TCLAP::ValueArg<unsigned int> nbThreadsArg("T", "nb-threads", "Number of threads to run on (default: all cores)", false, itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(), "number of threads", cmd);
 
@@ -112,7 +116,22 @@ int main(int argc,  char **argv)
 
     std::cout << "Loading input DWI image..." << std::endl;
 
-    anima::setMultipleImageFilterInputsFromFileName<InputImageType,FilterType>(dwiArg.getValue(), filter);
+    // Voxel major loading of the DWI, restricted to the computation mask
+    FilterType::DWIDataType dwiData;
+    if (int16StorageArg.isSet())
+        dwiData.SetStorageType(FilterType::DWIDataType::Int16);
+
+    MaskImageType::Pointer maskImage;
+    if (computationMaskArg.getValue() != "")
+    {
+        maskImage = anima::readImage<MaskImageType>(computationMaskArg.getValue());
+        dwiData.SetComputationMask(maskImage);
+    }
+
+    dwiData.Read(dwiArg.getValue());
+
+    filter->SetInput(0,dwiData.CreateGeometryImage<InputImageType>());
+    filter->SetDWIData(&dwiData);
 
     // Load gradient table and b-value list
     std::cout << "Importing gradient table and b-values..." << std::endl;
@@ -136,8 +155,8 @@ int main(int argc,  char **argv)
     filter->SetSmallDelta(smallDeltaArg.getValue());
     filter->SetBigDelta(bigDeltaArg.getValue());
 
-    if (computationMaskArg.getValue() != "")
-        filter->SetComputationMask(anima::readImage<MaskImageType>(computationMaskArg.getValue()));
+    if (maskImage)
+        filter->SetComputationMask(maskImage);
 
     if (inMoseArg.getValue() != "")
         filter->SetMoseVolume(anima::readImage<FilterType::MoseImageType>(inMoseArg.getValue()));
@@ -202,6 +221,9 @@ int main(int argc,  char **argv)
     else
         filter->SetUseCommonDiffusivities(false);
 
+    filter->SetUseThreadWorkspaces(!noThreadWorkspacesArg.isSet());
+    filter->SetUseSpatiallyOrderedEstimation(warmStartArg.isSet());
+    filter->SetWarmStartResidualRatio(warmStartRatioArg.getValue());
     filter->SetNumberOfWorkUnits(nbThreadsArg.getValue());
     filter->AddObserver(itk::ProgressEvent(), callback);
 
@@ -221,6 +243,7 @@ int main(int argc,  char **argv)
     tmpTimer.Stop();
 
     std::cout << "\nEstimation done in " << tmpTimer.GetTotal() << " s" << std::endl;
+    filter->PrintEstimationStatistics(std::cout);
     std::cout << "Writing MCM to: " << outArg.getValue() << std::endl;
 
     try
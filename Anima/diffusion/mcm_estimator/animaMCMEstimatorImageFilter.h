@@ -1,8 +1,10 @@
 #pragma once
 #include <cmath>
 #include <random>
+#include <map>
 
 #include <animaMaskedImageToImageFilter.h>
+#include <animaVoxelMajorDWIData.h>
 #include <animaMCMImage.h>
 #include <itkImage.h>
 #include <itkSingleValuedCostFunction.h>
@@ -10,6 +12,7 @@
 #include <animaMultiCompartmentModelCreator.h>
 #include <itkCostFunction.h>
 #include <itkNonLinearOptimizer.h>
+#include <itkTimeProbe.h>
 
 #include <animaHyperbolicFunctions.h>
 #include <animaMCMConstants.h>
@@ -67,6 +70,31 @@ public:
         VariableProjection
     };
 
+    //! Successive estimation stages of a voxel, each with its own model structure
+    enum EstimationStage
+    {
+        FreeWaterStage = 0,
+        InitialSticksStage,
+        SticksStage,
+        ZeppelinsStage,
+        FinalModelStage,
+        NumberOfEstimationStages
+    };
+
+    //! Per phase profiling information, times are in seconds and summed over threads
+    struct EstimationStatistics
+    {
+        unsigned long NumberOfEstimatedVoxels;
+        double SparseInitializationTime;
+        double CoarseGridInitializationTime;
+        double OptimizationTimes[NumberOfEstimationStages];
+        unsigned long NumberOfOptimizations[NumberOfEstimationStages];
+        //! Optimizer iterations (cost evaluations for NLOPT optimizers)
+        unsigned long NumberOfIterations[NumberOfEstimationStages];
+        unsigned long NumberOfWarmStarts;
+        unsigned long NumberOfWarmStartFallbacks;
+    };
+
     /** Method for creation through the object factory. */
     itkNewMacro(Self)
 
@@ -86,6 +114,13 @@ public:
     typedef typename Superclass::OutputImageRegionType OutputImageRegionType;
 
     typedef vnl_vector_fixed <double,3> GradientType;
+    typedef anima::VoxelMajorDWIData DWIDataType;
+
+    /**
+     * Reads diffusion signals from a voxel major container instead of the indexed inputs. Input 0 then only provides
+     * the geometry (see VoxelMajorDWIData::CreateGeometryImage)
+     */
+    void SetDWIData(DWIDataType *data) {m_DWIData = data;}
 
     // Acquisition-related parameters
     void SetGradientStrengths(std::vector <double> &mb) {m_GradientStrengths = mb;}
@@ -159,6 +194,28 @@ public:
     itkSetMacro(FTolerance, double)
     itkSetMacro(MaxEval, unsigned int)
 
+    //! Reuse per thread models, cost functions and optimizers across voxels instead of creating them for each voxel
+    itkSetMacro(UseThreadWorkspaces, bool)
+    itkGetMacro(UseThreadWorkspaces, bool)
+
+    /**
+     * Estimate voxels of each thread region in Morton (Z-order) curve order and seed the final model
+     * of each voxel from already estimated neighbours with the same number of compartments,
+     * skipping sparse and coarse grid initializations
+     */
+    itkSetMacro(UseSpatiallyOrderedEstimation, bool)
+    itkGetMacro(UseSpatiallyOrderedEstimation, bool)
+
+    /**
+     * Maximal ratio between the relative residual (sigma / B0) of a warm started voxel and that of its seed
+     * neighbour. Above it, the voxel is estimated again with the full initialization
+     */
+    itkSetMacro(WarmStartResidualRatio, double)
+    itkGetMacro(WarmStartResidualRatio, double)
+
+    const EstimationStatistics &GetEstimationStatistics() const {return m_EstimationStatistics;}
+    void PrintEstimationStatistics(std::ostream &os) const;
+
 protected:
     MCMEstimatorImageFilter() : Superclass()
     {
@@ -166,6 +223,7 @@ protected:
         m_B0Volume = 0;
         m_SigmaSquareVolume = 0;
         m_MoseVolume = 0;
+        m_DWIData = 0;
 
         m_GradientStrengths.clear();
         m_GradientDirections.clear();
@@ -215,6 +273,11 @@ protected:
 
         m_SmallDelta = anima::DiffusionSmallDelta;
         m_BigDelta = anima::DiffusionBigDelta;
+
+        m_UseThreadWorkspaces = true;
+        m_UseSpatiallyOrderedEstimation = false;
+        m_WarmStartResidualRatio = 1.2;
+        this->ResetEstimationStatistics();
     }
 
     virtual ~MCMEstimatorImageFilter()
@@ -229,6 +292,28 @@ protected:
     void GenerateOutputInformation() ITK_OVERRIDE;
     virtual void BeforeThreadedGenerateData() ITK_OVERRIDE;
     void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
+    virtual void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+    //! Objects used to estimate one stage of a voxel model, persistent across voxels when thread workspaces are used
+    struct StageWorkspace
+    {
+        MCMPointer Model;
+        //! Model as created by the MCM creator, used to reset Model before each voxel
+        MCMPointer ReferenceModel;
+        CostFunctionBasePointer Cost;
+        OptimizerPointer Optimizer;
+        EstimationStage Stage;
+    };
+
+    /**
+     * Gets the model, cost function and optimizer for a stage and number of anisotropic compartments,
+     * with observed signals set. The thread MCM creator has to be configured for this stage beforehand.
+     * Objects are created on first use and reset afterwards (or always created if thread workspaces are not used).
+     * Workspaces are keyed by stage and by the number of compartments requested in the current model selection
+     * step, so that the best model kept during model selection is never overwritten by a later step
+     */
+    StageWorkspace &GetStageWorkspace(EstimationStage stage, unsigned int numberOfCompartments,
+                                      std::vector <double> &observedSignals, itk::ThreadIdType threadId);
 
     //! Create a cost function following the noise type and estimation mode
     virtual CostFunctionBasePointer CreateCostFunction(std::vector<double> &observedSignals, MCMPointer &mcmModel);
@@ -245,6 +330,18 @@ protected:
                                           std::vector <double> &observedSignals, itk::ThreadIdType threadId,
                                           double &aiccValue, double &b0Value, double &sigmaSqValue);
 
+    /**
+     * Estimates the final model of a voxel starting from the estimate of its best already estimated neighbour
+     * with the same number of compartments. Returns false if there is no such neighbour or if the relative
+     * residual of the result is above the warm start residual ratio times that of the neighbour
+     */
+    bool WarmStartModelEstimation(MCMPointer &mcmValue, unsigned int currentNumberOfCompartments,
+                                  std::vector <double> &observedSignals, itk::ThreadIdType threadId,
+                                  double &aiccValue, double &b0Value, double &sigmaSqValue);
+
+    //! Computes the Morton curve order of the indexes of a region
+    void ComputeSpatialEstimationOrder(const OutputImageRegionType &region, std::vector <typename OutputImageType::IndexType> &orderedIndexes);
+
     //! Doing estimation only of multiple orientations
     void InitialOrientationsEstimation(MCMPointer &mcmValue, bool authorizedNegativeB0Value, unsigned int currentNumberOfCompartments,
                                        std::vector <double> &observedSignals, itk::ThreadIdType threadId,
@@ -254,9 +351,9 @@ protected:
     void ModelEstimation(MCMPointer &mcmValue, bool authorizedNegativeB0Value, std::vector <double> &observedSignals,
                          itk::ThreadIdType threadId, double &aiccValue, double &b0Value, double &sigmaSqValue);
     
-    //! Performs an optimization of the supplied cost function and parameters using the specified optimizer(s). Returns the optimized parameters.
-    double PerformSingleOptimization(ParametersType &p, CostFunctionBasePointer &cost, itk::Array<double> &lowerBounds,
-                                     itk::Array<double> &upperBounds);
+    //! Performs an optimization of the workspace cost function and parameters using the specified optimizer(s). Returns the optimized parameters.
+    double PerformSingleOptimization(ParametersType &p, StageWorkspace &workspace, itk::Array<double> &lowerBounds,
+                                     itk::Array<double> &upperBounds, itk::ThreadIdType threadId);
 
     //! Performs initialization from single DTI
     virtual void SparseInitializeSticks(MCMPointer &complexModel, bool authorizeNegativeB0Value,
@@ -294,6 +391,30 @@ private:
     //! Utility function to initialize dictionary of sticks for initial sparse estimation
     void InitializeDictionary();
 
+    void ResetEstimationStatistics();
+
+    //! Per thread stage workspaces and profiling probes
+    struct ThreadWorkspace
+    {
+        std::map <unsigned int, StageWorkspace> StageWorkspaces;
+        itk::TimeProbe SparseInitializationProbe;
+        itk::TimeProbe CoarseGridInitializationProbe;
+        itk::TimeProbe OptimizationProbes[NumberOfEstimationStages];
+        unsigned long NumberOfEstimatedVoxels;
+
+        //! Number of anisotropic compartments requested in the current model selection step
+        unsigned int RequestedNumberOfCompartments;
+
+        unsigned long NumberOfIterations[NumberOfEstimationStages];
+        unsigned long NumberOfWarmStarts;
+        unsigned long NumberOfWarmStartFallbacks;
+
+        //! Already estimated neighbours of the current voxel, candidate seeds for warm starts
+        std::vector <typename OutputImageType::IndexType> EstimatedNeighbours;
+        //! Model with the output structure, used to read neighbour estimates
+        MCMPointer OutputModel;
+    };
+
     double m_SmallDelta, m_BigDelta;
     std::vector <double> m_GradientStrengths;
     std::vector< GradientType > m_GradientDirections;
@@ -314,6 +435,7 @@ private:
 
     double m_B0Threshold;
     unsigned int m_NumberOfImages;
+    DWIDataType *m_DWIData;
 
     double m_AbsoluteCostChange;
     MaximumLikelihoodEstimationMode m_MLEstimationStrategy;
@@ -353,6 +475,12 @@ private:
 
     //! Coarse grid values for complex model initialization
     std::vector < std::vector <double> > m_ValuesCoarseGrid;
+
+    bool m_UseThreadWorkspaces;
+    bool m_UseSpatiallyOrderedEstimation;
+    double m_WarmStartResidualRatio;
+    std::vector <ThreadWorkspace> m_ThreadWorkspaces;
+    EstimationStatistics m_EstimationStatistics;
 };
 
 } // end namespace anima
@@ -4,8 +4,11 @@
 
 #include <itkImageRegionIterator.h>
 #include <itkImageRegionConstIterator.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
 #include <itkSymmetricEigenAnalysis.h>
 
+#include <algorithm>
+
 #include <animaNLOPTOptimizers.h>
 #include <animaBoundedLevenbergMarquardtOptimizer.h>
 #include <animaNNLSOptimizer.h>
@@ -112,13 +115,26 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
         bValueFirstB0Index = anima::GetBValueFromAcquisitionParameters(m_SmallDelta, m_BigDelta, m_GradientStrengths[firstB0Index]);
     }
 
-    B0IteratorType b0Itr(this->GetInput(firstB0Index),this->GetOutput()->GetLargestPossibleRegion());
-
     if (!this->GetComputationMask())
         this->Superclass::CheckComputationMask();
 
     MaskIteratorType maskItr(this->GetComputationMask(),this->GetOutput()->GetLargestPossibleRegion());
 
+    if (m_DWIData)
+    {
+        for (size_t i = 0;!maskItr.IsAtEnd();++i)
+        {
+            if ((maskItr.Get() != 0)&&(m_DWIData->GetVoxelSignal(i,firstB0Index) <= m_B0Threshold))
+                maskItr.Set(0);
+
+            ++maskItr;
+        }
+
+        return;
+    }
+
+    B0IteratorType b0Itr(this->GetInput(firstB0Index),this->GetOutput()->GetLargestPossibleRegion());
+
     while (!b0Itr.IsAtEnd())
     {
         if ((maskItr.Get() != 0)&&(b0Itr.Get() <= m_B0Threshold))
@@ -144,6 +160,8 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
         itkExceptionMacro("NCC noise is only compatible with profile estimation strategy");
 
     m_NumberOfImages = this->GetNumberOfIndexedInputs();
+    if (m_DWIData)
+        m_NumberOfImages = m_DWIData->GetNumberOfVolumes();
 
     if (m_GradientStrengths.size() != m_NumberOfImages)
         itkExceptionMacro("There should be the same number of input images and input b-values...");
@@ -211,6 +229,23 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     for (unsigned int i = 0;i < this->GetNumberOfWorkUnits();++i)
         m_MCMCreators[i] = this->GetNewMCMCreatorInstance();
 
+    m_ThreadWorkspaces.clear();
+    m_ThreadWorkspaces.resize(this->GetNumberOfWorkUnits());
+    for (unsigned int i = 0;i < this->GetNumberOfWorkUnits();++i)
+    {
+        m_ThreadWorkspaces[i].NumberOfEstimatedVoxels = 0;
+        m_ThreadWorkspaces[i].RequestedNumberOfCompartments = 0;
+        m_ThreadWorkspaces[i].NumberOfWarmStarts = 0;
+        m_ThreadWorkspaces[i].NumberOfWarmStartFallbacks = 0;
+        for (unsigned int j = 0;j < NumberOfEstimationStages;++j)
+            m_ThreadWorkspaces[i].NumberOfIterations[j] = 0;
+
+        if (m_UseSpatiallyOrderedEstimation)
+            m_ThreadWorkspaces[i].OutputModel = this->GetOutput()->GetDescriptionModel()->Clone();
+    }
+
+    this->ResetEstimationStatistics();
+
     std::cout << "Initial diffusivities:" << std::endl;
     std::cout << " - Axial diffusivity: " << m_AxialDiffusivityValue << " mm2/s," << std::endl;
     std::cout << " - Radial diffusivity 1: " << m_RadialDiffusivity1Value << " mm2/s," << std::endl;
@@ -254,6 +289,148 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     this->InitializeDictionary();
 }
 
+template <class InputPixelType, class OutputPixelType>
+void
+MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
+::AfterThreadedGenerateData()
+{
+    this->ResetEstimationStatistics();
+
+    for (unsigned int i = 0;i < m_ThreadWorkspaces.size();++i)
+    {
+        ThreadWorkspace &workspace = m_ThreadWorkspaces[i];
+        m_EstimationStatistics.NumberOfEstimatedVoxels += workspace.NumberOfEstimatedVoxels;
+        m_EstimationStatistics.NumberOfWarmStarts += workspace.NumberOfWarmStarts;
+        m_EstimationStatistics.NumberOfWarmStartFallbacks += workspace.NumberOfWarmStartFallbacks;
+        m_EstimationStatistics.SparseInitializationTime += workspace.SparseInitializationProbe.GetTotal();
+        m_EstimationStatistics.CoarseGridInitializationTime += workspace.CoarseGridInitializationProbe.GetTotal();
+
+        for (unsigned int j = 0;j < NumberOfEstimationStages;++j)
+        {
+            m_EstimationStatistics.OptimizationTimes[j] += workspace.OptimizationProbes[j].GetTotal();
+            m_EstimationStatistics.NumberOfOptimizations[j] += workspace.OptimizationProbes[j].GetNumberOfStops();
+            m_EstimationStatistics.NumberOfIterations[j] += workspace.NumberOfIterations[j];
+        }
+    }
+
+    // Release persistent models, costs and optimizers
+    m_ThreadWorkspaces.clear();
+
+    Superclass::AfterThreadedGenerateData();
+}
+
+template <class InputPixelType, class OutputPixelType>
+void
+MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
+::ResetEstimationStatistics()
+{
+    m_EstimationStatistics.NumberOfEstimatedVoxels = 0;
+    m_EstimationStatistics.SparseInitializationTime = 0;
+    m_EstimationStatistics.CoarseGridInitializationTime = 0;
+    m_EstimationStatistics.NumberOfWarmStarts = 0;
+    m_EstimationStatistics.NumberOfWarmStartFallbacks = 0;
+
+    for (unsigned int i = 0;i < NumberOfEstimationStages;++i)
+    {
+        m_EstimationStatistics.OptimizationTimes[i] = 0;
+        m_EstimationStatistics.NumberOfOptimizations[i] = 0;
+        m_EstimationStatistics.NumberOfIterations[i] = 0;
+    }
+}
+
+template <class InputPixelType, class OutputPixelType>
+void
+MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
+::PrintEstimationStatistics(std::ostream &os) const
+{
+    const char *stageNames[NumberOfEstimationStages] = {"free water", "initial sticks", "sticks", "zeppelins", "final model"};
+    unsigned long numVoxels = std::max(m_EstimationStatistics.NumberOfEstimatedVoxels, 1ul);
+
+    os << "Estimation statistics (times summed over threads, per voxel times in ms):" << std::endl;
+    os << " - Estimated voxels: " << m_EstimationStatistics.NumberOfEstimatedVoxels << std::endl;
+    os << " - Sparse sticks initialization: " << m_EstimationStatistics.SparseInitializationTime << " s ("
+       << 1000.0 * m_EstimationStatistics.SparseInitializationTime / numVoxels << " ms/voxel)" << std::endl;
+    os << " - Coarse grid initialization: " << m_EstimationStatistics.CoarseGridInitializationTime << " s ("
+       << 1000.0 * m_EstimationStatistics.CoarseGridInitializationTime / numVoxels << " ms/voxel)" << std::endl;
+
+    unsigned long totalIterations = 0;
+    for (unsigned int i = 0;i < NumberOfEstimationStages;++i)
+    {
+        if (m_EstimationStatistics.NumberOfOptimizations[i] == 0)
+            continue;
+
+        os << " - Optimization of " << stageNames[i] << ": " << m_EstimationStatistics.OptimizationTimes[i] << " s ("
+           << 1000.0 * m_EstimationStatistics.OptimizationTimes[i] / numVoxels << " ms/voxel, "
+           << m_EstimationStatistics.NumberOfOptimizations[i] << " optimizations, "
+           << (double)m_EstimationStatistics.NumberOfIterations[i] / numVoxels << " iterations/voxel)" << std::endl;
+
+        totalIterations += m_EstimationStatistics.NumberOfIterations[i];
+    }
+
+    os << " - Optimizer iterations: " << totalIterations << " (" << (double)totalIterations / numVoxels << " per voxel)" << std::endl;
+
+    if (m_UseSpatiallyOrderedEstimation)
+    {
+        os << " - Warm started estimations: " << m_EstimationStatistics.NumberOfWarmStarts
+           << ", fallbacks to full initialization: " << m_EstimationStatistics.NumberOfWarmStartFallbacks << std::endl;
+    }
+}
+
+template <class InputPixelType, class OutputPixelType>
+typename MCMEstimatorImageFilter<InputPixelType, OutputPixelType>::StageWorkspace &
+MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
+::GetStageWorkspace(EstimationStage stage, unsigned int numberOfCompartments,
+                    std::vector <double> &observedSignals, itk::ThreadIdType threadId)
+{
+    unsigned int workspaceKey = m_ThreadWorkspaces[threadId].RequestedNumberOfCompartments * NumberOfEstimationStages + stage;
+    StageWorkspace &workspace = m_ThreadWorkspaces[threadId].StageWorkspaces[workspaceKey];
+
+    bool createWorkspace = (!m_UseThreadWorkspaces)||(!workspace.Model);
+    if (!createWorkspace)
+    {
+        // Sparse initialization may have kept less compartments than requested for the previous voxel
+        unsigned int numAnisotropicCompartments = workspace.Model->GetNumberOfCompartments() - workspace.Model->GetNumberOfIsotropicCompartments();
+        createWorkspace = (numAnisotropicCompartments != numberOfCompartments);
+    }
+
+    if (createWorkspace)
+    {
+        MCMCreatorType *mcmCreator = m_MCMCreators[threadId];
+
+        workspace.Stage = stage;
+        workspace.Model = mcmCreator->GetNewMultiCompartmentModel();
+        if (m_UseThreadWorkspaces)
+            workspace.ReferenceModel = mcmCreator->GetNewMultiCompartmentModel();
+        workspace.Cost = this->CreateCostFunction(observedSignals,workspace.Model);
+        workspace.Optimizer = ITK_NULLPTR;
+
+        return workspace;
+    }
+
+    // Reset model to its creation state, previous voxel estimates would otherwise leak into initializations
+    unsigned int numCompartments = workspace.Model->GetNumberOfCompartments();
+    for (unsigned int i = 0;i < numCompartments;++i)
+        workspace.Model->GetCompartment(i)->CopyFromOther(workspace.ReferenceModel->GetCompartment(i));
+
+    workspace.Model->SetCompartmentWeights(workspace.ReferenceModel->GetCompartmentWeights());
+    workspace.Model->SetNegativeWeightBounds(false);
+
+    if (m_Optimizer == "levenberg")
+    {
+        anima::MCMMultipleValuedCostFunction *costCast =
+                dynamic_cast <anima::MCMMultipleValuedCostFunction *> (workspace.Cost.GetPointer());
+        costCast->GetInternalCost()->SetObservedSignals(observedSignals);
+    }
+    else
+    {
+        anima::MCMSingleValuedCostFunction *costCast =
+                dynamic_cast <anima::MCMSingleValuedCostFunction *> (workspace.Cost.GetPointer());
+        costCast->GetInternalCost()->SetObservedSignals(observedSignals);
+    }
+
+    return workspace;
+}
+
 template <class InputPixelType, class OutputPixelType>
 void
 MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
@@ -425,9 +602,12 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
 {
     typedef itk::ImageRegionConstIterator <InputImageType> ConstImageIteratorType;
 
-    std::vector <ConstImageIteratorType> inIterators(m_NumberOfImages);
-    for (unsigned int i = 0;i < m_NumberOfImages;++i)
-        inIterators[i] = ConstImageIteratorType(this->GetInput(i),outputRegionForThread);
+    std::vector <ConstImageIteratorType> inIterators;
+    if (!m_DWIData)
+    {
+        for (unsigned int i = 0;i < m_NumberOfImages;++i)
+            inIterators.push_back(ConstImageIteratorType(this->GetInput(i),outputRegionForThread));
+    }
 
     typedef itk::ImageRegionIterator <OutputImageType> OutImageIteratorType;
     OutImageIteratorType outIterator(this->GetOutput(),outputRegionForThread);
@@ -455,14 +635,73 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
 
     unsigned int threadId = this->GetSafeThreadId();
 
-    while (!outIterator.IsAtEnd())
+    // Spatially ordered estimation: visit voxels along a Morton curve, keeping track of estimated ones
+    typedef typename OutputImageType::IndexType IndexType;
+    std::vector <IndexType> orderedIndexes;
+    typedef itk::Image <unsigned char,3> EstimatedVoxelsImageType;
+    typename EstimatedVoxelsImageType::Pointer estimatedVoxels;
+    std::vector <IndexType> &estimatedNeighbours = m_ThreadWorkspaces[threadId].EstimatedNeighbours;
+    estimatedNeighbours.clear();
+
+    if (m_UseSpatiallyOrderedEstimation)
+    {
+        this->ComputeSpatialEstimationOrder(outputRegionForThread,orderedIndexes);
+
+        estimatedVoxels = EstimatedVoxelsImageType::New();
+        estimatedVoxels->SetRegions(outputRegionForThread);
+        estimatedVoxels->Allocate();
+        estimatedVoxels->FillBuffer(0);
+    }
+
+    unsigned int numRegionVoxels = outputRegionForThread.GetNumberOfPixels();
+    for (unsigned int voxelPosition = 0;voxelPosition < numRegionVoxels;++voxelPosition)
     {
+        if (m_UseSpatiallyOrderedEstimation)
+        {
+            IndexType currentIndex = orderedIndexes[voxelPosition];
+            for (unsigned int i = 0;i < inIterators.size();++i)
+                inIterators[i].SetIndex(currentIndex);
+
+            outIterator.SetIndex(currentIndex);
+            maskItr.SetIndex(currentIndex);
+            aiccIterator.SetIndex(currentIndex);
+            b0Iterator.SetIndex(currentIndex);
+            sigmaIterator.SetIndex(currentIndex);
+            moseIterator.SetIndex(currentIndex);
+
+            // Face neighbours already estimated by this thread are candidate warm start seeds
+            estimatedNeighbours.clear();
+            for (unsigned int i = 0;i < InputImageType::ImageDimension;++i)
+            {
+                for (int shift = -1;shift <= 1;shift += 2)
+                {
+                    IndexType neighbourIndex = currentIndex;
+                    neighbourIndex[i] += shift;
+
+                    if (!outputRegionForThread.IsInside(neighbourIndex))
+                        continue;
+
+                    if (estimatedVoxels->GetPixel(neighbourIndex) != 0)
+                        estimatedNeighbours.push_back(neighbourIndex);
+                }
+            }
+        }
+
         resVec.Fill(0.0);
 
+        // Load DWI
+        if (m_DWIData)
+            m_DWIData->GetVoxelSignals(m_DWIData->GetLinearIndex(maskItr.GetIndex()),&observedSignals[0]);
+        else
+        {
+            for (unsigned int i = 0;i < m_NumberOfImages;++i)
+                observedSignals[i] = inIterators[i].Get();
+        }
+
         bool emptyVoxel = true;
         for (unsigned int i = 0;i < m_NumberOfImages;++i)
         {
-            if (inIterators[i].Get() != 0)
+            if (observedSignals[i] != 0)
             {
                 emptyVoxel = false;
                 break;
@@ -473,7 +712,7 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
         {
             outIterator.Set(resVec);
 
-            for (unsigned int i = 0;i < m_NumberOfImages;++i)
+            for (unsigned int i = 0;i < inIterators.size();++i)
                 ++inIterators[i];
 
             ++outIterator;
@@ -486,10 +725,6 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
             continue;
         }
 
-        // Load DWI
-        for (unsigned int i = 0;i < m_NumberOfImages;++i)
-            observedSignals[i] = inIterators[i].Get();
-
         int moseValue = -1;
         bool estimateNonIsoCompartments = false;
         if (m_ExternalMoseVolume)
@@ -570,9 +805,13 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
         sigmaIterator.Set(sigmaSqValue);
         moseIterator.Set(mcmData->GetNumberOfCompartments() - mcmData->GetNumberOfIsotropicCompartments());
 
-        for (unsigned int i = 0;i < m_NumberOfImages;++i)
+        if (m_UseSpatiallyOrderedEstimation && (b0Value != 0.0))
+            estimatedVoxels->SetPixel(outIterator.GetIndex(),1);
+
+        for (unsigned int i = 0;i < inIterators.size();++i)
             ++inIterators[i];
 
+        ++m_ThreadWorkspaces[threadId].NumberOfEstimatedVoxels;
         this->IncrementNumberOfProcessedPoints();
         ++outIterator;
         ++maskItr;
@@ -596,17 +835,27 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     sigmaSqValue = 1;
     aiccValue = -1;
 
-    this->InitialOrientationsEstimation(mcmValue,false,currentNumberOfCompartments,observedSignals,threadId,
-                                        aiccValue,b0Value,sigmaSqValue);
+    m_ThreadWorkspaces[threadId].RequestedNumberOfCompartments = currentNumberOfCompartments;
 
-    this->ModelEstimation(mcmValue,false,observedSignals,threadId,aiccValue,b0Value,sigmaSqValue);
+    bool warmStarted = false;
+    if (m_UseSpatiallyOrderedEstimation)
+        warmStarted = this->WarmStartModelEstimation(mcmValue,currentNumberOfCompartments,observedSignals,threadId,
+                                                     aiccValue,b0Value,sigmaSqValue);
 
-    if (b0Value == 0.0)
+    if (!warmStarted)
     {
-        this->InitialOrientationsEstimation(mcmValue,true,currentNumberOfCompartments,observedSignals,threadId,
+        this->InitialOrientationsEstimation(mcmValue,false,currentNumberOfCompartments,observedSignals,threadId,
                                             aiccValue,b0Value,sigmaSqValue);
 
-        this->ModelEstimation(mcmValue,true,observedSignals,threadId,aiccValue,b0Value,sigmaSqValue);
+        this->ModelEstimation(mcmValue,false,observedSignals,threadId,aiccValue,b0Value,sigmaSqValue);
+
+        if (b0Value == 0.0)
+        {
+            this->InitialOrientationsEstimation(mcmValue,true,currentNumberOfCompartments,observedSignals,threadId,
+                                                aiccValue,b0Value,sigmaSqValue);
+
+            this->ModelEstimation(mcmValue,true,observedSignals,threadId,aiccValue,b0Value,sigmaSqValue);
+        }
     }
 
     if (b0Value != 0.0)
@@ -639,12 +888,14 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     mcmCreator->SetUseConstrainedStaniszDiffusivity(m_UseConstrainedStaniszDiffusivity);
     mcmCreator->SetUseConstrainedStaniszRadius(m_UseConstrainedStaniszRadius);
 
-    mcmValue = mcmCreator->GetNewMultiCompartmentModel();
+    m_ThreadWorkspaces[threadId].RequestedNumberOfCompartments = 0;
+    StageWorkspace &workspace = this->GetStageWorkspace(FreeWaterStage,0,observedSignals,threadId);
+    mcmValue = workspace.Model;
 
     b0Value = 0;
     sigmaSqValue = 1;
 
-    CostFunctionBasePointer cost = this->CreateCostFunction(observedSignals,mcmValue);
+    CostFunctionBasePointer &cost = workspace.Cost;
 
     unsigned int dimension = mcmValue->GetNumberOfParameters();
     ParametersType p(dimension);
@@ -667,7 +918,7 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
         for (unsigned int i = 0;i < dimension;++i)
             upperBounds[i] = workVec[i];
 
-        costValue = this->PerformSingleOptimization(p,cost,lowerBounds,upperBounds);
+        costValue = this->PerformSingleOptimization(p,workspace,lowerBounds,upperBounds,threadId);
 
         // - Get estimated DTI and B0
         for (unsigned int i = 0;i < dimension;++i)
@@ -699,7 +950,7 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
             for (unsigned int i = 0;i < dimension;++i)
                 p[i] = workVec[i];
 
-            costValue = this->PerformSingleOptimization(p,cost,lowerBounds,upperBounds);
+            costValue = this->PerformSingleOptimization(p,workspace,lowerBounds,upperBounds,threadId);
 
             // - Get estimated DTI and B0
             for (unsigned int i = 0;i < dimension;++i)
@@ -774,6 +1025,169 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>::CreateCostFunction(std
     return returnCost;
 }
 
+template <class InputPixelType, class OutputPixelType>
+void
+MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
+::ComputeSpatialEstimationOrder(const OutputImageRegionType &region, std::vector <typename OutputImageType::IndexType> &orderedIndexes)
+{
+    typedef typename OutputImageType::IndexType IndexType;
+    unsigned int numVoxels = region.GetNumberOfPixels();
+    std::vector <IndexType> regionIndexes(numVoxels);
+    std::vector < std::pair <unsigned long long, unsigned int> > mortonCodes(numVoxels);
+
+    // Interleave bits of region relative coordinates (21 bits per coordinate)
+    const unsigned int numBits = 21;
+    unsigned int pos = 0;
+    itk::ImageRegionConstIteratorWithIndex <OutputImageType> outItr(this->GetOutput(),region);
+    while (!outItr.IsAtEnd())
+    {
+        IndexType index = outItr.GetIndex();
+        unsigned long long code = 0;
+        for (unsigned int i = 0;i < InputImageType::ImageDimension;++i)
+        {
+            unsigned long long coordinate = index[i] - region.GetIndex()[i];
+            for (unsigned int j = 0;j < numBits;++j)
+                code |= ((coordinate >> j) & 1ull) << (InputImageType::ImageDimension * j + i);
+        }
+
+        regionIndexes[pos] = index;
+        mortonCodes[pos] = std::make_pair(code,pos);
+        ++pos;
+        ++outItr;
+    }
+
+    std::sort(mortonCodes.begin(),mortonCodes.end());
+
+    orderedIndexes.resize(numVoxels);
+    for (unsigned int i = 0;i < numVoxels;++i)
+        orderedIndexes[i] = regionIndexes[mortonCodes[i].second];
+}
+
+template <class InputPixelType, class OutputPixelType>
+bool
+MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
+::WarmStartModelEstimation(MCMPointer &mcmValue, unsigned int currentNumberOfCompartments,
+                           std::vector <double> &observedSignals, itk::ThreadIdType threadId,
+                           double &aiccValue, double &b0Value, double &sigmaSqValue)
+{
+    ThreadWorkspace &threadWorkspace = m_ThreadWorkspaces[threadId];
+
+    // Seed from the neighbour with the same number of compartments and the lowest relative residual
+    bool seedFound = false;
+    typename OutputImageType::IndexType seedIndex;
+    double seedResidual = 0;
+    double seedB0Value = 0;
+    for (unsigned int i = 0;i < threadWorkspace.EstimatedNeighbours.size();++i)
+    {
+        typename OutputImageType::IndexType neighbourIndex = threadWorkspace.EstimatedNeighbours[i];
+        if (m_MoseVolume->GetPixel(neighbourIndex) != currentNumberOfCompartments)
+            continue;
+
+        double neighbourB0Value = m_B0Volume->GetPixel(neighbourIndex);
+        if (neighbourB0Value == 0.0)
+            continue;
+
+        double neighbourResidual = std::sqrt(m_SigmaSquareVolume->GetPixel(neighbourIndex)) / std::abs(neighbourB0Value);
+        if ((!seedFound)||(neighbourResidual < seedResidual))
+        {
+            seedFound = true;
+            seedIndex = neighbourIndex;
+            seedResidual = neighbourResidual;
+            seedB0Value = neighbourB0Value;
+        }
+    }
+
+    if (!seedFound)
+        return false;
+
+    // Final model structure, same settings as in the full estimation
+    MCMCreatorType *mcmCreator = m_MCMCreators[threadId];
+    mcmCreator->SetModelWithFreeWaterComponent(m_ModelWithFreeWaterComponent);
+    mcmCreator->SetModelWithStationaryWaterComponent(m_ModelWithStationaryWaterComponent);
+    mcmCreator->SetModelWithRestrictedWaterComponent(m_ModelWithRestrictedWaterComponent);
+    mcmCreator->SetModelWithStaniszComponent(m_ModelWithStaniszComponent);
+    mcmCreator->SetCompartmentType(m_CompartmentType);
+    mcmCreator->SetNumberOfCompartments(currentNumberOfCompartments);
+    mcmCreator->SetVariableProjectionEstimationMode(m_MLEstimationStrategy == VariableProjection);
+    mcmCreator->SetUseConstrainedDiffusivity(m_UseConstrainedDiffusivity);
+    mcmCreator->SetUseConstrainedFreeWaterDiffusivity(m_UseConstrainedFreeWaterDiffusivity);
+    mcmCreator->SetUseConstrainedIRWDiffusivity(m_UseConstrainedIRWDiffusivity);
+    mcmCreator->SetUseConstrainedStaniszDiffusivity(m_UseConstrainedStaniszDiffusivity);
+    mcmCreator->SetUseConstrainedStaniszRadius(m_UseConstrainedStaniszRadius);
+    mcmCreator->SetUseCommonDiffusivities(m_UseCommonDiffusivities);
+    mcmCreator->SetUseConstrainedExtraAxonalFraction(m_UseConstrainedExtraAxonalFraction);
+    mcmCreator->SetUseConstrainedOrientationConcentration(m_UseConstrainedOrientationConcentration);
+    mcmCreator->SetUseCommonConcentrations(m_UseCommonConcentrations);
+    mcmCreator->SetUseCommonExtraAxonalFractions(m_UseCommonExtraAxonalFractions);
+
+    EstimationStage finalStage = FinalModelStage;
+    if (m_CompartmentType == Stick)
+        finalStage = m_UseConstrainedDiffusivity ? InitialSticksStage : SticksStage;
+    else if (m_CompartmentType == Zeppelin)
+        finalStage = ZeppelinsStage;
+
+    StageWorkspace &workspace = this->GetStageWorkspace(finalStage,currentNumberOfCompartments,observedSignals,threadId);
+    MCMPointer mcmUpdateValue = workspace.Model;
+    mcmUpdateValue->SetNegativeWeightBounds(seedB0Value < 0.0);
+
+    // - Initialize from neighbour estimate, output weights are normalized by B0
+    MCMPointer &seedModel = threadWorkspace.OutputModel;
+    seedModel->SetModelVector(this->GetOutput()->GetPixel(seedIndex));
+
+    unsigned int numCompartments = mcmUpdateValue->GetNumberOfCompartments();
+    MCMType::ListType seedWeights(numCompartments);
+    for (unsigned int i = 0;i < numCompartments;++i)
+    {
+        mcmUpdateValue->GetCompartment(i)->CopyFromOther(seedModel->GetCompartment(i));
+        seedWeights[i] = seedModel->GetCompartmentWeight(i) * seedB0Value;
+    }
+
+    mcmUpdateValue->SetCompartmentWeights(seedWeights);
+
+    CostFunctionBasePointer &cost = workspace.Cost;
+    unsigned int dimension = mcmUpdateValue->GetNumberOfParameters();
+    ParametersType p(dimension);
+    MCMType::ListType workVec(dimension);
+    itk::Array<double> lowerBounds(dimension), upperBounds(dimension);
+
+    workVec = mcmUpdateValue->GetParameterLowerBounds();
+    for (unsigned int i = 0;i < dimension;++i)
+        lowerBounds[i] = workVec[i];
+
+    workVec = mcmUpdateValue->GetParameterUpperBounds();
+    for (unsigned int i = 0;i < dimension;++i)
+        upperBounds[i] = workVec[i];
+
+    workVec = mcmUpdateValue->GetParametersAsVector();
+    for (unsigned int i = 0;i < dimension;++i)
+        p[i] = workVec[i];
+
+    double costValue = this->PerformSingleOptimization(p,workspace,lowerBounds,upperBounds,threadId);
+
+    for (unsigned int i = 0;i < dimension;++i)
+        workVec[i] = p[i];
+
+    mcmUpdateValue->SetParametersFromVector(workVec);
+    this->GetProfiledInformation(cost,mcmUpdateValue,b0Value,sigmaSqValue);
+
+    // - Fall back on full initialization if the warm start fit is much worse than its seed
+    bool acceptWarmStart = (b0Value != 0.0);
+    if (acceptWarmStart)
+        acceptWarmStart = (std::sqrt(sigmaSqValue) / std::abs(b0Value) <= m_WarmStartResidualRatio * seedResidual);
+
+    if (!acceptWarmStart)
+    {
+        ++threadWorkspace.NumberOfWarmStartFallbacks;
+        return false;
+    }
+
+    ++threadWorkspace.NumberOfWarmStarts;
+    aiccValue = this->ComputeAICcValue(mcmUpdateValue,costValue);
+    mcmValue = mcmUpdateValue;
+
+    return true;
+}
+
 template <class InputPixelType, class OutputPixelType>
 void
 MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
@@ -804,11 +1218,30 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     mcmCreator->SetUseConstrainedStaniszRadius(m_UseConstrainedStaniszRadius);
     mcmCreator->SetUseCommonDiffusivities(m_UseCommonDiffusivities);
 
-    MCMPointer mcmUpdateValue = mcmCreator->GetNewMultiCompartmentModel();
+    StageWorkspace &workspace = this->GetStageWorkspace(InitialSticksStage,currentNumberOfCompartments,observedSignals,threadId);
+    MCMPointer mcmUpdateValue = workspace.Model;
     mcmUpdateValue->SetNegativeWeightBounds(authorizedNegativeB0Value);
 
     // - Now initialize sticks from dictionary
+    itk::TimeProbe &sparseProbe = m_ThreadWorkspaces[threadId].SparseInitializationProbe;
+    sparseProbe.Start();
     this->SparseInitializeSticks(mcmUpdateValue,authorizedNegativeB0Value,observedSignals,threadId);
+    sparseProbe.Stop();
+
+    if (mcmUpdateValue != workspace.Model)
+    {
+        // Less sticks than requested were found, the sparse initialization created a smaller model
+        workspace.Model = mcmUpdateValue;
+        if (m_UseThreadWorkspaces)
+        {
+            // Reference model sized from the shrunk model, compartments are restored one by one from it
+            unsigned int numSticks = mcmUpdateValue->GetNumberOfCompartments() - mcmUpdateValue->GetNumberOfIsotropicCompartments();
+            mcmCreator->SetNumberOfCompartments(numSticks);
+            workspace.ReferenceModel = mcmCreator->GetNewMultiCompartmentModel();
+        }
+        workspace.Cost = this->CreateCostFunction(observedSignals,workspace.Model);
+        workspace.Optimizer = ITK_NULLPTR;
+    }
 
     unsigned int dimension = mcmUpdateValue->GetNumberOfParameters();
     ParametersType p(dimension);
@@ -823,14 +1256,14 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     for (unsigned int j = 0;j < dimension;++j)
         upperBounds[j] = workVec[j];
 
-    CostFunctionBasePointer cost = this->CreateCostFunction(observedSignals,mcmUpdateValue);
+    CostFunctionBasePointer &cost = workspace.Cost;
 
     // - Update ball and stick model against observed signals
     workVec = mcmUpdateValue->GetParametersAsVector();
     for (unsigned int j = 0;j < dimension;++j)
         p[j] = workVec[j];
 
-    double costValue = this->PerformSingleOptimization(p,cost,lowerBounds,upperBounds);
+    double costValue = this->PerformSingleOptimization(p,workspace,lowerBounds,upperBounds,threadId);
 
     // - Get estimated data
     for (unsigned int j = 0;j < dimension;++j)
@@ -862,13 +1295,14 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     mcmCreator->SetNumberOfCompartments(optimalNumberOfCompartments);
     mcmCreator->SetUseConstrainedDiffusivity(m_UseConstrainedDiffusivity);
 
-    MCMPointer mcmUpdateValue = mcmCreator->GetNewMultiCompartmentModel();
+    StageWorkspace *workspace = &this->GetStageWorkspace(SticksStage,optimalNumberOfCompartments,observedSignals,threadId);
+    MCMPointer mcmUpdateValue = workspace->Model;
     mcmUpdateValue->SetNegativeWeightBounds(authorizedNegativeB0Value);
 
     // - Now the tricky part: initialize from previous model, handled somewhere else
     this->InitializeModelFromSimplifiedOne(mcmValue,mcmUpdateValue);
 
-    CostFunctionBasePointer cost = this->CreateCostFunction(observedSignals,mcmUpdateValue);
+    CostFunctionBasePointer cost = workspace->Cost;
 
     unsigned int dimension = mcmUpdateValue->GetNumberOfParameters();
     ParametersType p(dimension);
@@ -887,7 +1321,7 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     for (unsigned int i = 0;i < dimension;++i)
         p[i] = workVec[i];
 
-    double costValue = this->PerformSingleOptimization(p,cost,lowerBounds,upperBounds);
+    double costValue = this->PerformSingleOptimization(p,*workspace,lowerBounds,upperBounds,threadId);
     this->GetProfiledInformation(cost,mcmUpdateValue,b0Value,sigmaSqValue);
 
     for (unsigned int i = 0;i < dimension;++i)
@@ -904,14 +1338,15 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     // We're done with ball and stick, next up is ball and zeppelin
     // - First create model
     mcmCreator->SetCompartmentType(Zeppelin);
-    mcmUpdateValue = mcmCreator->GetNewMultiCompartmentModel();
+    workspace = &this->GetStageWorkspace(ZeppelinsStage,optimalNumberOfCompartments,observedSignals,threadId);
+    mcmUpdateValue = workspace->Model;
     mcmUpdateValue->SetNegativeWeightBounds(authorizedNegativeB0Value);
 
     // - Now the tricky part: initialize from previous model, handled somewhere else
     this->InitializeModelFromSimplifiedOne(mcmValue,mcmUpdateValue);
 
     // - Update ball and zeppelin model against observed signals
-    cost = this->CreateCostFunction(observedSignals,mcmUpdateValue);
+    cost = workspace->Cost;
     dimension = mcmUpdateValue->GetNumberOfParameters();
     p.SetSize(dimension);
     lowerBounds.SetSize(dimension);
@@ -929,7 +1364,7 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     for (unsigned int i = 0;i < dimension;++i)
         p[i] = workVec[i];
 
-    costValue = this->PerformSingleOptimization(p,cost,lowerBounds,upperBounds);
+    costValue = this->PerformSingleOptimization(p,*workspace,lowerBounds,upperBounds,threadId);
     this->GetProfiledInformation(cost,mcmUpdateValue,b0Value,sigmaSqValue);
 
     for (unsigned int i = 0;i < dimension;++i)
@@ -951,14 +1386,15 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     mcmCreator->SetUseCommonConcentrations(m_UseCommonConcentrations);
     mcmCreator->SetUseCommonExtraAxonalFractions(m_UseCommonExtraAxonalFractions);
 
-    mcmUpdateValue = mcmCreator->GetNewMultiCompartmentModel();
+    workspace = &this->GetStageWorkspace(FinalModelStage,optimalNumberOfCompartments,observedSignals,threadId);
+    mcmUpdateValue = workspace->Model;
     mcmUpdateValue->SetNegativeWeightBounds(authorizedNegativeB0Value);
 
     // - Now the tricky part: initialize from previous model, handled somewhere else
     this->InitializeModelFromSimplifiedOne(mcmValue,mcmUpdateValue);
 
     // - Update complex model against observed signals
-    cost = this->CreateCostFunction(observedSignals,mcmUpdateValue);
+    cost = workspace->Cost;
     dimension = mcmUpdateValue->GetNumberOfParameters();
     p.SetSize(dimension);
     lowerBounds.SetSize(dimension);
@@ -972,6 +1408,9 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     for (unsigned int i = 0;i < dimension;++i)
         upperBounds[i] = workVec[i];
 
+    itk::TimeProbe &coarseGridProbe = m_ThreadWorkspaces[threadId].CoarseGridInitializationProbe;
+    coarseGridProbe.Start();
+
     switch (m_CompartmentType)
     {
         case NODDI:
@@ -988,11 +1427,13 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
             break;
     }
 
+    coarseGridProbe.Stop();
+
     workVec = mcmUpdateValue->GetParametersAsVector();
     for (unsigned int i = 0;i < dimension;++i)
         p[i] = workVec[i];
 
-    costValue = this->PerformSingleOptimization(p,cost,lowerBounds,upperBounds);
+    costValue = this->PerformSingleOptimization(p,*workspace,lowerBounds,upperBounds,threadId);
     this->GetProfiledInformation(cost,mcmUpdateValue,b0Value,sigmaSqValue);
 
     for (unsigned int i = 0;i < dimension;++i)
@@ -1237,15 +1678,45 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
 template <class InputPixelType, class OutputPixelType>
 double
 MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
-::PerformSingleOptimization(ParametersType &p, CostFunctionBasePointer &cost, itk::Array<double> &lowerBounds, itk::Array<double> &upperBounds)
+::PerformSingleOptimization(ParametersType &p, StageWorkspace &workspace, itk::Array<double> &lowerBounds,
+                            itk::Array<double> &upperBounds, itk::ThreadIdType threadId)
 {
+    itk::TimeProbe &optimizationProbe = m_ThreadWorkspaces[threadId].OptimizationProbes[workspace.Stage];
+    optimizationProbe.Start();
+
+    CostFunctionBasePointer &cost = workspace.Cost;
     double costValue = this->GetCostValue(cost,p);
 
-    OptimizerPointer optimizer = this->CreateOptimizer(cost,lowerBounds,upperBounds);
+    if (!workspace.Optimizer)
+        workspace.Optimizer = this->CreateOptimizer(cost,lowerBounds,upperBounds);
+    else if (m_Optimizer != "levenberg")
+    {
+        // Bounds depend on weight bounds, set per voxel
+        anima::NLOPTOptimizers *optCast = dynamic_cast <anima::NLOPTOptimizers *> (workspace.Optimizer.GetPointer());
+        optCast->SetLowerBoundParameters(lowerBounds);
+        optCast->SetUpperBoundParameters(upperBounds);
+    }
+    else
+    {
+        anima::BoundedLevenbergMarquardtOptimizer *optCast =
+                dynamic_cast <anima::BoundedLevenbergMarquardtOptimizer *> (workspace.Optimizer.GetPointer());
+        optCast->SetLowerBounds(lowerBounds);
+        optCast->SetUpperBounds(upperBounds);
+    }
+
+    OptimizerPointer &optimizer = workspace.Optimizer;
 
     optimizer->SetInitialPosition(p);
     optimizer->StartOptimization();
 
+    unsigned int numIterations = 0;
+    if (m_Optimizer != "levenberg")
+        numIterations = dynamic_cast <anima::NLOPTOptimizers *> (optimizer.GetPointer())->GetNumberOfEvaluations();
+    else
+        numIterations = dynamic_cast <anima::BoundedLevenbergMarquardtOptimizer *> (optimizer.GetPointer())->GetCurrentIteration();
+
+    m_ThreadWorkspaces[threadId].NumberOfIterations[workspace.Stage] += numIterations;
+
     p = optimizer->GetCurrentPosition();
 
     // Takes care of round-off errors resulting
@@ -1260,6 +1731,7 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     }
 
     costValue = this->GetCostValue(cost,p);
+    optimizationProbe.Stop();
 
     return costValue;
 }
@@ -0,0 +1,58 @@
+#include <tclap/CmdLine.h>
+
+#include <animaMCMFileReader.h>
+#include <animaMCMFileWriter.h>
+
+template <class PixelType>
+void convertMCM(const std::string &inputFileName, const std::string &outputFileName, unsigned int brickSize)
+{
+    typedef anima::MCMFileReader <PixelType,3> MCMReaderType;
+    typedef anima::MCMFileWriter <PixelType,3> MCMWriterType;
+
+    MCMReaderType mcmReader;
+    mcmReader.SetFileName(inputFileName);
+    mcmReader.Update();
+
+    MCMWriterType mcmWriter;
+    mcmWriter.SetInputImage(mcmReader.GetModelVectorImage());
+    mcmWriter.SetBrickSize(brickSize);
+    mcmWriter.SetFileName(outputFileName);
+    mcmWriter.Update();
+}
+
+int main(int argc, char **argv)
+{
+    TCLAP::CmdLine cmd("Converts MCM images between the XML (.mcm) and brick (.mcmb) formats, the output format being selected by its extension\nINRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
+
+    TCLAP::ValueArg<std::string> inArg("i","input","Input MCM image (.mcm or .mcmb)",true,"","input MCM image",cmd);
+    TCLAP::ValueArg<std::string> outArg("o","output","Output MCM image (.mcm or .mcmb)",true,"","output MCM image",cmd);
+    TCLAP::ValueArg<unsigned int> brickSizeArg("b","brick-size","Brick size in voxels for the brick format (default: 32)",false,32,"brick size",cmd);
+
+    try
+    {
+        cmd.parse(argc,argv);
+    }
+    catch (TCLAP::ArgException& e)
+    {
+        std::cerr << "Error: " << e.error() << "for argument " << e.argId() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Keep the input precision, so that float models are not written as doubles
+    switch (anima::GetMCMComponentType(inArg.getValue()))
+    {
+        case itk::IOComponentEnum::FLOAT:
+            convertMCM <float> (inArg.getValue(),outArg.getValue(),brickSizeArg.getValue());
+            break;
+
+        case itk::IOComponentEnum::UNKNOWNCOMPONENTTYPE:
+            std::cerr << "Unreadable MCM image " << inArg.getValue() << std::endl;
+            return EXIT_FAILURE;
+
+        default:
+            convertMCM <double> (inArg.getValue(),outArg.getValue(),brickSizeArg.getValue());
+            break;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+#include <animaMCMImage.h>
+#include <animaMCMLinearInterpolateImageFunction.h>
+#include <animaMCMWeightedAverager.h>
+#include <animaMultiCompartmentModelCreator.h>
+
+#include <itkImageRegionIterator.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Checks cached compartment matching of the MCM linear interpolator: on an image of two crossing tensor
+// compartments stored in random order, interpolations should average each fascicle with itself, i.e. give the same
+// result as an averager told the true fascicle of each compartment
+
+typedef anima::MCMImage <double,3> ImageType;
+typedef anima::MCMLinearInterpolateImageFunction <ImageType> InterpolatorType;
+typedef anima::MultiCompartmentModel MCModelType;
+typedef anima::MCMWeightedAverager AveragerType;
+
+// Largest difference between the directional compartments of two models, up to their order
+double compareDirectionalCompartments(MCModelType *model, MCModelType *referenceModel)
+{
+    unsigned int numIsoCompartments = model->GetNumberOfIsotropicCompartments();
+    unsigned int numCompartments = model->GetNumberOfCompartments();
+
+    double maxDifference = 0;
+    for (unsigned int i = 0;i < numIsoCompartments;++i)
+        maxDifference = std::max(maxDifference, std::abs(model->GetCompartmentWeight(i) - referenceModel->GetCompartmentWeight(i)));
+
+    for (unsigned int i = numIsoCompartments;i < numCompartments;++i)
+    {
+        double minDifference = -1;
+        for (unsigned int j = numIsoCompartments;j < numCompartments;++j)
+        {
+            double difference = std::abs(model->GetCompartmentWeight(i) - referenceModel->GetCompartmentWeight(j));
+            anima::BaseCompartment::Matrix3DType tensor = model->GetCompartment(i)->GetDiffusionTensor();
+            anima::BaseCompartment::Matrix3DType referenceTensor = referenceModel->GetCompartment(j)->GetDiffusionTensor();
+
+            // Tensor entries are of the order of diffusivities, compare them relatively to the largest one
+            for (unsigned int k = 0;k < 3;++k)
+            {
+                for (unsigned int l = 0;l < 3;++l)
+                    difference = std::max(difference, std::abs(tensor(k,l) - referenceTensor(k,l)) / 1.7e-3);
+            }
+
+            if ((minDifference < 0)||(difference < minDifference))
+                minDifference = difference;
+        }
+
+        maxDifference = std::max(maxDifference, minDifference);
+    }
+
+    return maxDifference;
+}
+
+int main(int argc, char **argv)
+{
+    anima::MultiCompartmentModelCreator mcmCreator;
+    mcmCreator.SetCompartmentType(anima::Tensor);
+    mcmCreator.SetNumberOfCompartments(2);
+    mcmCreator.SetModelWithFreeWaterComponent(true);
+
+    MCModelType::Pointer model = mcmCreator.GetNewMultiCompartmentModel();
+    unsigned int numIsoCompartments = model->GetNumberOfIsotropicCompartments();
+
+    ImageType::Pointer image = ImageType::New();
+    ImageType::RegionType region;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        region.SetIndex(i,0);
+        region.SetSize(i,6);
+    }
+
+    image->SetRegions(region);
+    image->SetNumberOfComponentsPerPixel(model->GetSize());
+    image->Allocate();
+    image->SetDescriptionModel(model);
+
+    // Fascicle of each directional compartment of each voxel: fascicle 0 is close to x, fascicle 1 close to y
+    std::mt19937 generator(0);
+    std::uniform_real_distribution <double> uniformDistribution(0.0,1.0);
+    std::vector <unsigned int> fascicleClasses(2 * region.GetNumberOfPixels());
+
+    itk::ImageRegionIterator <ImageType> imageItr(image,region);
+    for (unsigned int i = 0;!imageItr.IsAtEnd();++i)
+    {
+        bool swapped = (uniformDistribution(generator) < 0.5);
+        fascicleClasses[2 * i] = swapped;
+        fascicleClasses[2 * i + 1] = !swapped;
+
+        std::vector <double> weights(numIsoCompartments + 2);
+        weights[0] = 0.1 + 0.1 * uniformDistribution(generator);
+        for (unsigned int j = 0;j < 2;++j)
+        {
+            anima::BaseCompartment *compartment = model->GetCompartment(numIsoCompartments + j);
+            double fascicleAngle = fascicleClasses[2 * i + j] * M_PI / 2.0;
+
+            compartment->SetOrientationTheta(M_PI / 2.0 + 0.2 * (uniformDistribution(generator) - 0.5));
+            compartment->SetOrientationPhi(fascicleAngle + 0.2 * (uniformDistribution(generator) - 0.5));
+            compartment->SetPerpendicularAngle(0.2 * (uniformDistribution(generator) - 0.5));
+            compartment->SetAxialDiffusivity(1.7e-3 * (0.9 + 0.2 * uniformDistribution(generator)));
+            compartment->SetRadialDiffusivity1(3.0e-4 * (0.9 + 0.2 * uniformDistribution(generator)));
+            compartment->SetRadialDiffusivity2(2.0e-4 * (0.9 + 0.2 * uniformDistribution(generator)));
+
+            weights[numIsoCompartments + j] = (1.0 - weights[0]) * (0.3 + 0.4 * uniformDistribution(generator));
+        }
+
+        weights[numIsoCompartments + 1] = 1.0 - weights[0] - weights[numIsoCompartments];
+        model->SetCompartmentWeights(weights);
+
+        imageItr.Set(model->GetModelVector());
+        ++imageItr;
+    }
+
+    bool success = true;
+
+    // Ratios for which two compartments could be matched to the same one are refused
+    InterpolatorType::Pointer interpolator = InterpolatorType::New();
+    try
+    {
+        interpolator->SetMatchingDistanceRatio(1.0);
+        std::cerr << "A matching distance ratio of 1 should be refused" << std::endl;
+        success = false;
+    }
+    catch (itk::ExceptionObject &e)
+    {
+    }
+
+    interpolator->SetInputImage(image);
+    interpolator->SetReferenceOutputModel(model);
+    interpolator->SetUseCachedMatching(true);
+
+    AveragerType::Pointer averager = AveragerType::New();
+    averager->SetOutputModel(model);
+
+    std::vector <MCModelType::Pointer> inputModels(8);
+    std::vector <double> inputWeights(8);
+    for (unsigned int i = 0;i < 8;++i)
+        inputModels[i] = model->Clone();
+
+    MCModelType::Pointer outputModel = model->Clone();
+    std::vector <unsigned int> inputClasses;
+    double maxDifference = 0;
+
+    // Points strictly inside the image, so that all eight neighbors are used
+    for (unsigned int n = 0;n < 1000;++n)
+    {
+        InterpolatorType::ContinuousIndexType index;
+        for (unsigned int i = 0;i < 3;++i)
+            index[i] = 0.01 + (region.GetSize(i) - 1.02) * uniformDistribution(generator);
+
+        outputModel->SetModelVector(interpolator->EvaluateAtContinuousIndex(index));
+
+        ImageType::IndexType baseIndex;
+        for (unsigned int i = 0;i < 3;++i)
+            baseIndex[i] = std::floor(index[i]);
+
+        inputClasses.clear();
+        for (unsigned int i = 0;i < 8;++i)
+        {
+            ImageType::IndexType neighborIndex = baseIndex;
+            inputWeights[i] = 1.0;
+            for (unsigned int j = 0;j < 3;++j)
+            {
+                bool upper = (i >> j) & 1;
+                neighborIndex[j] += upper;
+                inputWeights[i] *= upper ? index[j] - baseIndex[j] : 1.0 - index[j] + baseIndex[j];
+            }
+
+            inputModels[i]->SetModelVector(image->GetPixel(neighborIndex));
+            size_t offset = image->ComputeOffset(neighborIndex);
+            inputClasses.push_back(fascicleClasses[2 * offset]);
+            inputClasses.push_back(fascicleClasses[2 * offset + 1]);
+        }
+
+        averager->SetInputModels(inputModels);
+        averager->SetInputWeights(inputWeights);
+        averager->SetInputCompartmentClasses(inputClasses);
+        averager->SetNumberOfOutputDirectionalCompartments(2);
+        averager->Update();
+
+        maxDifference = std::max(maxDifference, compareDirectionalCompartments(outputModel,averager->GetOutputModel()));
+    }
+
+    std::cout << "Maximal relative difference between cached matching interpolation and true fascicle averages: "
+              << maxDifference << std::endl;
+
+    if (maxDifference > 1.0e-8)
+    {
+        std::cerr << "Cached matching interpolation does not average compartments of the same fascicle" << std::endl;
+        success = false;
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -32,6 +32,8 @@ int main(int argc, char **argv)
 	TCLAP::SwitchArg radialArg("R","radialestimation","Use radial estimation (see Aganj et al) ? (default: no)",cmd,false);
 	TCLAP::ValueArg<double> aganjRegFactorArg("d","adr","Delta threshold for signal regularization, only use if R option activated (see Aganj et al, default : 0.001)",false,0.001,"delta signal regularization",cmd);
 	
+    TCLAP::SwitchArg int16StorageArg("","int16","Store DWI signals in memory as 16 bits integers (integer valued signals only)",cmd,false);
+
     TCLAP::ValueArg<unsigned int> nbpArg("p","numberofthreads","Number of threads to run on (default: all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
     
     try
@@ -65,7 +67,15 @@ int main(int argc, char **argv)
     if (normalizeArg.isSet())
         mainFilter->SetFileNameSphereTesselation(normSphereArg.getValue());
     
-    anima::setMultipleImageFilterInputsFromFileName<InputImageType,MainFilterType>(inArg.getValue(), mainFilter);
+    // Voxel major loading of the DWI
+    MainFilterType::DWIDataType dwiData;
+    if (int16StorageArg.isSet())
+        dwiData.SetStorageType(MainFilterType::DWIDataType::Int16);
+
+    dwiData.Read(inArg.getValue());
+
+    mainFilter->SetInput(0,dwiData.CreateGeometryImage<InputImageType>());
+    mainFilter->SetDWIData(&dwiData);
     
     if (refB0Arg.getValue() != "")
         mainFilter->SetReferenceB0Image(anima::readImage <InputImageType> (refB0Arg.getValue()));
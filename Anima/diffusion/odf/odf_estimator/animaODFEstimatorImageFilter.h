@@ -6,6 +6,8 @@
 #include <itkImage.h>
 #include <vector>
 
+#include <animaVoxelMajorDWIData.h>
+
 namespace anima
 {
 
@@ -37,7 +39,15 @@ public:
     /** Superclass typedefs. */
     typedef typename Superclass::OutputImageRegionType OutputImageRegionType;
 
+    typedef anima::VoxelMajorDWIData DWIDataType;
+
     void AddGradientDirection(unsigned int i, std::vector <double> &grad);
+
+    /**
+     * Reads diffusion signals from a voxel major container instead of the indexed inputs. Input 0 then only provides
+     * the geometry (see VoxelMajorDWIData::CreateGeometryImage)
+     */
+    void SetDWIData(DWIDataType *data) {m_DWIData = data;}
     void SetBValuesList(std::vector <double> bValuesList) {m_BValuesList = bValuesList;}
     itkSetMacro(BValueShellSelected, int)
 
@@ -53,6 +63,13 @@ public:
     itkSetMacro(UseAganjEstimation,bool);
     itkSetMacro(DeltaAganjRegularization, double);
 
+    /**
+     * Number of voxels estimated together: their signals are loaded into a contiguous gradients x voxels buffer and
+     * projected onto the SH basis with a single matrix product
+     */
+    itkSetMacro(TileSize, unsigned int)
+    itkGetMacro(TileSize, unsigned int)
+
     itkGetMacro(EstimatedB0Image, OutputScalarImageType *)
     itkGetMacro(EstimatedVarianceImage, OutputScalarImageType *)
 
@@ -80,6 +97,8 @@ protected:
         m_SphereSHSampling.clear();
 
         m_UseAganjEstimation = false;
+        m_TileSize = 512;
+        m_DWIData = nullptr;
     }
 
     virtual ~ODFEstimatorImageFilter() {}
@@ -119,6 +138,8 @@ private:
 
     vnl_matrix <double> m_TMatrix; // evaluation matrix computed once and for all before threaded generate data
     vnl_matrix <double> m_BMatrix;
+    // Signal simulation matrix, m_BMatrix with the P factors removed from its columns
+    vnl_matrix <double> m_SignalSimulationMatrix;
     std::vector <double> m_DeconvolutionVector;
     std::vector <double> m_PVector;
 
@@ -127,6 +148,8 @@ private:
     bool m_Normalize;
     std::string m_FileNameSphereTesselation;
     std::vector < std::vector <double> > m_SphereSHSampling;
+    // Sum over the sphere samples of each SH, ODF integral is its dot product with the SH coefficients
+    std::vector <double> m_SphereSHSamplingSum;
 
     double m_Lambda;
     double m_SharpnessRatio; // See Descoteaux et al. TMI 2009, article plus appendix
@@ -134,6 +157,9 @@ private:
     bool m_UseAganjEstimation;
     double m_DeltaAganjRegularization;
     unsigned int m_LOrder;
+
+    unsigned int m_TileSize;
+    DWIDataType *m_DWIData;
 };
 
 } // end of namespace anima
@@ -1,9 +1,11 @@
 #pragma once
 #include <cmath>
+#include <algorithm>
 
 #include "animaODFEstimatorImageFilter.h"
 #include <animaODFSphericalHarmonicBasis.h>
 #include <itkImageRegionConstIterator.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
 #include <itkImageRegionIterator.h>
 #include <boost/math/special_functions/legendre.hpp>
 #include <fstream>
@@ -54,7 +56,11 @@ ODFEstimatorImageFilter<TInputPixelType,TOutputPixelType>
     unsigned int vectorLength = (m_LOrder + 1)*(m_LOrder + 2)/2;
     unsigned int numGrads = m_GradientDirections.size();
 
-    if ((m_GradientIndexes.size() + m_B0Indexes.size()) != this->GetNumberOfIndexedInputs())
+    unsigned int numInputs = this->GetNumberOfIndexedInputs();
+    if (m_DWIData)
+        numInputs = m_DWIData->GetNumberOfVolumes();
+
+    if ((m_GradientIndexes.size() + m_B0Indexes.size()) != numInputs)
         throw itk::ExceptionObject(__FILE__, __LINE__,"Number of gradient directions different from number of inputs",ITK_LOCATION);
 
     if (m_UseAganjEstimation)
@@ -244,6 +250,25 @@ ODFEstimatorImageFilter<TInputPixelType,TOutputPixelType>
     }
     else
         m_Normalize = false;
+
+    m_SphereSHSamplingSum.resize(vectorLength);
+    std::fill(m_SphereSHSamplingSum.begin(),m_SphereSHSamplingSum.end(),0.0);
+    for (unsigned int i = 0;i < m_SphereSHSampling.size();++i)
+        for (unsigned int j = 0;j < vectorLength;++j)
+            m_SphereSHSamplingSum[j] += m_SphereSHSampling[i][j];
+
+    // With Aganj estimation, the first coefficient used to simulate signals is the raw projection (zero value)
+    m_SignalSimulationMatrix.set_size(numGrads,vectorLength);
+    for (unsigned int i = 0;i < numGrads;++i)
+    {
+        for (unsigned int j = 0;j < vectorLength;++j)
+        {
+            if ((j == 0) && (m_UseAganjEstimation))
+                m_SignalSimulationMatrix(i,j) = m_BMatrix(i,j);
+            else
+                m_SignalSimulationMatrix(i,j) = m_BMatrix(i,j) / m_PVector[j];
+        }
+    }
 }
 
 template <typename TInputPixelType, typename TOutputPixelType>
@@ -261,12 +286,24 @@ ODFEstimatorImageFilter<TInputPixelType,TOutputPixelType>
 
     OutputIteratorType resIt(this->GetOutput(),outputRegionForThread);
 
-    std::vector<InputIteratorType> diffusionIts(numGrads);
-    std::vector<InputIteratorType> b0Its(numGrads);
-    for (unsigned int i = 0;i < numGrads;++i)
-        diffusionIts[i] = InputIteratorType(this->GetInput(m_GradientIndexes[i]),outputRegionForThread);
-    for (unsigned int i = 0;i < numB0;++i)
-        b0Its[i] = InputIteratorType(this->GetInput(m_B0Indexes[i]),outputRegionForThread);
+    std::vector<InputIteratorType> diffusionIts;
+    std::vector<InputIteratorType> b0Its;
+    if (!m_DWIData)
+    {
+        for (unsigned int i = 0;i < numGrads;++i)
+            diffusionIts.push_back(InputIteratorType(this->GetInput(m_GradientIndexes[i]),outputRegionForThread));
+        for (unsigned int i = 0;i < numB0;++i)
+            b0Its.push_back(InputIteratorType(this->GetInput(m_B0Indexes[i]),outputRegionForThread));
+    }
+
+    typedef itk::ImageRegionConstIteratorWithIndex <OutputScalarImageType> IndexIteratorType;
+    IndexIteratorType indexItr;
+    std::vector <double> voxelSignals;
+    if (m_DWIData)
+    {
+        indexItr = IndexIteratorType(m_EstimatedB0Image, outputRegionForThread);
+        voxelSignals.resize(m_DWIData->GetNumberOfVolumes());
+    }
 
     InputIteratorType refB0Itr;
     if (m_ReferenceB0Image.IsNotNull())
@@ -275,138 +312,241 @@ ODFEstimatorImageFilter<TInputPixelType,TOutputPixelType>
     OutputScalarIteratorType varItr(m_EstimatedVarianceImage, outputRegionForThread);
     OutputScalarIteratorType outB0Itr(m_EstimatedB0Image, outputRegionForThread);
 
+    // Voxels are processed by tiles: signals are stored gradient by gradient (rows) for all voxels of the tile
+    // (columns), so that projections and signal simulations are matrix products running along contiguous rows
+    unsigned int tileSize = std::max(m_TileSize,1U);
+    std::vector <double> dwiSignals(numGrads * tileSize);
+    std::vector <double> b0Signals(numB0 * tileSize);
+    std::vector <double> projectedSignals;
+    if (m_UseAganjEstimation)
+        projectedSignals.resize(numGrads * tileSize);
+
+    std::vector <double> shCoefficients(vectorLength * tileSize);
+    std::vector <double> simulatedSignals(numGrads * tileSize);
+    std::vector <double> b0Values(tileSize), zeroValues(tileSize), noiseVariances(tileSize);
+    std::vector <bool> validVoxels(tileSize);
+
     itk::VariableLengthVector <TOutputPixelType> outputData(vectorLength);
-    std::vector <double> tmpData(numGrads,0);
-    while (!diffusionIts[0].IsAtEnd())
+    size_t numVoxels = outputRegionForThread.GetNumberOfPixels();
+
+    for (size_t tileStart = 0;tileStart < numVoxels;tileStart += tileSize)
     {
-        double b0Value = 0;
-        if (m_ReferenceB0Image.IsNotNull())
-            b0Value = refB0Itr.Get();
-        else
+        unsigned int numTileVoxels = std::min(static_cast <size_t> (tileSize), numVoxels - tileStart);
+
+        if (m_DWIData)
         {
-            for (unsigned int i = 0;i < numB0;++i)
-                b0Value += b0Its[i].Get();
+            // Load tile signals, voxel by voxel
+            for (unsigned int v = 0;v < numTileVoxels;++v)
+            {
+                m_DWIData->GetVoxelSignals(m_DWIData->GetLinearIndex(indexItr.GetIndex()),&voxelSignals[0]);
+                ++indexItr;
 
-            b0Value /= numB0;
-        }
+                for (unsigned int i = 0;i < numGrads;++i)
+                    dwiSignals[i * tileSize + v] = voxelSignals[m_GradientIndexes[i]];
 
-        for (unsigned int i = 0;i < numGrads;++i)
-            tmpData[i] = diffusionIts[i].Get();
+                for (unsigned int i = 0;i < numB0;++i)
+                    b0Signals[i * tileSize + v] = voxelSignals[m_B0Indexes[i]];
+            }
+        }
+        else
+        {
+            // Load tile signals, image by image
+            for (unsigned int i = 0;i < numGrads;++i)
+            {
+                double *signalRow = &dwiSignals[i * tileSize];
+                for (unsigned int v = 0;v < numTileVoxels;++v)
+                {
+                    signalRow[v] = diffusionIts[i].Get();
+                    ++diffusionIts[i];
+                }
+            }
 
-        for (unsigned int i = 0;i < vectorLength;++i)
-            outputData[i] = 0;
+            for (unsigned int i = 0;i < numB0;++i)
+            {
+                double *signalRow = &b0Signals[i * tileSize];
+                for (unsigned int v = 0;v < numTileVoxels;++v)
+                {
+                    signalRow[v] = b0Its[i].Get();
+                    ++b0Its[i];
+                }
+            }
+        }
 
-        if ((isZero(tmpData))||(b0Value <= 0))
+        for (unsigned int v = 0;v < numTileVoxels;++v)
         {
-            resIt.Set(outputData);
-            outB0Itr.Set(0.0);
-            varItr.Set(0.0);
-            ++resIt;
-            ++outB0Itr;
-            ++varItr;
+            if (m_ReferenceB0Image.IsNotNull())
+            {
+                b0Values[v] = refB0Itr.Get();
+                ++refB0Itr;
+            }
+            else
+            {
+                b0Values[v] = 0;
+                for (unsigned int i = 0;i < numB0;++i)
+                    b0Values[v] += b0Signals[i * tileSize + v];
 
-            for (unsigned int i = 0;i < numGrads;++i)
-                ++diffusionIts[i];
+                b0Values[v] /= numB0;
+            }
 
-            for (unsigned int i = 0;i < numB0;++i)
-                ++b0Its[i];
+            bool zeroData = true;
+            for (unsigned int i = 0;i < numGrads;++i)
+            {
+                if (dwiSignals[i * tileSize + v] != 0)
+                {
+                    zeroData = false;
+                    break;
+                }
+            }
 
-            continue;
+            validVoxels[v] = (!zeroData)&&(!(b0Values[v] <= 0));
         }
 
+        const double *projectionInput = &dwiSignals[0];
         if (m_UseAganjEstimation)
         {
             for (unsigned int i = 0;i < numGrads;++i)
             {
-                double e = tmpData[i] / b0Value;
-
-                if (e < 0)
-                    tmpData[i] = m_DeltaAganjRegularization / 2.0;
-                else if (e < m_DeltaAganjRegularization)
-                    tmpData[i] = m_DeltaAganjRegularization / 2.0 + e * e / (2.0 * m_DeltaAganjRegularization);
-                else if (e < 1.0 - m_DeltaAganjRegularization)
-                    tmpData[i] = e;
-                else if (e < 1)
-                    tmpData[i] = 1.0 - m_DeltaAganjRegularization / 2.0 - (1.0 - e) * (1.0 - e) / (2.0 * m_DeltaAganjRegularization);
-                else
-                    tmpData[i] = 1.0 - m_DeltaAganjRegularization / 2.0;
+                for (unsigned int v = 0;v < numTileVoxels;++v)
+                {
+                    unsigned int pos = i * tileSize + v;
+                    if (!validVoxels[v])
+                    {
+                        projectedSignals[pos] = 0;
+                        continue;
+                    }
+
+                    double e = dwiSignals[pos] / b0Values[v];
+                    double tmpData;
+
+                    if (e < 0)
+                        tmpData = m_DeltaAganjRegularization / 2.0;
+                    else if (e < m_DeltaAganjRegularization)
+                        tmpData = m_DeltaAganjRegularization / 2.0 + e * e / (2.0 * m_DeltaAganjRegularization);
+                    else if (e < 1.0 - m_DeltaAganjRegularization)
+                        tmpData = e;
+                    else if (e < 1)
+                        tmpData = 1.0 - m_DeltaAganjRegularization / 2.0 - (1.0 - e) * (1.0 - e) / (2.0 * m_DeltaAganjRegularization);
+                    else
+                        tmpData = 1.0 - m_DeltaAganjRegularization / 2.0;
+
+                    projectedSignals[pos] = std::log(-std::log(tmpData));
+                }
+            }
+
+            projectionInput = &projectedSignals[0];
+        }
 
-                tmpData[i] = std::log(-std::log(tmpData[i]));
+        // SH projection of the whole tile: shCoefficients = T * signals
+        for (unsigned int i = 0;i < vectorLength;++i)
+        {
+            double *coefRow = &shCoefficients[i * tileSize];
+            std::fill(coefRow,coefRow + numTileVoxels,0.0);
+
+            for (unsigned int j = 0;j < numGrads;++j)
+            {
+                double tValue = m_TMatrix(i,j);
+                const double *signalRow = projectionInput + j * tileSize;
+                for (unsigned int v = 0;v < numTileVoxels;++v)
+                    coefRow[v] += tValue * signalRow[v];
             }
         }
 
-        double zeroValue = 1.0;
-        if (b0Value > 0)
+        for (unsigned int v = 0;v < numTileVoxels;++v)
         {
-            for (unsigned int i = 0;i < vectorLength;++i)
-                for (unsigned int j = 0;j < numGrads;++j)
-                    outputData[i] += m_TMatrix(i,j)*tmpData[j];
+            if (!validVoxels[v])
+                continue;
 
             if (!m_UseAganjEstimation)
             {
                 for (unsigned int i = 0;i < vectorLength;++i)
-                    outputData[i] /= b0Value;
+                    shCoefficients[i * tileSize + v] /= b0Values[v];
             }
             else
             {
-                zeroValue = outputData[0];
-                outputData[0] = 1/(2*sqrt(M_PI));
+                zeroValues[v] = shCoefficients[v];
+                shCoefficients[v] = 1/(2*sqrt(M_PI));
             }
         }
 
-        double noiseVariance = 0.0;
+        // Simulated signals of the whole tile, from which noise variances are computed
         for (unsigned int i = 0;i < numGrads;++i)
         {
-            double signalSim = 0.0;
+            double *simulatedRow = &simulatedSignals[i * tileSize];
+            std::fill(simulatedRow,simulatedRow + numTileVoxels,0.0);
+
             for (unsigned int j = 0;j < vectorLength;++j)
             {
+                double bValue = m_SignalSimulationMatrix(i,j);
+                const double *coefRow = &shCoefficients[j * tileSize];
                 if ((j == 0) && (m_UseAganjEstimation))
-                    signalSim += m_BMatrix(i,j) * zeroValue;
-                else
-                    signalSim += m_BMatrix(i,j) * outputData[j] / m_PVector[j];
+                    coefRow = &zeroValues[0];
+
+                for (unsigned int v = 0;v < numTileVoxels;++v)
+                    simulatedRow[v] += bValue * coefRow[v];
             }
+        }
 
-            if (!m_UseAganjEstimation)
-                signalSim *= b0Value;
-            else
-                signalSim = b0Value * std::exp(- std::exp(signalSim));
+        std::fill(noiseVariances.begin(),noiseVariances.end(),0.0);
+        for (unsigned int i = 0;i < numGrads;++i)
+        {
+            for (unsigned int v = 0;v < numTileVoxels;++v)
+            {
+                unsigned int pos = i * tileSize + v;
+                double signalSim = simulatedSignals[pos];
+                if (!m_UseAganjEstimation)
+                    signalSim *= b0Values[v];
+                else
+                    signalSim = b0Values[v] * std::exp(- std::exp(signalSim));
 
-            double signalValue = diffusionIts[i].Get();
-            noiseVariance += (signalSim - signalValue) * (signalSim - signalValue);
+                noiseVariances[v] += (signalSim - dwiSignals[pos]) * (signalSim - dwiSignals[pos]);
+            }
         }
 
         for (unsigned int i = 0;i < numB0;++i)
         {
-            double b0Signal = b0Its[i].Get();
-            noiseVariance += (b0Value - b0Signal) * (b0Value - b0Signal);
+            for (unsigned int v = 0;v < numTileVoxels;++v)
+            {
+                double b0Signal = b0Signals[i * tileSize + v];
+                noiseVariances[v] += (b0Values[v] - b0Signal) * (b0Values[v] - b0Signal);
+            }
         }
 
-        noiseVariance /= (numGrads + numB0);
-        varItr.Set(noiseVariance);
-
-        outB0Itr.Set(b0Value);
-
-        if (m_Normalize)
+        // Scatter results back to the output images
+        for (unsigned int v = 0;v < numTileVoxels;++v)
         {
-            long double integralODF = 0;
-            for (unsigned int i = 0;i < m_SphereSHSampling.size();++i)
-                for (unsigned int j = 0;j < vectorLength;++j)
-                    integralODF += m_SphereSHSampling[i][j]*outputData[j];
+            if (!validVoxels[v])
+            {
+                outputData.Fill(0.0);
+                resIt.Set(outputData);
+                outB0Itr.Set(0.0);
+                varItr.Set(0.0);
+                ++resIt;
+                ++outB0Itr;
+                ++varItr;
+                continue;
+            }
+
+            varItr.Set(noiseVariances[v] / (numGrads + numB0));
+            outB0Itr.Set(b0Values[v]);
 
             for (unsigned int i = 0;i < vectorLength;++i)
-                outputData[i] /= integralODF;
-        }
+                outputData[i] = shCoefficients[i * tileSize + v];
 
-        resIt.Set(outputData);
-        ++resIt;
-        ++outB0Itr;
-        ++varItr;
+            if (m_Normalize)
+            {
+                long double integralODF = 0;
+                for (unsigned int i = 0;i < vectorLength;++i)
+                    integralODF += m_SphereSHSamplingSum[i] * outputData[i];
 
-        for (unsigned int i = 0;i < numGrads;++i)
-            ++diffusionIts[i];
+                for (unsigned int i = 0;i < vectorLength;++i)
+                    outputData[i] /= integralODF;
+            }
 
-        for (unsigned int i = 0;i < numB0;++i)
-            ++b0Its[i];
+            resIt.Set(outputData);
+            ++resIt;
+            ++outB0Itr;
+            ++varItr;
+        }
     }
 }
     
@@ -5,11 +5,19 @@
 
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
+#include <vtkPoints.h>
+#include <vtkDoubleArray.h>
 #include <itkProcessObject.h>
 #include <itkLinearInterpolateImageFunction.h>
 #include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <thread>
 #include <itkProgressReporter.h>
 
+#include <animaTRKWriter.h>
+
+#include <deque>
 #include <vector>
 #include <random>
 
@@ -65,6 +73,13 @@ public:
     typedef std::vector <FiberType> FiberProcessVectorType;
     typedef std::vector <unsigned int> MembershipType;
 
+    //! Compact fiber used for streamed output: float32 interleaved point coordinates and fiber weight
+    struct CompactFiberType
+    {
+        std::vector <float> points;
+        double weight;
+    };
+
     typedef struct {
         BaseProbabilisticTractographyImageFilter *trackerPtr;
         std::vector <FiberProcessVectorType> resultFibersFromThreads;
@@ -162,6 +177,16 @@ public:
     itkSetMacro(ModelDimension, unsigned int)
     itkGetMacro(ModelDimension, unsigned int)
 
+    /**
+     * Streaming output: fibers are sent by tracking threads through a bounded queue to a writer thread as soon
+     * as they are computed. They are written incrementally to disk for TRK outputs (B0 image used as reference),
+     * and appended to a float32 output otherwise, written to the output file name at the end of Update
+     */
+    itkSetMacro(StreamOutput,bool)
+    itkGetConstMacro(StreamOutput,bool)
+    itkSetMacro(StreamingQueueSize,unsigned int)
+    void SetOutputFileName(const std::string &name) {m_OutputFileName = name;}
+
     void Update() ITK_OVERRIDE;
 
     void createVTKOutput(FiberProcessVectorType &filteredFibers, ListType &filteredWeights);
@@ -182,6 +207,18 @@ protected:
                                ListType &resultWeights, unsigned int startSeedIndex,
                                unsigned int endSeedIndex);
 
+    //! Pushes a fiber to the streaming queue, waiting while the queue is full
+    void PushStreamedFiber(CompactFiberType &fiber);
+
+    //! Writer thread: consumes the streaming queue until tracking is done, trkWriter is null if not writing a TRK file
+    void WriteStreamedFibers(anima::TRKWriter *trkWriter);
+
+    //! Signals the writer thread that tracking is done and waits for it, also called when tracking failed
+    void StopStreamedFibersWriter(std::thread &writerThread);
+
+    //! Appends a compact fiber to the output polydata
+    void AppendFiberToOutput(const CompactFiberType &fiber);
+
     //! This little guy is the one handling probabilistic tracking
     FiberProcessVectorType ComputeFiber(FiberType &fiber, InterpolatorPointer &modelInterpolator,
                                         unsigned int numThread, ListType &resultWeights);
@@ -272,6 +309,19 @@ private:
 
     vtkSmartPointer<vtkPolyData> m_Output;
 
+    // Streaming output variables
+    bool m_StreamOutput;
+    std::string m_OutputFileName;
+    unsigned int m_StreamingQueueSize;
+    std::deque <CompactFiberType> m_StreamingQueue;
+    std::mutex m_StreamingQueueLock;
+    std::condition_variable m_StreamingQueueNotFull, m_StreamingQueueNotEmpty;
+    bool m_StreamingDone;
+    std::exception_ptr m_StreamingError;
+    unsigned int m_NumberOfStreamedFibers;
+    vtkSmartPointer <vtkPoints> m_StreamedPoints;
+    vtkSmartPointer <vtkDoubleArray> m_StreamedWeights;
+
     std::mutex m_LockHighestProcessedSeed;
     int m_HighestProcessedSeed;
     itk::ProgressReporter *m_ProgressReport;
@@ -18,8 +18,10 @@
 #include <vtkDoubleArray.h>
 
 #include <animaKMeansFilter.h>
+#include <animaShapesWriter.h>
 
 #include <ctime>
+#include <thread>
 
 namespace anima
 {
@@ -58,6 +60,12 @@ BaseProbabilisticTractographyImageFilter <TInputModelImageType>
 
     m_HighestProcessedSeed = 0;
     m_ProgressReport = 0;
+
+    m_StreamOutput = false;
+    m_OutputFileName = "";
+    m_StreamingQueueSize = 1000;
+    m_StreamingDone = false;
+    m_NumberOfStreamedFibers = 0;
 }
 
 template <class TInputModelImageType>
@@ -103,9 +111,100 @@ BaseProbabilisticTractographyImageFilter <TInputModelImageType>
         tmpStr.resultWeightsFromThreads[i] = resultWeights;
     }
 
+    // Start writer thread for streamed output
+    anima::TRKWriter *trkWriter = ITK_NULLPTR;
+    std::thread writerThread;
+    if (m_StreamOutput)
+    {
+        if (m_OutputFileName == "")
+            itkExceptionMacro("Streamed output requires an output file name");
+
+        std::string extensionName = m_OutputFileName.substr(m_OutputFileName.find_last_of('.') + 1);
+        if (extensionName == "trk")
+        {
+            trkWriter = new anima::TRKWriter;
+            trkWriter->SetFileName(m_OutputFileName);
+            trkWriter->SetReferenceImage(m_B0Image);
+
+            std::vector <std::string> scalarNames(1,"Fiber weights");
+            trkWriter->BeginStreaming(scalarNames);
+        }
+        else
+        {
+            m_Output->Initialize();
+            m_Output->Allocate();
+
+            m_StreamedPoints = vtkPoints::New();
+            m_StreamedPoints->SetDataTypeToFloat();
+            m_StreamedWeights = vtkDoubleArray::New();
+            m_StreamedWeights->SetNumberOfComponents(1);
+            m_StreamedWeights->SetName("Fiber weights");
+        }
+
+        m_StreamingQueue.clear();
+        m_StreamingDone = false;
+        m_StreamingError = ITK_NULLPTR;
+        m_NumberOfStreamedFibers = 0;
+        writerThread = std::thread(&Self::WriteStreamedFibers,this,trkWriter);
+    }
+
     this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
     this->GetMultiThreader()->SetSingleMethod(this->ThreadTracker,&tmpStr);
-    this->GetMultiThreader()->SingleMethodExecute();
+
+    try
+    {
+        this->GetMultiThreader()->SingleMethodExecute();
+    }
+    catch (...)
+    {
+        // The writer thread has to be joined before leaving, its destruction would otherwise terminate the program
+        if (m_StreamOutput)
+        {
+            this->StopStreamedFibersWriter(writerThread);
+            delete trkWriter;
+            m_StreamedPoints = ITK_NULLPTR;
+            m_StreamedWeights = ITK_NULLPTR;
+        }
+
+        throw;
+    }
+
+    if (m_StreamOutput)
+    {
+        this->StopStreamedFibersWriter(writerThread);
+
+        if (m_StreamingError)
+        {
+            delete trkWriter;
+            m_StreamedPoints = ITK_NULLPTR;
+            m_StreamedWeights = ITK_NULLPTR;
+            std::rethrow_exception(m_StreamingError);
+        }
+
+        std::cout << "\nKept " << m_NumberOfStreamedFibers << " fibers after filtering" << std::endl;
+
+        if (trkWriter)
+        {
+            trkWriter->EndStreaming();
+            delete trkWriter;
+            return;
+        }
+
+        m_Output->SetPoints(m_StreamedPoints);
+        if (m_ComputeLocalColors)
+            this->ComputeAdditionalScalarMaps();
+
+        m_Output->GetPointData()->AddArray(m_StreamedWeights);
+
+        anima::ShapesWriter writer;
+        writer.SetInputData(m_Output);
+        writer.SetFileName(m_OutputFileName);
+        writer.Update();
+
+        m_StreamedPoints = ITK_NULLPTR;
+        m_StreamedWeights = ITK_NULLPTR;
+        return;
+    }
 
     for (unsigned int j = 0;j < this->GetNumberOfWorkUnits();++j)
     {
@@ -342,6 +441,21 @@ BaseProbabilisticTractographyImageFilter <TInputModelImageType>
         {
             if (tmpFibers[j].size() > m_MinLengthFiber / m_StepProgression)
             {
+                if (m_StreamOutput)
+                {
+                    CompactFiberType compactFiber;
+                    compactFiber.weight = tmpWeights[j];
+                    compactFiber.points.resize(3 * tmpFibers[j].size());
+                    for (unsigned int k = 0;k < tmpFibers[j].size();++k)
+                    {
+                        for (unsigned int l = 0;l < 3;++l)
+                            compactFiber.points[3 * k + l] = tmpFibers[j][k][l];
+                    }
+
+                    this->PushStreamedFiber(compactFiber);
+                    continue;
+                }
+
                 resultFibers.push_back(tmpFibers[j]);
                 resultWeights.push_back(tmpWeights[j]);
             }
@@ -349,6 +463,104 @@ BaseProbabilisticTractographyImageFilter <TInputModelImageType>
     }
 }
 
+template <class TInputModelImageType>
+void
+BaseProbabilisticTractographyImageFilter <TInputModelImageType>
+::PushStreamedFiber(CompactFiberType &fiber)
+{
+    std::unique_lock <std::mutex> queueLock(m_StreamingQueueLock);
+    m_StreamingQueueNotFull.wait(queueLock, [this] {return m_StreamingQueue.size() < m_StreamingQueueSize;});
+
+    m_StreamingQueue.push_back(CompactFiberType());
+    m_StreamingQueue.back().points.swap(fiber.points);
+    m_StreamingQueue.back().weight = fiber.weight;
+
+    queueLock.unlock();
+    m_StreamingQueueNotEmpty.notify_one();
+}
+
+template <class TInputModelImageType>
+void
+BaseProbabilisticTractographyImageFilter <TInputModelImageType>
+::WriteStreamedFibers(anima::TRKWriter *trkWriter)
+{
+    CompactFiberType fiber;
+    std::vector <float> pointWeights;
+
+    std::unique_lock <std::mutex> queueLock(m_StreamingQueueLock);
+    while (true)
+    {
+        m_StreamingQueueNotEmpty.wait(queueLock, [this] {return (!m_StreamingQueue.empty())||(m_StreamingDone);});
+
+        // Queue is empty only if all tracking threads are done
+        if (m_StreamingQueue.empty())
+            break;
+
+        fiber.points.swap(m_StreamingQueue.front().points);
+        fiber.weight = m_StreamingQueue.front().weight;
+        m_StreamingQueue.pop_front();
+
+        queueLock.unlock();
+        m_StreamingQueueNotFull.notify_one();
+
+        // After a write error, fibers are still consumed so that tracking threads never wait on a full queue
+        if (!m_StreamingError)
+        {
+            try
+            {
+                if (trkWriter)
+                {
+                    unsigned int numPoints = fiber.points.size() / 3;
+                    pointWeights.resize(numPoints);
+                    std::fill(pointWeights.begin(),pointWeights.end(),fiber.weight);
+                    trkWriter->WriteTrack(fiber.points.data(),numPoints,pointWeights.data());
+                }
+                else
+                    this->AppendFiberToOutput(fiber);
+
+                ++m_NumberOfStreamedFibers;
+            }
+            catch (...)
+            {
+                m_StreamingError = std::current_exception();
+            }
+        }
+
+        queueLock.lock();
+    }
+}
+
+template <class TInputModelImageType>
+void
+BaseProbabilisticTractographyImageFilter <TInputModelImageType>
+::StopStreamedFibersWriter(std::thread &writerThread)
+{
+    m_StreamingQueueLock.lock();
+    m_StreamingDone = true;
+    m_StreamingQueueLock.unlock();
+    m_StreamingQueueNotEmpty.notify_all();
+
+    if (writerThread.joinable())
+        writerThread.join();
+}
+
+template <class TInputModelImageType>
+void
+BaseProbabilisticTractographyImageFilter <TInputModelImageType>
+::AppendFiberToOutput(const CompactFiberType &fiber)
+{
+    unsigned int npts = fiber.points.size() / 3;
+    std::vector <vtkIdType> ids(npts);
+
+    for (unsigned int j = 0;j < npts;++j)
+    {
+        ids[j] = m_StreamedPoints->InsertNextPoint(fiber.points[3 * j],fiber.points[3 * j + 1],fiber.points[3 * j + 2]);
+        m_StreamedWeights->InsertNextValue(fiber.weight);
+    }
+
+    m_Output->InsertNextCell(VTK_POLY_LINE, npts, ids.data());
+}
+
 template <class TInputModelImageType>
 typename BaseProbabilisticTractographyImageFilter <TInputModelImageType>::FiberProcessVectorType
 BaseProbabilisticTractographyImageFilter <TInputModelImageType>
@@ -8,6 +8,9 @@
 
 #include <vtkPointData.h>
 #include <vtkCellData.h>
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
 
 namespace anima
 {
@@ -33,26 +36,61 @@ void BaseTractographyImageFilter::Update()
     m_NumberOfProcessedPoints = 0;
     this->UpdateProgress(0.0);
 
-    std::vector <FiberType> resultFibers;
-    
+    m_PhysicalToIndexMatrix = m_SeedingImage->GetPhysicalPointToIndex();
+    if (m_FilteringImage.IsNotNull())
+    {
+        // Filtering index = F^-1 (seeding origin + S index - filtering origin), F and S being index to physical matrices
+        MatrixType filteringPhysicalToIndex = m_FilteringImage->GetPhysicalPointToIndex();
+        m_SeedingToFilteringMatrix = filteringPhysicalToIndex * m_SeedingImage->GetIndexToPhysicalPoint();
+
+        PointType seedingOrigin = m_SeedingImage->GetOrigin();
+        PointType filteringOrigin = m_FilteringImage->GetOrigin();
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            m_SeedingToFilteringOffset[i] = 0;
+            for (unsigned int j = 0;j < 3;++j)
+                m_SeedingToFilteringOffset[i] += filteringPhysicalToIndex(i,j) * (seedingOrigin[j] - filteringOrigin[j]);
+        }
+    }
+
+    m_TrackingWorkspaces.resize(this->GetNumberOfWorkUnits());
+    for (unsigned int i = 0;i < this->GetNumberOfWorkUnits();++i)
+        m_TrackingWorkspaces[i].modelValue.SetSize(1);
+
     trackerArguments tmpStr;
     tmpStr.trackerPtr = this;
-    for (unsigned int i = 0;i < this->GetNumberOfWorkUnits();++i)
-        tmpStr.resultFibersFromThreads.push_back(resultFibers);
+    tmpStr.resultFibersFromThreads.resize(this->GetNumberOfWorkUnits());
 
     this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
     this->GetMultiThreader()->SetSingleMethod(this->ThreadTracker,&tmpStr);
     this->GetMultiThreader()->SingleMethodExecute();
     
+    // Merge thread results, keeping only fibers going through all filtering labels
+    FiberSetType resultFibers;
+    size_t numTrackedFibers = 0;
     for (unsigned int j = 0;j < this->GetNumberOfWorkUnits();++j)
     {
-        resultFibers.insert(resultFibers.end(),tmpStr.resultFibersFromThreads[j].begin(),
-                            tmpStr.resultFibersFromThreads[j].end());
+        FiberSetType &threadFibers = tmpStr.resultFibersFromThreads[j];
+        numTrackedFibers += threadFibers.GetNumberOfFibers();
+
+        for (size_t i = 0;i < threadFibers.GetNumberOfFibers();++i)
+        {
+            size_t startPoint = threadFibers.fiberOffsets[i];
+            size_t numPoints = threadFibers.fiberOffsets[i + 1] - startPoint;
+            const float *fiberPoints = threadFibers.points.data() + 3 * startPoint;
+
+            if (!this->CheckFiberFiltering(fiberPoints,numPoints))
+                continue;
+
+            resultFibers.points.insert(resultFibers.points.end(),fiberPoints,fiberPoints + 3 * numPoints);
+            resultFibers.fiberOffsets.push_back(resultFibers.points.size() / 3);
+        }
+
+        threadFibers = FiberSetType();
     }
     
-    std::cout << "\nTracked a total of " << resultFibers.size() << " fibers" << std::endl;
-    resultFibers = this->FilterOutputFibers(resultFibers);
-    std::cout << "Kept " << resultFibers.size() << " fibers after filtering" << std::endl;
+    std::cout << "\nTracked a total of " << numTrackedFibers << " fibers" << std::endl;
+    std::cout << "Kept " << resultFibers.GetNumberOfFibers() << " fibers after filtering" << std::endl;
     this->createVTKOutput(resultFibers);
 }
 
@@ -158,7 +196,7 @@ ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION BaseTractographyImageFilter::ThreadTr
     return ITK_THREAD_RETURN_DEFAULT_VALUE;
 }
 
-void BaseTractographyImageFilter::ThreadTrack(unsigned int numThread, std::vector <FiberType> &resultFibers)
+void BaseTractographyImageFilter::ThreadTrack(unsigned int numThread, FiberSetType &resultFibers)
 {
     bool continueLoop = true;
     unsigned int highestToleratedSeedIndex = m_PointsToProcess.size();
@@ -199,25 +237,22 @@ void BaseTractographyImageFilter::ThreadTrack(unsigned int numThread, std::vecto
     }
 }
 
-void BaseTractographyImageFilter::ThreadedTrackComputer(unsigned int numThread, std::vector <FiberType> &resultFibers,
+void BaseTractographyImageFilter::ThreadedTrackComputer(unsigned int numThread, FiberSetType &resultFibers,
                                                         unsigned int startSeedIndex, unsigned int endSeedIndex)
 {    
     std::vector <PointType> initialDirections;
-    VectorType modelValue;
+    TrackingWorkspaceType &workspace = m_TrackingWorkspaces[numThread];
+    VectorType &modelValue = workspace.modelValue;
     bool is2d = (m_SeedingImage->GetLargestPossibleRegion().GetSize()[2] <= 1);
-    FiberType tmpFiber;
     ContinuousIndexType curIndex;
     IndexType curNearestIndex;
-    PointType initialPoint;
 
     for (unsigned int i = startSeedIndex;i < endSeedIndex;++i)
     {
         bool treatPoint = true;
 
         curIndex = m_PointsToProcess[i];
-        m_SeedingImage->TransformContinuousIndexToPhysicalPoint(m_PointsToProcess[i],initialPoint);
-        m_SeedingImage->TransformPhysicalPointToIndex(initialPoint,curNearestIndex);
-        modelValue.SetSize(1);
+        this->GetNearestIndex(curIndex,curNearestIndex);
 
         if (!m_CutMaskImage.IsNull())
         {
@@ -240,215 +275,205 @@ void BaseTractographyImageFilter::ThreadedTrackComputer(unsigned int numThread,
 
         this->GetModelValue(curIndex,modelValue);
         if (isZero(modelValue))
-            treatPoint = false;
+            continue;
 
         if (!this->CheckModelCompatibility(modelValue,numThread))
-            treatPoint = false;
+            continue;
 
         initialDirections = this->GetModelPrincipalDirections(modelValue, is2d, numThread);
 
         unsigned int numDirections = initialDirections.size();
         for (unsigned int j = 0;j < numDirections;++j)
         {
-            tmpFiber.clear();
-            tmpFiber.push_back(initialPoint);
-            this->ComputeFiber(tmpFiber,initialDirections[j],numThread);
-        
-            if (tmpFiber.size() > m_MinLengthFiber / m_StepProgression)
-                resultFibers.push_back(tmpFiber);
+            if (!this->ComputeFiber(curIndex,initialDirections[j],numThread))
+                continue;
+
+            size_t numPoints = 1 + (workspace.forwardPoints.size() + workspace.backwardPoints.size()) / 3;
+            if (numPoints > m_MinLengthFiber / m_StepProgression)
+                this->AppendWorkspaceFiber(curIndex,workspace,resultFibers);
         }
     }
 }
 
-std::vector < std::vector <BaseTractographyImageFilter::PointType> >
-BaseTractographyImageFilter::FilterOutputFibers(std::vector < FiberType > &fibers)
+void BaseTractographyImageFilter::AppendWorkspaceFiber(ContinuousIndexType &seedIndex, TrackingWorkspaceType &workspace,
+                                                       FiberSetType &fibers)
 {
-    std::vector < FiberType > resVal;
-    
-    if (m_FilteringValues.size() > 1)
+    const std::vector <float> &backwardPoints = workspace.backwardPoints;
+    const std::vector <float> &forwardPoints = workspace.forwardPoints;
+    size_t numBackwardPoints = backwardPoints.size() / 3;
+
+    size_t fiberStart = fibers.points.size();
+    fibers.points.resize(fiberStart + backwardPoints.size() + 3 + forwardPoints.size());
+    float *fiberPoints = fibers.points.data() + fiberStart;
+
+    for (size_t i = 0;i < numBackwardPoints;++i)
     {
-        std::vector <bool> touchingLabels(m_FilteringValues.size());
-        IndexType tmpIndex;
-        PointType tmpPoint;
-        for (unsigned int i = 0;i < fibers.size();++i)
+        for (unsigned int j = 0;j < 3;++j)
+            fiberPoints[3 * i + j] = backwardPoints[3 * (numBackwardPoints - 1 - i) + j];
+    }
+
+    fiberPoints += 3 * numBackwardPoints;
+    for (unsigned int j = 0;j < 3;++j)
+        fiberPoints[j] = seedIndex[j];
+
+    std::copy(forwardPoints.begin(),forwardPoints.end(),fiberPoints + 3);
+    fibers.fiberOffsets.push_back(fibers.points.size() / 3);
+}
+
+bool BaseTractographyImageFilter::CheckFiberFiltering(const float *fiberPoints, size_t numPoints)
+{
+    if (m_FilteringValues.size() <= 1)
+        return true;
+
+    std::vector <bool> touchingLabels(m_FilteringValues.size(),false);
+    IndexType tmpIndex;
+    ContinuousIndexType tmpContinuousIndex;
+    for (size_t j = 0;j < numPoints;++j)
+    {
+        for (unsigned int k = 0;k < 3;++k)
         {
-            std::fill(touchingLabels.begin(),touchingLabels.end(),false);
-            for (unsigned int j = 0;j < fibers[i].size();++j)
-            {
-                tmpPoint = fibers[i][j];
-                m_FilteringImage->TransformPhysicalPointToIndex(tmpPoint,tmpIndex);
-                
-                unsigned int maskValue = m_FilteringImage->GetPixel(tmpIndex);
-                if (maskValue != 0)
-                {
-                    for (unsigned int k = 0;k < m_FilteringValues.size();++k)
-                    {
-                        if (maskValue == m_FilteringValues[k])
-                        {
-                            touchingLabels[k] = true;
-                            break;
-                        }
-                    }
-                }
-            }
-            
-            bool keepFiber = true;
-            for (unsigned int k = 0;k < touchingLabels.size();++k)
+            tmpContinuousIndex[k] = m_SeedingToFilteringOffset[k];
+            for (unsigned int l = 0;l < 3;++l)
+                tmpContinuousIndex[k] += m_SeedingToFilteringMatrix(k,l) * fiberPoints[3 * j + l];
+        }
+
+        this->GetNearestIndex(tmpContinuousIndex,tmpIndex);
+        if (!this->CheckIndexInImageBounds(tmpIndex,m_FilteringImage))
+            continue;
+
+        unsigned int maskValue = m_FilteringImage->GetPixel(tmpIndex);
+        if (maskValue != 0)
+        {
+            for (unsigned int k = 0;k < m_FilteringValues.size();++k)
             {
-                if (!touchingLabels[k])
+                if (maskValue == m_FilteringValues[k])
                 {
-                    keepFiber = false;
+                    touchingLabels[k] = true;
                     break;
                 }
             }
-            
-            if (keepFiber)
-                resVal.push_back(fibers[i]);
         }
     }
-    else
-        resVal = fibers;
-    
-    return resVal;
-}
 
-void BaseTractographyImageFilter::createVTKOutput(std::vector < FiberType > &filteredFibers)
-{
-    m_Output = vtkPolyData::New();
-    m_Output->Initialize();
-    m_Output->Allocate();
-    
-    vtkSmartPointer <vtkPoints> myPoints = vtkPoints::New();    
-    for (unsigned int i = 0;i < filteredFibers.size();++i)
+    for (unsigned int k = 0;k < touchingLabels.size();++k)
     {
-        unsigned int npts = filteredFibers[i].size();
-        vtkIdType* ids = new vtkIdType[npts];
-        
-        for (unsigned int j = 0;j < npts;++j)
-            ids[j] = myPoints->InsertNextPoint(filteredFibers[i][j][0],filteredFibers[i][j][1],filteredFibers[i][j][2]);
-        
-        m_Output->InsertNextCell (VTK_POLY_LINE, npts, ids);
-        delete[] ids;
-    }
-    
-    m_Output->SetPoints (myPoints);
-    if (m_ComputeLocalColors)
-    {
-        std::cout << "Computing local colors and microstructure maps" << std::endl;
-        this->ComputeAdditionalScalarMaps();
+        if (!touchingLabels[k])
+            return false;
     }
+
+    return true;
 }
 
-void
-BaseTractographyImageFilter::ComputeFiber(BaseTractographyImageFilter::FiberType &fiber, PointType &initialDirection,
-                                          itk::ThreadIdType threadId)
+void BaseTractographyImageFilter::createVTKOutput(FiberSetType &filteredFibers)
 {
-    bool is2d = m_InputImage->GetLargestPossibleRegion().GetSize()[2] == 1;
-    
-    PointType curPoint = fiber[0];
-    PointType oldDir, newDir;
-    oldDir = initialDirection;
-    newDir = initialDirection;
+    m_Output = vtkPolyData::New();
+    m_Output->Initialize();
 
-    ContinuousIndexType curIndex;
-    IndexType curNearestIndex;
-    bool continueLoop = true;
-    VectorType modelValue;
-    modelValue.SetSize(1);
+    size_t numPoints = filteredFibers.points.size() / 3;
+    size_t numFibers = filteredFibers.GetNumberOfFibers();
 
-    this->GetModelValue(curIndex,modelValue);
-    // Go the forward way starting along initial direction provided
-    while (continueLoop)
-    {
-        oldDir = newDir;
-        newDir = this->GetNextDirection(oldDir,modelValue,is2d,threadId);
+    // Points from index space to physical space, written directly in the point array
+    vtkSmartPointer <vtkFloatArray> pointCoordinates = vtkSmartPointer <vtkFloatArray>::New();
+    pointCoordinates->SetNumberOfComponents(3);
+    pointCoordinates->SetNumberOfTuples(numPoints);
+    float *coordinates = pointCoordinates->GetPointer(0);
 
-        if (anima::ComputeOrientationAngle(oldDir, newDir) > m_MaxFiberAngle)
+    MatrixType indexToPhysicalMatrix = m_SeedingImage->GetIndexToPhysicalPoint();
+    PointType origin = m_SeedingImage->GetOrigin();
+    for (size_t i = 0;i < numPoints;++i)
+    {
+        const float *index = filteredFibers.points.data() + 3 * i;
+        for (unsigned int j = 0;j < 3;++j)
         {
-            continueLoop = false;
-            break;
+            double coordinate = origin[j];
+            for (unsigned int k = 0;k < 3;++k)
+                coordinate += indexToPhysicalMatrix(j,k) * index[k];
+
+            coordinates[3 * i + j] = coordinate;
         }
+    }
 
-        this->ComputeNewFiberPoint(fiber[fiber.size() - 1],newDir,curPoint,threadId);
+    vtkSmartPointer <vtkPoints> myPoints = vtkSmartPointer <vtkPoints>::New();
+    myPoints->SetData(pointCoordinates);
 
-        m_SeedingImage->TransformPhysicalPointToContinuousIndex(curPoint,curIndex);
-        m_SeedingImage->TransformPhysicalPointToIndex(curPoint,curNearestIndex);
+    // Fibers are consecutive runs of points, written in one preallocated legacy cell array (count, then point ids)
+    vtkSmartPointer <vtkIdTypeArray> cellData = vtkSmartPointer <vtkIdTypeArray>::New();
+    cellData->SetNumberOfValues(numFibers + numPoints);
+    vtkIdType *cellValues = cellData->GetPointer(0);
+    for (size_t i = 0;i < numFibers;++i)
+    {
+        vtkIdType fiberStart = filteredFibers.fiberOffsets[i];
+        vtkIdType fiberEnd = filteredFibers.fiberOffsets[i + 1];
 
-        if (!m_CutMaskImage.IsNull())
+        *cellValues = fiberEnd - fiberStart;
+        ++cellValues;
+        for (vtkIdType j = fiberStart;j < fiberEnd;++j)
         {
-            if (!this->CheckIndexInImageBounds(curNearestIndex,m_CutMaskImage))
-                continueLoop = false;
-            else if (m_CutMaskImage->GetPixel(curNearestIndex) != 0)
-                continueLoop = false;
-        }
-
-        if (!m_ForbiddenMaskImage.IsNull())
-        {
-            if (!this->CheckIndexInImageBounds(curNearestIndex,m_ForbiddenMaskImage))
-            {
-                fiber.clear();
-                return;
-            }
-            if (m_ForbiddenMaskImage->GetPixel(curNearestIndex) != 0)
-            {
-                fiber.clear();
-                return;
-            }
+            *cellValues = j;
+            ++cellValues;
         }
+    }
 
-        if (!this->CheckIndexInImageBounds(curIndex))
-            continueLoop = false;
-        else
-        {
-            this->GetModelValue(curIndex,modelValue);
+    vtkSmartPointer <vtkCellArray> fiberLines = vtkSmartPointer <vtkCellArray>::New();
+    fiberLines->SetCells(numFibers,cellData);
 
-            if (isZero(modelValue))
-                continueLoop = false;
-        }
+    m_Output->SetPoints(myPoints);
+    m_Output->SetLines(fiberLines);
 
-        if (!this->CheckModelCompatibility(modelValue,threadId))
-            continueLoop = false;
+    if (m_ComputeLocalColors)
+    {
+        std::cout << "Computing local colors and microstructure maps" << std::endl;
+        this->ComputeAdditionalScalarMaps();
+    }
+}
 
-        // Add new point to fiber
-        if (continueLoop)
-            fiber.push_back(curPoint);
+bool BaseTractographyImageFilter::ComputeFiber(ContinuousIndexType &seedIndex, PointType &initialDirection,
+                                               itk::ThreadIdType threadId)
+{
+    TrackingWorkspaceType &workspace = m_TrackingWorkspaces[threadId];
+    workspace.forwardPoints.clear();
+    workspace.backwardPoints.clear();
 
-        if (fiber.size() > m_MaxLengthFiber / m_StepProgression)
-        {
-            fiber.clear();
-            return;
-        }
-    }
+    // Go the forward way starting along initial direction provided
+    if (!this->TrackFiberSide(seedIndex,initialDirection,1,workspace.forwardPoints,threadId))
+        return false;
 
-    curPoint = fiber[0];
-    oldDir = initialDirection;
+    // Now go the backwards way to complete the fiber
+    PointType backwardDirection;
     for (unsigned int i = 0;i < 3;++i)
-        oldDir[i] *= -1.0;
+        backwardDirection[i] = - initialDirection[i];
 
-    newDir = oldDir;
-    continueLoop = true;
-    m_SeedingImage->TransformPhysicalPointToContinuousIndex(curPoint,curIndex);
-    m_SeedingImage->TransformPhysicalPointToIndex(curPoint,curNearestIndex);
+    unsigned int numForwardPoints = workspace.forwardPoints.size() / 3;
+    return this->TrackFiberSide(seedIndex,backwardDirection,1 + numForwardPoints,workspace.backwardPoints,threadId);
+}
 
-    modelValue.SetSize(1);
-    this->GetModelValue(curIndex,modelValue);
+bool BaseTractographyImageFilter::TrackFiberSide(ContinuousIndexType &seedIndex, PointType &initialDirection,
+                                                 unsigned int numOtherPoints, std::vector <float> &sidePoints,
+                                                 itk::ThreadIdType threadId)
+{
+    bool is2d = m_InputImage->GetLargestPossibleRegion().GetSize()[2] == 1;
+    VectorType &modelValue = m_TrackingWorkspaces[threadId].modelValue;
 
-    // Now go the backwards way to complete the fiber
+    ContinuousIndexType curIndex = seedIndex;
+    ContinuousIndexType newIndex;
+    IndexType curNearestIndex;
+    PointType oldDir, newDir;
+    newDir = initialDirection;
+
+    unsigned int numPoints = numOtherPoints;
+    bool continueLoop = true;
+
+    this->GetModelValue(curIndex,modelValue);
     while (continueLoop)
     {
         oldDir = newDir;
         newDir = this->GetNextDirection(oldDir,modelValue,is2d,threadId);
 
         if (anima::ComputeOrientationAngle(oldDir, newDir) > m_MaxFiberAngle)
-        {
-            continueLoop = false;
             break;
-        }
 
-        this->ComputeNewFiberPoint(fiber[0],newDir,curPoint,threadId);
-
-        m_SeedingImage->TransformPhysicalPointToContinuousIndex(curPoint,curIndex);
-        m_SeedingImage->TransformPhysicalPointToIndex(curPoint,curNearestIndex);
+        this->ComputeNewFiberPoint(curIndex,newDir,newIndex,modelValue,threadId);
+        this->GetNearestIndex(newIndex,curNearestIndex);
 
         if (!m_CutMaskImage.IsNull())
         {
@@ -461,22 +486,17 @@ BaseTractographyImageFilter::ComputeFiber(BaseTractographyImageFilter::FiberType
         if (!m_ForbiddenMaskImage.IsNull())
         {
             if (!this->CheckIndexInImageBounds(curNearestIndex,m_ForbiddenMaskImage))
-            {
-                fiber.clear();
-                return;
-            }
+                return false;
+
             if (m_ForbiddenMaskImage->GetPixel(curNearestIndex) != 0)
-            {
-                fiber.clear();
-                return;
-            }
+                return false;
         }
 
-        if (!this->CheckIndexInImageBounds(curIndex))
+        if (!this->CheckIndexInImageBounds(newIndex))
             continueLoop = false;
         else
         {
-            this->GetModelValue(curIndex,modelValue);
+            this->GetModelValue(newIndex,modelValue);
 
             if (isZero(modelValue))
                 continueLoop = false;
@@ -485,99 +505,98 @@ BaseTractographyImageFilter::ComputeFiber(BaseTractographyImageFilter::FiberType
         if (!this->CheckModelCompatibility(modelValue,threadId))
             continueLoop = false;
 
-        // Now add point to fiber
+        // Add new point to fiber
         if (continueLoop)
-            fiber.insert(fiber.begin(),1,curPoint);
-
-        if (fiber.size() > m_MaxLengthFiber / m_StepProgression)
         {
-            fiber.clear();
-            return;
+            for (unsigned int i = 0;i < 3;++i)
+                sidePoints.push_back(newIndex[i]);
+
+            curIndex = newIndex;
+            ++numPoints;
         }
+
+        if (numPoints > m_MaxLengthFiber / m_StepProgression)
+            return false;
     }
+
+    return true;
 }
 
-void BaseTractographyImageFilter::ComputeNewFiberPoint(PointType &oldPoint, PointType &newDirection, PointType &newPoint,
+void BaseTractographyImageFilter::ComputeNewFiberPoint(ContinuousIndexType &oldIndex, PointType &newDirection,
+                                                       ContinuousIndexType &newIndex, VectorType &modelValue,
                                                        itk::ThreadIdType threadId)
 {
     PointType k1, k2, k3, k4;
-    PointType kPosition;
-    ContinuousIndexType curIndex;
-    VectorType modelValue;
+    PointType combinedDirection;
+    ContinuousIndexType kIndex;
 
     bool is2d = (m_InputImage->GetLargestPossibleRegion().GetSize()[2] <= 1);
 
-    for (unsigned int i = 0;i < 3;++i)
-    {
-        k1[i] = newDirection[i];
-        kPosition[i] = oldPoint[i] + m_StepProgression * k1[i] / 2.0;
-    }
+    k1 = newDirection;
+    this->MoveIndex(oldIndex,k1,m_StepProgression / 2.0,kIndex);
 
-    m_SeedingImage->TransformPhysicalPointToContinuousIndex(kPosition,curIndex);
-    if (!this->CheckIndexInImageBounds(curIndex))
+    if (!this->CheckIndexInImageBounds(kIndex))
     {
-        for (unsigned int i = 0;i < 3;++i)
-            newPoint[i] = kPosition[i];
-
+        newIndex = kIndex;
         return;
     }
 
-    this->GetModelValue(curIndex,modelValue);
+    this->GetModelValue(kIndex,modelValue);
     if (isZero(modelValue))
     {
-        for (unsigned int i = 0;i < 3;++i)
-            newPoint[i] = kPosition[i];
-
+        newIndex = kIndex;
         return;
     }
 
     k2 = this->GetNextDirection(k1,modelValue,is2d,threadId);
-    for (unsigned int i = 0;i < 3;++i)
-        kPosition[i] = oldPoint[i] + m_StepProgression * k2[i] / 2.0;
+    this->MoveIndex(oldIndex,k2,m_StepProgression / 2.0,kIndex);
 
-    m_SeedingImage->TransformPhysicalPointToContinuousIndex(kPosition,curIndex);
-    if (!this->CheckIndexInImageBounds(curIndex))
+    if (!this->CheckIndexInImageBounds(kIndex))
     {
         for (unsigned int i = 0;i < 3;++i)
-            newPoint[i] = oldPoint[i] + m_StepProgression * (k1[i] + 2.0 * k2[i]) / 3.0;
+            combinedDirection[i] = (k1[i] + 2.0 * k2[i]) / 3.0;
 
+        this->MoveIndex(oldIndex,combinedDirection,m_StepProgression,newIndex);
         return;
     }
 
-    this->GetModelValue(curIndex,modelValue);
+    this->GetModelValue(kIndex,modelValue);
     if (isZero(modelValue))
     {
         for (unsigned int i = 0;i < 3;++i)
-            newPoint[i] = oldPoint[i] + m_StepProgression * (k1[i] + 2.0 * k2[i]) / 3.0;
+            combinedDirection[i] = (k1[i] + 2.0 * k2[i]) / 3.0;
 
+        this->MoveIndex(oldIndex,combinedDirection,m_StepProgression,newIndex);
         return;
     }
 
     k3 = this->GetNextDirection(k2,modelValue,is2d,threadId);
-    for (unsigned int i = 0;i < 3;++i)
-        kPosition[i] = oldPoint[i] + m_StepProgression * k3[i];
+    this->MoveIndex(oldIndex,k3,m_StepProgression,kIndex);
 
-    m_SeedingImage->TransformPhysicalPointToContinuousIndex(kPosition,curIndex);
-    if (!this->CheckIndexInImageBounds(curIndex))
+    if (!this->CheckIndexInImageBounds(kIndex))
     {
         for (unsigned int i = 0;i < 3;++i)
-            newPoint[i] = oldPoint[i] + m_StepProgression * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i]) / 5.0;
+            combinedDirection[i] = (k1[i] + 2.0 * k2[i] + 2.0 * k3[i]) / 5.0;
 
+        this->MoveIndex(oldIndex,combinedDirection,m_StepProgression,newIndex);
         return;
     }
 
-    this->GetModelValue(curIndex,modelValue);
+    this->GetModelValue(kIndex,modelValue);
     if (isZero(modelValue))
     {
         for (unsigned int i = 0;i < 3;++i)
-            newPoint[i] = oldPoint[i] + m_StepProgression * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i]) / 5.0;
+            combinedDirection[i] = (k1[i] + 2.0 * k2[i] + 2.0 * k3[i]) / 5.0;
 
+        this->MoveIndex(oldIndex,combinedDirection,m_StepProgression,newIndex);
         return;
     }
 
     k4 = this->GetNextDirection(k3,modelValue,is2d,threadId);
     for (unsigned int i = 0;i < 3;++i)
-        newPoint[i] = oldPoint[i] + (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]) * m_StepProgression / 6.0;
+        combinedDirection[i] = (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]) / 6.0;
+
+    this->MoveIndex(oldIndex,combinedDirection,m_StepProgression,newIndex);
 }
 
 bool BaseTractographyImageFilter::CheckIndexInImageBounds(IndexType &index, ImageBaseType *testImage)
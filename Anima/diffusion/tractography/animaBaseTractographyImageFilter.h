@@ -2,6 +2,7 @@
 
 #include <itkVectorImage.h>
 #include <itkImage.h>
+#include <itkMath.h>
 
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
@@ -39,12 +40,32 @@ public:
     typedef MaskImageType::PointType PointType;
     typedef MaskImageType::IndexType IndexType;
     
-    typedef std::vector <PointType> FiberType;
-    typedef std::vector <FiberType> FiberVectorType;
-    
+    typedef MaskImageType::DirectionType MatrixType;
+
+    /**
+     * Set of fibers stored contiguously: continuous indexes of their points as interleaved float32 coordinates, fiber i
+     * spanning points fiberOffsets[i] to fiberOffsets[i+1] (excluded)
+     */
+    struct FiberSetType
+    {
+        std::vector <float> points;
+        std::vector <size_t> fiberOffsets;
+
+        FiberSetType() : fiberOffsets(1,0) {}
+        size_t GetNumberOfFibers() const {return fiberOffsets.size() - 1;}
+    };
+
+    //! Per thread tracking buffers, reused from one fiber to the next
+    struct TrackingWorkspaceType
+    {
+        //! Points tracked on each side of the seed (in tracking order), float32 interleaved continuous indexes
+        std::vector <float> forwardPoints, backwardPoints;
+        VectorType modelValue;
+    };
+
     typedef struct {
         BaseTractographyImageFilter *trackerPtr;
-        std::vector <FiberVectorType> resultFibersFromThreads;
+        std::vector <FiberSetType> resultFibersFromThreads;
     } trackerArguments;
     
     virtual void SetInputImage(ModelImageType *input) {m_InputImage = input;}
@@ -66,7 +87,8 @@ public:
     void Update() ITK_OVERRIDE;
     
     void SetComputeLocalColors(bool flag) {m_ComputeLocalColors = flag;}
-    void createVTKOutput(std::vector < std::vector <PointType> > &filteredFibers);
+    //! Builds the output poly data (physical points and lines) in bulk from fibers in index space
+    void createVTKOutput(FiberSetType &filteredFibers);
     vtkPolyData *GetOutput() {return m_Output;}
     
 protected:
@@ -74,14 +96,27 @@ protected:
     virtual ~BaseTractographyImageFilter() {}
 
     static ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION ThreadTracker(void *arg);
-    void ThreadTrack(unsigned int numThread, std::vector <FiberType> &resultFibers);
-    void ThreadedTrackComputer(unsigned int numThread, std::vector <FiberType> &resultFibers,
+    void ThreadTrack(unsigned int numThread, FiberSetType &resultFibers);
+    void ThreadedTrackComputer(unsigned int numThread, FiberSetType &resultFibers,
                                unsigned int startSeedIndex, unsigned int endSeedIndex);
     
-    void ComputeFiber(FiberType &fiber, PointType &initialDirection, itk::ThreadIdType threadId);
+    //! Tracks both sides of a fiber from its seed into the thread workspace, returns false if the fiber is discarded
+    bool ComputeFiber(ContinuousIndexType &seedIndex, PointType &initialDirection, itk::ThreadIdType threadId);
+
+    /**
+     * Tracks one side of a fiber, appending points to sidePoints. numOtherPoints is the number of points of the fiber
+     * already tracked. Returns false if the fiber is discarded (forbidden area or too long)
+     */
+    bool TrackFiberSide(ContinuousIndexType &seedIndex, PointType &initialDirection, unsigned int numOtherPoints,
+                        std::vector <float> &sidePoints, itk::ThreadIdType threadId);
+
+    //! Appends the fiber held by a thread workspace (backward side reversed, seed, forward side) to a fiber set
+    void AppendWorkspaceFiber(ContinuousIndexType &seedIndex, TrackingWorkspaceType &workspace, FiberSetType &fibers);
     
     virtual void PrepareTractography();
-    std::vector < FiberType > FilterOutputFibers(std::vector < FiberType > &fibers);
+
+    //! True if a fiber (in index space) touches all labels of the filtering mask
+    bool CheckFiberFiltering(const float *fiberPoints, size_t numPoints);
     
     virtual bool CheckModelCompatibility(VectorType &modelValue, itk::ThreadIdType threadId) = 0;
 
@@ -95,8 +130,30 @@ protected:
     virtual std::vector <PointType> GetModelPrincipalDirections(VectorType &modelValue, bool is2d, itk::ThreadIdType threadId) = 0;
     virtual PointType GetNextDirection(PointType &previousDirection, VectorType &modelValue, bool is2d, itk::ThreadIdType threadId) = 0;
 
-    //! Computes new fiber point using Runge Kutta integration (better spread of fibers than Euler integration)
-    virtual void ComputeNewFiberPoint(PointType &oldPoint, PointType &newDirection, PointType &newPoint, itk::ThreadIdType threadId);
+    /**
+     * Computes new fiber point using Runge Kutta integration (better spread of fibers than Euler integration). Points
+     * are continuous indexes, directions are physical. modelValue is used as scratch for intermediate model values
+     */
+    virtual void ComputeNewFiberPoint(ContinuousIndexType &oldIndex, PointType &newDirection, ContinuousIndexType &newIndex,
+                                      VectorType &modelValue, itk::ThreadIdType threadId);
+
+    //! Moves a continuous index by a physical displacement (direction times length), using the precomputed index matrix
+    void MoveIndex(const ContinuousIndexType &index, const PointType &direction, double length, ContinuousIndexType &movedIndex)
+    {
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            movedIndex[i] = index[i];
+            for (unsigned int j = 0;j < 3;++j)
+                movedIndex[i] += length * m_PhysicalToIndexMatrix(i,j) * direction[j];
+        }
+    }
+
+    //! Nearest voxel of a continuous index, as ITK physical point to index transform
+    void GetNearestIndex(const ContinuousIndexType &index, IndexType &nearestIndex)
+    {
+        for (unsigned int i = 0;i < 3;++i)
+            nearestIndex[i] = itk::Math::RoundHalfIntegerUp <IndexType::IndexValueType> (index[i]);
+    }
 
     virtual void ComputeAdditionalScalarMaps() {}
     bool isZero(VectorType &value);
@@ -117,6 +174,14 @@ private:
     
     std::vector <ContinuousIndexType> m_PointsToProcess;
     std::vector <unsigned int> m_FilteringValues;
+
+    //! Physical to continuous index matrix of the seeding image, fibers being tracked in its index space
+    MatrixType m_PhysicalToIndexMatrix;
+
+    //! Affine map from seeding image continuous index to filtering image continuous index
+    MatrixType m_SeedingToFilteringMatrix;
+    PointType m_SeedingToFilteringOffset;
+    std::vector <TrackingWorkspaceType> m_TrackingWorkspaces;
     
     bool m_ComputeLocalColors;
     vtkSmartPointer<vtkPolyData> m_Output;
@@ -75,7 +75,76 @@ bool dtiTractographyImageFilter::CheckIndexInImageBounds(ContinuousIndexType &in
 void
 dtiTractographyImageFilter::GetModelValue(ContinuousIndexType &index, VectorType &modelValue)
 {
-    modelValue = m_DTIInterpolator->EvaluateAtContinuousIndex(index);
+    // Trilinear interpolation directly on the image buffer (same border handling as the linear interpolator), writing
+    // into the caller's vector so that no allocation happens along fibers
+    ModelImageType *inputImage = this->GetInputImage();
+    RegionType bufferedRegion = inputImage->GetBufferedRegion();
+    unsigned int vectorSize = inputImage->GetNumberOfComponentsPerPixel();
+
+    if (modelValue.GetSize() != vectorSize)
+        modelValue.SetSize(vectorSize);
+    modelValue.Fill(0.0);
+
+    long int baseIndex[3];
+    double distance[3];
+    size_t offsetTable[3];
+    offsetTable[0] = vectorSize;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        long int startIndex = bufferedRegion.GetIndex()[i];
+        long int endIndex = startIndex + bufferedRegion.GetSize()[i] - 1;
+
+        baseIndex[i] = itk::Math::Floor <long int> (index[i]);
+        distance[i] = index[i] - baseIndex[i];
+
+        if (baseIndex[i] < startIndex)
+        {
+            baseIndex[i] = startIndex;
+            distance[i] = 0.0;
+        }
+        else if (baseIndex[i] >= endIndex)
+        {
+            baseIndex[i] = endIndex;
+            distance[i] = 0.0;
+        }
+
+        baseIndex[i] -= startIndex;
+        if (i > 0)
+            offsetTable[i] = offsetTable[i - 1] * bufferedRegion.GetSize()[i - 1];
+    }
+
+    const double *bufferPointer = inputImage->GetBufferPointer();
+    const double *basePointer = bufferPointer + baseIndex[0] * offsetTable[0] + baseIndex[1] * offsetTable[1] +
+            baseIndex[2] * offsetTable[2];
+
+    for (unsigned int corner = 0;corner < 8;++corner)
+    {
+        double weight = 1.0;
+        size_t cornerOffset = 0;
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            if (corner & (1 << i))
+            {
+                if (distance[i] == 0.0)
+                {
+                    weight = 0.0;
+                    break;
+                }
+
+                weight *= distance[i];
+                cornerOffset += offsetTable[i];
+            }
+            else
+                weight *= 1.0 - distance[i];
+        }
+
+        if (weight == 0.0)
+            continue;
+
+        const double *cornerValue = basePointer + cornerOffset;
+        for (unsigned int j = 0;j < vectorSize;++j)
+            modelValue[j] += weight * cornerValue[j];
+    }
 }
 
 std::vector <dtiTractographyImageFilter::PointType>
@@ -0,0 +1,352 @@
+#include "animaFibersVoxelizer.h"
+
+#include <itkMath.h>
+
+#include <vtkCellArray.h>
+#include <vtkIdList.h>
+#include <vtkPoints.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+
+//! Number of fibers processed by a work unit each time it claims work
+const size_t FiberBatchSize = 1024;
+
+//! Number of voxels summed at once when merging the counts of the work units
+const size_t MergeChunkSize = 65536;
+
+}
+
+namespace anima
+{
+
+void FibersVoxelizer::VoxelGridType::Initialize(const GeometryType *image)
+{
+    physicalToIndex = image->GetPhysicalPointToIndex();
+    origin = image->GetOrigin();
+    startIndex = image->GetLargestPossibleRegion().GetIndex();
+    size = image->GetLargestPossibleRegion().GetSize();
+}
+
+int64_t FibersVoxelizer::VoxelGridType::GetVoxel(const double *point) const
+{
+    int64_t voxelIndex = 0;
+    for (int i = 2;i >= 0;--i)
+    {
+        double continuousIndex = 0;
+        for (unsigned int j = 0;j < 3;++j)
+            continuousIndex += physicalToIndex(i,j) * (point[j] - origin[j]);
+
+        int64_t index = itk::Math::RoundHalfIntegerUp <int64_t> (continuousIndex) - startIndex[i];
+        if ((index < 0) || (index >= static_cast <int64_t> (size[i])))
+            return -1;
+
+        voxelIndex = voxelIndex * size[i] + index;
+    }
+
+    return voxelIndex;
+}
+
+FibersVoxelizer::FibersVoxelizer()
+{
+    m_ComputeTrackDensity = false;
+    m_ComputeEndpointsDensity = false;
+
+    m_NumberOfWorkUnits = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+    m_MaximalCountsMemory = (size_t)1 << 30;
+
+    m_TouchMask = 0;
+    m_EndingsMask = 0;
+    m_ForbiddenMask = 0;
+    m_UseLabelQueries = false;
+
+    m_NextFiber = 0;
+    m_NumberOfKeptFibers = 0;
+}
+
+void FibersVoxelizer::InitializeLabelQueries()
+{
+    m_LabelBitmaps.clear();
+    m_TouchMask = 0;
+    m_EndingsMask = 0;
+    m_ForbiddenMask = 0;
+
+    m_UseLabelQueries = m_LabelImage.IsNotNull() &&
+            (!m_TouchLabels.empty() || !m_EndingsLabels.empty() || !m_ForbiddenLabels.empty());
+
+    if (!m_UseLabelQueries)
+        return;
+
+    std::vector <unsigned int> touchLabels = m_TouchLabels;
+    std::sort(touchLabels.begin(),touchLabels.end());
+    touchLabels.erase(std::unique(touchLabels.begin(),touchLabels.end()),touchLabels.end());
+
+    std::vector <unsigned int> endingsLabels = m_EndingsLabels;
+    std::sort(endingsLabels.begin(),endingsLabels.end());
+    endingsLabels.erase(std::unique(endingsLabels.begin(),endingsLabels.end()),endingsLabels.end());
+
+    // One bit per touch and endings label, the last one being for forbidden labels
+    if (touchLabels.size() + endingsLabels.size() > 63)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Too many touch and endings labels (at most 63)",ITK_LOCATION);
+
+    const unsigned int maxLabel = std::numeric_limits <LabelImageType::PixelType>::max();
+    m_LabelBitmaps.resize(maxLabel + 1,0);
+
+    unsigned int bit = 0;
+    for (unsigned int i = 0;i < touchLabels.size();++i,++bit)
+    {
+        m_TouchMask |= (uint64_t)1 << bit;
+        if (touchLabels[i] <= maxLabel)
+            m_LabelBitmaps[touchLabels[i]] |= (uint64_t)1 << bit;
+    }
+
+    for (unsigned int i = 0;i < endingsLabels.size();++i,++bit)
+    {
+        m_EndingsMask |= (uint64_t)1 << bit;
+        if (endingsLabels[i] <= maxLabel)
+            m_LabelBitmaps[endingsLabels[i]] |= (uint64_t)1 << bit;
+    }
+
+    m_ForbiddenMask = (uint64_t)1 << 63;
+    for (unsigned int i = 0;i < m_ForbiddenLabels.size();++i)
+    {
+        if (m_ForbiddenLabels[i] <= maxLabel)
+            m_LabelBitmaps[m_ForbiddenLabels[i]] |= m_ForbiddenMask;
+    }
+
+    m_LabelGrid.Initialize(m_LabelImage);
+}
+
+void FibersVoxelizer::Update()
+{
+    if (!m_InputTracks)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"No input tracks",ITK_LOCATION);
+
+    bool computeDensities = m_ComputeTrackDensity || m_ComputeEndpointsDensity;
+    if (computeDensities && m_Geometry.IsNull())
+        throw itk::ExceptionObject(__FILE__, __LINE__,"A geometry is required to compute density maps",ITK_LOCATION);
+
+    this->InitializeLabelQueries();
+
+    this->BuildLinesTable();
+
+    size_t numFibers = m_InputTracks->GetNumberOfLines();
+    m_KeptFibers.resize(numFibers);
+    std::fill(m_KeptFibers.begin(),m_KeptFibers.end(),0);
+
+    unsigned int numWorkUnits = std::max(m_NumberOfWorkUnits,1U);
+    m_TrackCounts.clear();
+    m_EndpointsCounts.clear();
+
+    if (computeDensities)
+    {
+        m_DensityGrid.Initialize(m_Geometry);
+        size_t numVoxels = m_Geometry->GetLargestPossibleRegion().GetNumberOfPixels();
+
+        // Limit the number of copies of the counts to the allowed memory
+        size_t countsMemory = numVoxels * sizeof(uint32_t) * ((m_ComputeTrackDensity ? 1 : 0) + (m_ComputeEndpointsDensity ? 1 : 0));
+        size_t maxCopies = std::max((size_t)1,m_MaximalCountsMemory / std::max(countsMemory,(size_t)1));
+        numWorkUnits = std::min((size_t)numWorkUnits,maxCopies);
+
+        if (m_ComputeTrackDensity)
+            m_TrackCounts.resize(numWorkUnits,std::vector <uint32_t> (numVoxels,0));
+
+        if (m_ComputeEndpointsDensity)
+            m_EndpointsCounts.resize(numWorkUnits,std::vector <uint32_t> (numVoxels,0));
+    }
+
+    m_NextFiber = 0;
+
+    m_Threader = itk::MultiThreaderBase::New();
+    m_Threader->SetNumberOfWorkUnits(numWorkUnits);
+    m_Threader->SetSingleMethod(this->ThreadVoxelizer,this);
+    m_Threader->SingleMethodExecute();
+
+    m_NumberOfKeptFibers = std::count(m_KeptFibers.begin(),m_KeptFibers.end(),1);
+
+    std::vector <vtkIdType> ().swap(m_LineOffsets);
+    std::vector <vtkIdType> ().swap(m_LinePointIds);
+
+    m_TrackDensityImage = ITK_NULLPTR;
+    m_EndpointsDensityImage = ITK_NULLPTR;
+
+    if (m_ComputeTrackDensity)
+        m_TrackDensityImage = this->MergeCounts(m_TrackCounts);
+
+    if (m_ComputeEndpointsDensity)
+        m_EndpointsDensityImage = this->MergeCounts(m_EndpointsCounts);
+}
+
+void FibersVoxelizer::BuildLinesTable()
+{
+    vtkCellArray *lines = m_InputTracks->GetLines();
+    size_t numFibers = m_InputTracks->GetNumberOfLines();
+
+    m_LineOffsets.resize(numFibers + 1);
+    m_LineOffsets[0] = 0;
+    m_LinePointIds.clear();
+    m_LinePointIds.reserve(m_InputTracks->GetNumberOfPoints());
+
+    vtkSmartPointer <vtkIdList> idList = vtkSmartPointer <vtkIdList>::New();
+    lines->InitTraversal();
+    for (size_t i = 0;i < numFibers;++i)
+    {
+        lines->GetNextCell(idList);
+        for (vtkIdType j = 0;j < idList->GetNumberOfIds();++j)
+            m_LinePointIds.push_back(idList->GetId(j));
+
+        m_LineOffsets[i + 1] = m_LinePointIds.size();
+    }
+}
+
+ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION FibersVoxelizer::ThreadVoxelizer(void *arg)
+{
+    itk::MultiThreaderBase::WorkUnitInfo *threadArgs = (itk::MultiThreaderBase::WorkUnitInfo *)arg;
+    unsigned int nbThread = threadArgs->WorkUnitID;
+
+    FibersVoxelizer *voxelizer = (FibersVoxelizer *)threadArgs->UserData;
+    voxelizer->ThreadVoxelize(nbThread);
+
+    return ITK_THREAD_RETURN_DEFAULT_VALUE;
+}
+
+void FibersVoxelizer::ThreadVoxelize(unsigned int workUnit)
+{
+    vtkPoints *points = m_InputTracks->GetPoints();
+    size_t numFibers = m_KeptFibers.size();
+
+    uint32_t *trackCounts = m_ComputeTrackDensity ? m_TrackCounts[workUnit].data() : ITK_NULLPTR;
+    uint32_t *endpointsCounts = m_ComputeEndpointsDensity ? m_EndpointsCounts[workUnit].data() : ITK_NULLPTR;
+
+    double pointPosition[3];
+
+    while (true)
+    {
+        size_t startFiber = m_NextFiber.fetch_add(FiberBatchSize);
+        if (startFiber >= numFibers)
+            break;
+
+        size_t endFiber = std::min(startFiber + FiberBatchSize,numFibers);
+        for (size_t i = startFiber;i < endFiber;++i)
+        {
+            vtkIdType numPoints = m_LineOffsets[i + 1] - m_LineOffsets[i];
+            const vtkIdType *pointIds = m_LinePointIds.data() + m_LineOffsets[i];
+
+            if (m_UseLabelQueries && !this->CheckFiber(numPoints,pointIds,points))
+                continue;
+
+            m_KeptFibers[i] = 1;
+
+            if (trackCounts)
+            {
+                for (vtkIdType j = 0;j < numPoints;++j)
+                {
+                    points->GetPoint(pointIds[j],pointPosition);
+                    int64_t voxel = m_DensityGrid.GetVoxel(pointPosition);
+                    if (voxel >= 0)
+                        ++trackCounts[voxel];
+                }
+            }
+
+            if (endpointsCounts && (numPoints > 0))
+            {
+                points->GetPoint(pointIds[0],pointPosition);
+                int64_t voxel = m_DensityGrid.GetVoxel(pointPosition);
+                if (voxel >= 0)
+                    ++endpointsCounts[voxel];
+
+                points->GetPoint(pointIds[numPoints - 1],pointPosition);
+                voxel = m_DensityGrid.GetVoxel(pointPosition);
+                if (voxel >= 0)
+                    ++endpointsCounts[voxel];
+            }
+        }
+    }
+}
+
+bool FibersVoxelizer::CheckFiber(vtkIdType numPoints, const vtkIdType *pointIds, vtkPoints *points)
+{
+    const LabelImageType::PixelType *labels = m_LabelImage->GetBufferPointer();
+    double pointPosition[3];
+
+    // First test endings, if not right, useless to continue
+    if (m_EndingsMask != 0)
+    {
+        vtkIdType upIndexStart = std::max(static_cast <vtkIdType> (5),numPoints / 20);
+        upIndexStart = std::min(upIndexStart,numPoints);
+        vtkIdType lowIndexEnd = numPoints - upIndexStart;
+
+        uint64_t seenEndings = 0;
+        for (vtkIdType j = 0;j < numPoints;++j)
+        {
+            if (j == upIndexStart)
+                j = std::max(j,lowIndexEnd);
+
+            points->GetPoint(pointIds[j],pointPosition);
+            int64_t voxel = m_LabelGrid.GetVoxel(pointPosition);
+            if (voxel >= 0)
+                seenEndings |= m_LabelBitmaps[labels[voxel]];
+        }
+
+        if ((seenEndings & m_EndingsMask) != m_EndingsMask)
+            return false;
+    }
+
+    // Then test forbidden and touched labels
+    uint64_t seenLabels = 0;
+    for (vtkIdType j = 0;j < numPoints;++j)
+    {
+        points->GetPoint(pointIds[j],pointPosition);
+        int64_t voxel = m_LabelGrid.GetVoxel(pointPosition);
+        if (voxel < 0)
+            continue;
+
+        uint64_t labelBitmap = m_LabelBitmaps[labels[voxel]];
+        if (labelBitmap & m_ForbiddenMask)
+            return false;
+
+        seenLabels |= labelBitmap;
+    }
+
+    return (seenLabels & m_TouchMask) == m_TouchMask;
+}
+
+FibersVoxelizer::DensityImageType::Pointer FibersVoxelizer::MergeCounts(std::vector < std::vector <uint32_t> > &counts)
+{
+    DensityImageType::Pointer densityImage = DensityImageType::New();
+    densityImage->Initialize();
+    densityImage->SetRegions(m_Geometry->GetLargestPossibleRegion());
+    densityImage->SetOrigin(m_Geometry->GetOrigin());
+    densityImage->SetSpacing(m_Geometry->GetSpacing());
+    densityImage->SetDirection(m_Geometry->GetDirection());
+    densityImage->Allocate();
+
+    double *densityValues = densityImage->GetBufferPointer();
+    size_t numVoxels = densityImage->GetLargestPossibleRegion().GetNumberOfPixels();
+    size_t numChunks = (numVoxels + MergeChunkSize - 1) / MergeChunkSize;
+
+    m_Threader->ParallelizeArray(0,numChunks,[&counts,densityValues,numVoxels](itk::SizeValueType chunk)
+    {
+        size_t startVoxel = chunk * MergeChunkSize;
+        size_t endVoxel = std::min(startVoxel + MergeChunkSize,numVoxels);
+
+        for (size_t i = startVoxel;i < endVoxel;++i)
+        {
+            uint64_t value = 0;
+            for (unsigned int j = 0;j < counts.size();++j)
+                value += counts[j][i];
+
+            densityValues[i] = value;
+        }
+    }, ITK_NULLPTR);
+
+    // Release the work unit counts
+    std::vector < std::vector <uint32_t> > ().swap(counts);
+
+    return densityImage;
+}
+
+} // end namespace anima
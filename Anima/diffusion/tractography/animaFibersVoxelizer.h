@@ -0,0 +1,142 @@
+#pragma once
+
+#include <itkImage.h>
+#include <itkMultiThreaderBase.h>
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+#include "AnimaTractographyExport.h"
+
+namespace anima
+{
+
+/**
+ * @brief Maps the fibers (lines) of a tractogram to voxels, in parallel and in a single pass over the fibers.
+ *
+ * Two queries are available, each point being mapped to its nearest voxel:
+ * - ROI queries on a label image: a fiber is kept if it touches all touch labels, has its endings (first and last 5% of
+ * its points, at least 5 points) touching all endings labels, and does not touch any forbidden label. Labels are
+ * turned into a lookup table of bitmaps (one bit per touch and endings label, one for forbidden labels), so that
+ * each point costs one voxel read and one table read.
+ * - Density maps on a geometry image: number of fiber points in each voxel (track density), and number of fiber
+ * extremities in each voxel (endpoints density). Only fibers kept by the ROI queries (all if there is none) are
+ * counted. Each work unit accumulates in its own counts, merged at the end.
+ *
+ * Counts cost 4 bytes per voxel and per density map for each work unit. The number of work units is reduced so that
+ * all counts fit in the maximal counts memory (1 GB by default), down to a single work unit when one copy of the
+ * counts already exceeds it.
+ */
+class ANIMATRACTOGRAPHY_EXPORT FibersVoxelizer
+{
+public:
+    typedef itk::Image <unsigned short, 3> LabelImageType;
+    typedef itk::ImageBase <3> GeometryType;
+    typedef itk::Image <double, 3> DensityImageType;
+
+    FibersVoxelizer();
+    ~FibersVoxelizer() {}
+
+    void SetInputTracks(vtkPolyData *tracks) {m_InputTracks = tracks;}
+
+    void SetLabelImage(LabelImageType *image) {m_LabelImage = image;}
+    void SetTouchLabels(const std::vector <unsigned int> &labels) {m_TouchLabels = labels;}
+    void SetEndingsLabels(const std::vector <unsigned int> &labels) {m_EndingsLabels = labels;}
+    void SetForbiddenLabels(const std::vector <unsigned int> &labels) {m_ForbiddenLabels = labels;}
+
+    //! Geometry of the density maps, required if any of them is computed
+    void SetGeometry(GeometryType *geometry) {m_Geometry = geometry;}
+    void SetComputeTrackDensity(bool val) {m_ComputeTrackDensity = val;}
+    void SetComputeEndpointsDensity(bool val) {m_ComputeEndpointsDensity = val;}
+
+    void SetNumberOfWorkUnits(unsigned int val) {m_NumberOfWorkUnits = val;}
+
+    //! Memory (in bytes) allowed for the per work unit counts of the density maps
+    void SetMaximalCountsMemory(size_t val) {m_MaximalCountsMemory = val;}
+
+    void Update();
+
+    //! One value per line of the input tracks, non zero if the fiber passes the ROI queries
+    const std::vector <unsigned char> &GetKeptFibers() const {return m_KeptFibers;}
+    size_t GetNumberOfKeptFibers() const {return m_NumberOfKeptFibers;}
+
+    DensityImageType *GetTrackDensityImage() {return m_TrackDensityImage;}
+    DensityImageType *GetEndpointsDensityImage() {return m_EndpointsDensityImage;}
+
+protected:
+    //! Physical point to voxel mapping of an image grid
+    struct VoxelGridType
+    {
+        GeometryType::DirectionType physicalToIndex;
+        GeometryType::PointType origin;
+        GeometryType::IndexType startIndex;
+        GeometryType::SizeType size;
+
+        void Initialize(const GeometryType *image);
+
+        //! Linear index (x fastest) of the nearest voxel of a point, -1 if outside
+        int64_t GetVoxel(const double *point) const;
+    };
+
+    //! Builds the label bitmaps and the bit masks that fibers have to match
+    void InitializeLabelQueries();
+
+    static ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION ThreadVoxelizer(void *arg);
+
+    //! Processes batches of fibers until none is left, accumulating in the counts of the work unit
+    void ThreadVoxelize(unsigned int workUnit);
+
+    //! Copies the point ids of all lines into a flat table, so that work units can read any line (on any VTK version)
+    void BuildLinesTable();
+
+    //! ROI queries on one fiber given its point ids
+    bool CheckFiber(vtkIdType numPoints, const vtkIdType *pointIds, vtkPoints *points);
+
+    //! Sums the counts of all work units into a density image
+    DensityImageType::Pointer MergeCounts(std::vector < std::vector <uint32_t> > &counts);
+
+private:
+    vtkSmartPointer <vtkPolyData> m_InputTracks;
+
+    LabelImageType::Pointer m_LabelImage;
+    std::vector <unsigned int> m_TouchLabels, m_EndingsLabels, m_ForbiddenLabels;
+
+    GeometryType::Pointer m_Geometry;
+    bool m_ComputeTrackDensity;
+    bool m_ComputeEndpointsDensity;
+
+    unsigned int m_NumberOfWorkUnits;
+    size_t m_MaximalCountsMemory;
+    itk::MultiThreaderBase::Pointer m_Threader;
+
+    VoxelGridType m_LabelGrid;
+    VoxelGridType m_DensityGrid;
+
+    //! Bitmap of each label value: bits of the touch labels, then of the endings labels, then the forbidden bit
+    std::vector <uint64_t> m_LabelBitmaps;
+    uint64_t m_TouchMask;
+    uint64_t m_EndingsMask;
+    uint64_t m_ForbiddenMask;
+    bool m_UseLabelQueries;
+
+    //! Point ids of line i are m_LinePointIds[m_LineOffsets[i]] to m_LinePointIds[m_LineOffsets[i + 1] - 1]
+    std::vector <vtkIdType> m_LineOffsets;
+    std::vector <vtkIdType> m_LinePointIds;
+
+    std::atomic <size_t> m_NextFiber;
+    std::vector <unsigned char> m_KeptFibers;
+    size_t m_NumberOfKeptFibers;
+
+    //! Per work unit counts
+    std::vector < std::vector <uint32_t> > m_TrackCounts;
+    std::vector < std::vector <uint32_t> > m_EndpointsCounts;
+
+    DensityImageType::Pointer m_TrackDensityImage;
+    DensityImageType::Pointer m_EndpointsDensityImage;
+};
+
+} // end namespace anima
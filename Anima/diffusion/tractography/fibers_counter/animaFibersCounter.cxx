@@ -7,10 +7,11 @@
 #include <vtkPoints.h>
 #include <vtkPointData.h>
 #include <vtkPolyData.h>
-#include <vtkCell.h>
 
 #include <itkCastImageFilter.h>
 
+#include <animaFibersVoxelizer.h>
+
 int main(int argc, char **argv)
 {
     TCLAP::CmdLine cmd("Filters fibers from a vtp file using a label image and specifying with several -t and -f which labels should be touched or are forbidden for each fiber. INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
@@ -19,8 +20,17 @@ int main(int argc, char **argv)
     TCLAP::ValueArg<std::string> outArg("o","output","output mask image",true,"","output mask image",cmd);
     TCLAP::ValueArg<std::string> geomArg("g","geometry","Geometry image",true,"","geometry image",cmd);
 
+    TCLAP::ValueArg<std::string> endpointsArg("E","endpoints","output fiber endpoints count image",false,"","endpoints image",cmd);
+
     TCLAP::SwitchArg proportionArg("P","proportion","Output proportion of fibers going through each pixel",cmd,false);
 
+    TCLAP::ValueArg<std::string> roiArg("r","roi","ROI label image to select counted fibers",false,"","ROI image",cmd);
+    TCLAP::MultiArg<unsigned int> touchArg("t", "touch", "Labels that have to be touched by counted fibers",false,"touched labels",cmd);
+    TCLAP::MultiArg<unsigned int> endingsArg("e", "endings", "Labels that have to be touched by the endings of counted fibers",false,"endings labels",cmd);
+    TCLAP::MultiArg<unsigned int> forbiddenArg("f", "forbid", "Labels that must not to be touched by counted fibers",false,"forbidden labels",cmd);
+
+    TCLAP::ValueArg<unsigned int> nbThreadsArg("T","nb-threads","Number of threads to run on (default: all available)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
+
     try
     {
         cmd.parse(argc,argv);
@@ -31,9 +41,8 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    typedef itk::Image <double, 3> OutputImageType;
-    OutputImageType::Pointer outputImage = anima::readImage <OutputImageType> (geomArg.getValue());
-    outputImage->FillBuffer(0.0);
+    typedef anima::FibersVoxelizer::DensityImageType OutputImageType;
+    OutputImageType::Pointer geometryImage = anima::readImage <OutputImageType> (geomArg.getValue());
 
     anima::ShapesReader trackReader;
     trackReader.SetFileName(inArg.getValue());
@@ -41,62 +50,65 @@ int main(int argc, char **argv)
 
     vtkSmartPointer <vtkPolyData> tracks = trackReader.GetOutput();
 
-    vtkIdType nbCells = tracks->GetNumberOfCells();
-    double incrementFactor = 1.0;
-    if (proportionArg.isSet())
-        incrementFactor /= nbCells;
-
-    double ptVals[3];
-    OutputImageType::IndexType currentIndex;
-    OutputImageType::PointType currentPoint;
-    OutputImageType::RegionType region = outputImage->GetLargestPossibleRegion();
+    anima::FibersVoxelizer voxelizer;
+    voxelizer.SetInputTracks(tracks);
+    voxelizer.SetGeometry(geometryImage);
+    voxelizer.SetComputeTrackDensity(true);
+    voxelizer.SetComputeEndpointsDensity(endpointsArg.getValue() != "");
+    voxelizer.SetNumberOfWorkUnits(nbThreadsArg.getValue());
 
-    // Explores individual fibers
-    for (int j = 0;j < nbCells;++j)
+    if (roiArg.getValue() != "")
     {
-        vtkCell *cell = tracks->GetCell(j);
-        vtkPoints *cellPts = cell->GetPoints();
-        vtkIdType nbPts = cellPts->GetNumberOfPoints();
+        voxelizer.SetLabelImage(anima::readImage <anima::FibersVoxelizer::LabelImageType> (roiArg.getValue()));
+        voxelizer.SetTouchLabels(touchArg.getValue());
+        voxelizer.SetEndingsLabels(endingsArg.getValue());
+        voxelizer.SetForbiddenLabels(forbiddenArg.getValue());
+    }
 
-        // Explores points in fibers
-        for (int i = 0;i < nbPts;++i)
-        {
-            cellPts->GetPoint(i,ptVals);
-
-            for (unsigned int k = 0;k < 3;++k)
-                currentPoint[k] = ptVals[k];
-
-            outputImage->TransformPhysicalPointToIndex(currentPoint,currentIndex);
-            bool insideBuffer = true;
-            for (unsigned int k = 0;k < 3;++k)
-            {
-                if ((currentIndex[k] < 0)||(currentIndex[k] >= region.GetSize(k)))
-                {
-                    insideBuffer = false;
-                    break;
-                }
-            }
-
-            if (!insideBuffer)
-                continue;
-
-            double countIndex = outputImage->GetPixel(currentIndex) + incrementFactor;
-            outputImage->SetPixel(currentIndex, countIndex);
-        }
+    voxelizer.Update();
+
+    if (roiArg.getValue() != "")
+        std::cout << "Counted " << voxelizer.GetNumberOfKeptFibers() << " fibers out of " << tracks->GetNumberOfLines() << std::endl;
+
+    std::vector <OutputImageType::Pointer> outputImages(1,voxelizer.GetTrackDensityImage());
+    std::vector <std::string> outputNames(1,outArg.getValue());
+    if (endpointsArg.getValue() != "")
+    {
+        outputImages.push_back(voxelizer.GetEndpointsDensityImage());
+        outputNames.push_back(endpointsArg.getValue());
     }
 
-    if (proportionArg.isSet())
-        anima::writeImage <OutputImageType> (outArg.getValue(),outputImage);
-    else
+    // Proportions are relative to the fibers actually counted
+    size_t numCountedFibers = tracks->GetNumberOfLines();
+    if (roiArg.getValue() != "")
+        numCountedFibers = voxelizer.GetNumberOfKeptFibers();
+
+    double incrementFactor = 1.0;
+    if (proportionArg.isSet() && (numCountedFibers > 0))
+        incrementFactor /= numCountedFibers;
+
+    for (unsigned int i = 0;i < outputImages.size();++i)
     {
-        using MaskImageType = itk::Image <unsigned int, 3>;
-        using CastFilterType = itk::CastImageFilter <OutputImageType, MaskImageType>;
+        if (proportionArg.isSet())
+        {
+            double *outputValues = outputImages[i]->GetBufferPointer();
+            size_t numVoxels = outputImages[i]->GetLargestPossibleRegion().GetNumberOfPixels();
+            for (size_t j = 0;j < numVoxels;++j)
+                outputValues[j] *= incrementFactor;
 
-        CastFilterType::Pointer castFilter = CastFilterType::New();
-        castFilter->SetInput(outputImage);
-        castFilter->Update();
+            anima::writeImage <OutputImageType> (outputNames[i],outputImages[i]);
+        }
+        else
+        {
+            using MaskImageType = itk::Image <unsigned int, 3>;
+            using CastFilterType = itk::CastImageFilter <OutputImageType, MaskImageType>;
 
-        anima::writeImage <MaskImageType> (outArg.getValue(), castFilter->GetOutput());
+            CastFilterType::Pointer castFilter = CastFilterType::New();
+            castFilter->SetInput(outputImages[i]);
+            castFilter->Update();
+
+            anima::writeImage <MaskImageType> (outputNames[i], castFilter->GetOutput());
+        }
     }
 
     return EXIT_SUCCESS;
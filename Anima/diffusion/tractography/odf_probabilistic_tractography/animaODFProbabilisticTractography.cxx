@@ -65,6 +65,7 @@ int main(int argc,  char*  argv[])
 
     TCLAP::SwitchArg averageClustersArg("M","average-clusters","Output only cluster mean",cmd,false);
     TCLAP::SwitchArg addLocalDataArg("L","local-data","Add local data information to output tracks",cmd);
+    TCLAP::SwitchArg streamArg("","stream","Stream fibers to the output while tracking, bounding memory (TRK output uses the B0 image as reference)",cmd,false);
 
     TCLAP::ValueArg<unsigned int> nbThreadsArg("T","nb-threads","Number of threads to run on (default: all available)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
@@ -132,6 +133,12 @@ int main(int argc,  char*  argv[])
     bool computeLocalColors = (fibersArg.getValue().find(".fds") != std::string::npos) && (addLocalDataArg.isSet());
     odfTracker->SetComputeLocalColors(computeLocalColors);
     odfTracker->SetMAPMergeFibers(averageClustersArg.getValue());
+
+    if (streamArg.isSet())
+    {
+        odfTracker->SetStreamOutput(true);
+        odfTracker->SetOutputFileName(fibersArg.getValue());
+    }
     
     itk::CStyleCommand::Pointer callback = itk::CStyleCommand::New();
     callback->SetCallback(eventCallback);
@@ -146,6 +153,10 @@ int main(int argc,  char*  argv[])
     tmpTime.Stop();
     std::cout << "Tracking time: " << tmpTime.GetTotal() << "s" << std::endl;
     
+    // Streamed output is written by the tracker itself
+    if (streamArg.isSet())
+        return EXIT_SUCCESS;
+
     anima::ShapesWriter writer;
     writer.SetInputData(odfTracker->GetOutput());
     writer.SetFileName(fibersArg.getValue());
@@ -105,6 +105,12 @@ int main(int ac, const char** av)
                                                 "Patch search neighborhood size",
                                                 cmd);
 
+    TCLAP::SwitchArg fastArg("F",
+                             "fast",
+                             "Compute patch distances for all voxels at once per displacement (faster, same result)",
+                             cmd,
+                             false);
+
     try
     {
         cmd.parse(ac,av);
@@ -158,6 +164,7 @@ int main(int ac, const char** av)
             if (weightMethod.getValue())
                 filter->SetWeightMethod(FilterType::RICIAN);
 
+            filter->SetUseFastPath(fastArg.isSet());
             filter->SetNumberOfWorkUnits(nbpArg.getValue());
 
             filter->AddObserver(itk::ProgressEvent(), callback );
@@ -197,6 +204,7 @@ int main(int ac, const char** av)
             if (weightMethod.getValue())
                 filter->SetWeightMethod(FilterType::RICIAN);
 
+            filter->SetUseFastPath(fastArg.isSet());
             filter->SetNumberOfWorkUnits(nbpArg.getValue());
 
             filter->AddObserver(itk::ProgressEvent(), callback );
@@ -250,6 +258,7 @@ int main(int ac, const char** av)
             if (weightMethod.getValue())
                 filter->SetWeightMethod(FilterType::RICIAN);
 
+            filter->SetUseFastPath(fastArg.isSet());
             filter->SetNumberOfWorkUnits(nbpArg.getValue());
 
             filter->AddObserver(itk::ProgressEvent(), callback );
@@ -67,6 +67,14 @@ public:
     itkSetMacro(VarMinThreshold, double)
     itkSetMacro(WeightMethod, WEIGHT)
 
+    /**
+     * Fast path: patch distances of all voxels are computed at once for each displacement,
+     * as separable box sums of squared differences, instead of patch by patch. Numerically
+     * equivalent to the standard patch search (up to summation order of patch distances)
+     */
+    itkSetMacro(UseFastPath, bool)
+    itkGetMacro(UseFastPath, bool)
+
 protected:
     NonLocalMeansImageFilter() :
         m_MeanMinThreshold(0.95),
@@ -77,6 +85,7 @@ protected:
         m_SearchStepSize(3),
         m_SearchNeighborhood(6),
         m_WeightMethod(EXP),
+        m_UseFastPath(false),
         m_localNeighborhood(1)
 
     {}
@@ -92,6 +101,12 @@ private:
     void computeAverageLocalVariance();
     void computeMeanAndVarImages();
 
+    //! Fast path threaded generate data, loops on displacements and computes patch distances for the whole region
+    void FastThreadedGenerateData(const OutputImageRegionType &outputRegionForThread);
+
+    //! Denoised value from the weighted sum of samples (squared samples for Rician noise), sum and maximum of weights
+    OutputPixelType ComputeDenoisedValue(double inputValue, double weightedSum, double weightSum, double maxWeight);
+
     double m_MeanMinThreshold;
     double m_VarMinThreshold;
     double m_WeightThreshold;
@@ -101,6 +116,7 @@ private:
     unsigned int m_SearchStepSize;
     unsigned int m_SearchNeighborhood;
     WEIGHT m_WeightMethod;
+    bool m_UseFastPath;
 
     double m_noiseCovariance;
     OutputImagePointer m_meanImage;
@@ -103,6 +103,12 @@ void
 NonLocalMeansImageFilter < TInputImage >
 ::DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread)
 {
+    if (m_UseFastPath)
+    {
+        this->FastThreadedGenerateData(outputRegionForThread);
+        return;
+    }
+
     // Allocate output
     typename OutputImageType::Pointer output = this->GetOutput();
     typename InputImageType::Pointer input = const_cast<InputImageType *> (this->GetInput());
@@ -141,49 +147,287 @@ NonLocalMeansImageFilter < TInputImage >
         //Compute weighted mean of databaseSamples
         double average = 0, sum = 0, w_max = 0;
 
-        switch (m_WeightMethod)
+        for (unsigned int d = 0;d < databaseSamples.size();++d)
         {
-        case EXP:
-            for (unsigned int d = 0;d < databaseSamples.size();++d)
-            {
+            if (m_WeightMethod == EXP)
                 average += databaseSamples[d] * databaseWeights[d];
-                sum += databaseWeights[d];
+            else
+                average += databaseWeights[d] * (databaseSamples[d] * databaseSamples[d]);
+
+            sum += databaseWeights[d];
+
+            if (w_max < databaseWeights[d])
+                w_max = databaseWeights[d];
+        }
+
+        outputIterator.Set(this->ComputeDenoisedValue(inputIterator.Get(),average,sum,w_max));
+
+        this->IncrementNumberOfProcessedPoints();
+        ++outputIterator;
+        ++inputIterator;
+    }
+}
+
+template <class TInputImage>
+typename NonLocalMeansImageFilter <TInputImage>::OutputPixelType
+NonLocalMeansImageFilter <TInputImage>
+::ComputeDenoisedValue(double inputValue, double weightedSum, double weightSum, double maxWeight)
+{
+    if (weightSum == 0)
+        return inputValue;
+
+    if (m_WeightMethod == EXP)
+        return (weightedSum + maxWeight * inputValue) / (weightSum + maxWeight);
+
+    double t = ((weightedSum + (inputValue * inputValue) * maxWeight) / (weightSum + maxWeight)) - (2.0 * m_noiseCovariance);
+
+    if (t < 0)
+        t = 0;
+
+    return std::sqrt(t);
+}
+
+template <class TInputImage>
+void
+NonLocalMeansImageFilter <TInputImage>
+::FastThreadedGenerateData(const OutputImageRegionType &outputRegionForThread)
+{
+    const InputImageType *input = this->GetInput();
+    const InputPixelType *inputBuffer = input->GetBufferPointer();
+    const OutputPixelType *meanBuffer = m_meanImage->GetBufferPointer();
+    const OutputPixelType *varBuffer = m_varImage->GetBufferPointer();
+    typename InputImageType::SizeType imageSize = input->GetLargestPossibleRegion().GetSize();
+
+    const long halfSize = m_PatchHalfSize;
+    const long maxDisp = m_maxAbsDisp;
+    const long stepSize = m_SearchStepSize;
+
+    // Thread region, and region extended by the patch half size, where squared differences are needed
+    long imageStrides[InputImageDimension];
+    long regionStart[InputImageDimension], regionSize[InputImageDimension];
+    long extendedStart[InputImageDimension], extendedSize[InputImageDimension], extendedStrides[InputImageDimension];
+    unsigned int numRegionVoxels = 1;
+    unsigned int numExtendedVoxels = 1;
+    for (unsigned int d = 0;d < InputImageDimension;++d)
+    {
+        imageStrides[d] = (d == 0) ? 1 : imageStrides[d - 1] * imageSize[d - 1];
+        regionStart[d] = outputRegionForThread.GetIndex()[d];
+        regionSize[d] = outputRegionForThread.GetSize()[d];
+
+        extendedStart[d] = std::max(0L, regionStart[d] - halfSize);
+        long extendedEnd = std::min((long)imageSize[d], regionStart[d] + regionSize[d] + halfSize);
+        extendedSize[d] = extendedEnd - extendedStart[d];
+        extendedStrides[d] = (d == 0) ? 1 : extendedStrides[d - 1] * extendedSize[d - 1];
+
+        numRegionVoxels *= regionSize[d];
+        numExtendedVoxels *= extendedSize[d];
+    }
+
+    std::vector <double> patchDistances(numExtendedVoxels);
+    std::vector <double> lineBuffer;
+    std::vector <double> weightedSums(numRegionVoxels,0.0);
+    std::vector <double> weightSums(numRegionVoxels,0.0);
+    std::vector <double> maxWeights(numRegionVoxels,0.0);
+
+    long position[InputImageDimension];
+    long displacement[InputImageDimension];
+    for (unsigned int d = 0;d < InputImageDimension;++d)
+        displacement[d] = - maxDisp;
+
+    // Displacements are visited in the raster order of the standard search window,
+    // so that weights are accumulated in the same order for each voxel
+    bool displacementsDone = false;
+    while (!displacementsDone)
+    {
+        bool centralDisplacement = true;
+        bool usefulDisplacement = true;
+        long displacementOffset = 0;
+        for (unsigned int d = 0;d < InputImageDimension;++d)
+        {
+            if (displacement[d] != 0)
+                centralDisplacement = false;
 
-                if (w_max < databaseWeights[d])
-                    w_max = databaseWeights[d];
+            displacementOffset += displacement[d] * imageStrides[d];
+
+            // Is there a voxel of the region for which this displacement is on the search grid ?
+            bool onSearchGrid = false;
+            for (long x = regionStart[d];(x < regionStart[d] + regionSize[d]) && (!onSearchGrid);++x)
+            {
+                long y = x + displacement[d];
+                if ((y >= 0)&&(y < (long)imageSize[d])&&((y - std::max(0L, x - maxDisp)) % stepSize == 0))
+                    onSearchGrid = true;
             }
 
-            if (sum != 0)
-                outputIterator.Set((average + w_max * inputIterator.Get()) / (sum + w_max));
-            else
-                outputIterator.Set(inputIterator.Get());
+            if (!onSearchGrid)
+                usefulDisplacement = false;
+        }
 
-            break;
+        if ((!centralDisplacement)&&(usefulDisplacement))
+        {
+            // Squared differences on the extended region, zero where the displaced voxel is outside
+            for (unsigned int d = 0;d < InputImageDimension;++d)
+                position[d] = extendedStart[d];
 
-        case RICIAN:
-            for (unsigned int d=0; d < databaseSamples.size(); d++)
+            for (unsigned int k = 0;k < numExtendedVoxels;++k)
             {
-                average += databaseWeights[d] * (databaseSamples[d] * databaseSamples[d]);
-                sum += databaseWeights[d];
-                if (w_max < databaseWeights[d])
-                    w_max = databaseWeights[d];
+                bool insideImage = true;
+                long offset = 0;
+                for (unsigned int d = 0;d < InputImageDimension;++d)
+                {
+                    long movingPosition = position[d] + displacement[d];
+                    if ((movingPosition < 0)||(movingPosition >= (long)imageSize[d]))
+                        insideImage = false;
+
+                    offset += position[d] * imageStrides[d];
+                }
+
+                double squaredDifference = 0;
+                if (insideImage)
+                {
+                    double diffValue = (double)inputBuffer[offset] - (double)inputBuffer[offset + displacementOffset];
+                    squaredDifference = diffValue * diffValue;
+                }
+
+                patchDistances[k] = squaredDifference;
+
+                for (unsigned int d = 0;d < InputImageDimension;++d)
+                {
+                    ++position[d];
+                    if (position[d] < extendedStart[d] + extendedSize[d])
+                        break;
+
+                    position[d] = extendedStart[d];
+                }
             }
 
-            if (sum != 0)
+            // Separable box sums, windows clipped to the extended region i.e. to the image for region voxels
+            for (unsigned int d = 0;d < InputImageDimension;++d)
             {
-                double t = ((average + (inputIterator.Get() * inputIterator.Get())
-                             * w_max) / (sum + w_max)) - (2.0 * m_noiseCovariance);
+                long lineSize = extendedSize[d];
+                lineBuffer.resize(lineSize);
+                unsigned int numLines = numExtendedVoxels / lineSize;
+
+                for (unsigned int line = 0;line < numLines;++line)
+                {
+                    long lineStart = 0;
+                    unsigned int remainder = line;
+                    for (unsigned int e = 0;e < InputImageDimension;++e)
+                    {
+                        if (e == d)
+                            continue;
+
+                        lineStart += (remainder % extendedSize[e]) * extendedStrides[e];
+                        remainder /= extendedSize[e];
+                    }
+
+                    for (long i = 0;i < lineSize;++i)
+                        lineBuffer[i] = patchDistances[lineStart + i * extendedStrides[d]];
+
+                    for (long i = 0;i < lineSize;++i)
+                    {
+                        long windowEnd = std::min(lineSize - 1, i + halfSize);
+                        double boxSum = 0;
+                        for (long j = std::max(0L, i - halfSize);j <= windowEnd;++j)
+                            boxSum += lineBuffer[j];
+
+                        patchDistances[lineStart + i * extendedStrides[d]] = boxSum;
+                    }
+                }
+            }
 
-                if (t < 0)
-                    t = 0;
+            // Weights for region voxels, with the same validity and conformity tests as the standard search
+            for (unsigned int d = 0;d < InputImageDimension;++d)
+                position[d] = regionStart[d];
 
-                outputIterator.Set(std::sqrt(t));
+            for (unsigned int k = 0;k < numRegionVoxels;++k)
+            {
+                bool validCandidate = true;
+                long dataOffset = 0;
+                long extendedOffset = 0;
+                unsigned int numPatchVoxels = 1;
+
+                for (unsigned int d = 0;d < InputImageDimension;++d)
+                {
+                    long x = position[d];
+                    long y = x + displacement[d];
+                    if ((y < 0)||(y >= (long)imageSize[d])||((y - std::max(0L, x - maxDisp)) % stepSize != 0))
+                    {
+                        validCandidate = false;
+                        break;
+                    }
+
+                    long blockStart = std::max(0L, x - halfSize);
+                    long blockSize = std::min((long)imageSize[d] - 1, x + halfSize) - blockStart + 1;
+                    if ((blockStart + displacement[d] < 0)||(blockStart + displacement[d] + blockSize > (long)imageSize[d]))
+                    {
+                        validCandidate = false;
+                        break;
+                    }
+
+                    numPatchVoxels *= blockSize;
+                    dataOffset += x * imageStrides[d];
+                    extendedOffset += (x - extendedStart[d]) * extendedStrides[d];
+                }
+
+                if (validCandidate)
+                {
+                    long candidateOffset = dataOffset + displacementOffset;
+
+                    double meanRate = (double)meanBuffer[dataOffset] / (double)meanBuffer[candidateOffset];
+                    double varianceRate = (double)varBuffer[dataOffset] / (double)varBuffer[candidateOffset];
+
+                    if ( ( meanRate > m_MeanMinThreshold ) && ( meanRate < ( 1.0 / m_MeanMinThreshold ) ) &&
+                         ( varianceRate > m_VarMinThreshold ) && ( varianceRate < ( 1.0 / m_VarMinThreshold ) ) )
+                    {
+                        double weightValue = std::exp(- patchDistances[extendedOffset] / (2.0 * m_BetaParameter * m_noiseCovariance * numPatchVoxels));
+                        if (weightValue > m_WeightThreshold)
+                        {
+                            double sampleValue = inputBuffer[candidateOffset];
+                            if (m_WeightMethod == EXP)
+                                weightedSums[k] += sampleValue * weightValue;
+                            else
+                                weightedSums[k] += weightValue * (sampleValue * sampleValue);
+
+                            weightSums[k] += weightValue;
+                            if (maxWeights[k] < weightValue)
+                                maxWeights[k] = weightValue;
+                        }
+                    }
+                }
+
+                for (unsigned int d = 0;d < InputImageDimension;++d)
+                {
+                    ++position[d];
+                    if (position[d] < regionStart[d] + regionSize[d])
+                        break;
+
+                    position[d] = regionStart[d];
+                }
+            }
+        }
+
+        displacementsDone = true;
+        for (unsigned int d = 0;d < InputImageDimension;++d)
+        {
+            ++displacement[d];
+            if (displacement[d] <= maxDisp)
+            {
+                displacementsDone = false;
+                break;
             }
-            else
-                outputIterator.Set(inputIterator.Get());
 
-            break;
+            displacement[d] = - maxDisp;
         }
+    }
+
+    typedef itk::ImageRegionConstIterator <InputImageType> InIteratorType;
+    typedef itk::ImageRegionIterator <OutputImageType> OutIteratorType;
+    InIteratorType inputIterator(input, outputRegionForThread);
+    OutIteratorType outputIterator(this->GetOutput(), outputRegionForThread);
+
+    for (unsigned int k = 0;k < numRegionVoxels;++k)
+    {
+        outputIterator.Set(this->ComputeDenoisedValue(inputIterator.Get(),weightedSums[k],weightSums[k],maxWeights[k]));
 
         this->IncrementNumberOfProcessedPoints();
         ++outputIterator;
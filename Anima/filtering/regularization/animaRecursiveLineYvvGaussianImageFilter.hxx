@@ -1,6 +1,7 @@
 #pragma once
 
 #include "animaRecursiveLineYvvGaussianImageFilter.h"
+#include <animaRecursiveYvvGaussianKernel.h>
 #include <itkObjectFactory.h>
 #include <itkImageLinearIteratorWithIndex.h>
 #include <itkImageLinearConstIteratorWithIndex.h>
@@ -54,51 +55,22 @@ void
 RecursiveLineYvvGaussianImageFilter<TInputImage,TOutputImage>
 ::SetUp(ScalarRealType spacing)
 {
-    const ScalarRealType sigmad = m_Sigma/spacing;
+    // Coefficients are shared with the multi-line kernel
+    anima::RecursiveYvvGaussianKernel <double> kernel;
+    kernel.SetUp(m_Sigma,spacing);
 
-    // Compute q according to 16 in Young et al on Gabor filering
-    ScalarRealType q = 0;
-    if (sigmad >= 3.556)
-        q = 0.9804 * (sigmad - 3.556) + 2.5091;
-    else
-    {
-        if (sigmad < 0.5)
-            std::cerr << "Too low sigma value (< 0.5), computation will not be precise." << std::endl;
-
-        q = 0.0561 * sigmad * sigmad + 0.5784 * sigmad - 0.2568;
-    }
-
-    // Compute B and B1 to B3 according to Young et al 2003
-    ScalarRealType m0 = 1.16680;
-    ScalarRealType m1 = 1.10783;
-    ScalarRealType m2 = 1.40586;
-    ScalarRealType scale = (m0 + q) * (m1 * m1 + m2 * m2 + 2 * m1 * q + q * q);
-
-    m_B1 = q * (2 * m0 * m1 + m1 * m1 + m2 * m2 + (2 * m0 + 4 * m1) * q + 3 * q * q) / scale;
-
-    m_B2 = - q * q * (m0 + 2 * m1 + 3 * q) / scale;
-
-    m_B3 = q * q * q / scale;
-
-    ScalarRealType baseB = (m0 * (m1 * m1 + m2 * m2)) / scale;
-    m_B = baseB * baseB;
+    m_B1 = kernel.GetB1();
+    m_B2 = kernel.GetB2();
+    m_B3 = kernel.GetB3();
+    m_B = kernel.GetB();
 
     // M Matrix for initialization on backward pass, from Triggs and Sdika, IEEE TSP
     m_MMatrix = vnl_matrix <ScalarRealType> (3,3);
-
-    m_MMatrix(0,0) = - m_B3 * m_B1 + 1 - m_B3 * m_B3 - m_B2;
-    m_MMatrix(0,1) = (m_B3 + m_B1) * (m_B2 + m_B3 * m_B1);
-    m_MMatrix(0,2) = m_B3 * (m_B1 + m_B3 * m_B2);
-
-    m_MMatrix(1,0) = m_B1 + m_B3 * m_B2;
-    m_MMatrix(1,1) = (1 - m_B2) * (m_B2 + m_B3 * m_B1);
-    m_MMatrix(1,2) = - m_B3 * (m_B3 * m_B1 + m_B3 * m_B3 + m_B2 - 1);
-
-    m_MMatrix(2,0) = m_B3 * m_B1 + m_B2 + m_B1 * m_B1 - m_B2 * m_B2;
-    m_MMatrix(2,1) = m_B1 * m_B2 + m_B3 * m_B2 * m_B2 - m_B1 * m_B3 * m_B3 - m_B3 * m_B3 * m_B3 - m_B3 * m_B2 + m_B3;
-    m_MMatrix(2,2) = m_B3 * (m_B1 + m_B3 * m_B2);
-
-    m_MMatrix /= (1 + m_B1 - m_B2 + m_B3) * (1 - m_B1 - m_B2 - m_B3) * (1 + m_B2 + (m_B1 - m_B3) * m_B3);
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        for (unsigned int j = 0;j < 3;++j)
+            m_MMatrix(i,j) = kernel.GetMMatrix()[i * 3 + j];
+    }
 }
 
 /**
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <itkMultiThreaderBase.h>
+#include <itkSize.h>
+
+#include <atomic>
+#include <vector>
+
+namespace anima
+{
+
+/**
+ * @brief Young - van Vliet recursive Gaussian filtering (Young et al. 2003, with Triggs and Sdika boundary handling)
+ * of a contiguous buffer of scalars, several adjacent lines at a time.
+ *
+ * Lines along the filtered direction are processed by tiles: a tile gathers a group of adjacent lines (and all
+ * components of their pixels) into a scratch buffer where each point of the lines is a row of lanes, so that the
+ * recursion runs on all lanes at once in contiguous (vectorizable) loops. The tile width is chosen so that the tile
+ * fits in cache. Pixels with several components (vectors) are handled as more lanes, without per component passes.
+ * Filtering is done in place, one direction at a time, using one scratch buffer per work unit that may be reused
+ * across directions.
+ */
+template <typename TScalarType>
+class RecursiveYvvGaussianKernel
+{
+public:
+    typedef std::vector <TScalarType> ScratchBufferType;
+
+    RecursiveYvvGaussianKernel();
+    ~RecursiveYvvGaussianKernel() {}
+
+    //! Computes the filter coefficients for a given sigma and spacing along the filtered direction
+    void SetUp(double sigma, double spacing);
+
+    double GetB1() const {return m_B1;}
+    double GetB2() const {return m_B2;}
+    double GetB3() const {return m_B3;}
+    double GetB() const {return m_B;}
+
+    //! Initialization matrix of the anti-causal pass (row major)
+    const double *GetMMatrix() const {return m_MMatrix;}
+
+    /**
+     * Filters in place a buffer of size (x fastest) pixels of numComponents scalars along one direction, which must
+     * have at least 4 pixels. scratchBuffers holds one buffer per work unit, resized if needed.
+     */
+    template <unsigned int NDimension>
+    void FilterBuffer(TScalarType *buffer, const itk::Size <NDimension> &size, unsigned int numComponents,
+                      unsigned int direction, itk::MultiThreaderBase *threader, unsigned int numWorkUnits,
+                      std::vector <ScratchBufferType> &scratchBuffers);
+
+    //! Filters the lanes of a tile: ln rows of width lanes, work holding 4 * width scalars
+    void FilterTile(TScalarType *tile, unsigned int ln, unsigned int width, TScalarType *work);
+
+protected:
+    //! Target size (in bytes) of a tile, so that it stays in cache during the recursion
+    static const size_t TileTargetBytes = 128 * 1024;
+
+    //! Lane counts are kept multiple of this, for vectorization
+    static const size_t LaneMultiple = 8;
+
+    //! Description of the tiles of one direction: buffer seen as [outer][ln][inner] scalars
+    struct TilingType
+    {
+        TScalarType *buffer;
+        size_t inner;
+        size_t outer;
+        unsigned int ln;
+
+        //! Each tile covers groupSize outer blocks (and inner scalars [j, j + tileWidth) of each)
+        size_t tileWidth;
+        size_t groupSize;
+        size_t numInnerTiles;
+        size_t numTiles;
+
+        std::atomic <size_t> nextTile;
+        RecursiveYvvGaussianKernel *kernel;
+        std::vector <ScratchBufferType> *scratchBuffers;
+    };
+
+    static ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION ThreadFilterTiles(void *arg);
+    void FilterTiles(TilingType &tiling, ScratchBufferType &scratch);
+
+private:
+    double m_B1, m_B2, m_B3, m_B;
+    double m_MMatrix[9];
+};
+
+} // end namespace anima
+
+#include "animaRecursiveYvvGaussianKernel.hxx"
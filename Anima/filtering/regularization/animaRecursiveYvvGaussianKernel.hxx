@@ -0,0 +1,255 @@
+#pragma once
+#include "animaRecursiveYvvGaussianKernel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace anima
+{
+
+template <typename TScalarType>
+RecursiveYvvGaussianKernel<TScalarType>::RecursiveYvvGaussianKernel()
+{
+    m_B1 = m_B2 = m_B3 = 0;
+    m_B = 1;
+    std::fill(m_MMatrix,m_MMatrix + 9,0.0);
+}
+
+template <typename TScalarType>
+void RecursiveYvvGaussianKernel<TScalarType>::SetUp(double sigma, double spacing)
+{
+    const double sigmad = sigma / spacing;
+
+    // Compute q according to 16 in Young et al on Gabor filering
+    double q = 0;
+    if (sigmad >= 3.556)
+        q = 0.9804 * (sigmad - 3.556) + 2.5091;
+    else
+    {
+        if (sigmad < 0.5)
+            std::cerr << "Too low sigma value (< 0.5), computation will not be precise." << std::endl;
+
+        q = 0.0561 * sigmad * sigmad + 0.5784 * sigmad - 0.2568;
+    }
+
+    // Compute B and B1 to B3 according to Young et al 2003
+    double m0 = 1.16680;
+    double m1 = 1.10783;
+    double m2 = 1.40586;
+    double scale = (m0 + q) * (m1 * m1 + m2 * m2 + 2 * m1 * q + q * q);
+
+    m_B1 = q * (2 * m0 * m1 + m1 * m1 + m2 * m2 + (2 * m0 + 4 * m1) * q + 3 * q * q) / scale;
+
+    m_B2 = - q * q * (m0 + 2 * m1 + 3 * q) / scale;
+
+    m_B3 = q * q * q / scale;
+
+    double baseB = (m0 * (m1 * m1 + m2 * m2)) / scale;
+    m_B = baseB * baseB;
+
+    // M Matrix for initialization on backward pass, from Triggs and Sdika, IEEE TSP
+    m_MMatrix[0] = - m_B3 * m_B1 + 1 - m_B3 * m_B3 - m_B2;
+    m_MMatrix[1] = (m_B3 + m_B1) * (m_B2 + m_B3 * m_B1);
+    m_MMatrix[2] = m_B3 * (m_B1 + m_B3 * m_B2);
+
+    m_MMatrix[3] = m_B1 + m_B3 * m_B2;
+    m_MMatrix[4] = (1 - m_B2) * (m_B2 + m_B3 * m_B1);
+    m_MMatrix[5] = - m_B3 * (m_B3 * m_B1 + m_B3 * m_B3 + m_B2 - 1);
+
+    m_MMatrix[6] = m_B3 * m_B1 + m_B2 + m_B1 * m_B1 - m_B2 * m_B2;
+    m_MMatrix[7] = m_B1 * m_B2 + m_B3 * m_B2 * m_B2 - m_B1 * m_B3 * m_B3 - m_B3 * m_B3 * m_B3 - m_B3 * m_B2 + m_B3;
+    m_MMatrix[8] = m_B3 * (m_B1 + m_B3 * m_B2);
+
+    double normalization = (1 + m_B1 - m_B2 + m_B3) * (1 - m_B1 - m_B2 - m_B3) * (1 + m_B2 + (m_B1 - m_B3) * m_B3);
+    for (unsigned int i = 0;i < 9;++i)
+        m_MMatrix[i] /= normalization;
+}
+
+template <typename TScalarType>
+void RecursiveYvvGaussianKernel<TScalarType>::FilterTile(TScalarType *tile, unsigned int ln, unsigned int width,
+                                                         TScalarType *work)
+{
+    const TScalarType b1 = m_B1;
+    const TScalarType b2 = m_B2;
+    const TScalarType b3 = m_B3;
+    const TScalarType b = m_B;
+    const TScalarType factor = 1.0 / (1.0 - m_B1 - m_B2 - m_B3);
+
+    TScalarType * __restrict v0 = work;
+    TScalarType * __restrict v1 = work + width;
+    TScalarType * __restrict v2 = work + 2 * width;
+    TScalarType * __restrict lastInput = work + 3 * width;
+
+    // Causal pass, the first value being assumed to exist from the border to infinity
+    TScalarType * __restrict row = tile;
+    std::memcpy(lastInput,tile + (size_t)(ln - 1) * width,width * sizeof(TScalarType));
+    for (unsigned int j = 0;j < width;++j)
+    {
+        v0[j] = row[j] * factor;
+        v1[j] = v0[j];
+        v2[j] = v0[j];
+    }
+
+    for (unsigned int i = 0;i < ln;++i)
+    {
+        row = tile + (size_t)i * width;
+        for (unsigned int j = 0;j < width;++j)
+        {
+            TScalarType out = row[j] + v0[j] * b1 + v1[j] * b2 + v2[j] * b3;
+            v2[j] = v1[j];
+            v1[j] = v0[j];
+            v0[j] = out;
+            row[j] = out;
+        }
+    }
+
+    // Anti-causal pass, outside values handled according to Triggs and Sdika
+    const TScalarType *lastRows[3];
+    for (unsigned int k = 0;k < 3;++k)
+        lastRows[k] = tile + (size_t)(ln - 1 - k) * width;
+
+    TScalarType m[9];
+    for (unsigned int k = 0;k < 9;++k)
+        m[k] = m_MMatrix[k];
+
+    for (unsigned int j = 0;j < width;++j)
+    {
+        TScalarType u_p = lastInput[j] * factor;
+        TScalarType v_p = u_p * factor;
+
+        TScalarType d0 = lastRows[0][j] - u_p;
+        TScalarType d1 = lastRows[1][j] - u_p;
+        TScalarType d2 = lastRows[2][j] - u_p;
+
+        // This was not in the 2006 Triggs paper but sounds quite logical since m_B is not one
+        v0[j] = (v_p + d0 * m[0] + d1 * m[1] + d2 * m[2]) * b;
+        v1[j] = (v_p + d0 * m[3] + d1 * m[4] + d2 * m[5]) * b;
+        v2[j] = (v_p + d0 * m[6] + d1 * m[7] + d2 * m[8]) * b;
+    }
+
+    row = tile + (size_t)(ln - 1) * width;
+    std::memcpy(row,v0,width * sizeof(TScalarType));
+
+    for (int i = ln - 2;i >= 0;--i)
+    {
+        row = tile + (size_t)i * width;
+        for (unsigned int j = 0;j < width;++j)
+        {
+            TScalarType out = row[j] * b + v0[j] * b1 + v1[j] * b2 + v2[j] * b3;
+            v2[j] = v1[j];
+            v1[j] = v0[j];
+            v0[j] = out;
+            row[j] = out;
+        }
+    }
+}
+
+template <typename TScalarType>
+template <unsigned int NDimension>
+void RecursiveYvvGaussianKernel<TScalarType>::FilterBuffer(TScalarType *buffer, const itk::Size <NDimension> &size,
+                                                           unsigned int numComponents, unsigned int direction,
+                                                           itk::MultiThreaderBase *threader, unsigned int numWorkUnits,
+                                                           std::vector <ScratchBufferType> &scratchBuffers)
+{
+    TilingType tiling;
+    tiling.buffer = buffer;
+    tiling.ln = size[direction];
+    tiling.inner = numComponents;
+    tiling.outer = 1;
+    for (unsigned int i = 0;i < direction;++i)
+        tiling.inner *= size[i];
+    for (unsigned int i = direction + 1;i < NDimension;++i)
+        tiling.outer *= size[i];
+
+    // Tile width: as many lanes as fit in the cache target, either within one outer block (if wide enough) or
+    // grouping several outer blocks
+    size_t targetWidth = TileTargetBytes / (tiling.ln * sizeof(TScalarType));
+    targetWidth = std::max((size_t)LaneMultiple,targetWidth - targetWidth % LaneMultiple);
+
+    if (tiling.inner >= targetWidth)
+    {
+        tiling.tileWidth = targetWidth;
+        tiling.groupSize = 1;
+        tiling.numInnerTiles = (tiling.inner + targetWidth - 1) / targetWidth;
+        tiling.numTiles = tiling.numInnerTiles * tiling.outer;
+    }
+    else
+    {
+        tiling.tileWidth = tiling.inner;
+        tiling.groupSize = std::max((size_t)1,targetWidth / tiling.inner);
+        tiling.numInnerTiles = 1;
+        tiling.numTiles = (tiling.outer + tiling.groupSize - 1) / tiling.groupSize;
+    }
+
+    tiling.nextTile = 0;
+    tiling.kernel = this;
+    tiling.scratchBuffers = &scratchBuffers;
+
+    numWorkUnits = std::max(1U,std::min(numWorkUnits,(unsigned int)tiling.numTiles));
+    if (scratchBuffers.size() < numWorkUnits)
+        scratchBuffers.resize(numWorkUnits);
+
+    threader->SetNumberOfWorkUnits(numWorkUnits);
+    threader->SetSingleMethod(this->ThreadFilterTiles,&tiling);
+    threader->SingleMethodExecute();
+}
+
+template <typename TScalarType>
+ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION
+RecursiveYvvGaussianKernel<TScalarType>::ThreadFilterTiles(void *arg)
+{
+    itk::MultiThreaderBase::WorkUnitInfo *threadArgs = (itk::MultiThreaderBase::WorkUnitInfo *)arg;
+    unsigned int nbThread = threadArgs->WorkUnitID;
+
+    TilingType *tiling = (TilingType *)threadArgs->UserData;
+    tiling->kernel->FilterTiles(*tiling,(*tiling->scratchBuffers)[nbThread]);
+
+    return ITK_THREAD_RETURN_DEFAULT_VALUE;
+}
+
+template <typename TScalarType>
+void RecursiveYvvGaussianKernel<TScalarType>::FilterTiles(TilingType &tiling, ScratchBufferType &scratch)
+{
+    size_t maxWidth = tiling.tileWidth * tiling.groupSize;
+    size_t scratchSize = (tiling.ln + 4) * maxWidth;
+    if (scratch.size() < scratchSize)
+        scratch.resize(scratchSize);
+
+    TScalarType *tile = scratch.data();
+    TScalarType *work = tile + tiling.ln * maxWidth;
+    size_t lineSize = tiling.ln * tiling.inner;
+
+    while (true)
+    {
+        size_t tileIndex = tiling.nextTile++;
+        if (tileIndex >= tiling.numTiles)
+            break;
+
+        size_t firstOuter = (tileIndex / tiling.numInnerTiles) * tiling.groupSize;
+        size_t groupSize = std::min(tiling.groupSize,tiling.outer - firstOuter);
+        size_t innerStart = (tileIndex % tiling.numInnerTiles) * tiling.tileWidth;
+        size_t tileWidth = std::min(tiling.tileWidth,tiling.inner - innerStart);
+        size_t width = groupSize * tileWidth;
+
+        // Gather lines into lanes: row i of the tile holds point i of all lines
+        for (size_t g = 0;g < groupSize;++g)
+        {
+            const TScalarType *source = tiling.buffer + (firstOuter + g) * lineSize + innerStart;
+            for (unsigned int i = 0;i < tiling.ln;++i)
+                std::memcpy(tile + i * width + g * tileWidth,source + i * tiling.inner,tileWidth * sizeof(TScalarType));
+        }
+
+        this->FilterTile(tile,tiling.ln,width,work);
+
+        // Scatter back
+        for (size_t g = 0;g < groupSize;++g)
+        {
+            TScalarType *destination = tiling.buffer + (firstOuter + g) * lineSize + innerStart;
+            for (unsigned int i = 0;i < tiling.ln;++i)
+                std::memcpy(destination + i * tiling.inner,tile + i * width + g * tileWidth,tileWidth * sizeof(TScalarType));
+        }
+    }
+}
+
+} // end namespace anima
@@ -1,12 +1,13 @@
 #pragma once
 
-#include <animaRecursiveLineYvvGaussianImageFilter.h>
-#include <itkCastImageFilter.h>
+#include <animaRecursiveYvvGaussianKernel.h>
+#include <itkInPlaceImageFilter.h>
 #include <itkImage.h>
 #include <itkPixelTraits.h>
-#include <itkCommand.h>
 #include <itkFixedArray.h>
 
+#include <type_traits>
+
 namespace anima
 {
 
@@ -41,39 +42,17 @@ public:
     typedef itk::FixedArray< ScalarRealType,
     itkGetStaticConstMacro(ImageDimension) > SigmaArrayType;
 
-    /** Define the image type for internal computations
-     RealType is usually 'float' in NumericTraits.
-     Here we prefer double in order to save memory.  */
-
-    typedef typename itk::NumericTraits< PixelType >::RealType   InternalRealType;
-    typedef typename InputImageType::template Rebind<InternalRealType>::Type RealImageType;
-
-    /**  The first in the pipeline  */
-    typedef anima::RecursiveLineYvvGaussianImageFilter<
-    InputImageType,
-    RealImageType
-    >    FirstGaussianFilterType;
-
-    /**  Smoothing filter type */
-    typedef anima::RecursiveLineYvvGaussianImageFilter<
-    RealImageType,
-    RealImageType
-    >    InternalGaussianFilterType;
+    /** Scalar types of the input and output pixel components */
+    typedef typename itk::NumericTraits<PixelType>::ValueType                       InputValueType;
+    typedef typename itk::NumericTraits<typename TOutputImage::PixelType>::ValueType OutputValueType;
 
-    /**  The last in the pipeline  */
-    typedef itk::CastImageFilter<
-    RealImageType,
-    OutputImageType
-    >    CastingFilterType;
+    /** Scalar type for internal computations: float if both input and output components are floats, double
+     otherwise */
+    typedef typename std::conditional<std::is_same<InputValueType,float>::value &&
+    std::is_same<OutputValueType,float>::value, float, double>::type InternalScalarType;
 
-    /**  Pointer to a gaussian filter.  */
-    typedef typename InternalGaussianFilterType::Pointer    InternalGaussianFilterPointer;
-
-    /**  Pointer to the first gaussian filter.  */
-    typedef typename FirstGaussianFilterType::Pointer       FirstGaussianFilterPointer;
-
-    /**  Pointer to the last filter, casting  */
-    typedef typename CastingFilterType::Pointer             CastingFilterPointer;
+    /** Multi-line recursive kernel, applied in place along each direction */
+    typedef anima::RecursiveYvvGaussianKernel<InternalScalarType> KernelType;
 
     /**  Pointer to the Output Image */
     typedef typename OutputImageType::Pointer                  OutputImagePointer;
@@ -95,8 +74,6 @@ public:
     void SetNormalizeAcrossScale(bool normalizeInScaleSpace);
     itkGetConstMacro(NormalizeAcrossScale, bool)
 
-    void SetNumberOfWorkUnits(itk::ThreadIdType nb) ITK_OVERRIDE;
-
     // See super class for doxygen documentation
     //
     virtual bool CanRunInPlace() const ITK_OVERRIDE;
@@ -106,7 +83,8 @@ protected:
     virtual ~SmoothingRecursiveYvvGaussianImageFilter() {}
     void PrintSelf(std::ostream& os, itk::Indent indent) const ITK_OVERRIDE;
 
-    /** Generate Data */
+    /** Generate Data: the input is copied into a single buffer (the output buffer if its components are of the
+     internal type), which is then filtered in place along each direction by tiles of adjacent lines */
     void GenerateData() ITK_OVERRIDE;
 
     /** SmoothingRecursiveYvvGaussianImageFilter needs all of the input to produce an
@@ -122,10 +100,6 @@ protected:
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(SmoothingRecursiveYvvGaussianImageFilter);
 
-    InternalGaussianFilterPointer         m_SmoothingFilters[ImageDimension - 1];
-    FirstGaussianFilterPointer            m_FirstSmoothingFilter;
-    CastingFilterPointer                  m_CastingFilter;
-
     /** Normalize the image across scale space */
     bool m_NormalizeAcrossScale;
 
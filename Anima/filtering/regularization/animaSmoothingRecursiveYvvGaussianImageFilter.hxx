@@ -2,7 +2,8 @@
 
 #include "animaSmoothingRecursiveYvvGaussianImageFilter.h"
 #include <itkImageRegionIteratorWithIndex.h>
-#include <itkProgressAccumulator.h>
+
+#include <algorithm>
 
 namespace anima
 {
@@ -16,76 +17,19 @@ SmoothingRecursiveYvvGaussianImageFilter<TInputImage,TOutputImage>
 {
     m_NormalizeAcrossScale = false;
 
-    m_FirstSmoothingFilter = FirstGaussianFilterType::New();
-    m_FirstSmoothingFilter->SetDirection(ImageDimension - 1);
-    m_FirstSmoothingFilter->SetNormalizeAcrossScale( m_NormalizeAcrossScale );
-    m_FirstSmoothingFilter->ReleaseDataFlagOn();
-
-    for( unsigned int i = 0; i<ImageDimension-1; i++ )
-    {
-        m_SmoothingFilters[i] = InternalGaussianFilterType::New();
-        m_SmoothingFilters[i]->SetNormalizeAcrossScale( m_NormalizeAcrossScale );
-        m_SmoothingFilters[i]->SetDirection(i);
-        m_SmoothingFilters[i]->ReleaseDataFlagOn();
-        m_SmoothingFilters[i]->InPlaceOn();
-    }
-
-    m_SmoothingFilters[0]->SetInput( m_FirstSmoothingFilter->GetOutput() );
-    for( unsigned int i = 1; i<ImageDimension-1; i++ )
-    {
-        m_SmoothingFilters[i]->SetInput(m_SmoothingFilters[i-1]->GetOutput());
-    }
-
-    m_CastingFilter = CastingFilterType::New();
-    m_CastingFilter->SetInput(m_SmoothingFilters[ImageDimension-2]->GetOutput());
-    m_CastingFilter->InPlaceOn();
-
     this->InPlaceOff();
 
-    //
-    // NB: We must call SetSigma in order to initialize the smoothing
-    // filters with the default scale.  However, m_Sigma must first be
-    // initialized (it is used inside SetSigma) and it must be different
-    // from 1.0 or the call will be ignored.
-    this->m_Sigma.Fill(0.0);
-    this->SetSigma( 1.0 );
+    this->m_Sigma.Fill(1.0);
 }
 
 
-template <typename TInputImage, typename TOutputImage>
-void
-SmoothingRecursiveYvvGaussianImageFilter<TInputImage,TOutputImage>
-::SetNumberOfWorkUnits( itk::ThreadIdType nb )
-{
-    Superclass::SetNumberOfWorkUnits( nb );
-    for( unsigned int i = 0; i<ImageDimension-1; i++ )
-    {
-        m_SmoothingFilters[ i ]->SetNumberOfWorkUnits( nb );
-    }
-    m_FirstSmoothingFilter->SetNumberOfWorkUnits( nb );
-
-}
-
 template< typename TInputImage, typename TOutputImage >
 bool
 SmoothingRecursiveYvvGaussianImageFilter<TInputImage,TOutputImage>
 ::CanRunInPlace() const
 {
-    // Note: There are two different ways this filter may try to run
-    // in-place:
-    // 1) Similar to the standard way, when the input and output image
-    // are of the same type, they can share the bulk data. The output
-    // will be grafted onto the last filter. In this fashion the input
-    // and output will be the same bulk data, but the intermediate
-    // mini-pipeline will use different data.
-    // 2) If the input image is the same type as the RealImage used for
-    // the mini-pipeline, then all the filters may re-use the same
-    // bulk data, stealing it from the input then moving it down the
-    // pipeline filter by filter. Additionally, if the output is also
-    // RealType then the last filter will run in-place making the entire
-    // pipeline in-place and only utilizing on copy of the bulk data.
-
-    return m_FirstSmoothingFilter->CanRunInPlace() || this->Superclass::CanRunInPlace();
+    // Input and output of the same type share their bulk data, which is then directly filtered
+    return this->Superclass::CanRunInPlace();
 }
 
 // Set value of Sigma (isotropic)
@@ -110,12 +54,6 @@ SmoothingRecursiveYvvGaussianImageFilter<TInputImage,TOutputImage>
     if (this->m_Sigma != sigma)
     {
         this->m_Sigma = sigma;
-        for( unsigned int i = 0; i<ImageDimension-1; i++ )
-        {
-            m_SmoothingFilters[ i ]->SetSigma( m_Sigma[i] );
-        }
-        m_FirstSmoothingFilter->SetSigma(m_Sigma[ImageDimension - 1]);
-
         this->Modified();
     }
 }
@@ -151,13 +89,6 @@ SmoothingRecursiveYvvGaussianImageFilter<TInputImage,TOutputImage>
 ::SetNormalizeAcrossScale( bool normalize )
 {
     m_NormalizeAcrossScale = normalize;
-
-    for( unsigned int i = 0; i<ImageDimension-1; i++ )
-    {
-        m_SmoothingFilters[i]->SetNormalizeAcrossScale(normalize);
-    }
-    m_FirstSmoothingFilter->SetNormalizeAcrossScale(normalize);
-
     this->Modified();
 }
 
@@ -215,48 +146,57 @@ SmoothingRecursiveYvvGaussianImageFilter<TInputImage,TOutputImage >
         }
     }
 
-    // If this filter is running in-place, then set the first smoothing
-    // filter to steal the bulk data, by running in-place.
-    if (this->CanRunInPlace() && this->GetInPlace())
-    {
-        m_FirstSmoothingFilter->InPlaceOn();
+    // If running in-place, the output steals the input bulk data
+    this->AllocateOutputs();
 
-        // To make this filter's input and out share the same data, call
-        // the InPlace's/Superclass's allocate methods, which takes care
-        // of the needed bulk data sharing.
-        this->AllocateOutputs();
-    }
+    OutputImageType *outputImage = this->GetOutput();
+    const typename TOutputImage::SizeType bufferSize = outputImage->GetBufferedRegion().GetSize();
+    const unsigned int numComponents = outputImage->GetNumberOfComponentsPerPixel();
+    const size_t numScalars = outputImage->GetBufferedRegion().GetNumberOfPixels() * numComponents;
+
+    // Pixels are seen as contiguous components, for scalar, fixed and variable length vector images alike
+    const InputValueType *inputBuffer = reinterpret_cast <const InputValueType *> (inputImage->GetBufferPointer());
+    OutputValueType *outputBuffer = reinterpret_cast <OutputValueType *> (outputImage->GetBufferPointer());
+
+    // Single buffer filtered along all directions: the output buffer itself if possible
+    std::vector <InternalScalarType> internalBuffer;
+    InternalScalarType *workBuffer = ITK_NULLPTR;
+    if (std::is_same <OutputValueType,InternalScalarType>::value)
+        workBuffer = reinterpret_cast <InternalScalarType *> (outputBuffer);
     else
     {
-        m_FirstSmoothingFilter->InPlaceOff();
+        internalBuffer.resize(numScalars);
+        workBuffer = internalBuffer.data();
     }
 
-    // If the last filter is running in-place then this bulk data is not
-    // needed, release it to save memory.
-    if ( m_CastingFilter->CanRunInPlace() )
+    if (static_cast <const void *> (workBuffer) != static_cast <const void *> (inputBuffer))
     {
-        this->GetOutput()->ReleaseData();
+        for (size_t i = 0;i < numScalars;++i)
+            workBuffer[i] = static_cast <InternalScalarType> (inputBuffer[i]);
     }
 
-    // Create a process accumulator for tracking the progress of this minipipeline
-    itk::ProgressAccumulator::Pointer progress = itk::ProgressAccumulator::New();
-    progress->SetMiniPipelineFilter(this);
+    // Scratch buffers of the work units, reused for all directions
+    std::vector <typename KernelType::ScratchBufferType> scratchBuffers;
+    KernelType kernel;
 
-    // Register the filter with the with progress accumulator using
-    // equal weight proportion
-    for(unsigned int i = 0;i < ImageDimension - 1;++i)
+    const typename TInputImage::SpacingType &spacing = inputImage->GetSpacing();
+    for (unsigned int i = 0;i < ImageDimension;++i)
     {
-        progress->RegisterInternalFilter(m_SmoothingFilters[i],1.0 / (ImageDimension));
-    }
+        // Same order as line by line filtering: last direction first
+        unsigned int direction = (i == 0) ? ImageDimension - 1 : i - 1;
 
-    progress->RegisterInternalFilter(m_FirstSmoothingFilter,1.0 / (ImageDimension));
-    m_FirstSmoothingFilter->SetInput( inputImage );
-    // graft our output to the internal filter to force the proper regions
-    // to be generated
-    m_CastingFilter->GraftOutput(this->GetOutput());
-    m_CastingFilter->Update();
-    this->GraftOutput(m_CastingFilter->GetOutput());
+        kernel.SetUp(m_Sigma[direction],spacing[direction]);
+        kernel.FilterBuffer(workBuffer,bufferSize,numComponents,direction,this->GetMultiThreader(),
+                            this->GetNumberOfWorkUnits(),scratchBuffers);
 
+        this->UpdateProgress((i + 1.0) / ImageDimension);
+    }
+
+    if (!internalBuffer.empty())
+    {
+        for (size_t i = 0;i < numScalars;++i)
+            outputBuffer[i] = static_cast <OutputValueType> (internalBuffer[i]);
+    }
 }
 
 
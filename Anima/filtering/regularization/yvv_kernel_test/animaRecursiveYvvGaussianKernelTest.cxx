@@ -0,0 +1,151 @@
+#include <animaRecursiveYvvGaussianKernel.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+// Checks the tiled Young - van Vliet kernel against the line by line recursion, along each direction of random
+// scalar and vector buffers, in double and float
+
+//! Reference causal and anti-causal recursion of one line, in double
+template <class TScalarType>
+void FilterLine(const anima::RecursiveYvvGaussianKernel <TScalarType> &kernel, std::vector <double> &line)
+{
+    double b1 = kernel.GetB1();
+    double b2 = kernel.GetB2();
+    double b3 = kernel.GetB3();
+    double b = kernel.GetB();
+    const double *mMatrix = kernel.GetMMatrix();
+
+    unsigned int ln = line.size();
+    std::vector <double> output(ln);
+
+    double v0 = line[0] / (1.0 - b1 - b2 - b3);
+    double v1 = v0;
+    double v2 = v0;
+    for (unsigned int i = 0;i < ln;++i)
+    {
+        output[i] = line[i] + v0 * b1 + v1 * b2 + v2 * b3;
+        v2 = v1;
+        v1 = v0;
+        v0 = output[i];
+    }
+
+    // Triggs and Sdika initialization of the anti-causal pass
+    double uPlus = line[ln - 1] / (1.0 - b1 - b2 - b3);
+    double vPlus = uPlus / (1.0 - b1 - b2 - b3);
+    v0 = vPlus;
+    v1 = vPlus;
+    v2 = vPlus;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        v0 += (output[ln - 1 - i] - uPlus) * mMatrix[i];
+        v1 += (output[ln - 1 - i] - uPlus) * mMatrix[3 + i];
+        v2 += (output[ln - 1 - i] - uPlus) * mMatrix[6 + i];
+    }
+
+    v0 *= b;
+    v1 *= b;
+    v2 *= b;
+    output[ln - 1] = v0;
+
+    for (int i = ln - 2;i >= 0;--i)
+    {
+        double value = output[i] * b + v0 * b1 + v1 * b2 + v2 * b3;
+        v2 = v1;
+        v1 = v0;
+        v0 = value;
+        output[i] = value;
+    }
+
+    line = output;
+}
+
+template <class TScalarType>
+bool TestKernel(unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ, unsigned int numComponents,
+                unsigned int numWorkUnits)
+{
+    itk::Size <3> size;
+    size[0] = sizeX;
+    size[1] = sizeY;
+    size[2] = sizeZ;
+
+    size_t numValues = static_cast <size_t> (sizeX) * sizeY * sizeZ * numComponents;
+    std::vector <double> referenceValues(numValues);
+    std::mt19937 generator(1);
+    std::uniform_real_distribution <double> uniformDistribution(-1.0,1.0);
+    for (size_t i = 0;i < numValues;++i)
+        referenceValues[i] = uniformDistribution(generator);
+
+    std::vector <TScalarType> values(referenceValues.begin(),referenceValues.end());
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    std::vector <typename anima::RecursiveYvvGaussianKernel <TScalarType>::ScratchBufferType> scratchBuffers;
+
+    for (unsigned int d = 0;d < 3;++d)
+    {
+        anima::RecursiveYvvGaussianKernel <TScalarType> kernel;
+        kernel.SetUp(2.0 + d,1.0);
+        kernel.FilterBuffer(values.data(),size,numComponents,d,threader.GetPointer(),numWorkUnits,scratchBuffers);
+
+        // Lines along d start at each scalar of the first pixel row along d, in each outer block
+        size_t inner = numComponents;
+        for (unsigned int i = 0;i < d;++i)
+            inner *= size[i];
+
+        unsigned int ln = size[d];
+        std::vector <double> line(ln);
+        for (size_t start = 0;start < numValues;++start)
+        {
+            if (start % (inner * ln) >= inner)
+                continue;
+
+            for (unsigned int i = 0;i < ln;++i)
+                line[i] = referenceValues[start + i * inner];
+
+            FilterLine(kernel,line);
+
+            for (unsigned int i = 0;i < ln;++i)
+                referenceValues[start + i * inner] = line[i];
+        }
+    }
+
+    double maxError = 0;
+    for (size_t i = 0;i < numValues;++i)
+        maxError = std::max(maxError,std::abs(referenceValues[i] - values[i]));
+
+    // A few rounding errors of the scalar type on inputs in [-1,1]: about 1e-15 in double, 1e-6 in float
+    double tolerance = 16.0 * std::numeric_limits <TScalarType>::epsilon();
+
+    std::cout << sizeX << "x" << sizeY << "x" << sizeZ << ", " << numComponents << " components, "
+              << ((sizeof(TScalarType) == sizeof(float)) ? "float" : "double") << ", " << numWorkUnits
+              << " work units: maximal error " << maxError << " (tolerance " << tolerance << ")" << std::endl;
+
+    return (maxError <= tolerance);
+}
+
+int main(int argc, char **argv)
+{
+    bool success = true;
+
+    for (unsigned int numWorkUnits = 1;numWorkUnits <= 4;numWorkUnits *= 2)
+    {
+        success &= TestKernel <double> (37,41,23,1,numWorkUnits);
+        success &= TestKernel <double> (64,64,64,3,numWorkUnits);
+        success &= TestKernel <double> (5,300,7,2,numWorkUnits);
+        success &= TestKernel <double> (2000,4,4,1,numWorkUnits);
+        success &= TestKernel <float> (64,50,40,3,numWorkUnits);
+    }
+
+    if (!success)
+    {
+        std::cerr << "Tiled recursive Gaussian kernel differs from the line by line recursion" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -4,6 +4,10 @@
 #include <itkImageFileWriter.h>
 #include <itkExtractImageFilter.h>
 
+#include <fstream>
+#include <string>
+#include <vector>
+
 namespace anima
 {
 
@@ -73,6 +77,29 @@ getImagesFromHigherDimensionImage(InputImageType *inputImage)
     return outputData;
 }
 
+//! Reads the non empty lines of a text file (e.g. a list of files or of values)
+inline std::vector <std::string> readFileLines(const std::string &fileName)
+{
+    std::ifstream fileIn(fileName.c_str());
+    if (!fileIn.is_open())
+    {
+        std::string errStr = "Unable to read file: ";
+        errStr += fileName;
+
+        throw itk::ExceptionObject(__FILE__, __LINE__,errStr,ITK_LOCATION);
+    }
+
+    std::vector <std::string> lines;
+    std::string line;
+    while (std::getline(fileIn,line))
+    {
+        if (line != "")
+            lines.push_back(line);
+    }
+
+    return lines;
+}
+
 //! Set inputs of an image to image filter from a file name containing either a list of files or a higher dimensional image
 template <class InputImageType, class ImageFilterType>
 unsigned int
@@ -89,36 +116,20 @@ setMultipleImageFilterInputsFromFileName(std::string &fileName,
 
     if( !imageIO ) // file list
     {
-        std::ifstream fileIn(fileName.c_str());
-        if (!fileIn.is_open())
-        {
-            std::string errStr = "Unable to read file: ";
-            errStr += fileName;
-
-            throw itk::ExceptionObject(__FILE__, __LINE__,errStr,ITK_LOCATION);
-        }
-
+        std::vector <std::string> fileNames = anima::readFileLines(fileName);
         typename ImageReaderType::Pointer imageReader;
 
-        while (!fileIn.eof())
+        for (unsigned int i = 0;i < fileNames.size();++i)
         {
-            char tmpStr[2048];
-            fileIn.getline(tmpStr,2048);
-
-            if (strcmp(tmpStr,"") == 0)
-                continue;
-
-            std::cout << "Loading image " << nbPats << " " << tmpStr << "..." << std::endl;
+            std::cout << "Loading image " << nbPats << " " << fileNames[i] << "..." << std::endl;
             imageReader = ImageReaderType::New();
-            imageReader->SetFileName(tmpStr);
+            imageReader->SetFileName(fileNames[i]);
             imageReader->Update();
 
             filter->SetInput(nbPats,imageReader->GetOutput());
 
             nbPats++;
         }
-
-        fileIn.close();
     }
     else // N+1D image tentative
     {
@@ -11,9 +11,9 @@
 namespace anima
 {
 
-void TRKWriter::Update()
+void TRKWriter::FillHeader(TRKHeaderStructure &headerStr, const std::vector <std::string> &scalarNames,
+                           const std::vector <std::string> &propertyNames)
 {
-    anima::TRKHeaderStructure headerStr;
     strcpy(headerStr.id_string,"TRACK");
 
     for (unsigned int i = 0;i < 3;++i)
@@ -30,48 +30,28 @@ void TRKWriter::Update()
         headerStr.property_name[i][0] = '\0';
     }
 
-    unsigned int numScalarFields = m_TrackData->GetPointData()->GetNumberOfArrays();
-    unsigned int numPropertyFields = m_TrackData->GetCellData()->GetNumberOfArrays();
-
     unsigned int pos = 0;
-    std::vector <vtkDoubleArray *> scalarArrays;
-    for (unsigned int i = 0;i < numScalarFields;++i)
+    for (unsigned int i = 0;(i < scalarNames.size()) && (pos < 10);++i)
     {
-        unsigned int numComponents = m_TrackData->GetPointData()->GetArray(i)->GetNumberOfComponents();
-        if (numComponents != 1)
-            continue;
-
-        std::string arrayName = m_TrackData->GetPointData()->GetArrayName(i);
+        std::string arrayName = scalarNames[i];
         if (arrayName.size() >= 20)
             arrayName.erase(arrayName.begin() + 19);
 
         strcpy(headerStr.scalar_name[pos],arrayName.c_str());
         ++pos;
-        scalarArrays.push_back(dynamic_cast <vtkDoubleArray *> (m_TrackData->GetPointData()->GetArray(i)));
-
-        if (pos == 10)
-            break;
     }
 
     headerStr.n_scalars = pos;
 
     pos = 0;
-    std::vector <vtkDoubleArray *> propertyArrays;
-    for (unsigned int i = 0;i < numPropertyFields;++i)
+    for (unsigned int i = 0;(i < propertyNames.size()) && (pos < 10);++i)
     {
-        unsigned int numComponents = m_TrackData->GetCellData()->GetArray(i)->GetNumberOfComponents();
-        if (numComponents != 1)
-            continue;
-
-        std::string arrayName = m_TrackData->GetCellData()->GetArrayName(i);
+        std::string arrayName = propertyNames[i];
         if (arrayName.size() >= 20)
             arrayName.erase(arrayName.begin() + 19);
 
         strcpy(headerStr.property_name[pos],arrayName.c_str());
-        propertyArrays.push_back(dynamic_cast <vtkDoubleArray *> (m_TrackData->GetCellData()->GetArray(i)));
         ++pos;
-        if (pos == 10)
-            break;
     }
 
     headerStr.n_properties = pos;
@@ -130,9 +110,64 @@ void TRKWriter::Update()
     for (unsigned int i = 0;i < 6;++i)
         headerStr.image_orientation_patient[i] = 0;
 
-    headerStr.n_count = m_TrackData->GetNumberOfCells();
+    headerStr.n_count = 0;
     headerStr.version = 2;
     headerStr.hdr_size = 1000;
+}
+
+vnl_matrix <double> TRKWriter::ComputePhysicalToTrackMatrix(const TRKHeaderStructure &headerStr)
+{
+    vnl_matrix <double> directionMatrix(4,4);
+
+    for (unsigned int i = 0;i < 4;++i)
+    {
+        for (unsigned int j = 0;j < 4;++j)
+            directionMatrix(i,j) = headerStr.vox_to_ras[i][j];
+    }
+
+    return vnl_matrix_inverse <double> (directionMatrix).as_matrix();
+}
+
+void TRKWriter::Update()
+{
+    anima::TRKHeaderStructure headerStr;
+
+    unsigned int numScalarFields = m_TrackData->GetPointData()->GetNumberOfArrays();
+    unsigned int numPropertyFields = m_TrackData->GetCellData()->GetNumberOfArrays();
+
+    std::vector <std::string> scalarNames;
+    std::vector <vtkDoubleArray *> scalarArrays;
+    for (unsigned int i = 0;i < numScalarFields;++i)
+    {
+        unsigned int numComponents = m_TrackData->GetPointData()->GetArray(i)->GetNumberOfComponents();
+        if (numComponents != 1)
+            continue;
+
+        scalarNames.push_back(m_TrackData->GetPointData()->GetArrayName(i));
+        scalarArrays.push_back(dynamic_cast <vtkDoubleArray *> (m_TrackData->GetPointData()->GetArray(i)));
+
+        if (scalarNames.size() == 10)
+            break;
+    }
+
+    std::vector <std::string> propertyNames;
+    std::vector <vtkDoubleArray *> propertyArrays;
+    for (unsigned int i = 0;i < numPropertyFields;++i)
+    {
+        unsigned int numComponents = m_TrackData->GetCellData()->GetArray(i)->GetNumberOfComponents();
+        if (numComponents != 1)
+            continue;
+
+        propertyNames.push_back(m_TrackData->GetCellData()->GetArrayName(i));
+        propertyArrays.push_back(dynamic_cast <vtkDoubleArray *> (m_TrackData->GetCellData()->GetArray(i)));
+
+        if (propertyNames.size() == 10)
+            break;
+    }
+
+    this->FillHeader(headerStr,scalarNames,propertyNames);
+
+    headerStr.n_count = m_TrackData->GetNumberOfCells();
 
     std::ofstream outFile(m_FileName,std::ios::binary);
     if (!outFile.is_open())
@@ -143,15 +178,7 @@ void TRKWriter::Update()
     // handle individual tracks now : transform and store
     std::vector <float> cellData;
     std::vector <float> cellScalars(numPropertyFields);
-    vnl_matrix <double> directionMatrix(4,4);
-
-    for (unsigned int i = 0;i < 4;++i)
-    {
-        for (unsigned int j = 0;j < 4;++j)
-            directionMatrix(i,j) = headerStr.vox_to_ras[i][j];
-    }
-
-    directionMatrix = vnl_matrix_inverse <double> (directionMatrix).as_matrix();
+    vnl_matrix <double> directionMatrix = this->ComputePhysicalToTrackMatrix(headerStr);
 
     for (unsigned int i = 0;i < headerStr.n_count;++i)
     {
@@ -188,4 +215,60 @@ void TRKWriter::Update()
     outFile.close();
 }
 
+void TRKWriter::BeginStreaming(const std::vector <std::string> &scalarNames)
+{
+    if (m_ReferenceImage.IsNull())
+        throw itk::ExceptionObject(__FILE__, __LINE__, "TRK streaming needs a reference image", ITK_LOCATION);
+
+    std::vector <std::string> propertyNames;
+    this->FillHeader(m_StreamedHeader,scalarNames,propertyNames);
+    m_StreamedPhysicalToTrackMatrix = this->ComputePhysicalToTrackMatrix(m_StreamedHeader);
+    m_NumberOfStreamedTracks = 0;
+
+    m_StreamedFile.open(m_FileName,std::ios::binary);
+    if (!m_StreamedFile.is_open())
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Unable to open file " + m_FileName,ITK_LOCATION);
+
+    m_StreamedFile.write((char *) &m_StreamedHeader, sizeof(anima::TRKHeaderStructure));
+}
+
+void TRKWriter::WriteTrack(const float *points, unsigned int numPoints, const float *scalars)
+{
+    unsigned int numScalars = m_StreamedHeader.n_scalars;
+    unsigned int pointSize = 3 + numScalars;
+    m_StreamedPointData.resize(numPoints * pointSize);
+
+    for (unsigned int j = 0;j < numPoints;++j)
+    {
+        float *cellData = m_StreamedPointData.data() + j * pointSize;
+        for (unsigned int k = 0;k < 3;++k)
+        {
+            double trackCoordinate = m_StreamedPhysicalToTrackMatrix(k,3);
+            for (unsigned int l = 0;l < 3;++l)
+                trackCoordinate += m_StreamedPhysicalToTrackMatrix(k,l) * points[3 * j + l];
+
+            cellData[k] = trackCoordinate;
+        }
+
+        for (unsigned int k = 0;k < numScalars;++k)
+            cellData[k + 3] = scalars[j * numScalars + k];
+    }
+
+    int cellSize = numPoints;
+    m_StreamedFile.write((char *) &cellSize, sizeof(int));
+    m_StreamedFile.write((char *) m_StreamedPointData.data(), m_StreamedPointData.size() * sizeof(float));
+    ++m_NumberOfStreamedTracks;
+}
+
+void TRKWriter::EndStreaming()
+{
+    if (!m_StreamedFile.is_open())
+        return;
+
+    m_StreamedHeader.n_count = m_NumberOfStreamedTracks;
+    m_StreamedFile.seekp(0);
+    m_StreamedFile.write((char *) &m_StreamedHeader, sizeof(anima::TRKHeaderStructure));
+    m_StreamedFile.close();
+}
+
 } // end namespace anime
@@ -1,12 +1,16 @@
 #pragma once
 
 #include <AnimaDataIOExport.h>
+#include <animaTRKHeaderStructure.h>
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
 #include <itkImage.h>
 
 #include <map>
+#include <fstream>
+#include <vector>
 #include <itkSpatialOrientation.h>
+#include <vnl/vnl_matrix.h>
 
 namespace anima
 {
@@ -18,6 +22,7 @@ public:
     {
         m_FileName = "";
         m_VoxelCoordinatesOutput = false;
+        m_NumberOfStreamedTracks = 0;
         m_OrientationsMap[itk::SpatialOrientation::ITK_COORDINATE_Right] = 'L';
         m_OrientationsMap[itk::SpatialOrientation::ITK_COORDINATE_Left] = 'R';
         m_OrientationsMap[itk::SpatialOrientation::ITK_COORDINATE_Posterior] = 'A';
@@ -39,6 +44,26 @@ public:
 
     void Update();
 
+    /**
+     * Streaming mode: tracks are appended one at a time instead of being read from a vtkPolyData.
+     * Opens the file and writes a header declaring the given per point scalars (no properties)
+     */
+    void BeginStreaming(const std::vector <std::string> &scalarNames);
+
+    //! Appends one track, points given as interleaved physical coordinates, scalars interleaved per point
+    void WriteTrack(const float *points, unsigned int numPoints, const float *scalars);
+
+    //! Writes the final number of tracks in the header and closes the file
+    void EndStreaming();
+
+protected:
+    //! Fills header geometry and scalar / property names from the reference image
+    void FillHeader(TRKHeaderStructure &headerStr, const std::vector <std::string> &scalarNames,
+                    const std::vector <std::string> &propertyNames);
+
+    //! Computes the physical to track coordinates matrix from the header
+    vnl_matrix <double> ComputePhysicalToTrackMatrix(const TRKHeaderStructure &headerStr);
+
 private:
     vtkSmartPointer <vtkPolyData> m_TrackData;
     ImagePointer m_ReferenceImage;
@@ -48,6 +73,13 @@ private:
     bool m_VoxelCoordinatesOutput;
 
     std::map <CoordinatesKeyType, char> m_OrientationsMap;
+
+    // Streaming mode variables
+    std::ofstream m_StreamedFile;
+    TRKHeaderStructure m_StreamedHeader;
+    vnl_matrix <double> m_StreamedPhysicalToTrackMatrix;
+    std::vector <float> m_StreamedPointData;
+    unsigned int m_NumberOfStreamedTracks;
 };
 
 } // end namespace anima
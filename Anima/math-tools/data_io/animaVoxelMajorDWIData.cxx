@@ -0,0 +1,319 @@
+#include <animaVoxelMajorDWIData.h>
+
+#include <itkImageFileReader.h>
+#include <itkImageToImageFilterCommon.h>
+#include <itkImageRegionConstIterator.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+
+namespace anima
+{
+
+VoxelMajorDWIData::VoxelMajorDWIData()
+{
+    m_StorageType = Float32;
+    m_ComputationMask = ITK_NULLPTR;
+    m_NumberOfSlicesPerChunk = 4;
+
+    m_Geometry = ITK_NULLPTR;
+    m_NumberOfVolumes = 0;
+    m_NumberOfStoredVoxels = 0;
+}
+
+void VoxelMajorDWIData::Read(const std::string &fileName)
+{
+    itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO(fileName.c_str(), itk::IOFileModeEnum::ReadMode);
+
+    if (!imageIO)
+    {
+        // File list
+        std::ifstream fileIn(fileName.c_str());
+        if (!fileIn.is_open())
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Unable to read file: " + fileName,ITK_LOCATION);
+
+        std::vector <std::string> fileNames;
+        while (!fileIn.eof())
+        {
+            char tmpStr[2048];
+            fileIn.getline(tmpStr,2048);
+
+            if (strcmp(tmpStr,"") == 0)
+                continue;
+
+            fileNames.push_back(tmpStr);
+        }
+
+        fileIn.close();
+
+        this->ReadImageList(fileNames);
+        return;
+    }
+
+    imageIO->SetFileName(fileName);
+    imageIO->ReadImageInformation();
+
+    unsigned int ndim = imageIO->GetNumberOfDimensions();
+    if (ndim == 3)
+        this->ReadImageList(std::vector <std::string> (1,fileName));
+    else if (ndim == 4)
+        this->ReadImage4D(fileName,imageIO);
+    else
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Unable to read file: " + fileName,ITK_LOCATION);
+}
+
+void VoxelMajorDWIData::ReadImage4D(const std::string &fileName, itk::ImageIOBase *imageIO)
+{
+    typedef itk::ImageFileReader <Image4DType> ReaderType;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetImageIO(imageIO);
+    reader->SetFileName(fileName);
+    reader->UpdateOutputInformation();
+
+    Image4DType *image = reader->GetOutput();
+    Image4DType::RegionType largestRegion = image->GetLargestPossibleRegion();
+
+    GeometryType::Pointer geometry = GeometryType::New();
+    GeometryType::RegionType geometryRegion;
+    GeometryType::PointType geometryOrigin;
+    GeometryType::SpacingType geometrySpacing;
+    GeometryType::DirectionType geometryDirection;
+
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        geometryRegion.SetIndex(i,largestRegion.GetIndex(i));
+        geometryRegion.SetSize(i,largestRegion.GetSize(i));
+        geometryOrigin[i] = image->GetOrigin()[i];
+        geometrySpacing[i] = image->GetSpacing()[i];
+
+        for (unsigned int j = 0;j < 3;++j)
+            geometryDirection(i,j) = image->GetDirection()(i,j);
+    }
+
+    geometry->SetLargestPossibleRegion(geometryRegion);
+    geometry->SetOrigin(geometryOrigin);
+    geometry->SetSpacing(geometrySpacing);
+    geometry->SetDirection(geometryDirection);
+
+    this->InitializeStorage(geometry,largestRegion.GetSize(3));
+
+    // Read slabs of slices for all volumes, and scatter them to voxel major storage. If the image IO cannot stream,
+    // the whole image is read by the first slab and the following ones are served from the reader buffer
+    unsigned int numSlices = largestRegion.GetSize(2);
+    size_t sliceSize = largestRegion.GetSize(0) * largestRegion.GetSize(1);
+    unsigned int chunkSize = std::max(m_NumberOfSlicesPerChunk,1U);
+
+    for (unsigned int firstSlice = 0;firstSlice < numSlices;firstSlice += chunkSize)
+    {
+        Image4DType::RegionType slabRegion = largestRegion;
+        slabRegion.SetIndex(2,largestRegion.GetIndex(2) + firstSlice);
+        slabRegion.SetSize(2,std::min(chunkSize,numSlices - firstSlice));
+
+        image->SetRequestedRegion(slabRegion);
+        image->PropagateRequestedRegion();
+        image->UpdateOutputData();
+
+        size_t firstVoxel = sliceSize * firstSlice;
+        size_t numSlabVoxels = sliceSize * slabRegion.GetSize(2);
+
+        itk::ImageRegionConstIterator <Image4DType> slabItr(image,slabRegion);
+        for (unsigned int t = 0;t < m_NumberOfVolumes;++t)
+        {
+            for (size_t i = 0;i < numSlabVoxels;++i)
+            {
+                int32_t storedIndex = m_StoredVoxelIndexes[firstVoxel + i];
+                if (storedIndex >= 0)
+                    this->SetStoredSignal(storedIndex,t,slabItr.Get());
+
+                ++slabItr;
+            }
+        }
+    }
+}
+
+void VoxelMajorDWIData::ReadImageList(const std::vector <std::string> &fileNames)
+{
+    typedef itk::ImageFileReader <VolumeImageType> ReaderType;
+
+    for (unsigned int t = 0;t < fileNames.size();++t)
+    {
+        ReaderType::Pointer reader = ReaderType::New();
+        reader->SetFileName(fileNames[t]);
+        reader->Update();
+
+        VolumeImageType *volume = reader->GetOutput();
+        if (t == 0)
+        {
+            GeometryType::Pointer geometry = GeometryType::New();
+            geometry->SetLargestPossibleRegion(volume->GetLargestPossibleRegion());
+            geometry->SetOrigin(volume->GetOrigin());
+            geometry->SetSpacing(volume->GetSpacing());
+            geometry->SetDirection(volume->GetDirection());
+
+            this->InitializeStorage(geometry,fileNames.size());
+        }
+        else if (volume->GetLargestPossibleRegion().GetSize() != m_Geometry->GetLargestPossibleRegion().GetSize())
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Volumes of different sizes in " + fileNames[t],ITK_LOCATION);
+        else if (!this->HasSameGeometry(volume))
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Volumes of different origins, spacings or directions in " + fileNames[t],ITK_LOCATION);
+
+        itk::ImageRegionConstIterator <VolumeImageType> volumeItr(volume,volume->GetLargestPossibleRegion());
+        for (size_t i = 0;!volumeItr.IsAtEnd();++i)
+        {
+            int32_t storedIndex = m_StoredVoxelIndexes[i];
+            if (storedIndex >= 0)
+                this->SetStoredSignal(storedIndex,t,volumeItr.Get());
+
+            ++volumeItr;
+        }
+    }
+}
+
+bool VoxelMajorDWIData::HasSameGeometry(const GeometryType *volume) const
+{
+    // Same tolerances as ITK filters checking that their inputs occupy the same physical space
+    double coordinateTolerance = itk::ImageToImageFilterCommon::GetGlobalDefaultCoordinateTolerance() * m_Geometry->GetSpacing()[0];
+    double directionTolerance = itk::ImageToImageFilterCommon::GetGlobalDefaultDirectionTolerance();
+
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        if (std::abs(volume->GetOrigin()[i] - m_Geometry->GetOrigin()[i]) > coordinateTolerance)
+            return false;
+
+        if (std::abs(volume->GetSpacing()[i] - m_Geometry->GetSpacing()[i]) > coordinateTolerance)
+            return false;
+
+        for (unsigned int j = 0;j < 3;++j)
+        {
+            if (std::abs(volume->GetDirection()(i,j) - m_Geometry->GetDirection()(i,j)) > directionTolerance)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void VoxelMajorDWIData::InitializeStorage(GeometryType *geometry, unsigned int numberOfVolumes)
+{
+    m_Geometry = geometry;
+    m_NumberOfVolumes = numberOfVolumes;
+
+    size_t numVoxels = m_Geometry->GetLargestPossibleRegion().GetNumberOfPixels();
+    if (numVoxels > static_cast <size_t> (std::numeric_limits <int32_t>::max()))
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Too many voxels for voxel major storage",ITK_LOCATION);
+
+    m_StoredVoxelIndexes.resize(numVoxels);
+    m_NumberOfStoredVoxels = 0;
+
+    if (m_ComputationMask)
+    {
+        if (m_ComputationMask->GetLargestPossibleRegion().GetSize() != m_Geometry->GetLargestPossibleRegion().GetSize())
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Computation mask and diffusion images have different sizes",ITK_LOCATION);
+
+        typedef itk::ImageRegionConstIterator <MaskImageType> MaskIteratorType;
+        MaskIteratorType maskItr(m_ComputationMask,m_ComputationMask->GetLargestPossibleRegion());
+        for (size_t i = 0;i < numVoxels;++i)
+        {
+            if (maskItr.Get() != 0)
+            {
+                m_StoredVoxelIndexes[i] = m_NumberOfStoredVoxels;
+                ++m_NumberOfStoredVoxels;
+            }
+            else
+                m_StoredVoxelIndexes[i] = -1;
+
+            ++maskItr;
+        }
+    }
+    else
+    {
+        for (size_t i = 0;i < numVoxels;++i)
+            m_StoredVoxelIndexes[i] = i;
+
+        m_NumberOfStoredVoxels = numVoxels;
+    }
+
+    m_FloatSignals.clear();
+    m_IntegerSignals.clear();
+
+    size_t storageSize = m_NumberOfStoredVoxels * m_NumberOfVolumes;
+    if (m_StorageType == Float32)
+        m_FloatSignals.resize(storageSize,0.0f);
+    else
+        m_IntegerSignals.resize(storageSize,0);
+}
+
+void VoxelMajorDWIData::SetStoredSignal(size_t storedIndex, unsigned int volume, float value)
+{
+    size_t pos = storedIndex * m_NumberOfVolumes + volume;
+    if (m_StorageType == Float32)
+    {
+        m_FloatSignals[pos] = value;
+        return;
+    }
+
+    // Integer storage is exact or refused: rounding normalized signals or clamping high range ones would silently
+    // change the data
+    if ((value != std::round(value))||(value < std::numeric_limits <int16_t>::min())||(value > std::numeric_limits <int16_t>::max()))
+    {
+        std::string errorMessage = "DWI signal value " + std::to_string(value) +
+                " cannot be stored as a 16 bits integer, use 32 bits float storage";
+        throw itk::ExceptionObject(__FILE__, __LINE__,errorMessage,ITK_LOCATION);
+    }
+
+    m_IntegerSignals[pos] = static_cast <int16_t> (value);
+}
+
+size_t VoxelMajorDWIData::GetLinearIndex(const IndexType &index) const
+{
+    const GeometryType::RegionType &region = m_Geometry->GetLargestPossibleRegion();
+
+    size_t linearIndex = 0;
+    for (int i = 2;i >= 0;--i)
+        linearIndex = linearIndex * region.GetSize(i) + (index[i] - region.GetIndex(i));
+
+    return linearIndex;
+}
+
+bool VoxelMajorDWIData::GetVoxelSignals(size_t linearIndex, double *signals) const
+{
+    int32_t storedIndex = m_StoredVoxelIndexes[linearIndex];
+    if (storedIndex < 0)
+    {
+        std::fill(signals,signals + m_NumberOfVolumes,0.0);
+        return false;
+    }
+
+    size_t pos = static_cast <size_t> (storedIndex) * m_NumberOfVolumes;
+    if (m_StorageType == Float32)
+    {
+        for (unsigned int i = 0;i < m_NumberOfVolumes;++i)
+            signals[i] = m_FloatSignals[pos + i];
+    }
+    else
+    {
+        for (unsigned int i = 0;i < m_NumberOfVolumes;++i)
+            signals[i] = m_IntegerSignals[pos + i];
+    }
+
+    return true;
+}
+
+double VoxelMajorDWIData::GetVoxelSignal(size_t linearIndex, unsigned int volume) const
+{
+    int32_t storedIndex = m_StoredVoxelIndexes[linearIndex];
+    if (storedIndex < 0)
+        return 0;
+
+    size_t pos = static_cast <size_t> (storedIndex) * m_NumberOfVolumes + volume;
+    if (m_StorageType == Float32)
+        return m_FloatSignals[pos];
+
+    return m_IntegerSignals[pos];
+}
+
+} // end namespace anima
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <AnimaDataIOExport.h>
+#include <itkImage.h>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace anima
+{
+
+/**
+ * @brief Voxel major storage of diffusion weighted images: the signals of all volumes at a voxel are contiguous,
+ * and only the voxels of an optional mask are stored.
+ *
+ * It is filled by reading a 4D image by slabs of slices (streamed if the image IO supports it), or a text file listing
+ * 3D volumes one volume at a time, so that the volumes never exist as separate images. Signals are stored as 32 bits
+ * floats (default) or 16 bits integers (integer valued acquisitions only: reading throws if a signal is not an integer
+ * in the int16 range).
+ * Estimators reading this container only need a geometry image as input (see CreateGeometryImage).
+ */
+class ANIMADATAIO_EXPORT VoxelMajorDWIData
+{
+public:
+    typedef enum
+    {
+        Float32 = 0,
+        Int16
+    } StorageType;
+
+    typedef itk::Image <unsigned char, 3> MaskImageType;
+    typedef itk::Image <float, 3> VolumeImageType;
+    typedef itk::Image <float, 4> Image4DType;
+    typedef itk::ImageBase <3> GeometryType;
+    typedef GeometryType::IndexType IndexType;
+
+    VoxelMajorDWIData();
+    ~VoxelMajorDWIData() {}
+
+    void SetStorageType(StorageType val) {m_StorageType = val;}
+    StorageType GetStorageType() const {return m_StorageType;}
+
+    //! Voxels outside the mask are not stored, all voxels are stored if no mask is set
+    void SetComputationMask(MaskImageType *mask) {m_ComputationMask = mask;}
+
+    //! Number of slices of a 4D image read at once
+    void SetNumberOfSlicesPerChunk(unsigned int val) {m_NumberOfSlicesPerChunk = val;}
+
+    //! Reads either a 4D image, a 3D image (one volume) or a text file listing 3D volumes
+    void Read(const std::string &fileName);
+
+    unsigned int GetNumberOfVolumes() const {return m_NumberOfVolumes;}
+    size_t GetNumberOfStoredVoxels() const {return m_NumberOfStoredVoxels;}
+
+    //! Geometry (largest possible region, origin, spacing, direction) of the volumes
+    const GeometryType *GetGeometry() const {return m_Geometry;}
+
+    //! Image with the geometry of the volumes and no buffer, used as the geometry input of estimators
+    template <class TImageType>
+    typename TImageType::Pointer CreateGeometryImage() const
+    {
+        typename TImageType::Pointer geometryImage = TImageType::New();
+        geometryImage->Initialize();
+        geometryImage->SetRegions(m_Geometry->GetLargestPossibleRegion());
+        geometryImage->SetOrigin(m_Geometry->GetOrigin());
+        geometryImage->SetSpacing(m_Geometry->GetSpacing());
+        geometryImage->SetDirection(m_Geometry->GetDirection());
+
+        return geometryImage;
+    }
+
+    //! Linear index of a voxel in the largest possible region of the volumes
+    size_t GetLinearIndex(const IndexType &index) const;
+
+    bool IsStored(size_t linearIndex) const {return m_StoredVoxelIndexes[linearIndex] >= 0;}
+
+    //! Copies the signals of a voxel (one per volume), zeroes them and returns false if the voxel is not stored
+    bool GetVoxelSignals(size_t linearIndex, double *signals) const;
+
+    //! Signal of a voxel in one volume, zero if the voxel is not stored
+    double GetVoxelSignal(size_t linearIndex, unsigned int volume) const;
+
+private:
+    //! Allocates storage for the mask voxels, all signals being null
+    void InitializeStorage(GeometryType *geometry, unsigned int numberOfVolumes);
+
+    void SetStoredSignal(size_t storedIndex, unsigned int volume, float value);
+
+    void ReadImage4D(const std::string &fileName, itk::ImageIOBase *imageIO);
+    void ReadImageList(const std::vector <std::string> &fileNames);
+
+    //! Checks that a volume has the origin, spacing and direction of the stored geometry
+    bool HasSameGeometry(const GeometryType *volume) const;
+
+    StorageType m_StorageType;
+    MaskImageType::Pointer m_ComputationMask;
+    unsigned int m_NumberOfSlicesPerChunk;
+
+    GeometryType::Pointer m_Geometry;
+    unsigned int m_NumberOfVolumes;
+    size_t m_NumberOfStoredVoxels;
+
+    //! Position of each voxel of the volumes among stored voxels, -1 if not stored
+    std::vector <int32_t> m_StoredVoxelIndexes;
+
+    // Stored signals, voxel major, only one of them is used depending on the storage type
+    std::vector <float> m_FloatSignals;
+    std::vector <int16_t> m_IntegerSignals;
+};
+
+} // end namespace anima
@@ -2,8 +2,12 @@
 
 #include <itkInterpolateImageFunction.h>
 #include <animaMultiCompartmentModel.h>
-#include <mutex>
 #include <animaMCMWeightedAverager.h>
+#include <animaBaseTensorTools.h>
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
 
 namespace anima
 {
@@ -51,6 +55,8 @@ public:
     typedef anima::MCMWeightedAverager AveragerType;
     typedef AveragerType::Pointer AveragerPointer;
 
+    typedef anima::LogEuclideanTensorCalculator <double> LECalculatorType;
+
     /** Evaluate the function at a ContinuousIndex position
      *
      * Returns the linearly interpolated image intensity at a
@@ -67,6 +73,22 @@ public:
 
     std::vector <AveragerPointer> &GetAveragers() const {return m_MCMAveragers;}
 
+    /**
+     * If on, matchings between the directional compartments of neighboring voxels are computed once when setting the
+     * input image. Interpolations whose neighbors are all unambiguously matched then average matched compartments
+     * directly, the others use the spectral clustering of the averager
+     */
+    void SetUseCachedMatching(bool val);
+    itkGetConstMacro(UseCachedMatching, bool)
+
+    /**
+     * Two compartments are unambiguously matched if their squared log-Euclidean distance is lower than this ratio
+     * times their distance to any other compartment of the neighbor voxel. Should be in ]0,1[, a ratio of 1 or more
+     * would match a compartment with one of two equidistant compartments
+     */
+    void SetMatchingDistanceRatio(double val);
+    itkGetConstMacro(MatchingDistanceRatio, double)
+
     SizeType GetRadius() const override
     {
         return SizeType::Filled(1);
@@ -106,9 +128,26 @@ protected:
     //! Sets averager specific parameters if sub-classes are derived
     virtual void SetSpecificAveragerParameters(unsigned int threadIndex) const {}
 
+    //! Claims a free workspace without locking, each thread first trying its own, yielding if all are in use
     unsigned int GetFreeWorkIndex() const;
     void UnlockWorkIndex(unsigned int index) const;
 
+    //! Computes the matching of directional compartments of each voxel with its next neighbor along each axis
+    void ComputeCompartmentMatchings();
+
+    /**
+     * Matching code of the directional compartments of two voxels (given by their log tensors and effective
+     * compartments), 0 if they are not unambiguously matched
+     */
+    uint16_t MatchCompartments(unsigned int numCompartments, const double *logTensors, const unsigned char *effective,
+                               const double *neighborLogTensors, const unsigned char *neighborEffective) const;
+
+    /**
+     * Propagates the cached matchings over the neighbors used by an interpolation to label their compartments, returns
+     * false if some of them are not unambiguously matched
+     */
+    bool ComputeCachedCompartmentClasses(unsigned int threadIndex, unsigned int numUsedNeighbors) const;
+
 private:
     MCMLinearInterpolateImageFunction(const Self&); //purposely not implemented
     void operator=(const Self&); //purposely not implemented
@@ -117,12 +156,29 @@ private:
     static const unsigned long m_Neighbors;
     static const unsigned int m_SphereDimension = 3;
 
-    mutable std::mutex m_LockUsedModels;
-    mutable std::vector <int> m_UsedModels;
+    //! Matching codes hold 2 bits per compartment and a matched flag
+    static const unsigned int m_MaximalMatchedCompartments = 4;
+    static const uint16_t m_MatchedFlag = 1 << 8;
+
+    std::unique_ptr <std::atomic <bool> []> m_UsedWorkspaces;
 
     mutable std::vector < std::vector <MCModelPointer> > m_ReferenceInputModels;
     mutable std::vector < std::vector <double> > m_ReferenceInputWeights;
     mutable std::vector <AveragerPointer> m_MCMAveragers;
+
+    bool m_UseCachedMatching;
+    double m_MatchingDistanceRatio;
+
+    //! Matching codes of each buffered voxel with its next neighbor along each axis, empty if not computed
+    std::vector <uint16_t> m_CompartmentMatchings;
+    const InputImageType *m_MatchingsImage;
+    itk::ModifiedTimeType m_MatchingsTime;
+
+    // Per workspace buffers of cached matching interpolations
+    mutable std::vector < std::vector <unsigned int> > m_WorkNeighborCorners;
+    mutable std::vector < std::vector <size_t> > m_WorkNeighborOffsets;
+    mutable std::vector < std::vector <int> > m_WorkCompartmentLabels;
+    mutable std::vector < std::vector <unsigned int> > m_WorkCompartmentClasses;
 };
 
 } // end namespace anima
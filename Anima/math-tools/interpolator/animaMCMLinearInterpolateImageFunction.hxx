@@ -3,6 +3,9 @@
 
 #include <itkMultiThreaderBase.h>
 
+#include <functional>
+#include <thread>
+
 namespace anima
 {
 /**
@@ -21,6 +24,11 @@ template<class TInputImage, class TCoordRep>
 MCMLinearInterpolateImageFunction< TInputImage, TCoordRep >
 ::MCMLinearInterpolateImageFunction()
 {
+    m_UseCachedMatching = false;
+    m_MatchingDistanceRatio = 0.25;
+
+    m_MatchingsImage = ITK_NULLPTR;
+    m_MatchingsTime = 0;
 }
 
 template<class TInputImage, class TCoordRep>
@@ -50,6 +58,335 @@ MCMLinearInterpolateImageFunction< TInputImage, TCoordRep >
         for (unsigned int j = 0;j < m_Neighbors;++j)
             m_ReferenceInputModels[i][j] = model->Clone();
     }
+
+    m_UsedWorkspaces.reset(new std::atomic <bool> [numThreads]);
+    for (unsigned int i = 0;i < numThreads;++i)
+        m_UsedWorkspaces[i] = false;
+
+    unsigned int numDirectionalCompartments = model->GetNumberOfCompartments() - model->GetNumberOfIsotropicCompartments();
+    m_WorkNeighborCorners.resize(numThreads);
+    m_WorkNeighborOffsets.resize(numThreads);
+    m_WorkCompartmentLabels.resize(numThreads);
+    m_WorkCompartmentClasses.resize(numThreads);
+    for (unsigned int i = 0;i < numThreads;++i)
+    {
+        m_WorkNeighborCorners[i].resize(m_Neighbors);
+        m_WorkNeighborOffsets[i].resize(m_Neighbors);
+        m_WorkCompartmentLabels[i].resize(m_Neighbors * numDirectionalCompartments);
+    }
+
+    this->ComputeCompartmentMatchings();
+}
+
+template<class TInputImage, class TCoordRep>
+void
+MCMLinearInterpolateImageFunction< TInputImage, TCoordRep >
+::SetUseCachedMatching(bool val)
+{
+    if (m_UseCachedMatching == val)
+        return;
+
+    m_UseCachedMatching = val;
+    if (this->GetInputImage())
+        this->ComputeCompartmentMatchings();
+
+    this->Modified();
+}
+
+template<class TInputImage, class TCoordRep>
+void
+MCMLinearInterpolateImageFunction< TInputImage, TCoordRep >
+::SetMatchingDistanceRatio(double val)
+{
+    if ((val <= 0.0)||(val >= 1.0))
+        itkExceptionMacro("Matching distance ratio should be strictly between 0 and 1");
+
+    if (m_MatchingDistanceRatio == val)
+        return;
+
+    m_MatchingDistanceRatio = val;
+
+    // Matchings computed with the previous ratio are outdated
+    m_MatchingsImage = ITK_NULLPTR;
+    if (this->GetInputImage())
+        this->ComputeCompartmentMatchings();
+
+    this->Modified();
+}
+
+template<class TInputImage, class TCoordRep>
+void
+MCMLinearInterpolateImageFunction< TInputImage, TCoordRep >
+::ComputeCompartmentMatchings()
+{
+    const InputImageType *input = this->GetInputImage();
+    if ((!m_UseCachedMatching)||(!input))
+    {
+        m_CompartmentMatchings.clear();
+        m_MatchingsImage = ITK_NULLPTR;
+        return;
+    }
+
+    // Already computed on this image
+    if ((input == m_MatchingsImage)&&(input->GetMTime() == m_MatchingsTime))
+        return;
+
+    m_CompartmentMatchings.clear();
+    m_MatchingsImage = input;
+    m_MatchingsTime = input->GetMTime();
+
+    MCModelPointer model = const_cast <InputImageType *> (input)->GetDescriptionModel();
+    unsigned int numIsoCompartments = model->GetNumberOfIsotropicCompartments();
+    unsigned int numCompartments = model->GetNumberOfCompartments() - numIsoCompartments;
+
+    // Nothing to match, or not handled: interpolations use the averager clustering
+    if ((numCompartments == 0)||(numCompartments > m_MaximalMatchedCompartments))
+        return;
+
+    if (!model->GetCompartment(numIsoCompartments)->GetTensorCompatible())
+        return;
+
+    typename InputImageType::RegionType region = input->GetBufferedRegion();
+    m_CompartmentMatchings.resize(region.GetNumberOfPixels() * ImageDimension);
+
+    // Slices along the last axis are processed in parallel, each one with the log tensors of its next slice
+    size_t strides[ImageDimension];
+    strides[0] = 1;
+    for (unsigned int i = 1;i < ImageDimension;++i)
+        strides[i] = strides[i-1] * region.GetSize(i-1);
+
+    unsigned int lastDimension = ImageDimension - 1;
+    size_t sliceSize = strides[lastDimension];
+    unsigned int numSlices = region.GetSize(lastDimension);
+    unsigned int logTensorsSize = numCompartments * 6;
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->ParallelizeArray(0,numSlices,[&](itk::SizeValueType slice)
+    {
+        MCModelPointer workModel = model->Clone();
+        typename LECalculatorType::Pointer leCalculator = LECalculatorType::New();
+        vnl_matrix <double> workTensor(m_SphereDimension,m_SphereDimension);
+        itk::VariableLengthVector <double> workLogVector;
+
+        unsigned int numLoadedSlices = (slice + 1 < numSlices) ? 2 : 1;
+        std::vector <double> logTensors(numLoadedSlices * sliceSize * logTensorsSize,0.0);
+        std::vector <unsigned char> effectiveCompartments(numLoadedSlices * sliceSize * numCompartments,0);
+
+        for (size_t i = 0;i < numLoadedSlices * sliceSize;++i)
+        {
+            const PixelType value = input->GetPixel(input->ComputeIndex(slice * sliceSize + i));
+            if (isZero(value))
+                continue;
+
+            workModel->SetModelVector(value);
+            for (unsigned int j = 0;j < numCompartments;++j)
+            {
+                if (workModel->GetCompartmentWeight(numIsoCompartments + j) <= 0)
+                    continue;
+
+                effectiveCompartments[i * numCompartments + j] = 1;
+                workTensor = workModel->GetCompartment(numIsoCompartments + j)->GetDiffusionTensor().GetVnlMatrix().as_matrix();
+                leCalculator->GetTensorLogarithm(workTensor,workTensor);
+                anima::GetVectorRepresentation(workTensor,workLogVector,6,true);
+
+                for (unsigned int k = 0;k < 6;++k)
+                    logTensors[i * logTensorsSize + j * 6 + k] = workLogVector[k];
+            }
+        }
+
+        for (size_t i = 0;i < sliceSize;++i)
+        {
+            size_t offset = slice * sliceSize + i;
+            IndexType index = input->ComputeIndex(offset);
+
+            for (unsigned int d = 0;d < ImageDimension;++d)
+            {
+                uint16_t &matchingCode = m_CompartmentMatchings[offset * ImageDimension + d];
+                if (index[d] + 1 >= static_cast <IndexValueType> (region.GetIndex(d) + region.GetSize(d)))
+                {
+                    matchingCode = 0;
+                    continue;
+                }
+
+                size_t neighbor = i + strides[d];
+                matchingCode = this->MatchCompartments(numCompartments,&logTensors[i * logTensorsSize],
+                                                       &effectiveCompartments[i * numCompartments],
+                                                       &logTensors[neighbor * logTensorsSize],
+                                                       &effectiveCompartments[neighbor * numCompartments]);
+            }
+        }
+    }, ITK_NULLPTR);
+}
+
+template<class TInputImage, class TCoordRep>
+uint16_t
+MCMLinearInterpolateImageFunction< TInputImage, TCoordRep >
+::MatchCompartments(unsigned int numCompartments, const double *logTensors, const unsigned char *effective,
+                    const double *neighborLogTensors, const unsigned char *neighborEffective) const
+{
+    unsigned int slots[m_MaximalMatchedCompartments], neighborSlots[m_MaximalMatchedCompartments];
+    unsigned int numEffective = 0, numNeighborEffective = 0;
+    for (unsigned int i = 0;i < numCompartments;++i)
+    {
+        if (effective[i])
+            slots[numEffective++] = i;
+
+        if (neighborEffective[i])
+            neighborSlots[numNeighborEffective++] = i;
+    }
+
+    if ((numEffective == 0)||(numEffective != numNeighborEffective))
+        return 0;
+
+    double distances[m_MaximalMatchedCompartments][m_MaximalMatchedCompartments];
+    for (unsigned int i = 0;i < numEffective;++i)
+    {
+        for (unsigned int j = 0;j < numEffective;++j)
+        {
+            const double *logTensor = logTensors + slots[i] * 6;
+            const double *neighborLogTensor = neighborLogTensors + neighborSlots[j] * 6;
+
+            double distValue = 0;
+            for (unsigned int k = 0;k < 6;++k)
+                distValue += (logTensor[k] - neighborLogTensor[k]) * (logTensor[k] - neighborLogTensor[k]);
+
+            distances[i][j] = distValue;
+        }
+    }
+
+    // Each compartment has to be much closer to its match than to any other compartment, on both sides
+    uint16_t matchingCode = m_MatchedFlag;
+    for (unsigned int i = 0;i < numEffective;++i)
+    {
+        unsigned int bestMatch = 0;
+        for (unsigned int j = 1;j < numEffective;++j)
+        {
+            if (distances[i][j] < distances[i][bestMatch])
+                bestMatch = j;
+        }
+
+        double bestDistance = distances[i][bestMatch];
+        for (unsigned int j = 0;j < numEffective;++j)
+        {
+            if ((j != bestMatch)&&(bestDistance >= m_MatchingDistanceRatio * distances[i][j]))
+                return 0;
+
+            if ((j != i)&&(bestDistance >= m_MatchingDistanceRatio * distances[j][bestMatch]))
+                return 0;
+        }
+
+        matchingCode |= neighborSlots[bestMatch] << (2 * slots[i]);
+    }
+
+    return matchingCode;
+}
+
+template<class TInputImage, class TCoordRep>
+bool
+MCMLinearInterpolateImageFunction< TInputImage, TCoordRep >
+::ComputeCachedCompartmentClasses(unsigned int threadIndex, unsigned int numUsedNeighbors) const
+{
+    const std::vector <unsigned int> &neighborCorners = m_WorkNeighborCorners[threadIndex];
+    const std::vector <size_t> &neighborOffsets = m_WorkNeighborOffsets[threadIndex];
+    const std::vector <MCModelPointer> &neighborModels = m_ReferenceInputModels[threadIndex];
+    std::vector <int> &compartmentLabels = m_WorkCompartmentLabels[threadIndex];
+
+    unsigned int numIsoCompartments = neighborModels[0]->GetNumberOfIsotropicCompartments();
+    unsigned int numCompartments = neighborModels[0]->GetNumberOfCompartments() - numIsoCompartments;
+
+    int cornerPositions[1 << ImageDimension];
+    bool labeledNeighbors[1 << ImageDimension];
+    unsigned int labelingQueue[1 << ImageDimension];
+    for (unsigned int i = 0;i < m_Neighbors;++i)
+    {
+        cornerPositions[i] = -1;
+        labeledNeighbors[i] = false;
+    }
+
+    for (unsigned int i = 0;i < numUsedNeighbors;++i)
+        cornerPositions[neighborCorners[i]] = i;
+
+    // First neighbor compartments define the labels, that are then propagated along the cached matchings
+    int numLabels = 0;
+    for (unsigned int j = 0;j < numCompartments;++j)
+        compartmentLabels[j] = (neighborModels[0]->GetCompartmentWeight(numIsoCompartments + j) > 0) ? numLabels++ : -1;
+
+    labeledNeighbors[0] = true;
+    labelingQueue[0] = 0;
+    unsigned int queueEnd = 1;
+    int newLabels[m_MaximalMatchedCompartments];
+
+    for (unsigned int queueStart = 0;queueStart < queueEnd;++queueStart)
+    {
+        unsigned int pos = labelingQueue[queueStart];
+        unsigned int corner = neighborCorners[pos];
+        int *labels = &compartmentLabels[pos * numCompartments];
+
+        for (unsigned int d = 0;d < ImageDimension;++d)
+        {
+            int neighborPos = cornerPositions[corner ^ (1 << d)];
+            if (neighborPos < 0)
+                continue;
+
+            // Matchings are stored on the lower voxel of the pair
+            bool forwardMatching = (((corner >> d) & 1) == 0);
+            size_t lowerOffset = forwardMatching ? neighborOffsets[pos] : neighborOffsets[neighborPos];
+            uint16_t matchingCode = m_CompartmentMatchings[lowerOffset * ImageDimension + d];
+            if (!(matchingCode & m_MatchedFlag))
+                return false;
+
+            MCModelType *neighborModel = neighborModels[neighborPos];
+            for (unsigned int j = 0;j < numCompartments;++j)
+                newLabels[j] = -1;
+
+            for (unsigned int j = 0;j < numCompartments;++j)
+            {
+                if (forwardMatching)
+                {
+                    if (labels[j] >= 0)
+                        newLabels[(matchingCode >> (2 * j)) & 3] = labels[j];
+                }
+                else if (neighborModel->GetCompartmentWeight(numIsoCompartments + j) > 0)
+                    newLabels[j] = labels[(matchingCode >> (2 * j)) & 3];
+            }
+
+            int *neighborLabels = &compartmentLabels[neighborPos * numCompartments];
+            for (unsigned int j = 0;j < numCompartments;++j)
+            {
+                bool effectiveCompartment = (neighborModel->GetCompartmentWeight(numIsoCompartments + j) > 0);
+                if (effectiveCompartment != (newLabels[j] >= 0))
+                    return false;
+
+                if (labeledNeighbors[neighborPos] && (neighborLabels[j] != newLabels[j]))
+                    return false;
+
+                neighborLabels[j] = newLabels[j];
+            }
+
+            if (!labeledNeighbors[neighborPos])
+            {
+                labeledNeighbors[neighborPos] = true;
+                labelingQueue[queueEnd] = neighborPos;
+                ++queueEnd;
+            }
+        }
+    }
+
+    if (queueEnd != numUsedNeighbors)
+        return false;
+
+    std::vector <unsigned int> &compartmentClasses = m_WorkCompartmentClasses[threadIndex];
+    compartmentClasses.clear();
+    for (unsigned int i = 0;i < numUsedNeighbors;++i)
+    {
+        for (unsigned int j = 0;j < numCompartments;++j)
+        {
+            if (compartmentLabels[i * numCompartments + j] >= 0)
+                compartmentClasses.push_back(compartmentLabels[i * numCompartments + j]);
+        }
+    }
+
+    return true;
 }
 
 template<class TInputImage, class TCoordRep>
@@ -124,31 +461,23 @@ unsigned int
 MCMLinearInterpolateImageFunction< TInputImage, TCoordRep >
 ::GetFreeWorkIndex() const
 {
-    m_LockUsedModels.lock();
+    unsigned int numWorkspaces = m_ReferenceInputModels.size();
+    unsigned int workIndex = std::hash <std::thread::id> () (std::this_thread::get_id()) % numWorkspaces;
 
-    unsigned int workIndex = 0;
-    bool workIndexOk = false;
-
-    while ((!workIndexOk)&&(workIndex < m_ReferenceInputModels.size()))
+    unsigned int numTries = 0;
+    while (true)
     {
-        workIndexOk = true;
-        for (unsigned int i = 0;i < m_UsedModels.size();++i)
-        {
-            if (m_UsedModels[i] == workIndex)
-            {
-                workIndexOk = false;
-                break;
-            }
-        }
-
-        if (!workIndexOk)
-            ++workIndex;
-    }
+        bool usedWorkspace = false;
+        if (m_UsedWorkspaces[workIndex].compare_exchange_weak(usedWorkspace,true,std::memory_order_acquire))
+            return workIndex;
 
-    m_UsedModels.push_back(workIndex);
-    m_LockUsedModels.unlock();
+        workIndex = (workIndex + 1) % numWorkspaces;
 
-    return workIndex;
+        // All workspaces in use: let their owners run instead of spinning
+        ++numTries;
+        if (numTries % numWorkspaces == 0)
+            std::this_thread::yield();
+    }
 }
 
 template<class TInputImage, class TCoordRep>
@@ -156,18 +485,7 @@ void
 MCMLinearInterpolateImageFunction< TInputImage, TCoordRep >
 ::UnlockWorkIndex(unsigned int index) const
 {
-    m_LockUsedModels.lock();
-
-    for (unsigned int i = 0;i < m_UsedModels.size();++i)
-    {
-        if (m_UsedModels[i] == index)
-        {
-            m_UsedModels.erase(m_UsedModels.begin() + i);
-            break;
-        }
-    }
-
-    m_LockUsedModels.unlock();
+    m_UsedWorkspaces[index].store(false,std::memory_order_release);
 }
 
 /**
@@ -253,6 +571,8 @@ MCMLinearInterpolateImageFunction< TInputImage, TCoordRep >
 
             m_ReferenceInputModels[threadIndex][posMCM]->SetModelVector(input);
             m_ReferenceInputWeights[threadIndex][posMCM] = overlap;
+            m_WorkNeighborCorners[threadIndex][posMCM] = counterInput;
+            m_WorkNeighborOffsets[threadIndex][posMCM] = this->GetInputImage()->ComputeOffset(neighIndex);
 
             unsigned int numEffectiveAnisotropicCompartments = 0;
             for (unsigned int i = numIsoCompartments;i < numberOfTotalInputCompartments;++i)
@@ -279,6 +599,14 @@ MCMLinearInterpolateImageFunction< TInputImage, TCoordRep >
         return voxelOutputValue;
     }
 
+    bool cachedMatching = (m_CompartmentMatchings.size() != 0)&&(m_MatchingsImage == this->GetInputImage())&&
+            (m_MatchingsImage->GetMTime() == m_MatchingsTime);
+
+    if (cachedMatching && this->ComputeCachedCompartmentClasses(threadIndex,posMCM))
+        m_MCMAveragers[threadIndex]->SetInputCompartmentClasses(m_WorkCompartmentClasses[threadIndex]);
+    else
+        m_MCMAveragers[threadIndex]->SetInputCompartmentClasses(std::vector <unsigned int> ());
+
     m_MCMAveragers[threadIndex]->SetNumberOfOutputDirectionalCompartments(maxNumCompartments);
     m_MCMAveragers[threadIndex]->SetInputModels(m_ReferenceInputModels[threadIndex]);
     m_MCMAveragers[threadIndex]->SetInputWeights(m_ReferenceInputWeights[threadIndex]);
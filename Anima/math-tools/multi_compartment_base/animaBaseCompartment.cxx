@@ -6,6 +6,60 @@
 namespace anima
 {
 
+void MCMGradientTable::Initialize(double smallDelta, double bigDelta, const std::vector <double> &gradientStrengths,
+                                  const std::vector <Vector3DType> &gradients)
+{
+    unsigned int numGradients = gradients.size();
+
+    SmallDelta = smallDelta;
+    BigDelta = bigDelta;
+    GradientStrengths = gradientStrengths;
+    BValues.resize(numGradients);
+
+    for (unsigned int j = 0;j < 3;++j)
+        Directions[j].resize(numGradients);
+
+    for (unsigned int i = 0;i < numGradients;++i)
+    {
+        BValues[i] = anima::GetBValueFromAcquisitionParameters(smallDelta, bigDelta, gradientStrengths[i]);
+        for (unsigned int j = 0;j < 3;++j)
+            Directions[j][i] = gradients[i][j];
+    }
+}
+
+MCMGradientTable::Vector3DType MCMGradientTable::GetGradient(unsigned int i) const
+{
+    Vector3DType gradient;
+    for (unsigned int j = 0;j < 3;++j)
+        gradient[j] = Directions[j][i];
+
+    return gradient;
+}
+
+void BaseCompartment::GetFourierTransformedDiffusionProfiles(const GradientTableType &gradientTable, double *attenuations)
+{
+    unsigned int numGradients = gradientTable.GetNumberOfGradients();
+
+    for (unsigned int i = 0;i < numGradients;++i)
+        attenuations[i] = this->GetFourierTransformedDiffusionProfile(gradientTable.SmallDelta, gradientTable.BigDelta,
+                                                                      gradientTable.GradientStrengths[i], gradientTable.GetGradient(i));
+}
+
+void BaseCompartment::GetSignalAttenuationJacobians(const GradientTableType &gradientTable, vnl_matrix <double> &jacobians)
+{
+    unsigned int numGradients = gradientTable.GetNumberOfGradients();
+    jacobians.set_size(this->GetNumberOfParameters(),numGradients);
+
+    for (unsigned int i = 0;i < numGradients;++i)
+    {
+        ListType &jacobian = this->GetSignalAttenuationJacobian(gradientTable.SmallDelta, gradientTable.BigDelta,
+                                                                gradientTable.GradientStrengths[i], gradientTable.GetGradient(i));
+
+        for (unsigned int j = 0;j < jacobian.size();++j)
+            jacobians.put(j,i,jacobian[j]);
+    }
+}
+
 double BaseCompartment::GetPredictedSignal(double smallDelta, double bigDelta, double gradientStrength, const Vector3DType &gradient)
 {
     double ftDiffusionProfile = GetFourierTransformedDiffusionProfile(smallDelta,bigDelta, gradientStrength, gradient);
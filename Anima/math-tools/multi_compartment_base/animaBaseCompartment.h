@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <vnl/vnl_vector_fixed.h>
+#include <vnl/vnl_matrix.h>
 #include <itkMatrix.h>
 #include <itkLightObject.h>
 #include <itkObjectFactory.h>
@@ -27,6 +28,29 @@ enum DiffusionModelCompartmentType
     DDI
 };
 
+/**
+ * @brief Gradient table stored as a structure of arrays (b-values, one array per direction coordinate)
+ * for batched signal predictions. Acquisition parameters are kept for compartments that depend on them
+ */
+struct ANIMAMCMBASE_EXPORT MCMGradientTable
+{
+    typedef vnl_vector_fixed <double,3> Vector3DType;
+
+    MCMGradientTable() : SmallDelta(0.0), BigDelta(0.0) {}
+
+    //! Fills the table from acquisition parameters and gradient directions
+    void Initialize(double smallDelta, double bigDelta, const std::vector <double> &gradientStrengths,
+                    const std::vector <Vector3DType> &gradients);
+
+    unsigned int GetNumberOfGradients() const {return BValues.size();}
+    Vector3DType GetGradient(unsigned int i) const;
+
+    double SmallDelta, BigDelta;
+    std::vector <double> GradientStrengths;
+    std::vector <double> BValues;
+    std::vector <double> Directions[3];
+};
+
 class ANIMAMCMBASE_EXPORT BaseCompartment : public itk::LightObject
 {
 public:
@@ -46,9 +70,22 @@ public:
     typedef vnl_vector_fixed <double,3> Vector3DType;
     typedef std::vector <double> ListType;
     typedef itk::VariableLengthVector <double> ModelOutputVectorType;
+    typedef anima::MCMGradientTable GradientTableType;
 
     virtual double GetFourierTransformedDiffusionProfile(double smallDelta, double bigDelta, double gradientStrength, const Vector3DType &gradient) = 0;
     virtual ListType &GetSignalAttenuationJacobian(double smallDelta, double bigDelta, double gradientStrength, const Vector3DType &gradient) = 0;
+
+    /**
+     * Batched signal attenuations for a whole gradient table, written contiguously in attenuations (one value per gradient).
+     * Default implementation loops over GetFourierTransformedDiffusionProfile, compartments re-implement it with vectorizable kernels
+     */
+    virtual void GetFourierTransformedDiffusionProfiles(const GradientTableType &gradientTable, double *attenuations);
+
+    /**
+     * Batched signal attenuation jacobians for a whole gradient table. jacobians is resized to
+     * number of parameters x number of gradients, each row holding the derivatives with respect to one parameter
+     */
+    virtual void GetSignalAttenuationJacobians(const GradientTableType &gradientTable, vnl_matrix <double> &jacobians);
     virtual double GetLogDiffusionProfile(const Vector3DType &sample) = 0;
 
     //! Various methods for optimization parameters setting and getting
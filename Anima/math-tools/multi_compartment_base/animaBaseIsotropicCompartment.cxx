@@ -25,6 +25,32 @@ BaseCompartment::ListType &BaseIsotropicCompartment::GetSignalAttenuationJacobia
     m_JacobianVector[0] = - bValue * signalAttenuation;
     return m_JacobianVector;
 }
+
+void BaseIsotropicCompartment::GetFourierTransformedDiffusionProfiles(const GradientTableType &gradientTable, double *attenuations)
+{
+    unsigned int numGradients = gradientTable.GetNumberOfGradients();
+    const double *bValues = gradientTable.BValues.data();
+    double diffusivity = this->GetAxialDiffusivity();
+
+    for (unsigned int i = 0;i < numGradients;++i)
+        attenuations[i] = std::exp(- bValues[i] * diffusivity);
+}
+
+void BaseIsotropicCompartment::GetSignalAttenuationJacobians(const GradientTableType &gradientTable, vnl_matrix <double> &jacobians)
+{
+    unsigned int numGradients = gradientTable.GetNumberOfGradients();
+    jacobians.set_size(this->GetNumberOfParameters(),numGradients);
+
+    if (jacobians.rows() == 0)
+        return;
+
+    const double *bValues = gradientTable.BValues.data();
+    double diffusivity = this->GetAxialDiffusivity();
+    double *diffusivityDerivatives = jacobians[0];
+
+    for (unsigned int i = 0;i < numGradients;++i)
+        diffusivityDerivatives[i] = - bValues[i] * std::exp(- bValues[i] * diffusivity);
+}
     
 double BaseIsotropicCompartment::GetLogDiffusionProfile(const Vector3DType &sample)
 {
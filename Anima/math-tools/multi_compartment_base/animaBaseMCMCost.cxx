@@ -10,6 +10,17 @@ BaseMCMCost::BaseMCMCost()
 
     m_SmallDelta = anima::DiffusionSmallDelta;
     m_BigDelta = anima::DiffusionBigDelta;
+
+    m_ModifiedGradientTable = true;
+}
+
+void BaseMCMCost::UpdateGradientTable()
+{
+    if (!m_ModifiedGradientTable)
+        return;
+
+    m_GradientTable.Initialize(m_SmallDelta, m_BigDelta, m_GradientStrengths, m_Gradients);
+    m_ModifiedGradientTable = false;
 }
 
 } // end namespace anima
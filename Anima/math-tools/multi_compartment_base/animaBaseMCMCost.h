@@ -34,10 +34,11 @@ public:
     typedef MCMType::Pointer MCMPointer;
     typedef MCMType::Vector3DType Vector3DType;
     typedef MCMType::ListType ListType;
+    typedef MCMType::GradientTableType GradientTableType;
 
     void SetObservedSignals(ListType &value) {m_ObservedSignals = value;}
-    void SetGradients(std::vector<Vector3DType> &value) {m_Gradients = value;}
-    void SetGradientStrengths(ListType &value) {m_GradientStrengths = value;}
+    void SetGradients(std::vector<Vector3DType> &value) {m_Gradients = value; m_ModifiedGradientTable = true;}
+    void SetGradientStrengths(ListType &value) {m_GradientStrengths = value; m_ModifiedGradientTable = true;}
 
     void SetMCMStructure(MCMType *model) {m_MCMStructure = model;}
     MCMPointer &GetMCMStructure() {return m_MCMStructure;}
@@ -70,13 +71,16 @@ public:
 
     virtual double GetSigmaSquare() {return m_SigmaSquare;}
 
-    void SetSmallDelta(double val) {m_SmallDelta = val;}
-    void SetBigDelta(double val) {m_BigDelta = val;}
+    void SetSmallDelta(double val) {m_SmallDelta = val; m_ModifiedGradientTable = true;}
+    void SetBigDelta(double val) {m_BigDelta = val; m_ModifiedGradientTable = true;}
 
 protected:
     BaseMCMCost();
     virtual ~BaseMCMCost() {}
 
+    //! Rebuilds the structure of arrays gradient table used for batched predictions if acquisition parameters changed
+    void UpdateGradientTable();
+
     double m_SigmaSquare;
     std::vector <double> m_PredictedSignals;
 
@@ -91,6 +95,9 @@ protected:
 
     MCMPointer m_MCMStructure;
 
+    GradientTableType m_GradientTable;
+    bool m_ModifiedGradientTable;
+
 private:
     BaseMCMCost(const Self&); //purposely not implemented
     void operator=(const Self&); //purposely not implemented
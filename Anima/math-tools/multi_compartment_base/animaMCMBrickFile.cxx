@@ -0,0 +1,430 @@
+#include "animaMCMBrickFile.h"
+
+#include <itkMacro.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace anima
+{
+
+namespace
+{
+
+const char MCMBrickFileMagic[8] = {'A','N','I','M','A','M','C','B'};
+const uint32_t MCMBrickFileVersion = 1;
+
+// Magic, version, component size, image size, brick size, number of compartments, origin, spacing, direction
+const size_t MCMBrickFileFixedHeaderSize = 8 + 9 * sizeof(uint32_t) + 15 * sizeof(double);
+
+// Compartment type name (zero padded) and size
+const size_t MCMBrickFileTypeNameSize = 32;
+const size_t MCMBrickFileCompartmentSize = MCMBrickFileTypeNameSize + sizeof(uint32_t);
+
+}
+
+MCMBrickFile::MCMBrickFile()
+{
+    m_ImageSize.Fill(0);
+    m_BrickSize.Fill(0);
+    m_BrickGridSize.Fill(0);
+
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        m_Origin[i] = 0;
+        m_Spacing[i] = 1;
+    }
+
+    for (unsigned int i = 0;i < 9;++i)
+        m_Direction[i] = (i % 4 == 0) ? 1 : 0;
+
+    m_ComponentSize = sizeof(double);
+
+    m_MappedData = ITK_NULLPTR;
+    m_MappedSize = 0;
+    m_FileData = ITK_NULLPTR;
+}
+
+MCMBrickFile::~MCMBrickFile()
+{
+    // A file still being written was not completed by Close (e.g. error while writing): it is incomplete, discard it
+    if (m_OutputFile.is_open())
+        this->DiscardOutputFile();
+
+    this->Close();
+}
+
+bool MCMBrickFile::IsBrickFile(const std::string &fileName)
+{
+    std::ifstream inFile(fileName.c_str(),std::ios::binary);
+    if (!inFile.is_open())
+        return false;
+
+    char magic[8];
+    inFile.read(magic,8);
+
+    return (inFile.gcount() == 8)&&(std::memcmp(magic,MCMBrickFileMagic,8) == 0);
+}
+
+size_t MCMBrickFile::GetHeaderSize() const
+{
+    return MCMBrickFileFixedHeaderSize + m_Compartments.size() * MCMBrickFileCompartmentSize;
+}
+
+void MCMBrickFile::InitializeBrickGrid()
+{
+    for (unsigned int i = 0;i < 3;++i)
+        m_BrickGridSize[i] = (m_ImageSize[i] + m_BrickSize[i] - 1) / m_BrickSize[i];
+}
+
+void MCMBrickFile::GetBrickRegion(unsigned int brick, IndexType &index, SizeType &size) const
+{
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        unsigned int brickPosition = brick % m_BrickGridSize[i];
+        brick /= m_BrickGridSize[i];
+
+        index[i] = brickPosition * m_BrickSize[i];
+        size[i] = std::min(m_BrickSize[i],m_ImageSize[i] - index[i]);
+    }
+}
+
+size_t MCMBrickFile::GetNumberOfBrickVoxels(unsigned int brick) const
+{
+    IndexType index;
+    SizeType size;
+    this->GetBrickRegion(brick,index,size);
+
+    return size[0] * size[1] * size[2];
+}
+
+unsigned int MCMBrickFile::GetBlockWidth(unsigned int block) const
+{
+    if (block == 0)
+        return m_Compartments.size();
+
+    return m_Compartments[block - 1].size;
+}
+
+void MCMBrickFile::Open(const std::string &fileName)
+{
+    this->Close();
+
+    size_t fileSize = 0;
+
+#ifndef _WIN32
+    int fileDescriptor = open(fileName.c_str(),O_RDONLY);
+    if (fileDescriptor < 0)
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Could not open MCM brick file " + fileName,ITK_LOCATION);
+
+    struct stat fileStats;
+    if ((fstat(fileDescriptor,&fileStats) != 0)||(fileStats.st_size < (off_t)MCMBrickFileFixedHeaderSize))
+    {
+        close(fileDescriptor);
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Invalid MCM brick file " + fileName,ITK_LOCATION);
+    }
+
+    fileSize = fileStats.st_size;
+    void *mappedData = mmap(ITK_NULLPTR,fileSize,PROT_READ,MAP_SHARED,fileDescriptor,0);
+    close(fileDescriptor);
+
+    if (mappedData == MAP_FAILED)
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Could not map MCM brick file " + fileName,ITK_LOCATION);
+
+    m_MappedData = (char *)mappedData;
+    m_MappedSize = fileSize;
+    m_FileData = m_MappedData;
+#else
+    std::ifstream inFile(fileName.c_str(),std::ios::binary | std::ios::ate);
+    if (!inFile.is_open())
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Could not open MCM brick file " + fileName,ITK_LOCATION);
+
+    fileSize = inFile.tellg();
+    inFile.seekg(0);
+    m_ReadBuffer.resize(fileSize);
+    inFile.read(m_ReadBuffer.data(),fileSize);
+    m_FileData = m_ReadBuffer.data();
+#endif
+
+    if ((fileSize < MCMBrickFileFixedHeaderSize)||(std::memcmp(m_FileData,MCMBrickFileMagic,8) != 0))
+    {
+        this->Close();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Invalid MCM brick file " + fileName,ITK_LOCATION);
+    }
+
+    uint32_t headerValues[9];
+    std::memcpy(headerValues,m_FileData + 8,9 * sizeof(uint32_t));
+    if (headerValues[0] != MCMBrickFileVersion)
+    {
+        this->Close();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Unsupported MCM brick file version in " + fileName,ITK_LOCATION);
+    }
+
+    m_ComponentSize = headerValues[1];
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        m_ImageSize[i] = headerValues[2 + i];
+        m_BrickSize[i] = headerValues[5 + i];
+    }
+
+    unsigned int numCompartments = headerValues[8];
+
+    size_t pos = 8 + 9 * sizeof(uint32_t);
+    std::memcpy(m_Origin,m_FileData + pos,3 * sizeof(double));
+    pos += 3 * sizeof(double);
+    std::memcpy(m_Spacing,m_FileData + pos,3 * sizeof(double));
+    pos += 3 * sizeof(double);
+    std::memcpy(m_Direction,m_FileData + pos,9 * sizeof(double));
+    pos += 9 * sizeof(double);
+
+    bool validSizes = (m_ComponentSize == sizeof(float))||(m_ComponentSize == sizeof(double));
+    for (unsigned int i = 0;i < 3;++i)
+        validSizes = validSizes && (m_BrickSize[i] > 0);
+
+    if ((!validSizes)||(fileSize < pos + numCompartments * MCMBrickFileCompartmentSize))
+    {
+        this->Close();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Invalid MCM brick file " + fileName,ITK_LOCATION);
+    }
+
+    m_Compartments.resize(numCompartments);
+    for (unsigned int i = 0;i < numCompartments;++i)
+    {
+        char typeName[MCMBrickFileTypeNameSize + 1];
+        std::memcpy(typeName,m_FileData + pos,MCMBrickFileTypeNameSize);
+        typeName[MCMBrickFileTypeNameSize] = '\0';
+        pos += MCMBrickFileTypeNameSize;
+
+        uint32_t compartmentSize;
+        std::memcpy(&compartmentSize,m_FileData + pos,sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+
+        m_Compartments[i].type = typeName;
+        m_Compartments[i].size = compartmentSize;
+    }
+
+    this->InitializeBrickGrid();
+    unsigned int numBricks = this->GetNumberOfBricks();
+    if (fileSize < pos + numBricks * sizeof(uint64_t))
+    {
+        this->Close();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Truncated MCM brick file " + fileName,ITK_LOCATION);
+    }
+
+    m_BrickOffsets.resize(numBricks);
+    std::memcpy(m_BrickOffsets.data(),m_FileData + pos,numBricks * sizeof(uint64_t));
+
+    unsigned int voxelWidth = 0;
+    for (unsigned int i = 0;i <= numCompartments;++i)
+        voxelWidth += this->GetBlockWidth(i);
+
+    for (unsigned int i = 0;i < numBricks;++i)
+    {
+        if (m_BrickOffsets[i] == 0)
+            continue;
+
+        if (m_BrickOffsets[i] + this->GetNumberOfBrickVoxels(i) * voxelWidth * m_ComponentSize > fileSize)
+        {
+            this->Close();
+            throw itk::ExceptionObject(__FILE__,__LINE__,"Truncated MCM brick file " + fileName,ITK_LOCATION);
+        }
+    }
+}
+
+void MCMBrickFile::ReadBrickBlock(unsigned int brick, unsigned int block, double *values) const
+{
+    size_t numBrickVoxels = this->GetNumberOfBrickVoxels(brick);
+    size_t numValues = numBrickVoxels * this->GetBlockWidth(block);
+
+    if (m_BrickOffsets[brick] == 0)
+    {
+        std::fill(values,values + numValues,0.0);
+        return;
+    }
+
+    size_t blockOffset = 0;
+    for (unsigned int i = 0;i < block;++i)
+        blockOffset += numBrickVoxels * this->GetBlockWidth(i);
+
+    const char *blockData = m_FileData + m_BrickOffsets[brick] + blockOffset * m_ComponentSize;
+    if (m_ComponentSize == sizeof(double))
+        std::memcpy(values,blockData,numValues * sizeof(double));
+    else
+    {
+        for (size_t i = 0;i < numValues;++i)
+        {
+            float value;
+            std::memcpy(&value,blockData + i * sizeof(float),sizeof(float));
+            values[i] = value;
+        }
+    }
+}
+
+void MCMBrickFile::Create(const std::string &fileName, const SizeType &imageSize, const SizeType &brickSize,
+                          const double *origin, const double *spacing, const double *direction,
+                          const std::vector <CompartmentDescription> &compartments, unsigned int componentSize)
+{
+    this->Close();
+
+    if ((componentSize != sizeof(float))&&(componentSize != sizeof(double)))
+        throw itk::ExceptionObject(__FILE__,__LINE__,"MCM brick files only store floats or doubles",ITK_LOCATION);
+
+    m_ImageSize = imageSize;
+    m_BrickSize = brickSize;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        if (m_BrickSize[i] == 0)
+            throw itk::ExceptionObject(__FILE__,__LINE__,"Null MCM brick size",ITK_LOCATION);
+
+        m_Origin[i] = origin[i];
+        m_Spacing[i] = spacing[i];
+    }
+
+    for (unsigned int i = 0;i < 9;++i)
+        m_Direction[i] = direction[i];
+
+    m_Compartments = compartments;
+    m_ComponentSize = componentSize;
+
+    for (unsigned int i = 0;i < m_Compartments.size();++i)
+    {
+        if (m_Compartments[i].type.size() > MCMBrickFileTypeNameSize)
+            throw itk::ExceptionObject(__FILE__,__LINE__,"Compartment type name too long: " + m_Compartments[i].type,ITK_LOCATION);
+    }
+
+    this->InitializeBrickGrid();
+    m_BrickOffsets.resize(this->GetNumberOfBricks());
+    std::fill(m_BrickOffsets.begin(),m_BrickOffsets.end(),0);
+
+    m_OutputFile.open(fileName.c_str(),std::ios::binary | std::ios::trunc);
+    if (!m_OutputFile.is_open())
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Could not create MCM brick file " + fileName,ITK_LOCATION);
+
+    m_OutputFileName = fileName;
+
+    uint32_t headerValues[9];
+    headerValues[0] = MCMBrickFileVersion;
+    headerValues[1] = m_ComponentSize;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        headerValues[2 + i] = m_ImageSize[i];
+        headerValues[5 + i] = m_BrickSize[i];
+    }
+
+    headerValues[8] = m_Compartments.size();
+
+    m_OutputFile.write(MCMBrickFileMagic,8);
+    m_OutputFile.write((const char *)headerValues,9 * sizeof(uint32_t));
+    m_OutputFile.write((const char *)m_Origin,3 * sizeof(double));
+    m_OutputFile.write((const char *)m_Spacing,3 * sizeof(double));
+    m_OutputFile.write((const char *)m_Direction,9 * sizeof(double));
+
+    for (unsigned int i = 0;i < m_Compartments.size();++i)
+    {
+        char typeName[MCMBrickFileTypeNameSize];
+        std::memset(typeName,0,MCMBrickFileTypeNameSize);
+        std::memcpy(typeName,m_Compartments[i].type.c_str(),m_Compartments[i].type.size());
+
+        uint32_t compartmentSize = m_Compartments[i].size;
+        m_OutputFile.write(typeName,MCMBrickFileTypeNameSize);
+        m_OutputFile.write((const char *)&compartmentSize,sizeof(uint32_t));
+    }
+
+    // Brick table, filled when closing
+    m_OutputFile.write((const char *)m_BrickOffsets.data(),m_BrickOffsets.size() * sizeof(uint64_t));
+
+    if (m_OutputFile.fail())
+    {
+        this->DiscardOutputFile();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Error while writing MCM brick file " + fileName,ITK_LOCATION);
+    }
+}
+
+void MCMBrickFile::WriteBrick(unsigned int brick, const double *values)
+{
+    if (!m_OutputFile.is_open())
+        throw itk::ExceptionObject(__FILE__,__LINE__,"MCM brick file not created for writing",ITK_LOCATION);
+
+    if (!values)
+    {
+        m_BrickOffsets[brick] = 0;
+        return;
+    }
+
+    unsigned int voxelWidth = 0;
+    for (unsigned int i = 0;i <= m_Compartments.size();++i)
+        voxelWidth += this->GetBlockWidth(i);
+
+    size_t numValues = this->GetNumberOfBrickVoxels(brick) * voxelWidth;
+    std::streamoff brickOffset = m_OutputFile.tellp();
+
+    if (m_ComponentSize == sizeof(double))
+        m_OutputFile.write((const char *)values,numValues * sizeof(double));
+    else
+    {
+        m_WriteBuffer.resize(numValues * sizeof(float));
+        for (size_t i = 0;i < numValues;++i)
+        {
+            float value = values[i];
+            std::memcpy(m_WriteBuffer.data() + i * sizeof(float),&value,sizeof(float));
+        }
+
+        m_OutputFile.write(m_WriteBuffer.data(),m_WriteBuffer.size());
+    }
+
+    if ((brickOffset < 0)||m_OutputFile.fail())
+    {
+        std::string fileName = m_OutputFileName;
+        this->DiscardOutputFile();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Error while writing MCM brick file " + fileName,ITK_LOCATION);
+    }
+
+    m_BrickOffsets[brick] = brickOffset;
+}
+
+void MCMBrickFile::DiscardOutputFile()
+{
+    m_OutputFile.close();
+    m_OutputFile.clear();
+    std::remove(m_OutputFileName.c_str());
+    m_OutputFileName.clear();
+}
+
+void MCMBrickFile::Close()
+{
+    if (m_OutputFile.is_open())
+    {
+        m_OutputFile.seekp(this->GetHeaderSize());
+        m_OutputFile.write((const char *)m_BrickOffsets.data(),m_BrickOffsets.size() * sizeof(uint64_t));
+        m_OutputFile.close();
+
+        if (m_OutputFile.fail())
+        {
+            std::string fileName = m_OutputFileName;
+            this->DiscardOutputFile();
+            throw itk::ExceptionObject(__FILE__,__LINE__,"Error while writing MCM brick file " + fileName,ITK_LOCATION);
+        }
+
+        m_OutputFileName.clear();
+    }
+
+#ifndef _WIN32
+    if (m_MappedData)
+        munmap(m_MappedData,m_MappedSize);
+#endif
+
+    m_MappedData = ITK_NULLPTR;
+    m_MappedSize = 0;
+    m_ReadBuffer.clear();
+    m_FileData = ITK_NULLPTR;
+}
+
+} // end namespace anima
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <itkIndex.h>
+#include <itkSize.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <AnimaMCMBaseExport.h>
+
+namespace anima
+{
+
+/**
+ * @brief Single file binary storage of MCM images, chunked in bricks of voxels and memory mapped for reading.
+ *
+ * File layout (native endianness): a header (magic, version, component size, image size, brick size, number of
+ * compartments, geometry), the compartment descriptions (type name, size), the offset of each brick in the file (0 for
+ * empty bricks, i.e. whose weights are all null), then the brick data. A brick stores a weights block (brick voxels x
+ * number of compartments) followed by one block per compartment (brick voxels x compartment size), the voxels of a
+ * brick being ordered x fastest. Blocks are only decoded when requested, so that reading a region or a subset of
+ * compartments only touches the corresponding data.
+ */
+class ANIMAMCMBASE_EXPORT MCMBrickFile
+{
+public:
+    typedef itk::Size <3> SizeType;
+    typedef itk::Index <3> IndexType;
+
+    struct CompartmentDescription
+    {
+        //! Compartment type name, as in the XML MCM format
+        std::string type;
+        unsigned int size;
+    };
+
+    MCMBrickFile();
+    ~MCMBrickFile();
+
+    //! True if the file starts with the MCM brick file signature
+    static bool IsBrickFile(const std::string &fileName);
+
+    //! Maps a brick file for reading and parses its header
+    void Open(const std::string &fileName);
+
+    /**
+     * Creates a brick file for writing: bricks are then written with WriteBrick and the file is completed by Close.
+     * Origin, spacing and direction (row major) are those of the image, whose index starts at 0
+     */
+    void Create(const std::string &fileName, const SizeType &imageSize, const SizeType &brickSize,
+                const double *origin, const double *spacing, const double *direction,
+                const std::vector <CompartmentDescription> &compartments, unsigned int componentSize);
+
+    //! Writes a brick from its blocks converted to doubles (see layout), or an empty brick if values is null
+    void WriteBrick(unsigned int brick, const double *values);
+
+    /**
+     * Completes a file being written, or releases a mapped file. A file whose writing failed, or that is destroyed
+     * before being closed, is removed
+     */
+    void Close();
+
+    const SizeType &GetImageSize() const {return m_ImageSize;}
+    const SizeType &GetBrickSize() const {return m_BrickSize;}
+    const double *GetOrigin() const {return m_Origin;}
+    const double *GetSpacing() const {return m_Spacing;}
+    const double *GetDirection() const {return m_Direction;}
+
+    //! Size in bytes of the stored values (4 for floats, 8 for doubles)
+    unsigned int GetComponentSize() const {return m_ComponentSize;}
+
+    const std::vector <CompartmentDescription> &GetCompartments() const {return m_Compartments;}
+
+    //! Bricks are numbered x fastest over the brick grid
+    unsigned int GetNumberOfBricks() const {return m_BrickGridSize[0] * m_BrickGridSize[1] * m_BrickGridSize[2];}
+    const SizeType &GetBrickGridSize() const {return m_BrickGridSize;}
+
+    //! Image region covered by a brick, clipped to the image
+    void GetBrickRegion(unsigned int brick, IndexType &index, SizeType &size) const;
+
+    bool IsBrickEmpty(unsigned int brick) const {return m_BrickOffsets[brick] == 0;}
+
+    //! Number of values per voxel in a block (0: weights, c + 1: compartment c)
+    unsigned int GetBlockWidth(unsigned int block) const;
+
+    //! Decodes a block of a brick into values (brick voxels x block width), zeroes for an empty brick
+    void ReadBrickBlock(unsigned int brick, unsigned int block, double *values) const;
+
+private:
+    void InitializeBrickGrid();
+    size_t GetNumberOfBrickVoxels(unsigned int brick) const;
+    size_t GetHeaderSize() const;
+
+    //! Closes and removes an incomplete output file
+    void DiscardOutputFile();
+
+    SizeType m_ImageSize;
+    SizeType m_BrickSize;
+    SizeType m_BrickGridSize;
+    double m_Origin[3];
+    double m_Spacing[3];
+    double m_Direction[9];
+    unsigned int m_ComponentSize;
+    std::vector <CompartmentDescription> m_Compartments;
+
+    std::vector <uint64_t> m_BrickOffsets;
+
+    // Mapped file (reading)
+    char *m_MappedData;
+    size_t m_MappedSize;
+    std::vector <char> m_ReadBuffer;
+    const char *m_FileData;
+
+    // Output file (writing)
+    std::ofstream m_OutputFile;
+    std::string m_OutputFileName;
+    std::vector <char> m_WriteBuffer;
+};
+
+} // end namespace anima
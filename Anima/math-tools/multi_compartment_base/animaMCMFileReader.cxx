@@ -1,4 +1,5 @@
 #include <animaMCMFileReader.h>
+#include <animaMCMBrickFile.h>
 #include <tinyxml2.h>
 #include <itkObjectFactoryBase.h>
 
@@ -7,6 +8,25 @@ namespace anima
 
 itk::IOComponentEnum GetMCMComponentType(std::string fileName)
 {
+    if (anima::MCMBrickFile::IsBrickFile(fileName))
+    {
+        anima::MCMBrickFile brickFile;
+
+        try
+        {
+            brickFile.Open(fileName);
+        }
+        catch(itk::ExceptionObject &e)
+        {
+            return itk::IOComponentEnum::UNKNOWNCOMPONENTTYPE;
+        }
+
+        if (brickFile.GetComponentSize() == sizeof(float))
+            return itk::IOComponentEnum::FLOAT;
+
+        return itk::IOComponentEnum::DOUBLE;
+    }
+
     tinyxml2::XMLDocument doc;
     tinyxml2::XMLError loadOk = doc.LoadFile(fileName.c_str());
 
@@ -5,6 +5,7 @@
 #include <itkImageIOBase.h>
 
 #include <string>
+#include <vector>
 #include <animaBaseCompartment.h>
 
 #include <AnimaMCMBaseExport.h>
@@ -25,6 +26,7 @@ public:
     typedef typename OutputImageType::Pointer OutputImagePointer;
     typedef itk::VectorImage <PixelType, ImageDimension> BaseInputImageType;
     typedef typename BaseInputImageType::Pointer BaseInputImagePointer;
+    typedef typename OutputImageType::RegionType RegionType;
 
     MCMFileReader();
     ~MCMFileReader();
@@ -32,12 +34,35 @@ public:
     OutputImagePointer &GetModelVectorImage() {return m_OutputImage;}
     void SetFileName(std::string fileName) {m_FileName = fileName;}
 
+    //! Only reads this region of the image (whole image if empty), the output keeps the image geometry
+    void SetRequestedRegion(const RegionType &region) {m_RequestedRegion = region;}
+
+    /**
+     * Only reads these compartments (all if empty), in this order. Their weights are kept as stored, i.e. they are
+     * not normalized to sum to one
+     */
+    void SetCompartmentIndexes(const std::vector <unsigned int> &indexes) {m_CompartmentIndexes = indexes;}
+
+    //! Reads either an XML MCM file or a brick MCM file (see anima::MCMBrickFile)
     void Update();
     virtual anima::BaseCompartment::Pointer CreateCompartmentForType(std::string &compartmentType);
 
+protected:
+    void ReadXMLFile();
+    void ReadBrickFile();
+
+    //! Indexes of the compartments to read among the stored ones
+    std::vector <unsigned int> GetReadCompartmentIndexes(unsigned int numStoredCompartments);
+
+    //! Region to read, checked against the largest possible region
+    RegionType GetReadRegion(const RegionType &largestRegion);
+
 private:
     OutputImagePointer m_OutputImage;
     std::string m_FileName;
+
+    RegionType m_RequestedRegion;
+    std::vector <unsigned int> m_CompartmentIndexes;
 };
 
 } // end namespace anima
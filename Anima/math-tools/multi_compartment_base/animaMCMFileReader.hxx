@@ -2,6 +2,7 @@
 #include "animaMCMFileReader.h"
 
 #include <animaReadWriteFunctions.h>
+#include <animaMCMBrickFile.h>
 
 #include <animaFreeWaterCompartment.h>
 #include <animaIsotropicRestrictedWaterCompartment.h>
@@ -13,6 +14,7 @@
 #include <animaNODDICompartment.h>
 
 #include <itkImageRegionIterator.h>
+#include <itkImageRegionIteratorWithIndex.h>
 #include <tinyxml2.h>
 
 namespace anima
@@ -35,6 +37,62 @@ template <class PixelType, unsigned int ImageDimension>
 void
 MCMFileReader <PixelType, ImageDimension>
 ::Update()
+{
+    if (anima::MCMBrickFile::IsBrickFile(m_FileName))
+        this->ReadBrickFile();
+    else
+        this->ReadXMLFile();
+}
+
+template <class PixelType, unsigned int ImageDimension>
+std::vector <unsigned int>
+MCMFileReader <PixelType, ImageDimension>
+::GetReadCompartmentIndexes(unsigned int numStoredCompartments)
+{
+    if (m_CompartmentIndexes.size() == 0)
+    {
+        std::vector <unsigned int> readIndexes(numStoredCompartments);
+        for (unsigned int i = 0;i < numStoredCompartments;++i)
+            readIndexes[i] = i;
+
+        return readIndexes;
+    }
+
+    for (unsigned int i = 0;i < m_CompartmentIndexes.size();++i)
+    {
+        if (m_CompartmentIndexes[i] >= numStoredCompartments)
+        {
+            std::string error("Compartment index out of range in ");
+            error += m_FileName;
+            throw itk::ExceptionObject(__FILE__, __LINE__,error,ITK_LOCATION);
+        }
+    }
+
+    return m_CompartmentIndexes;
+}
+
+template <class PixelType, unsigned int ImageDimension>
+typename MCMFileReader <PixelType, ImageDimension>::RegionType
+MCMFileReader <PixelType, ImageDimension>
+::GetReadRegion(const RegionType &largestRegion)
+{
+    if (m_RequestedRegion.GetNumberOfPixels() == 0)
+        return largestRegion;
+
+    if (!largestRegion.IsInside(m_RequestedRegion))
+    {
+        std::string error("Requested region outside of the image in ");
+        error += m_FileName;
+        throw itk::ExceptionObject(__FILE__, __LINE__,error,ITK_LOCATION);
+    }
+
+    return m_RequestedRegion;
+}
+
+template <class PixelType, unsigned int ImageDimension>
+void
+MCMFileReader <PixelType, ImageDimension>
+::ReadXMLFile()
 {
     tinyxml2::XMLDocument doc;
     tinyxml2::XMLError loadOk = doc.LoadFile(m_FileName.c_str());
@@ -86,14 +144,31 @@ MCMFileReader <PixelType, ImageDimension>
     weightsFileName += weightsNode->GetText();
     
     BaseInputImagePointer weightsImage = anima::readImage <BaseInputImageType>(weightsFileName);
-    unsigned int numCompartments = weightsImage->GetVectorLength();
-    
+    std::vector <unsigned int> readIndexes = this->GetReadCompartmentIndexes(weightsImage->GetVectorLength());
+    unsigned int numCompartments = readIndexes.size();
+
+    std::vector <tinyxml2::XMLElement *> compartmentNodes;
     tinyxml2::XMLElement *compartmentNode = modelNode->FirstChildElement( "Compartment" );
+    while (compartmentNode)
+    {
+        compartmentNodes.push_back(compartmentNode);
+        compartmentNode = compartmentNode->NextSiblingElement("Compartment");
+    }
+
     ModelPointer referenceModel = ModelType::New();
     
+    // Only the images of the read compartments are loaded
     std::vector <BaseInputImagePointer> compartmentImages;
-    while (compartmentNode)
+    for (unsigned int i = 0;i < numCompartments;++i)
     {
+        if (readIndexes[i] >= compartmentNodes.size())
+        {
+            std::string error("Missing compartment in ");
+            error += m_FileName;
+            throw itk::ExceptionObject(__FILE__, __LINE__,error,ITK_LOCATION);
+        }
+
+        compartmentNode = compartmentNodes[readIndexes[i]];
         tinyxml2::XMLElement *typeNode = compartmentNode->FirstChildElement("Type");
         std::string compartmentType = typeNode->GetText();
         
@@ -106,15 +181,15 @@ MCMFileReader <PixelType, ImageDimension>
         imageFileName += fileNameNode->GetText();
 
         compartmentImages.push_back(anima::readImage <BaseInputImageType> (imageFileName));
-
-        compartmentNode = compartmentNode->NextSiblingElement("Compartment");
     }
     
+    RegionType readRegion = this->GetReadRegion(weightsImage->GetLargestPossibleRegion());
+
     unsigned int vectorFinalSize = referenceModel->GetSize();
     m_OutputImage = OutputImageType::New();
     m_OutputImage->Initialize();
-    m_OutputImage->CopyInformation(compartmentImages[0]);
-    m_OutputImage->SetRegions(compartmentImages[0]->GetLargestPossibleRegion());
+    m_OutputImage->CopyInformation(weightsImage);
+    m_OutputImage->SetRegions(readRegion);
     m_OutputImage->SetNumberOfComponentsPerPixel(vectorFinalSize);
     m_OutputImage->Allocate();
     m_OutputImage->SetDescriptionModel(referenceModel);
@@ -124,10 +199,10 @@ MCMFileReader <PixelType, ImageDimension>
 
     std::vector <InputImageIteratorType> inputIterators(numCompartments);
     for (unsigned int i = 0;i < numCompartments;++i)
-        inputIterators[i] = InputImageIteratorType(compartmentImages[i],m_OutputImage->GetLargestPossibleRegion());
+        inputIterators[i] = InputImageIteratorType(compartmentImages[i],readRegion);
     
-    InputImageIteratorType weightsIterator(weightsImage,m_OutputImage->GetLargestPossibleRegion());
-    OutputImageIteratorType outItr(m_OutputImage,m_OutputImage->GetLargestPossibleRegion());
+    InputImageIteratorType weightsIterator(weightsImage,readRegion);
+    OutputImageIteratorType outItr(m_OutputImage,readRegion);
 
     typedef typename OutputImageType::PixelType ImagePixelType;
     ImagePixelType outValue(vectorFinalSize);
@@ -141,7 +216,7 @@ MCMFileReader <PixelType, ImageDimension>
     {
         weightsData = weightsIterator.Get();
         for (unsigned int i = 0;i < numCompartments;++i)
-            weightsVector[i] = weightsData[i];
+            weightsVector[i] = weightsData[readIndexes[i]];
 
         referenceModel->SetCompartmentWeights(weightsVector);
 
@@ -168,6 +243,142 @@ MCMFileReader <PixelType, ImageDimension>
     }
 }
 
+template <class PixelType, unsigned int ImageDimension>
+void
+MCMFileReader <PixelType, ImageDimension>
+::ReadBrickFile()
+{
+    if (ImageDimension != 3)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"MCM brick files only hold 3D images",ITK_LOCATION);
+
+    anima::MCMBrickFile brickFile;
+    brickFile.Open(m_FileName);
+
+    const std::vector <anima::MCMBrickFile::CompartmentDescription> &storedCompartments = brickFile.GetCompartments();
+    unsigned int numStoredCompartments = storedCompartments.size();
+    std::vector <unsigned int> readIndexes = this->GetReadCompartmentIndexes(numStoredCompartments);
+    unsigned int numCompartments = readIndexes.size();
+
+    ModelPointer referenceModel = ModelType::New();
+    for (unsigned int i = 0;i < numCompartments;++i)
+    {
+        std::string compartmentType = storedCompartments[readIndexes[i]].type;
+        anima::BaseCompartment::Pointer additionalCompartment = this->CreateCompartmentForType(compartmentType);
+
+        referenceModel->AddCompartment(1.0 / numCompartments,additionalCompartment);
+    }
+
+    RegionType largestRegion;
+    typename OutputImageType::PointType origin;
+    typename OutputImageType::SpacingType spacing;
+    typename OutputImageType::DirectionType direction;
+    for (unsigned int i = 0;i < ImageDimension;++i)
+    {
+        largestRegion.SetIndex(i,0);
+        largestRegion.SetSize(i,brickFile.GetImageSize()[i]);
+        origin[i] = brickFile.GetOrigin()[i];
+        spacing[i] = brickFile.GetSpacing()[i];
+
+        for (unsigned int j = 0;j < ImageDimension;++j)
+            direction(i,j) = brickFile.GetDirection()[i * ImageDimension + j];
+    }
+
+    RegionType readRegion = this->GetReadRegion(largestRegion);
+
+    unsigned int vectorFinalSize = referenceModel->GetSize();
+    m_OutputImage = OutputImageType::New();
+    m_OutputImage->Initialize();
+    m_OutputImage->SetRegions(readRegion);
+    m_OutputImage->SetOrigin(origin);
+    m_OutputImage->SetSpacing(spacing);
+    m_OutputImage->SetDirection(direction);
+    m_OutputImage->SetNumberOfComponentsPerPixel(vectorFinalSize);
+    m_OutputImage->Allocate();
+    m_OutputImage->SetDescriptionModel(referenceModel);
+
+    typedef itk::ImageRegionIteratorWithIndex <OutputImageType> OutputImageIteratorType;
+    typedef typename OutputImageType::PixelType ImagePixelType;
+    typedef typename OutputImageType::IndexType ImageIndexType;
+
+    // Voxels of empty bricks have null weights, hence a null model vector
+    ImagePixelType outValue(vectorFinalSize);
+    ImagePixelType emptyValue(vectorFinalSize);
+    emptyValue.Fill(0.0);
+
+    ModelType::ModelOutputVectorType inputMCMValue;
+    ModelType::ListType weightsVector(numCompartments);
+    std::vector <double> weightsBlock;
+    std::vector < std::vector <double> > compartmentBlocks(numCompartments);
+
+    for (unsigned int brick = 0;brick < brickFile.GetNumberOfBricks();++brick)
+    {
+        anima::MCMBrickFile::IndexType brickIndex;
+        anima::MCMBrickFile::SizeType brickSize;
+        brickFile.GetBrickRegion(brick,brickIndex,brickSize);
+
+        RegionType brickRegion;
+        for (unsigned int i = 0;i < ImageDimension;++i)
+        {
+            brickRegion.SetIndex(i,brickIndex[i]);
+            brickRegion.SetSize(i,brickSize[i]);
+        }
+
+        // Bricks outside of the read region are never decoded
+        if (!brickRegion.Crop(readRegion))
+            continue;
+
+        OutputImageIteratorType outItr(m_OutputImage,brickRegion);
+        if (brickFile.IsBrickEmpty(brick))
+        {
+            while (!outItr.IsAtEnd())
+            {
+                outItr.Set(emptyValue);
+                ++outItr;
+            }
+
+            continue;
+        }
+
+        size_t numBrickVoxels = brickSize[0] * brickSize[1] * brickSize[2];
+        weightsBlock.resize(numBrickVoxels * numStoredCompartments);
+        brickFile.ReadBrickBlock(brick,0,weightsBlock.data());
+
+        for (unsigned int i = 0;i < numCompartments;++i)
+        {
+            compartmentBlocks[i].resize(numBrickVoxels * brickFile.GetBlockWidth(readIndexes[i] + 1));
+            brickFile.ReadBrickBlock(brick,readIndexes[i] + 1,compartmentBlocks[i].data());
+        }
+
+        while (!outItr.IsAtEnd())
+        {
+            ImageIndexType index = outItr.GetIndex();
+            size_t brickVoxel = (index[0] - brickIndex[0]) + brickSize[0] * ((index[1] - brickIndex[1]) + brickSize[1] * (index[2] - brickIndex[2]));
+
+            for (unsigned int i = 0;i < numCompartments;++i)
+                weightsVector[i] = weightsBlock[brickVoxel * numStoredCompartments + readIndexes[i]];
+
+            referenceModel->SetCompartmentWeights(weightsVector);
+
+            for (unsigned int i = 0;i < numCompartments;++i)
+            {
+                unsigned int compartmentSize = brickFile.GetBlockWidth(readIndexes[i] + 1);
+                if (inputMCMValue.GetSize() != compartmentSize)
+                    inputMCMValue.SetSize(compartmentSize);
+
+                for (unsigned int j = 0;j < compartmentSize;++j)
+                    inputMCMValue[j] = compartmentBlocks[i][brickVoxel * compartmentSize + j];
+
+                referenceModel->GetCompartment(i)->SetCompartmentVector(inputMCMValue);
+            }
+
+            outValue = referenceModel->GetModelVector();
+            outItr.Set(outValue);
+
+            ++outItr;
+        }
+    }
+}
+
 template <class PixelType, unsigned int ImageDimension>
 anima::BaseCompartment::Pointer
 MCMFileReader <PixelType, ImageDimension>
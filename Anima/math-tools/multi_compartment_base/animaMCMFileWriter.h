@@ -22,13 +22,28 @@ public:
     ~MCMFileWriter();
 
     void SetInputImage(InputImageType *input) {m_InputImage = input;}
+
+    //! A .mcmb extension selects the brick format (see anima::MCMBrickFile), the XML format is used otherwise
     void SetFileName(std::string fileName);
 
+    //! Size (in voxels, along each axis) of the bricks of the brick format
+    void SetBrickSize(unsigned int val) {m_BrickSize = val;}
+
     void Update();
 
+    //! Type name of a compartment in MCM files
+    static std::string GetCompartmentTypeName(anima::BaseCompartment *compartment);
+
+protected:
+    void WriteXMLFile();
+    void WriteBrickFile();
+
 private:
     InputImagePointer m_InputImage;
     std::string m_FileName;
+
+    bool m_BrickFormat;
+    unsigned int m_BrickSize;
 };
 
 } // end namespace anima
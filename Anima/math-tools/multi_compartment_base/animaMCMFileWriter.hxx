@@ -2,8 +2,10 @@
 #include "animaMCMFileWriter.h"
 
 #include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIterator.h>
 #include <itkFileTools.h>
 #include <animaReadWriteFunctions.h>
+#include <animaMCMBrickFile.h>
 
 namespace anima
 {
@@ -13,6 +15,8 @@ MCMFileWriter <PixelType, ImageDimension>
 ::MCMFileWriter()
 {
     m_FileName = "";
+    m_BrickFormat = false;
+    m_BrickSize = 32;
 }
 
 template <class PixelType, unsigned int ImageDimension>
@@ -28,13 +32,56 @@ MCMFileWriter <PixelType, ImageDimension>
 {
     m_FileName = fileName;
     std::replace(m_FileName.begin(),m_FileName.end(), '\\', '/');
+    m_BrickFormat = false;
 
     if (m_FileName.find(".") != std::string::npos)
     {
         std::size_t lastPointPos = m_FileName.find_last_of(".");
         std::size_t lastSlashPos = m_FileName.find_last_of("/");
         if (lastSlashPos == std::string::npos || lastPointPos > lastSlashPos)
-            m_FileName.erase(lastPointPos);
+        {
+            if (m_FileName.substr(lastPointPos) == ".mcmb")
+                m_BrickFormat = true;
+            else
+                m_FileName.erase(lastPointPos);
+        }
+    }
+}
+
+template <class PixelType, unsigned int ImageDimension>
+std::string
+MCMFileWriter <PixelType, ImageDimension>
+::GetCompartmentTypeName(anima::BaseCompartment *compartment)
+{
+    switch(compartment->GetCompartmentType())
+    {
+        case Stick:
+            return "Stick";
+
+        case Zeppelin:
+            return "Zeppelin";
+
+        case Tensor:
+            return "Tensor";
+
+        case NODDI:
+            return "NODDI";
+
+        case DDI:
+            return "DDI";
+
+        case FreeWater:
+            return "FreeWater";
+
+        case StationaryWater:
+            return "StationaryWater";
+
+        case Stanisz:
+            return "Stanisz";
+
+        case IsotropicRestrictedWater:
+        default:
+            return "IRWater";
     }
 }
 
@@ -52,6 +99,17 @@ MCMFileWriter <PixelType, ImageDimension>
     if (!m_InputImage->GetDescriptionModel())
         throw itk::ExceptionObject(__FILE__, __LINE__,"No reference model provided for writing MCM file",ITK_LOCATION);
 
+    if (m_BrickFormat)
+        this->WriteBrickFile();
+    else
+        this->WriteXMLFile();
+}
+
+template <class PixelType, unsigned int ImageDimension>
+void
+MCMFileWriter <PixelType, ImageDimension>
+::WriteXMLFile()
+{
     std::string noPathName = m_FileName;
     std::size_t lastSlashPos = m_FileName.find_last_of("/");
 
@@ -117,45 +175,7 @@ MCMFileWriter <PixelType, ImageDimension>
     for (unsigned int i = 0;i < descriptionModel->GetNumberOfCompartments();++i)
     {
         outputHeaderFile << "<Compartment>" << std::endl;
-        switch(descriptionModel->GetCompartment(i)->GetCompartmentType())
-        {
-            case Stick:
-                outputHeaderFile << "<Type>Stick</Type>" << std::endl;
-                break;
-
-            case Zeppelin:
-                outputHeaderFile << "<Type>Zeppelin</Type>" << std::endl;
-                break;
-
-            case Tensor:
-                outputHeaderFile << "<Type>Tensor</Type>" << std::endl;
-                break;
-                
-            case NODDI:
-                outputHeaderFile << "<Type>NODDI</Type>" << std::endl;
-                break;
-
-            case DDI:
-                outputHeaderFile << "<Type>DDI</Type>" << std::endl;
-                break;
-
-            case FreeWater:
-                outputHeaderFile << "<Type>FreeWater</Type>" << std::endl;
-                break;
-
-            case StationaryWater:
-                outputHeaderFile << "<Type>StationaryWater</Type>" << std::endl;
-                break;
-
-            case Stanisz:
-                outputHeaderFile << "<Type>Stanisz</Type>" << std::endl;
-                break;
-
-            case IsotropicRestrictedWater:
-            default:
-                outputHeaderFile << "<Type>IRWater</Type>" << std::endl;
-                break;
-        }
+        outputHeaderFile << "<Type>" << GetCompartmentTypeName(descriptionModel->GetCompartment(i)) << "</Type>" << std::endl;
 
         // Output compartment image
         unsigned int compartmentSize = descriptionModel->GetCompartment(i)->GetCompartmentSize();
@@ -210,4 +230,108 @@ MCMFileWriter <PixelType, ImageDimension>
     outputHeaderFile.close();
 }
 
+template <class PixelType, unsigned int ImageDimension>
+void
+MCMFileWriter <PixelType, ImageDimension>
+::WriteBrickFile()
+{
+    if (ImageDimension != 3)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"MCM brick files only hold 3D images",ITK_LOCATION);
+
+    if (m_BrickSize == 0)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Null brick size for writing MCM brick file",ITK_LOCATION);
+
+    ModelPointer descriptionModel = m_InputImage->GetDescriptionModel();
+    unsigned int numberOfCompartments = descriptionModel->GetNumberOfCompartments();
+
+    std::vector <anima::MCMBrickFile::CompartmentDescription> compartments(numberOfCompartments);
+    unsigned int voxelWidth = numberOfCompartments;
+    for (unsigned int i = 0;i < numberOfCompartments;++i)
+    {
+        compartments[i].type = GetCompartmentTypeName(descriptionModel->GetCompartment(i));
+        compartments[i].size = descriptionModel->GetCompartment(i)->GetCompartmentSize();
+        voxelWidth += compartments[i].size;
+    }
+
+    // Brick files index images from 0, the origin is moved to the first voxel of the region
+    typedef typename InputImageType::RegionType RegionType;
+    RegionType largestRegion = m_InputImage->GetLargestPossibleRegion();
+    typename InputImageType::PointType regionOrigin;
+    m_InputImage->TransformIndexToPhysicalPoint(largestRegion.GetIndex(),regionOrigin);
+
+    anima::MCMBrickFile::SizeType imageSize, brickSize;
+    double origin[3], spacing[3], direction[9];
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        imageSize[i] = largestRegion.GetSize(i);
+        brickSize[i] = m_BrickSize;
+        origin[i] = regionOrigin[i];
+        spacing[i] = m_InputImage->GetSpacing()[i];
+
+        for (unsigned int j = 0;j < 3;++j)
+            direction[i * 3 + j] = m_InputImage->GetDirection()(i,j);
+    }
+
+    unsigned int componentSize = (sizeof(PixelType) == sizeof(float)) ? sizeof(float) : sizeof(double);
+
+    anima::MCMBrickFile brickFile;
+    brickFile.Create(m_FileName,imageSize,brickSize,origin,spacing,direction,compartments,componentSize);
+
+    typedef itk::ImageRegionConstIterator <InputImageType> InputImageIteratorType;
+    typedef typename InputImageType::PixelType VectorType;
+
+    std::vector <double> brickValues;
+    VectorType workVector;
+    for (unsigned int brick = 0;brick < brickFile.GetNumberOfBricks();++brick)
+    {
+        anima::MCMBrickFile::IndexType brickIndex;
+        anima::MCMBrickFile::SizeType brickRegionSize;
+        brickFile.GetBrickRegion(brick,brickIndex,brickRegionSize);
+
+        RegionType brickRegion;
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            brickRegion.SetIndex(i,largestRegion.GetIndex(i) + brickIndex[i]);
+            brickRegion.SetSize(i,brickRegionSize[i]);
+        }
+
+        size_t numBrickVoxels = brickRegion.GetNumberOfPixels();
+        brickValues.resize(numBrickVoxels * voxelWidth);
+
+        // Weights block, then one block per compartment, voxels in the iterator order (x fastest)
+        bool emptyBrick = true;
+        InputImageIteratorType inputItr(m_InputImage,brickRegion);
+        for (size_t v = 0;v < numBrickVoxels;++v)
+        {
+            workVector = inputItr.Get();
+
+            for (unsigned int i = 0;i < numberOfCompartments;++i)
+            {
+                brickValues[v * numberOfCompartments + i] = workVector[i];
+                if (workVector[i] != 0)
+                    emptyBrick = false;
+            }
+
+            size_t blockStart = numBrickVoxels * numberOfCompartments;
+            unsigned int pos = numberOfCompartments;
+            for (unsigned int i = 0;i < numberOfCompartments;++i)
+            {
+                unsigned int compartmentSize = compartments[i].size;
+                for (unsigned int j = 0;j < compartmentSize;++j)
+                    brickValues[blockStart + v * compartmentSize + j] = workVector[pos + j];
+
+                blockStart += numBrickVoxels * compartmentSize;
+                pos += compartmentSize;
+            }
+
+            ++inputItr;
+        }
+
+        // Bricks with null weights everywhere are read back as null model vectors, they are not stored
+        brickFile.WriteBrick(brick,emptyBrick ? ITK_NULLPTR : brickValues.data());
+    }
+
+    brickFile.Close();
+}
+
 } // end namespace anima
@@ -146,21 +146,43 @@ void MCMWeightedAverager::Update()
     }
 
     bool tensorCompatibility = m_WorkCompartmentsVector[0]->GetTensorCompatible();
-    if (tensorCompatibility)
-        this->ComputeTensorDistanceMatrix();
+    bool useInputClasses = tensorCompatibility && (m_InputCompartmentClasses.size() == numInputCompartments);
+    for (unsigned int i = 0;(i < m_InputCompartmentClasses.size())&&useInputClasses;++i)
+    {
+        if (m_InputCompartmentClasses[i] >= numOutputCompartments)
+            useInputClasses = false;
+    }
+
+    m_InternalSpectralMemberships.resize(numInputCompartments);
+    if (useInputClasses)
+    {
+        // Compartments already matched: hard memberships, no distance matrix nor clustering
+        this->ComputeLogTensors();
+
+        for (unsigned int i = 0;i < numInputCompartments;++i)
+        {
+            m_InternalSpectralMemberships[i].resize(numOutputCompartments);
+            std::fill(m_InternalSpectralMemberships[i].begin(),m_InternalSpectralMemberships[i].end(),0.0);
+            m_InternalSpectralMemberships[i][m_InputCompartmentClasses[i]] = 1.0;
+        }
+    }
     else
-        this->ComputeNonTensorDistanceMatrix();
+    {
+        if (tensorCompatibility)
+            this->ComputeTensorDistanceMatrix();
+        else
+            this->ComputeNonTensorDistanceMatrix();
 
-    m_InternalSpectralCluster.SetNbClass(numOutputCompartments);
-    m_InternalSpectralCluster.SetInputData(m_InternalDistanceMatrix);
-    m_InternalSpectralCluster.SetDataWeights(m_WorkCompartmentWeights);
-    m_InternalSpectralCluster.InitializeSigmaFromDistances();
+        m_InternalSpectralCluster.SetNbClass(numOutputCompartments);
+        m_InternalSpectralCluster.SetInputData(m_InternalDistanceMatrix);
+        m_InternalSpectralCluster.SetDataWeights(m_WorkCompartmentWeights);
+        m_InternalSpectralCluster.InitializeSigmaFromDistances();
 
-    m_InternalSpectralCluster.Update();
+        m_InternalSpectralCluster.Update();
 
-    m_InternalSpectralMemberships.resize(numInputCompartments);
-    for (unsigned int i = 0;i < numInputCompartments;++i)
-        m_InternalSpectralMemberships[i] = m_InternalSpectralCluster.GetClassesMembership(i);
+        for (unsigned int i = 0;i < numInputCompartments;++i)
+            m_InternalSpectralMemberships[i] = m_InternalSpectralCluster.GetClassesMembership(i);
+    }
 
     if (tensorCompatibility)
         this->ComputeOutputTensorCompatibleModel();
@@ -172,7 +194,7 @@ void MCMWeightedAverager::Update()
     m_UpToDate = true;
 }
 
-void MCMWeightedAverager::ComputeTensorDistanceMatrix()
+void MCMWeightedAverager::ComputeLogTensors()
 {
     unsigned int numCompartments = m_WorkCompartmentsVector.size();
     m_InternalLogTensors.resize(numCompartments);
@@ -183,6 +205,12 @@ void MCMWeightedAverager::ComputeTensorDistanceMatrix()
         m_leCalculator->GetTensorLogarithm(m_InternalWorkMatrix,m_InternalWorkMatrix);
         anima::GetVectorRepresentation(m_InternalWorkMatrix,m_InternalLogTensors[i],6,true);
     }
+}
+
+void MCMWeightedAverager::ComputeTensorDistanceMatrix()
+{
+    this->ComputeLogTensors();
+    unsigned int numCompartments = m_WorkCompartmentsVector.size();
 
     m_InternalDistanceMatrix.set_size(numCompartments,numCompartments);
     m_InternalDistanceMatrix.fill(0);
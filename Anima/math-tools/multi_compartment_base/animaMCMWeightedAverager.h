@@ -45,6 +45,13 @@ public:
     void SetInputModels(std::vector <MCMPointer> &models) {m_InputModels = models; m_UpToDate = false;}
     void SetInputWeights(std::vector <double> &weights) {m_InputWeights = weights; m_UpToDate = false;}
 
+    /**
+     * Output compartment of each directional input compartment with a non null weight (in input then compartment order),
+     * when they are already matched across inputs. If set (and tensor compatible), replaces the spectral clustering.
+     * Empty to cluster compartments
+     */
+    void SetInputCompartmentClasses(const std::vector <unsigned int> &classes) {m_InputCompartmentClasses = classes; m_UpToDate = false;}
+
     void SetNumberOfOutputDirectionalCompartments(unsigned int val);
     void ResetNumberOfOutputDirectionalCompartments();
 
@@ -62,6 +69,7 @@ protected:
     MCMWeightedAverager();
     ~MCMWeightedAverager() {}
 
+    void ComputeLogTensors();
     void ComputeTensorDistanceMatrix();
     virtual void ComputeNonTensorDistanceMatrix();
 
@@ -71,6 +79,7 @@ protected:
 private:
     std::vector <MCMPointer> m_InputModels;
     std::vector <double> m_InputWeights;
+    std::vector <unsigned int> m_InputCompartmentClasses;
 
     unsigned int m_NumberOfOutputDirectionalCompartments;
 
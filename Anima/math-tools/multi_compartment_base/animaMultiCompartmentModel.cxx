@@ -242,6 +242,24 @@ double MultiCompartmentModel::GetPredictedSignal(double smallDelta, double bigDe
     return ftDiffusionProfile;
 }
     
+void MultiCompartmentModel::GetPredictedSignals(const GradientTableType &gradientTable, ListType &signals)
+{
+    unsigned int numGradients = gradientTable.GetNumberOfGradients();
+    signals.resize(numGradients);
+    std::fill(signals.begin(),signals.end(),0.0);
+    m_WorkAttenuations.resize(numGradients);
+
+    for (unsigned int i = 0;i < m_Compartments.size();++i)
+    {
+        if (m_CompartmentWeights[i] == 0.0)
+            continue;
+
+        m_Compartments[i]->GetFourierTransformedDiffusionProfiles(gradientTable, m_WorkAttenuations.data());
+        for (unsigned int j = 0;j < numGradients;++j)
+            signals[j] += m_CompartmentWeights[i] * m_WorkAttenuations[j];
+    }
+}
+
 MultiCompartmentModel::ListType &MultiCompartmentModel::GetSignalJacobian(double smallDelta, double bigDelta, double gradientStrength, const Vector3DType &gradient)
 {
     unsigned int jacobianSize = 0;
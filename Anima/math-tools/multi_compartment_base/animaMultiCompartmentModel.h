@@ -34,6 +34,7 @@ public:
     typedef BaseCompartment::Vector3DType Vector3DType;
     typedef BaseCompartment::ListType ListType;
     typedef BaseCompartment::ModelOutputVectorType ModelOutputVectorType;
+    typedef BaseCompartment::GradientTableType GradientTableType;
 
     /**
      * Returns a clone of this MCM in terms of compartment organization, used by Clone method
@@ -62,6 +63,9 @@ public:
 
     double GetPredictedSignal(double smallDelta, double bigDelta, double gradientStrength, const Vector3DType &gradient);
     ListType &GetSignalJacobian(double smallDelta, double bigDelta, double gradientStrength, const Vector3DType &gradient);
+
+    //! Batched version of GetPredictedSignal for a whole gradient table, signals is resized to the number of gradients
+    void GetPredictedSignals(const GradientTableType &gradientTable, ListType &signals);
     double GetDiffusionProfile(Vector3DType &sample);
 
     ListType &GetParameterLowerBounds();
@@ -121,6 +125,9 @@ private:
     //! Vector holding working value vector
     ListType m_WorkVector;
 
+    //! Working compartment attenuations for batched signal predictions
+    ListType m_WorkAttenuations;
+
     //! Vector holding current parameters lower bounds
     ListType m_ParametersLowerBoundsVector;
 
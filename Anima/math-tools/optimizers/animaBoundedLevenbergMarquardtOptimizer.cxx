@@ -9,6 +9,7 @@ namespace anima
 void BoundedLevenbergMarquardtOptimizer::StartOptimization()
 {
     m_CurrentPosition = this->GetInitialPosition();
+    m_CurrentIteration = 0;
     ParametersType parameters(m_CurrentPosition);
 
     unsigned int nbParams = parameters.size();
@@ -240,6 +241,7 @@ void BoundedLevenbergMarquardtOptimizer::StartOptimization()
         }
     }
 
+    m_CurrentIteration = numIterations;
     this->SetCurrentPosition(oldParameters);
 }
 
@@ -46,6 +46,9 @@ public:
 
     itkGetMacro(CurrentValue, double)
 
+    //! Number of iterations performed by the last optimization
+    itkGetConstMacro(CurrentIteration, unsigned int)
+
     itkSetMacro(LowerBounds, ParametersType)
     itkSetMacro(UpperBounds, ParametersType)
 
@@ -59,6 +62,7 @@ protected:
         m_DeltaParameter = 0.0;
 
         m_CurrentValue = 0.0;
+        m_CurrentIteration = 0;
         m_LambdaCostFunction = anima::BLMLambdaCostFunction::New();
     }
 
@@ -86,6 +90,7 @@ private:
     double m_LambdaParameter;
     double m_DeltaParameter;
     double m_CurrentValue;
+    unsigned int m_CurrentIteration;
 
     anima::BLMLambdaCostFunction::Pointer m_LambdaCostFunction;
     ParametersType m_LowerBounds, m_UpperBounds;
@@ -61,6 +61,7 @@ namespace anima
         m_PopulationSize = -1;
         m_VectorStorageSize = -1;
         m_CurrentCost = 0;
+        m_NumberOfEvaluations = 0;
     }
 
     /**********************************************************************************************//**
@@ -95,6 +96,7 @@ namespace anima
     double NLOPTOptimizers::NloptFunctionWrapper(unsigned n, const double *x, double *grad, void *data)
     {
         NLOPTOptimizers *optimizer = static_cast<NLOPTOptimizers *>(data);
+        ++optimizer->m_NumberOfEvaluations;
 
         //-----------------------------------------
         // Copy the nlopt position to a itk position
@@ -104,19 +106,19 @@ namespace anima
         for ( unsigned int i=0; i<n ; i++ )
             itkCurrentPosition[i] = x[i]/optimizer->GetScales()[i];
 
-        double f = (optimizer->GetCostFunction()->GetValue(itkCurrentPosition));
-
         //-----------------------------------------
-        // If needed, also compute the derivative and copy
-        // back in *grad
+        // If needed, also compute the derivative (in a single
+        // cost function call) and copy it back in *grad,
+        // expressed with respect to the scaled nlopt position
         //-----------------------------------------
-        if ( grad!=NULL )
-        {
-            DerivativeType derivative;
-            optimizer->GetCostFunction()->GetDerivative (itkCurrentPosition, derivative);
-            for ( unsigned int i=0; i<n ; i++ )
-                grad[i] = derivative[i];
-        }
+        if ( grad==NULL )
+            return optimizer->GetCostFunction()->GetValue(itkCurrentPosition);
+
+        double f;
+        DerivativeType derivative;
+        optimizer->GetCostFunction()->GetValueAndDerivative(itkCurrentPosition, f, derivative);
+        for ( unsigned int i=0; i<n ; i++ )
+            grad[i] = derivative[i] / optimizer->GetScales()[i];
 
         return f;
     }
@@ -231,6 +233,7 @@ namespace anima
         //--------------------------------------
         nlopt_set_local_optimizer(m_NloptOptions, m_NloptLocalOptions);
 
+        m_NumberOfEvaluations = 0;
         this->InvokeEvent( itk::StartEvent() );
 
         //----------------------------------------
@@ -132,6 +132,9 @@ namespace anima
         /** Returns the current value */
         MeasureType GetValue() const {return this->GetCurrentCost();}
 
+        /** Returns the number of cost function evaluations of the last optimization */
+        itkGetConstMacro(NumberOfEvaluations, unsigned int)
+
         void SetLowerBoundParameters( const ParametersType& p );
         itkGetConstReferenceMacro(LowerBoundParameters, ParametersType)
 
@@ -343,6 +346,8 @@ namespace anima
         /** Internal storage for the value type / used as a cache  */
         MeasureType			m_CurrentCost;
 
+        unsigned int        m_NumberOfEvaluations;
+
         std::vector<ConstraintsFunctionType::Pointer> m_InequalityConstraints;
         std::vector<ConstraintsFunctionType::Pointer> m_EqualityConstraints;
 
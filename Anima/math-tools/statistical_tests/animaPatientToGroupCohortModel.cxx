@@ -0,0 +1,452 @@
+#include "animaPatientToGroupCohortModel.h"
+
+#include <itkMacro.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace anima
+{
+
+namespace
+{
+
+const char CohortModelMagic[8] = {'A','N','I','M','A','P','T','G'};
+const uint32_t CohortModelVersion = 2;
+
+// Magic, version, model dimension, image size, number of records, origin, spacing, direction, explained ratio,
+// number of PCA eigen values, statistical test, number of sample directions, padding. Sample directions follow
+// as (theta, phi) pairs
+const size_t CohortModelHeaderSize = 8 + 6 * sizeof(uint32_t) + 16 * sizeof(double) + 4 * sizeof(uint32_t);
+
+size_t GetRecordIndexesSize(unsigned int numVoxels)
+{
+    // Padded so that offsets and records stay aligned on 8 bytes
+    size_t size = numVoxels * sizeof(int32_t);
+    return (size + 7) & ~(size_t)7;
+}
+
+size_t GetRecordLength(unsigned int modelDimension, unsigned int reducedDimension)
+{
+    return 2 + modelDimension + reducedDimension * modelDimension + reducedDimension + reducedDimension * reducedDimension;
+}
+
+}
+
+PatientToGroupCohortModel::PatientToGroupCohortModel()
+{
+    m_ModelDimension = 0;
+    m_NumberOfVoxels = 0;
+    m_ImageSize.Fill(0);
+
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        m_Origin[i] = 0;
+        m_Spacing[i] = 1;
+    }
+
+    for (unsigned int i = 0;i < 9;++i)
+        m_Direction[i] = (i % 4 == 0) ? 1 : 0;
+
+    m_ExplainedRatio = 0;
+    m_NumEigenValuesPCA = 0;
+    m_StatisticalTestType = 0;
+
+    m_MappedData = ITK_NULLPTR;
+    m_MappedSize = 0;
+    m_RecordIndexes = ITK_NULLPTR;
+    m_RecordOffsets = ITK_NULLPTR;
+    m_RecordData = ITK_NULLPTR;
+}
+
+PatientToGroupCohortModel::~PatientToGroupCohortModel()
+{
+    this->ReleaseMapping();
+}
+
+void PatientToGroupCohortModel::ReleaseMapping()
+{
+#ifndef _WIN32
+    if (m_MappedData)
+        munmap(m_MappedData,m_MappedSize);
+#endif
+
+    m_MappedData = ITK_NULLPTR;
+    m_MappedSize = 0;
+    m_ReadBuffer.clear();
+    m_RecordIndexes = ITK_NULLPTR;
+    m_RecordOffsets = ITK_NULLPTR;
+    m_RecordData = ITK_NULLPTR;
+}
+
+void PatientToGroupCohortModel::Initialize(const GeometryType *geometry, unsigned int modelDimension,
+                                           const std::vector <unsigned int> &modelVoxels)
+{
+    this->ReleaseMapping();
+
+    m_ModelDimension = modelDimension;
+    m_ImageSize = geometry->GetLargestPossibleRegion().GetSize();
+    m_NumberOfVoxels = m_ImageSize[0] * m_ImageSize[1] * m_ImageSize[2];
+
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        m_Origin[i] = geometry->GetOrigin()[i];
+        m_Spacing[i] = geometry->GetSpacing()[i];
+        for (unsigned int j = 0;j < 3;++j)
+            m_Direction[i * 3 + j] = geometry->GetDirection()(i,j);
+    }
+
+    m_BuildRecordIndexes.assign(m_NumberOfVoxels,-1);
+    for (unsigned int i = 0;i < modelVoxels.size();++i)
+    {
+        if (modelVoxels[i] >= m_NumberOfVoxels)
+            throw itk::ExceptionObject(__FILE__,__LINE__,"Cohort model voxel outside of the model geometry",ITK_LOCATION);
+
+        m_BuildRecordIndexes[modelVoxels[i]] = i;
+    }
+
+    m_BuildRecords.clear();
+    m_BuildRecords.resize(modelVoxels.size());
+}
+
+void PatientToGroupCohortModel::SetVoxelModel(unsigned int voxelIndex, unsigned int numberOfSamples, unsigned int reducedDimension,
+                                              const double *mean, const double *basis, const double *reducedMean,
+                                              const double *inverseCovariance)
+{
+    if ((voxelIndex >= m_BuildRecordIndexes.size())||(m_BuildRecordIndexes[voxelIndex] < 0))
+        return;
+
+    std::vector <double> &record = m_BuildRecords[m_BuildRecordIndexes[voxelIndex]];
+    record.resize(GetRecordLength(m_ModelDimension,reducedDimension));
+
+    unsigned int pos = 0;
+    record[pos++] = numberOfSamples;
+    record[pos++] = reducedDimension;
+
+    std::copy(mean,mean + m_ModelDimension,record.begin() + pos);
+    pos += m_ModelDimension;
+    std::copy(basis,basis + reducedDimension * m_ModelDimension,record.begin() + pos);
+    pos += reducedDimension * m_ModelDimension;
+    std::copy(reducedMean,reducedMean + reducedDimension,record.begin() + pos);
+    pos += reducedDimension;
+    std::copy(inverseCovariance,inverseCovariance + reducedDimension * reducedDimension,record.begin() + pos);
+}
+
+void PatientToGroupCohortModel::SetBuildParameters(double explainedRatio, unsigned int numEigenValuesPCA, unsigned int statisticalTestType,
+                                                   const std::vector < std::vector <double> > &sampleDirections)
+{
+    for (unsigned int i = 0;i < sampleDirections.size();++i)
+    {
+        if (sampleDirections[i].size() != 2)
+            throw itk::ExceptionObject(__FILE__,__LINE__,"Cohort model sample directions must be given as spherical coordinates",ITK_LOCATION);
+    }
+
+    m_ExplainedRatio = explainedRatio;
+    m_NumEigenValuesPCA = numEigenValuesPCA;
+    m_StatisticalTestType = statisticalTestType;
+    m_SampleDirections = sampleDirections;
+}
+
+void PatientToGroupCohortModel::Write(const std::string &fileName)
+{
+    if (m_BuildRecordIndexes.size() != m_NumberOfVoxels)
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Only in-memory cohort models can be written",ITK_LOCATION);
+
+    // Compact records: voxels whose model was never set have no record
+    std::vector <int32_t> recordIndexes(m_NumberOfVoxels,-1);
+    std::vector <uint64_t> recordOffsets;
+    uint64_t currentOffset = 0;
+    for (unsigned int i = 0;i < m_NumberOfVoxels;++i)
+    {
+        int32_t buildIndex = m_BuildRecordIndexes[i];
+        if ((buildIndex < 0)||(m_BuildRecords[buildIndex].size() == 0))
+            continue;
+
+        recordIndexes[i] = recordOffsets.size();
+        recordOffsets.push_back(currentOffset);
+        currentOffset += m_BuildRecords[buildIndex].size();
+    }
+
+    std::ofstream outFile(fileName.c_str(),std::ios::binary);
+    if (!outFile.is_open())
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Could not open cohort model file for writing: " + fileName,ITK_LOCATION);
+
+    uint32_t headerValues[6];
+    headerValues[0] = CohortModelVersion;
+    headerValues[1] = m_ModelDimension;
+    for (unsigned int i = 0;i < 3;++i)
+        headerValues[2 + i] = m_ImageSize[i];
+    headerValues[5] = recordOffsets.size();
+
+    outFile.write(CohortModelMagic,8);
+    outFile.write((const char *)headerValues,6 * sizeof(uint32_t));
+    outFile.write((const char *)m_Origin,3 * sizeof(double));
+    outFile.write((const char *)m_Spacing,3 * sizeof(double));
+    outFile.write((const char *)m_Direction,9 * sizeof(double));
+
+    uint32_t parameterValues[4];
+    parameterValues[0] = m_NumEigenValuesPCA;
+    parameterValues[1] = m_StatisticalTestType;
+    parameterValues[2] = m_SampleDirections.size();
+    parameterValues[3] = 0;
+
+    outFile.write((const char *)&m_ExplainedRatio,sizeof(double));
+    outFile.write((const char *)parameterValues,4 * sizeof(uint32_t));
+    for (unsigned int i = 0;i < m_SampleDirections.size();++i)
+        outFile.write((const char *)m_SampleDirections[i].data(),2 * sizeof(double));
+
+    outFile.write((const char *)recordIndexes.data(),m_NumberOfVoxels * sizeof(int32_t));
+    size_t paddingSize = GetRecordIndexesSize(m_NumberOfVoxels) - m_NumberOfVoxels * sizeof(int32_t);
+    const char padding[8] = {0,0,0,0,0,0,0,0};
+    outFile.write(padding,paddingSize);
+
+    if (recordOffsets.size() != 0)
+        outFile.write((const char *)recordOffsets.data(),recordOffsets.size() * sizeof(uint64_t));
+
+    for (unsigned int i = 0;i < m_NumberOfVoxels;++i)
+    {
+        if (recordIndexes[i] < 0)
+            continue;
+
+        const std::vector <double> &record = m_BuildRecords[m_BuildRecordIndexes[i]];
+        outFile.write((const char *)record.data(),record.size() * sizeof(double));
+    }
+
+    if (!outFile.good())
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Error while writing cohort model file " + fileName,ITK_LOCATION);
+
+    outFile.close();
+}
+
+void PatientToGroupCohortModel::Read(const std::string &fileName)
+{
+    this->ReleaseMapping();
+    m_BuildRecordIndexes.clear();
+    m_BuildRecords.clear();
+
+    const char *fileData = ITK_NULLPTR;
+    size_t fileSize = 0;
+
+#ifndef _WIN32
+    int fileDescriptor = open(fileName.c_str(),O_RDONLY);
+    if (fileDescriptor < 0)
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Could not open cohort model file " + fileName,ITK_LOCATION);
+
+    struct stat fileStats;
+    if ((fstat(fileDescriptor,&fileStats) != 0)||(fileStats.st_size < (off_t)CohortModelHeaderSize))
+    {
+        close(fileDescriptor);
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Invalid cohort model file " + fileName,ITK_LOCATION);
+    }
+
+    fileSize = fileStats.st_size;
+    void *mappedData = mmap(ITK_NULLPTR,fileSize,PROT_READ,MAP_SHARED,fileDescriptor,0);
+    close(fileDescriptor);
+
+    if (mappedData == MAP_FAILED)
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Could not map cohort model file " + fileName,ITK_LOCATION);
+
+    m_MappedData = (char *)mappedData;
+    m_MappedSize = fileSize;
+    fileData = m_MappedData;
+#else
+    std::ifstream inFile(fileName.c_str(),std::ios::binary | std::ios::ate);
+    if (!inFile.is_open())
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Could not open cohort model file " + fileName,ITK_LOCATION);
+
+    std::streamoff streamSize = inFile.tellg();
+    if (streamSize < (std::streamoff)CohortModelHeaderSize)
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Invalid cohort model file " + fileName,ITK_LOCATION);
+
+    fileSize = streamSize;
+    inFile.seekg(0);
+    m_ReadBuffer.resize(fileSize);
+    if (!inFile.read(m_ReadBuffer.data(),fileSize))
+    {
+        this->ReleaseMapping();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Error while reading cohort model file " + fileName,ITK_LOCATION);
+    }
+
+    fileData = m_ReadBuffer.data();
+#endif
+
+    uint32_t headerValues[6];
+    if ((fileSize < CohortModelHeaderSize)||(std::memcmp(fileData,CohortModelMagic,8) != 0))
+    {
+        this->ReleaseMapping();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Invalid cohort model file " + fileName,ITK_LOCATION);
+    }
+
+    std::memcpy(headerValues,fileData + 8,6 * sizeof(uint32_t));
+    if (headerValues[0] != CohortModelVersion)
+    {
+        this->ReleaseMapping();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Unsupported cohort model file version in " + fileName,ITK_LOCATION);
+    }
+
+    m_ModelDimension = headerValues[1];
+    for (unsigned int i = 0;i < 3;++i)
+        m_ImageSize[i] = headerValues[2 + i];
+    unsigned int numRecords = headerValues[5];
+
+    uint64_t numVoxels = (uint64_t)headerValues[2] * headerValues[3] * headerValues[4];
+    if ((m_ModelDimension == 0)||(numVoxels > fileSize / sizeof(int32_t)))
+    {
+        this->ReleaseMapping();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Invalid cohort model file " + fileName,ITK_LOCATION);
+    }
+
+    m_NumberOfVoxels = numVoxels;
+
+    size_t pos = 8 + 6 * sizeof(uint32_t);
+    std::memcpy(m_Origin,fileData + pos,3 * sizeof(double));
+    pos += 3 * sizeof(double);
+    std::memcpy(m_Spacing,fileData + pos,3 * sizeof(double));
+    pos += 3 * sizeof(double);
+    std::memcpy(m_Direction,fileData + pos,9 * sizeof(double));
+    pos += 9 * sizeof(double);
+
+    uint32_t parameterValues[4];
+    std::memcpy(&m_ExplainedRatio,fileData + pos,sizeof(double));
+    pos += sizeof(double);
+    std::memcpy(parameterValues,fileData + pos,4 * sizeof(uint32_t));
+    pos += 4 * sizeof(uint32_t);
+
+    m_NumEigenValuesPCA = parameterValues[0];
+    m_StatisticalTestType = parameterValues[1];
+    unsigned int numDirections = parameterValues[2];
+    if (numDirections > (fileSize - pos) / (2 * sizeof(double)))
+    {
+        this->ReleaseMapping();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Truncated cohort model file " + fileName,ITK_LOCATION);
+    }
+
+    m_SampleDirections.assign(numDirections,std::vector <double> (2,0.0));
+    for (unsigned int i = 0;i < numDirections;++i)
+    {
+        std::memcpy(m_SampleDirections[i].data(),fileData + pos,2 * sizeof(double));
+        pos += 2 * sizeof(double);
+    }
+
+    size_t dataStart = pos + GetRecordIndexesSize(m_NumberOfVoxels) + (size_t)numRecords * sizeof(uint64_t);
+    if (fileSize < dataStart)
+    {
+        this->ReleaseMapping();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Truncated cohort model file " + fileName,ITK_LOCATION);
+    }
+
+    const int32_t *recordIndexes = (const int32_t *)(fileData + pos);
+    const uint64_t *recordOffsets = (const uint64_t *)(fileData + pos + GetRecordIndexesSize(m_NumberOfVoxels));
+    const double *recordData = (const double *)(fileData + dataStart);
+
+    // Every record referenced by a voxel, and every record end, has to lie inside the file
+    bool validTables = true;
+    for (unsigned int i = 0;(i < m_NumberOfVoxels) && validTables;++i)
+        validTables = (recordIndexes[i] < (int64_t)numRecords);
+
+    uint64_t numDataValues = (fileSize - dataStart) / sizeof(double);
+    for (unsigned int i = 0;(i < numRecords) && validTables;++i)
+    {
+        uint64_t recordOffset = recordOffsets[i];
+        if ((recordOffset > numDataValues)||(numDataValues - recordOffset < 2))
+        {
+            validTables = false;
+            break;
+        }
+
+        double reducedDimension = recordData[recordOffset + 1];
+        if (!(reducedDimension >= 0)||(reducedDimension > m_ModelDimension))
+        {
+            validTables = false;
+            break;
+        }
+
+        size_t recordLength = GetRecordLength(m_ModelDimension,(unsigned int)reducedDimension);
+        validTables = (numDataValues - recordOffset >= recordLength);
+    }
+
+    if (!validTables)
+    {
+        this->ReleaseMapping();
+        throw itk::ExceptionObject(__FILE__,__LINE__,"Corrupted cohort model file " + fileName,ITK_LOCATION);
+    }
+
+    m_RecordIndexes = recordIndexes;
+    m_RecordOffsets = recordOffsets;
+    m_RecordData = recordData;
+}
+
+const double *PatientToGroupCohortModel::GetRecord(unsigned int voxelIndex) const
+{
+    if (voxelIndex >= m_NumberOfVoxels)
+        return ITK_NULLPTR;
+
+    if (m_RecordIndexes)
+    {
+        int32_t recordIndex = m_RecordIndexes[voxelIndex];
+        if (recordIndex < 0)
+            return ITK_NULLPTR;
+
+        return m_RecordData + m_RecordOffsets[recordIndex];
+    }
+
+    if ((voxelIndex >= m_BuildRecordIndexes.size())||(m_BuildRecordIndexes[voxelIndex] < 0))
+        return ITK_NULLPTR;
+
+    const std::vector <double> &record = m_BuildRecords[m_BuildRecordIndexes[voxelIndex]];
+    if (record.size() == 0)
+        return ITK_NULLPTR;
+
+    return record.data();
+}
+
+bool PatientToGroupCohortModel::GetVoxelModel(unsigned int voxelIndex, VoxelModel &model) const
+{
+    const double *record = this->GetRecord(voxelIndex);
+    if (!record)
+        return false;
+
+    model.numberOfSamples = (unsigned int)record[0];
+    model.reducedDimension = (unsigned int)record[1];
+    model.mean = record + 2;
+    model.basis = model.mean + m_ModelDimension;
+    model.reducedMean = model.basis + model.reducedDimension * m_ModelDimension;
+    model.inverseCovariance = model.reducedMean + model.reducedDimension;
+
+    return true;
+}
+
+bool PatientToGroupCohortModel::IsCompatible(const GeometryType *geometry) const
+{
+    const double tolerance = 1.0e-4;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        if (geometry->GetLargestPossibleRegion().GetSize()[i] != m_ImageSize[i])
+            return false;
+
+        if (std::abs(geometry->GetOrigin()[i] - m_Origin[i]) > tolerance * std::max(1.0,std::abs(m_Origin[i])))
+            return false;
+
+        if (std::abs(geometry->GetSpacing()[i] - m_Spacing[i]) > tolerance * m_Spacing[i])
+            return false;
+
+        for (unsigned int j = 0;j < 3;++j)
+        {
+            if (std::abs(geometry->GetDirection()(i,j) - m_Direction[i * 3 + j]) > tolerance)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+} // end namespace anima
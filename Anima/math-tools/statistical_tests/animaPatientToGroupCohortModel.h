@@ -0,0 +1,119 @@
+#pragma once
+
+#include <itkImageBase.h>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "AnimaStatisticalTestsExport.h"
+
+namespace anima
+{
+
+/**
+ * @brief Per voxel control group model for patient to group comparison: mean and PCA basis of the control samples,
+ * mean and inverse covariance matrix of the projected samples, and number of samples. It is built once for a
+ * database of controls, written to a binary file, and then memory mapped by the comparison filters so that each
+ * patient comparison only projects the patient and evaluates a Mahalanobis distance.
+ *
+ * File layout (native endianness): a header (magic, model dimension, image geometry, build parameters and ODF sample
+ * directions), one record number per image voxel (-1 if no model), the offset of each record, and the records
+ * themselves as doubles.
+ * A record is: number of samples, reduced dimension r, mean (model dimension m), basis (r x m, row major),
+ * reduced mean (r), inverse covariance (r x r, row major).
+ */
+class ANIMASTATISTICALTESTS_EXPORT PatientToGroupCohortModel
+{
+public:
+    typedef itk::ImageBase <3> GeometryType;
+
+    //! Read only view of the model of one voxel, pointing to the model data
+    struct VoxelModel
+    {
+        unsigned int numberOfSamples;
+        unsigned int reducedDimension;
+        const double *mean;
+        const double *basis;
+        const double *reducedMean;
+        const double *inverseCovariance;
+    };
+
+    PatientToGroupCohortModel();
+    ~PatientToGroupCohortModel();
+
+    /**
+     * Prepares an empty in-memory model on a geometry. Models live in a space of dimension modelDimension
+     * (dimension of the sampled data, see PatientToGroupComparisonImageFilter::SampleFromDiffusionModels), and may only
+     * be set for the voxels (linear indexes in the geometry largest possible region) of modelVoxels
+     */
+    void Initialize(const GeometryType *geometry, unsigned int modelDimension, const std::vector <unsigned int> &modelVoxels);
+
+    /**
+     * Sets the model of a voxel given in Initialize. Thread safe for distinct voxels. Basis and inverse covariance are row major
+     */
+    void SetVoxelModel(unsigned int voxelIndex, unsigned int numberOfSamples, unsigned int reducedDimension,
+                       const double *mean, const double *basis, const double *reducedMean, const double *inverseCovariance);
+
+    /**
+     * Sets the parameters the model was built with (PCA explained ratio and minimal number of eigen values, statistical
+     * test, ODF sample directions in spherical coordinates, empty if none). Stored in the file so that comparisons may check them
+     */
+    void SetBuildParameters(double explainedRatio, unsigned int numEigenValuesPCA, unsigned int statisticalTestType,
+                            const std::vector < std::vector <double> > &sampleDirections);
+
+    double GetExplainedRatio() const {return m_ExplainedRatio;}
+    unsigned int GetNumEigenValuesPCA() const {return m_NumEigenValuesPCA;}
+    unsigned int GetStatisticalTestType() const {return m_StatisticalTestType;}
+    const std::vector < std::vector <double> > &GetSampleDirections() const {return m_SampleDirections;}
+
+    //! Writes the model to disk, voxels whose model was not set are written as without model
+    void Write(const std::string &fileName);
+
+    //! Maps a model file written by Write, replaces any in-memory model
+    void Read(const std::string &fileName);
+
+    //! Returns false if there is no model at this voxel (linear index in the model geometry)
+    bool GetVoxelModel(unsigned int voxelIndex, VoxelModel &model) const;
+
+    unsigned int GetModelDimension() const {return m_ModelDimension;}
+    unsigned int GetNumberOfVoxels() const {return m_NumberOfVoxels;}
+
+    //! Size of the model image, linear voxel indexes are computed from it
+    const itk::Size <3> &GetImageSize() const {return m_ImageSize;}
+
+    //! True if the geometry has the same size, origin, spacing and direction as the model
+    bool IsCompatible(const GeometryType *geometry) const;
+
+private:
+    void ReleaseMapping();
+    const double *GetRecord(unsigned int voxelIndex) const;
+
+    unsigned int m_ModelDimension;
+    unsigned int m_NumberOfVoxels;
+
+    itk::Size <3> m_ImageSize;
+    double m_Origin[3];
+    double m_Spacing[3];
+    double m_Direction[9];
+
+    // Build parameters
+    double m_ExplainedRatio;
+    unsigned int m_NumEigenValuesPCA;
+    unsigned int m_StatisticalTestType;
+    std::vector < std::vector <double> > m_SampleDirections;
+
+    // In-memory model (while building)
+    std::vector <int32_t> m_BuildRecordIndexes;
+    std::vector < std::vector <double> > m_BuildRecords;
+
+    // Mapped model (after Read)
+    char *m_MappedData;
+    size_t m_MappedSize;
+    std::vector <char> m_ReadBuffer;
+    const int32_t *m_RecordIndexes;
+    const uint64_t *m_RecordOffsets;
+    const double *m_RecordData;
+};
+
+} // end namespace anima
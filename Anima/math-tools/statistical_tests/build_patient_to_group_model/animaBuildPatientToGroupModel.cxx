@@ -0,0 +1,103 @@
+#include <iostream>
+#include <tclap/CmdLine.h>
+
+#include <animaReadWriteFunctions.h>
+#include <animaPatientToGroupODFComparisonImageFilter.h>
+#include <animaPatientToGroupCohortModel.h>
+#include <animaODFFunctions.h>
+
+#include <itkTimeProbe.h>
+
+int main(int argc, char **argv)
+{
+    TCLAP::CmdLine cmd("Builds a control group model (per voxel mean, PCA basis and inverse covariance) for animaPatientToGroupComparison "
+                       "and animaPatientToGroupODFComparison (-M option). Parameters must be the ones used for the comparisons.\n"
+                       "INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
+
+    TCLAP::ValueArg<std::string> dataLTArg("I","database","Database Image List (log-tensors or ODFs)",true,"","database image list",cmd);
+    TCLAP::ValueArg<std::string> maskArg("m","maskname","Computation mask",true,"","computation mask",cmd);
+    TCLAP::ValueArg<std::string> resArg("o","outputname","Output cohort model file",true,"","output cohort model",cmd);
+
+    TCLAP::ValueArg<std::string> statTestArg("t","stat-test","Statistical test the model is built for ([fisher],chi)",false,"fisher","statistical test",cmd);
+    TCLAP::ValueArg<double> expVarArg("e","expvar","PCA threshold: threshold on eigenvalues to compute the new basis (default: 0.5)",false,0.5,"PCA threshold",cmd);
+    TCLAP::ValueArg<unsigned int> numEigenArg("E","numeigenpca","Number of eigenvalues to keep (default: 6)",false,6,"Number of PCA eigen values",cmd);
+
+    TCLAP::ValueArg<unsigned int> nbThetaArg("T","theta","ODF only: number of theta values (theta varies between 0 and pi/2",false,0,"number of theta values",cmd);
+    TCLAP::ValueArg<unsigned int> nbPhiArg("P","phi","ODF only: number of phi values (theta varies between 0 and 2 pi",false,0,"number of phi values",cmd);
+    TCLAP::ValueArg<std::string> samplesFileNameArg("d","sampledirectionsfile","ODF only: samples directions in a text file",false,"","Samples directions file",cmd);
+
+    TCLAP::ValueArg<unsigned int> nbpArg("p","numberofthreads","Number of threads to run on (default: all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
+
+    try
+    {
+        cmd.parse(argc,argv);
+    }
+    catch (TCLAP::ArgException& e)
+    {
+        std::cerr << "Error: " << e.error() << "for argument " << e.argId() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    typedef itk::VectorImage<double,3> InputImageType;
+    // Without sample directions, the ODF filter behaves as the generic comparison filter
+    typedef anima::PatientToGroupODFComparisonImageFilter<double> MainFilterType;
+
+    MainFilterType::Pointer mainFilter = MainFilterType::New();
+    mainFilter->SetComputationMask(anima::readImage < itk::Image <unsigned char, 3> > (maskArg.getValue()));
+    mainFilter->SetNumberOfWorkUnits(nbpArg.getValue());
+    mainFilter->SetExplainedRatio(expVarArg.getValue());
+    mainFilter->SetNumEigenValuesPCA(numEigenArg.getValue());
+
+    if (statTestArg.getValue() == "chi")
+        mainFilter->SetStatisticalTestType(MainFilterType::CHI_SQUARE);
+    else
+        mainFilter->SetStatisticalTestType(MainFilterType::FISHER);
+
+    if ((nbThetaArg.getValue() != 0)||(nbPhiArg.getValue() != 0)||(samplesFileNameArg.getValue() != ""))
+    {
+        std::vector < std::vector <double> > sampleDirections = anima::InitializeSampleDirections(nbThetaArg.getValue(),nbPhiArg.getValue(),
+                                                                                                  samplesFileNameArg.getValue());
+        mainFilter->SetSampleDirections(sampleDirections);
+    }
+
+    std::ifstream fileIn(dataLTArg.getValue());
+    if (!fileIn.is_open())
+    {
+        std::cerr << "Could not open data file (" << dataLTArg.getValue() << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    while (!fileIn.eof())
+    {
+        char tmpStr[2048];
+        fileIn.getline(tmpStr,2048);
+
+        if (strcmp(tmpStr,"") == 0)
+            continue;
+
+        std::cout << "Loading image " << tmpStr << "..." << std::endl;
+        mainFilter->AddDatabaseInput(anima::readImage <InputImageType> (tmpStr));
+    }
+    fileIn.close();
+
+    anima::PatientToGroupCohortModel cohortModel;
+
+    try
+    {
+        itk::TimeProbe tmpTime;
+        tmpTime.Start();
+
+        mainFilter->BuildCohortModel(&cohortModel);
+        cohortModel.Write(resArg.getValue());
+
+        tmpTime.Stop();
+        std::cout << "Cohort model built in " << tmpTime.GetTotal() << "s" << std::endl;
+    }
+    catch (itk::ExceptionObject &e)
+    {
+        std::cerr << e << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -16,7 +16,8 @@ int main(int argc, char **argv)
     TCLAP::CmdLine cmd("INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
     
     TCLAP::ValueArg<std::string> refLTArg("i","input","Test Image",true,"","test image",cmd);
-    TCLAP::ValueArg<std::string> dataLTArg("I","database","Database Image List",true,"","database image list",cmd);
+    TCLAP::ValueArg<std::string> dataLTArg("I","database","Database Image List",false,"","database image list",cmd);
+    TCLAP::ValueArg<std::string> modelArg("M","model","Cohort model built by animaBuildPatientToGroupModel, replaces the database",false,"","cohort model",cmd);
     
     TCLAP::ValueArg<std::string> maskArg("m","maskname","Computation mask",true,"","computation mask",cmd);
     TCLAP::ValueArg<std::string> resArg("o","outputname","Z-Score output image",true,"","Z-Score output image",cmd);
@@ -37,6 +38,12 @@ int main(int argc, char **argv)
         std::cerr << "Error: " << e.error() << "for argument " << e.argId() << std::endl;
         return EXIT_FAILURE;
     }
+
+    if ((dataLTArg.getValue() == "")&&(modelArg.getValue() == ""))
+    {
+        std::cerr << "Error: either a database image list or a cohort model is required" << std::endl;
+        return EXIT_FAILURE;
+    }
     
     typedef itk::VectorImage<double,3> LogTensorImageType;
     typedef anima::PatientToGroupComparisonImageFilter<double> MAZScoreImageFilterType;
@@ -57,25 +64,43 @@ int main(int argc, char **argv)
     else
         mainFilter->SetStatisticalTestType(MAZScoreImageFilterType::FISHER);
 
-    std::ifstream fileIn(dataLTArg.getValue());
-    if (!fileIn.is_open())
+    anima::PatientToGroupCohortModel cohortModel;
+    if (modelArg.getValue() != "")
     {
-        std::cerr << "Could not open data file (" << dataLTArg.getValue() << ")" << std::endl;
-        return EXIT_FAILURE;
+        try
+        {
+            cohortModel.Read(modelArg.getValue());
+        }
+        catch (itk::ExceptionObject &e)
+        {
+            std::cerr << e << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        mainFilter->SetCohortModel(&cohortModel);
     }
-    
-    while (!fileIn.eof())
+    else
     {
-        char tmpStr[2048];
-        fileIn.getline(tmpStr,2048);
+        std::ifstream fileIn(dataLTArg.getValue());
+        if (!fileIn.is_open())
+        {
+            std::cerr << "Could not open data file (" << dataLTArg.getValue() << ")" << std::endl;
+            return EXIT_FAILURE;
+        }
+    
+        while (!fileIn.eof())
+        {
+            char tmpStr[2048];
+            fileIn.getline(tmpStr,2048);
         
-        if (strcmp(tmpStr,"") == 0)
-            continue;
+            if (strcmp(tmpStr,"") == 0)
+                continue;
         
-        std::cout << "Loading tensor image " << tmpStr << "..." << std::endl;
-        mainFilter->AddDatabaseInput(anima::readImage <LogTensorImageType> (tmpStr));
+            std::cout << "Loading tensor image " << tmpStr << "..." << std::endl;
+            mainFilter->AddDatabaseInput(anima::readImage <LogTensorImageType> (tmpStr));
+        }
+        fileIn.close();
     }
-    fileIn.close();
 
     mainFilter->AddObserver(itk::ProgressEvent(), callback);
 
@@ -5,6 +5,8 @@
 #include <itkVectorImage.h>
 #include <itkImage.h>
 
+#include <animaPatientToGroupCohortModel.h>
+
 #include <vector>
 
 namespace anima
@@ -17,6 +19,10 @@ namespace anima
      * from a database of controls. It can virtually process any type of input, however for tensor images, be warned
      * that they should be expressed as log-vectors.
      *
+     * The control group model (mean, PCA basis and inverse covariance at each voxel) does not depend on the patient. It
+     * may be computed once with BuildCohortModel and saved, and then given to SetCohortModel in place of the database
+     * images: each comparison then only projects the patient and evaluates its Mahalanobis distance.
+     *
      */
 template <class PixelScalarType>
 class PatientToGroupComparisonImageFilter :
@@ -67,6 +73,16 @@ public:
 
     itkSetMacro(StatisticalTestType, TestType);
 
+    //! Use a precomputed control group model instead of the database images, not owned by the filter
+    void SetCohortModel(anima::PatientToGroupCohortModel *model) {m_CohortModel = model;}
+
+    /**
+     * Computes the control group model from the database images at each voxel of the computation mask (required,
+     * it provides the model geometry). Uses the current PCA and sampling parameters, the input image is not needed.
+     * These parameters and the statistical test are stored in the model, comparisons using it must have the same ones
+     */
+    void BuildCohortModel(anima::PatientToGroupCohortModel *model);
+
 protected:
     PatientToGroupComparisonImageFilter()
         : Superclass()
@@ -80,6 +96,7 @@ protected:
 
         m_DatabaseImages.clear();
         m_StatisticalTestType = FISHER;
+        m_CohortModel = ITK_NULLPTR;
     }
 
     virtual ~PatientToGroupComparisonImageFilter() {}
@@ -93,19 +110,52 @@ protected:
         return patientVectorValue.GetSize();
     }
 
+    //! Reimplement in subclasses to set up sampling (called before SampleFromDiffusionModels is used), ndim is the input dimension
+    virtual void InitializeSampling(unsigned int ndim) {}
+
+    //! Reimplement in subclasses sampling their inputs, the directions are stored in cohort models and checked against them
+    virtual std::vector < std::vector <double> > GetSampleDirections() {return std::vector < std::vector <double> > ();}
+
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(PatientToGroupComparisonImageFilter);
 
+    //! Control group model at one voxel, as computed from the database samples
+    struct VoxelModelData
+    {
+        unsigned int numberOfSamples;
+        unsigned int reducedDimension;
+        std::vector <double> mean;
+        vnl_matrix <double> basis;
+        std::vector <double> reducedMean;
+        vnl_matrix <double> inverseCovariance;
+    };
+
     bool isZero(const VectorType &vec);
 
+    //! Returns the dimension of the data once sampled by SampleFromDiffusionModels
+    unsigned int GetSampledDimension(unsigned int ndim);
+
+    /**
+     * Computes the model from the (sampled) non zero database samples, databaseValues are modified. Returns false
+     * if there are not enough samples for the model dimension
+     */
+    bool ComputeVoxelModel(std::vector <VectorType> &databaseValues, unsigned int ndim, VoxelModelData &model);
+
+    //! Projects the (sampled) patient on the model and computes the z-score and p-value
+    void ComputeTestValues(const anima::PatientToGroupCohortModel::VoxelModel &model, unsigned int ndim,
+                           const VectorType &patientVectorValue, double &zScore, double &pValue);
+
+    //! Computes PCA mean and basis from the data, and projects the data on it. Returns the reduced dimension
     unsigned int GetPCAVectorsFromData(std::vector < itk::VariableLengthVector <double> > &databaseVectors,
-                                       itk::VariableLengthVector <double> &patientVectorValue);
+                                       std::vector <double> &dataMean, vnl_matrix <double> &basisMatrix);
 
     unsigned int m_NumEigenValuesPCA;
     double m_ExplainedRatio;
 
     std::vector <InputImagePointer> m_DatabaseImages;
     TestType m_StatisticalTestType;
+
+    anima::PatientToGroupCohortModel *m_CohortModel;
 };
 
 } // end namespace anima
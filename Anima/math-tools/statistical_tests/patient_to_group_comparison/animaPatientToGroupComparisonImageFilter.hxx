@@ -11,6 +11,7 @@
 #include <boost/math/distributions/chi_squared.hpp>
 
 #include <itkTimeProbe.h>
+#include <itkMultiThreaderBase.h>
 
 namespace anima
 {
@@ -33,10 +34,129 @@ PatientToGroupComparisonImageFilter<PixelScalarType>
     if (m_NumEigenValuesPCA > ndim)
         m_NumEigenValuesPCA = ndim;
 
+    this->InitializeSampling(ndim);
+
+    if (m_CohortModel)
+    {
+        if (m_CohortModel->GetModelDimension() != this->GetSampledDimension(ndim))
+            itkExceptionMacro("Error: Cohort model dimension does not match input data...");
+
+        if (!m_CohortModel->IsCompatible(this->GetInput(0)))
+            itkExceptionMacro("Error: Cohort model geometry does not match input image...");
+
+        if ((std::abs(m_CohortModel->GetExplainedRatio() - m_ExplainedRatio) > 1.0e-8)||
+                (m_CohortModel->GetNumEigenValuesPCA() != m_NumEigenValuesPCA))
+            itkExceptionMacro("Error: Cohort model PCA parameters (explained ratio " << m_CohortModel->GetExplainedRatio()
+                              << ", " << m_CohortModel->GetNumEigenValuesPCA() << " eigen values) differ from the requested ones...");
+
+        if (m_CohortModel->GetStatisticalTestType() != (unsigned int)m_StatisticalTestType)
+            itkExceptionMacro("Error: Cohort model was built for another statistical test...");
+
+        std::vector < std::vector <double> > sampleDirections = this->GetSampleDirections();
+        const std::vector < std::vector <double> > &modelDirections = m_CohortModel->GetSampleDirections();
+        bool sameDirections = (sampleDirections.size() == modelDirections.size());
+        for (unsigned int i = 0;(i < sampleDirections.size()) && sameDirections;++i)
+        {
+            for (unsigned int j = 0;j < sampleDirections[i].size();++j)
+            {
+                if (std::abs(sampleDirections[i][j] - modelDirections[i][j]) > 1.0e-8)
+                    sameDirections = false;
+            }
+        }
+
+        if (!sameDirections)
+            itkExceptionMacro("Error: Cohort model sample directions differ from the requested ones...");
+
+        return;
+    }
+
     if (m_DatabaseImages.size() <= this->GetInput(0)->GetNumberOfComponentsPerPixel())
         itkExceptionMacro("Error: Not enough inputs available...");
 }
 
+template <class PixelScalarType>
+void
+PatientToGroupComparisonImageFilter<PixelScalarType>
+::BuildCohortModel(anima::PatientToGroupCohortModel *model)
+{
+    MaskImageType *maskImage = this->GetComputationMask();
+    if (!maskImage)
+        itkExceptionMacro("Error: A computation mask is required to build a cohort model...");
+
+    unsigned int numSamplesDatabase = m_DatabaseImages.size();
+    if (numSamplesDatabase == 0)
+        itkExceptionMacro("Error: No database images available...");
+
+    unsigned int inputDimension = m_DatabaseImages[0]->GetNumberOfComponentsPerPixel();
+    if (numSamplesDatabase <= inputDimension)
+        itkExceptionMacro("Error: Not enough inputs available...");
+
+    for (unsigned int i = 0;i < numSamplesDatabase;++i)
+    {
+        if (m_DatabaseImages[i]->GetLargestPossibleRegion().GetSize() != maskImage->GetLargestPossibleRegion().GetSize())
+            itkExceptionMacro("Error: Database images and computation mask sizes differ...");
+    }
+
+    if (m_NumEigenValuesPCA > inputDimension)
+        m_NumEigenValuesPCA = inputDimension;
+
+    this->InitializeSampling(inputDimension);
+    unsigned int ndim = this->GetSampledDimension(inputDimension);
+
+    typedef itk::ImageRegionConstIteratorWithIndex < MaskImageType > MaskRegionIteratorType;
+    MaskRegionIteratorType maskIterator(maskImage,maskImage->GetLargestPossibleRegion());
+    std::vector <unsigned int> modelVoxels;
+    while (!maskIterator.IsAtEnd())
+    {
+        if (maskIterator.Get() != 0)
+            modelVoxels.push_back(maskImage->ComputeOffset(maskIterator.GetIndex()));
+
+        ++maskIterator;
+    }
+
+    model->Initialize(maskImage,ndim,modelVoxels);
+    model->SetBuildParameters(m_ExplainedRatio,m_NumEigenValuesPCA,m_StatisticalTestType,this->GetSampleDirections());
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+    threader->ParallelizeArray(0,modelVoxels.size(),[&](itk::SizeValueType voxel)
+    {
+        InputImageIndexType index = maskImage->ComputeIndex(modelVoxels[voxel]);
+
+        std::vector <VectorType> databaseValues;
+        for (unsigned int i = 0;i < numSamplesDatabase;++i)
+        {
+            VectorType databaseValue = m_DatabaseImages[i]->GetPixel(index);
+            if (!this->isZero(databaseValue))
+                databaseValues.push_back(databaseValue);
+        }
+
+        VectorType patientVectorValue(inputDimension);
+        patientVectorValue.Fill(0);
+        this->SampleFromDiffusionModels(databaseValues,patientVectorValue);
+
+        VoxelModelData voxelModel;
+        if (!this->ComputeVoxelModel(databaseValues,ndim,voxelModel))
+            return;
+
+        model->SetVoxelModel(modelVoxels[voxel],voxelModel.numberOfSamples,voxelModel.reducedDimension,
+                             voxelModel.mean.data(),voxelModel.basis.data_block(),voxelModel.reducedMean.data(),
+                             voxelModel.inverseCovariance.data_block());
+    }, ITK_NULLPTR);
+}
+
+template <class PixelScalarType>
+unsigned int
+PatientToGroupComparisonImageFilter<PixelScalarType>
+::GetSampledDimension(unsigned int ndim)
+{
+    std::vector <VectorType> databaseValues;
+    VectorType sampleVector(ndim);
+    sampleVector.Fill(0);
+
+    return this->SampleFromDiffusionModels(databaseValues,sampleVector);
+}
+
 template <class PixelScalarType>
 void
 PatientToGroupComparisonImageFilter<PixelScalarType>
@@ -51,7 +171,8 @@ PatientToGroupComparisonImageFilter<PixelScalarType>
     OutRegionIteratorType outPValIterator(this->GetOutput(1), outputRegionForThread);
     MaskRegionIteratorType maskIterator (this->GetComputationMask(), outputRegionForThread);
 
-    unsigned int numSamplesDatabase = m_DatabaseImages.size();
+    // Database images are not needed when a cohort model is provided
+    unsigned int numSamplesDatabase = m_CohortModel ? 0 : m_DatabaseImages.size();
     std::vector < InIteratorType > databaseIterators;
     InIteratorType patientIterator(this->GetInput(0), outputRegionForThread);
 
@@ -59,157 +180,209 @@ PatientToGroupComparisonImageFilter<PixelScalarType>
         databaseIterators.push_back(InIteratorType(m_DatabaseImages[i],outputRegionForThread));
 
     unsigned int ndim = this->GetInput(0)->GetNumberOfComponentsPerPixel();
-    CovMatrixType tmpCovMatrix(ndim,ndim), tmpCovMatrixInv;
-    VectorType tmpMean(ndim);
 
     std::vector < VectorType > databaseValues(numSamplesDatabase);
     VectorType patientVectorValue;
+    VoxelModelData voxelModelData;
+    anima::PatientToGroupCohortModel::VoxelModel voxelModel;
 
     while (!outIterator.IsAtEnd())
     {
         patientVectorValue = patientIterator.Get();
         ndim = patientVectorValue.GetSize();
 
-        if ((maskIterator.Get() == 0)||(this->isZero(patientVectorValue)))
+        bool validModel = (maskIterator.Get() != 0)&&(!this->isZero(patientVectorValue));
+
+        if (validModel && m_CohortModel)
         {
-            outIterator.Set(0.0);
-            outPValIterator.Set(0.0);
-            ++outIterator;
-            ++outPValIterator;
-            ++maskIterator;
-            ++patientIterator;
+            validModel = m_CohortModel->GetVoxelModel(this->GetOutput(0)->ComputeOffset(outIterator.GetIndex()),voxelModel);
+            if (validModel)
+            {
+                databaseValues.clear();
+                ndim = this->SampleFromDiffusionModels(databaseValues,patientVectorValue);
+            }
+        }
+        else if (validModel)
+        {
+            databaseValues.resize(numSamplesDatabase);
 
+            unsigned int numEffectiveSamples = 0;
             for (unsigned int i = 0;i < numSamplesDatabase;++i)
-                ++databaseIterators[i];
+            {
+                databaseValues[numEffectiveSamples] = databaseIterators[i].Get();
+                if (!this->isZero(databaseValues[numEffectiveSamples]))
+                    numEffectiveSamples++;
+            }
 
-            continue;
-        }
+            databaseValues.resize(numEffectiveSamples);
 
-        databaseValues.resize(numSamplesDatabase);
+            ndim = this->SampleFromDiffusionModels(databaseValues,patientVectorValue);
+            validModel = this->ComputeVoxelModel(databaseValues,ndim,voxelModelData);
 
-        unsigned int numEffectiveSamples = 0;
-        for (unsigned int i = 0;i < numSamplesDatabase;++i)
+            if (validModel)
+            {
+                voxelModel.numberOfSamples = voxelModelData.numberOfSamples;
+                voxelModel.reducedDimension = voxelModelData.reducedDimension;
+                voxelModel.mean = voxelModelData.mean.data();
+                voxelModel.basis = voxelModelData.basis.data_block();
+                voxelModel.reducedMean = voxelModelData.reducedMean.data();
+                voxelModel.inverseCovariance = voxelModelData.inverseCovariance.data_block();
+            }
+        }
+
+        if (!validModel)
+        {
+            outIterator.Set(0.0);
+            outPValIterator.Set(0.0);
+        }
+        else
         {
-            databaseValues[numEffectiveSamples] = databaseIterators[i].Get();
-            if (!this->isZero(databaseValues[numEffectiveSamples]))
-                numEffectiveSamples++;
+            double zScore, pValue;
+            this->ComputeTestValues(voxelModel,ndim,patientVectorValue,zScore,pValue);
+
+            this->IncrementNumberOfProcessedPoints();
+            outIterator.Set(zScore);
+            outPValIterator.Set(pValue);
         }
 
-        databaseValues.resize(numEffectiveSamples);
+        ++outIterator;
+        ++outPValIterator;
+        ++maskIterator;
+        ++patientIterator;
 
-        ndim = this->SampleFromDiffusionModels(databaseValues,patientVectorValue);
-        unsigned int ndim_afterpca = ndim;
+        for (unsigned int i = 0;i < numSamplesDatabase;++i)
+            ++databaseIterators[i];
+    }
+}
 
-        if ((m_NumEigenValuesPCA < ndim)||(m_ExplainedRatio < 1))
-            ndim_afterpca = this->GetPCAVectorsFromData(databaseValues,patientVectorValue);
+template <class PixelScalarType>
+bool
+PatientToGroupComparisonImageFilter<PixelScalarType>
+::ComputeVoxelModel(std::vector <VectorType> &databaseValues, unsigned int ndim, VoxelModelData &model)
+{
+    unsigned int numEffectiveSamples = databaseValues.size();
+    unsigned int ndim_afterpca = ndim;
 
-        if (numEffectiveSamples <= ndim_afterpca)
-        {
-            outIterator.Set(0.0);
-            outPValIterator.Set(0.0);
-            ++outIterator;
-            ++outPValIterator;
-            ++maskIterator;
-            ++patientIterator;
+    if (numEffectiveSamples == 0)
+        return false;
 
-            for (unsigned int i = 0;i < numSamplesDatabase;++i)
-                ++databaseIterators[i];
+    if ((m_NumEigenValuesPCA < ndim)||(m_ExplainedRatio < 1))
+        ndim_afterpca = this->GetPCAVectorsFromData(databaseValues,model.mean,model.basis);
+    else
+    {
+        // No projection: null mean and identity basis leave the data untouched
+        model.mean.assign(ndim,0.0);
+        model.basis.set_size(ndim,ndim);
+        model.basis.set_identity();
+    }
 
-            continue;
-        }
+    if (numEffectiveSamples <= ndim_afterpca)
+        return false;
 
-        tmpCovMatrix.set_size(ndim_afterpca,ndim_afterpca);
-        tmpCovMatrix.fill(0);
-        tmpMean.SetSize(ndim_afterpca);
-        tmpMean.Fill(0);
+    model.numberOfSamples = numEffectiveSamples;
+    model.reducedDimension = ndim_afterpca;
 
-        for (unsigned int i = 0;i < numEffectiveSamples;++i)
-        {
-            for (unsigned int j = 0;j < ndim_afterpca;++j)
-                tmpMean[j] += databaseValues[i][j];
-        }
+    CovMatrixType tmpCovMatrix(ndim_afterpca,ndim_afterpca);
+    tmpCovMatrix.fill(0);
+    std::vector <double> &tmpMean = model.reducedMean;
+    tmpMean.assign(ndim_afterpca,0.0);
 
-        tmpMean /= numEffectiveSamples;
+    for (unsigned int i = 0;i < numEffectiveSamples;++i)
+    {
+        for (unsigned int j = 0;j < ndim_afterpca;++j)
+            tmpMean[j] += databaseValues[i][j];
+    }
 
-        for (unsigned int i = 0;i < numEffectiveSamples;++i)
-        {
-            for (unsigned int j = 0;j < ndim_afterpca;++j)
-                for (unsigned int k = j;k < ndim_afterpca;++k)
-                    tmpCovMatrix(j,k) += (databaseValues[i][j] - tmpMean[j])*(databaseValues[i][k] - tmpMean[k]);
-        }
+    for (unsigned int j = 0;j < ndim_afterpca;++j)
+        tmpMean[j] /= numEffectiveSamples;
 
+    for (unsigned int i = 0;i < numEffectiveSamples;++i)
+    {
         for (unsigned int j = 0;j < ndim_afterpca;++j)
             for (unsigned int k = j;k < ndim_afterpca;++k)
-            {
-                tmpCovMatrix(j,k) /= (numEffectiveSamples - 1.0);
-                if (j != k)
-                    tmpCovMatrix(k,j) = tmpCovMatrix(j,k);
-            }
+                tmpCovMatrix(j,k) += (databaseValues[i][j] - tmpMean[j])*(databaseValues[i][k] - tmpMean[k]);
+    }
+
+    for (unsigned int j = 0;j < ndim_afterpca;++j)
+        for (unsigned int k = j;k < ndim_afterpca;++k)
+        {
+            tmpCovMatrix(j,k) /= (numEffectiveSamples - 1.0);
+            if (j != k)
+                tmpCovMatrix(k,j) = tmpCovMatrix(j,k);
+        }
 
-        vnl_matrix_inverse <double> matrixInverter(tmpCovMatrix);
-        tmpCovMatrixInv = matrixInverter.inverse();
+    vnl_matrix_inverse <double> matrixInverter(tmpCovMatrix);
+    model.inverseCovariance = matrixInverter.inverse();
 
-        double resValue = 0;
+    return true;
+}
 
-        for (unsigned int i = 0;i < ndim_afterpca;++i)
-            for (unsigned int j = i;j < ndim_afterpca;++j)
-            {
-                // This is because we are working only on triangular superior for being faster
-                // The input data has to be in the right log-vector form
-                double factor = 2.0;
-                if (i == j)
-                    factor = 1;
+template <class PixelScalarType>
+void
+PatientToGroupComparisonImageFilter<PixelScalarType>
+::ComputeTestValues(const anima::PatientToGroupCohortModel::VoxelModel &model, unsigned int ndim,
+                    const VectorType &patientVectorValue, double &zScore, double &pValue)
+{
+    unsigned int numEffectiveSamples = model.numberOfSamples;
+    unsigned int ndim_afterpca = model.reducedDimension;
 
-                resValue += factor*tmpCovMatrixInv(i,j)*(patientVectorValue[i] - tmpMean[i])*(patientVectorValue[j] - tmpMean[j]);
-            }
+    // Projection of the patient on the model basis, centered on the reduced database mean
+    std::vector <double> patientResidual(ndim_afterpca);
+    for (unsigned int j = 0;j < ndim_afterpca;++j)
+    {
+        double projectedValue = 0;
+        for (unsigned int k = 0;k < ndim;++k)
+            projectedValue += model.basis[j * ndim + k] * (patientVectorValue[k] - model.mean[k]);
+
+        patientResidual[j] = projectedValue - model.reducedMean[j];
+    }
 
-        switch (m_StatisticalTestType)
+    double resValue = 0;
+
+    for (unsigned int i = 0;i < ndim_afterpca;++i)
+        for (unsigned int j = i;j < ndim_afterpca;++j)
         {
-            case FISHER:
-            {
-                double testScore = numEffectiveSamples * (numEffectiveSamples - ndim_afterpca) * resValue / ((numEffectiveSamples * numEffectiveSamples - 1) * ndim_afterpca);
-                boost::math::fisher_f_distribution <double> fisherDist(ndim_afterpca,numEffectiveSamples - ndim_afterpca);
-                outPValIterator.Set (1.0 - boost::math::cdf(fisherDist, testScore));
-                break;
-            }
+            // This is because we are working only on triangular superior for being faster
+            // The input data has to be in the right log-vector form
+            double factor = 2.0;
+            if (i == j)
+                factor = 1;
 
-            case CHI_SQUARE:
-            default:
-            {
-                boost::math::chi_squared_distribution <double> chiDist(ndim_afterpca);
-                outPValIterator.Set (1.0 - boost::math::cdf(chiDist, resValue));
-                break;
-            }
+            resValue += factor * model.inverseCovariance[i * ndim_afterpca + j] * patientResidual[i] * patientResidual[j];
         }
 
-        resValue = sqrt(resValue);
-        // If scalar values, put a sign on out z-score
-        if (ndim == 1)
+    switch (m_StatisticalTestType)
+    {
+        case FISHER:
         {
-            if (tmpMean[0] > patientVectorValue[0])
-                resValue *= -1;
+            double testScore = numEffectiveSamples * (numEffectiveSamples - ndim_afterpca) * resValue / ((numEffectiveSamples * numEffectiveSamples - 1) * ndim_afterpca);
+            boost::math::fisher_f_distribution <double> fisherDist(ndim_afterpca,numEffectiveSamples - ndim_afterpca);
+            pValue = 1.0 - boost::math::cdf(fisherDist, testScore);
+            break;
         }
 
-        this->IncrementNumberOfProcessedPoints();
-        outIterator.Set(resValue);
-        ++outIterator;
-        ++outPValIterator;
-        ++maskIterator;
-        ++patientIterator;
-
-        for (unsigned int i = 0;i < numSamplesDatabase;++i)
-            ++databaseIterators[i];
+        case CHI_SQUARE:
+        default:
+        {
+            boost::math::chi_squared_distribution <double> chiDist(ndim_afterpca);
+            pValue = 1.0 - boost::math::cdf(chiDist, resValue);
+            break;
+        }
     }
-}
 
+    zScore = sqrt(resValue);
+    // If scalar values, put a sign on out z-score
+    if ((ndim == 1)&&(patientResidual[0] < 0))
+        zScore *= -1;
+}
 
 template <class PixelScalarType>
 unsigned int
 PatientToGroupComparisonImageFilter<PixelScalarType>
 ::GetPCAVectorsFromData(std::vector < itk::VariableLengthVector <double> > &databaseVectors,
-                                                                        itk::VariableLengthVector <double> &patientVectorValue)
+                        std::vector <double> &dataMean, vnl_matrix <double> &basisMatrix)
 {
-    unsigned int refNDim = patientVectorValue.GetSize();
+    unsigned int refNDim = databaseVectors[0].GetSize();
     vnl_matrix <double> allCovarianceMatrix(refNDim,refNDim);
 
     for (unsigned int i = 0;i < refNDim;++i)
@@ -217,7 +390,7 @@ PatientToGroupComparisonImageFilter<PixelScalarType>
             allCovarianceMatrix(i,j) = 0;
 
     unsigned int numData = databaseVectors.size();
-    std::vector <double> dataMean(refNDim,0);
+    dataMean.assign(refNDim,0);
 
     for (unsigned int i = 0;i < numData;++i)
         for (unsigned int j = 0;j < refNDim;++j)
@@ -261,7 +434,7 @@ PatientToGroupComparisonImageFilter<PixelScalarType>
     if (outNDim < m_NumEigenValuesPCA)
         outNDim = m_NumEigenValuesPCA;
 
-    vnl_matrix <double> basisMatrix(outNDim,refNDim);
+    basisMatrix.set_size(outNDim,refNDim);
     for (unsigned int i = 0;i < outNDim;++i)
         for (unsigned int j = 0;j < refNDim;++j)
             basisMatrix(i,j) = eigenVectors(refNDim - 1 - i,j);
@@ -280,15 +453,6 @@ PatientToGroupComparisonImageFilter<PixelScalarType>
         databaseVectors[i] = resData;
     }
 
-    for (unsigned int j = 0;j < outNDim;++j)
-    {
-        resData[j] = 0;
-        for (unsigned int k = 0;k < refNDim;++k)
-            resData[j] += basisMatrix(j,k)*(patientVectorValue[k] - dataMean[k]);
-    }
-
-    patientVectorValue = resData;
-
     return outNDim;
 }
 
@@ -19,7 +19,8 @@ int main(int argc, char **argv)
 
     TCLAP::ValueArg<std::string> refODFArg("i","inputodf","ODF Test Image",true,"","ODF test image",cmd);
 
-    TCLAP::ValueArg<std::string> dataODFArg("I","databaseodf","ODF Database Image List",true,"","ODF database image list",cmd);
+    TCLAP::ValueArg<std::string> dataODFArg("I","databaseodf","ODF Database Image List",false,"","ODF database image list",cmd);
+    TCLAP::ValueArg<std::string> modelArg("M","model","Cohort model built by animaBuildPatientToGroupModel, replaces the database",false,"","cohort model",cmd);
     
     TCLAP::ValueArg<std::string> maskArg("m","maskname","Computation mask",true,"","computation mask",cmd);
     TCLAP::ValueArg<std::string> resArg("o","outputname","Z-Score output image",true,"","Z-Score output image",cmd);
@@ -46,6 +47,12 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
+    if ((dataODFArg.getValue() == "")&&(modelArg.getValue() == ""))
+    {
+        std::cerr << "Error: either a database image list or a cohort model is required" << std::endl;
+        return EXIT_FAILURE;
+    }
+
     typedef itk::VectorImage<double,3> ODFImageType;
     typedef anima::PatientToGroupODFComparisonImageFilter<double> MAOZScoreImageFilterType;
 
@@ -70,25 +77,43 @@ int main(int argc, char **argv)
     else
         mainFilter->SetStatisticalTestType(MAOZScoreImageFilterType::FISHER);
 
-    std::ifstream fileIn(dataODFArg.getValue());
-    if (!fileIn.is_open())
+    anima::PatientToGroupCohortModel cohortModel;
+    if (modelArg.getValue() != "")
     {
-        std::cerr << "Could not open ODF data file (" << dataODFArg.getValue() << ")" << std::endl;
-        return EXIT_FAILURE;
+        try
+        {
+            cohortModel.Read(modelArg.getValue());
+        }
+        catch (itk::ExceptionObject &e)
+        {
+            std::cerr << e << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        mainFilter->SetCohortModel(&cohortModel);
     }
-    
-    while (!fileIn.eof())
+    else
     {
-        char tmpStr[2048];
-        fileIn.getline(tmpStr,2048);
+        std::ifstream fileIn(dataODFArg.getValue());
+        if (!fileIn.is_open())
+        {
+            std::cerr << "Could not open ODF data file (" << dataODFArg.getValue() << ")" << std::endl;
+            return EXIT_FAILURE;
+        }
+    
+        while (!fileIn.eof())
+        {
+            char tmpStr[2048];
+            fileIn.getline(tmpStr,2048);
         
-        if (strcmp(tmpStr,"") == 0)
-            continue;
+            if (strcmp(tmpStr,"") == 0)
+                continue;
         
-        std::cout << "Loading ODF image " << tmpStr << "..." << std::endl;
-        mainFilter->AddDatabaseInput(anima::readImage <ODFImageType> (tmpStr));
+            std::cout << "Loading ODF image " << tmpStr << "..." << std::endl;
+            mainFilter->AddDatabaseInput(anima::readImage <ODFImageType> (tmpStr));
+        }
+        fileIn.close();
     }
-    fileIn.close();
     
     mainFilter->AddObserver(itk::ProgressEvent(), callback);
 
@@ -41,8 +41,9 @@ protected:
             delete m_ShData;
     }
 
-    virtual void BeforeThreadedGenerateData() ITK_OVERRIDE;
+    void InitializeSampling(unsigned int ndim) ITK_OVERRIDE;
     unsigned int SampleFromDiffusionModels(std::vector <VectorType> &databaseValues, VectorType &patientVectorValue) ITK_OVERRIDE;
+    std::vector < std::vector <double> > GetSampleDirections() ITK_OVERRIDE {return m_SampleDirections;}
 
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(PatientToGroupODFComparisonImageFilter);
@@ -7,11 +7,8 @@ namespace anima
 template <class PixelScalarType>
 void
 PatientToGroupODFComparisonImageFilter<PixelScalarType>
-::BeforeThreadedGenerateData ()
+::InitializeSampling(unsigned int ndim)
 {
-    Superclass::BeforeThreadedGenerateData();
-
-    unsigned int ndim = this->GetInput(0)->GetNumberOfComponentsPerPixel();
     m_LOrder = (unsigned int)floor((-3.0 + sqrt(8.0 * ndim + 1.0))/2.0);
 
     if (m_ShData)
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <itkCompositeTransform.h>
+#include <itkImageBase.h>
+#include <itkImageIOBase.h>
 
 namespace anima
 {
@@ -25,6 +27,7 @@ public:
 
     typedef itk::CompositeTransform <TScalarType,NDimensions> OutputTransformType;
     typedef typename OutputTransformType::Pointer OutputTransformPointer;
+    typedef itk::ImageBase <NDimensions> GeometryType;
 
     TransformSeriesReader();
     ~TransformSeriesReader();
@@ -34,6 +37,22 @@ public:
     void SetNumberOfWorkUnits(unsigned int num) {m_NumberOfThreads = num;}
     void SetExponentiationOrder(unsigned int val) {m_ExponentiationOrder = val;}
 
+    /**
+     * If set, non linear series are flattened into a single displacement field sampled on this geometry.
+     * The flattened transform is exact at the geometry voxel centers, and linearly interpolated in between
+     */
+    void SetFlatteningGeometry(const GeometryType *geometry) {m_FlatteningGeometry = geometry;}
+
+    //! Flattening geometry taken from the image information of a geometry image (dimensions above NDimensions are ignored)
+    void SetFlatteningGeometry(itk::ImageIOBase *geometryImageIO);
+
+    /**
+     * If not empty, SVF exponentials are stored in this directory, indexed by a hash of the loaded SVF values and
+     * geometry, the exponentiation order and the inversion flag, and reused when the same SVF is read again.
+     * Hashing the loaded field rather than the file makes split formats (header and data files) safe
+     */
+    void SetExponentialCacheDirectory(std::string const& dirName) {m_ExponentialCacheDirectory = dirName;}
+
     void Update();
 
     OutputTransformType *GetOutputTransform() {return m_OutputTransform;}
@@ -43,6 +62,13 @@ protected:
     void addSVFTransformation(std::string &fileName, bool invert);
     void addDenseTransformation(std::string &fileName, bool invert);
 
+    //! Replaces the output transform by a single displacement field on the flattening geometry
+    void flattenOutputTransform();
+
+    //! Cache file name for the exponential of a loaded SVF, given its geometry and its raw buffer
+    std::string getExponentialCacheFileName(const GeometryType *svfGeometry, const void *svfBuffer,
+                                            size_t bufferSize, bool invert);
+
 private:
     OutputTransformPointer m_OutputTransform;
     bool m_InvertTransform;
@@ -51,6 +77,9 @@ private:
     unsigned int m_ExponentiationOrder;
 
     std::string m_Input;
+
+    typename GeometryType::ConstPointer m_FlatteningGeometry;
+    std::string m_ExponentialCacheDirectory;
 };
 
 } // end namespace itk
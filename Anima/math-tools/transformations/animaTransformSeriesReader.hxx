@@ -3,14 +3,24 @@
 
 #include <tinyxml2.h>
 
+#include <itkImage.h>
 #include <itkTransformFileReader.h>
 #include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkTransformToDisplacementFieldFilter.h>
 
 #include <itkMatrixOffsetTransformBase.h>
 #include <itkStationaryVelocityFieldTransform.h>
 #include <rpiDisplacementFieldTransform.h>
 #include <animaVelocityUtils.h>
 
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
 namespace anima
 {
 
@@ -20,6 +30,7 @@ TransformSeriesReader<TScalarType,NDimensions>
 {
     m_OutputTransform = NULL;
     m_InvertTransform = false;
+    m_FlatteningGeometry = NULL;
 
     m_ExponentiationOrder = 1;
     m_NumberOfThreads = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
@@ -32,6 +43,47 @@ TransformSeriesReader<TScalarType,NDimensions>
 
 }
 
+template <class TScalarType, unsigned int NDimensions>
+void
+TransformSeriesReader<TScalarType,NDimensions>
+::SetFlatteningGeometry(itk::ImageIOBase *geometryImageIO)
+{
+    typedef itk::Image <unsigned char, NDimensions> GeometryImageType;
+
+    typename GeometryImageType::RegionType region;
+    typename GeometryImageType::PointType origin;
+    typename GeometryImageType::SpacingType spacing;
+    typename GeometryImageType::DirectionType direction;
+    direction.SetIdentity();
+    origin.Fill(0.0);
+    spacing.Fill(1.0);
+
+    unsigned int imageIODimension = std::min(geometryImageIO->GetNumberOfDimensions(),NDimensions);
+    for (unsigned int i = 0;i < NDimensions;++i)
+    {
+        region.SetIndex(i,0);
+        region.SetSize(i,1);
+    }
+
+    for (unsigned int i = 0;i < imageIODimension;++i)
+    {
+        region.SetSize(i,geometryImageIO->GetDimensions(i));
+        origin[i] = geometryImageIO->GetOrigin(i);
+        spacing[i] = geometryImageIO->GetSpacing(i);
+        for (unsigned int j = 0;j < imageIODimension;++j)
+            direction(i,j) = geometryImageIO->GetDirection(j)[i];
+    }
+
+    // Geometry only, never allocated
+    typename GeometryImageType::Pointer geometryImage = GeometryImageType::New();
+    geometryImage->SetRegions(region);
+    geometryImage->SetOrigin(origin);
+    geometryImage->SetSpacing(spacing);
+    geometryImage->SetDirection(direction);
+
+    m_FlatteningGeometry = geometryImage.GetPointer();
+}
+
 template <class TScalarType, unsigned int NDimensions>
 void
 TransformSeriesReader<TScalarType,NDimensions>
@@ -156,6 +208,92 @@ TransformSeriesReader<TScalarType,NDimensions>
     }
 
     std::cout << "Loaded " << m_OutputTransform->GetNumberOfTransforms() << " transformations from transform list file: " << m_Input << std::endl;
+
+    if (m_FlatteningGeometry && !m_OutputTransform->IsLinear())
+        this->flattenOutputTransform();
+}
+
+template <class TScalarType, unsigned int NDimensions>
+void
+TransformSeriesReader<TScalarType,NDimensions>
+::flattenOutputTransform()
+{
+    typedef rpi::DisplacementFieldTransform <TScalarType,NDimensions> DenseTransformType;
+    typedef typename DenseTransformType::Pointer DenseTransformPointer;
+    typedef typename DenseTransformType::VectorFieldType DisplacementFieldType;
+
+    typedef itk::TransformToDisplacementFieldFilter <DisplacementFieldType, TScalarType> DisplacementFieldGeneratorType;
+    typename DisplacementFieldGeneratorType::Pointer dispFieldGenerator = DisplacementFieldGeneratorType::New();
+
+    typename GeometryType::RegionType geometryRegion = m_FlatteningGeometry->GetLargestPossibleRegion();
+    dispFieldGenerator->UseReferenceImageOff();
+    dispFieldGenerator->SetOutputDirection(m_FlatteningGeometry->GetDirection());
+    dispFieldGenerator->SetOutputOrigin(m_FlatteningGeometry->GetOrigin());
+    dispFieldGenerator->SetOutputSpacing(m_FlatteningGeometry->GetSpacing());
+    dispFieldGenerator->SetOutputStartIndex(geometryRegion.GetIndex());
+    dispFieldGenerator->SetSize(geometryRegion.GetSize());
+
+    dispFieldGenerator->SetTransform(m_OutputTransform);
+    dispFieldGenerator->SetNumberOfWorkUnits(m_NumberOfThreads);
+    dispFieldGenerator->Update();
+
+    typename DisplacementFieldType::Pointer dispField = dispFieldGenerator->GetOutput();
+    dispField->DisconnectPipeline();
+
+    DenseTransformPointer dispTrsf = DenseTransformType::New();
+    dispTrsf->SetParametersAsVectorField(dispField.GetPointer());
+
+    m_OutputTransform = OutputTransformType::New();
+    m_OutputTransform->AddTransform(dispTrsf);
+
+    std::cout << "Transformation series flattened into a single displacement field" << std::endl;
+}
+
+template <class TScalarType, unsigned int NDimensions>
+std::string
+TransformSeriesReader<TScalarType,NDimensions>
+::getExponentialCacheFileName(const GeometryType *svfGeometry, const void *svfBuffer, size_t bufferSize, bool invert)
+{
+    // FNV-1a hash of the SVF geometry and values
+    uint64_t hashValue = 14695981039346656037ULL;
+    auto hashBytes = [&hashValue] (const void *data, size_t numBytes)
+    {
+        const unsigned char *bytes = static_cast <const unsigned char *> (data);
+        for (size_t i = 0;i < numBytes;++i)
+        {
+            hashValue ^= bytes[i];
+            hashValue *= 1099511628211ULL;
+        }
+    };
+
+    typename GeometryType::RegionType svfRegion = svfGeometry->GetLargestPossibleRegion();
+    for (unsigned int i = 0;i < NDimensions;++i)
+    {
+        int64_t regionValues[2] = {static_cast <int64_t> (svfRegion.GetIndex()[i]),
+                                   static_cast <int64_t> (svfRegion.GetSize()[i])};
+        double geometryValues[2] = {svfGeometry->GetOrigin()[i], svfGeometry->GetSpacing()[i]};
+
+        hashBytes(regionValues,sizeof(regionValues));
+        hashBytes(geometryValues,sizeof(geometryValues));
+        for (unsigned int j = 0;j < NDimensions;++j)
+        {
+            double directionValue = svfGeometry->GetDirection()(i,j);
+            hashBytes(&directionValue,sizeof(double));
+        }
+    }
+
+    hashBytes(svfBuffer,bufferSize);
+
+    std::ostringstream cacheFileName;
+    cacheFileName << m_ExponentialCacheDirectory << "/svf_exp_" << std::hex << std::setw(16) << std::setfill('0') << hashValue
+                  << std::dec << "_" << NDimensions << "d_order" << m_ExponentiationOrder;
+
+    if (invert)
+        cacheFileName << "_inv";
+
+    cacheFileName << ".nrrd";
+
+    return cacheFileName.str();
 }
 
 template <class TScalarType, unsigned int NDimensions>
@@ -226,13 +364,49 @@ TransformSeriesReader<TScalarType,NDimensions>
     typedef rpi::DisplacementFieldTransform <TScalarType,NDimensions> DenseTransformType;
     typedef typename DenseTransformType::Pointer DenseTransformPointer;
 
+    typedef typename DenseTransformType::VectorFieldType DisplacementFieldType;
+
     typedef itk::ImageFileReader<VelocityFieldType> SVFReaderType;
     typename SVFReaderType::Pointer trReader = SVFReaderType::New();
     trReader->SetFileName(fileName);
     trReader->Update();
 
+    VelocityFieldType *svfField = trReader->GetOutput();
+
+    std::string cacheFileName;
+    if (m_ExponentialCacheDirectory != "")
+    {
+        size_t bufferSize = svfField->GetPixelContainer()->Size() * sizeof(typename VelocityFieldType::PixelType);
+        cacheFileName = this->getExponentialCacheFileName(svfField,svfField->GetBufferPointer(),bufferSize,invert);
+    }
+
+    if (cacheFileName != "")
+    {
+        typedef itk::ImageFileReader<DisplacementFieldType> DispReaderType;
+        typename DispReaderType::Pointer cacheReader = DispReaderType::New();
+        cacheReader->SetFileName(cacheFileName);
+
+        bool cacheHit = true;
+        try
+        {
+            cacheReader->Update();
+        }
+        catch (itk::ExceptionObject &)
+        {
+            cacheHit = false;
+        }
+
+        if (cacheHit)
+        {
+            DenseTransformPointer dispTrsf = DenseTransformType::New();
+            dispTrsf->SetParametersAsVectorField(cacheReader->GetOutput());
+            m_OutputTransform->AddTransform(dispTrsf);
+            return;
+        }
+    }
+
     SVFTransformPointer svfPointer = SVFTransformType::New();
-    svfPointer->SetParametersAsVectorField(trReader->GetOutput());
+    svfPointer->SetParametersAsVectorField(svfField);
 
     double power = 1.0;
     if (invert)
@@ -241,6 +415,31 @@ TransformSeriesReader<TScalarType,NDimensions>
     DenseTransformPointer dispTrsf = DenseTransformType::New();
     anima::GetSVFExponential(svfPointer.GetPointer(),dispTrsf.GetPointer(),m_ExponentiationOrder,m_NumberOfThreads,power);
 
+    if (cacheFileName != "")
+    {
+        // Written to a temporary file then renamed, so that concurrent jobs never read a partial cache file
+        std::random_device randomDevice;
+        std::ostringstream tmpFileName;
+        tmpFileName << cacheFileName << "." << std::hex << randomDevice() << ".tmp.nrrd";
+
+        typedef itk::ImageFileWriter<DisplacementFieldType> DispWriterType;
+        typename DispWriterType::Pointer cacheWriter = DispWriterType::New();
+        cacheWriter->SetInput(dispTrsf->GetParametersAsVectorField());
+        cacheWriter->SetFileName(tmpFileName.str());
+
+        try
+        {
+            cacheWriter->Update();
+            if (std::rename(tmpFileName.str().c_str(),cacheFileName.c_str()) != 0)
+                std::remove(tmpFileName.str().c_str());
+        }
+        catch (itk::ExceptionObject &)
+        {
+            std::cerr << "Unable to write SVF exponential cache file " << cacheFileName << std::endl;
+            std::remove(tmpFileName.str().c_str());
+        }
+    }
+
     m_OutputTransform->AddTransform(dispTrsf);
 }
 
@@ -51,6 +51,16 @@ std::vector <double> EPGMonoT2Integrand::operator() (double const t)
     }
 
     double refExcitationValue = m_SignalSimulator.GetExcitationFlipAngle();
+
+    if (m_EPGDictionary && m_EPGDictionary->IsFlipAngleInside(pulseProfileValue * m_FlipAngle))
+    {
+        std::vector <double> epgValue(m_EPGDictionary->GetNumberOfEchoes());
+        m_EPGDictionary->GetValue(m_DictionaryT2Index, pulseProfileValue * m_FlipAngle,
+                                  std::sin(excitationProfileValue * refExcitationValue), epgValue.data());
+
+        return epgValue;
+    }
+
     m_SignalSimulator.SetExcitationFlipAngle(excitationProfileValue * refExcitationValue);
 
     std::vector <double> epgValue = m_SignalSimulator.GetValue(m_T1Value, m_T2Value, pulseProfileValue * m_FlipAngle, 1.0);
@@ -1,6 +1,7 @@
 #pragma once
 #include "AnimaRelaxometryExport.h"
 #include <animaEPGSignalSimulator.h>
+#include <animaEPGDictionary.h>
 #include <animaB1GMMDistributionIntegrand.h>
 #include <animaB1GammaDistributionIntegrand.h>
 #include <animaB1GammaDerivativeDistributionIntegrand.h>
@@ -19,7 +20,11 @@ namespace anima
 class ANIMARELAXOMETRY_EXPORT EPGMonoT2Integrand
 {
 public:
-    EPGMonoT2Integrand() {}
+    EPGMonoT2Integrand()
+    {
+        m_EPGDictionary = 0;
+        m_DictionaryT2Index = 0;
+    }
 
     void SetT1Value(double val) {m_T1Value = val;}
     void SetT2Value(double val) {m_T2Value = val;}
@@ -29,6 +34,13 @@ public:
     void SetSlicePulseProfile(const std::vector < std::pair <double, double> > &profile) {m_SlicePulseProfile = profile;}
     void SetSliceExcitationProfile(const std::vector < std::pair <double, double> > &profile) {m_SliceExcitationProfile = profile;}
 
+    //! Uses the dictionary entry t2Index (matching the T2 value) for flip angles inside the dictionary range
+    void SetEPGDictionary(const anima::EPGDictionary *dictionary, unsigned int t2Index)
+    {
+        m_EPGDictionary = dictionary;
+        m_DictionaryT2Index = t2Index;
+    }
+
     std::vector <double> operator() (double const t);
 
 private:
@@ -36,6 +48,9 @@ private:
     double m_T2Value;
     double m_FlipAngle;
 
+    const anima::EPGDictionary *m_EPGDictionary;
+    unsigned int m_DictionaryT2Index;
+
     anima::EPGSignalSimulator m_SignalSimulator;
     std::vector < std::pair <double, double> > m_SlicePulseProfile;
     std::vector < std::pair <double, double> > m_SliceExcitationProfile;
@@ -4,6 +4,8 @@
 #include <animaGaussLegendreQuadrature.h>
 #include <animaEPGProfileIntegrands.h>
 
+#include <cmath>
+
 namespace anima
 {
     
@@ -23,10 +25,19 @@ MultiT2EPGRelaxometryCostFunction::GetValue(const ParametersType & parameters) c
     anima::EPGSignalSimulator::RealVectorType simulatedT2Values(numT2Signals,0);
     anima::EPGSignalSimulator::RealVectorType subSignalData(numT2Signals,0);
 
+    bool useDictionary = false;
+    if (m_EPGDictionary)
+        useDictionary = m_EPGDictionary->IsCompatible(m_T1Value,m_EchoSpacing,numT2Signals,m_T2Values);
+
     for (unsigned int i = 0;i < numT2Peaks;++i)
     {
         if (m_UniformPulses)
-            subSignalData = t2SignalSimulator.GetValue(m_T1Value,m_T2Values[i],parameters[0],1.0);
+        {
+            if (useDictionary && m_EPGDictionary->IsFlipAngleInside(parameters[0]))
+                m_EPGDictionary->GetValue(i,parameters[0],std::sin(m_ExcitationFlipAngle),subSignalData.data());
+            else
+                subSignalData = t2SignalSimulator.GetValue(m_T1Value,m_T2Values[i],parameters[0],1.0);
+        }
         else
         {
             double halfPixelWidth = m_PixelWidth / 2.0;
@@ -39,6 +50,8 @@ MultiT2EPGRelaxometryCostFunction::GetValue(const ParametersType & parameters) c
             integrand.SetSignalSimulator(t2SignalSimulator);
             integrand.SetT1Value(m_T1Value);
             integrand.SetT2Value(m_T2Values[i]);
+            if (useDictionary)
+                integrand.SetEPGDictionary(m_EPGDictionary,i);
             integrand.SetSlicePulseProfile(m_PulseProfile);
             integrand.SetSliceExcitationProfile(m_ExcitationProfile);
 
@@ -3,6 +3,7 @@
 #include <vnl/vnl_matrix.h>
 #include <itkSingleValuedCostFunction.h>
 #include <animaNNLSOptimizer.h>
+#include <animaEPGDictionary.h>
 #include "AnimaRelaxometryExport.h"
 
 namespace anima
@@ -56,6 +57,12 @@ public:
     void SetPulseProfile(std::vector < std::pair <double, double> > &profile) {m_PulseProfile = profile;}
     void SetExcitationProfile(std::vector < std::pair <double, double> > &profile) {m_ExcitationProfile = profile;}
 
+    /**
+     * Optional precomputed EPG dictionary, used for the T2 values instead of running the EPG simulation
+     * when it matches the acquisition, T1 and T2 values. Falls back on simulation otherwise
+     */
+    void SetEPGDictionary(const anima::EPGDictionary *dictionary) {m_EPGDictionary = dictionary;}
+
     unsigned int GetNumberOfParameters() const ITK_OVERRIDE
     {
         return 1;
@@ -72,6 +79,8 @@ protected:
 
         m_UniformPulses = true;
         m_PixelWidth = 3.0;
+
+        m_EPGDictionary = ITK_NULLPTR;
     }
 
     virtual ~MultiT2EPGRelaxometryCostFunction() {}
@@ -93,6 +102,8 @@ private:
 
     double m_T1Value;
 
+    const anima::EPGDictionary *m_EPGDictionary;
+
     mutable NNLSOptimizerPointer m_NNLSOptimizer;
     mutable vnl_matrix <double> m_AMatrix;
     mutable ParametersType m_OptimizedT2Weights;
@@ -62,6 +62,9 @@ int main(int argc, char **argv)
     TCLAP::ValueArg<unsigned int> patchSSArg("s","patchStepSize","Patch step size for searching -> default: 1",false,1,"Patch search step size",cmd);
     TCLAP::ValueArg<unsigned int> patchNeighArg("","patchNeighborhood","Patch half neighborhood size -> default: 5",false,5,"Patch search neighborhood size",cmd);
 
+    TCLAP::SwitchArg noEPGDictArg("","no-epg-dict","Run EPG simulations for each voxel instead of using a precomputed EPG dictionary (default: no)",cmd);
+    TCLAP::ValueArg<std::string> epgDictCacheArg("","epg-dict-cache","EPG dictionary cache file (loaded if it matches the acquisition, written otherwise)",false,"","EPG dictionary cache",cmd);
+
     TCLAP::ValueArg<unsigned int> nbpArg("T","numberofthreads","Number of threads to run on (default : all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 	
     try
@@ -184,6 +187,8 @@ int main(int argc, char **argv)
     }
     
     mainFilter->SetAverageSignalThreshold(backgroundSignalThresholdArg.getValue());
+    mainFilter->SetUseEPGDictionary(!noEPGDictArg.isSet());
+    mainFilter->SetEPGDictionaryFileName(epgDictCacheArg.getValue());
     mainFilter->SetNumberOfWorkUnits(nbpArg.getValue());
 
     itk::CStyleCommand::Pointer callback = itk::CStyleCommand::New();
@@ -236,6 +241,8 @@ int main(int argc, char **argv)
         secondaryFilter->SetComputationMask(mainFilter->GetComputationMask());
 
         secondaryFilter->SetAverageSignalThreshold(backgroundSignalThresholdArg.getValue());
+        secondaryFilter->SetUseEPGDictionary(!noEPGDictArg.isSet());
+        secondaryFilter->SetEPGDictionaryFileName(epgDictCacheArg.getValue());
         secondaryFilter->SetNumberOfWorkUnits(nbpArg.getValue());
 
         itk::CStyleCommand::Pointer secondaryCallback = itk::CStyleCommand::New();
@@ -6,6 +6,7 @@
 
 #include <animaNonLocalT2DistributionPatchSearcher.h>
 #include <animaMultiT2RegularizationCostFunction.h>
+#include <animaEPGDictionary.h>
 
 namespace anima
 {
@@ -92,6 +93,10 @@ public:
 
     itkSetMacro(T2ExcitationFlipAngle, double)
 
+    //! T1 value (in ms) used where no T1 map is given or its value is not positive
+    itkSetMacro(DefaultT1Value, double)
+    itkGetConstMacro(DefaultT1Value, double)
+
     void SetT2FlipAngles(std::vector <double> & flipAngles) {m_T2FlipAngles = flipAngles;}
     void SetT2FlipAngles(double singleAngle, unsigned int numAngles) {m_T2FlipAngles = std::vector <double> (numAngles,singleAngle);}
 
@@ -103,6 +108,11 @@ public:
 
     std::vector <double> &GetT2CompartmentValues() {return m_T2CompartmentValues;}
 
+    //! Use a precomputed EPG dictionary over the T2 compartments (for voxels with the default T1 value)
+    itkSetMacro(UseEPGDictionary, bool)
+    //! Optional file used to cache the EPG dictionary between runs
+    itkSetMacro(EPGDictionaryFileName, std::string)
+
 protected:
     MultiT2RelaxometryEstimationImageFilter()
     : Superclass()
@@ -126,6 +136,7 @@ protected:
         m_RegularizationRatio = 1.02;
 
         m_T2ExcitationFlipAngle = M_PI / 6;
+        m_DefaultT1Value = 1000;
 
         m_MeanMinThreshold = 0.95;
         m_VarMinThreshold = 0.5;
@@ -139,6 +150,8 @@ protected:
         m_UniformPulses = true;
         m_ReferenceSliceThickness = 3.0;
         m_PulseWidthFactor = 1.5;
+
+        m_UseEPGDictionary = true;
     }
 
     virtual ~MultiT2RelaxometryEstimationImageFilter() {}
@@ -149,6 +162,9 @@ protected:
     void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
 
     void PrepareNLPatchSearchers();
+
+    //! Builds (or loads from cache) the EPG dictionary for the T2 compartments and default T1 value
+    void PrepareEPGDictionary();
     void ComputeTikhonovPrior(const IndexType &refIndex, OutputVectorType &refDistribution,
                               PatchSearcherType &nlPatchSearcher, itk::OptimizerParameters <double> &priorDistribution,
                               std::vector <double> &workDataWeights, std::vector <OutputVectorType> &workDataSamples);
@@ -172,6 +188,7 @@ private:
 
     // T1 relaxometry specific values
     InputImagePointer m_T1Map;
+    double m_DefaultT1Value;
 
     // Optional input images, mainly used for NL estimation
     InputImagePointer m_InitialB1Map;
@@ -209,6 +226,10 @@ private:
     double m_EchoSpacing;
     std::vector <double> m_T2FlipAngles;
     double m_T2ExcitationFlipAngle;
+
+    bool m_UseEPGDictionary;
+    std::string m_EPGDictionaryFileName;
+    anima::EPGDictionary m_EPGDictionary;
 };
     
 } // end namespace anima
@@ -125,6 +125,40 @@ MultiT2RelaxometryEstimationImageFilter <TPixelScalarType>
         for (unsigned int i = 0;i < m_PulseProfile.size();++i)
             m_PulseProfile[i].first *= pulseRatioToProfile;
     }
+
+    if (m_UseEPGDictionary)
+        this->PrepareEPGDictionary();
+}
+
+template <class TPixelScalarType>
+void
+MultiT2RelaxometryEstimationImageFilter <TPixelScalarType>
+::PrepareEPGDictionary()
+{
+    // Flip angles explored are at most the nominal one, scaled by the pulse profile if any
+    double maxProfileValue = 1.0;
+    if (!m_UniformPulses)
+    {
+        for (unsigned int i = 0;i < m_PulseProfile.size();++i)
+            maxProfileValue = std::max(maxProfileValue,m_PulseProfile[i].second);
+    }
+
+    m_EPGDictionary.SetEchoSpacing(m_EchoSpacing);
+    m_EPGDictionary.SetNumberOfEchoes(this->GetNumberOfIndexedInputs());
+    m_EPGDictionary.SetT1Value(m_DefaultT1Value);
+    m_EPGDictionary.SetT2Values(m_T2CompartmentValues);
+    m_EPGDictionary.SetFlipAngleRange(0.0,maxProfileValue * m_T2FlipAngles[0]);
+
+    if (m_EPGDictionaryFileName != "")
+    {
+        if (m_EPGDictionary.Load(m_EPGDictionaryFileName))
+            return;
+    }
+
+    m_EPGDictionary.Build();
+
+    if (m_EPGDictionaryFileName != "")
+        m_EPGDictionary.Save(m_EPGDictionaryFileName);
 }
 
 template <class TPixelScalarType>
@@ -230,6 +264,8 @@ MultiT2RelaxometryEstimationImageFilter <TPixelScalarType>
     typename B1CostFunctionType::Pointer cost = B1CostFunctionType::New();
     cost->SetEchoSpacing(m_EchoSpacing);
     cost->SetExcitationFlipAngle(m_T2ExcitationFlipAngle);
+    if (m_UseEPGDictionary)
+        cost->SetEPGDictionary(&m_EPGDictionary);
 
     unsigned int dimension = cost->GetNumberOfParameters();
     itk::Array<double> lowerBounds(dimension);
@@ -279,7 +315,7 @@ MultiT2RelaxometryEstimationImageFilter <TPixelScalarType>
             continue;
         }
 
-        double t1Value = 1000;
+        double t1Value = m_DefaultT1Value;
         double m0Value = 0.0;
 
         signalValuesExtended.fill(0.0);
@@ -293,7 +329,7 @@ MultiT2RelaxometryEstimationImageFilter <TPixelScalarType>
         {
             t1Value = t1MapItr.Get();
             if (t1Value <= 0.0)
-                t1Value = 1000;
+                t1Value = m_DefaultT1Value;
         }
 
         cost->SetT1Value(t1Value);
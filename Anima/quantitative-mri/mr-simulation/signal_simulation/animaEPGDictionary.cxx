@@ -0,0 +1,194 @@
+#include "animaEPGDictionary.h"
+#include "animaEPGSignalSimulator.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+
+namespace anima
+{
+
+EPGDictionary::EPGDictionary()
+{
+    m_EchoSpacing = 10;
+    m_NumberOfEchoes = 1;
+    m_T1Value = 1000;
+
+    m_MinimalFlipAngle = 0;
+    m_MaximalFlipAngle = M_PI;
+    m_NumberOfFlipAngleSamples = 512;
+    m_FlipAngleStep = 0;
+}
+
+void EPGDictionary::SetFlipAngleRange(double minFlipAngle, double maxFlipAngle)
+{
+    m_MinimalFlipAngle = minFlipAngle;
+    m_MaximalFlipAngle = maxFlipAngle;
+}
+
+void EPGDictionary::Build()
+{
+    if (m_NumberOfFlipAngleSamples < 2)
+        m_NumberOfFlipAngleSamples = 2;
+
+    m_FlipAngleStep = (m_MaximalFlipAngle - m_MinimalFlipAngle) / (m_NumberOfFlipAngleSamples - 1.0);
+
+    unsigned int sampleSize = 2 * m_NumberOfEchoes;
+    m_Table.resize(m_T2Values.size() * m_NumberOfFlipAngleSamples * sampleSize);
+
+    // Excitation flip angle sine and M0 are factored out of the table
+    anima::EPGSignalSimulator epgSimulator;
+    epgSimulator.SetNumberOfEchoes(m_NumberOfEchoes);
+    epgSimulator.SetEchoSpacing(m_EchoSpacing);
+    epgSimulator.SetExcitationFlipAngle(M_PI / 2.0);
+
+    RealVectorType values, faDerivatives;
+    double *tablePtr = m_Table.data();
+    for (unsigned int i = 0;i < m_T2Values.size();++i)
+    {
+        for (unsigned int j = 0;j < m_NumberOfFlipAngleSamples;++j)
+        {
+            double flipAngle = m_MinimalFlipAngle + j * m_FlipAngleStep;
+            epgSimulator.GetValueAndFADerivative(m_T1Value,m_T2Values[i],flipAngle,1.0,values,faDerivatives);
+
+            std::copy(values.begin(),values.end(),tablePtr);
+            std::copy(faDerivatives.begin(),faDerivatives.end(),tablePtr + m_NumberOfEchoes);
+            tablePtr += sampleSize;
+        }
+    }
+}
+
+bool EPGDictionary::Load(const std::string &fileName)
+{
+    std::ifstream inputFile(fileName.c_str(),std::ios::binary);
+    if (!inputFile.is_open())
+        return false;
+
+    char magicString[8];
+    inputFile.read(magicString,8);
+    if ((!inputFile.good())||(std::strncmp(magicString,"ANIMAEPG",8) != 0))
+        return false;
+
+    unsigned int numEchoes, numT2Values, numFlipAngleSamples;
+    double echoSpacing, t1Value, minFlipAngle, maxFlipAngle;
+    inputFile.read((char *) &numEchoes, sizeof(unsigned int));
+    inputFile.read((char *) &numT2Values, sizeof(unsigned int));
+    inputFile.read((char *) &numFlipAngleSamples, sizeof(unsigned int));
+    inputFile.read((char *) &echoSpacing, sizeof(double));
+    inputFile.read((char *) &t1Value, sizeof(double));
+    inputFile.read((char *) &minFlipAngle, sizeof(double));
+    inputFile.read((char *) &maxFlipAngle, sizeof(double));
+
+    if ((!inputFile.good())||(numFlipAngleSamples != m_NumberOfFlipAngleSamples)||
+            (minFlipAngle != m_MinimalFlipAngle)||(maxFlipAngle != m_MaximalFlipAngle)||
+            (numT2Values != m_T2Values.size()))
+        return false;
+
+    RealVectorType t2Values(numT2Values);
+    inputFile.read((char *) t2Values.data(), numT2Values * sizeof(double));
+    if ((!inputFile.good())||(!this->IsCompatible(t1Value,echoSpacing,numEchoes,t2Values)))
+        return false;
+
+    RealVectorType table(numT2Values * numFlipAngleSamples * 2 * numEchoes);
+    inputFile.read((char *) table.data(), table.size() * sizeof(double));
+    if (!inputFile.good())
+        return false;
+
+    m_Table.swap(table);
+    m_FlipAngleStep = (m_MaximalFlipAngle - m_MinimalFlipAngle) / (m_NumberOfFlipAngleSamples - 1.0);
+
+    return true;
+}
+
+bool EPGDictionary::Save(const std::string &fileName) const
+{
+    std::ofstream outputFile(fileName.c_str(),std::ios::binary);
+    if (!outputFile.is_open())
+        return false;
+
+    unsigned int numT2Values = m_T2Values.size();
+
+    outputFile.write("ANIMAEPG",8);
+    outputFile.write((char *) &m_NumberOfEchoes, sizeof(unsigned int));
+    outputFile.write((char *) &numT2Values, sizeof(unsigned int));
+    outputFile.write((char *) &m_NumberOfFlipAngleSamples, sizeof(unsigned int));
+    outputFile.write((char *) &m_EchoSpacing, sizeof(double));
+    outputFile.write((char *) &m_T1Value, sizeof(double));
+    outputFile.write((char *) &m_MinimalFlipAngle, sizeof(double));
+    outputFile.write((char *) &m_MaximalFlipAngle, sizeof(double));
+    outputFile.write((char *) m_T2Values.data(), numT2Values * sizeof(double));
+    outputFile.write((char *) m_Table.data(), m_Table.size() * sizeof(double));
+
+    return outputFile.good();
+}
+
+bool EPGDictionary::IsCompatible(double t1Value, double echoSpacing, unsigned int numEchoes,
+                                 const RealVectorType &t2Values) const
+{
+    if ((t1Value != m_T1Value)||(echoSpacing != m_EchoSpacing)||(numEchoes != m_NumberOfEchoes))
+        return false;
+
+    return (t2Values == m_T2Values);
+}
+
+bool EPGDictionary::IsFlipAngleInside(double flipAngle) const
+{
+    return (flipAngle >= m_MinimalFlipAngle)&&(flipAngle <= m_MaximalFlipAngle);
+}
+
+inline const double *EPGDictionary::GetSamplesAndPosition(unsigned int t2Index, double flipAngle, double &position) const
+{
+    double continuousIndex = (flipAngle - m_MinimalFlipAngle) / m_FlipAngleStep;
+    unsigned int baseIndex = 0;
+    if (continuousIndex > 0)
+        baseIndex = std::min(static_cast <unsigned int> (continuousIndex), m_NumberOfFlipAngleSamples - 2);
+
+    position = continuousIndex - baseIndex;
+
+    return m_Table.data() + (t2Index * m_NumberOfFlipAngleSamples + baseIndex) * 2 * m_NumberOfEchoes;
+}
+
+void EPGDictionary::GetValue(unsigned int t2Index, double flipAngle, double scale, double *values) const
+{
+    double t;
+    const double *lowerSample = this->GetSamplesAndPosition(t2Index,flipAngle,t);
+    const double *upperSample = lowerSample + 2 * m_NumberOfEchoes;
+
+    // Cubic Hermite basis, derivative terms scaled by the sample step
+    double t2 = t * t;
+    double t3 = t2 * t;
+    double lowerValueWeight = scale * (2.0 * t3 - 3.0 * t2 + 1.0);
+    double lowerDerivativeWeight = scale * m_FlipAngleStep * (t3 - 2.0 * t2 + t);
+    double upperValueWeight = scale * (3.0 * t2 - 2.0 * t3);
+    double upperDerivativeWeight = scale * m_FlipAngleStep * (t3 - t2);
+
+    for (unsigned int i = 0;i < m_NumberOfEchoes;++i)
+    {
+        values[i] = lowerValueWeight * lowerSample[i] + lowerDerivativeWeight * lowerSample[m_NumberOfEchoes + i]
+                + upperValueWeight * upperSample[i] + upperDerivativeWeight * upperSample[m_NumberOfEchoes + i];
+    }
+}
+
+void EPGDictionary::GetValueAndFADerivative(unsigned int t2Index, double flipAngle, double scale,
+                                            double *values, double *faDerivatives) const
+{
+    this->GetValue(t2Index,flipAngle,scale,values);
+
+    double t;
+    const double *lowerSample = this->GetSamplesAndPosition(t2Index,flipAngle,t);
+    const double *upperSample = lowerSample + 2 * m_NumberOfEchoes;
+
+    double t2 = t * t;
+    double valueWeight = scale * (6.0 * t2 - 6.0 * t) / m_FlipAngleStep;
+    double lowerDerivativeWeight = scale * (3.0 * t2 - 4.0 * t + 1.0);
+    double upperDerivativeWeight = scale * (3.0 * t2 - 2.0 * t);
+
+    for (unsigned int i = 0;i < m_NumberOfEchoes;++i)
+    {
+        faDerivatives[i] = valueWeight * (lowerSample[i] - upperSample[i]) + lowerDerivativeWeight * lowerSample[m_NumberOfEchoes + i]
+                + upperDerivativeWeight * upperSample[m_NumberOfEchoes + i];
+    }
+}
+
+} // end namespace anima
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "AnimaSignalSimulationExport.h"
+
+namespace anima
+{
+
+/**
+ * @brief Precomputed EPG echo trains over a grid of T2 values and refocusing flip angles, for a given acquisition
+ * (echo spacing, number of echoes) and T1 value. Echo trains and their flip angle derivatives are stored in a single
+ * contiguous table, with M0 and the sine of the excitation flip angle factored out. Lookups at arbitrary flip angles
+ * use cubic Hermite interpolation from the stored values and derivatives. The table may be cached to disk.
+ * Once built, the dictionary is read only and may be shared between threads.
+ */
+class ANIMASIGNALSIMULATION_EXPORT EPGDictionary
+{
+public:
+    EPGDictionary();
+    virtual ~EPGDictionary() {}
+
+    typedef std::vector <double> RealVectorType;
+
+    void SetEchoSpacing(double val) {m_EchoSpacing = val;}
+    void SetNumberOfEchoes(unsigned int val) {m_NumberOfEchoes = val;}
+    void SetT1Value(double val) {m_T1Value = val;}
+    void SetT2Values(const RealVectorType &values) {m_T2Values = values;}
+    void SetFlipAngleRange(double minFlipAngle, double maxFlipAngle);
+    void SetNumberOfFlipAngleSamples(unsigned int val) {m_NumberOfFlipAngleSamples = val;}
+
+    unsigned int GetNumberOfEchoes() const {return m_NumberOfEchoes;}
+    const RealVectorType &GetT2Values() const {return m_T2Values;}
+    bool IsBuilt() const {return m_Table.size() != 0;}
+
+    //! Computes the table for all (T2, flip angle) grid points
+    void Build();
+
+    /**
+     * Loads the table from disk. Returns false, leaving the dictionary untouched, if the file
+     * cannot be read or was built with different parameters than those currently set
+     */
+    bool Load(const std::string &fileName);
+
+    //! Saves the table to disk, returns false if the file cannot be written
+    bool Save(const std::string &fileName) const;
+
+    //! Checks if the dictionary was built for the given acquisition and T1 / T2 values
+    bool IsCompatible(double t1Value, double echoSpacing, unsigned int numEchoes, const RealVectorType &t2Values) const;
+    bool IsFlipAngleInside(double flipAngle) const;
+
+    /**
+     * Interpolated echo train for the T2 value of index t2Index and the given flip angle (which has to be
+     * inside the flip angle range), multiplied by scale (M0 times sine of the excitation flip angle)
+     */
+    void GetValue(unsigned int t2Index, double flipAngle, double scale, double *values) const;
+
+    //! Same as GetValue, also providing the flip angle derivatives of the echo train
+    void GetValueAndFADerivative(unsigned int t2Index, double flipAngle, double scale,
+                                 double *values, double *faDerivatives) const;
+
+protected:
+    //! Locates the flip angle sample interval and returns the normalized position in it
+    inline const double *GetSamplesAndPosition(unsigned int t2Index, double flipAngle, double &position) const;
+
+private:
+    double m_EchoSpacing;
+    unsigned int m_NumberOfEchoes;
+    double m_T1Value;
+    RealVectorType m_T2Values;
+
+    double m_MinimalFlipAngle, m_MaximalFlipAngle;
+    unsigned int m_NumberOfFlipAngleSamples;
+    double m_FlipAngleStep;
+
+    //! Table: for each T2 then each flip angle sample, N echo values followed by their N flip angle derivatives
+    RealVectorType m_Table;
+};
+
+} // end namespace anima
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <algorithm>
 
 #include <iostream>
 #include "animaEPGSignalSimulator.h"
@@ -11,220 +12,268 @@ EPGSignalSimulator::EPGSignalSimulator()
     m_NumberOfEchoes = 1;
     m_EchoSpacing = 10;
     m_ExcitationFlipAngle = M_PI / 2.0;
+    m_BaseValue = 0.0;
 }
 
 EPGSignalSimulator::RealVectorType &EPGSignalSimulator::GetValue(double t1Value, double t2Value,
                                                                  double flipAngle, double m0Value)
 {
-    m_SimulatedT2Values.set_size(m_NumberOfEchoes + 1,3 * m_NumberOfEchoes + 1);
-    m_SimulatedT2Values.fill(0.0);
-    m_OutputVector.resize(m_NumberOfEchoes);
+    this->ComputeT2SignalMatrixElements(t1Value,t2Value,flipAngle);
+    m_BaseValue = m0Value * std::sin(m_ExcitationFlipAngle);
 
+    this->RunEPGRecursion();
+
+    return m_OutputVector;
+}
+
+EPGSignalSimulator::RealVectorType &EPGSignalSimulator::GetFADerivative()
+{
+    // Reuses the states stored by the last GetValue call
+    this->RunEPGDerivativeRecursion();
+
+    return m_OutputB1Derivative;
+}
+
+void EPGSignalSimulator::GetValueAndFADerivative(double t1Value, double t2Value, double flipAngle, double m0Value,
+                                                 RealVectorType &values, RealVectorType &faDerivatives)
+{
     this->ComputeT2SignalMatrixElements(t1Value,t2Value,flipAngle);
+    m_BaseValue = m0Value * std::sin(m_ExcitationFlipAngle);
 
-    double baseValue = m0Value * std::sin(m_ExcitationFlipAngle);
-    m_SimulatedT2Values(0,0) = baseValue;
+    this->RunEPGRecursion();
+    this->RunEPGDerivativeRecursion();
+
+    values = m_OutputVector;
+    faDerivatives = m_OutputB1Derivative;
+}
+
+unsigned int EPGSignalSimulator::GetMaximalOrder(unsigned int echo)
+{
+    // Orders above 2i + 1 are still zero after i + 1 refocusing pulses, and those above
+    // 2(N - i) - 1 cannot reach the echo signal anymore in the remaining pulses
+    unsigned int maxOrder = std::min(2 * echo + 1, m_NumberOfEchoes - 1);
+    return std::min(maxOrder, 2 * (m_NumberOfEchoes - echo) - 1);
+}
+
+void EPGSignalSimulator::RunEPGRecursion()
+{
+    unsigned int numStates = 3 * m_NumberOfEchoes + 1;
+    m_OutputVector.resize(m_NumberOfEchoes);
+
+    m_EPGStates.assign((m_NumberOfEchoes + 1) * numStates,0.0);
+    m_EPGStates[0] = m_BaseValue;
 
     // Loop on all signals to be generated
     for (unsigned int i = 0;i < m_NumberOfEchoes;++i)
     {
+        const double *currentStates = m_EPGStates.data() + i * numStates;
+        double *nextStates = m_EPGStates.data() + (i + 1) * numStates;
+
+        unsigned int maxOrder = this->GetMaximalOrder(i);
+
         // First line
-        m_SimulatedT2Values(i+1,0) = m_FirstEPGProduct * m_SimulatedT2Values(i,0) - m_SecondEPGProduct * m_SimulatedT2Values(i,3);
+        nextStates[0] = m_FirstEPGProduct * currentStates[0] - m_SecondEPGProduct * currentStates[3];
         if (m_NumberOfEchoes > 1)
-            m_SimulatedT2Values(i+1,0) += m_ThirdEPGProduct * m_SimulatedT2Values(i,5);
+            nextStates[0] += m_ThirdEPGProduct * currentStates[5];
 
         // First block
-        m_SimulatedT2Values(i+1,1) = m_FourthEPGProduct * m_SimulatedT2Values(i,2);
-        m_SimulatedT2Values(i+1,2) = m_FirstEPGProduct * m_SimulatedT2Values(i,1);
-        m_SimulatedT2Values(i+1,3) = m_FifthEPGProduct * m_SimulatedT2Values(i,3) - m_SecondEPGProduct * m_SimulatedT2Values(i,0) / 2.0;
+        nextStates[1] = m_FourthEPGProduct * currentStates[2];
+        nextStates[2] = m_FirstEPGProduct * currentStates[1];
+        nextStates[3] = m_FifthEPGProduct * currentStates[3] - m_SecondEPGProduct * currentStates[0] / 2.0;
 
         if (m_NumberOfEchoes > 1)
         {
-            m_SimulatedT2Values(i+1,2) -= m_SecondEPGProduct * m_SimulatedT2Values(i,6);
-            m_SimulatedT2Values(i+1,3) += m_SecondEPGProduct * m_SimulatedT2Values(i,5) / 2.0;
+            nextStates[2] -= m_SecondEPGProduct * currentStates[6];
+            nextStates[3] += m_SecondEPGProduct * currentStates[5] / 2.0;
 
             if (m_NumberOfEchoes > 2)
-                m_SimulatedT2Values(i+1,2) += m_ThirdEPGProduct * m_SimulatedT2Values(i,8);
+                nextStates[2] += m_ThirdEPGProduct * currentStates[8];
         }
 
         //other blocks
-        unsigned int j;
-        for (j = 1;j < m_NumberOfEchoes;++j)
+        for (unsigned int j = 1;j <= maxOrder;++j)
         {
-            m_SimulatedT2Values(i+1,1 + j * 3) = m_SecondEPGProduct * m_SimulatedT2Values(i,3 + (j - 1) * 3) + m_FirstEPGProduct * m_SimulatedT2Values(i,2 + j * 3);
+            nextStates[1 + j * 3] = m_SecondEPGProduct * currentStates[3 + (j - 1) * 3] + m_FirstEPGProduct * currentStates[2 + j * 3];
             if (j > 1)
-                m_SimulatedT2Values(i+1,1 + j * 3) += m_ThirdEPGProduct * m_SimulatedT2Values(i,1 + (j - 2) * 3);
+                nextStates[1 + j * 3] += m_ThirdEPGProduct * currentStates[1 + (j - 2) * 3];
             else
-                m_SimulatedT2Values(i+1,1 + j * 3) += m_ThirdEPGProduct * m_SimulatedT2Values(i,0);
-
-            m_SimulatedT2Values(i+1,2 + j * 3) = 0.0;
-            if (j < m_NumberOfEchoes)
-                m_SimulatedT2Values(i+1,2 + j * 3) = m_FirstEPGProduct * m_SimulatedT2Values(i,1 + j * 3);
+                nextStates[1 + j * 3] += m_ThirdEPGProduct * currentStates[0];
 
-            m_SimulatedT2Values(i+1,3 + j * 3) = m_FifthEPGProduct * m_SimulatedT2Values(i,3 + j * 3) - m_SecondEPGProduct * m_SimulatedT2Values(i,1 + (j - 1) * 3) / 2.0;
+            nextStates[2 + j * 3] = m_FirstEPGProduct * currentStates[1 + j * 3];
+            nextStates[3 + j * 3] = m_FifthEPGProduct * currentStates[3 + j * 3] - m_SecondEPGProduct * currentStates[1 + (j - 1) * 3] / 2.0;
 
             if ((j + 1) < m_NumberOfEchoes)
             {
-                m_SimulatedT2Values(i+1,2 + j * 3) -= m_SecondEPGProduct * m_SimulatedT2Values(i,3 + (j + 1) * 3);
-                m_SimulatedT2Values(i+1,3 + j * 3) += m_SecondEPGProduct * m_SimulatedT2Values(i,2 + (j + 1) * 3) / 2.0;
+                nextStates[2 + j * 3] -= m_SecondEPGProduct * currentStates[3 + (j + 1) * 3];
+                nextStates[3 + j * 3] += m_SecondEPGProduct * currentStates[2 + (j + 1) * 3] / 2.0;
 
                 if ((j + 2) < m_NumberOfEchoes)
-                    m_SimulatedT2Values(i+1,2 + j * 3) += m_ThirdEPGProduct * m_SimulatedT2Values(i,2 + (j + 2) * 3);
+                    nextStates[2 + j * 3] += m_ThirdEPGProduct * currentStates[2 + (j + 2) * 3];
             }
         }
 
-        m_OutputVector[i] = m_SimulatedT2Values(i+1,0);
+        m_OutputVector[i] = nextStates[0];
     }
-
-    return m_OutputVector;
-}
-
-void EPGSignalSimulator::ComputeT2SignalMatrixElements(double t1Value, double t2Value,
-                                                       double flipAngle)
-{
-    double espT2Value = 0.0;
-    if (t2Value != 0.0)
-        espT2Value = std::exp(- m_EchoSpacing / (2 * t2Value));
-
-    double espT1Value = 0.0;
-    if (t1Value != 0.0)
-        espT1Value = std::exp(- m_EchoSpacing / (2 * t1Value));
-
-    double cosB1alpha = std::cos(flipAngle);
-    double cosB1alpha2 = std::cos(flipAngle / 2.0);
-    double sinB1alpha = std::sin(flipAngle);
-    double sinB1alpha2 = std::sin(flipAngle / 2.0);
-
-    m_FirstEPGProduct = sinB1alpha2 * sinB1alpha2 * espT2Value * espT2Value;
-    m_SecondEPGProduct = sinB1alpha * espT1Value * espT2Value;
-    m_ThirdEPGProduct = cosB1alpha2 * cosB1alpha2 * espT2Value * espT2Value;
-    m_FourthEPGProduct = espT2Value * espT2Value;
-    m_FifthEPGProduct = cosB1alpha * espT1Value * espT1Value;
-
-    m_FirstDerivativeProduct = cosB1alpha2 * sinB1alpha2 * espT2Value * espT2Value;
-    m_SecondDerivativeProduct = cosB1alpha * espT1Value * espT2Value;
-    m_ThirdDerivativeProduct = - sinB1alpha * espT1Value * espT1Value;
 }
 
-EPGSignalSimulator::RealVectorType &EPGSignalSimulator::GetFADerivative()
+void EPGSignalSimulator::RunEPGDerivativeRecursion()
 {
+    unsigned int numStates = 3 * m_NumberOfEchoes + 1;
     m_OutputB1Derivative.resize(m_NumberOfEchoes);
+    for (unsigned int i = 0;i < 2;++i)
+        m_EPGDerivativeStates[i].assign(numStates,0.0);
 
-    m_SimulatedDerivativeT2Values.set_size(m_NumberOfEchoes + 1,3 * m_NumberOfEchoes + 1);
-    m_SimulatedDerivativeT2Values.fill(0.0);
-
-    // Loop on all signals to be generated
     for (unsigned int i = 0;i < m_NumberOfEchoes;++i)
     {
+        const double *currentStates = m_EPGStates.data() + i * numStates;
+        unsigned int maxOrder = this->GetMaximalOrder(i);
+
+        const double *currentDerivatives = m_EPGDerivativeStates[i % 2].data();
+        double *nextDerivatives = m_EPGDerivativeStates[(i + 1) % 2].data();
+
         // Start by doing dE * simulatedValues
         // First line
-        m_SimulatedDerivativeT2Values(i+1,0) = m_FirstDerivativeProduct * m_SimulatedT2Values(i,0) - m_SecondDerivativeProduct * m_SimulatedT2Values(i,3);
+        nextDerivatives[0] = m_FirstDerivativeProduct * currentStates[0] - m_SecondDerivativeProduct * currentStates[3];
 
         // First block
-        m_SimulatedDerivativeT2Values(i+1,1) = 0.0;
-        m_SimulatedDerivativeT2Values(i+1,2) = m_FirstDerivativeProduct * m_SimulatedT2Values(i,1);
-        m_SimulatedDerivativeT2Values(i+1,3) = m_ThirdDerivativeProduct * m_SimulatedT2Values(i,3) - m_SecondDerivativeProduct * m_SimulatedT2Values(i,0) / 2.0;
+        nextDerivatives[1] = 0.0;
+        nextDerivatives[2] = m_FirstDerivativeProduct * currentStates[1];
+        nextDerivatives[3] = m_ThirdDerivativeProduct * currentStates[3] - m_SecondDerivativeProduct * currentStates[0] / 2.0;
 
         if (m_NumberOfEchoes > 1)
         {
-            m_SimulatedDerivativeT2Values(i+1,0) -= m_FirstDerivativeProduct * m_SimulatedT2Values(i,5);
-            m_SimulatedDerivativeT2Values(i+1,2) -= m_SecondDerivativeProduct * m_SimulatedT2Values(i,6);
+            nextDerivatives[0] -= m_FirstDerivativeProduct * currentStates[5];
+            nextDerivatives[2] -= m_SecondDerivativeProduct * currentStates[6];
 
             if (m_NumberOfEchoes > 2)
-                m_SimulatedDerivativeT2Values(i+1,2) -= m_FirstDerivativeProduct * m_SimulatedT2Values(i,8);
+                nextDerivatives[2] -= m_FirstDerivativeProduct * currentStates[8];
 
-            m_SimulatedDerivativeT2Values(i+1,3) += m_SecondDerivativeProduct * m_SimulatedT2Values(i,5) / 2.0;
+            nextDerivatives[3] += m_SecondDerivativeProduct * currentStates[5] / 2.0;
         }
 
         //center blocks
-        unsigned int j;
-        for (j = 1;j < m_NumberOfEchoes - 1;++j)
+        unsigned int maxCenterOrder = std::min(maxOrder, m_NumberOfEchoes - 2);
+        if (m_NumberOfEchoes < 2)
+            maxCenterOrder = 0;
+
+        for (unsigned int j = 1;j <= maxCenterOrder;++j)
         {
-            m_SimulatedDerivativeT2Values(i+1,1 + j * 3) = m_SecondDerivativeProduct * m_SimulatedT2Values(i,3 + (j - 1) * 3) + m_FirstDerivativeProduct * m_SimulatedT2Values(i,2 + j * 3);
+            nextDerivatives[1 + j * 3] = m_SecondDerivativeProduct * currentStates[3 + (j - 1) * 3] + m_FirstDerivativeProduct * currentStates[2 + j * 3];
             if (j > 1)
-                m_SimulatedDerivativeT2Values(i+1,1 + j * 3) -= m_FirstDerivativeProduct * m_SimulatedT2Values(i,1 + (j - 2) * 3);
+                nextDerivatives[1 + j * 3] -= m_FirstDerivativeProduct * currentStates[1 + (j - 2) * 3];
             else
-                m_SimulatedDerivativeT2Values(i+1,1 + j * 3) -= m_FirstDerivativeProduct * m_SimulatedT2Values(i,0);
+                nextDerivatives[1 + j * 3] -= m_FirstDerivativeProduct * currentStates[0];
 
-            m_SimulatedDerivativeT2Values(i+1,2 + j * 3) = m_FirstDerivativeProduct * m_SimulatedT2Values(i,1 + j * 3);
-            m_SimulatedDerivativeT2Values(i+1,3 + j * 3) = m_ThirdDerivativeProduct * m_SimulatedT2Values(i,3 + j * 3) - m_SecondDerivativeProduct * m_SimulatedT2Values(i,1 + (j - 1) * 3) / 2.0;
+            nextDerivatives[2 + j * 3] = m_FirstDerivativeProduct * currentStates[1 + j * 3];
+            nextDerivatives[3 + j * 3] = m_ThirdDerivativeProduct * currentStates[3 + j * 3] - m_SecondDerivativeProduct * currentStates[1 + (j - 1) * 3] / 2.0;
 
             if ((j + 1) < m_NumberOfEchoes)
             {
-                m_SimulatedDerivativeT2Values(i+1,2 + j * 3) -= m_SecondDerivativeProduct * m_SimulatedT2Values(i,3 + (j + 1) * 3);
-                m_SimulatedDerivativeT2Values(i+1,3 + j * 3) += m_SecondDerivativeProduct * m_SimulatedT2Values(i,2 + (j + 1) * 3) / 2.0;
+                nextDerivatives[2 + j * 3] -= m_SecondDerivativeProduct * currentStates[3 + (j + 1) * 3];
+                nextDerivatives[3 + j * 3] += m_SecondDerivativeProduct * currentStates[2 + (j + 1) * 3] / 2.0;
 
                 if ((j + 2) < m_NumberOfEchoes)
-                    m_SimulatedDerivativeT2Values(i+1,2 + j * 3) -= m_FirstDerivativeProduct * m_SimulatedT2Values(i,2 + (j + 2) * 3);
+                    nextDerivatives[2 + j * 3] -= m_FirstDerivativeProduct * currentStates[2 + (j + 2) * 3];
             }
         }
 
-        // end block line
-        j = m_NumberOfEchoes - 1;
-        m_SimulatedDerivativeT2Values(i+1,1 + j * 3) = m_SecondDerivativeProduct * m_SimulatedT2Values(i,3 + (j - 1) * 3) + m_FirstDerivativeProduct * m_SimulatedT2Values(i,2 + j * 3);
-        if (j > 1)
-            m_SimulatedDerivativeT2Values(i+1,1 + j * 3) -= m_FirstDerivativeProduct * m_SimulatedT2Values(i,1 + (j - 2) * 3);
-        else
-            m_SimulatedDerivativeT2Values(i+1,1 + j * 3) -= m_FirstDerivativeProduct * m_SimulatedT2Values(i,0);
+        // end block line, only when it may be non zero
+        unsigned int j = m_NumberOfEchoes - 1;
+        bool computeEndBlock = (j >= 1) && (j <= maxOrder);
+        if (computeEndBlock)
+        {
+            nextDerivatives[1 + j * 3] = m_SecondDerivativeProduct * currentStates[3 + (j - 1) * 3] + m_FirstDerivativeProduct * currentStates[2 + j * 3];
+            if (j > 1)
+                nextDerivatives[1 + j * 3] -= m_FirstDerivativeProduct * currentStates[1 + (j - 2) * 3];
+            else
+                nextDerivatives[1 + j * 3] -= m_FirstDerivativeProduct * currentStates[0];
 
-        m_SimulatedDerivativeT2Values(i+1,2 + j * 3) = 0.0;
-        m_SimulatedDerivativeT2Values(i+1,3 + j * 3) = m_ThirdDerivativeProduct * m_SimulatedT2Values(i,3 + j * 3) - m_SecondDerivativeProduct * m_SimulatedT2Values(i,1 + (j - 1) * 3) / 2.0;
+            nextDerivatives[2 + j * 3] = 0.0;
+            nextDerivatives[3 + j * 3] = m_ThirdDerivativeProduct * currentStates[3 + j * 3] - m_SecondDerivativeProduct * currentStates[1 + (j - 1) * 3] / 2.0;
+        }
 
         // Now adding E * simulatedDerivative[i]
         // First line
-        m_SimulatedDerivativeT2Values(i+1,0) += m_FirstEPGProduct * m_SimulatedDerivativeT2Values(i,0) - m_SecondEPGProduct * m_SimulatedDerivativeT2Values(i,3);
+        nextDerivatives[0] += m_FirstEPGProduct * currentDerivatives[0] - m_SecondEPGProduct * currentDerivatives[3];
         if (m_NumberOfEchoes > 1)
-            m_SimulatedDerivativeT2Values(i+1,0) += m_ThirdEPGProduct * m_SimulatedDerivativeT2Values(i,5);
+            nextDerivatives[0] += m_ThirdEPGProduct * currentDerivatives[5];
 
         // First block
-        m_SimulatedDerivativeT2Values(i+1,1) += m_FourthEPGProduct * m_SimulatedDerivativeT2Values(i,2);
-        m_SimulatedDerivativeT2Values(i+1,2) += m_FirstEPGProduct * m_SimulatedDerivativeT2Values(i,1);
-        m_SimulatedDerivativeT2Values(i+1,3) += m_FifthEPGProduct * m_SimulatedDerivativeT2Values(i,3) - m_SecondEPGProduct * m_SimulatedDerivativeT2Values(i,0) / 2.0;
+        nextDerivatives[1] += m_FourthEPGProduct * currentDerivatives[2];
+        nextDerivatives[2] += m_FirstEPGProduct * currentDerivatives[1];
+        nextDerivatives[3] += m_FifthEPGProduct * currentDerivatives[3] - m_SecondEPGProduct * currentDerivatives[0] / 2.0;
         if (m_NumberOfEchoes > 1)
         {
-            m_SimulatedDerivativeT2Values(i+1,2) -= m_SecondEPGProduct * m_SimulatedDerivativeT2Values(i,6);
-            m_SimulatedDerivativeT2Values(i+1,3) += m_SecondEPGProduct * m_SimulatedDerivativeT2Values(i,5) / 2.0;
+            nextDerivatives[2] -= m_SecondEPGProduct * currentDerivatives[6];
+            nextDerivatives[3] += m_SecondEPGProduct * currentDerivatives[5] / 2.0;
 
             if (m_NumberOfEchoes > 2)
-                m_SimulatedDerivativeT2Values(i+1,2) += m_ThirdEPGProduct * m_SimulatedDerivativeT2Values(i,8);
+                nextDerivatives[2] += m_ThirdEPGProduct * currentDerivatives[8];
         }
 
         //center blocks
-        for (j = 1;j < m_NumberOfEchoes - 1;++j)
+        for (unsigned int j = 1;j <= maxCenterOrder;++j)
         {
-            m_SimulatedDerivativeT2Values(i+1,1 + j * 3) += m_SecondEPGProduct * m_SimulatedDerivativeT2Values(i,3 + (j - 1) * 3) + m_FirstEPGProduct * m_SimulatedDerivativeT2Values(i,2 + j * 3);
+            nextDerivatives[1 + j * 3] += m_SecondEPGProduct * currentDerivatives[3 + (j - 1) * 3] + m_FirstEPGProduct * currentDerivatives[2 + j * 3];
             if (j > 1)
-                m_SimulatedDerivativeT2Values(i+1,1 + j * 3) += m_ThirdEPGProduct * m_SimulatedDerivativeT2Values(i,1 + (j - 2) * 3);
+                nextDerivatives[1 + j * 3] += m_ThirdEPGProduct * currentDerivatives[1 + (j - 2) * 3];
             else
-                m_SimulatedDerivativeT2Values(i+1,1 + j * 3) += m_ThirdEPGProduct * m_SimulatedDerivativeT2Values(i,0);
+                nextDerivatives[1 + j * 3] += m_ThirdEPGProduct * currentDerivatives[0];
 
-            m_SimulatedDerivativeT2Values(i+1,2 + j * 3) += m_FirstEPGProduct * m_SimulatedDerivativeT2Values(i,1 + j * 3);
-            m_SimulatedDerivativeT2Values(i+1,3 + j * 3) += m_FifthEPGProduct * m_SimulatedDerivativeT2Values(i,3 + j * 3) - m_SecondEPGProduct * m_SimulatedDerivativeT2Values(i,1 + (j - 1) * 3) / 2.0;
+            nextDerivatives[2 + j * 3] += m_FirstEPGProduct * currentDerivatives[1 + j * 3];
+            nextDerivatives[3 + j * 3] += m_FifthEPGProduct * currentDerivatives[3 + j * 3] - m_SecondEPGProduct * currentDerivatives[1 + (j - 1) * 3] / 2.0;
 
             if ((j + 1) < m_NumberOfEchoes)
             {
-                m_SimulatedDerivativeT2Values(i+1,2 + j * 3) -= m_SecondEPGProduct * m_SimulatedDerivativeT2Values(i,3 + (j + 1) * 3);
-                m_SimulatedDerivativeT2Values(i+1,3 + j * 3) += m_SecondEPGProduct * m_SimulatedDerivativeT2Values(i,2 + (j + 1) * 3) / 2.0;
+                nextDerivatives[2 + j * 3] -= m_SecondEPGProduct * currentDerivatives[3 + (j + 1) * 3];
+                nextDerivatives[3 + j * 3] += m_SecondEPGProduct * currentDerivatives[2 + (j + 1) * 3] / 2.0;
 
                 if ((j + 2) < m_NumberOfEchoes)
-                    m_SimulatedDerivativeT2Values(i+1,2 + j * 3) += m_ThirdEPGProduct * m_SimulatedDerivativeT2Values(i,2 + (j + 2) * 3);
+                    nextDerivatives[2 + j * 3] += m_ThirdEPGProduct * currentDerivatives[2 + (j + 2) * 3];
             }
         }
 
         // end block line
-        j = m_NumberOfEchoes - 1;
-        m_SimulatedDerivativeT2Values(i+1,1 + j * 3) += m_SecondEPGProduct * m_SimulatedDerivativeT2Values(i,3 + (j - 1) * 3) + m_FirstEPGProduct * m_SimulatedDerivativeT2Values(i,2 + j * 3);
-        m_SimulatedDerivativeT2Values(i+1,3 + j * 3) += m_FifthEPGProduct * m_SimulatedDerivativeT2Values(i,3 + j * 3) - m_SecondEPGProduct * m_SimulatedDerivativeT2Values(i,1 + (j - 1) * 3) / 2.0;
+        if (computeEndBlock)
+        {
+            nextDerivatives[1 + j * 3] += m_SecondEPGProduct * currentDerivatives[3 + (j - 1) * 3] + m_FirstEPGProduct * currentDerivatives[2 + j * 3];
+            nextDerivatives[3 + j * 3] += m_FifthEPGProduct * currentDerivatives[3 + j * 3] - m_SecondEPGProduct * currentDerivatives[1 + (j - 1) * 3] / 2.0;
 
-        if (j > 1)
-            m_SimulatedDerivativeT2Values(i+1,1 + j * 3) += m_ThirdEPGProduct * m_SimulatedDerivativeT2Values(i,1 + (j - 2) * 3);
-        else
-            m_SimulatedDerivativeT2Values(i+1,1 + j * 3) += m_ThirdEPGProduct * m_SimulatedDerivativeT2Values(i,0);
+            if (j > 1)
+                nextDerivatives[1 + j * 3] += m_ThirdEPGProduct * currentDerivatives[1 + (j - 2) * 3];
+            else
+                nextDerivatives[1 + j * 3] += m_ThirdEPGProduct * currentDerivatives[0];
+        }
 
-        m_OutputB1Derivative[i] = m_SimulatedDerivativeT2Values(i+1,0);
+        m_OutputB1Derivative[i] = nextDerivatives[0];
     }
+}
 
-    return m_OutputB1Derivative;
+void EPGSignalSimulator::ComputeT2SignalMatrixElements(double t1Value, double t2Value,
+                                                       double flipAngle)
+{
+    double espT2Value = 0.0;
+    if (t2Value != 0.0)
+        espT2Value = std::exp(- m_EchoSpacing / (2 * t2Value));
+
+    double espT1Value = 0.0;
+    if (t1Value != 0.0)
+        espT1Value = std::exp(- m_EchoSpacing / (2 * t1Value));
+
+    double cosB1alpha = std::cos(flipAngle);
+    double cosB1alpha2 = std::cos(flipAngle / 2.0);
+    double sinB1alpha = std::sin(flipAngle);
+    double sinB1alpha2 = std::sin(flipAngle / 2.0);
+
+    m_FirstEPGProduct = sinB1alpha2 * sinB1alpha2 * espT2Value * espT2Value;
+    m_SecondEPGProduct = sinB1alpha * espT1Value * espT2Value;
+    m_ThirdEPGProduct = cosB1alpha2 * cosB1alpha2 * espT2Value * espT2Value;
+    m_FourthEPGProduct = espT2Value * espT2Value;
+    m_FifthEPGProduct = cosB1alpha * espT1Value * espT1Value;
+
+    m_FirstDerivativeProduct = cosB1alpha2 * sinB1alpha2 * espT2Value * espT2Value;
+    m_SecondDerivativeProduct = cosB1alpha * espT1Value * espT2Value;
+    m_ThirdDerivativeProduct = - sinB1alpha * espT1Value * espT1Value;
 }
-    
+
 } // end of namespace anima
@@ -1,13 +1,17 @@
 #pragma once
 
 #include <vector>
-#include <vnl/vnl_matrix.h>
 
 #include "AnimaSignalSimulationExport.h"
 
 namespace anima
 {
     
+/**
+ * @brief Extended phase graph simulation of multi spin echo T2 relaxometry signals.
+ * EPG states are kept for all echoes (O(N^2) memory for N echoes) so that flip angle derivatives
+ * reuse them, and only the configuration orders that may be non zero at a given echo are updated
+ */
 class ANIMASIGNALSIMULATION_EXPORT EPGSignalSimulator
 {
 public:
@@ -20,9 +24,17 @@ public:
     RealVectorType &GetValue(double t1Value, double t2Value,
                              double flipAngle, double m0Value);
 
-    //! Get EPG derivative values at same point that was used for getting EPG values. Requires a run of GetValue first
+    //! Get EPG derivative values at same point that was used for getting EPG values. Requires a run of GetValue first,
+    //! whose EPG states are reused
     RealVectorType &GetFADerivative();
 
+    //! Get EPG values and their flip angle derivatives at given point in a single pass
+    void GetValueAndFADerivative(double t1Value, double t2Value, double flipAngle, double m0Value,
+                                 RealVectorType &values, RealVectorType &faDerivatives);
+
+    double GetEchoSpacing() {return m_EchoSpacing;}
+    unsigned int GetNumberOfEchoes() {return m_NumberOfEchoes;}
+
     void SetEchoSpacing(double val) {m_EchoSpacing = val;}
     void SetExcitationFlipAngle(double val) {m_ExcitationFlipAngle = val;}
     double GetExcitationFlipAngle() {return m_ExcitationFlipAngle;}
@@ -32,6 +44,15 @@ public:
 protected:
     void ComputeT2SignalMatrixElements(double t1Value, double t2Value, double flipAngle);
 
+    //! Runs the EPG recursion from the last computed matrix elements, storing the states at each echo
+    void RunEPGRecursion();
+
+    //! Runs the flip angle derivative recursion from the states stored by the last EPG recursion
+    void RunEPGDerivativeRecursion();
+
+    //! Highest configuration order that may be non zero and still reach the signal, after the given echo
+    unsigned int GetMaximalOrder(unsigned int echo);
+
 private:
     double m_EchoSpacing;
     double m_ExcitationFlipAngle;
@@ -40,9 +61,13 @@ private:
     double m_FirstEPGProduct, m_SecondEPGProduct, m_ThirdEPGProduct, m_FourthEPGProduct, m_FifthEPGProduct;
     double m_FirstDerivativeProduct, m_SecondDerivativeProduct, m_ThirdDerivativeProduct;
 
+    //! Initial transverse magnetization of the last GetValue call
+    double m_BaseValue;
+
     // Internal work variables. Because of this, not thread safe !
-    vnl_matrix <double> m_SimulatedT2Values;
-    vnl_matrix <double> m_SimulatedDerivativeT2Values;
+    // EPG states at all echoes ((N+1) x (3N+1) values), flip angle derivatives at current and next echoes only
+    RealVectorType m_EPGStates;
+    RealVectorType m_EPGDerivativeStates[2];
     RealVectorType m_OutputVector;
     RealVectorType m_OutputB1Derivative;
 };
@@ -27,8 +27,9 @@ public:
     typedef typename Superclass::OptimizerPointer OptimizerPointer;
 
     bool GetMaximizedMetric();
-    void SetSimilarityType(SimilarityDefinition val) {m_SimilarityType = val;}
-    void SetDefaultBackgroundValue(double val) {m_DefaultBackgroundValue = val;}
+    bool GetMetricProvidesDerivatives() ITK_OVERRIDE {return true;}
+    void SetSimilarityType(SimilarityDefinition val) {m_SimilarityType = val; this->ResetWorkspaces();}
+    void SetDefaultBackgroundValue(double val) {m_DefaultBackgroundValue = val; this->ResetWorkspaces();}
 
 protected:
     virtual MetricPointer SetupMetric();
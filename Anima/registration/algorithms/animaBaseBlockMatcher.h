@@ -3,7 +3,7 @@
 
 #include <itkSingleValuedNonLinearOptimizer.h>
 #include <itkSingleValuedCostFunction.h>
-#include <mutex>
+#include <atomic>
 
 namespace anima
 {
@@ -16,10 +16,12 @@ public:
     BaseBlockMatcher();
     virtual ~BaseBlockMatcher() {}
 
+    //! LBFGS requires metrics providing derivatives (see GetMetricProvidesDerivatives), Update throws otherwise
     enum OptimizerDefinition
     {
         Exhaustive = 0,
-        Bobyqa
+        Bobyqa,
+        LBFGS
     };
 
     typedef TInputImageType InputImageType;
@@ -65,8 +67,12 @@ public:
     void SetBlockSpacing(unsigned int val) {m_BlockSpacing = val;}
     unsigned int GetBlockSpacing() {return m_BlockSpacing;}
 
-    void SetStepSize (double val) {m_StepSize = val;}
-    void SetOptimizerMaximumIterations (unsigned int val) {m_OptimizerMaximumIterations = val;}
+    void SetStepSize (double val) {m_StepSize = val; this->ResetWorkspaces();}
+    void SetOptimizerMaximumIterations (unsigned int val) {m_OptimizerMaximumIterations = val; this->ResetWorkspaces();}
+
+    //! Number of consecutive blocks taken at once by a work unit from its own or a stolen range
+    void SetSchedulingGrainSize(unsigned int val) {m_SchedulingGrainSize = std::max(val,(unsigned int)1);}
+    unsigned int GetSchedulingGrainSize() {return m_SchedulingGrainSize;}
 
     void Update();
 
@@ -79,7 +85,7 @@ public:
 
     const std::vector <double> &GetBlockWeights() {return m_BlockWeights;}
 
-    void SetOptimizerType(OptimizerDefinition val) {m_OptimizerType = val;}
+    void SetOptimizerType(OptimizerDefinition val) {m_OptimizerType = val; this->ResetWorkspaces();}
     OptimizerDefinition GetOptimizerType() {return m_OptimizerType;}
 
     InputImagePointer &GetReferenceImage() {return m_ReferenceImage;}
@@ -88,20 +94,77 @@ public:
 
     virtual bool GetMaximizedMetric() = 0;
 
+    //! True if the block metrics implement GetValueAndDerivative, required by the LBFGS optimizer
+    virtual bool GetMetricProvidesDerivatives() {return false;}
+
     void SetVerbose(bool value) {m_Verbose = value;}
     bool GetVerbose() {return m_Verbose;}
 
+    /**
+     * Scheduling counters, accumulated over all calls to Update since the last block initialization.
+     * The ratio between the summed busy time of all work units and the matching wall time gives the
+     * effective speedup over a single core.
+     */
+    struct SchedulingStatistics
+    {
+        unsigned int NumberOfUpdates;
+        unsigned int NumberOfWorkUnits;
+        unsigned long NumberOfProcessedBlocks;
+        unsigned long NumberOfStolenBlocks;
+        unsigned long NumberOfWorkspaceSetups;
+        double WallTime;
+        double SummedBusyTime;
+        double MaximalBusyTime;
+    };
+
+    const SchedulingStatistics &GetSchedulingStatistics() {return m_SchedulingStatistics;}
+    void PrintSchedulingStatistics(std::ostream &os);
+
 protected:
+    //! Contiguous range of blocks initially owned by one work unit, its cursor may be advanced by any work unit
+    struct alignas(64) BlockRangeType
+    {
+        std::atomic <unsigned int> NextBlock;
+        unsigned int EndBlock;
+    };
+
     struct ThreadedMatchData
     {
         Self *BlockMatch;
+        BlockRangeType *BlockRanges;
+        unsigned int NumberOfRanges;
+    };
+
+    //! Per work unit metric and optimizer, kept alive across blocks and calls to Update
+    struct BlockMatchWorkspace
+    {
+        MetricPointer Metric;
+        OptimizerPointer Optimizer;
+        InputImageType *MetricReferenceImage;
+        InputImageType *MetricMovingImage;
+    };
+
+    //! Per work unit counters of the last call to Update
+    struct WorkUnitCounters
+    {
+        unsigned long NumberOfProcessedBlocks;
+        unsigned long NumberOfStolenBlocks;
+        unsigned long NumberOfWorkspaceSetups;
+        double BusyTime;
     };
 
     /** Do the matching for a batch of regions (split according to the thread id + nb threads) */
     static ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION ThreadedMatching(void *arg);
 
-    void ProcessBlockMatch();
-    void BlockMatch(unsigned int startIndex, unsigned int endIndex);
+    void ProcessBlockMatch(unsigned int workUnit, BlockRangeType *blockRanges, unsigned int numRanges);
+    void BlockMatch(unsigned int startIndex, unsigned int endIndex, BlockMatchWorkspace &workspace);
+
+    //! Makes sure the workspace metric and optimizer are set up for the current images
+    void PrepareWorkspace(BlockMatchWorkspace &workspace, WorkUnitCounters &counters);
+
+    //! Drops all per work unit metrics and optimizers, they will be re-created at the next update
+    void ResetWorkspaces();
+    void ResetSchedulingStatistics();
 
     virtual void InitializeBlocks();
 
@@ -151,8 +214,11 @@ private:
     unsigned int m_OptimizerMaximumIterations;
     double m_StepSize;
 
-    std::mutex m_LockHighestProcessedBlock;
-    int m_HighestProcessedBlock;
+    // Work-stealing scheduling
+    unsigned int m_SchedulingGrainSize;
+    std::vector <BlockMatchWorkspace> m_Workspaces;
+    std::vector <WorkUnitCounters> m_WorkUnitCounters;
+    SchedulingStatistics m_SchedulingStatistics;
 };
 
 } // end namespace anima
@@ -5,6 +5,7 @@
 #include <animaVoxelExhaustiveOptimizer.h>
 #include <animaBlockMatchInitializer.h>
 #include <itkPoolMultiThreader.h>
+#include <itkTimeProbe.h>
 
 namespace anima
 {
@@ -28,7 +29,8 @@ BaseBlockMatcher <TInputImageType>
     m_OptimizerType = Bobyqa;
     m_Verbose = true;
 
-    m_HighestProcessedBlock = 0;
+    m_SchedulingGrainSize = 4;
+    this->ResetSchedulingStatistics();
 }
 
 template <typename TInputImageType>
@@ -77,10 +79,15 @@ BaseBlockMatcher <TInputImageType>
     switch (m_OptimizerType)
     {
         case Bobyqa:
+        case LBFGS:
         {
             anima::NLOPTOptimizers::Pointer tmpOpt = anima::NLOPTOptimizers::New();
 
-            tmpOpt->SetAlgorithm(NLOPT_LN_BOBYQA);
+            if (m_OptimizerType == LBFGS)
+                tmpOpt->SetAlgorithm(NLOPT_LD_LBFGS);
+            else
+                tmpOpt->SetAlgorithm(NLOPT_LN_BOBYQA);
+
             double xTol = 1.0e-4;
             double fTol = 1.0e-2 * xTol;
 
@@ -139,20 +146,75 @@ void
 BaseBlockMatcher <TInputImageType>
 ::Update()
 {
+    // Blocks whose metric has no derivative would otherwise silently end up with a null weight
+    if ((m_OptimizerType == LBFGS) && (!this->GetMetricProvidesDerivatives()))
+        throw itk::ExceptionObject(__FILE__, __LINE__,"LBFGS optimizer requires a block metric providing derivatives",ITK_LOCATION);
+
     // Generate blocks if needed on reference image
     if ((m_ForceComputeBlocks) || (m_BlockTransformPointers.size() == 0))
+    {
         this->InitializeBlocks();
+        this->ResetWorkspaces();
+        this->ResetSchedulingStatistics();
+    }
 
-    m_HighestProcessedBlock = 0;
     itk::PoolMultiThreader::Pointer threadWorker = itk::PoolMultiThreader::New();
+    threadWorker->SetNumberOfWorkUnits(m_NumberOfThreads);
+    unsigned int numWorkUnits = threadWorker->GetNumberOfWorkUnits();
+
+    // Split blocks in one contiguous range per work unit, idle work units then steal from the others
+    unsigned int numBlocks = m_BlockRegions.size();
+    std::vector <BlockRangeType> blockRanges(numWorkUnits);
+    for (unsigned int i = 0;i < numWorkUnits;++i)
+    {
+        blockRanges[i].NextBlock.store(static_cast <unsigned long> (i) * numBlocks / numWorkUnits);
+        blockRanges[i].EndBlock = static_cast <unsigned long> (i + 1) * numBlocks / numWorkUnits;
+    }
+
+    if (m_Workspaces.size() < numWorkUnits)
+    {
+        BlockMatchWorkspace emptyWorkspace;
+        emptyWorkspace.MetricReferenceImage = ITK_NULLPTR;
+        emptyWorkspace.MetricMovingImage = ITK_NULLPTR;
+        m_Workspaces.resize(numWorkUnits,emptyWorkspace);
+    }
+
+    WorkUnitCounters emptyCounters;
+    emptyCounters.NumberOfProcessedBlocks = 0;
+    emptyCounters.NumberOfStolenBlocks = 0;
+    emptyCounters.NumberOfWorkspaceSetups = 0;
+    emptyCounters.BusyTime = 0;
+    m_WorkUnitCounters.assign(numWorkUnits,emptyCounters);
+
     ThreadedMatchData *tmpStr = new ThreadedMatchData;
     tmpStr->BlockMatch = this;
+    tmpStr->BlockRanges = blockRanges.data();
+    tmpStr->NumberOfRanges = numWorkUnits;
+
+    itk::TimeProbe wallTime;
+    wallTime.Start();
 
-    threadWorker->SetNumberOfWorkUnits(m_NumberOfThreads);
     threadWorker->SetSingleMethod(this->ThreadedMatching,tmpStr);
     threadWorker->SingleMethodExecute();
 
+    wallTime.Stop();
     delete tmpStr;
+
+    m_SchedulingStatistics.NumberOfUpdates++;
+    m_SchedulingStatistics.NumberOfWorkUnits = numWorkUnits;
+    m_SchedulingStatistics.WallTime += wallTime.GetTotal();
+
+    double maxBusyTime = 0;
+    for (unsigned int i = 0;i < numWorkUnits;++i)
+    {
+        m_SchedulingStatistics.NumberOfProcessedBlocks += m_WorkUnitCounters[i].NumberOfProcessedBlocks;
+        m_SchedulingStatistics.NumberOfStolenBlocks += m_WorkUnitCounters[i].NumberOfStolenBlocks;
+        m_SchedulingStatistics.NumberOfWorkspaceSetups += m_WorkUnitCounters[i].NumberOfWorkspaceSetups;
+        m_SchedulingStatistics.SummedBusyTime += m_WorkUnitCounters[i].BusyTime;
+        maxBusyTime = std::max(maxBusyTime,m_WorkUnitCounters[i].BusyTime);
+    }
+
+    m_SchedulingStatistics.MaximalBusyTime += maxBusyTime;
 }
 
 template <typename TInputImageType>
@@ -163,53 +225,116 @@ BaseBlockMatcher <TInputImageType>
     itk::MultiThreaderBase::WorkUnitInfo *threadArgs = (itk::MultiThreaderBase::WorkUnitInfo *)arg;
     ThreadedMatchData* data = (ThreadedMatchData *)threadArgs->UserData;
 
-    data->BlockMatch->ProcessBlockMatch();
+    data->BlockMatch->ProcessBlockMatch(threadArgs->WorkUnitID,data->BlockRanges,data->NumberOfRanges);
     return ITK_THREAD_RETURN_DEFAULT_VALUE;
 }
 
 template <typename TInputImageType>
 void
 BaseBlockMatcher <TInputImageType>
-::ProcessBlockMatch()
+::ProcessBlockMatch(unsigned int workUnit, BlockRangeType *blockRanges, unsigned int numRanges)
 {
-    bool continueLoop = true;
-    unsigned int highestToleratedBlockIndex = m_BlockRegions.size();
+    BlockMatchWorkspace &workspace = m_Workspaces[workUnit];
+    WorkUnitCounters &counters = m_WorkUnitCounters[workUnit];
 
-    unsigned int stepData = std::ceil(m_BlockRegions.size() / (10 * this->GetNumberOfWorkUnits()));
-    unsigned int minNumBlocks = std::min(highestToleratedBlockIndex,static_cast <unsigned int> (10));
-    stepData = std::max(minNumBlocks,stepData);
+    itk::TimeProbe busyTime;
+    busyTime.Start();
 
-    while (continueLoop)
+    // Own range first, then steal from the following ones. Grabbing blocks is a single atomic
+    // increment of the range cursor, so that neither owner nor thieves ever wait on a lock
+    for (unsigned int i = 0;i < numRanges;++i)
     {
-        m_LockHighestProcessedBlock.lock();
+        BlockRangeType &range = blockRanges[(workUnit + i) % numRanges];
 
-        if (m_HighestProcessedBlock >= highestToleratedBlockIndex)
+        while (range.NextBlock.load(std::memory_order_relaxed) < range.EndBlock)
         {
-            m_LockHighestProcessedBlock.unlock();
-            continueLoop = false;
-            continue;
-        }
+            unsigned int startBlock = range.NextBlock.fetch_add(m_SchedulingGrainSize,std::memory_order_relaxed);
+            if (startBlock >= range.EndBlock)
+                break;
+
+            unsigned int endBlock = std::min(startBlock + m_SchedulingGrainSize,range.EndBlock);
 
-        unsigned int startPoint = m_HighestProcessedBlock;
-        unsigned int endPoint = m_HighestProcessedBlock + stepData;
-        if (endPoint > highestToleratedBlockIndex)
-            endPoint = highestToleratedBlockIndex;
+            this->PrepareWorkspace(workspace,counters);
+            this->BlockMatch(startBlock,endBlock,workspace);
+
+            counters.NumberOfProcessedBlocks += endBlock - startBlock;
+            if (i != 0)
+                counters.NumberOfStolenBlocks += endBlock - startBlock;
+        }
+    }
 
-        m_HighestProcessedBlock = endPoint;
+    busyTime.Stop();
+    counters.BusyTime = busyTime.GetTotal();
+}
 
-        m_LockHighestProcessedBlock.unlock();
+template <typename TInputImageType>
+void
+BaseBlockMatcher <TInputImageType>
+::PrepareWorkspace(BlockMatchWorkspace &workspace, WorkUnitCounters &counters)
+{
+    if (workspace.Optimizer.IsNull())
+    {
+        workspace.Optimizer = this->SetupOptimizer();
+        counters.NumberOfWorkspaceSetups++;
+    }
 
-        this->BlockMatch(startPoint,endPoint);
+    // The metric holds references to both images, a new image can therefore not reuse the address of an old one
+    if (workspace.Metric.IsNull() || (workspace.MetricReferenceImage != m_ReferenceImage.GetPointer()) ||
+            (workspace.MetricMovingImage != m_MovingImage.GetPointer()))
+    {
+        workspace.Metric = this->SetupMetric();
+        workspace.MetricReferenceImage = m_ReferenceImage.GetPointer();
+        workspace.MetricMovingImage = m_MovingImage.GetPointer();
+        counters.NumberOfWorkspaceSetups++;
     }
 }
 
 template <typename TInputImageType>
 void
 BaseBlockMatcher <TInputImageType>
-::BlockMatch(unsigned int startIndex, unsigned int endIndex)
+::ResetWorkspaces()
+{
+    m_Workspaces.clear();
+}
+
+template <typename TInputImageType>
+void
+BaseBlockMatcher <TInputImageType>
+::ResetSchedulingStatistics()
+{
+    m_SchedulingStatistics.NumberOfUpdates = 0;
+    m_SchedulingStatistics.NumberOfWorkUnits = 0;
+    m_SchedulingStatistics.NumberOfProcessedBlocks = 0;
+    m_SchedulingStatistics.NumberOfStolenBlocks = 0;
+    m_SchedulingStatistics.NumberOfWorkspaceSetups = 0;
+    m_SchedulingStatistics.WallTime = 0;
+    m_SchedulingStatistics.SummedBusyTime = 0;
+    m_SchedulingStatistics.MaximalBusyTime = 0;
+}
+
+template <typename TInputImageType>
+void
+BaseBlockMatcher <TInputImageType>
+::PrintSchedulingStatistics(std::ostream &os)
+{
+    const SchedulingStatistics &stats = m_SchedulingStatistics;
+    double speedup = (stats.WallTime > 0) ? stats.SummedBusyTime / stats.WallTime : 0.0;
+    double balance = (stats.MaximalBusyTime > 0) ? stats.SummedBusyTime / (stats.NumberOfWorkUnits * stats.MaximalBusyTime) : 0.0;
+
+    os << "Block matching: " << stats.NumberOfProcessedBlocks << " block optimizations in " << stats.NumberOfUpdates
+       << " updates on " << stats.NumberOfWorkUnits << " work units" << std::endl;
+    os << "Block matching: wall time " << stats.WallTime << "s, summed busy time " << stats.SummedBusyTime
+       << "s, speedup " << speedup << ", load balance " << 100.0 * balance << "%, "
+       << stats.NumberOfStolenBlocks << " stolen blocks, " << stats.NumberOfWorkspaceSetups << " workspace setups" << std::endl;
+}
+
+template <typename TInputImageType>
+void
+BaseBlockMatcher <TInputImageType>
+::BlockMatch(unsigned int startIndex, unsigned int endIndex, BlockMatchWorkspace &workspace)
 {
-    MetricPointer metric = this->SetupMetric();
-    OptimizerPointer optimizer = this->SetupOptimizer();
+    MetricPointer &metric = workspace.Metric;
+    OptimizerPointer &optimizer = workspace.Optimizer;
 
     // Loop over the desired blocks
     for (unsigned int block = startIndex;block < endIndex;++block)
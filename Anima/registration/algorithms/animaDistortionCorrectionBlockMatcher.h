@@ -47,7 +47,8 @@ public:
     void SetTransformDirection(unsigned int val) {m_TransformDirection = val;}
 
     bool GetMaximizedMetric();
-    void SetSimilarityType(SimilarityDefinition val) {m_SimilarityType = val;}
+    bool GetMetricProvidesDerivatives() ITK_OVERRIDE {return true;}
+    void SetSimilarityType(SimilarityDefinition val) {m_SimilarityType = val; this->ResetWorkspaces();}
 
 protected:
     virtual BaseInputTransformPointer GetNewBlockTransform(PointType &blockCenter);
@@ -44,14 +44,14 @@ public:
     typedef anima::MCMLinearInterpolateImageFunction <InputImageType,double> MCMInterpolatorType;
 
     bool GetMaximizedMetric();
-    void SetSimilarityType(SimilarityDefinition val) {m_SimilarityType = val;}
+    void SetSimilarityType(SimilarityDefinition val) {m_SimilarityType = val; this->ResetWorkspaces();}
 
-    void SetModelRotationType(ModelRotationType val) {m_ModelRotationType = val;}
+    void SetModelRotationType(ModelRotationType val) {m_ModelRotationType = val; this->ResetWorkspaces();}
 
-    void SetSmallDelta(double val) {m_SmallDelta = val;}
-    void SetBigDelta(double val) {m_BigDelta = val;}
-    void SetGradientStrengths(std::vector <double> &val) {m_GradientStrengths = val;}
-    void SetGradientDirections(std::vector <vnl_vector_fixed <double,3> > &grads) {m_GradientDirections = grads;}
+    void SetSmallDelta(double val) {m_SmallDelta = val; this->ResetWorkspaces();}
+    void SetBigDelta(double val) {m_BigDelta = val; this->ResetWorkspaces();}
+    void SetGradientStrengths(std::vector <double> &val) {m_GradientStrengths = val; this->ResetWorkspaces();}
+    void SetGradientDirections(std::vector <vnl_vector_fixed <double,3> > &grads) {m_GradientDirections = grads; this->ResetWorkspaces();}
 
 protected:
     virtual MetricPointer SetupMetric();
@@ -35,9 +35,9 @@ public:
     typedef typename Superclass::OptimizerPointer OptimizerPointer;
 
     bool GetMaximizedMetric();
-    void SetSimilarityType(SimilarityDefinition val) {m_SimilarityType = val;}
+    void SetSimilarityType(SimilarityDefinition val) {m_SimilarityType = val; this->ResetWorkspaces();}
 
-    void SetModelRotationType(ModelRotationType val) {m_ModelRotationType = val;}
+    void SetModelRotationType(ModelRotationType val) {m_ModelRotationType = val; this->ResetWorkspaces();}
 
 protected:
     virtual MetricPointer SetupMetric();
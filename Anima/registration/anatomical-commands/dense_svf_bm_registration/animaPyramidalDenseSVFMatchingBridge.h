@@ -81,7 +81,8 @@ public:
     enum Optimizer
     {
         Exhaustive = 0,
-        Bobyqa
+        Bobyqa,
+        LBFGS
     };
 
     enum Agregator
@@ -186,6 +187,9 @@ public:
     double GetMEstimateConvergenceThreshold() {return m_MEstimateConvergenceThreshold;}
     void SetMEstimateConvergenceThreshold(double mEstimateConvergenceThreshold) {m_MEstimateConvergenceThreshold = mEstimateConvergenceThreshold;}
 
+    bool GetUseSparseSupportRegularization() {return m_UseSparseSupportRegularization;}
+    void SetUseSparseSupportRegularization(bool val) {m_UseSparseSupportRegularization = val;}
+
     unsigned int GetBCHCompositionOrder() {return m_BCHCompositionOrder;}
     void SetBCHCompositionOrder(unsigned int order) {m_BCHCompositionOrder = order;}
 
@@ -257,6 +261,7 @@ private:
     double m_ElasticSigma;
     double m_OutlierSigma;
     double m_MEstimateConvergenceThreshold;
+    bool m_UseSparseSupportRegularization;
     unsigned int m_BCHCompositionOrder;
     unsigned int m_ExponentiationOrder;
 
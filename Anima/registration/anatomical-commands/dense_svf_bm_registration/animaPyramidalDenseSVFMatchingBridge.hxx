@@ -57,6 +57,7 @@ PyramidalDenseSVFMatchingBridge<ImageDimension>::PyramidalDenseSVFMatchingBridge
     m_ElasticSigma = 3;
     m_OutlierSigma = 3;
     m_MEstimateConvergenceThreshold = 0.01;
+    m_UseSparseSupportRegularization = false;
     m_BCHCompositionOrder = 1;
     m_ExponentiationOrder = 1;
     m_NumberOfPyramidLevels = 3;
@@ -199,6 +200,7 @@ PyramidalDenseSVFMatchingBridge<ImageDimension>::Update()
 
             agreg->SetGeometryInformation(refImage.GetPointer());
             agreg->SetMEstimateConvergenceThreshold(m_MEstimateConvergenceThreshold);
+            agreg->SetUseSparseSupportRegularization(m_UseSparseSupportRegularization);
 
             agregPtr = agreg;
         }
@@ -356,6 +358,12 @@ PyramidalDenseSVFMatchingBridge<ImageDimension>::Update()
                     reverseMatcher->SetOptimizerType(BlockMatcherType::Exhaustive);
                 break;
 
+            case LBFGS:
+                mainMatcher->SetOptimizerType(BlockMatcherType::LBFGS);
+                if (reverseMatcher)
+                    reverseMatcher->SetOptimizerType(BlockMatcherType::LBFGS);
+                break;
+
             case Bobyqa:
             default:
                 mainMatcher->SetOptimizerType(BlockMatcherType::Bobyqa);
@@ -429,6 +437,13 @@ PyramidalDenseSVFMatchingBridge<ImageDimension>::Update()
         const BaseTransformType *resTrsf = dynamic_cast <const BaseTransformType *> (m_bmreg->GetOutput()->Get());
         m_OutputTransform->SetParametersAsVectorField(resTrsf->GetParametersAsVectorField());
 
+        if (m_Verbose)
+        {
+            mainMatcher->PrintSchedulingStatistics(std::cout);
+            if (reverseMatcher)
+                reverseMatcher->PrintSchedulingStatistics(std::cout);
+        }
+
         delete mainMatcher;
         if (reverseMatcher)
             delete reverseMatcher;
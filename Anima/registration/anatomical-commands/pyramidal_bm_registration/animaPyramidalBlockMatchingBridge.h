@@ -82,7 +82,8 @@ public:
     enum Optimizer
     {
         Exhaustive = 0,
-        Bobyqa
+        Bobyqa,
+        LBFGS
     };
 
     enum Agregator
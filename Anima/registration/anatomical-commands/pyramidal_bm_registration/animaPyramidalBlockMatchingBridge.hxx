@@ -396,6 +396,12 @@ void PyramidalBlockMatchingBridge<ImageDimension>::Update()
                     reverseMatcher->SetOptimizerType(BlockMatcherType::Exhaustive);
                 break;
 
+            case LBFGS:
+                mainMatcher->SetOptimizerType(BlockMatcherType::LBFGS);
+                if (reverseMatcher)
+                    reverseMatcher->SetOptimizerType(BlockMatcherType::LBFGS);
+                break;
+
             case Bobyqa:
             default:
                 mainMatcher->SetOptimizerType(BlockMatcherType::Bobyqa);
@@ -473,6 +479,13 @@ void PyramidalBlockMatchingBridge<ImageDimension>::Update()
         AffineTransformType *tmpTrsf = dynamic_cast<AffineTransformType *>(m_OutputTransform.GetPointer());
         tmpTrsf->SetParameters(m_bmreg->GetOutput()->Get()->GetParameters());
 
+        if (m_Verbose)
+        {
+            mainMatcher->PrintSchedulingStatistics(std::cout);
+            if (reverseMatcher)
+                reverseMatcher->PrintSchedulingStatistics(std::cout);
+        }
+
         delete mainMatcher;
         if (reverseMatcher)
             delete reverseMatcher;
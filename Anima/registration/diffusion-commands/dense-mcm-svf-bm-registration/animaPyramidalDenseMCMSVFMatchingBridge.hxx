@@ -59,6 +59,7 @@ PyramidalDenseMCMSVFMatchingBridge<ImageDimension>::PyramidalDenseMCMSVFMatching
     m_BCHCompositionOrder = 1;
     m_ExponentiationOrder = 1;
     m_NumberOfPyramidLevels = 3;
+    m_Verbose = true;
     m_LastPyramidLevel = 0;
     m_PercentageKept = 0.8;
     m_RegistrationPointLocation = 0.5;
@@ -406,6 +407,13 @@ PyramidalDenseMCMSVFMatchingBridge<ImageDimension>::Update()
         const BaseTransformType *resTrsf = dynamic_cast <const BaseTransformType *> (m_bmreg->GetOutput()->Get());
         m_OutputTransform->SetParametersAsVectorField(resTrsf->GetParametersAsVectorField());
 
+        if (m_Verbose)
+        {
+            mainMatcher->PrintSchedulingStatistics(std::cout);
+            if (reverseMatcher)
+                reverseMatcher->PrintSchedulingStatistics(std::cout);
+        }
+
         delete mainMatcher;
         if (reverseMatcher)
             delete reverseMatcher;
@@ -201,6 +201,8 @@ public:
     unsigned int GetNumberOfPyramidLevels() {return m_NumberOfPyramidLevels;}
     void SetNumberOfPyramidLevels(unsigned int NumberOfPyramidLevels) {m_NumberOfPyramidLevels=NumberOfPyramidLevels;}
 
+    void SetVerbose(bool value) {m_Verbose = value;}
+
     unsigned int GetLastPyramidLevel() {return m_LastPyramidLevel;}
     void SetLastPyramidLevel(unsigned int LastPyramidLevel) {m_LastPyramidLevel=LastPyramidLevel;}
 
@@ -259,6 +261,7 @@ private:
     unsigned int m_ExponentiationOrder;
 
     unsigned int m_NumberOfPyramidLevels;
+    bool m_Verbose;
     unsigned int m_LastPyramidLevel;
     double m_PercentageKept;
 
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <itkImageBase.h>
+#include <itkTransform.h>
+#include <itkMultiThreaderBase.h>
+
+#include <vector>
+
+namespace anima
+{
+
+/**
+ * @brief Precomputed sampling plan to resample many images sharing the same geometry (e.g. the volumes
+ * of a 4D image) with the same transform. The transform chain is evaluated once per output voxel, and the
+ * input buffer offset and interpolation weights are stored. Applying the plan is then a multithreaded
+ * gather, performed for several volumes at once so that weights are computed once per voxel.
+ * Nearest neighbor, linear and Hamming windowed sinc (radius 4, zero boundary) interpolations are
+ * handled, and give the same values as their ITK interpolators used in anima::ResampleImageFilter.
+ * Weights may be stored as 16 bits fixed point values to reduce the plan memory footprint.
+ */
+template <unsigned int NDimensions = 3>
+class ResamplingPlan
+{
+public:
+    ResamplingPlan();
+    virtual ~ResamplingPlan() {}
+
+    typedef itk::ImageBase <NDimensions> GeometryType;
+    typedef itk::Transform <double, NDimensions, NDimensions> TransformType;
+
+    enum InterpolationMode
+    {
+        Nearest = 0,
+        Linear,
+        Sinc
+    };
+
+    //! Radius of the windowed sinc kernel, same as the one used in animaApplyTransformSerie
+    static const unsigned int SincRadius = 4;
+
+    void SetInterpolationMode(InterpolationMode mode) {m_InterpolationMode = mode;}
+    InterpolationMode GetInterpolationMode() const {return m_InterpolationMode;}
+
+    //! Stores weights as 16 bits fixed point values instead of floats
+    void SetCompressWeights(bool val) {m_CompressWeights = val;}
+    void SetNumberOfWorkUnits(unsigned int val) {m_NumberOfWorkUnits = val;}
+
+    /**
+     * Evaluates the transform (output to input physical space) at all voxels of the output geometry
+     * and stores, for each of them, where and how to sample an input image with the input geometry
+     */
+    void Build(const TransformType *transform, const GeometryType *inputGeometry, const GeometryType *outputGeometry);
+
+    unsigned int GetNumberOfOutputVoxels() const {return m_BaseOffsets.size();}
+    unsigned int GetNumberOfInputVoxels() const {return m_NumberOfInputVoxels;}
+
+    //! Memory used by the plan, in bytes
+    size_t GetMemorySize() const;
+
+    /**
+     * Resamples numVolumes volumes stored one after the other in inputBuffer (each of them having the input
+     * geometry) into outputBuffer (volumes with the output geometry). Points outside the input are set to defaultValue
+     */
+    template <class TInputPixel, class TOutputPixel>
+    void Apply(const TInputPixel *inputBuffer, TOutputPixel *outputBuffer, unsigned int numVolumes, double defaultValue) const;
+
+protected:
+    //! Number of weights stored per dimension and voxel
+    unsigned int GetWeightsPerDimension() const;
+
+    //! Weight of index i in dimension dim for output voxel voxelIndex
+    inline double GetWeight(unsigned int voxelIndex, unsigned int dim, unsigned int i) const;
+
+    template <class TInputPixel, class TOutputPixel>
+    void ApplyOnRange(const TInputPixel *inputBuffer, TOutputPixel *outputBuffer, unsigned int numVolumes,
+                      double defaultValue, unsigned int startVoxel, unsigned int endVoxel) const;
+
+private:
+    InterpolationMode m_InterpolationMode;
+    bool m_CompressWeights;
+    unsigned int m_NumberOfWorkUnits;
+
+    unsigned int m_NumberOfInputVoxels;
+    long m_InputStrides[NDimensions];
+
+    //! Number of samples along each dimension (windowed sinc may be shortened on small images)
+    unsigned int m_WindowLengths[NDimensions];
+
+    //! Input offset of the first sample of each output voxel, -1 for voxels outside the input
+    std::vector <int> m_BaseOffsets;
+
+    //! Linear interpolation: bit d set if the next sample along dimension d is clamped to the current one
+    std::vector <unsigned char> m_ClampFlags;
+
+    // Per voxel weights (linear: fractional part per dimension, sinc: window weights per dimension)
+    std::vector <float> m_Weights;
+    std::vector <short> m_CompressedWeights;
+};
+
+} // end namespace anima
+
+#include "animaResamplingPlan.hxx"
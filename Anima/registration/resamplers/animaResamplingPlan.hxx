@@ -0,0 +1,385 @@
+#pragma once
+#include "animaResamplingPlan.h"
+
+#include <itkContinuousIndex.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace anima
+{
+
+template <unsigned int NDimensions>
+ResamplingPlan <NDimensions>::
+ResamplingPlan()
+{
+    m_InterpolationMode = Linear;
+    m_CompressWeights = false;
+    m_NumberOfWorkUnits = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+
+    m_NumberOfInputVoxels = 0;
+    for (unsigned int i = 0;i < NDimensions;++i)
+    {
+        m_InputStrides[i] = 0;
+        m_WindowLengths[i] = 1;
+    }
+}
+
+template <unsigned int NDimensions>
+unsigned int
+ResamplingPlan <NDimensions>::
+GetWeightsPerDimension() const
+{
+    switch (m_InterpolationMode)
+    {
+        case Linear:
+            return 1;
+
+        case Sinc:
+            return 2 * SincRadius;
+
+        case Nearest:
+        default:
+            return 0;
+    }
+}
+
+template <unsigned int NDimensions>
+double
+ResamplingPlan <NDimensions>::
+GetWeight(unsigned int voxelIndex, unsigned int dim, unsigned int i) const
+{
+    unsigned int weightIndex = (voxelIndex * NDimensions + dim) * this->GetWeightsPerDimension() + i;
+    if (m_CompressWeights)
+        return m_CompressedWeights[weightIndex] / 32767.0;
+
+    return m_Weights[weightIndex];
+}
+
+template <unsigned int NDimensions>
+size_t
+ResamplingPlan <NDimensions>::
+GetMemorySize() const
+{
+    return m_BaseOffsets.size() * sizeof(int) + m_ClampFlags.size() * sizeof(unsigned char)
+            + m_Weights.size() * sizeof(float) + m_CompressedWeights.size() * sizeof(short);
+}
+
+template <unsigned int NDimensions>
+void
+ResamplingPlan <NDimensions>::
+Build(const TransformType *transform, const GeometryType *inputGeometry, const GeometryType *outputGeometry)
+{
+    typedef typename GeometryType::RegionType RegionType;
+    typedef typename GeometryType::IndexType IndexType;
+    typedef typename GeometryType::PointType PointType;
+    typedef itk::ContinuousIndex <double, NDimensions> ContinuousIndexType;
+
+    RegionType inputRegion = inputGeometry->GetLargestPossibleRegion();
+    RegionType outputRegion = outputGeometry->GetLargestPossibleRegion();
+
+    m_NumberOfInputVoxels = inputRegion.GetNumberOfPixels();
+    long inputStartIndex[NDimensions], inputEndIndex[NDimensions];
+    long outputStrides[NDimensions];
+    long inputStride = 1;
+    long outputStride = 1;
+    for (unsigned int i = 0;i < NDimensions;++i)
+    {
+        m_InputStrides[i] = inputStride;
+        inputStride *= inputRegion.GetSize()[i];
+        outputStrides[i] = outputStride;
+        outputStride *= outputRegion.GetSize()[i];
+
+        inputStartIndex[i] = inputRegion.GetIndex()[i];
+        inputEndIndex[i] = inputStartIndex[i] + inputRegion.GetSize()[i] - 1;
+
+        m_WindowLengths[i] = 1;
+        if (m_InterpolationMode == Sinc)
+            m_WindowLengths[i] = std::min(2 * SincRadius, (unsigned int)inputRegion.GetSize()[i]);
+    }
+
+    unsigned int numOutputVoxels = outputRegion.GetNumberOfPixels();
+    unsigned int numWeights = numOutputVoxels * NDimensions * this->GetWeightsPerDimension();
+
+    m_BaseOffsets.resize(numOutputVoxels);
+    m_ClampFlags.clear();
+    if (m_InterpolationMode == Linear)
+        m_ClampFlags.resize(numOutputVoxels);
+
+    m_Weights.clear();
+    m_CompressedWeights.clear();
+    if (m_CompressWeights)
+        m_CompressedWeights.resize(numWeights);
+    else
+        m_Weights.resize(numWeights);
+
+    unsigned int weightsPerDimension = this->GetWeightsPerDimension();
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfWorkUnits);
+
+    threader->template ParallelizeImageRegion<NDimensions> (
+        outputRegion,
+        [&](const RegionType &region)
+    {
+        IndexType index = region.GetIndex();
+        PointType outputPoint, inputPoint;
+        ContinuousIndexType inputIndex;
+        double sampleWeights[2 * SincRadius];
+        std::vector <double> voxelWeights(NDimensions * weightsPerDimension);
+
+        unsigned int numRegionVoxels = region.GetNumberOfPixels();
+        for (unsigned int p = 0;p < numRegionVoxels;++p)
+        {
+            unsigned int voxelIndex = 0;
+            for (unsigned int i = 0;i < NDimensions;++i)
+                voxelIndex += (index[i] - outputRegion.GetIndex()[i]) * outputStrides[i];
+
+            outputGeometry->TransformIndexToPhysicalPoint(index,outputPoint);
+            inputPoint = transform->TransformPoint(outputPoint);
+            inputGeometry->TransformPhysicalPointToContinuousIndex(inputPoint,inputIndex);
+
+            // Same test as itk::ImageFunction::IsInsideBuffer (written so that NaNs are outside)
+            bool insideBuffer = true;
+            for (unsigned int i = 0;i < NDimensions;++i)
+            {
+                if (!((inputIndex[i] >= inputStartIndex[i] - 0.5) && (inputIndex[i] < inputEndIndex[i] + 0.5)))
+                {
+                    insideBuffer = false;
+                    break;
+                }
+            }
+
+            int baseOffset = -1;
+            std::fill(voxelWeights.begin(),voxelWeights.end(),0.0);
+
+            if (insideBuffer)
+            {
+                baseOffset = 0;
+                unsigned char clampFlags = 0;
+
+                for (unsigned int i = 0;i < NDimensions;++i)
+                {
+                    long baseIndex = 0;
+                    switch (m_InterpolationMode)
+                    {
+                        case Nearest:
+                            baseIndex = std::floor(inputIndex[i] + 0.5);
+                            baseIndex = std::max(inputStartIndex[i],std::min(inputEndIndex[i],baseIndex));
+                            break;
+
+                        case Linear:
+                        {
+                            // Same border handling as itk::LinearInterpolateImageFunction
+                            baseIndex = std::max(inputStartIndex[i],(long)std::floor(inputIndex[i]));
+                            voxelWeights[i] = std::max(0.0,inputIndex[i] - baseIndex);
+                            if (baseIndex >= inputEndIndex[i])
+                                clampFlags |= (1 << i);
+                            break;
+                        }
+
+                        case Sinc:
+                        {
+                            // Same weights as itk::WindowedSincInterpolateImageFunction with a Hamming window
+                            long floorIndex = std::floor(inputIndex[i]);
+                            double distance = inputIndex[i] - floorIndex;
+                            double x = distance + SincRadius;
+                            for (unsigned int j = 0;j < 2 * SincRadius;++j)
+                            {
+                                if (distance == 0.0)
+                                {
+                                    sampleWeights[j] = (j == SincRadius - 1) ? 1.0 : 0.0;
+                                    continue;
+                                }
+
+                                x -= 1.0;
+                                double sincValue = 1.0;
+                                if (x != 0.0)
+                                    sincValue = std::sin(M_PI * x) / (M_PI * x);
+
+                                sampleWeights[j] = (0.54 + 0.46 * std::cos(M_PI * x / SincRadius)) * sincValue;
+                            }
+
+                            // Window shifted inside the input, samples outside of it are zero (constant boundary)
+                            long firstSampleIndex = floorIndex - SincRadius + 1;
+                            baseIndex = std::max(inputStartIndex[i],std::min(inputEndIndex[i] - m_WindowLengths[i] + 1,firstSampleIndex));
+                            for (unsigned int j = 0;j < m_WindowLengths[i];++j)
+                            {
+                                long sampleShift = baseIndex + j - firstSampleIndex;
+                                if ((sampleShift >= 0) && (sampleShift < 2 * SincRadius))
+                                    voxelWeights[i * weightsPerDimension + j] = sampleWeights[sampleShift];
+                            }
+
+                            break;
+                        }
+                    }
+
+                    baseOffset += (baseIndex - inputStartIndex[i]) * m_InputStrides[i];
+                }
+
+                if (m_InterpolationMode == Linear)
+                    m_ClampFlags[voxelIndex] = clampFlags;
+            }
+
+            m_BaseOffsets[voxelIndex] = baseOffset;
+            unsigned int weightStart = voxelIndex * NDimensions * weightsPerDimension;
+            for (unsigned int i = 0;i < NDimensions * weightsPerDimension;++i)
+            {
+                if (m_CompressWeights)
+                    m_CompressedWeights[weightStart + i] = std::round(voxelWeights[i] * 32767.0);
+                else
+                    m_Weights[weightStart + i] = voxelWeights[i];
+            }
+
+            for (unsigned int i = 0;i < NDimensions;++i)
+            {
+                ++index[i];
+                if (index[i] < region.GetIndex()[i] + (long)region.GetSize()[i])
+                    break;
+
+                index[i] = region.GetIndex()[i];
+            }
+        }
+    }, ITK_NULLPTR);
+}
+
+template <unsigned int NDimensions>
+template <class TInputPixel, class TOutputPixel>
+void
+ResamplingPlan <NDimensions>::
+Apply(const TInputPixel *inputBuffer, TOutputPixel *outputBuffer, unsigned int numVolumes, double defaultValue) const
+{
+    typedef itk::ImageRegion <1> VoxelRangeType;
+    VoxelRangeType voxelRange;
+    voxelRange.SetIndex(0,0);
+    voxelRange.SetSize(0,m_BaseOffsets.size());
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfWorkUnits);
+
+    threader->template ParallelizeImageRegion<1> (
+        voxelRange,
+        [&](const VoxelRangeType &range)
+    {
+        unsigned int startVoxel = range.GetIndex()[0];
+        this->ApplyOnRange(inputBuffer,outputBuffer,numVolumes,defaultValue,startVoxel,startVoxel + range.GetSize()[0]);
+    }, ITK_NULLPTR);
+}
+
+template <unsigned int NDimensions>
+template <class TInputPixel, class TOutputPixel>
+void
+ResamplingPlan <NDimensions>::
+ApplyOnRange(const TInputPixel *inputBuffer, TOutputPixel *outputBuffer, unsigned int numVolumes,
+             double defaultValue, unsigned int startVoxel, unsigned int endVoxel) const
+{
+    // Volumes are processed by blocks, sample offsets and weights being computed once per voxel and block
+    const unsigned int volumeBlockSize = 16;
+    unsigned int numOutputVoxels = m_BaseOffsets.size();
+
+    unsigned int numSamples = 1;
+    if (m_InterpolationMode == Linear)
+        numSamples = 1 << NDimensions;
+    else if (m_InterpolationMode == Sinc)
+    {
+        for (unsigned int i = 0;i < NDimensions;++i)
+            numSamples *= m_WindowLengths[i];
+    }
+
+    std::vector <long> sampleOffsets(numSamples);
+    std::vector <double> sampleWeights(numSamples);
+    unsigned int sampleIndexes[NDimensions];
+
+    for (unsigned int blockStart = 0;blockStart < numVolumes;blockStart += volumeBlockSize)
+    {
+        unsigned int blockEnd = std::min(numVolumes,blockStart + volumeBlockSize);
+
+        for (unsigned int v = startVoxel;v < endVoxel;++v)
+        {
+            int baseOffset = m_BaseOffsets[v];
+            if (baseOffset < 0)
+            {
+                for (unsigned int t = blockStart;t < blockEnd;++t)
+                    outputBuffer[(size_t)t * numOutputVoxels + v] = static_cast <TOutputPixel> (defaultValue);
+
+                continue;
+            }
+
+            switch (m_InterpolationMode)
+            {
+                case Nearest:
+                    sampleOffsets[0] = baseOffset;
+                    sampleWeights[0] = 1.0;
+                    break;
+
+                case Linear:
+                {
+                    unsigned char clampFlags = m_ClampFlags[v];
+                    for (unsigned int c = 0;c < numSamples;++c)
+                    {
+                        double weight = 1.0;
+                        long offset = baseOffset;
+                        for (unsigned int i = 0;i < NDimensions;++i)
+                        {
+                            double fraction = this->GetWeight(v,i,0);
+                            if ((c >> i) & 1)
+                            {
+                                weight *= fraction;
+                                if (!((clampFlags >> i) & 1))
+                                    offset += m_InputStrides[i];
+                            }
+                            else
+                                weight *= 1.0 - fraction;
+                        }
+
+                        sampleOffsets[c] = offset;
+                        sampleWeights[c] = weight;
+                    }
+
+                    break;
+                }
+
+                case Sinc:
+                {
+                    std::fill(sampleIndexes,sampleIndexes + NDimensions,0);
+                    for (unsigned int c = 0;c < numSamples;++c)
+                    {
+                        double weight = 1.0;
+                        long offset = baseOffset;
+                        for (unsigned int i = 0;i < NDimensions;++i)
+                        {
+                            weight *= this->GetWeight(v,i,sampleIndexes[i]);
+                            offset += sampleIndexes[i] * m_InputStrides[i];
+                        }
+
+                        sampleOffsets[c] = offset;
+                        sampleWeights[c] = weight;
+
+                        for (unsigned int i = 0;i < NDimensions;++i)
+                        {
+                            ++sampleIndexes[i];
+                            if (sampleIndexes[i] < m_WindowLengths[i])
+                                break;
+
+                            sampleIndexes[i] = 0;
+                        }
+                    }
+
+                    break;
+                }
+            }
+
+            for (unsigned int t = blockStart;t < blockEnd;++t)
+            {
+                const TInputPixel *volumeBuffer = inputBuffer + (size_t)t * m_NumberOfInputVoxels;
+                double value = 0.0;
+                for (unsigned int c = 0;c < numSamples;++c)
+                    value += sampleWeights[c] * volumeBuffer[sampleOffsets[c]];
+
+                outputBuffer[(size_t)t * numOutputVoxels + v] = static_cast <TOutputPixel> (value);
+            }
+        }
+    }
+}
+
+} // end namespace anima
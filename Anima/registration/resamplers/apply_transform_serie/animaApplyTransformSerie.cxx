@@ -12,21 +12,35 @@
 
 #include <itkExtractImageFilter.h>
 #include <animaResampleImageFilter.h>
+#include <animaResamplingPlan.h>
 #include <animaTransformSeriesReader.h>
 #include <animaReadWriteFunctions.h>
 #include <animaRetrieveImageTypeMacros.h>
 
 #include <animaGradientFileReader.h>
 #include <itkTransformToDisplacementFieldFilter.h>
+#include <vnl/algo/vnl_determinant.h>
 
 struct arguments
 {
     bool invert;
+    bool useSamplingPlan, compressSamplingPlan;
+    bool flatten;
     unsigned int exponentiationOrder;
     unsigned int pthread;
     std::string input, output, geometry, transfo, interpolation;
+    std::string expCacheDir;
 };
 
+// Sets up exponential caching and flattening on the geometry image grid
+template <class TransformSeriesReaderType>
+void setupTransformSeriesReader(TransformSeriesReaderType *trReader, itk::ImageIOBase::Pointer geometryImageIO, const arguments &args)
+{
+    trReader->SetExponentialCacheDirectory(args.expCacheDir);
+    if (args.flatten)
+        trReader->SetFlatteningGeometry(geometryImageIO.GetPointer());
+}
+
 void applyTransformationToGradients(std::string &inputGradientsFileName, std::string &outputGradientsFileName, const arguments &args)
 {
     typedef anima::TransformSeriesReader <double, 3> TransformSeriesReaderType;
@@ -107,6 +121,7 @@ applyVectorTransfo(itk::ImageIOBase::Pointer geometryImageIO, const arguments &a
     trReader->SetInvertTransform(args.invert);
     trReader->SetExponentiationOrder(args.exponentiationOrder);
     trReader->SetNumberOfWorkUnits(args.pthread);
+    setupTransformSeriesReader(trReader,geometryImageIO,args);
     trReader->Update();
     typename TransformType::Pointer transfo = trReader->GetOutputTransform();
 
@@ -183,6 +198,7 @@ applyScalarTransfo4D(itk::ImageIOBase::Pointer geometryImageIO, const arguments
     trReader->SetInvertTransform(args.invert);
     trReader->SetExponentiationOrder(args.exponentiationOrder);
     trReader->SetNumberOfWorkUnits(args.pthread);
+    setupTransformSeriesReader(trReader,geometryImageIO,args);
     trReader->Update();
     typename TransformType::Pointer transfo = trReader->GetOutputTransform();
 
@@ -255,9 +271,77 @@ applyScalarTransfo4D(itk::ImageIOBase::Pointer geometryImageIO, const arguments
             minImageValue = 0.0;
     }
 
-
     unsigned int numImages = inputImage->GetLargestPossibleRegion().GetSize()[InternalImageDimension];
 
+    if (args.useSamplingPlan && (args.interpolation != "bspline"))
+    {
+        // Transform evaluated once, then applied to all sub-images
+        typename InternalImageType::Pointer inputGeometry = InternalImageType::New();
+        typename InternalImageType::Pointer outputGeometry = InternalImageType::New();
+
+        typename InternalImageType::RegionType inputGeometryRegion, outputGeometryRegion;
+        typename InternalImageType::PointType inputGeometryOrigin;
+        typename InternalImageType::SpacingType inputGeometrySpacing;
+        typename InternalImageType::DirectionType inputGeometryDirection, outputGeometryDirection;
+        typename InternalImageType::PointType outputGeometryOrigin;
+        typename InternalImageType::SpacingType outputGeometrySpacing;
+
+        for (unsigned int i = 0;i < InternalImageDimension;++i)
+        {
+            inputGeometryRegion.SetIndex(i,inputImage->GetLargestPossibleRegion().GetIndex()[i]);
+            inputGeometryRegion.SetSize(i,inputImage->GetLargestPossibleRegion().GetSize()[i]);
+            inputGeometryOrigin[i] = inputImage->GetOrigin()[i];
+            inputGeometrySpacing[i] = inputImage->GetSpacing()[i];
+
+            outputGeometryRegion.SetIndex(i,0);
+            outputGeometryRegion.SetSize(i,outputRegion.GetSize()[i]);
+            outputGeometryOrigin[i] = origin[i];
+            outputGeometrySpacing[i] = spacing[i];
+
+            for (unsigned int j = 0;j < InternalImageDimension;++j)
+            {
+                inputGeometryDirection(i,j) = inputImage->GetDirection()(i,j);
+                outputGeometryDirection(i,j) = direction(i,j);
+            }
+        }
+
+        // Same direction as the one guessed by itk::ExtractImageFilter
+        if (vnl_determinant(inputGeometryDirection.GetVnlMatrix().as_matrix()) == 0.0)
+            inputGeometryDirection.SetIdentity();
+
+        inputGeometry->SetRegions(inputGeometryRegion);
+        inputGeometry->SetOrigin(inputGeometryOrigin);
+        inputGeometry->SetSpacing(inputGeometrySpacing);
+        inputGeometry->SetDirection(inputGeometryDirection);
+
+        outputGeometry->SetRegions(outputGeometryRegion);
+        outputGeometry->SetOrigin(outputGeometryOrigin);
+        outputGeometry->SetSpacing(outputGeometrySpacing);
+        outputGeometry->SetDirection(outputGeometryDirection);
+
+        typedef anima::ResamplingPlan <InternalImageDimension> ResamplingPlanType;
+        ResamplingPlanType samplingPlan;
+        if (args.interpolation == "nearest")
+            samplingPlan.SetInterpolationMode(ResamplingPlanType::Nearest);
+        else if (args.interpolation == "sinc")
+            samplingPlan.SetInterpolationMode(ResamplingPlanType::Sinc);
+        else
+            samplingPlan.SetInterpolationMode(ResamplingPlanType::Linear);
+
+        samplingPlan.SetCompressWeights(args.compressSamplingPlan);
+        samplingPlan.SetNumberOfWorkUnits(args.pthread);
+
+        std::cout << "Computing sampling plan..." << std::flush;
+        samplingPlan.Build(transfo.GetPointer(),inputGeometry.GetPointer(),outputGeometry.GetPointer());
+        std::cout << " done (" << samplingPlan.GetMemorySize() / (1024 * 1024) << " MB)" << std::endl;
+
+        std::cout << "Resampling " << numImages << " sub-images" << std::endl;
+        samplingPlan.Apply(inputImage->GetBufferPointer(),outputImage->GetBufferPointer(),numImages,minImageValue);
+
+        anima::writeImage<OutputType>(args.output, outputImage);
+        return;
+    }
+
     for (unsigned int i = 0;i < numImages;++i)
     {
         if (i == 0)
@@ -348,6 +432,7 @@ applyScalarTransfo(itk::ImageIOBase::Pointer geometryImageIO, const arguments &a
     trReader->SetInvertTransform(args.invert);
     trReader->SetExponentiationOrder(args.exponentiationOrder);
     trReader->SetNumberOfWorkUnits(args.pthread);
+    setupTransformSeriesReader(trReader,geometryImageIO,args);
     trReader->Update();
     typename TransformType::Pointer transfo = trReader->GetOutputTransform();
 
@@ -503,6 +588,12 @@ int main(int ac, const char** av)
                                                   "interpolation method",
                                                   cmd);
 
+    TCLAP::SwitchArg flattenArg("F","flatten","Flatten non linear transformation series into a single displacement field on the geometry grid",cmd,false);
+    TCLAP::ValueArg<std::string> expCacheArg("","exp-cache","Directory where SVF exponentials are cached and reused across runs",false,"","exponential cache directory",cmd);
+
+    TCLAP::SwitchArg noSamplingPlanArg("","no-sampling-plan","For 4D images, resample each sub-image independently instead of computing the transform once",cmd,false);
+    TCLAP::SwitchArg compressSamplingPlanArg("","compress-plan","For 4D images, store sampling plan weights on 16 bits to save memory",cmd,false);
+
     TCLAP::ValueArg<unsigned int> nbpArg("p","numberofthreads","Number of threads to run on (default : all cores)",
                                          false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
@@ -552,6 +643,10 @@ int main(int ac, const char** av)
     args.pthread = nbpArg.getValue();
     args.exponentiationOrder = expOrderArg.getValue();
     args.interpolation = interpolationArg.getValue();
+    args.flatten = flattenArg.isSet();
+    args.expCacheDir = expCacheArg.getValue();
+    args.useSamplingPlan = !noSamplingPlanArg.isSet();
+    args.compressSamplingPlan = compressSamplingPlanArg.isSet();
 
     bool badInterpolation = true;
     std::string interpolations[4] = {"nearest", "linear", "bspline", "sinc"};
@@ -625,6 +720,7 @@ int main(int ac, const char** av)
         trReader->SetInput(args.transfo);
         trReader->SetExponentiationOrder(args.exponentiationOrder);
         trReader->SetInvertTransform(!args.invert);
+        trReader->SetExponentialCacheDirectory(args.expCacheDir);
         trReader->Update();
         typename TransformType::Pointer transfo = trReader->GetOutputTransform();
 
@@ -38,6 +38,8 @@ int main(int ac, const char** av)
     TCLAP::ValueArg<unsigned int> expOrderArg("e","exp-order","Order of field exponentiation approximation (in between 0 and 1, default: 0)",false,0,"exponentiation order",cmd);
     TCLAP::SwitchArg invertArg("I","invert","Invert the transformation series",cmd,false);
     TCLAP::SwitchArg nearestArg("N","nearest","Use nearest neighbor interpolation",cmd,false);
+    TCLAP::SwitchArg flattenArg("F","flatten","Flatten non linear transformation series into a single displacement field on the geometry grid",cmd,false);
+    TCLAP::ValueArg<std::string> expCacheArg("","exp-cache","Directory where SVF exponentials are cached and reused across runs",false,"","exponential cache directory",cmd);
 
     TCLAP::ValueArg<unsigned int> nbpArg("p","numberofthreads","Number of threads to run on (default: all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
@@ -78,11 +80,31 @@ int main(int ac, const char** av)
     imageIO->SetFileName(geomArg.getValue());
     imageIO->ReadImageInformation();
 
+    ImageType::DirectionType directionMatrix;
+    ImageType::PointType origin;
+    ImageType::SpacingType spacing;
+    ImageType::RegionType largestRegion;
+
+    for (unsigned int i = 0;i < Dimension;++i)
+    {
+        origin[i] = imageIO->GetOrigin(i);
+        spacing[i] = imageIO->GetSpacing(i);
+        largestRegion.SetIndex(i,0);
+        largestRegion.SetSize(i,imageIO->GetDimensions(i));
+
+        for (unsigned int j = 0;j < Dimension;++j)
+            directionMatrix(i,j) = imageIO->GetDirection(j)[i];
+    }
+
     TransformSeriesReaderType *trReader = new TransformSeriesReaderType;
     trReader->SetInput(trArg.getValue());
     trReader->SetInvertTransform(invertArg.isSet());
     trReader->SetExponentiationOrder(expOrderArg.getValue());
     trReader->SetNumberOfWorkUnits(nbpArg.getValue());
+    trReader->SetExponentialCacheDirectory(expCacheArg.getValue());
+
+    if (flattenArg.isSet())
+        trReader->SetFlatteningGeometry(imageIO.GetPointer());
 
     try
     {
@@ -112,22 +134,6 @@ int main(int ac, const char** av)
     resample->SetInterpolator(interpolator.GetPointer());
     resample->SetNumberOfWorkUnits(nbpArg.getValue());
 
-    ImageType::DirectionType directionMatrix;
-    ImageType::PointType origin;
-    ImageType::SpacingType spacing;
-    ImageType::RegionType largestRegion;
-
-    for (unsigned int i = 0;i < Dimension;++i)
-    {
-        origin[i] = imageIO->GetOrigin(i);
-        spacing[i] = imageIO->GetSpacing(i);
-        largestRegion.SetIndex(i,0);
-        largestRegion.SetSize(i,imageIO->GetDimensions(i));
-
-        for (unsigned int j = 0;j < Dimension;++j)
-            directionMatrix(i,j) = imageIO->GetDirection(j)[i];
-    }
-
     resample->SetOutputLargestPossibleRegion(largestRegion);
     resample->SetOutputOrigin(origin);
     resample->SetOutputSpacing(spacing);
@@ -3,6 +3,7 @@
 #include <itkImageToImageMetric.h>
 #include <itkCovariantVector.h>
 #include <itkPoint.h>
+#include <animaIndexSpaceLinearSampler.h>
 
 
 namespace anima
@@ -45,7 +46,12 @@ public:
     typedef typename Superclass::MovingImageConstPointer  MovingImageConstPointer;
 
 
-    /** Get the derivatives of the match measure. */
+    typedef anima::IndexSpaceLinearSampler <TFixedImage,TMovingImage> SamplerType;
+
+    /**
+     * Get the derivatives of the match measure. Analytic with respect to the moving image, only
+     * available with the fast path (linear interpolation, translation or matrix offset transforms)
+     */
     void GetDerivative(const TransformParametersType & parameters,
                        DerivativeType & Derivative) const ITK_OVERRIDE;
 
@@ -61,11 +67,18 @@ public:
     itkSetMacro(ScaleIntensities, bool)
     itkSetMacro(DefaultBackgroundValue, double)
 
+    //! Use the batched index space evaluation when transform and interpolator allow it (on by default)
+    itkSetMacro(UseFastPath, bool)
+    itkGetConstMacro(UseFastPath, bool)
+
 protected:
     FastCorrelationImageToImageMetric();
     virtual ~FastCorrelationImageToImageMetric() {}
     void PrintSelf(std::ostream& os, itk::Indent indent) const ITK_OVERRIDE;
 
+    //! Generic evaluation of moving values through the transform and interpolator
+    void ComputeMovingValues(std::vector <RealType> &movingValues) const;
+
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(FastCorrelationImageToImageMetric);
 
@@ -78,6 +91,17 @@ private:
 
     std::vector <InputPointType> m_FixedImagePoints;
     std::vector <RealType> m_FixedImageValues;
+
+    // Fast path: fixed indexes stored per dimension, batched sampler and its output buffer
+    bool m_UseFastPath;
+    std::vector <double> m_FixedImageIndexes[TFixedImage::ImageDimension];
+    mutable anima::IndexSpaceLinearSampler <TFixedImage,TMovingImage> m_FastSampler;
+    mutable std::vector <RealType> m_MovingValues;
+
+    // Derivative work buffers
+    mutable std::vector <double> m_MovingIndexGradients[TFixedImage::ImageDimension];
+    mutable std::vector <unsigned char> m_InsideBuffer;
+    mutable std::vector <double> m_PointWeights;
 };
 
 } // end of namespace anima
@@ -2,6 +2,7 @@
 #include "animaFastCorrelationImageToImageMetric.h"
 
 #include <itkImageRegionConstIteratorWithIndex.h>
+#include <vnl/algo/vnl_matrix_inverse.h>
 
 namespace anima
 {
@@ -15,6 +16,7 @@ FastCorrelationImageToImageMetric<TFixedImage,TMovingImage>
     m_DefaultBackgroundValue = 0.0;
     m_SquaredCorrelation = true;
     m_ScaleIntensities = false;
+    m_UseFastPath = true;
     m_FixedImagePoints.clear();
     m_FixedImageValues.clear();
 }
@@ -41,30 +43,43 @@ FastCorrelationImageToImageMetric<TFixedImage,TMovingImage>
     AccumulateType sfm = itk::NumericTraits< AccumulateType >::Zero;
     AccumulateType sm  = itk::NumericTraits< AccumulateType >::Zero;
 
-    OutputPointType transformedPoint;
-    ContinuousIndexType transformedIndex;
-    RealType movingValue;
+    double factor = 1.0;
+    bool fastPath = m_UseFastPath && m_FastSampler.SetTransform(this->m_Transform);
+    if (fastPath)
+    {
+        const double *fixedIndexes[TFixedImage::ImageDimension];
+        for (unsigned int i = 0;i < TFixedImage::ImageDimension;++i)
+            fixedIndexes[i] = m_FixedImageIndexes[i].data();
 
-    for (unsigned int i = 0;i < this->m_NumberOfPixelsCounted;++i)
+        m_MovingValues.resize(this->m_NumberOfPixelsCounted);
+        m_FastSampler.Sample(fixedIndexes,this->m_NumberOfPixelsCounted,m_DefaultBackgroundValue,m_MovingValues.data());
+
+        // Intensity scaling factor is constant over the block
+        if (m_ScaleIntensities)
+            factor = m_FastSampler.GetLinearPartDeterminant();
+    }
+    else
     {
-        transformedPoint = this->m_Transform->TransformPoint(m_FixedImagePoints[i]);
-        this->m_Interpolator->GetInputImage()->TransformPhysicalPointToContinuousIndex(transformedPoint,transformedIndex);
+        this->ComputeMovingValues(m_MovingValues);
 
-        movingValue = m_DefaultBackgroundValue;
-        if (this->m_Interpolator->IsInsideBuffer(transformedIndex))
-            movingValue = this->m_Interpolator->EvaluateAtContinuousIndex(transformedIndex);
+        if (m_ScaleIntensities)
+        {
+            typedef itk::MatrixOffsetTransformBase <typename TransformType::ScalarType,
+                    TFixedImage::ImageDimension, TFixedImage::ImageDimension> BaseTransformType;
+            BaseTransformType *currentTrsf = dynamic_cast<BaseTransformType *> (this->m_Transform.GetPointer());
+
+            factor = vnl_determinant(currentTrsf->GetMatrix().GetVnlMatrix());
+        }
+    }
+
+    RealType movingValue;
+    for (unsigned int i = 0;i < this->m_NumberOfPixelsCounted;++i)
+    {
+        movingValue = m_MovingValues[i];
 
         if (movingValue != 0.0)
         {
-            if (m_ScaleIntensities)
-            {
-                typedef itk::MatrixOffsetTransformBase <typename TransformType::ScalarType,
-                        TFixedImage::ImageDimension, TFixedImage::ImageDimension> BaseTransformType;
-                BaseTransformType *currentTrsf = dynamic_cast<BaseTransformType *> (this->m_Transform.GetPointer());
-
-                double factor = vnl_determinant(currentTrsf->GetMatrix().GetVnlMatrix());
-                movingValue *= factor;
-            }
+            movingValue *= factor;
 
             smm += movingValue * movingValue;
             sfm += m_FixedImageValues[i] * movingValue;
@@ -94,6 +109,26 @@ FastCorrelationImageToImageMetric<TFixedImage,TMovingImage>
     return measure;
 }
 
+template <class TFixedImage, class TMovingImage>
+void
+FastCorrelationImageToImageMetric<TFixedImage,TMovingImage>
+::ComputeMovingValues(std::vector <RealType> &movingValues) const
+{
+    OutputPointType transformedPoint;
+    ContinuousIndexType transformedIndex;
+
+    movingValues.resize(this->m_NumberOfPixelsCounted);
+    for (unsigned int i = 0;i < this->m_NumberOfPixelsCounted;++i)
+    {
+        transformedPoint = this->m_Transform->TransformPoint(m_FixedImagePoints[i]);
+        this->m_Interpolator->GetInputImage()->TransformPhysicalPointToContinuousIndex(transformedPoint,transformedIndex);
+
+        movingValues[i] = m_DefaultBackgroundValue;
+        if (this->m_Interpolator->IsInsideBuffer(transformedIndex))
+            movingValues[i] = this->m_Interpolator->EvaluateAtContinuousIndex(transformedIndex);
+    }
+}
+
 template < class TFixedImage, class TMovingImage>
 void
 FastCorrelationImageToImageMetric<TFixedImage,TMovingImage>
@@ -119,6 +154,11 @@ FastCorrelationImageToImageMetric<TFixedImage,TMovingImage>
 
     m_FixedImagePoints.resize(this->m_NumberOfPixelsCounted);
     m_FixedImageValues.resize(this->m_NumberOfPixelsCounted);
+    for (unsigned int i = 0;i < TFixedImage::ImageDimension;++i)
+        m_FixedImageIndexes[i].resize(this->m_NumberOfPixelsCounted);
+
+    if (m_UseFastPath)
+        m_FastSampler.SetImages(fixedImage,this->m_Interpolator);
 
     InputPointType inputPoint;
 
@@ -130,6 +170,9 @@ FastCorrelationImageToImageMetric<TFixedImage,TMovingImage>
         fixedImage->TransformIndexToPhysicalPoint( index, inputPoint );
 
         m_FixedImagePoints[pos] = inputPoint;
+        for (unsigned int i = 0;i < TFixedImage::ImageDimension;++i)
+            m_FixedImageIndexes[i][pos] = index[i];
+
         fixedValue = ti.Value();
         m_FixedImageValues[pos] = fixedValue;
 
@@ -149,7 +192,8 @@ FastCorrelationImageToImageMetric<TFixedImage,TMovingImage>
 ::GetDerivative( const TransformParametersType & parameters,
                 DerivativeType & derivative ) const
 {
-    itkExceptionMacro("Derivative not implemented yet...");
+    MeasureType value;
+    this->GetValueAndDerivative(parameters,value,derivative);
 }
 
 template <class TFixedImage, class TMovingImage>
@@ -158,7 +202,127 @@ FastCorrelationImageToImageMetric<TFixedImage,TMovingImage>
 ::GetValueAndDerivative(const TransformParametersType & parameters,
                         MeasureType & value, DerivativeType  & derivative) const
 {
-    itkExceptionMacro("Derivative not implemented yet...");
+    FixedImageConstPointer fixedImage = this->m_FixedImage;
+
+    if (!fixedImage)
+        itkExceptionMacro( << "Fixed image has not been assigned" );
+
+    unsigned int numParameters = this->m_Transform->GetNumberOfParameters();
+    derivative.SetSize(numParameters);
+    derivative.Fill(0.0);
+
+    if (this->m_NumberOfPixelsCounted == 0)
+    {
+        value = 0;
+        return;
+    }
+
+    this->SetTransformParameters(parameters);
+
+    vnl_matrix <double> affineJacobian;
+    if (!m_UseFastPath || !SamplerType::ComputeAffineParametersJacobian(this->m_Transform,affineJacobian)
+            || !m_FastSampler.SetTransform(this->m_Transform))
+        itkExceptionMacro("Derivative only available for linear interpolation and affine block transforms");
+
+    const unsigned int numPoints = this->m_NumberOfPixelsCounted;
+    const double *fixedIndexes[TFixedImage::ImageDimension];
+    double *indexGradients[TFixedImage::ImageDimension];
+    for (unsigned int i = 0;i < TFixedImage::ImageDimension;++i)
+    {
+        fixedIndexes[i] = m_FixedImageIndexes[i].data();
+        m_MovingIndexGradients[i].resize(numPoints);
+        indexGradients[i] = m_MovingIndexGradients[i].data();
+    }
+
+    m_MovingValues.resize(numPoints);
+    m_InsideBuffer.resize(numPoints);
+    m_FastSampler.SampleWithGradient(fixedIndexes,numPoints,m_DefaultBackgroundValue,m_MovingValues.data(),
+                                     indexGradients,m_InsideBuffer.data());
+
+    double factor = 1.0;
+    if (m_ScaleIntensities)
+        factor = m_FastSampler.GetLinearPartDeterminant();
+
+    double smm = 0, sfm = 0, sm = 0;
+    for (unsigned int i = 0;i < numPoints;++i)
+    {
+        double movingValue = m_MovingValues[i];
+        if (movingValue != 0.0)
+        {
+            movingValue *= factor;
+
+            smm += movingValue * movingValue;
+            sfm += m_FixedImageValues[i] * movingValue;
+            sm += movingValue;
+        }
+    }
+
+    double movingVariance = smm - sm * sm / numPoints;
+    double covData = sfm - m_SumFixed * sm / numPoints;
+    double multVars = m_VarFixed * movingVariance;
+
+    if ((numPoints <= 1) || (multVars <= 1.0e-16))
+    {
+        value = m_SquaredCorrelation ? 0.0 : -1.0;
+        return;
+    }
+
+    // Derivative of the measure with respect to each scaled moving value
+    double meanFixed = m_SumFixed / numPoints;
+    double meanMoving = sm / numPoints;
+    double covFactor, varFactor;
+    if (m_SquaredCorrelation)
+    {
+        value = covData * covData / multVars;
+        covFactor = 2.0 * covData / multVars;
+        varFactor = - 2.0 * value / movingVariance;
+    }
+    else
+    {
+        double correlation = covData / std::sqrt(multVars);
+        value = std::max(-1.0,correlation);
+        if (correlation <= -1.0)
+            return;
+
+        covFactor = 1.0 / std::sqrt(multVars);
+        varFactor = - correlation / movingVariance;
+    }
+
+    m_PointWeights.resize(numPoints);
+    double scaleWeight = 0;
+    for (unsigned int i = 0;i < numPoints;++i)
+    {
+        m_PointWeights[i] = 0;
+        if (m_MovingValues[i] == 0.0)
+            continue;
+
+        double weight = covFactor * (m_FixedImageValues[i] - meanFixed) + varFactor * (factor * m_MovingValues[i] - meanMoving);
+        scaleWeight += weight * m_MovingValues[i];
+        m_PointWeights[i] = weight * factor;
+    }
+
+    vnl_vector <double> affineGradient;
+    m_FastSampler.AccumulateAffineGradient(fixedIndexes,indexGradients,m_PointWeights.data(),numPoints,affineGradient);
+
+    // Intensity scaling by det(M) adds det(M) M^-T times the weighted sum of unscaled values
+    if (m_ScaleIntensities)
+    {
+        const unsigned int dimension = TFixedImage::ImageDimension;
+        vnl_matrix_inverse <double> invTransformMatrix(m_FastSampler.GetTransformMatrix().as_matrix());
+        vnl_matrix <double> inverseMatrix = invTransformMatrix.inverse();
+        for (unsigned int i = 0;i < dimension;++i)
+            for (unsigned int j = 0;j < dimension;++j)
+                affineGradient[i * dimension + j] += scaleWeight * factor * inverseMatrix(j,i);
+    }
+
+    for (unsigned int k = 0;k < numParameters;++k)
+    {
+        double derivativeValue = 0;
+        for (unsigned int i = 0;i < affineGradient.size();++i)
+            derivativeValue += affineGradient[i] * affineJacobian(i,k);
+
+        derivative[k] = derivativeValue;
+    }
 }
 
 template < class TFixedImage, class TMovingImage>
@@ -3,6 +3,7 @@
 #include "itkImageToImageMetric.h"
 #include "itkCovariantVector.h"
 #include "itkPoint.h"
+#include <animaIndexSpaceLinearSampler.h>
 
 namespace anima
 {
@@ -44,7 +45,12 @@ public:
     typedef typename Superclass::MovingImageConstPointer  MovingImageConstPointer;
 
 
-    /** Get the derivatives of the match measure. */
+    typedef anima::IndexSpaceLinearSampler <TFixedImage,TMovingImage> SamplerType;
+
+    /**
+     * Get the derivatives of the match measure. Analytic with respect to the moving image, only
+     * available with the fast path (linear interpolation, translation or matrix offset transforms)
+     */
     void GetDerivative(const TransformParametersType & parameters,
                        DerivativeType & Derivative) const ITK_OVERRIDE;
 
@@ -58,6 +64,10 @@ public:
     itkSetMacro(ScaleIntensities, bool)
     itkSetMacro(DefaultBackgroundValue, double)
 
+    //! Use the batched index space evaluation when transform and interpolator allow it (on by default)
+    itkSetMacro(UseFastPath, bool)
+    itkGetConstMacro(UseFastPath, bool)
+
     void PreComputeFixedValues();
 
 protected:
@@ -73,6 +83,15 @@ private:
 
     std::vector <InputPointType> m_FixedImagePoints;
     std::vector <RealType> m_FixedImageValues;
+
+    // Fast path: fixed indexes stored per dimension, batched sampler and work buffers
+    bool m_UseFastPath;
+    std::vector <double> m_FixedImageIndexes[TFixedImage::ImageDimension];
+    mutable SamplerType m_FastSampler;
+    mutable std::vector <double> m_MovingValues;
+    mutable std::vector <double> m_MovingIndexGradients[TFixedImage::ImageDimension];
+    mutable std::vector <unsigned char> m_InsideBuffer;
+    mutable std::vector <double> m_PointWeights;
 };
 
 } // end namespace anima
@@ -2,6 +2,7 @@
 #include "animaFastMeanSquaresImageToImageMetric.h"
 
 #include <itkImageRegionConstIteratorWithIndex.h>
+#include <vnl/algo/vnl_matrix_inverse.h>
 
 namespace anima
 {
@@ -12,6 +13,7 @@ FastMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
 {
     m_ScaleIntensities = false;
     m_DefaultBackgroundValue = 0.0;
+    m_UseFastPath = true;
 }
 
 template <class TFixedImage, class TMovingImage>
@@ -32,6 +34,34 @@ FastMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
     MeasureType measure = 0;
     this->SetTransformParameters( parameters );
 
+    if (m_UseFastPath && m_FastSampler.SetTransform(this->m_Transform))
+    {
+        const double *fixedIndexes[TFixedImage::ImageDimension];
+        for (unsigned int i = 0;i < TFixedImage::ImageDimension;++i)
+            fixedIndexes[i] = m_FixedImageIndexes[i].data();
+
+        unsigned int numPoints = this->m_NumberOfPixelsCounted;
+        m_MovingValues.resize(numPoints);
+        m_InsideBuffer.resize(numPoints);
+        m_FastSampler.Sample(fixedIndexes,numPoints,m_DefaultBackgroundValue,m_MovingValues.data(),m_InsideBuffer.data());
+
+        // Only values inside the moving buffer are scaled, as in the generic path
+        if (m_ScaleIntensities)
+        {
+            double factor = m_FastSampler.GetLinearPartDeterminant();
+            for (unsigned int i = 0;i < numPoints;++i)
+            {
+                if (m_InsideBuffer[i])
+                    m_MovingValues[i] *= factor;
+            }
+        }
+
+        for (unsigned int i = 0;i < numPoints;++i)
+            measure += (m_MovingValues[i] - m_FixedImageValues[i]) * (m_MovingValues[i] - m_FixedImageValues[i]);
+
+        return measure / numPoints;
+    }
+
     OutputPointType transformedPoint;
     ContinuousIndexType transformedIndex;
     RealType movingValue;
@@ -72,7 +102,8 @@ FastMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
 ::GetDerivative( const TransformParametersType & parameters,
                  DerivativeType & derivative ) const
 {
-    itkExceptionMacro("Derivative not implemented yet...");
+    MeasureType value;
+    this->GetValueAndDerivative(parameters,value,derivative);
 }
 
 template <class TFixedImage, class TMovingImage>
@@ -81,7 +112,90 @@ FastMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
 ::GetValueAndDerivative(const TransformParametersType & parameters,
                         MeasureType & value, DerivativeType  & derivative) const
 {
-    itkExceptionMacro("Derivative not implemented yet...");
+    FixedImageConstPointer fixedImage = this->m_FixedImage;
+
+    if( !fixedImage )
+    {
+        itkExceptionMacro( << "Fixed image has not been assigned" );
+    }
+
+    unsigned int numParameters = this->m_Transform->GetNumberOfParameters();
+    derivative.SetSize(numParameters);
+    derivative.Fill(0.0);
+    value = 0;
+
+    if (this->m_NumberOfPixelsCounted == 0)
+        return;
+
+    this->SetTransformParameters(parameters);
+
+    vnl_matrix <double> affineJacobian;
+    if (!m_UseFastPath || !SamplerType::ComputeAffineParametersJacobian(this->m_Transform,affineJacobian)
+            || !m_FastSampler.SetTransform(this->m_Transform))
+        itkExceptionMacro("Derivative only available for linear interpolation and affine block transforms");
+
+    const unsigned int numPoints = this->m_NumberOfPixelsCounted;
+    const double *fixedIndexes[TFixedImage::ImageDimension];
+    double *indexGradients[TFixedImage::ImageDimension];
+    for (unsigned int i = 0;i < TFixedImage::ImageDimension;++i)
+    {
+        fixedIndexes[i] = m_FixedImageIndexes[i].data();
+        m_MovingIndexGradients[i].resize(numPoints);
+        indexGradients[i] = m_MovingIndexGradients[i].data();
+    }
+
+    m_MovingValues.resize(numPoints);
+    m_InsideBuffer.resize(numPoints);
+    m_FastSampler.SampleWithGradient(fixedIndexes,numPoints,m_DefaultBackgroundValue,m_MovingValues.data(),
+                                     indexGradients,m_InsideBuffer.data());
+
+    double factor = 1.0;
+    if (m_ScaleIntensities)
+        factor = m_FastSampler.GetLinearPartDeterminant();
+
+    // Derivative of the measure with respect to each moving value, background values are constant
+    m_PointWeights.resize(numPoints);
+    double scaleWeight = 0;
+    for (unsigned int i = 0;i < numPoints;++i)
+    {
+        double movingValue = m_MovingValues[i];
+        m_PointWeights[i] = 0;
+
+        if (m_InsideBuffer[i])
+        {
+            movingValue *= factor;
+            double weight = 2.0 * (movingValue - m_FixedImageValues[i]) / numPoints;
+            m_PointWeights[i] = weight * factor;
+            scaleWeight += weight * m_MovingValues[i];
+        }
+
+        value += (movingValue - m_FixedImageValues[i]) * (movingValue - m_FixedImageValues[i]);
+    }
+
+    value /= numPoints;
+
+    vnl_vector <double> affineGradient;
+    m_FastSampler.AccumulateAffineGradient(fixedIndexes,indexGradients,m_PointWeights.data(),numPoints,affineGradient);
+
+    // Intensity scaling by det(M) adds det(M) M^-T times the weighted sum of unscaled values
+    if (m_ScaleIntensities)
+    {
+        const unsigned int dimension = TFixedImage::ImageDimension;
+        vnl_matrix_inverse <double> invTransformMatrix(m_FastSampler.GetTransformMatrix().as_matrix());
+        vnl_matrix <double> inverseMatrix = invTransformMatrix.inverse();
+        for (unsigned int i = 0;i < dimension;++i)
+            for (unsigned int j = 0;j < dimension;++j)
+                affineGradient[i * dimension + j] += scaleWeight * factor * inverseMatrix(j,i);
+    }
+
+    for (unsigned int k = 0;k < numParameters;++k)
+    {
+        double derivativeValue = 0;
+        for (unsigned int i = 0;i < affineGradient.size();++i)
+            derivativeValue += affineGradient[i] * affineJacobian(i,k);
+
+        derivative[k] = derivativeValue;
+    }
 }
 
 template <class TFixedImage, class TMovingImage>
@@ -107,6 +221,11 @@ FastMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
 
     m_FixedImagePoints.resize(this->m_NumberOfPixelsCounted);
     m_FixedImageValues.resize(this->m_NumberOfPixelsCounted);
+    for (unsigned int i = 0;i < TFixedImage::ImageDimension;++i)
+        m_FixedImageIndexes[i].resize(this->m_NumberOfPixelsCounted);
+
+    if (m_UseFastPath)
+        m_FastSampler.SetImages(fixedImage,this->m_Interpolator);
 
     InputPointType inputPoint;
 
@@ -119,6 +238,9 @@ FastMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
         fixedImage->TransformIndexToPhysicalPoint( index, inputPoint );
 
         m_FixedImagePoints[pos] = inputPoint;
+        for (unsigned int i = 0;i < TFixedImage::ImageDimension;++i)
+            m_FixedImageIndexes[i][pos] = index[i];
+
         fixedValue = ti.Value();
         m_FixedImageValues[pos] = fixedValue;
 
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <itkLinearInterpolateImageFunction.h>
+#include <itkMatrixOffsetTransformBase.h>
+#include <itkTranslationTransform.h>
+#include <vnl/vnl_matrix.h>
+#include <vnl/vnl_vector.h>
+#include <vnl/vnl_matrix_fixed.h>
+#include <vnl/vnl_vector_fixed.h>
+
+namespace anima
+{
+
+/**
+ * @brief Batched trilinear sampler of a scalar moving image for block matching metrics.
+ * The block transform and the geometries of both images are folded into a single affine map
+ * from fixed image indexes to moving image continuous indexes. A whole block is then mapped and
+ * sampled in fixed size batches stored as structures of arrays, avoiding per point virtual calls.
+ * Only linear interpolation of images with translation or matrix offset transforms is handled,
+ * IsUsable / SetTransform return false otherwise so that the caller falls back on ITK.
+ * Sampled values match those of itk::LinearInterpolateImageFunction (same border handling).
+ */
+template <class TFixedImage, class TMovingImage>
+class IndexSpaceLinearSampler
+{
+public:
+    IndexSpaceLinearSampler();
+    virtual ~IndexSpaceLinearSampler() {}
+
+    itkStaticConstMacro(ImageDimension, unsigned int, TFixedImage::ImageDimension);
+
+    typedef TFixedImage FixedImageType;
+    typedef TMovingImage MovingImageType;
+    typedef typename MovingImageType::PixelType MovingPixelType;
+    typedef itk::InterpolateImageFunction <MovingImageType,double> InterpolatorType;
+    typedef itk::LinearInterpolateImageFunction <MovingImageType,double> LinearInterpolatorType;
+    typedef itk::Transform <double,ImageDimension,ImageDimension> TransformType;
+
+    typedef vnl_matrix_fixed <double,ImageDimension,ImageDimension> MatrixType;
+    typedef vnl_vector_fixed <double,ImageDimension> VectorType;
+
+    //! Number of points mapped and sampled together
+    static constexpr unsigned int BatchSize = 64;
+
+    /**
+     * Sets up images and interpolator, to be called whenever one of them changes.
+     * Returns false if the configuration is not supported by the fast path
+     */
+    bool SetImages(const FixedImageType *fixedImage, const InterpolatorType *interpolator);
+    bool IsUsable() const {return m_Usable;}
+
+    //! Folds the transform into the index to index map. Returns false for non affine transforms
+    bool SetTransform(const TransformType *transform);
+
+    //! Determinant of the linear part of the last transform set (for intensity scaling)
+    double GetLinearPartDeterminant() const {return m_LinearPartDeterminant;}
+
+    const MatrixType &GetIndexToIndexMatrix() const {return m_IndexToIndexMatrix;}
+    const VectorType &GetIndexToIndexOffset() const {return m_IndexToIndexOffset;}
+    const MatrixType &GetMovingPhysicalToIndexMatrix() const {return m_MovingPhysicalToIndexMatrix;}
+    //! Linear part of the last transform set
+    const MatrixType &GetTransformMatrix() const {return m_TransformMatrix;}
+
+    /**
+     * Samples the moving image at the transformed positions of fixed indexes given as one
+     * array per dimension. Points falling outside the moving buffer get backgroundValue,
+     * insideBuffer (optional) flags points that were inside.
+     */
+    void Sample(const double * const *fixedIndexes, unsigned int numPoints,
+                double backgroundValue, double *values, unsigned char *insideBuffer = ITK_NULLPTR) const;
+
+    /**
+     * Same as Sample, also providing the gradient of the trilinear interpolant with respect to
+     * the moving continuous index (one array per dimension) and whether each point was inside
+     * the moving buffer. Gradients are zero outside the buffer and on clamped borders.
+     */
+    void SampleWithGradient(const double * const *fixedIndexes, unsigned int numPoints,
+                            double backgroundValue, double *values, double * const *indexGradients,
+                            unsigned char *insideBuffer) const;
+
+    /**
+     * Accumulates the sum over points of pointWeights times the derivative of the sampled moving value with
+     * respect to the affine coefficients of the transform (matrix in row major order, then offset),
+     * from index gradients given by SampleWithGradient
+     */
+    void AccumulateAffineGradient(const double * const *fixedIndexes, const double * const *indexGradients,
+                                  const double *pointWeights, unsigned int numPoints, vnl_vector <double> &affineGradient) const;
+
+    /**
+     * Computes the derivative of the affine coefficients of the transform (matrix in row major order,
+     * then offset) with respect to its parameters. Exact for translations, obtained by central
+     * differences of the parameterization for other matrix offset transforms, whose parameters are
+     * restored afterwards. Returns false for non affine transforms
+     */
+    static bool ComputeAffineParametersJacobian(TransformType *transform, vnl_matrix <double> &jacobian);
+
+protected:
+    //! Multilinear evaluation (and index space gradient if not null) from the cell corners, for any dimension
+    static inline double InterpolateCorners(const MovingPixelType *basePtr, const long *upperSteps, const double *weights,
+                                            double *gradient);
+
+    //! Trilinear evaluation at one continuous index known to be inside the buffer (multilinear if not 3D)
+    inline double InterpolateInside(const double *contIndex) const;
+
+    //! Trilinear evaluation and index space gradient at one continuous index known to be inside the buffer (multilinear if not 3D)
+    inline double InterpolateInsideWithGradient(const double *contIndex, double *gradient) const;
+
+    //! Affine mapping of a batch of fixed indexes, flags points inside the moving buffer
+    inline void MapBatch(const double * const *fixedIndexes, unsigned int batchStart, unsigned int batchLength,
+                         double contIndexes[][BatchSize], bool *insideBuffer) const;
+
+private:
+    bool m_Usable;
+
+    const MovingPixelType *m_MovingBuffer;
+    long m_BufferStart[ImageDimension];
+    long m_EndIndex[ImageDimension];
+    long m_Strides[ImageDimension];
+    double m_StartContinuousIndex[ImageDimension];
+    double m_EndContinuousIndex[ImageDimension];
+
+    // Fixed index to fixed physical point
+    MatrixType m_FixedIndexToPhysicalMatrix;
+    VectorType m_FixedOrigin;
+
+    // Moving physical point to moving continuous index
+    MatrixType m_MovingPhysicalToIndexMatrix;
+    VectorType m_MovingOrigin;
+
+    // Combined fixed index to moving continuous index map
+    MatrixType m_IndexToIndexMatrix;
+    VectorType m_IndexToIndexOffset;
+    MatrixType m_TransformMatrix;
+    double m_LinearPartDeterminant;
+};
+
+} // end namespace anima
+
+#include "animaIndexSpaceLinearSampler.hxx"
@@ -0,0 +1,479 @@
+#pragma once
+#include "animaIndexSpaceLinearSampler.h"
+
+#include <vnl/algo/vnl_determinant.h>
+#include <cmath>
+
+namespace anima
+{
+
+template <class TFixedImage, class TMovingImage>
+IndexSpaceLinearSampler<TFixedImage,TMovingImage>
+::IndexSpaceLinearSampler()
+{
+    m_Usable = false;
+    m_MovingBuffer = ITK_NULLPTR;
+    m_LinearPartDeterminant = 1.0;
+
+    m_IndexToIndexMatrix.set_identity();
+    m_IndexToIndexOffset.fill(0.0);
+    m_TransformMatrix.set_identity();
+}
+
+template <class TFixedImage, class TMovingImage>
+bool
+IndexSpaceLinearSampler<TFixedImage,TMovingImage>
+::SetImages(const FixedImageType *fixedImage, const InterpolatorType *interpolator)
+{
+    m_Usable = false;
+
+    if ((!fixedImage) || (!interpolator))
+        return false;
+
+    const LinearInterpolatorType *linearInterpolator = dynamic_cast <const LinearInterpolatorType *> (interpolator);
+    if (!linearInterpolator)
+        return false;
+
+    const MovingImageType *movingImage = linearInterpolator->GetInputImage();
+    if (!movingImage)
+        return false;
+
+    m_MovingBuffer = movingImage->GetBufferPointer();
+    const typename MovingImageType::OffsetValueType *offsetTable = movingImage->GetOffsetTable();
+    typename MovingImageType::IndexType bufferStart = movingImage->GetBufferedRegion().GetIndex();
+
+    for (unsigned int i = 0;i < ImageDimension;++i)
+    {
+        m_BufferStart[i] = bufferStart[i];
+        m_EndIndex[i] = linearInterpolator->GetEndIndex()[i];
+        m_Strides[i] = offsetTable[i];
+        m_StartContinuousIndex[i] = linearInterpolator->GetStartContinuousIndex()[i];
+        m_EndContinuousIndex[i] = linearInterpolator->GetEndContinuousIndex()[i];
+
+        m_FixedOrigin[i] = fixedImage->GetOrigin()[i];
+        m_MovingOrigin[i] = movingImage->GetOrigin()[i];
+
+        for (unsigned int j = 0;j < ImageDimension;++j)
+        {
+            m_FixedIndexToPhysicalMatrix(i,j) = fixedImage->GetDirection()(i,j) * fixedImage->GetSpacing()[j];
+            m_MovingPhysicalToIndexMatrix(i,j) = movingImage->GetPhysicalPointToIndexMatrix()(i,j);
+        }
+    }
+
+    m_Usable = true;
+    return true;
+}
+
+template <class TFixedImage, class TMovingImage>
+bool
+IndexSpaceLinearSampler<TFixedImage,TMovingImage>
+::SetTransform(const TransformType *transform)
+{
+    if (!m_Usable)
+        return false;
+
+    MatrixType linearPart;
+    VectorType offset;
+
+    typedef itk::MatrixOffsetTransformBase <double,ImageDimension,ImageDimension> MatrixOffsetTransformType;
+    typedef itk::TranslationTransform <double,ImageDimension> TranslationTransformType;
+
+    if (const MatrixOffsetTransformType *matrixTrsf = dynamic_cast <const MatrixOffsetTransformType *> (transform))
+    {
+        for (unsigned int i = 0;i < ImageDimension;++i)
+        {
+            offset[i] = matrixTrsf->GetOffset()[i];
+            for (unsigned int j = 0;j < ImageDimension;++j)
+                linearPart(i,j) = matrixTrsf->GetMatrix()(i,j);
+        }
+
+        m_LinearPartDeterminant = vnl_determinant(linearPart);
+    }
+    else if (const TranslationTransformType *translationTrsf = dynamic_cast <const TranslationTransformType *> (transform))
+    {
+        linearPart.set_identity();
+        for (unsigned int i = 0;i < ImageDimension;++i)
+            offset[i] = translationTrsf->GetOffset()[i];
+
+        m_LinearPartDeterminant = 1.0;
+    }
+    else
+        return false;
+
+    // y = T (F i + o_f) + t, moving index = P (y - o_m)
+    m_IndexToIndexMatrix = m_MovingPhysicalToIndexMatrix * linearPart * m_FixedIndexToPhysicalMatrix;
+    m_IndexToIndexOffset = m_MovingPhysicalToIndexMatrix * (linearPart * m_FixedOrigin + offset - m_MovingOrigin);
+    m_TransformMatrix = linearPart;
+
+    return true;
+}
+
+template <class TFixedImage, class TMovingImage>
+bool
+IndexSpaceLinearSampler<TFixedImage,TMovingImage>
+::ComputeAffineParametersJacobian(TransformType *transform, vnl_matrix <double> &jacobian)
+{
+    typedef itk::MatrixOffsetTransformBase <double,ImageDimension,ImageDimension> MatrixOffsetTransformType;
+    typedef itk::TranslationTransform <double,ImageDimension> TranslationTransformType;
+
+    const unsigned int numAffineCoefficients = ImageDimension * (ImageDimension + 1);
+    unsigned int numParameters = transform->GetNumberOfParameters();
+    jacobian.set_size(numAffineCoefficients,numParameters);
+    jacobian.fill(0.0);
+
+    if (dynamic_cast <TranslationTransformType *> (transform))
+    {
+        for (unsigned int i = 0;i < ImageDimension;++i)
+            jacobian(ImageDimension * ImageDimension + i,i) = 1.0;
+
+        return true;
+    }
+
+    MatrixOffsetTransformType *matrixTrsf = dynamic_cast <MatrixOffsetTransformType *> (transform);
+    if (!matrixTrsf)
+        return false;
+
+    // Parameters are angles, log-scales or translations in mm, a fixed step is accurate enough for all
+    const double parameterStep = 1.0e-6;
+    typename TransformType::ParametersType initialParameters = transform->GetParameters();
+    typename TransformType::ParametersType shiftedParameters = initialParameters;
+
+    for (unsigned int k = 0;k < numParameters;++k)
+    {
+        for (int sign = -1;sign <= 1;sign += 2)
+        {
+            shiftedParameters[k] = initialParameters[k] + sign * parameterStep;
+            transform->SetParameters(shiftedParameters);
+
+            for (unsigned int i = 0;i < ImageDimension;++i)
+            {
+                for (unsigned int j = 0;j < ImageDimension;++j)
+                    jacobian(i * ImageDimension + j,k) += sign * matrixTrsf->GetMatrix()(i,j) / (2.0 * parameterStep);
+
+                jacobian(ImageDimension * ImageDimension + i,k) += sign * matrixTrsf->GetOffset()[i] / (2.0 * parameterStep);
+            }
+        }
+
+        shiftedParameters[k] = initialParameters[k];
+    }
+
+    transform->SetParameters(initialParameters);
+    return true;
+}
+
+template <class TFixedImage, class TMovingImage>
+inline double
+IndexSpaceLinearSampler<TFixedImage,TMovingImage>
+::InterpolateCorners(const MovingPixelType *basePtr, const long *upperSteps, const double *weights, double *gradient)
+{
+    // Sum over the 2^ImageDimension corners of the cell, each weighted by the product of its per axis weights
+    double value = 0;
+    if (gradient)
+    {
+        for (unsigned int i = 0;i < ImageDimension;++i)
+            gradient[i] = 0;
+    }
+
+    for (unsigned int corner = 0;corner < (1U << ImageDimension);++corner)
+    {
+        long offset = 0;
+        double axisWeights[ImageDimension];
+        for (unsigned int i = 0;i < ImageDimension;++i)
+        {
+            bool upper = (corner >> i) & 1;
+            axisWeights[i] = upper ? weights[i] : 1.0 - weights[i];
+            if (upper)
+                offset += upperSteps[i];
+        }
+
+        double cornerValue = basePtr[offset];
+        double cornerWeight = 1.0;
+        for (unsigned int i = 0;i < ImageDimension;++i)
+            cornerWeight *= axisWeights[i];
+
+        value += cornerWeight * cornerValue;
+
+        if (!gradient)
+            continue;
+
+        for (unsigned int i = 0;i < ImageDimension;++i)
+        {
+            double derivativeWeight = ((corner >> i) & 1) ? 1.0 : -1.0;
+            for (unsigned int j = 0;j < ImageDimension;++j)
+            {
+                if (j != i)
+                    derivativeWeight *= axisWeights[j];
+            }
+
+            gradient[i] += derivativeWeight * cornerValue;
+        }
+    }
+
+    return value;
+}
+
+template <class TFixedImage, class TMovingImage>
+inline double
+IndexSpaceLinearSampler<TFixedImage,TMovingImage>
+::InterpolateInside(const double *contIndex) const
+{
+    // Same border handling as itk::LinearInterpolateImageFunction: lower corner clamped to the
+    // buffer start, upper neighbour replaced by the lower one past the buffer end
+    long baseOffset = 0;
+    long upperSteps[ImageDimension];
+    double weights[ImageDimension];
+
+    for (unsigned int i = 0;i < ImageDimension;++i)
+    {
+        long lowerIndex = static_cast <long> (std::floor(contIndex[i]));
+        if (lowerIndex < m_BufferStart[i])
+            lowerIndex = m_BufferStart[i];
+
+        weights[i] = std::max(contIndex[i] - lowerIndex, 0.0);
+        upperSteps[i] = (lowerIndex < m_EndIndex[i]) ? m_Strides[i] : 0;
+        baseOffset += (lowerIndex - m_BufferStart[i]) * m_Strides[i];
+    }
+
+    const MovingPixelType *basePtr = m_MovingBuffer + baseOffset;
+
+    if constexpr (ImageDimension != 3)
+        return InterpolateCorners(basePtr,upperSteps,weights,ITK_NULLPTR);
+    else
+    {
+        double v00 = (1.0 - weights[0]) * basePtr[0] + weights[0] * basePtr[upperSteps[0]];
+        double v10 = (1.0 - weights[0]) * basePtr[upperSteps[1]] + weights[0] * basePtr[upperSteps[1] + upperSteps[0]];
+        double v01 = (1.0 - weights[0]) * basePtr[upperSteps[2]] + weights[0] * basePtr[upperSteps[2] + upperSteps[0]];
+        double v11 = (1.0 - weights[0]) * basePtr[upperSteps[2] + upperSteps[1]]
+                + weights[0] * basePtr[upperSteps[2] + upperSteps[1] + upperSteps[0]];
+
+        double v0 = (1.0 - weights[1]) * v00 + weights[1] * v10;
+        double v1 = (1.0 - weights[1]) * v01 + weights[1] * v11;
+
+        return (1.0 - weights[2]) * v0 + weights[2] * v1;
+    }
+}
+
+template <class TFixedImage, class TMovingImage>
+inline double
+IndexSpaceLinearSampler<TFixedImage,TMovingImage>
+::InterpolateInsideWithGradient(const double *contIndex, double *gradient) const
+{
+    long baseOffset = 0;
+    long upperSteps[ImageDimension];
+    double weights[ImageDimension];
+    bool clampedAxis[ImageDimension];
+
+    for (unsigned int i = 0;i < ImageDimension;++i)
+    {
+        long lowerIndex = static_cast <long> (std::floor(contIndex[i]));
+        if (lowerIndex < m_BufferStart[i])
+            lowerIndex = m_BufferStart[i];
+
+        weights[i] = std::max(contIndex[i] - lowerIndex, 0.0);
+        upperSteps[i] = (lowerIndex < m_EndIndex[i]) ? m_Strides[i] : 0;
+        clampedAxis[i] = (contIndex[i] < lowerIndex) || (upperSteps[i] == 0);
+        baseOffset += (lowerIndex - m_BufferStart[i]) * m_Strides[i];
+    }
+
+    const MovingPixelType *basePtr = m_MovingBuffer + baseOffset;
+
+    double value = 0;
+    if constexpr (ImageDimension != 3)
+        value = InterpolateCorners(basePtr,upperSteps,weights,gradient);
+    else
+    {
+        double c000 = basePtr[0];
+        double c100 = basePtr[upperSteps[0]];
+        double c010 = basePtr[upperSteps[1]];
+        double c110 = basePtr[upperSteps[1] + upperSteps[0]];
+        double c001 = basePtr[upperSteps[2]];
+        double c101 = basePtr[upperSteps[2] + upperSteps[0]];
+        double c011 = basePtr[upperSteps[2] + upperSteps[1]];
+        double c111 = basePtr[upperSteps[2] + upperSteps[1] + upperSteps[0]];
+
+        double v00 = (1.0 - weights[0]) * c000 + weights[0] * c100;
+        double v10 = (1.0 - weights[0]) * c010 + weights[0] * c110;
+        double v01 = (1.0 - weights[0]) * c001 + weights[0] * c101;
+        double v11 = (1.0 - weights[0]) * c011 + weights[0] * c111;
+
+        double v0 = (1.0 - weights[1]) * v00 + weights[1] * v10;
+        double v1 = (1.0 - weights[1]) * v01 + weights[1] * v11;
+
+        gradient[0] = (1.0 - weights[2]) * ((1.0 - weights[1]) * (c100 - c000) + weights[1] * (c110 - c010))
+                + weights[2] * ((1.0 - weights[1]) * (c101 - c001) + weights[1] * (c111 - c011));
+        gradient[1] = (1.0 - weights[2]) * (v10 - v00) + weights[2] * (v11 - v01);
+        gradient[2] = v1 - v0;
+
+        value = (1.0 - weights[2]) * v0 + weights[2] * v1;
+    }
+
+    for (unsigned int i = 0;i < ImageDimension;++i)
+    {
+        if (clampedAxis[i])
+            gradient[i] = 0.0;
+    }
+
+    return value;
+}
+
+template <class TFixedImage, class TMovingImage>
+inline void
+IndexSpaceLinearSampler<TFixedImage,TMovingImage>
+::MapBatch(const double * const *fixedIndexes, unsigned int batchStart, unsigned int batchLength,
+           double contIndexes[][BatchSize], bool *insideBuffer) const
+{
+    // Affine mapping of the whole batch, written as plain loops over contiguous arrays for vectorization
+    for (unsigned int i = 0;i < ImageDimension;++i)
+    {
+        double *outIndexes = contIndexes[i];
+        for (unsigned int k = 0;k < batchLength;++k)
+            outIndexes[k] = m_IndexToIndexOffset[i];
+
+        for (unsigned int j = 0;j < ImageDimension;++j)
+        {
+            const double coefficient = m_IndexToIndexMatrix(i,j);
+            const double *inIndexes = fixedIndexes[j] + batchStart;
+            for (unsigned int k = 0;k < batchLength;++k)
+                outIndexes[k] += coefficient * inIndexes[k];
+        }
+    }
+
+    for (unsigned int k = 0;k < batchLength;++k)
+        insideBuffer[k] = true;
+
+    for (unsigned int i = 0;i < ImageDimension;++i)
+    {
+        for (unsigned int k = 0;k < batchLength;++k)
+        {
+            // Written so that NaN indexes are outside, as in ITK
+            insideBuffer[k] = insideBuffer[k] && (contIndexes[i][k] >= m_StartContinuousIndex[i])
+                    && (contIndexes[i][k] < m_EndContinuousIndex[i]);
+        }
+    }
+}
+
+template <class TFixedImage, class TMovingImage>
+void
+IndexSpaceLinearSampler<TFixedImage,TMovingImage>
+::Sample(const double * const *fixedIndexes, unsigned int numPoints,
+         double backgroundValue, double *values, unsigned char *insideBuffer) const
+{
+    double contIndexes[ImageDimension][BatchSize];
+    bool batchInside[BatchSize];
+
+    for (unsigned int batchStart = 0;batchStart < numPoints;batchStart += BatchSize)
+    {
+        unsigned int batchLength = std::min(BatchSize,numPoints - batchStart);
+        this->MapBatch(fixedIndexes,batchStart,batchLength,contIndexes,batchInside);
+
+        if (insideBuffer)
+        {
+            for (unsigned int k = 0;k < batchLength;++k)
+                insideBuffer[batchStart + k] = batchInside[k];
+        }
+
+        double *outValues = values + batchStart;
+        double contIndex[ImageDimension];
+        for (unsigned int k = 0;k < batchLength;++k)
+        {
+            if (!batchInside[k])
+            {
+                outValues[k] = backgroundValue;
+                continue;
+            }
+
+            for (unsigned int i = 0;i < ImageDimension;++i)
+                contIndex[i] = contIndexes[i][k];
+
+            outValues[k] = this->InterpolateInside(contIndex);
+        }
+    }
+}
+
+template <class TFixedImage, class TMovingImage>
+void
+IndexSpaceLinearSampler<TFixedImage,TMovingImage>
+::SampleWithGradient(const double * const *fixedIndexes, unsigned int numPoints,
+                     double backgroundValue, double *values, double * const *indexGradients,
+                     unsigned char *insideBuffer) const
+{
+    double contIndexes[ImageDimension][BatchSize];
+    bool batchInside[BatchSize];
+
+    for (unsigned int batchStart = 0;batchStart < numPoints;batchStart += BatchSize)
+    {
+        unsigned int batchLength = std::min(BatchSize,numPoints - batchStart);
+        this->MapBatch(fixedIndexes,batchStart,batchLength,contIndexes,batchInside);
+
+        double contIndex[ImageDimension];
+        double gradient[ImageDimension];
+        for (unsigned int k = 0;k < batchLength;++k)
+        {
+            unsigned int pos = batchStart + k;
+            insideBuffer[pos] = batchInside[k];
+            if (!batchInside[k])
+            {
+                values[pos] = backgroundValue;
+                for (unsigned int i = 0;i < ImageDimension;++i)
+                    indexGradients[i][pos] = 0.0;
+
+                continue;
+            }
+
+            for (unsigned int i = 0;i < ImageDimension;++i)
+                contIndex[i] = contIndexes[i][k];
+
+            values[pos] = this->InterpolateInsideWithGradient(contIndex,gradient);
+            for (unsigned int i = 0;i < ImageDimension;++i)
+                indexGradients[i][pos] = gradient[i];
+        }
+    }
+}
+
+template <class TFixedImage, class TMovingImage>
+void
+IndexSpaceLinearSampler<TFixedImage,TMovingImage>
+::AccumulateAffineGradient(const double * const *fixedIndexes, const double * const *indexGradients,
+                           const double *pointWeights, unsigned int numPoints, vnl_vector <double> &affineGradient) const
+{
+    // Accumulated in index space: sum_k w_k g_k i_k^T and sum_k w_k g_k, with g_k the index space gradient
+    MatrixType indexOuterProducts;
+    VectorType indexGradientSum;
+
+    for (unsigned int i = 0;i < ImageDimension;++i)
+    {
+        double gradientSum = 0.0;
+        for (unsigned int k = 0;k < numPoints;++k)
+            gradientSum += pointWeights[k] * indexGradients[i][k];
+
+        indexGradientSum[i] = gradientSum;
+
+        for (unsigned int j = 0;j < ImageDimension;++j)
+        {
+            double outerSum = 0.0;
+            for (unsigned int k = 0;k < numPoints;++k)
+                outerSum += pointWeights[k] * indexGradients[i][k] * fixedIndexes[j][k];
+
+            indexOuterProducts(i,j) = outerSum;
+        }
+    }
+
+    // Back to physical space: moving index = P (M x + t - o_m) with x = F i + o_f
+    MatrixType physicalToIndexTransposed = m_MovingPhysicalToIndexMatrix.transpose();
+    VectorType offsetGradient = physicalToIndexTransposed * indexGradientSum;
+    MatrixType matrixGradient = physicalToIndexTransposed * indexOuterProducts * m_FixedIndexToPhysicalMatrix.transpose();
+    for (unsigned int i = 0;i < ImageDimension;++i)
+        for (unsigned int j = 0;j < ImageDimension;++j)
+            matrixGradient(i,j) += offsetGradient[i] * m_FixedOrigin[j];
+
+    affineGradient.set_size(ImageDimension * (ImageDimension + 1));
+    for (unsigned int i = 0;i < ImageDimension;++i)
+    {
+        for (unsigned int j = 0;j < ImageDimension;++j)
+            affineGradient[i * ImageDimension + j] = matrixGradient(i,j);
+
+        affineGradient[ImageDimension * ImageDimension + i] = offsetGradient[i];
+    }
+}
+
+} // end namespace anima
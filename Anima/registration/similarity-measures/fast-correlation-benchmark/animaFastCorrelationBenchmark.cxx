@@ -0,0 +1,203 @@
+#include <animaFastCorrelationImageToImageMetric.h>
+#include <animaLogRigid3DTransform.h>
+#include <animaSplitAffine3DTransform.h>
+
+#include <itkImageRegionIterator.h>
+#include <itkLinearInterpolateImageFunction.h>
+#include <itkTranslationTransform.h>
+#include <itkTimeProbe.h>
+
+#include <random>
+#include <tclap/CmdLine.h>
+
+typedef itk::Image <double,3> ImageType;
+typedef anima::FastCorrelationImageToImageMetric <ImageType,ImageType> MetricType;
+typedef itk::LinearInterpolateImageFunction <ImageType,double> InterpolatorType;
+typedef itk::Transform <double,3,3> TransformType;
+
+void BenchmarkTransform(const std::string &name, TransformType *transform, ImageType *fixedImage, ImageType *movingImage,
+                        unsigned int blockSize, unsigned int numEvaluations, double parameterRange, bool scaleIntensities)
+{
+    std::mt19937 generator(42);
+    std::uniform_real_distribution <double> paramDistribution(- parameterRange, parameterRange);
+
+    ImageType::RegionType largestRegion = fixedImage->GetLargestPossibleRegion();
+    ImageType::SizeType blockRegionSize;
+    blockRegionSize.Fill(blockSize);
+
+    // Blocks spread over the whole image, including the borders where the moving buffer is left
+    std::vector <ImageType::RegionType> blockRegions;
+    for (unsigned int z = 0;z + blockSize <= largestRegion.GetSize()[2];z += 2 * blockSize)
+        for (unsigned int y = 0;y + blockSize <= largestRegion.GetSize()[1];y += 2 * blockSize)
+            for (unsigned int x = 0;x + blockSize <= largestRegion.GetSize()[0];x += 2 * blockSize)
+            {
+                ImageType::IndexType blockIndex;
+                blockIndex[0] = x;
+                blockIndex[1] = y;
+                blockIndex[2] = z;
+                blockRegions.push_back(ImageType::RegionType(blockIndex,blockRegionSize));
+            }
+
+    MetricType::Pointer metrics[2];
+    for (unsigned int i = 0;i < 2;++i)
+    {
+        InterpolatorType::Pointer interpolator = InterpolatorType::New();
+        interpolator->SetInputImage(movingImage);
+
+        metrics[i] = MetricType::New();
+        metrics[i]->SetFixedImage(fixedImage);
+        metrics[i]->SetMovingImage(movingImage);
+        metrics[i]->SetInterpolator(interpolator);
+        metrics[i]->ComputeGradientOff();
+        metrics[i]->SetScaleIntensities(scaleIntensities);
+        metrics[i]->SetUseFastPath(i == 1);
+    }
+
+    std::vector <TransformType::ParametersType> parameters(numEvaluations);
+    TransformType::ParametersType initialParameters = transform->GetParameters();
+    for (unsigned int i = 0;i < numEvaluations;++i)
+    {
+        parameters[i] = initialParameters;
+        for (unsigned int j = 0;j < parameters[i].GetSize();++j)
+            parameters[i][j] += paramDistribution(generator);
+    }
+
+    double totalTimes[2] = {0.0, 0.0};
+    double maxDifference = 0.0;
+    double maxDerivativeDifference = 0.0;
+    const double derivativeStep = 1.0e-6;
+    std::vector <double> values[2];
+
+    for (unsigned int b = 0;b < blockRegions.size();++b)
+    {
+        for (unsigned int i = 0;i < 2;++i)
+        {
+            metrics[i]->SetFixedImageRegion(blockRegions[b]);
+            metrics[i]->SetTransform(transform);
+            metrics[i]->Initialize();
+            metrics[i]->PreComputeFixedValues();
+
+            values[i].resize(numEvaluations);
+            itk::TimeProbe tmpTime;
+            tmpTime.Start();
+
+            for (unsigned int j = 0;j < numEvaluations;++j)
+                values[i][j] = metrics[i]->GetValue(parameters[j]);
+
+            tmpTime.Stop();
+            totalTimes[i] += tmpTime.GetTotal();
+        }
+
+        for (unsigned int j = 0;j < numEvaluations;++j)
+            maxDifference = std::max(maxDifference,std::abs(values[0][j] - values[1][j]));
+
+        // Analytic derivative against central differences of the value
+        MetricType::DerivativeType derivative;
+        double value;
+        metrics[1]->GetValueAndDerivative(parameters[0],value,derivative);
+
+        TransformType::ParametersType shiftedParameters = parameters[0];
+        for (unsigned int k = 0;k < shiftedParameters.GetSize();++k)
+        {
+            shiftedParameters[k] = parameters[0][k] + derivativeStep;
+            double upperValue = metrics[1]->GetValue(shiftedParameters);
+            shiftedParameters[k] = parameters[0][k] - derivativeStep;
+            double lowerValue = metrics[1]->GetValue(shiftedParameters);
+            shiftedParameters[k] = parameters[0][k];
+
+            double numericDerivative = (upperValue - lowerValue) / (2.0 * derivativeStep);
+            maxDerivativeDifference = std::max(maxDerivativeDifference,std::abs(numericDerivative - derivative[k]));
+        }
+    }
+
+    unsigned int totalEvaluations = blockRegions.size() * numEvaluations;
+    std::cout << name << ": " << totalEvaluations << " evaluations on " << blockRegions.size() << " blocks" << std::endl;
+    std::cout << "  ITK path:  " << totalTimes[0] << "s (" << 1.0e6 * totalTimes[0] / totalEvaluations << " us/evaluation)" << std::endl;
+    std::cout << "  Fast path: " << totalTimes[1] << "s (" << 1.0e6 * totalTimes[1] / totalEvaluations << " us/evaluation)" << std::endl;
+    std::cout << "  Speedup: " << totalTimes[0] / totalTimes[1] << ", max metric difference: " << maxDifference << std::endl;
+    std::cout << "  Max difference between analytic and numerical derivatives: " << maxDerivativeDifference << std::endl;
+}
+
+int main(int ac, const char** av)
+{
+    TCLAP::CmdLine cmd("INRIA / IRISA - VisAGeS/Empenn Team", ' ', ANIMA_VERSION);
+
+    TCLAP::ValueArg<unsigned int> sizeArg("s","size","Synthetic image size (default: 64)",false,64,"image size",cmd);
+    TCLAP::ValueArg<unsigned int> blockSizeArg("b","block-size","Block size (default: 5)",false,5,"block size",cmd);
+    TCLAP::ValueArg<unsigned int> nbEvalArg("n","nb-eval","Number of metric evaluations per block (default: 200)",false,200,"number of evaluations",cmd);
+    TCLAP::SwitchArg scaleArg("S","scale-intensities","Scale moving intensities by the transform determinant",cmd,false);
+
+    try
+    {
+        cmd.parse(ac,av);
+    }
+    catch (TCLAP::ArgException& e)
+    {
+        std::cerr << "Error: " << e.error() << "for argument " << e.argId() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Synthetic anisotropic, oblique images: smooth pattern plus noise
+    ImageType::RegionType region;
+    region.SetSize(0,sizeArg.getValue());
+    region.SetSize(1,sizeArg.getValue());
+    region.SetSize(2,sizeArg.getValue());
+
+    ImageType::SpacingType spacing;
+    spacing[0] = 1.0;
+    spacing[1] = 1.2;
+    spacing[2] = 2.0;
+
+    ImageType::DirectionType direction;
+    direction.SetIdentity();
+    double angle = 0.1;
+    direction(0,0) = std::cos(angle);
+    direction(0,1) = - std::sin(angle);
+    direction(1,0) = std::sin(angle);
+    direction(1,1) = std::cos(angle);
+
+    std::mt19937 generator(12);
+    std::normal_distribution <double> noiseDistribution(0.0,5.0);
+
+    ImageType::Pointer images[2];
+    for (unsigned int i = 0;i < 2;++i)
+    {
+        images[i] = ImageType::New();
+        images[i]->SetRegions(region);
+        images[i]->SetSpacing(spacing);
+        images[i]->SetDirection(direction);
+        images[i]->Allocate();
+
+        itk::ImageRegionIterator <ImageType> imageItr(images[i],region);
+        while (!imageItr.IsAtEnd())
+        {
+            ImageType::IndexType index = imageItr.GetIndex();
+            double value = 100.0 + 50.0 * std::sin(0.2 * index[0] + i * 0.1) * std::cos(0.15 * index[1]) + 20.0 * std::sin(0.3 * index[2]);
+            imageItr.Set(value + noiseDistribution(generator));
+            ++imageItr;
+        }
+    }
+
+    ImageType::PointType center;
+    for (unsigned int i = 0;i < 3;++i)
+        center[i] = 0.5 * sizeArg.getValue() * spacing[i];
+
+    typedef itk::TranslationTransform <double,3> TranslationType;
+    TranslationType::Pointer translation = TranslationType::New();
+    translation->SetIdentity();
+    BenchmarkTransform("Translation",translation,images[0],images[1],blockSizeArg.getValue(),nbEvalArg.getValue(),2.0,false);
+
+    typedef anima::LogRigid3DTransform <double> RigidType;
+    RigidType::Pointer rigid = RigidType::New();
+    rigid->SetIdentity();
+    rigid->SetCenter(center);
+    BenchmarkTransform("Rigid",rigid,images[0],images[1],blockSizeArg.getValue(),nbEvalArg.getValue(),0.1,scaleArg.isSet());
+
+    typedef anima::SplitAffine3DTransform <double> AffineType;
+    AffineType::Pointer affine = AffineType::New();
+    affine->SetIdentity();
+    affine->SetCenter(center);
+    BenchmarkTransform("Affine",affine,images[0],images[1],blockSizeArg.getValue(),nbEvalArg.getValue(),0.1,scaleArg.isSet());
+
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <itkImageToImageFilter.h>
+#include <vnl/vnl_matrix_fixed.h>
 
 namespace anima
 {
@@ -14,6 +15,11 @@ namespace anima
  *
  * S. Ferraris et al. Accurate small deformation exponential approximant to integrate large velocity fields: Application to image registration. WBIR 2016
  * V. Arsigny et al. A Log-Euclidean Framework for Statistics on Diffeomorphisms. MICCAI 2006.
+ *
+ * Squarings are by default performed in place by a dedicated composition kernel, ping-ponging between
+ * the output and a single work buffer and interpolating directly in index space. It matches
+ * itk::ComposeDisplacementFieldsImageFilter with a linear, nearest neighbor extrapolating interpolator.
+ * Squarings may optionally be carried out on single precision buffers.
  */
 template <typename TPixelType, unsigned int Dimension>
 class SVFExponentialImageFilter :
@@ -43,12 +49,24 @@ public:
     itkSetMacro(ExponentiationOrder, unsigned int)
     itkSetMacro(MaximalDisplacementAmplitude, double)
 
+    //! Use dedicated in place composition kernel for squarings (default), ITK compose filter otherwise
+    itkSetMacro(UseFastComposition, bool)
+    itkGetConstMacro(UseFastComposition, bool)
+
+    //! Perform squarings on float buffers (only used with fast composition)
+    itkSetMacro(UseSinglePrecisionComposition, bool)
+    itkGetConstMacro(UseSinglePrecisionComposition, bool)
+
 protected:
     SVFExponentialImageFilter()
     {
         m_ExponentiationOrder = 0;
         m_MaximalDisplacementAmplitude = 0.25;
         m_FieldJacobian = 0;
+        m_NumberOfSquarings = 0;
+
+        m_UseFastComposition = true;
+        m_UseSinglePrecisionComposition = false;
     }
 
     virtual ~SVFExponentialImageFilter() {}
@@ -57,6 +75,20 @@ protected:
     void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
     void AfterThreadedGenerateData() ITK_OVERRIDE;
 
+    //! Recursive squaring using ITK compose displacement fields filter
+    void ComputeSquaringsWithITK();
+
+    //! Recursive squaring using the in place composition kernel
+    void ComputeFastSquarings();
+
+    /**
+     * Composes the field stored in inputBuffer (interleaved components) with itself on a sub-region
+     * of the output buffered region, writing the result into outputBuffer
+     */
+    template <class TComputeType>
+    void ComposeFieldWithItself(const TComputeType *inputBuffer, TComputeType *outputBuffer,
+                                const OutputImageRegionType &region);
+
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(SVFExponentialImageFilter);
 
@@ -71,6 +103,14 @@ private:
 
     //! Internal variable that holds the automatically computed number of recursive squarings
     unsigned int m_NumberOfSquarings;
+
+    bool m_UseFastComposition;
+    bool m_UseSinglePrecisionComposition;
+
+    //! Maps physical displacements to index displacements (inverse of direction times spacing)
+    vnl_matrix_fixed <double, Dimension, Dimension> m_PhysicalToIndexMatrix;
+    OutputImageRegionType m_ComposedRegion;
+    long m_BufferStrides[Dimension];
 };
 
 } // end namespace anima
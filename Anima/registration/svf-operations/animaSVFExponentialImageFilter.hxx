@@ -4,6 +4,10 @@
 #include <animaJacobianMatrixImageFilter.h>
 #include <itkImageRegionConstIterator.h>
 #include <itkImageRegionIterator.h>
+#include <itkMultiThreaderBase.h>
+
+#include <algorithm>
+#include <vector>
 
 #include <itkComposeDisplacementFieldsImageFilter.h>
 #include <itkVectorLinearInterpolateNearestNeighborExtrapolateImageFunction.h>
@@ -128,6 +132,20 @@ SVFExponentialImageFilter <TPixelType, Dimension>
 {
     this->Superclass::AfterThreadedGenerateData();
 
+    if (m_NumberOfSquarings == 0)
+        return;
+
+    if (m_UseFastComposition)
+        this->ComputeFastSquarings();
+    else
+        this->ComputeSquaringsWithITK();
+}
+
+template <typename TPixelType, unsigned int Dimension>
+void
+SVFExponentialImageFilter <TPixelType, Dimension>
+::ComputeSquaringsWithITK()
+{
     // Compute recursive squaring of the output
     typedef itk::ComposeDisplacementFieldsImageFilter <OutputImageType,OutputImageType> ComposeFilterType;
     typedef itk::VectorLinearInterpolateNearestNeighborExtrapolateImageFunction <OutputImageType,
@@ -150,8 +168,179 @@ SVFExponentialImageFilter <TPixelType, Dimension>
         outputPtr->DisconnectPipeline();
     }
 
-    if (m_NumberOfSquarings > 0)
-        this->GraftOutput(outputPtr);
+    this->GraftOutput(outputPtr);
+}
+
+template <typename TPixelType, unsigned int Dimension>
+void
+SVFExponentialImageFilter <TPixelType, Dimension>
+::ComputeFastSquarings()
+{
+    typename OutputImageType::Pointer outputPtr = this->GetOutput();
+
+    m_ComposedRegion = outputPtr->GetBufferedRegion();
+    m_PhysicalToIndexMatrix = outputPtr->GetPhysicalPointToIndex().GetVnlMatrix();
+
+    m_BufferStrides[0] = 1;
+    for (unsigned int i = 1;i < Dimension;++i)
+        m_BufferStrides[i] = m_BufferStrides[i - 1] * m_ComposedRegion.GetSize()[i - 1];
+
+    unsigned int numValues = m_ComposedRegion.GetNumberOfPixels() * Dimension;
+    TPixelType *outputBuffer = reinterpret_cast <TPixelType *> (outputPtr->GetBufferPointer());
+
+    if (m_UseSinglePrecisionComposition)
+    {
+        // Ping-pong between two float buffers, output is only written back at the end
+        std::vector <float> workBuffers[2];
+        workBuffers[0].resize(numValues);
+        workBuffers[1].resize(numValues);
+
+        for (unsigned int i = 0;i < numValues;++i)
+            workBuffers[0][i] = outputBuffer[i];
+
+        for (unsigned int i = 0;i < m_NumberOfSquarings;++i)
+        {
+            const float *inputBuffer = workBuffers[i % 2].data();
+            float *composedBuffer = workBuffers[(i + 1) % 2].data();
+
+            this->GetMultiThreader()->template ParallelizeImageRegion<Dimension> (
+                m_ComposedRegion,
+                [this,inputBuffer,composedBuffer](const OutputImageRegionType & regionForThread)
+                  { this->ComposeFieldWithItself(inputBuffer,composedBuffer,regionForThread); }, ITK_NULLPTR);
+        }
+
+        const std::vector <float> &resultBuffer = workBuffers[m_NumberOfSquarings % 2];
+        for (unsigned int i = 0;i < numValues;++i)
+            outputBuffer[i] = resultBuffer[i];
+
+        return;
+    }
+
+    // Ping-pong between the output and a single work field
+    typename OutputImageType::Pointer workField = OutputImageType::New();
+    workField->Initialize();
+    workField->CopyInformation(outputPtr);
+    workField->SetBufferedRegion(m_ComposedRegion);
+    workField->SetRequestedRegion(outputPtr->GetRequestedRegion());
+    workField->Allocate();
+
+    TPixelType *buffers[2] = {outputBuffer, reinterpret_cast <TPixelType *> (workField->GetBufferPointer())};
+
+    for (unsigned int i = 0;i < m_NumberOfSquarings;++i)
+    {
+        const TPixelType *inputBuffer = buffers[i % 2];
+        TPixelType *composedBuffer = buffers[(i + 1) % 2];
+
+        this->GetMultiThreader()->template ParallelizeImageRegion<Dimension> (
+            m_ComposedRegion,
+            [this,inputBuffer,composedBuffer](const OutputImageRegionType & regionForThread)
+              { this->ComposeFieldWithItself(inputBuffer,composedBuffer,regionForThread); }, ITK_NULLPTR);
+    }
+
+    if (m_NumberOfSquarings % 2 == 1)
+        this->GraftOutput(workField);
+}
+
+template <typename TPixelType, unsigned int Dimension>
+template <class TComputeType>
+void
+SVFExponentialImageFilter <TPixelType, Dimension>
+::ComposeFieldWithItself(const TComputeType *inputBuffer, TComputeType *outputBuffer,
+                         const OutputImageRegionType &region)
+{
+    // Positions are handled relative to the buffer start
+    long bufferSize[Dimension];
+    long regionStart[Dimension];
+    long regionEnd[Dimension];
+    long position[Dimension];
+    for (unsigned int i = 0;i < Dimension;++i)
+    {
+        bufferSize[i] = m_ComposedRegion.GetSize()[i];
+        regionStart[i] = region.GetIndex()[i] - m_ComposedRegion.GetIndex()[i];
+        regionEnd[i] = regionStart[i] + region.GetSize()[i];
+        position[i] = regionStart[i];
+    }
+
+    const unsigned int numCorners = 1 << Dimension;
+    double contIndex[Dimension];
+    long baseIndex[Dimension];
+    double distance[Dimension];
+    double interpolatedValue[Dimension];
+
+    unsigned int numPixels = region.GetNumberOfPixels();
+    for (unsigned int n = 0;n < numPixels;++n)
+    {
+        long offset = 0;
+        for (unsigned int i = 0;i < Dimension;++i)
+            offset += position[i] * m_BufferStrides[i];
+
+        const TComputeType *warpValue = inputBuffer + offset * Dimension;
+        TComputeType *outputValue = outputBuffer + offset * Dimension;
+
+        // Same inside buffer test as ITK interpolators: [-0.5, size - 0.5)
+        bool insideBuffer = true;
+        for (unsigned int i = 0;i < Dimension;++i)
+        {
+            contIndex[i] = position[i];
+            for (unsigned int j = 0;j < Dimension;++j)
+                contIndex[i] += m_PhysicalToIndexMatrix(i,j) * warpValue[j];
+
+            if (!((contIndex[i] >= -0.5) && (contIndex[i] < bufferSize[i] - 0.5)))
+                insideBuffer = false;
+
+            interpolatedValue[i] = 0.0;
+        }
+
+        if (insideBuffer)
+        {
+            for (unsigned int i = 0;i < Dimension;++i)
+            {
+                baseIndex[i] = static_cast <long> (std::floor(contIndex[i]));
+                distance[i] = contIndex[i] - baseIndex[i];
+            }
+
+            // Linear interpolation, neighbors outside the buffer are clamped to its border
+            for (unsigned int corner = 0;corner < numCorners;++corner)
+            {
+                double weight = 1.0;
+                long cornerOffset = 0;
+                for (unsigned int i = 0;i < Dimension;++i)
+                {
+                    long cornerIndex = baseIndex[i];
+                    if (corner & (1 << i))
+                    {
+                        ++cornerIndex;
+                        weight *= distance[i];
+                    }
+                    else
+                        weight *= 1.0 - distance[i];
+
+                    cornerIndex = std::max(0L,std::min(cornerIndex,bufferSize[i] - 1));
+                    cornerOffset += cornerIndex * m_BufferStrides[i];
+                }
+
+                if (weight == 0.0)
+                    continue;
+
+                const TComputeType *cornerValue = inputBuffer + cornerOffset * Dimension;
+                for (unsigned int i = 0;i < Dimension;++i)
+                    interpolatedValue[i] += weight * cornerValue[i];
+            }
+        }
+
+        for (unsigned int i = 0;i < Dimension;++i)
+            outputValue[i] = warpValue[i] + interpolatedValue[i];
+
+        // Next position in raster order
+        for (unsigned int i = 0;i < Dimension;++i)
+        {
+            ++position[i];
+            if (position[i] < regionEnd[i])
+                break;
+
+            position[i] = regionStart[i];
+        }
+    }
 }
 
 } // end namespace anima
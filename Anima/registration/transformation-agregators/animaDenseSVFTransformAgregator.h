@@ -45,6 +45,9 @@ public:
     void SetNumberOfWorkUnits(unsigned int num) {m_NumberOfThreads = num;}
     void SetMEstimateConvergenceThreshold(double num) {m_MEstimateConvergenceThreshold = num;}
 
+    //! Use the sparse support IRLS of MEstimateSVFImageFilter (linear in the number of voxels)
+    void SetUseSparseSupportRegularization(bool val) {m_UseSparseSupportRegularization = val;}
+
     template <class TInputImageType> void SetGeometryInformation(const TInputImageType *geomImage)
     {
         if (geomImage == NULL)
@@ -61,6 +64,7 @@ protected:
     double m_OutlierRejectionSigma;
 
     double m_MEstimateConvergenceThreshold;
+    bool m_UseSparseSupportRegularization;
 
     VelocityFieldPointType m_Origin;
     VelocityFieldRegionType m_LargestRegion;
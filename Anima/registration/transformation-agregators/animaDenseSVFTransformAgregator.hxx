@@ -18,6 +18,7 @@ DenseSVFTransformAgregator() : Superclass()
     m_ExtrapolationSigma = 4.0;
     m_OutlierRejectionSigma = 3.0;
     m_MEstimateConvergenceThreshold = 0.001;
+    m_UseSparseSupportRegularization = false;
 
     m_NumberOfThreads = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
 }
@@ -133,6 +134,7 @@ estimateSVFFromTranslations()
 
     fieldSmoother->SetConvergenceThreshold(m_MEstimateConvergenceThreshold);
     fieldSmoother->SetMaxNumIterations(100);
+    fieldSmoother->SetUseSparseSupport(m_UseSparseSupportRegularization);
 
     fieldSmoother->SetNumberOfWorkUnits(m_NumberOfThreads);
 
@@ -216,6 +218,7 @@ estimateSVFFromRigidTransforms()
 
     fieldSmoother->SetConvergenceThreshold(m_MEstimateConvergenceThreshold);
     fieldSmoother->SetMaxNumIterations(100);
+    fieldSmoother->SetUseSparseSupport(m_UseSparseSupportRegularization);
 
     fieldSmoother->SetNumberOfWorkUnits(m_NumberOfThreads);
 
@@ -378,6 +381,7 @@ estimateSVFFromAffineTransforms()
 
     fieldSmoother->SetConvergenceThreshold(m_MEstimateConvergenceThreshold);
     fieldSmoother->SetMaxNumIterations(100);
+    fieldSmoother->SetUseSparseSupport(m_UseSparseSupportRegularization);
 
     fieldSmoother->SetNumberOfWorkUnits(m_NumberOfThreads);
 
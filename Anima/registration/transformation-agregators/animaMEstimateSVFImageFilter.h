@@ -48,19 +48,38 @@ public:
     itkSetMacro(ConvergenceThreshold, double)
     itkSetMacro(MaxNumIterations, unsigned int)
 
+    /**
+     * If true, IRLS iterations are run globally: block contributions (weights times M-estimation
+     * weights) are scattered into sparse images smoothed by separable recursive Gaussian filters,
+     * and M-estimation weights are updated from the estimate at each block position. Each iteration
+     * is then linear in the number of voxels instead of scaling with the kernel size. M-estimation weights
+     * are no longer evaluated at each voxel, and the zero output region only approximates the one of the
+     * truncated dense kernel, so results differ slightly from the dense estimation
+     */
+    itkSetMacro(UseSparseSupport, bool)
+    itkGetConstMacro(UseSparseSupport, bool)
+
 protected:
     MEstimateSVFImageFilter()
     {
         m_FluidSigma = 4.0;
         m_MEstimateFactor = 1.0;
         m_AverageResidualValue = 1.0;
+        m_UseSparseSupport = false;
     }
 
     virtual ~MEstimateSVFImageFilter() {}
 
+    void GenerateData() ITK_OVERRIDE;
     void BeforeThreadedGenerateData() ITK_OVERRIDE;
     void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
 
+    //! Average squared residual between the input and its Gaussian smoothing at block positions
+    void ComputeAverageResidualValue();
+
+    //! Sparse support IRLS estimation over the whole image
+    void ComputeSparseSupportEstimation();
+
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(MEstimateSVFImageFilter);
 
@@ -76,6 +95,8 @@ private:
     std::vector <double> m_InternalSpatialKernelWeights;
     std::vector <InputIndexType> m_InternalSpatialKernelIndexes;
 
+    bool m_UseSparseSupport;
+
     //Internal parameter
     double m_AverageResidualValue;
 };
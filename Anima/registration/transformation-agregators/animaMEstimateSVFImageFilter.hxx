@@ -3,6 +3,8 @@
 
 #include <itkImageRegionIteratorWithIndex.h>
 #include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIterator.h>
 #include <itkThresholdLabelerImageFilter.h>
 
 #include <animaSmoothingRecursiveYvvGaussianImageFilter.h>
@@ -19,7 +21,84 @@ BeforeThreadedGenerateData ()
     if (nbInputs != 1)
         itkExceptionMacro("Error: There should be one input...");
 
-    typedef itk::ImageRegionIterator <WeightImageType> WeightIteratorType;
+    this->ComputeAverageResidualValue();
+
+    // Now compute image of spatial weights
+    OutputImageRegionType tmpRegion;
+    InputIndexType centerIndex, curIndex;
+    InputPointType curPosition, centerPosition;
+    m_NeighborhoodHalfSizes.resize(NDimensions);
+
+    for (unsigned int i = 0;i < NDimensions;++i)
+    {
+        tmpRegion.SetIndex(i,0);
+        m_NeighborhoodHalfSizes[i] = std::ceil(3.0 * m_FluidSigma / this->GetInput()->GetSpacing()[i]);
+        tmpRegion.SetSize(i,2 * m_NeighborhoodHalfSizes[i] + 1);
+        centerIndex[i] = m_NeighborhoodHalfSizes[i];
+    }
+
+    typename WeightImageType::Pointer internalSpatialWeight = WeightImageType::New();
+
+    internalSpatialWeight->Initialize();
+    internalSpatialWeight->SetRegions (tmpRegion);
+    internalSpatialWeight->SetSpacing (this->GetInput()->GetSpacing());
+    internalSpatialWeight->SetOrigin (this->GetInput()->GetOrigin());
+    internalSpatialWeight->SetDirection (this->GetInput()->GetDirection());
+    internalSpatialWeight->Allocate();
+
+    typedef itk::ImageRegionIterator <WeightImageType> WeightIteratorWithIndexType;
+    WeightIteratorWithIndexType spatialWeightItr(internalSpatialWeight,tmpRegion);
+    internalSpatialWeight->TransformIndexToPhysicalPoint(centerIndex,centerPosition);
+
+    m_InternalSpatialKernelWeights.clear();
+    m_InternalSpatialKernelIndexes.clear();
+
+    while (!spatialWeightItr.IsAtEnd())
+    {
+        curIndex = spatialWeightItr.GetIndex();
+        internalSpatialWeight->TransformIndexToPhysicalPoint(curIndex,curPosition);
+
+        double centerDist = 0;
+        for (unsigned int i = 0;i < NDimensions;++i)
+            centerDist += (centerPosition[i] - curPosition[i]) * (centerPosition[i] - curPosition[i]);
+
+        double weightFunctionValue = std::exp(- centerDist / (3.0 * m_FluidSigma));
+
+        if (weightFunctionValue > 0.01)
+        {
+            m_InternalSpatialKernelWeights.push_back(weightFunctionValue);
+            m_InternalSpatialKernelIndexes.push_back(curIndex);
+        }
+
+        ++spatialWeightItr;
+    }
+}
+
+template <class TScalarType, unsigned int NDegreesOfFreedom, unsigned int NDimensions>
+void
+MEstimateSVFImageFilter<TScalarType,NDegreesOfFreedom,NDimensions>::
+GenerateData ()
+{
+    if (!m_UseSparseSupport)
+    {
+        Superclass::GenerateData();
+        return;
+    }
+
+    unsigned int nbInputs = this->GetNumberOfIndexedInputs();
+    if (nbInputs != 1)
+        itkExceptionMacro("Error: There should be one input...");
+
+    this->AllocateOutputs();
+    this->ComputeAverageResidualValue();
+    this->ComputeSparseSupportEstimation();
+}
+
+template <class TScalarType, unsigned int NDegreesOfFreedom, unsigned int NDimensions>
+void
+MEstimateSVFImageFilter<TScalarType,NDegreesOfFreedom,NDimensions>::
+ComputeAverageResidualValue ()
+{
     typedef itk::ThresholdLabelerImageFilter <WeightImageType, WeightImageType> ThresholdFilterType;
 
     typename ThresholdFilterType::Pointer thrFilter = ThresholdFilterType::New();
@@ -91,55 +170,187 @@ BeforeThreadedGenerateData ()
 
     m_AverageResidualValue = averageDist / numPairings;
     m_AverageResidualValue *= m_AverageResidualValue;
+}
 
-    // Now compute image of spatial weights
-    OutputImageRegionType tmpRegion;
-    InputIndexType centerIndex, curIndex;
-    InputPointType curPosition, centerPosition;
-    m_NeighborhoodHalfSizes.resize(NDimensions);
+template <class TScalarType, unsigned int NDegreesOfFreedom, unsigned int NDimensions>
+void
+MEstimateSVFImageFilter<TScalarType,NDegreesOfFreedom,NDimensions>::
+ComputeSparseSupportEstimation ()
+{
+    const TInputImage *input = this->GetInput();
+    OutputImageRegionType largestRegion = input->GetLargestPossibleRegion();
 
-    for (unsigned int i = 0;i < NDimensions;++i)
+    // Gaussian equivalent of the exp(- d^2 / (3 sigma)) spatial kernel of the dense estimation
+    double kernelSigma = std::sqrt(1.5 * m_FluidSigma);
+
+    // Gather blocks (non zero weights), input and weight images share the same buffer
+    std::vector <unsigned int> blockOffsets;
+    std::vector <double> blockWeights;
+    std::vector <InputPixelType> blockValues;
+
+    const TScalarType *weightBuffer = m_WeightImage->GetBufferPointer();
+    const InputPixelType *inputBuffer = input->GetBufferPointer();
+    unsigned int numVoxels = largestRegion.GetNumberOfPixels();
+    for (unsigned int i = 0;i < numVoxels;++i)
     {
-        tmpRegion.SetIndex(i,0);
-        m_NeighborhoodHalfSizes[i] = std::ceil(3.0 * m_FluidSigma / this->GetInput()->GetSpacing()[i]);
-        tmpRegion.SetSize(i,2 * m_NeighborhoodHalfSizes[i] + 1);
-        centerIndex[i] = m_NeighborhoodHalfSizes[i];
+        if (weightBuffer[i] <= 0.0)
+            continue;
+
+        blockOffsets.push_back(i);
+        blockWeights.push_back(weightBuffer[i]);
+        blockValues.push_back(inputBuffer[i]);
     }
 
-    typename WeightImageType::Pointer internalSpatialWeight = WeightImageType::New();
+    unsigned int numBlocks = blockOffsets.size();
 
-    internalSpatialWeight->Initialize();
-    internalSpatialWeight->SetRegions (tmpRegion);
-    internalSpatialWeight->SetSpacing (this->GetInput()->GetSpacing());
-    internalSpatialWeight->SetOrigin (this->GetInput()->GetOrigin());
-    internalSpatialWeight->SetDirection (this->GetInput()->GetDirection());
-    internalSpatialWeight->Allocate();
+    InputImagePointer numeratorImage = TInputImage::New();
+    numeratorImage->Initialize();
+    numeratorImage->SetRegions(largestRegion);
+    numeratorImage->SetSpacing(input->GetSpacing());
+    numeratorImage->SetOrigin(input->GetOrigin());
+    numeratorImage->SetDirection(input->GetDirection());
+    numeratorImage->Allocate();
 
-    WeightIteratorWithIndexType spatialWeightItr(internalSpatialWeight,tmpRegion);
-    internalSpatialWeight->TransformIndexToPhysicalPoint(centerIndex,centerPosition);
+    WeightImagePointer denominatorImage = WeightImageType::New();
+    denominatorImage->Initialize();
+    denominatorImage->SetRegions(largestRegion);
+    denominatorImage->SetSpacing(input->GetSpacing());
+    denominatorImage->SetOrigin(input->GetOrigin());
+    denominatorImage->SetDirection(input->GetDirection());
+    denominatorImage->Allocate();
 
-    m_InternalSpatialKernelWeights.clear();
-    m_InternalSpatialKernelIndexes.clear();
+    typedef anima::SmoothingRecursiveYvvGaussianImageFilter<TInputImage,TInputImage> FieldSmootherType;
+    typename FieldSmootherType::Pointer numeratorSmooth = FieldSmootherType::New();
+    numeratorSmooth->SetInput(numeratorImage);
+    numeratorSmooth->SetSigma(kernelSigma);
+    numeratorSmooth->InPlaceOff();
+    numeratorSmooth->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
 
-    while (!spatialWeightItr.IsAtEnd())
+    typedef anima::SmoothingRecursiveYvvGaussianImageFilter<WeightImageType,WeightImageType> WeightSmootherType;
+    typename WeightSmootherType::Pointer denominatorSmooth = WeightSmootherType::New();
+    denominatorSmooth->SetInput(denominatorImage);
+    denominatorSmooth->SetSigma(kernelSigma);
+    denominatorSmooth->InPlaceOff();
+    denominatorSmooth->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+
+    // Approximate support of the dense estimation: the smoothed block indicator is compared to the Gaussian
+    // value of a single block at the 0.01 kernel level. Voxels at the border of the truncated dense kernel,
+    // or where several far blocks add up, may therefore be set differently to zero
+    TScalarType *denominatorBuffer = denominatorImage->GetBufferPointer();
+    denominatorImage->FillBuffer(0.0);
+    for (unsigned int i = 0;i < numBlocks;++i)
+        denominatorBuffer[blockOffsets[i]] = 1.0;
+
+    denominatorSmooth->Update();
+    WeightImagePointer supportImage = denominatorSmooth->GetOutput();
+    supportImage->DisconnectPipeline();
+
+    double supportThreshold = 0.01;
+    for (unsigned int i = 0;i < NDimensions;++i)
+        supportThreshold *= input->GetSpacing()[i] / (std::sqrt(2.0 * M_PI) * kernelSigma);
+
+    // IRLS iterations, M-estimation weights being computed from the estimate at each block
+    InputPixelType *numeratorBuffer = numeratorImage->GetBufferPointer();
+    InputPixelType zeroPixel;
+    zeroPixel.Fill(0.0);
+
+    std::vector <double> mEstimateWeights(numBlocks,1.0);
+    std::vector <OutputPixelType> blockEstimates(numBlocks,zeroPixel);
+    std::vector <OutputPixelType> previousBlockEstimates(numBlocks);
+
+    bool stopLoop = false;
+    unsigned int numIter = 0;
+    while (!stopLoop)
     {
-        curIndex = spatialWeightItr.GetIndex();
-        internalSpatialWeight->TransformIndexToPhysicalPoint(curIndex,curPosition);
+        ++numIter;
 
-        double centerDist = 0;
-        for (unsigned int i = 0;i < NDimensions;++i)
-            centerDist += (centerPosition[i] - curPosition[i]) * (centerPosition[i] - curPosition[i]);
+        numeratorImage->FillBuffer(zeroPixel);
+        denominatorImage->FillBuffer(0.0);
+        for (unsigned int i = 0;i < numBlocks;++i)
+        {
+            double tmpWeight = blockWeights[i] * mEstimateWeights[i];
+            numeratorBuffer[blockOffsets[i]] = blockValues[i] * tmpWeight;
+            denominatorBuffer[blockOffsets[i]] = tmpWeight;
+        }
 
-        double weightFunctionValue = std::exp(- centerDist / (3.0 * m_FluidSigma));
+        numeratorImage->Modified();
+        denominatorImage->Modified();
+        numeratorSmooth->Update();
+        denominatorSmooth->Update();
 
-        if (weightFunctionValue > 0.01)
+        const InputPixelType *smoothNumeratorBuffer = numeratorSmooth->GetOutput()->GetBufferPointer();
+        const TScalarType *smoothDenominatorBuffer = denominatorSmooth->GetOutput()->GetBufferPointer();
+
+        bool converged = true;
+        for (unsigned int i = 0;i < numBlocks;++i)
         {
-            m_InternalSpatialKernelWeights.push_back(weightFunctionValue);
-            m_InternalSpatialKernelIndexes.push_back(curIndex);
+            previousBlockEstimates[i] = blockEstimates[i];
+            double sumWeights = smoothDenominatorBuffer[blockOffsets[i]];
+
+            blockEstimates[i] = zeroPixel;
+            if (sumWeights > 0.0)
+            {
+                for (unsigned int j = 0;j < NDegreesOfFreedom;++j)
+                    blockEstimates[i][j] = smoothNumeratorBuffer[blockOffsets[i]][j] / sumWeights;
+            }
+
+            if (converged)
+                converged = checkConvergenceThreshold(previousBlockEstimates[i],blockEstimates[i]);
         }
 
-        ++spatialWeightItr;
+        if ((numIter == m_MaxNumIterations) || converged)
+            stopLoop = true;
+
+        if (!stopLoop)
+        {
+            for (unsigned int i = 0;i < numBlocks;++i)
+            {
+                double residual = 0;
+                for (unsigned int j = 0;j < NDegreesOfFreedom;++j)
+                    residual += (blockEstimates[i][j] - blockValues[i][j]) * (blockEstimates[i][j] - blockValues[i][j]);
+
+                mEstimateWeights[i] = std::exp(- residual / (m_AverageResidualValue * m_MEstimateFactor));
+            }
+        }
     }
+
+    // Final estimate at every voxel from the last smoothed images
+    const TInputImage *smoothNumeratorImage = numeratorSmooth->GetOutput();
+    const WeightImageType *smoothDenominatorImage = denominatorSmooth->GetOutput();
+    TOutputImage *output = this->GetOutput();
+
+    this->GetMultiThreader()->template ParallelizeImageRegion<NDimensions> (
+        output->GetRequestedRegion(),
+        [&](const OutputImageRegionType &region)
+    {
+        typedef itk::ImageRegionConstIterator <TInputImage> FieldConstIteratorType;
+        typedef itk::ImageRegionConstIterator <WeightImageType> WeightConstIteratorType;
+        typedef itk::ImageRegionIterator <TOutputImage> OutIteratorType;
+
+        FieldConstIteratorType numeratorItr(smoothNumeratorImage,region);
+        WeightConstIteratorType denominatorItr(smoothDenominatorImage,region);
+        WeightConstIteratorType supportItr(supportImage,region);
+        OutIteratorType outItr(output,region);
+
+        OutputPixelType outValue;
+        while (!outItr.IsAtEnd())
+        {
+            outValue.Fill(0.0);
+            double sumWeights = denominatorItr.Get();
+            if ((supportItr.Get() >= supportThreshold) && (sumWeights > 0.0))
+            {
+                for (unsigned int j = 0;j < NDegreesOfFreedom;++j)
+                    outValue[j] = numeratorItr.Get()[j] / sumWeights;
+            }
+
+            outItr.Set(outValue);
+
+            ++numeratorItr;
+            ++denominatorItr;
+            ++supportItr;
+            ++outItr;
+        }
+    }, ITK_NULLPTR);
 }
 
 template <class TScalarType, unsigned int NDegreesOfFreedom, unsigned int NDimensions>
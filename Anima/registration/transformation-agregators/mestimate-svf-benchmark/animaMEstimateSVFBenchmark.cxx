@@ -0,0 +1,177 @@
+#include <animaMEstimateSVFImageFilter.h>
+
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkTimeProbe.h>
+
+#include <random>
+#include <tclap/CmdLine.h>
+
+typedef anima::MEstimateSVFImageFilter <double,3,3> FilterType;
+typedef FilterType::TInputImage FieldType;
+typedef FilterType::WeightImageType WeightImageType;
+
+FieldType::Pointer RunFilter(FieldType *field, WeightImageType *weights, double fluidSigma, unsigned int maxIterations,
+                             bool sparseSupport, unsigned int numThreads, double &runTime)
+{
+    FilterType::Pointer filter = FilterType::New();
+    filter->SetInput(field);
+    filter->SetWeightImage(weights);
+    filter->SetFluidSigma(fluidSigma);
+    filter->SetMEstimateFactor(3.0);
+    filter->SetConvergenceThreshold(0.001);
+    filter->SetMaxNumIterations(maxIterations);
+    filter->SetUseSparseSupport(sparseSupport);
+    filter->SetNumberOfWorkUnits(numThreads);
+
+    itk::TimeProbe tmpTime;
+    tmpTime.Start();
+    filter->Update();
+    tmpTime.Stop();
+
+    runTime = tmpTime.GetTotal();
+
+    FieldType::Pointer output = filter->GetOutput();
+    output->DisconnectPipeline();
+    return output;
+}
+
+void CompareFields(FieldType *refField, FieldType *testField, double &relativeRMSDifference, double &maxDifference)
+{
+    typedef itk::ImageRegionConstIterator <FieldType> FieldIteratorType;
+    FieldIteratorType refItr(refField,refField->GetLargestPossibleRegion());
+    FieldIteratorType testItr(testField,testField->GetLargestPossibleRegion());
+
+    double sumSqDiffs = 0.0;
+    double sumSqRefs = 0.0;
+    maxDifference = 0.0;
+    while (!refItr.IsAtEnd())
+    {
+        double diffNorm = 0.0;
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            double diff = refItr.Get()[i] - testItr.Get()[i];
+            diffNorm += diff * diff;
+            sumSqRefs += refItr.Get()[i] * refItr.Get()[i];
+        }
+
+        sumSqDiffs += diffNorm;
+        maxDifference = std::max(maxDifference,std::sqrt(diffNorm));
+
+        ++refItr;
+        ++testItr;
+    }
+
+    relativeRMSDifference = 0.0;
+    if (sumSqRefs > 0.0)
+        relativeRMSDifference = std::sqrt(sumSqDiffs / sumSqRefs);
+}
+
+int main(int ac, const char** av)
+{
+    TCLAP::CmdLine cmd("INRIA / IRISA - VisAGeS/Empenn Team", ' ', ANIMA_VERSION);
+
+    TCLAP::ValueArg<unsigned int> sizeArg("s","size","Synthetic field size (default: 64)",false,64,"field size",cmd);
+    TCLAP::ValueArg<unsigned int> blockSpacingArg("b","block-spacing","Spacing between block positions in voxels (default: 3)",false,3,"block spacing",cmd);
+    TCLAP::ValueArg<double> outlierRatioArg("r","outlier-ratio","Ratio of outlier pairings (default: 0.05)",false,0.05,"outlier ratio",cmd);
+    TCLAP::MultiArg<double> sigmaArg("f","fluid-sigma","Fluid sigma values to benchmark (default: 1, 2, 3, 4)",false,"fluid sigma",cmd);
+    TCLAP::ValueArg<unsigned int> numThreadsArg("T","threads","Number of execution threads (default: all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
+
+    try
+    {
+        cmd.parse(ac,av);
+    }
+    catch (TCLAP::ArgException& e)
+    {
+        std::cerr << "Error: " << e.error() << "for argument " << e.argId() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Synthetic block matching output: smooth field plus noise and outliers on a sparse grid of blocks
+    FieldType::RegionType region;
+    for (unsigned int i = 0;i < 3;++i)
+        region.SetSize(i,sizeArg.getValue());
+
+    FieldType::Pointer field = FieldType::New();
+    field->SetRegions(region);
+    field->Allocate();
+
+    WeightImageType::Pointer weights = WeightImageType::New();
+    weights->SetRegions(region);
+    weights->Allocate();
+    weights->FillBuffer(0.0);
+
+    FieldType::PixelType zeroPixel;
+    zeroPixel.Fill(0.0);
+    field->FillBuffer(zeroPixel);
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution <double> uniformDistribution(0.0,1.0);
+    std::normal_distribution <double> noiseDistribution(0.0,0.3);
+
+    unsigned int blockSpacing = blockSpacingArg.getValue();
+    unsigned int numBlocks = 0;
+    FieldType::IndexType index;
+    for (index[2] = blockSpacing / 2;index[2] < sizeArg.getValue();index[2] += blockSpacing)
+        for (index[1] = blockSpacing / 2;index[1] < sizeArg.getValue();index[1] += blockSpacing)
+            for (index[0] = blockSpacing / 2;index[0] < sizeArg.getValue();index[0] += blockSpacing)
+            {
+                // Some blocks are discarded as in block selection
+                if (uniformDistribution(generator) < 0.2)
+                    continue;
+
+                FieldType::PixelType value;
+                for (unsigned int i = 0;i < 3;++i)
+                {
+                    value[i] = 2.0 * std::sin(0.1 * index[0] + i) * std::cos(0.07 * index[1]) + std::sin(0.05 * index[2]);
+                    value[i] += noiseDistribution(generator);
+                }
+
+                if (uniformDistribution(generator) < outlierRatioArg.getValue())
+                {
+                    for (unsigned int i = 0;i < 3;++i)
+                        value[i] += 8.0 * (uniformDistribution(generator) - 0.5);
+                }
+
+                field->SetPixel(index,value);
+                weights->SetPixel(index,0.2 + uniformDistribution(generator));
+                ++numBlocks;
+            }
+
+    std::vector <double> fluidSigmas = sigmaArg.getValue();
+    if (fluidSigmas.size() == 0)
+    {
+        fluidSigmas.push_back(1.0);
+        fluidSigmas.push_back(2.0);
+        fluidSigmas.push_back(3.0);
+        fluidSigmas.push_back(4.0);
+    }
+
+    std::cout << "Field size: " << sizeArg.getValue() << ", " << numBlocks << " blocks" << std::endl;
+
+    for (unsigned int i = 0;i < fluidSigmas.size();++i)
+    {
+        double denseTime, sparseTime;
+        double relativeRMSDifference, maxDifference;
+
+        unsigned int kernelHalfSize = std::ceil(3.0 * fluidSigmas[i]);
+        std::cout << "Fluid sigma " << fluidSigmas[i] << " (dense kernel " << 2 * kernelHalfSize + 1 << "^3)" << std::endl;
+
+        // Single iteration: no M-estimation, only compares the spatial kernels
+        FieldType::Pointer denseField = RunFilter(field,weights,fluidSigmas[i],1,false,numThreadsArg.getValue(),denseTime);
+        FieldType::Pointer sparseField = RunFilter(field,weights,fluidSigmas[i],1,true,numThreadsArg.getValue(),sparseTime);
+        CompareFields(denseField,sparseField,relativeRMSDifference,maxDifference);
+
+        std::cout << "  Kernel smoothing: dense " << denseTime << "s, sparse " << sparseTime << "s, relative RMS difference "
+                  << relativeRMSDifference << ", max difference " << maxDifference << std::endl;
+
+        denseField = RunFilter(field,weights,fluidSigmas[i],100,false,numThreadsArg.getValue(),denseTime);
+        sparseField = RunFilter(field,weights,fluidSigmas[i],100,true,numThreadsArg.getValue(),sparseTime);
+        CompareFields(denseField,sparseField,relativeRMSDifference,maxDifference);
+
+        std::cout << "  M-estimation: dense " << denseTime << "s, sparse " << sparseTime << "s (speedup " << denseTime / sparseTime
+                  << "), relative RMS difference " << relativeRMSDifference << ", max difference " << maxDifference << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
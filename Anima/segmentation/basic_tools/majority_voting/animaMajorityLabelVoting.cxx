@@ -1,15 +1,25 @@
 #include <animaMajorityLabelVotingImageFilter.h>
 #include <animaReadWriteFunctions.h>
 
+#include <itkStreamingImageFilter.h>
+
 #include <tclap/CmdLine.h>
 
+#include <algorithm>
+
 int main(int argc, char **argv)
 {
-    TCLAP::CmdLine cmd("INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
-    
+    TCLAP::CmdLine cmd("Label fusion by (weighted) majority voting. INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
+
     TCLAP::ValueArg<std::string> inputArg("i","input-images","Input images",true,"","Label input images (list or 4D image)",cmd);
     TCLAP::ValueArg<std::string> consensusImageArg("o","consensus-image","consensus label image",true,"","consensus image",cmd);
 
+    TCLAP::ValueArg<std::string> atlasWeightsArg("w","weights","Text file of global vote weights (one per input)",false,"","atlas weights",cmd);
+    TCLAP::ValueArg<std::string> weightImagesArg("W","weight-images","List of local vote weight images (one per input)",false,"","weight images",cmd);
+
+    TCLAP::ValueArg<unsigned int> nbSlabsArg("s","slabs","Number of slabs processed one after the other when inputs are given as a list (default: 8)",false,8,"number of slabs",cmd);
+    TCLAP::ValueArg<unsigned int> nbThreadsArg("T","nb-threads","Number of threads to run on (default: all available)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
+
     try
     {
         cmd.parse(argc,argv);
@@ -22,13 +32,99 @@ int main(int argc, char **argv)
 
     typedef itk::Image <unsigned int, 3> ImageType;
     typedef anima::MajorityLabelVotingImageFilter <unsigned int> VotingFilterType;
+    typedef VotingFilterType::WeightImageType WeightImageType;
+    typedef itk::ImageFileReader <ImageType> ImageReaderType;
+    typedef itk::ImageFileReader <WeightImageType> WeightReaderType;
+    typedef itk::StreamingImageFilter <ImageType, ImageType> StreamingFilterType;
 
     VotingFilterType::Pointer votingFilter = VotingFilterType::New();
-    anima::setMultipleImageFilterInputsFromFileName <ImageType,VotingFilterType> (inputArg.getValue(),votingFilter);
+    votingFilter->SetNumberOfWorkUnits(nbThreadsArg.getValue());
+
+    std::string inputName = inputArg.getValue();
+    itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO(inputName.c_str(), itk::IOFileModeEnum::ReadMode);
+    bool inputList = !imageIO;
+
+    unsigned int nbInputs = 0;
+    if (inputList)
+    {
+        // Readers are left un-updated so that inputs are read slab by slab when streaming
+        std::vector <std::string> inputFiles = anima::readFileLines(inputName);
+        for (unsigned int i = 0;i < inputFiles.size();++i)
+        {
+            ImageReaderType::Pointer imageReader = ImageReaderType::New();
+            imageReader->SetFileName(inputFiles[i]);
+            votingFilter->SetInput(i,imageReader->GetOutput());
+        }
+
+        nbInputs = inputFiles.size();
+    }
+    else
+        nbInputs = anima::setMultipleImageFilterInputsFromFileName <ImageType,VotingFilterType> (inputName,votingFilter);
+
+    if (atlasWeightsArg.getValue() != "")
+    {
+        std::vector <std::string> weightLines = anima::readFileLines(atlasWeightsArg.getValue());
+        if (weightLines.size() != nbInputs)
+        {
+            std::cerr << "Error: " << weightLines.size() << " atlas weights for " << nbInputs << " inputs" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::vector <double> atlasWeights(nbInputs);
+        for (unsigned int i = 0;i < nbInputs;++i)
+        {
+            try
+            {
+                atlasWeights[i] = std::stod(weightLines[i]);
+            }
+            catch (std::exception &e)
+            {
+                std::cerr << "Error: invalid atlas weight \"" << weightLines[i] << "\" for input " << i << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            if (atlasWeights[i] < 0)
+            {
+                std::cerr << "Error: negative atlas weight " << atlasWeights[i] << " for input " << i << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
 
-    votingFilter->Update();
+        votingFilter->SetAtlasWeights(atlasWeights);
+    }
+
+    if (weightImagesArg.getValue() != "")
+    {
+        std::vector <std::string> weightFiles = anima::readFileLines(weightImagesArg.getValue());
+        if (weightFiles.size() != nbInputs)
+        {
+            std::cerr << "Error: " << weightFiles.size() << " weight images for " << nbInputs << " inputs" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        for (unsigned int i = 0;i < nbInputs;++i)
+        {
+            WeightReaderType::Pointer weightReader = WeightReaderType::New();
+            weightReader->SetFileName(weightFiles[i]);
+            votingFilter->SetWeightImage(i,weightReader->GetOutput());
+        }
+    }
+
+    StreamingFilterType::Pointer streamingFilter = StreamingFilterType::New();
+    streamingFilter->SetInput(votingFilter->GetOutput());
+    streamingFilter->SetNumberOfStreamDivisions(inputList ? std::max(1U,nbSlabsArg.getValue()) : 1);
+
+    try
+    {
+        streamingFilter->Update();
+    }
+    catch (itk::ExceptionObject &e)
+    {
+        std::cerr << e << std::endl;
+        return EXIT_FAILURE;
+    }
 
-    anima::writeImage <ImageType> (consensusImageArg.getValue(), votingFilter->GetOutput());
+    anima::writeImage <ImageType> (consensusImageArg.getValue(), streamingFilter->GetOutput());
 
     return EXIT_SUCCESS;
 }
@@ -2,9 +2,24 @@
 
 #include <itkImageToImageFilter.h>
 
+#include <string>
+#include <vector>
+
 namespace anima
 {
 
+/**
+ * @brief Label fusion by (weighted) majority voting. Each input segmentation votes for its label at each voxel, the
+ * output is the label with the highest vote (the lowest label in case of ties).
+ *
+ * Votes have a weight of 1 by default. They may be weighted globally (one weight per input, SetAtlasWeights) and/or
+ * locally (one weight image per input, SetWeightImage), the vote weight being the product of both. Weights must be
+ * non negative. Voxels where all votes have a null weight are set to 0.
+ *
+ * Labels present in the processed region are mapped to consecutive indexes beforehand, so that votes are
+ * accumulated in a small dense array per thread. The filter only needs its inputs on the output requested region: it
+ * may be streamed (e.g. by slabs) with inputs read by slabs as well.
+ */
 template <class TPixelType>
 class MajorityLabelVotingImageFilter :
 public itk::ImageToImageFilter< itk::Image <TPixelType, 3>, itk::Image<TPixelType, 3> >
@@ -15,6 +30,7 @@ public:
     using Self = MajorityLabelVotingImageFilter;
     using InputImageType = itk::Image <TPixelType, 3>;
     using OutputImageType = itk::Image <TPixelType, 3>;
+    using WeightImageType = itk::Image <float, 3>;
     using Superclass = itk::ImageToImageFilter <InputImageType, OutputImageType>;
     using Pointer = itk::SmartPointer<Self>;
     using ConstPointer = itk::SmartPointer<const Self>;
@@ -27,17 +43,46 @@ public:
 
     using InputRegionType = typename InputImageType::RegionType;
 
+    //! Global vote weight of each input (all 1 if empty)
+    void SetAtlasWeights(const std::vector <double> &weights) {m_AtlasWeights = weights;this->Modified();}
+
+    //! Local vote weights of an input, voting is locally weighted if set for all inputs
+    void SetWeightImage(unsigned int i, WeightImageType *image);
+    const WeightImageType *GetWeightImage(unsigned int i);
+
 protected:
     MajorityLabelVotingImageFilter ()
     {
+        m_UseDirectLookup = false;
+        m_MinimalLabel = 0;
     }
 
     virtual ~MajorityLabelVotingImageFilter () {}
 
+    //! Largest label range for which labels are mapped to indexes by a direct lookup table
+    static const unsigned int MaximalDirectLookupRange = 1 << 16;
+
+    //! Checks vote weights and builds the table of labels present in the output requested region
+    void BeforeThreadedGenerateData() ITK_OVERRIDE;
     void DynamicThreadedGenerateData(const InputRegionType &region) ITK_OVERRIDE;
 
+    //! Index of a label in the label table
+    unsigned int GetLabelIndex(const TPixelType &label) const;
+
+    std::string GetWeightImageName(unsigned int i) const {return "WeightImage" + std::to_string(i);}
+
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(MajorityLabelVotingImageFilter);
+
+    std::vector <double> m_AtlasWeights;
+
+    //! Labels present in the processed region, in ascending order
+    std::vector <TPixelType> m_Labels;
+
+    //! Direct lookup (label - minimal label) to label index, used for integer labels of small range
+    bool m_UseDirectLookup;
+    TPixelType m_MinimalLabel;
+    std::vector <unsigned int> m_LabelLookup;
 };
 
 } // end namespace anima
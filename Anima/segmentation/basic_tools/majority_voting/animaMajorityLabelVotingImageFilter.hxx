@@ -3,11 +3,142 @@
 
 #include <itkImageRegionConstIterator.h>
 #include <itkImageRegionIterator.h>
-#include <map>
+
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <type_traits>
 
 namespace anima
 {
 
+template <class TPixelType>
+void
+MajorityLabelVotingImageFilter <TPixelType>
+::SetWeightImage(unsigned int i, WeightImageType *image)
+{
+    this->itk::ProcessObject::SetInput(this->GetWeightImageName(i),image);
+}
+
+template <class TPixelType>
+const typename MajorityLabelVotingImageFilter <TPixelType>::WeightImageType *
+MajorityLabelVotingImageFilter <TPixelType>
+::GetWeightImage(unsigned int i)
+{
+    return dynamic_cast <const WeightImageType *> (this->itk::ProcessObject::GetInput(this->GetWeightImageName(i)));
+}
+
+template <class TPixelType>
+void
+MajorityLabelVotingImageFilter <TPixelType>
+::BeforeThreadedGenerateData()
+{
+    unsigned int numInputs = this->GetNumberOfIndexedInputs();
+    if ((m_AtlasWeights.size() != 0) && (m_AtlasWeights.size() != numInputs))
+        itkExceptionMacro("Number of atlas weights different from the number of inputs");
+
+    for (unsigned int i = 0;i < m_AtlasWeights.size();++i)
+    {
+        if (m_AtlasWeights[i] < 0)
+            itkExceptionMacro("Negative atlas weight for input " << i);
+    }
+
+    InputRegionType region = this->GetOutput()->GetRequestedRegion();
+    typedef itk::ImageRegionConstIterator <InputImageType> InputIteratorType;
+    typedef itk::ImageRegionConstIterator <WeightImageType> WeightIteratorType;
+
+    for (unsigned int i = 0;i < numInputs;++i)
+    {
+        if (!this->GetWeightImage(i))
+            continue;
+
+        WeightIteratorType weightItr(this->GetWeightImage(i),region);
+        while (!weightItr.IsAtEnd())
+        {
+            if (weightItr.Get() < 0)
+                itkExceptionMacro("Negative local weight in weight image " << i);
+
+            ++weightItr;
+        }
+    }
+
+    m_Labels.clear();
+    m_LabelLookup.clear();
+    m_UseDirectLookup = false;
+
+    if (std::is_integral <TPixelType>::value)
+    {
+        TPixelType minLabel = std::numeric_limits <TPixelType>::max();
+        TPixelType maxLabel = std::numeric_limits <TPixelType>::lowest();
+        for (unsigned int i = 0;i < numInputs;++i)
+        {
+            InputIteratorType inputItr(this->GetInput(i),region);
+            while (!inputItr.IsAtEnd())
+            {
+                TPixelType value = inputItr.Get();
+                minLabel = std::min(minLabel,value);
+                maxLabel = std::max(maxLabel,value);
+                ++inputItr;
+            }
+        }
+
+        if ((minLabel <= maxLabel) && (static_cast <double> (maxLabel) - minLabel < MaximalDirectLookupRange))
+        {
+            // Mark present labels, then number them in ascending order
+            m_UseDirectLookup = true;
+            m_MinimalLabel = minLabel;
+            unsigned int range = static_cast <unsigned int> (maxLabel - minLabel) + 1;
+            m_LabelLookup.resize(range,0);
+
+            for (unsigned int i = 0;i < numInputs;++i)
+            {
+                InputIteratorType inputItr(this->GetInput(i),region);
+                while (!inputItr.IsAtEnd())
+                {
+                    m_LabelLookup[static_cast <unsigned int> (inputItr.Get() - minLabel)] = 1;
+                    ++inputItr;
+                }
+            }
+
+            for (unsigned int i = 0;i < range;++i)
+            {
+                if (m_LabelLookup[i] == 0)
+                    continue;
+
+                m_LabelLookup[i] = m_Labels.size();
+                m_Labels.push_back(static_cast <TPixelType> (minLabel + i));
+            }
+
+            return;
+        }
+    }
+
+    // Labels of any type or range: sorted table, searched by dichotomy
+    std::set <TPixelType> labelSet;
+    for (unsigned int i = 0;i < numInputs;++i)
+    {
+        InputIteratorType inputItr(this->GetInput(i),region);
+        while (!inputItr.IsAtEnd())
+        {
+            labelSet.insert(inputItr.Get());
+            ++inputItr;
+        }
+    }
+
+    m_Labels.assign(labelSet.begin(),labelSet.end());
+}
+
+template <class TPixelType>
+unsigned int
+MajorityLabelVotingImageFilter <TPixelType>
+::GetLabelIndex(const TPixelType &label) const
+{
+    if (m_UseDirectLookup)
+        return m_LabelLookup[static_cast <unsigned int> (label - m_MinimalLabel)];
+
+    return std::lower_bound(m_Labels.begin(),m_Labels.end(),label) - m_Labels.begin();
+}
+
 template <class TPixelType>
 void
 MajorityLabelVotingImageFilter <TPixelType>
@@ -16,6 +147,7 @@ MajorityLabelVotingImageFilter <TPixelType>
     unsigned int numInputs = this->GetNumberOfIndexedInputs();
 
     typedef itk::ImageRegionConstIterator <InputImageType> InputIteratorType;
+    typedef itk::ImageRegionConstIterator <WeightImageType> WeightIteratorType;
     typedef itk::ImageRegionIterator <OutputImageType> OutputIteratorType;
 
     std::vector<InputIteratorType> inputIterators (numInputs);
@@ -23,38 +155,80 @@ MajorityLabelVotingImageFilter <TPixelType>
     for (unsigned int i = 0; i < numInputs; ++i)
         inputIterators[i] = InputIteratorType (this->GetInput(i), region);
 
-    OutputIteratorType outputIterator (this->GetOutput(), region);
+    // Local weights are used only if available for all inputs
+    bool useWeightImages = true;
+    for (unsigned int i = 0;i < numInputs;++i)
+    {
+        if (!this->GetWeightImage(i))
+        {
+            useWeightImages = false;
+            break;
+        }
+    }
 
-    std::map <TPixelType,unsigned int> vecCount;
-    using MapIterator = typename std::map <TPixelType,unsigned int>::iterator;
-    while (!inputIterators[0].IsAtEnd())
+    std::vector <WeightIteratorType> weightIterators;
+    if (useWeightImages)
     {
-        vecCount.clear();
+        weightIterators.resize(numInputs);
+        for (unsigned int i = 0;i < numInputs;++i)
+            weightIterators[i] = WeightIteratorType(this->GetWeightImage(i),region);
+    }
+
+    std::vector <double> atlasWeights = m_AtlasWeights;
+    if (atlasWeights.size() != numInputs)
+        atlasWeights.assign(numInputs,1.0);
 
+    OutputIteratorType outputIterator (this->GetOutput(), region);
+
+    // Dense votes over label indexes, only the voted entries being reset after each voxel
+    std::vector <double> votes(m_Labels.size(),0.0);
+    std::vector <unsigned char> votedLabels(m_Labels.size(),0);
+    std::vector <unsigned int> votedIndexes;
+    votedIndexes.reserve(numInputs);
+
+    while (!outputIterator.IsAtEnd())
+    {
         for (unsigned int i = 0;i < numInputs;++i)
         {
-            TPixelType value = inputIterators[i].Get();
-            if (vecCount.count(value) == 0)
-                vecCount[value] = 1;
-            else
-                ++vecCount[value];
+            unsigned int labelIndex = this->GetLabelIndex(inputIterators[i].Get());
+            double weight = atlasWeights[i];
+            if (useWeightImages)
+            {
+                weight *= weightIterators[i].Get();
+                ++weightIterators[i];
+            }
+
+            if (!votedLabels[labelIndex])
+            {
+                votedLabels[labelIndex] = 1;
+                votedIndexes.push_back(labelIndex);
+            }
+
+            votes[labelIndex] += weight;
+            ++inputIterators[i];
         }
 
         TPixelType outValue = 0;
-        unsigned int maxCount = 0;
-        for (MapIterator it = vecCount.begin();it != vecCount.end();++it)
+        double maxVote = 0;
+        unsigned int maxIndex = 0;
+        for (unsigned int j = 0;j < votedIndexes.size();++j)
         {
-            if (it->second > maxCount)
+            unsigned int labelIndex = votedIndexes[j];
+            double vote = votes[labelIndex];
+            if ((vote > maxVote) || ((vote == maxVote) && (vote > 0) && (labelIndex < maxIndex)))
             {
-                outValue = it->first;
-                maxCount = it->second;
+                outValue = m_Labels[labelIndex];
+                maxVote = vote;
+                maxIndex = labelIndex;
             }
+
+            votes[labelIndex] = 0;
+            votedLabels[labelIndex] = 0;
         }
 
-        //Set output value then move iterators
+        votedIndexes.clear();
+
         outputIterator.Set(outValue);
-        for (unsigned int i = 0;i < numInputs;++i)
-            ++inputIterators[i];
         ++outputIterator;
     }
 }
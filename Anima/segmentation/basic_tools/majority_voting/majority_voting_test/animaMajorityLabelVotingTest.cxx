@@ -0,0 +1,129 @@
+#include <animaMajorityLabelVotingImageFilter.h>
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+// Checks unweighted majority voting against the reference voting by label counts in a std::map (lowest label on
+// ties), for integer labels of small and large range, negative labels and floating point labels
+
+template <class TPixelType>
+bool TestVoting(const std::vector <TPixelType> &labels, unsigned int numInputs, unsigned int numThreads)
+{
+    typedef anima::MajorityLabelVotingImageFilter <TPixelType> VotingFilterType;
+    typedef typename VotingFilterType::InputImageType ImageType;
+
+    typename ImageType::RegionType region;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        region.SetIndex(i,0);
+        region.SetSize(i,17 + 3 * i);
+    }
+
+    // Few labels and inputs, so that ties are frequent
+    std::mt19937 generator(numInputs);
+    std::uniform_int_distribution <unsigned int> labelDistribution(0,labels.size() - 1);
+
+    typename VotingFilterType::Pointer votingFilter = VotingFilterType::New();
+    std::vector <typename ImageType::Pointer> inputImages(numInputs);
+    for (unsigned int i = 0;i < numInputs;++i)
+    {
+        inputImages[i] = ImageType::New();
+        inputImages[i]->SetRegions(region);
+        inputImages[i]->Allocate();
+
+        itk::ImageRegionIterator <ImageType> inputItr(inputImages[i],region);
+        while (!inputItr.IsAtEnd())
+        {
+            inputItr.Set(labels[labelDistribution(generator)]);
+            ++inputItr;
+        }
+
+        votingFilter->SetInput(i,inputImages[i]);
+    }
+
+    votingFilter->SetNumberOfWorkUnits(numThreads);
+    votingFilter->Update();
+
+    typedef itk::ImageRegionConstIterator <ImageType> IteratorType;
+    std::vector <IteratorType> inputIterators(numInputs);
+    for (unsigned int i = 0;i < numInputs;++i)
+        inputIterators[i] = IteratorType(inputImages[i],region);
+
+    IteratorType outputItr(votingFilter->GetOutput(),region);
+    std::map <TPixelType,unsigned int> labelCounts;
+    unsigned int numDifferences = 0;
+    unsigned int numTies = 0;
+
+    while (!outputItr.IsAtEnd())
+    {
+        labelCounts.clear();
+        for (unsigned int i = 0;i < numInputs;++i)
+        {
+            ++labelCounts[inputIterators[i].Get()];
+            ++inputIterators[i];
+        }
+
+        TPixelType referenceValue = 0;
+        unsigned int maxCount = 0;
+        bool tie = false;
+        for (typename std::map <TPixelType,unsigned int>::iterator it = labelCounts.begin();it != labelCounts.end();++it)
+        {
+            if (it->second > maxCount)
+            {
+                referenceValue = it->first;
+                maxCount = it->second;
+                tie = false;
+            }
+            else if (it->second == maxCount)
+                tie = true;
+        }
+
+        if (tie)
+            ++numTies;
+
+        if (outputItr.Get() != referenceValue)
+            ++numDifferences;
+
+        ++outputItr;
+    }
+
+    std::cout << labels.size() << " labels, " << numInputs << " inputs, " << numThreads << " threads: "
+              << numDifferences << " differences, " << numTies << " ties out of " << region.GetNumberOfPixels()
+              << " voxels" << std::endl;
+
+    return (numDifferences == 0);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector <unsigned int> smallRangeLabels = {0, 1, 2, 5};
+    std::vector <unsigned int> largeRangeLabels = {0, 3, 70000, 4000000000U};
+    std::vector <short> negativeLabels = {-3, -1, 0, 2};
+    std::vector <float> floatLabels = {-0.5f, 0.0f, 0.25f, 1.0f};
+
+    bool success = true;
+    for (unsigned int numInputs = 2;numInputs <= 7;++numInputs)
+    {
+        for (unsigned int numThreads = 1;numThreads <= 4;numThreads *= 2)
+        {
+            success &= TestVoting <unsigned int> (smallRangeLabels,numInputs,numThreads);
+            success &= TestVoting <unsigned int> (largeRangeLabels,numInputs,numThreads);
+            success &= TestVoting <short> (negativeLabels,numInputs,numThreads);
+            success &= TestVoting <float> (floatLabels,numInputs,numThreads);
+        }
+    }
+
+    if (!success)
+    {
+        std::cerr << "Majority voting differs from the reference voting" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -2,12 +2,17 @@
 
 #include "itkProcessObject.h"
 #include "itkGaussianMembershipFunction.h"
+#include <itkMultiThreaderBase.h>
+
+#include <vector>
 
 namespace anima
 {
 
 /** @brief Gaussian Model estimator
    * Class performing expectation-maximation algorithm.
+   * The masked voxels are gathered in a flat joint histogram (one bin per distinct intensity vector), on which
+   * expectation and maximization steps are computed in parallel over chunks of bins.
    */
 template <typename TInputImage, typename TMaskImage>
 class GaussianEMEstimator : public itk::ProcessObject
@@ -39,8 +44,26 @@ public:
     typedef double Ocurrences;
     typedef unsigned short MeasureType;
     typedef std::vector<MeasureType> Intensities;
-    typedef std::map< Intensities, std::vector<Ocurrences> > GenericContainer;
-    typedef std::map<Intensities,Ocurrences> Histogram;
+
+    /** @brief Joint histogram stored as flat arrays, bins being sorted in lexicographic order of their intensities.
+       * Intensities are stored modality by modality (intensities[j * size() + b] for modality j of bin b)
+       */
+    struct Histogram
+    {
+        unsigned int dimension;
+        std::vector<double> intensities;
+        std::vector<Ocurrences> counts;
+
+        Histogram() : dimension(0) {}
+
+        unsigned int size() const {return counts.size();}
+        bool empty() const {return counts.empty();}
+        void clear() {intensities.clear(); counts.clear();}
+    };
+
+    /** @brief A posteriori probabilities of each class, stored class by class (container[c * nbBins + b])
+       */
+    typedef std::vector<double> GenericContainer;
 
     typedef double                    NumericType;
     typedef itk::VariableLengthVector<NumericType> MeasurementVectorType;
@@ -63,7 +86,9 @@ public:
     virtual bool maximization(std::vector<GaussianFunctionType::Pointer> &newModel, std::vector<double> &newAlphas);
     virtual double expectation();
 
-    double likelihood(GaussianFunctionType::CovarianceMatrixType *invCovariance=NULL, double *detCovariance=NULL);
+    /** @brief Likelihood of the current model, a posteriori probabilities must have been computed
+       */
+    double likelihood();
 
     double computeDistance(std::vector<GaussianFunctionType::Pointer> &newModel);
 
@@ -119,9 +144,32 @@ protected:
         m_IndexImage4=m_nbMaxImages;
         m_IndexImage5=m_nbMaxImages;
         m_IndexImage6=m_nbMaxImages;
+        m_Threader = itk::MultiThreaderBase::New();
     }
     virtual ~GaussianEMEstimator(){}
 
+    /** @brief Number of histogram bins processed by a single parallel task
+       */
+    static const unsigned int BinChunkSize = 1024;
+
+    /** @brief Builds the joint histogram only if inputs changed since the last one was built
+       */
+    void updateJointHistogram();
+
+    /** @brief Computes means, inverse covariances and determinants of the current model in the flat m_Model* arrays.
+       * Returns false if a covariance determinant is below minDeterminant
+       */
+    bool computeModelParameters(double minDeterminant);
+
+    /** @brief Mahalanobis distances of bins [startBin,endBin[ of histo to all classes of the model (computeModelParameters
+       * must have been called), stored class by class in distances (distances[c * (endBin - startBin) + b - startBin])
+       */
+    void computeMahalanobisDistances(const Histogram &histo, unsigned int startBin, unsigned int endBin, std::vector<double> &distances);
+
+    /** @brief Runs function(startBin,endBin,chunk) on all chunks of numBins bins in parallel
+       */
+    template <class TFunction> void parallelizeOverBins(unsigned int numBins, TFunction function);
+
     GenericContainer m_APosterioriProbability;
 
     double m_ModelMinDistance;
@@ -140,6 +188,15 @@ protected:
     Histogram m_JointHistogramInitial;
 
     std::vector<InputImageConstPointer > m_ImagesVector;
+    itk::TimeStamp m_JointHistogramTime;
+
+    /** @brief flat parameters of the current model, see computeModelParameters
+       */
+    std::vector<double> m_ModelMeans;
+    std::vector<double> m_ModelInverseCovariances;
+    std::vector<double> m_ModelDeterminants;
+
+    itk::MultiThreaderBase::Pointer m_Threader;
 
     bool m_Verbose;
     unsigned int m_nbMaxImages;
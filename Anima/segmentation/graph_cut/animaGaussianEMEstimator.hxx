@@ -1,5 +1,7 @@
 #include "animaGaussianEMEstimator.h"
 
+#include <algorithm>
+
 namespace anima
 {
 
@@ -110,31 +112,16 @@ void GaussianEMEstimator<TInputImage,TMaskImage>::createJointHistogram()
         InputConstIteratorType It(m_ImagesVector[i],m_ImagesVector[i]->GetLargestPossibleRegion() );
         ImagesVectorIt.push_back(It);
     }
+
+    // Gather intensities of all masked voxels, one row per voxel
+    std::vector<MeasureType> voxelValues;
     MaskConstIteratorType MaskIt (this->GetMask(), this->GetMask()->GetLargestPossibleRegion() );
-    Histogram::iterator it;
     while (!MaskIt.IsAtEnd())
     {
         if(MaskIt.Get()!=0)
         {
-            Intensities value(histoDimension);
             for(unsigned int m = 0; m < histoDimension; m++ )
-            {
-                if(static_cast<MeasureType>(ImagesVectorIt[m].Get()) < 0 )
-                    value[m] = 0;
-                if(static_cast<MeasureType>(ImagesVectorIt[m].Get()) > static_cast<double>(std::numeric_limits<MeasureType>::max()))
-                    value[m]= std::numeric_limits<MeasureType>::max();
-                else
-                    value[m] = static_cast<MeasureType>(ImagesVectorIt[m].Get());
-            }
-            it = m_JointHistogramInitial.find(value);
-            if(it == m_JointHistogramInitial.end())
-            {
-                m_JointHistogramInitial.insert(Histogram::value_type(value,1));
-            }
-            else
-            {
-                (it->second)++;
-            }
+                voxelValues.push_back(static_cast<MeasureType>(ImagesVectorIt[m].Get()));
         }
         for ( unsigned int i = 0; i < histoDimension; i++ )
         {
@@ -142,129 +129,228 @@ void GaussianEMEstimator<TInputImage,TMaskImage>::createJointHistogram()
         }
         ++MaskIt;
     }
+
+    m_JointHistogramInitial.dimension = histoDimension;
+    if ((histoDimension == 0)||(voxelValues.empty()))
+        return;
+
+    // Sorting voxels in lexicographic order of their intensities makes identical vectors contiguous
+    unsigned int numVoxels = voxelValues.size() / histoDimension;
+    std::vector<unsigned int> voxelOrder(numVoxels);
+    for (unsigned int i = 0; i < numVoxels; ++i)
+        voxelOrder[i] = i;
+
+    const MeasureType *values = voxelValues.data();
+    std::sort(voxelOrder.begin(),voxelOrder.end(),[values,histoDimension](unsigned int a, unsigned int b)
+    {
+        return std::lexicographical_compare(values + a * histoDimension, values + (a + 1) * histoDimension,
+                                            values + b * histoDimension, values + (b + 1) * histoDimension);
+    });
+
+    std::vector<unsigned int> binVoxels;
+    for (unsigned int i = 0; i < numVoxels; ++i)
+    {
+        const MeasureType *currentValue = values + voxelOrder[i] * histoDimension;
+        if ((i == 0)||(!std::equal(currentValue,currentValue + histoDimension,values + binVoxels.back() * histoDimension)))
+        {
+            binVoxels.push_back(voxelOrder[i]);
+            m_JointHistogramInitial.counts.push_back(1);
+        }
+        else
+            m_JointHistogramInitial.counts.back()++;
+    }
+
+    unsigned int numBins = binVoxels.size();
+    m_JointHistogramInitial.intensities.resize(histoDimension * numBins);
+    for (unsigned int j = 0; j < histoDimension; ++j)
+    {
+        for (unsigned int b = 0; b < numBins; ++b)
+            m_JointHistogramInitial.intensities[j * numBins + b] = values[binVoxels[b] * histoDimension + j];
+    }
 }
 
 template <typename TInputImage, typename TMaskImage>
-double GaussianEMEstimator<TInputImage,TMaskImage>::expectation()
+void GaussianEMEstimator<TInputImage,TMaskImage>::updateJointHistogram()
+{
+    // Estimators are often updated many times with different initializations: the histogram is only rebuilt on input
+    // change. The estimator time covers inputs (and mask) being replaced, possibly by older images, and settings changes
+    itk::ModifiedTimeType inputsTime = this->GetMTime();
+    for (unsigned int i = 0; i < this->GetNumberOfIndexedInputs(); ++i)
+    {
+        if (this->itk::ProcessObject::GetInput(i))
+            inputsTime = std::max(inputsTime,this->itk::ProcessObject::GetInput(i)->GetMTime());
+    }
+
+    if (m_JointHistogramInitial.empty() || (inputsTime > m_JointHistogramTime.GetMTime()))
+    {
+        this->createJointHistogram();
+        m_JointHistogramTime.Modified();
+    }
+}
+
+template <typename TInputImage, typename TMaskImage>
+template <class TFunction>
+void GaussianEMEstimator<TInputImage,TMaskImage>::parallelizeOverBins(unsigned int numBins, TFunction function)
+{
+    unsigned int numChunks = (numBins + BinChunkSize - 1) / BinChunkSize;
+    if (numChunks == 0)
+        return;
+
+    m_Threader->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+    m_Threader->ParallelizeArray(0,numChunks,[&function,numBins](itk::SizeValueType chunk)
+    {
+        unsigned int startBin = chunk * BinChunkSize;
+        unsigned int endBin = std::min(startBin + BinChunkSize,numBins);
+        function(startBin,endBin,chunk);
+    }, ITK_NULLPTR);
+}
+
+template <typename TInputImage, typename TMaskImage>
+bool GaussianEMEstimator<TInputImage,TMaskImage>::computeModelParameters(double minDeterminant)
 {
     unsigned int nbClasses = m_GaussianModel.size();
-    this->m_APosterioriProbability.clear();
+    if (nbClasses == 0)
+        return false;
+
+    unsigned int dimension = (m_GaussianModel[0])->GetMean().Size();
+
+    m_ModelMeans.resize(nbClasses * dimension);
+    m_ModelInverseCovariances.resize(nbClasses * dimension * dimension);
+    m_ModelDeterminants.resize(nbClasses);
 
-    //1. We calculate the inverse of the covariance and the determinant;
-    GaussianFunctionType::CovarianceMatrixType *inverseCovariance = new GaussianFunctionType::CovarianceMatrixType[nbClasses];
-    double *determinantCovariance = new double[nbClasses];
     for(unsigned int i = 0 ; i < nbClasses; i++)
     {
         GaussianFunctionType::CovarianceMatrixType covar = (m_GaussianModel[i])->GetCovariance();
 
-        determinantCovariance[i] = vnl_determinant(covar.GetVnlMatrix());
-        if(std::abs(determinantCovariance[i]) < 1e-12)
+        m_ModelDeterminants[i] = vnl_determinant(covar.GetVnlMatrix());
+        if(std::abs(m_ModelDeterminants[i]) < minDeterminant)
+            return false;
+
+        GaussianFunctionType::CovarianceMatrixType inverseCovariance(covar.GetInverse());
+        GaussianFunctionType::MeanVectorType mu = (m_GaussianModel[i])->GetMean();
+        for(unsigned int j = 0; j < dimension; j++)
         {
-            if(inverseCovariance != NULL)
-            {
-                delete[] inverseCovariance;
-                inverseCovariance=NULL;
-            }
-            if(determinantCovariance != NULL)
-            {
-                delete[] determinantCovariance;
-                determinantCovariance= NULL;
-            }
-            return 1.0;
+            m_ModelMeans[i * dimension + j] = mu[j];
+            for(unsigned int k = 0; k < dimension; k++)
+                m_ModelInverseCovariances[(i * dimension + j) * dimension + k] = inverseCovariance(j,k);
         }
-        inverseCovariance[i] = covar.GetInverse();
     }
 
-    //2. We calculate the a posterirori probability
-    Histogram::iterator histoIt;
-    GaussianFunctionType::CovarianceMatrixType intensities(this->m_JointHistogram.begin()->first.size(),1);
-    std::vector<double> probas(nbClasses);
+    return true;
+}
 
-    GaussianFunctionType::CovarianceMatrixType *xi = new GaussianFunctionType::CovarianceMatrixType[nbClasses];
-    unsigned int matrixSize = 0;
+template <typename TInputImage, typename TMaskImage>
+void GaussianEMEstimator<TInputImage,TMaskImage>::computeMahalanobisDistances(const Histogram &histo, unsigned int startBin, unsigned int endBin,
+                                                                              std::vector<double> &distances)
+{
+    unsigned int nbClasses = m_ModelDeterminants.size();
+    unsigned int dimension = histo.dimension;
+    unsigned int numBins = histo.size();
+    unsigned int chunkSize = endBin - startBin;
+
+    distances.resize(nbClasses * chunkSize);
+    std::fill(distances.begin(),distances.end(),0.0);
+
+    // Loops over bins are innermost, on contiguous intensities, so that they vectorize
     for(unsigned int i = 0; i < nbClasses; i++)
     {
-        GaussianFunctionType::MeanVectorType mu = (m_GaussianModel[i])->GetMean();
-        matrixSize = mu.Size();
-        for(unsigned int j = 0; j < mu.Size(); j++)
+        double *classDistances = distances.data() + i * chunkSize;
+        const double *mean = m_ModelMeans.data() + i * dimension;
+        const double *inverseCovariance = m_ModelInverseCovariances.data() + i * dimension * dimension;
+
+        for (unsigned int j = 0; j < dimension; ++j)
         {
-            (xi[i]).SetSize(mu.Size(),1);
-            (xi[i])(j,0) = mu[j];
+            const double *intensitiesJ = histo.intensities.data() + j * numBins + startBin;
+            for (unsigned int k = j; k < dimension; ++k)
+            {
+                const double *intensitiesK = histo.intensities.data() + k * numBins + startBin;
+                double factor = (j == k) ? inverseCovariance[j * dimension + j] : 2.0 * inverseCovariance[j * dimension + k];
+
+                for (unsigned int b = 0; b < chunkSize; ++b)
+                    classDistances[b] += factor * (intensitiesJ[b] - mean[j]) * (intensitiesK[b] - mean[k]);
+            }
         }
     }
+}
 
-    GaussianFunctionType::CovarianceMatrixType x;
+template <typename TInputImage, typename TMaskImage>
+double GaussianEMEstimator<TInputImage,TMaskImage>::expectation()
+{
+    unsigned int nbClasses = m_GaussianModel.size();
+    unsigned int numBins = this->m_JointHistogram.size();
 
-    for(histoIt = this->m_JointHistogram.begin(); histoIt != this->m_JointHistogram.end(); ++histoIt)
+    //1. We calculate the inverse of the covariance and the determinant;
+    if ((numBins == 0)||(!this->computeModelParameters(1e-12)))
+        return 1.0;
+
+    unsigned int dimension = this->m_JointHistogram.dimension;
+    std::vector<double> sqrtDeterminants(nbClasses), logNormalizations(nbClasses);
+    for(unsigned int i = 0; i < nbClasses; i++)
     {
-        //We set the intensities of the histogram in a vector
-        for(unsigned int i = 0; i < histoIt->first.size(); i++)
-        {
-            intensities(i,0) = static_cast<double>(histoIt->first[i]);
-        }
+        sqrtDeterminants[i] = std::sqrt(std::fabs(m_ModelDeterminants[i]));
+        logNormalizations[i] = std::log(std::sqrt(std::pow(2*M_PI,static_cast<int>(dimension)) * std::fabs(m_ModelDeterminants[i])));
+    }
 
-        // Calculate probability a posteriori for each pixel
-        // To eliminate problems with too small numbers we are going to substract in the exponetial
-        // the minimum found to at least have one "significant" value (equivalent to multiply the whole for a constant)
-        // Afterwards the a posteriory probability is normalize so this constant is eliminated
-        double minExpoTerm = 1e10;
-        double sumProba = 0.0;
+    //2. We calculate the a posteriori probability, and the likelihood at the same time
+    this->m_APosterioriProbability.resize(nbClasses * numBins);
+    unsigned int numChunks = (numBins + BinChunkSize - 1) / BinChunkSize;
+    std::vector<double> chunkLikelihoods(numChunks,0.0);
 
-        //Calculate the exponential term and the minimum of them
-        for(unsigned int i = 0; i < nbClasses; i++)
-        {
-            x = intensities - xi[i];
+    this->parallelizeOverBins(numBins,[&](unsigned int startBin, unsigned int endBin, unsigned int chunk)
+    {
+        unsigned int chunkSize = endBin - startBin;
+        std::vector<double> distances;
+        this->computeMahalanobisDistances(this->m_JointHistogram,startBin,endBin,distances);
 
-            double result = 0;
-            for (unsigned int j = 0; j < matrixSize; ++j)
+        double likelihoodValue = 0.0;
+        for (unsigned int b = 0; b < chunkSize; ++b)
+        {
+            // To eliminate problems with too small numbers we are going to substract in the exponetial
+            // the minimum found to at least have one "significant" value (equivalent to multiply the whole for a constant)
+            // Afterwards the a posteriory probability is normalize so this constant is eliminated
+            double minExpoTerm = 1e10;
+            for(unsigned int i = 0; i < nbClasses; i++)
             {
-                result += inverseCovariance[i](j,j) * x(j,0) * x(j,0);
-                for (unsigned int k = j+1; k < matrixSize; ++k)
-                    result += 2 * inverseCovariance[i](j,k) * x(j,0) * x(k,0);
+                if( minExpoTerm > distances[i * chunkSize + b])
+                    minExpoTerm = distances[i * chunkSize + b];
             }
-            probas[i] = result;
 
-            if( minExpoTerm > probas[i])
+            double sumProba = 0.0;
+            for(unsigned int i = 0; i < nbClasses; i++)
             {
-                minExpoTerm = probas[i];
+                // Constant * conditional probability of pixel knwoing gaussian i, last value multiply by the gaussian proportion
+                double proba = m_Alphas[i] * std::exp(0.5 * (minExpoTerm - distances[i * chunkSize + b])) / sqrtDeterminants[i];
+                this->m_APosterioriProbability[i * numBins + startBin + b] = proba;
+                sumProba += proba;
             }
-        }
 
-        //Calculate numerator and denominator of a posteriori probability
-        for(unsigned int i = 0; i < probas.size(); i++)
-        {
-            // Constant * conditional probability of pixel knwoing gaussian i, last value multiply by the gaussian proportion
-            probas[i] = m_Alphas[i] * ((std::exp(0.5* (minExpoTerm - probas[i])) / std::sqrt(std::fabs(determinantCovariance[i]))));
-            // adding all classes to have the denominator
-            sumProba += probas[i];
-        }
-
-        // This division eliminate the constant ment before
-        for(unsigned int i = 0; i < probas.size(); i++)
-        {
-            probas[i] /= sumProba;
-        }
+            // This division eliminate the constant ment before
+            unsigned int maxIndex = 0;
+            double maxPostProba = 0.0;
+            for(unsigned int i = 0; i < nbClasses; i++)
+            {
+                double &proba = this->m_APosterioriProbability[i * numBins + startBin + b];
+                proba /= sumProba;
 
-        //Add probability to the GenericContainer
-        this->m_APosterioriProbability.insert(GenericContainer::value_type(histoIt->first, probas));
-    }
+                if(proba > maxPostProba)
+                {
+                    maxPostProba = proba;
+                    maxIndex = i;
+                }
+            }
 
-    double likelihoodValue = this->likelihood(inverseCovariance, determinantCovariance);
+            // Likelihood, computed for the class of maximal a posteriori probability
+            likelihoodValue += this->m_JointHistogram.counts[startBin + b] * ( -distances[maxIndex * chunkSize + b]/2.0 - logNormalizations[maxIndex]
+                                                                               + std::log(m_Alphas[maxIndex]/maxPostProba));
+        }
 
-    // memory free
-    if(inverseCovariance != NULL)
-    {
-        delete[] inverseCovariance;
-        inverseCovariance = NULL;
-    }
-    if(determinantCovariance != NULL)
-    {
-        delete[] determinantCovariance;
-        determinantCovariance = NULL;
-    }
+        chunkLikelihoods[chunk] = likelihoodValue;
+    });
 
-    delete[] xi;
-    xi = NULL;
+    // Chunk results are summed in order so that the result does not depend on the number of threads
+    double likelihoodValue = 0.0;
+    for (unsigned int i = 0; i < numChunks; ++i)
+        likelihoodValue += chunkLikelihoods[i];
 
     return likelihoodValue;
 }
@@ -272,83 +358,112 @@ double GaussianEMEstimator<TInputImage,TMaskImage>::expectation()
 template <typename TInputImage, typename TMaskImage>
 bool GaussianEMEstimator<TInputImage,TMaskImage>::maximization(std::vector<GaussianFunctionType::Pointer>  &newModel, std::vector<double> &newAlphas)
 {
-    GenericContainer::iterator it;
-    Histogram::iterator histoIt;
-
     unsigned int numberOfClasses = m_GaussianModel.size();
-    unsigned int dimensions = this->m_JointHistogram.begin()->first.size();
-    double numberOfPixels = 0;
-
-    // initializations for estimations
-    double *mixedProportions = new double[numberOfClasses];
-    double **means = new double*[numberOfClasses];
-    for (unsigned int i = 0; i < numberOfClasses; ++i)
+    unsigned int dimensions = this->m_JointHistogram.dimension;
+    unsigned int numBins = this->m_JointHistogram.size();
+    unsigned int numChunks = (numBins + BinChunkSize - 1) / BinChunkSize;
+    const double *intensities = this->m_JointHistogram.intensities.data();
+    const double *counts = this->m_JointHistogram.counts.data();
+    const double *posteriors = this->m_APosterioriProbability.data();
+
+    // Weighted sums are computed per chunk of bins, then summed in order
+    // First pass: [sum of weights, weighted intensities] for each class, second pass: upper part of weighted covariances
+    unsigned int firstPassSize = numberOfClasses * (1 + dimensions);
+    std::vector<double> firstPassSums(numChunks * firstPassSize,0.0);
+    this->parallelizeOverBins(numBins,[&](unsigned int startBin, unsigned int endBin, unsigned int chunk)
     {
-        means[i] = new double [dimensions];
-    }
+        double *sums = firstPassSums.data() + chunk * firstPassSize;
+        for(unsigned int i = 0; i < numberOfClasses; i++)
+        {
+            const double *classPosteriors = posteriors + i * numBins;
+            double *classSums = sums + i * (1 + dimensions);
 
-    std::vector<GaussianFunctionType::CovarianceMatrixType> covariances(numberOfClasses, GaussianFunctionType::CovarianceMatrixType(dimensions,dimensions));
+            //mixedProportions [A posteriori probability] * [occurrences]
+            for (unsigned int b = startBin; b < endBin; ++b)
+                classSums[0] += classPosteriors[b] * counts[b];
 
-    for(unsigned int i = 0; i < numberOfClasses;i++)
-    {
-        mixedProportions[i] = 0.0;
-        for(unsigned int j = 0; j < dimensions; j++)
-        {
-            means[i][j] = 0.0;
-            for(unsigned int k = 0; k < dimensions; k++)
-                covariances[i](j,k)=0.0;
+            // means: [A posteriori probability] * [occurrences]*[intensity]
+            for(unsigned int j = 0; j < dimensions; j++)
+            {
+                const double *intensitiesJ = intensities + j * numBins;
+                for (unsigned int b = startBin; b < endBin; ++b)
+                    classSums[1 + j] += classPosteriors[b] * counts[b] * intensitiesJ[b];
+            }
         }
-    }
+    });
+
+    double numberOfPixels = 0;
+    for (unsigned int b = 0; b < numBins; ++b)
+        numberOfPixels += counts[b];
 
-    //Mixing proportions and gaussian means
-    for(it = this->m_APosterioriProbability.begin(),histoIt = this->m_JointHistogram.begin(); it != this->m_APosterioriProbability.end(); ++it, ++histoIt) //for all histogram
+    std::vector<double> mixedProportions(numberOfClasses,0.0);
+    std::vector<double> means(numberOfClasses * dimensions,0.0);
+    for (unsigned int c = 0; c < numChunks; ++c)
     {
-        numberOfPixels += static_cast<double>(histoIt->second);//counting all pixels
+        const double *sums = firstPassSums.data() + c * firstPassSize;
         for(unsigned int i = 0; i < numberOfClasses; i++)
         {
-            mixedProportions[i] += it->second[i] * histoIt->second; //mixedProportions [A posteriori probability] * [occurrences]
-
+            mixedProportions[i] += sums[i * (1 + dimensions)];
             for(unsigned int j = 0; j < dimensions; j++)
-                means[i][j] += it->second[i] * histoIt->second * histoIt->first[j]; // means: [A posteriori probability] * [occurrences]*[intensity]
+                means[i * dimensions + j] += sums[i * (1 + dimensions) + 1 + j];
         }
     }
 
+    // normalization of means by sum( [A posteriori probability] * [occurrences])
     for(unsigned int i = 0; i < numberOfClasses; i++)
     {
-        // normalization of means by sum( [A posteriori probability] * [occurrences])
         for(unsigned int j = 0; j < dimensions; j++)
-            means[i][j] /= mixedProportions[i];
+            means[i * dimensions + j] /= mixedProportions[i];
     }
 
-    // Covariance matrix for gaussians
-    for(it = this->m_APosterioriProbability.begin(), histoIt = this->m_JointHistogram.begin() ; it != this->m_APosterioriProbability.end(); ++it, ++histoIt) //for all histogram
+    // Covariance matrix for gaussians: [post proba] [occurrences] ([intensity]-[mean])^2
+    unsigned int secondPassSize = numberOfClasses * dimensions * dimensions;
+    std::vector<double> secondPassSums(numChunks * secondPassSize,0.0);
+    this->parallelizeOverBins(numBins,[&](unsigned int startBin, unsigned int endBin, unsigned int chunk)
     {
+        double *sums = secondPassSums.data() + chunk * secondPassSize;
         for(unsigned int i = 0; i < numberOfClasses; i++)
+        {
+            const double *classPosteriors = posteriors + i * numBins;
             for(unsigned int j = 0; j < dimensions; j++)
+            {
+                const double *intensitiesJ = intensities + j * numBins;
+                double meanJ = means[i * dimensions + j];
                 for(unsigned int k = j; k < dimensions; k++)
-                    covariances[i](j,k) += it->second[i] * histoIt->second * ( histoIt->first[j] - means[i][j] ) * ( histoIt->first[k] - means[i][k] ); //[post proba] [occurrences] ([intensity]-[mean])^2
-    }
+                {
+                    const double *intensitiesK = intensities + k * numBins;
+                    double meanK = means[i * dimensions + k];
+                    double sum = 0.0;
+                    for (unsigned int b = startBin; b < endBin; ++b)
+                        sum += classPosteriors[b] * counts[b] * (intensitiesJ[b] - meanJ) * (intensitiesK[b] - meanK);
+
+                    sums[(i * dimensions + j) * dimensions + k] = sum;
+                }
+            }
+        }
+    });
 
-    double mix_pro;
+    std::vector<GaussianFunctionType::CovarianceMatrixType> covariances(numberOfClasses, GaussianFunctionType::CovarianceMatrixType(dimensions,dimensions));
     for(unsigned int i = 0; i < numberOfClasses; i++)
     {
         for(unsigned int j = 0; j < dimensions; j++)
         {
-            mix_pro = mixedProportions[i];
-            covariances[i](j,j) /= mixedProportions[i];
-            for(unsigned int k = j+1; k < dimensions; k++)
+            for(unsigned int k = j; k < dimensions; k++)
             {
-                covariances[i](j,k) /= mixedProportions[i];
+                double sum = 0.0;
+                for (unsigned int c = 0; c < numChunks; ++c)
+                    sum += secondPassSums[c * secondPassSize + (i * dimensions + j) * dimensions + k];
+
+                covariances[i](j,k) = sum / mixedProportions[i];
                 covariances[i](k,j) = covariances[i](j,k);
             }
         }
         mixedProportions[i] /= static_cast<double>(numberOfPixels); // normalization of proportions by [numberOfPixels]
     }
 
-
     //storing values in an appropiate class
     newModel.clear();
-    int *sort = new int[numberOfClasses]; //sorting in increasing order the means[0]
+    std::vector<int> sort(numberOfClasses); //sorting in increasing order the means[0]
     for (unsigned int i = 0; i < numberOfClasses;i++)
     {
         sort[i] =-1;
@@ -366,9 +481,9 @@ bool GaussianEMEstimator<TInputImage,TMaskImage>::maximization(std::vector<Gauss
                 }
             }
             // if not used we get the min
-            if(!used && means[j][0] < minValue)
+            if(!used && means[j * dimensions] < minValue)
             {
-                minValue = means[j][0];
+                minValue = means[j * dimensions];
                 sort[i] = j;
             }
         }
@@ -385,7 +500,7 @@ bool GaussianEMEstimator<TInputImage,TMaskImage>::maximization(std::vector<Gauss
         GaussianFunctionType::MeanVectorType mu(dimensions);
         for(unsigned int j = 0; j < dimensions; j++)
         {
-            mu[j] = means[sort[i]][j];
+            mu[j] = means[sort[i] * dimensions + j];
         }
 
         GaussianFunctionType::Pointer tmp = GaussianFunctionType::New();
@@ -395,20 +510,13 @@ bool GaussianEMEstimator<TInputImage,TMaskImage>::maximization(std::vector<Gauss
         newModel.push_back(tmp);
     }
 
-    delete[] sort;
-    for (unsigned int i = 0; i < numberOfClasses; ++i)
-    {
-        delete[] (means[i]);
-    }
-    delete[] mixedProportions;
-
     return true;
 }
 
 template <typename TInputImage, typename TMaskImage>
 void GaussianEMEstimator<TInputImage,TMaskImage>::Update()
 {
-    this->createJointHistogram();
+    this->updateJointHistogram();
     this->m_JointHistogram = this->m_JointHistogramInitial;
     unsigned int iter = 0; //number of current iterations
     double distance = 0.0;
@@ -441,88 +549,37 @@ void GaussianEMEstimator<TInputImage,TMaskImage>::Update()
 }
 
 template <typename TInputImage, typename TMaskImage>
-double GaussianEMEstimator<TInputImage,TMaskImage>::likelihood(GaussianFunctionType::CovarianceMatrixType *invCovariance, double *detCovariance)
+double GaussianEMEstimator<TInputImage,TMaskImage>::likelihood()
 {
     double likelihoodValue = 0.0;
     unsigned int nbClasses = m_GaussianModel.size();
-    GaussianFunctionType::CovarianceMatrixType *inverseCovariance = NULL;
-    double *determinantCovariance = NULL;
-    if(invCovariance != NULL && detCovariance !=NULL)
-    {
-        inverseCovariance = invCovariance;
-        determinantCovariance = detCovariance;
-    }
-    else
-    {
-        inverseCovariance = new GaussianFunctionType::CovarianceMatrixType[nbClasses];
-        determinantCovariance = new double[nbClasses];
+    unsigned int numBins = this->m_JointHistogram.size();
 
-        //1. We calculate covariance inverse and determinant
-        for(unsigned int i = 0 ; i < nbClasses; i++)
-        {
-            GaussianFunctionType::CovarianceMatrixType covar = (m_GaussianModel[i])->GetCovariance();
-            determinantCovariance[i] = vnl_determinant(covar.GetVnlMatrix());
-            if(std::fabs(determinantCovariance[i]) < 1e-9)
-            {
-                return likelihoodValue;
-            }
-            inverseCovariance[i] = covar.GetInverse();
-        }
-    }
-
-    //2. We calculate the a posteriori probability
-    Histogram::iterator histoIt;
-    GenericContainer::iterator it = this->m_APosterioriProbability.begin();
+    //1. We calculate covariance inverse and determinant
+    if ((numBins == 0)||(this->m_APosterioriProbability.size() != nbClasses * numBins)||(!this->computeModelParameters(1e-9)))
+        return likelihoodValue;
 
-    GaussianFunctionType::CovarianceMatrixType intensities(this->m_JointHistogram.begin()->first.size(),1);
+    unsigned int dimension = this->m_JointHistogram.dimension;
+    std::vector<double> distances;
+    this->computeMahalanobisDistances(this->m_JointHistogram,0,numBins,distances);
 
-    for(histoIt = this->m_JointHistogram.begin(); histoIt != this->m_JointHistogram.end(); ++histoIt, ++it)
+    for (unsigned int b = 0; b < numBins; ++b)
     {
-        //We set the intensities of the histogram in a vector
-        for(unsigned int i = 0; i < histoIt->first.size(); i++)
-        {
-            intensities(i,0) = static_cast<double> (histoIt->first[i]);
-        }
-
         unsigned int maxIndex = 0;
         double maxPostProba = 0.0;
         //we look for the max post proba to resolve de ecuation
         for(unsigned int i = 0; i < nbClasses; i++)
         {
-            if(it->second[i] > maxPostProba)
+            if(this->m_APosterioriProbability[i * numBins + b] > maxPostProba)
             {
-                maxPostProba = it->second[i];
+                maxPostProba = this->m_APosterioriProbability[i * numBins + b];
                 maxIndex = i;
             }
         }
 
-        GaussianFunctionType::CovarianceMatrixType x,xT,result;
-        GaussianFunctionType::MeanVectorType mu = (m_GaussianModel[maxIndex])->GetMean();
-        for(unsigned int i = 0; i < mu.Size(); i++)
-        {
-            x.SetSize(mu.Size(),1);
-            x(i,0) = mu[i];
-        }
-        x = intensities - x;
-        xT = (x.GetTranspose());
-        result = xT * inverseCovariance[maxIndex] * x;
-        double proba = result(0,0);
-
-        likelihoodValue += histoIt->second * ( -proba/2.0 - std::log(std::sqrt(pow(2*M_PI,static_cast<int>(this->m_JointHistogram.begin()->first.size())) *
-                                                                              std::fabs(determinantCovariance[maxIndex])))
-                                              + std::log(m_Alphas[maxIndex]/maxPostProba));
-    }
-
-    //Cleaning pointers if created in this function
-    if((invCovariance == NULL)&&(inverseCovariance!=NULL))
-    {
-        delete[] inverseCovariance;
-        inverseCovariance=NULL;
-    }
-    if((detCovariance ==NULL)&&(determinantCovariance!=NULL))
-    {
-        delete[] determinantCovariance;
-        determinantCovariance=NULL;
+        likelihoodValue += this->m_JointHistogram.counts[b] * ( -distances[maxIndex * numBins + b]/2.0
+                                                                - std::log(std::sqrt(std::pow(2*M_PI,static_cast<int>(dimension)) * std::fabs(m_ModelDeterminants[maxIndex])))
+                                                                + std::log(m_Alphas[maxIndex]/maxPostProba));
     }
 
     return likelihoodValue;
@@ -13,6 +13,7 @@ namespace anima
  * The trimming parameter m_RejectionRatio determines how many voxels are rejected from the estimation.
  * In other words, the likelihood is only computed with the voxels that are the most likely to belong to the model.
  * For m_RejectionRatio = 0, the REM algorithm is equivalent to the original EM.
+ * Expectation and maximization steps are the ones of GaussianEMEstimator, on the concentrated flat joint histogram.
  * @see GaussianEMEstimator
  */
 template <typename TInputImage, typename TMaskImage>
@@ -35,12 +36,12 @@ public:
     typedef double                    NumericType;
     typedef itk::VariableSizeMatrix< NumericType >::InternalMatrixType DoubleVariableSizeMatrixVnlType;
 
-    typedef double Ocurrences;
-    typedef unsigned short MeasureType;
-    typedef std::vector<MeasureType> Intensities;
-    typedef std::map< Intensities, std::vector<Ocurrences> > GenericContainer;
-    typedef std::map<Intensities,Ocurrences> Histogram;
-    typedef std::map<double,std::vector<unsigned short> > ResidualMap;
+    typedef GaussianEMEstimator<TInputImage,TMaskImage> EMEstimatorType;
+    typedef typename EMEstimatorType::Ocurrences Ocurrences;
+    typedef typename EMEstimatorType::MeasureType MeasureType;
+    typedef typename EMEstimatorType::Intensities Intensities;
+    typedef typename EMEstimatorType::GenericContainer GenericContainer;
+    typedef typename EMEstimatorType::Histogram Histogram;
 
     typedef itk::VariableLengthVector<double> MeasurementVectorType;
     typedef itk::Statistics::GaussianMembershipFunction< MeasurementVectorType > GaussianFunctionType;
@@ -1,120 +1,104 @@
 #include "animaGaussianREMEstimator.h"
 
+#include <algorithm>
+
 namespace anima
 {
 
 template <typename TInputImage, typename TMaskImage>
 bool GaussianREMEstimator<TInputImage,TMaskImage>::concentration()
 {
-    std::vector<vnl_matrix<GaussianREMEstimator::NumericType> > inverseCovariance;
-    inverseCovariance.reserve(this->m_GaussianModel.size());
-    double *determinantCovariance = new double[this->m_GaussianModel.size()];
-
-    if(!this->m_APosterioriProbability.empty())
-        this->m_APosterioriProbability.clear();
-    if(!this->m_JointHistogram.empty())
-        this->m_JointHistogram.clear();
-
-    GaussianFunctionType::CovarianceMatrixType *covari = new GaussianFunctionType::CovarianceMatrixType[this->m_GaussianModel.size()];
-    for(unsigned int i = 0; i < this->m_GaussianModel.size(); i++)
-    {
-        covari[i] = (this->m_GaussianModel[i])->GetCovariance();
-    }
+    this->m_APosterioriProbability.clear();
+    this->m_JointHistogram.clear();
 
     //1. We calculate covariance inverse and determinant
-    for(unsigned int i = 0; i < this->m_GaussianModel.size(); i++)
+    unsigned int numBins = this->m_OriginalJointHistogram.size();
+    if ((numBins == 0)||(!this->computeModelParameters(1e-12)))
+        return false;
+
+    unsigned int nbClasses = this->m_GaussianModel.size();
+    std::vector<double> sqrtDeterminants(nbClasses);
+    for(unsigned int i = 0; i < nbClasses; i++)
+        sqrtDeterminants[i] = std::sqrt(this->m_ModelDeterminants[i]);
+
+    // Log of the probability of each bin under the mixture (up to a constant)
+    std::vector<double> residuals(numBins);
+    this->parallelizeOverBins(numBins,[&](unsigned int startBin, unsigned int endBin, unsigned int chunk)
     {
-        determinantCovariance[i] = vnl_determinant(covari[i].GetVnlMatrix());
-        if(std::fabs(determinantCovariance[i]) < 1e-12)
-        {
-            return false;
-        }
-        inverseCovariance.push_back(covari[i].GetInverse());
-    }
-
-    Histogram::iterator histoIt;
-    GaussianFunctionType::CovarianceMatrixType intensities(this->m_OriginalJointHistogram.begin()->first.size(),1);
-    std::vector<double> probas(this->m_GaussianModel.size());
+        unsigned int chunkSize = endBin - startBin;
+        std::vector<double> distances;
+        this->computeMahalanobisDistances(this->m_OriginalJointHistogram,startBin,endBin,distances);
 
-    ResidualMap residualMap;
-    double numberOfPixels=0;
-
-    GaussianFunctionType::CovarianceMatrixType *xi = new GaussianFunctionType::CovarianceMatrixType[probas.size()];
-    for(unsigned int i = 0; i < probas.size(); i++)
-    {
-        GaussianFunctionType::MeanVectorType mu = (this->m_GaussianModel[i])->GetMean();
-        (xi[i]).SetSize(mu.Size(),1);
-        for(unsigned int j = 0; j < mu.Size(); j++)
+        for (unsigned int b = 0; b < chunkSize; ++b)
         {
-            (xi[i])(j,0) = mu[j];
-        }
-    }
+            double concentrationValue = 0.0;
+            for(unsigned int i = 0; i < nbClasses; i++)
+                concentrationValue += this->m_Alphas[i] * std::exp(-distances[i * chunkSize + b] / 2.0) / sqrtDeterminants[i];
 
-    GaussianFunctionType::CovarianceMatrixType x,xT;
-    for(histoIt = this->m_OriginalJointHistogram.begin(); histoIt != this->m_OriginalJointHistogram.end(); ++histoIt)
-    {
-        //We set the intensities of the histogram in a vector
-        for(unsigned int i = 0; i < histoIt->first.size(); i++)
-        {
-            intensities(i,0) = static_cast<double>(histoIt->first[i]);
+            residuals[startBin + b] = std::log(concentrationValue);
         }
+    });
 
-        double concentrationValue = 0.0;
+    double numberOfPixels = 0;
+    for (unsigned int b = 0; b < numBins; ++b)
+        numberOfPixels += this->m_OriginalJointHistogram.counts[b];
 
-        //Calculate the exponential term and the minimum of them
-        for(unsigned int i = 0; i < probas.size(); i++)
-        {
-            x = intensities - xi[i];
-            xT = (x.GetTranspose());
-            vnl_matrix<GaussianREMEstimator::NumericType> result = xT.GetVnlMatrix() * inverseCovariance[i] * x.GetVnlMatrix();
-            probas[i] = result(0,0)/2;
-            concentrationValue += this->m_Alphas[i] * std::exp(-probas[i]) / std::sqrt( determinantCovariance[i] );
-        }
+    // Bins are rejected from the least probable one
+    std::vector<unsigned int> residualOrder(numBins);
+    for (unsigned int b = 0; b < numBins; ++b)
+        residualOrder[b] = b;
 
-        //Add value to the GenericContainer
-        // We are storing the value inside of the exponential( it will be use in expectation)
-        //this->m_APosterioriProbability.insert(GenericContainer::value_type(histoIt->first,probas));
-        //Fill residualmap with probabilities of the mixed gaussian (probability = constant * concentrationvalue)
-        residualMap.insert(ResidualMap::value_type(std::log(concentrationValue),histoIt->first));
-        numberOfPixels+=histoIt->second;
-    }
-
-    ResidualMap::iterator it = residualMap.begin();
+    std::stable_sort(residualOrder.begin(),residualOrder.end(),[&residuals](unsigned int a, unsigned int b)
+    {
+        return residuals[a] < residuals[b];
+    });
 
     //number of rejected pixels
     double numberOfRejections = this->m_RejectionRatio * numberOfPixels;
     double rejected = 0;
-    this->m_JointHistogram = this->m_OriginalJointHistogram;
+    std::vector<Ocurrences> keptCounts(this->m_OriginalJointHistogram.counts);
 
-    for(it=residualMap.begin(); it != residualMap.end(); ++it)
+    for (unsigned int i = 0; i < numBins; ++i)
     {
         if(rejected >= numberOfRejections)
             break;
-        histoIt = this->m_JointHistogram.find(it->second);
-        if(histoIt == this->m_JointHistogram.end())
-        {
-            return false;
-        }
-        double actual = histoIt->second;
+
+        double actual = keptCounts[residualOrder[i]];
         if(actual+rejected >= numberOfRejections)
         {
             //We pass the limit...we get only some points of this Intensities
-            histoIt->second = actual+rejected-numberOfRejections;
+            keptCounts[residualOrder[i]] = actual+rejected-numberOfRejections;
             break;
         }
         else
         {
             //We don't pass the limit... we eliminate this Intensities
-            this->m_JointHistogram.erase(histoIt);
+            keptCounts[residualOrder[i]] = -1;
             rejected += actual;
         }
     }
 
-    delete[] determinantCovariance;
-    determinantCovariance = NULL;
+    // Concentrated histogram: remaining bins, in their original order
+    unsigned int dimension = this->m_OriginalJointHistogram.dimension;
+    std::vector<unsigned int> keptBins;
+    for (unsigned int b = 0; b < numBins; ++b)
+    {
+        if (keptCounts[b] >= 0)
+            keptBins.push_back(b);
+    }
 
-    delete[] xi;
-    xi = NULL;
+    unsigned int numKeptBins = keptBins.size();
+    this->m_JointHistogram.dimension = dimension;
+    this->m_JointHistogram.counts.resize(numKeptBins);
+    this->m_JointHistogram.intensities.resize(dimension * numKeptBins);
+    for (unsigned int b = 0; b < numKeptBins; ++b)
+        this->m_JointHistogram.counts[b] = keptCounts[keptBins[b]];
+
+    for (unsigned int j = 0; j < dimension; ++j)
+    {
+        for (unsigned int b = 0; b < numKeptBins; ++b)
+            this->m_JointHistogram.intensities[j * numKeptBins + b] = this->m_OriginalJointHistogram.intensities[j * numBins + keptBins[b]];
+    }
 
     return true;
 }
@@ -149,7 +133,7 @@ int GaussianREMEstimator<TInputImage,TMaskImage>
 template <typename TInputImage, typename TMaskImage>
 void GaussianREMEstimator<TInputImage,TMaskImage>::Update()
 {
-    this->createJointHistogram();
+    this->updateJointHistogram();
 
     this->m_OriginalJointHistogram = this->m_JointHistogramInitial;
 
@@ -12,12 +12,14 @@
 #include <itkIdentityTransform.h>
 #include <itkBSplineInterpolateImageFunction.h>
 #include <itkMaskImageFilter.h>
+#include <itksys/SystemInformation.hxx>
 
 namespace anima
 {
 /**
  * @brief Class allowing the decimation of the images if necessary (if 3D graph size causes memory problems).
- * This class just launchs NLinksFilter with appropriate image sizes.
+ * This class just launchs NLinksFilter with appropriate image sizes. The memory needed by the grid graph is
+ * known analytically, decimation is only used if it exceeds the available physical memory.
  */
 template <typename TInput, typename TOutput>
 class Graph3DFilter :
@@ -59,7 +61,7 @@ public:
     typedef itk::ImageRegionIterator< TMask > MaskRegionIteratorType;
     typedef itk::ImageRegionConstIterator< TMask > MaskRegionConstIteratorType;
 
-    typedef Graph<double,double,double> GraphType;
+    typedef GridGraph <double> GraphType;
 
     typedef double NumericType;
     typedef itk::VariableSizeMatrix<NumericType> doubleVariableSizeMatrixType;
@@ -138,6 +140,7 @@ protected:
         m_NLinksFilter = NLinksFilterType::New();
 
         m_Tol = 0.0001;
+        m_AvailableMemory = 0;
 
         this->SetNumberOfRequiredOutputs(2);
         this->SetNumberOfRequiredInputs(4);
@@ -166,6 +169,10 @@ protected:
 
     void GenerateData() ITK_OVERRIDE;
     bool CheckMemory();
+
+    //! Memory (in bytes) needed by the graph and the n-links filter images at a given downsampling factor
+    size_t EstimateRequiredMemory(double downsamplingFactor);
+
     void ProcessGraphCut();
     void FindDownsampleFactor();
     void InitResampleFilters();
@@ -182,10 +189,6 @@ private:
      */
     double m_Sigma;
 
-    /** the created graph
-     */
-    GraphType *m_graph;
-
     /** transformation matrix (from im1,im2,im3 to e,el,ell)
      */
     std::string m_MatFilename;
@@ -201,6 +204,9 @@ private:
     double m_DownsamplingFactor;
     int m_Count;
 
+    //! Physical memory available for the graph, in bytes, computed by CheckMemory
+    size_t m_AvailableMemory;
+
     TMask::Pointer m_CurrentMask;
     typename TInput::SizeType m_InputSize;
     typename TInput::DirectionType m_OutputDirection;
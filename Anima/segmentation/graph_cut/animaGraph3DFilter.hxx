@@ -253,36 +253,22 @@ bool
 Graph3DFilter<TInput, TOutput>
 ::CheckMemory()
 {
-    unsigned int nb_vox = 0;
-    bool mem = true;
-    MaskRegionConstIteratorType maskIt (this->GetMask(),this->GetMask()->GetLargestPossibleRegion() );
-    while (!maskIt.IsAtEnd())
-    {
-        if (maskIt.Get() != 0)
-        {
-            nb_vox++;
-        }
-        ++maskIt;
-    }
-
-    unsigned int nb_edges = 7*nb_vox;
-
-    try
-    {
-        m_graph = new GraphType(nb_vox, nb_edges);
-    }
-    catch (std::bad_alloc& ba)
-    {
-        std::cerr << "-- In Graph3DFilter: insufficient memory to create the graph: " << ba.what() << '\n';
-        mem = false;
-    }
-
-    if (m_graph)
-    {
-        delete m_graph;
-        m_graph = NULL;
-    }
-    return mem;
+    // The grid graph size is known analytically from the mask bounding box, no need to try allocating it
+    itksys::SystemInformation systemInformation;
+    systemInformation.RunMemoryCheck();
+    m_AvailableMemory = static_cast <size_t> (systemInformation.GetAvailablePhysicalMemory()) * 1024 * 1024;
+
+    // Unknown available memory: try at full resolution
+    if (m_AvailableMemory == 0)
+        return true;
+
+    size_t requiredMemory = this->EstimateRequiredMemory(1.0);
+    if (requiredMemory <= m_AvailableMemory)
+        return true;
+
+    std::cerr << "-- In Graph3DFilter: insufficient memory to create the graph: " << requiredMemory / (1024 * 1024)
+              << " MB needed, " << m_AvailableMemory / (1024 * 1024) << " MB available" << std::endl;
+    return false;
 }
 
 template <typename TInput, typename TOutput>
@@ -325,6 +311,33 @@ Graph3DFilter<TInput, TOutput>
     this->GraftNthOutput( 1 , m_NLinksFilter->GetOutputBackground() );
 }
 
+template <typename TInput, typename TOutput>
+size_t
+Graph3DFilter<TInput, TOutput>
+::EstimateRequiredMemory(double downsamplingFactor)
+{
+    // Graph on the mask bounding box, at the given decimation level
+    TMask::RegionType boundingBox = NLinksFilterType::ComputeMaskBoundingBox(this->GetMask());
+    typename GraphType::SizeType graphSize;
+    for (unsigned int i = 0;i < 3;++i)
+        graphSize[i] = std::ceil(boundingBox.GetSize()[i] / downsamplingFactor);
+
+    size_t requiredMemory = GraphType::EstimateMemorySize(graphSize);
+
+    // Images allocated by the n-links filter on the whole (decimated) mask: foreground and background outputs,
+    // and the two spectral gradient components if used
+    typename TMask::SizeType imageSize = this->GetMask()->GetLargestPossibleRegion().GetSize();
+    size_t numPixels = 1;
+    for (unsigned int i = 0;i < 3;++i)
+        numPixels *= std::max(static_cast <size_t> (1), static_cast <size_t> (imageSize[i] / downsamplingFactor));
+
+    requiredMemory += 2 * numPixels * sizeof(OutputPixelType);
+    if (m_UseSpectralGradient)
+        requiredMemory += 2 * numPixels * sizeof(SeedProbaPixelType);
+
+    return requiredMemory;
+}
+
 template <typename TInput, typename TOutput>
 void
 Graph3DFilter<TInput, TOutput>::FindDownsampleFactor()
@@ -332,65 +345,21 @@ Graph3DFilter<TInput, TOutput>::FindDownsampleFactor()
     m_DownsamplingFactor = 2.0;
     m_Count = 1;
 
-    bool mem2 = false;
-    while(!mem2)
-    {
-        typename TInput::SizeType inputSize = this->GetMask()->GetLargestPossibleRegion().GetSize();
-        typename TInput::DirectionType outputDirection = this->GetMask()->GetDirection();
-        typename TInput::PointType outputOrigin = this->GetMask()->GetOrigin();
+    // Decimated images should keep at least one voxel along each axis
+    typename TMask::SizeType imageSize = this->GetMask()->GetLargestPossibleRegion().GetSize();
+    double maximalFactor = std::min(imageSize[0], std::min(imageSize[1], imageSize[2]));
+    if (m_DownsamplingFactor > maximalFactor)
+        itkExceptionMacro("Insufficient memory to create the graph, and image too small to be downsampled");
 
-        // Resize images
-        typename TInput::SizeType outputSize;
-        outputSize[0] = inputSize[0] / m_DownsamplingFactor;
-        outputSize[1] = inputSize[1] / m_DownsamplingFactor;
-        outputSize[2] = inputSize[2] / m_DownsamplingFactor;
-        typename TInput::SpacingType outputSpacing;
-        outputSpacing[0] = this->GetMask()->GetSpacing()[0] * (static_cast<double>(inputSize[0]) / static_cast<double>(outputSize[0]));
-        outputSpacing[1] = this->GetMask()->GetSpacing()[1] * (static_cast<double>(inputSize[1]) / static_cast<double>(outputSize[1]));
-        outputSpacing[2] = this->GetMask()->GetSpacing()[2] * (static_cast<double>(inputSize[2]) / static_cast<double>(outputSize[2]));
-
-        ResampleImageFilterMaskType::Pointer resampleMask = ResampleImageFilterMaskType::New();
-        resampleMask->SetOutputDirection( outputDirection );
-        resampleMask->SetOutputOrigin( outputOrigin );
-        resampleMask->SetInput( this->GetMask() );
-        resampleMask->SetSize( outputSize );
-        resampleMask->SetOutputSpacing( outputSpacing );
-        resampleMask->SetTransform( TransformType::New() );
-        resampleMask->SetNumberOfWorkUnits( this->GetNumberOfWorkUnits() );
-        resampleMask->SetCoordinateTolerance( m_Tol );
-        resampleMask->SetDirectionTolerance( m_Tol );
-        resampleMask->Update();
-
-        unsigned int nb_vox = 0;
-        MaskRegionIteratorType maskIt (resampleMask->GetOutput(),resampleMask->GetOutput()->GetLargestPossibleRegion() );
-        while (!maskIt.IsAtEnd())
-        {
-            if (maskIt.Get() != 0)
-            {
-                nb_vox++;
-            }
-            ++maskIt;
-        }
+    while (this->EstimateRequiredMemory(m_DownsamplingFactor) > m_AvailableMemory)
+    {
+        std::cerr << "-- In Graph3DFilter: insufficient memory to create the graph at downsampling factor " << m_DownsamplingFactor << std::endl;
 
-        unsigned int nb_edges = 7*nb_vox;
-        mem2 = true;
-        try
-        {
-            m_graph = new GraphType(nb_vox, nb_edges);
-        }
-        catch (std::bad_alloc& ba)
-        {
-            std::cerr << "-- In Graph3DFilter: insufficient memory to create the graph ICI: " << ba.what() << '\n';
-            mem2 = false;
-            m_Count++;
-            m_DownsamplingFactor*=2.0;
-        }
+        if (2.0 * m_DownsamplingFactor > maximalFactor)
+            itkExceptionMacro("Insufficient memory to create the graph, even at the largest downsampling factor");
 
-        if (m_graph)
-        {
-            delete m_graph;
-            m_graph = NULL;
-        }
+        m_Count++;
+        m_DownsamplingFactor*=2.0;
     }
 }
 
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <itkMultiThreaderBase.h>
+#include <itkSize.h>
+
+#include <vector>
+
+namespace anima
+{
+
+/**
+ * @brief Compact 6-connected graph on a 3D voxel grid, with a parallel max-flow / min-cut solver.
+ *
+ * Nodes are the voxels of the grid, edges are implicit: each node stores the residual capacities towards its 6
+ * neighbors and towards the sink, its excess and its distance label, in flat arrays indexed by voxel. There is no
+ * per node or per edge structure, so the memory footprint is known in advance (see EstimateMemorySize).
+ *
+ * The maximum flow is computed with a region-parallel push-relabel algorithm: the grid is split into slabs of z
+ * slices, even and odd slabs being discharged alternately. Slabs of the same parity are never adjacent, so each
+ * one runs a sequential FIFO push-relabel on its nodes, pushing excess to the neighboring slabs whose labels stay
+ * fixed meanwhile, without any locking. Exact distance labels are restored periodically by a breadth first search
+ * from the sink.
+ *
+ * The resulting cut is the same as the one of the Boykov-Kolmogorov Graph class: a node is on the SINK side if it
+ * can still reach the sink in the residual graph, on the SOURCE side otherwise (including isolated nodes). The latter
+ * is kept as a reference implementation, checked against in grid_graph_test.
+ */
+template <class TCapacity>
+class GridGraph
+{
+public:
+    typedef enum
+    {
+        SOURCE = 0,
+        SINK = 1
+    } TerminalType;
+
+    typedef itk::Size <3> SizeType;
+
+    GridGraph();
+    ~GridGraph() {}
+
+    //! Allocates the graph on a grid of the given size, all capacities being null
+    void Initialize(const SizeType &size);
+
+    //! Memory (in bytes) required by a graph on a grid of the given size
+    static size_t EstimateMemorySize(const SizeType &size);
+
+    void SetNumberOfWorkUnits(unsigned int val) {m_NumberOfWorkUnits = val;}
+
+    /**
+     * Fraction of the number of nodes: a global relabeling (exact distances to the sink) is performed each time
+     * region discharges have scanned or relabeled this many nodes since the last one
+     */
+    void SetGlobalRelabelFrequency(double val) {m_GlobalRelabelFrequency = val;}
+
+    size_t GetNodeIndex(unsigned int x, unsigned int y, unsigned int z) const
+    {
+        return x + m_Size[0] * (y + static_cast <size_t> (m_Size[1]) * z);
+    }
+
+    /**
+     * Sets the capacities of the edge between node (x,y,z) and its neighbor along +axis (cap), and back (revCap).
+     * Thread safe for distinct nodes
+     */
+    void SetNeighborCapacities(unsigned int x, unsigned int y, unsigned int z, unsigned int axis, TCapacity cap, TCapacity revCap);
+
+    //! Sets the capacities from the source and to the sink of a node. Thread safe for distinct nodes
+    void SetTerminalCapacities(size_t nodeIndex, TCapacity sourceCap, TCapacity sinkCap);
+
+    //! Computes the maximum flow and the associated minimum cut
+    void ComputeMaxFlow();
+
+    //! Side of the minimum cut of a node, only valid after ComputeMaxFlow
+    TerminalType GetSegment(size_t nodeIndex) const
+    {
+        return (m_Labels[nodeIndex] == InfiniteLabel) ? SOURCE : SINK;
+    }
+
+protected:
+    //! Label of nodes that cannot reach the sink anymore
+    static const unsigned int InfiniteLabel = static_cast <unsigned int> (-1);
+
+    //! Splits the grid into slabs of z slices, at least two slices thick
+    void InitializeRegions();
+
+    //! Computes exact distances to the sink with a breadth first search in the residual graph, updates active regions
+    void GlobalRelabel();
+
+    /**
+     * Sequential FIFO push-relabel on the nodes of a region, nodes of other regions being only pushed to.
+     * Stops after maximalRelabels relabelings so that a global relabeling may be done, returns true if the region has
+     * no active node left
+     */
+    bool DischargeRegion(unsigned int region, size_t maximalRelabels);
+
+    //! Node index of the neighbor in direction d (+x,-x,+y,-y,+z,-z)
+    size_t GetNeighborIndex(size_t nodeIndex, unsigned int d) const
+    {
+        unsigned int axis = d / 2;
+        return (d % 2 == 0) ? nodeIndex + m_Strides[axis] : nodeIndex - m_Strides[axis];
+    }
+
+private:
+    SizeType m_Size;
+    size_t m_NumberOfNodes;
+    size_t m_Strides[3];
+
+    //! Residual capacities towards the neighbors (+x,-x,+y,-y,+z,-z) of each node
+    std::vector <TCapacity> m_ResidualCapacities;
+    std::vector <TCapacity> m_Excesses;
+    std::vector <TCapacity> m_SinkCapacities;
+    std::vector <unsigned int> m_Labels;
+
+    //! Queue of the global relabeling, and FIFO queues of the regions on their own node range
+    std::vector <unsigned int> m_Queue;
+    std::vector <unsigned char> m_QueuedNodes;
+
+    //! First slice of each region, plus the number of slices
+    std::vector <unsigned int> m_RegionStarts;
+    std::vector <unsigned char> m_ActiveRegions;
+    //! Set by a region discharge if it pushed flow to the previous / next region
+    std::vector <unsigned char> m_PushedToPreviousRegion;
+    std::vector <unsigned char> m_PushedToNextRegion;
+    //! Number of nodes scanned and relabeled by the last discharge of each region
+    std::vector <size_t> m_RegionWork;
+
+    unsigned int m_NumberOfWorkUnits;
+    double m_GlobalRelabelFrequency;
+    itk::MultiThreaderBase::Pointer m_Threader;
+};
+
+} // end namespace anima
+
+#include "animaGridGraph.hxx"
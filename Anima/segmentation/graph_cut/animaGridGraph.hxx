@@ -0,0 +1,339 @@
+#pragma once
+#include "animaGridGraph.h"
+
+#include <itkMacro.h>
+#include <algorithm>
+
+namespace anima
+{
+
+template <class TCapacity>
+const unsigned int GridGraph <TCapacity>::InfiniteLabel;
+
+template <class TCapacity>
+GridGraph <TCapacity>::GridGraph()
+{
+    m_Size.Fill(0);
+    m_NumberOfNodes = 0;
+    m_Strides[0] = m_Strides[1] = m_Strides[2] = 0;
+
+    m_NumberOfWorkUnits = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+    m_GlobalRelabelFrequency = 0.5;
+    m_Threader = itk::MultiThreaderBase::New();
+}
+
+template <class TCapacity>
+size_t GridGraph <TCapacity>::EstimateMemorySize(const SizeType &size)
+{
+    size_t numNodes = static_cast <size_t> (size[0]) * size[1] * size[2];
+
+    // 6 residual capacities, excess and sink capacity, label, queue entry and queued flag per node
+    size_t nodeSize = 8 * sizeof(TCapacity) + 2 * sizeof(unsigned int) + sizeof(unsigned char);
+    size_t sliceSize = sizeof(unsigned int) + 3 * sizeof(unsigned char) + sizeof(size_t);
+
+    return numNodes * nodeSize + size[2] * sliceSize;
+}
+
+template <class TCapacity>
+void GridGraph <TCapacity>::Initialize(const SizeType &size)
+{
+    m_Size = size;
+    m_NumberOfNodes = static_cast <size_t> (size[0]) * size[1] * size[2];
+    m_Strides[0] = 1;
+    m_Strides[1] = size[0];
+    m_Strides[2] = static_cast <size_t> (size[0]) * size[1];
+
+    if (m_NumberOfNodes >= InfiniteLabel)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Too many nodes for a grid graph",ITK_LOCATION);
+
+    m_ResidualCapacities.assign(6 * m_NumberOfNodes,0);
+    m_Excesses.assign(m_NumberOfNodes,0);
+    m_SinkCapacities.assign(m_NumberOfNodes,0);
+    m_Labels.assign(m_NumberOfNodes,InfiniteLabel);
+    m_Queue.assign(m_NumberOfNodes,0);
+    m_QueuedNodes.assign(m_NumberOfNodes,0);
+}
+
+template <class TCapacity>
+void GridGraph <TCapacity>::SetNeighborCapacities(unsigned int x, unsigned int y, unsigned int z, unsigned int axis,
+                                                  TCapacity cap, TCapacity revCap)
+{
+    unsigned int coordinates[3] = {x, y, z};
+    if ((axis > 2) || (coordinates[axis] + 1 >= m_Size[axis]))
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Grid graph edge outside of the grid",ITK_LOCATION);
+
+    size_t nodeIndex = this->GetNodeIndex(x,y,z);
+    size_t neighborIndex = nodeIndex + m_Strides[axis];
+
+    m_ResidualCapacities[6 * nodeIndex + 2 * axis] = cap;
+    m_ResidualCapacities[6 * neighborIndex + 2 * axis + 1] = revCap;
+}
+
+template <class TCapacity>
+void GridGraph <TCapacity>::SetTerminalCapacities(size_t nodeIndex, TCapacity sourceCap, TCapacity sinkCap)
+{
+    // Flow min(sourceCap, sinkCap) goes directly from the source to the sink, only the rest is kept
+    if (sourceCap > sinkCap)
+    {
+        m_Excesses[nodeIndex] = sourceCap - sinkCap;
+        m_SinkCapacities[nodeIndex] = 0;
+    }
+    else
+    {
+        m_Excesses[nodeIndex] = 0;
+        m_SinkCapacities[nodeIndex] = sinkCap - sourceCap;
+    }
+}
+
+template <class TCapacity>
+void GridGraph <TCapacity>::InitializeRegions()
+{
+    unsigned int numSlices = m_Size[2];
+
+    // Two regions per work unit so that each parity keeps all threads busy, a single region when sequential
+    unsigned int numRegions = 1;
+    if (m_NumberOfWorkUnits > 1)
+        numRegions = std::max(1u,std::min(2 * m_NumberOfWorkUnits,numSlices / 2));
+
+    m_RegionStarts.resize(numRegions + 1);
+    for (unsigned int i = 0;i <= numRegions;++i)
+        m_RegionStarts[i] = static_cast <unsigned int> ((static_cast <size_t> (numSlices) * i) / numRegions);
+
+    m_ActiveRegions.assign(numRegions,0);
+    m_PushedToPreviousRegion.assign(numRegions,0);
+    m_PushedToNextRegion.assign(numRegions,0);
+    m_RegionWork.assign(numRegions,0);
+}
+
+template <class TCapacity>
+void GridGraph <TCapacity>::ComputeMaxFlow()
+{
+    if (m_NumberOfNodes == 0)
+        return;
+
+    this->InitializeRegions();
+    unsigned int numRegions = m_ActiveRegions.size();
+
+    // Work of discharges (scanned and relabeled nodes) after which a global relabeling is done, it costs about as much
+    size_t workThreshold = static_cast <size_t> (m_GlobalRelabelFrequency * m_NumberOfNodes) + 1;
+    size_t regionRelabelThreshold = workThreshold / numRegions + 1;
+    size_t work = 0;
+
+    this->GlobalRelabel();
+    m_Threader->SetNumberOfWorkUnits(m_NumberOfWorkUnits);
+
+    while (std::find(m_ActiveRegions.begin(),m_ActiveRegions.end(),1) != m_ActiveRegions.end())
+    {
+        for (unsigned int parity = 0;parity < 2;++parity)
+        {
+            unsigned int numParityRegions = (numRegions + 1 - parity) / 2;
+            m_Threader->ParallelizeArray(0,numParityRegions,[this,parity,regionRelabelThreshold](itk::SizeValueType i)
+            {
+                unsigned int region = 2 * i + parity;
+                m_RegionWork[region] = 0;
+                m_PushedToPreviousRegion[region] = 0;
+                m_PushedToNextRegion[region] = 0;
+
+                if (m_ActiveRegions[region])
+                    m_ActiveRegions[region] = !this->DischargeRegion(region,regionRelabelThreshold);
+            }, ITK_NULLPTR);
+
+            for (unsigned int region = parity;region < numRegions;region += 2)
+            {
+                work += m_RegionWork[region];
+
+                if (m_PushedToPreviousRegion[region])
+                    m_ActiveRegions[region - 1] = 1;
+                if (m_PushedToNextRegion[region])
+                    m_ActiveRegions[region + 1] = 1;
+            }
+        }
+
+        if (work >= workThreshold)
+        {
+            this->GlobalRelabel();
+            work = 0;
+        }
+    }
+
+    // Remaining excess cannot reach the sink: exact labels now give the minimum cut
+    this->GlobalRelabel();
+}
+
+template <class TCapacity>
+void GridGraph <TCapacity>::GlobalRelabel()
+{
+    std::fill(m_Labels.begin(),m_Labels.end(),InfiniteLabel);
+
+    // Breadth first search from the sink, backwards along residual edges
+    size_t queueStart = 0;
+    size_t queueEnd = 0;
+
+    for (size_t i = 0;i < m_NumberOfNodes;++i)
+    {
+        if (m_SinkCapacities[i] > 0)
+        {
+            m_Labels[i] = 1;
+            m_Queue[queueEnd++] = i;
+        }
+    }
+
+    while (queueStart < queueEnd)
+    {
+        size_t nodeIndex = m_Queue[queueStart++];
+        unsigned int nextLabel = m_Labels[nodeIndex] + 1;
+
+        size_t remainder = nodeIndex;
+        unsigned int coordinates[3];
+        coordinates[2] = remainder / m_Strides[2];
+        remainder -= coordinates[2] * m_Strides[2];
+        coordinates[1] = remainder / m_Strides[1];
+        coordinates[0] = remainder - coordinates[1] * m_Strides[1];
+
+        for (unsigned int axis = 0;axis < 3;++axis)
+        {
+            // Neighbor along +axis, its edge towards this node is its -axis one
+            if (coordinates[axis] + 1 < m_Size[axis])
+            {
+                size_t neighborIndex = nodeIndex + m_Strides[axis];
+                if ((m_Labels[neighborIndex] == InfiniteLabel) && (m_ResidualCapacities[6 * neighborIndex + 2 * axis + 1] > 0))
+                {
+                    m_Labels[neighborIndex] = nextLabel;
+                    m_Queue[queueEnd++] = neighborIndex;
+                }
+            }
+
+            if (coordinates[axis] > 0)
+            {
+                size_t neighborIndex = nodeIndex - m_Strides[axis];
+                if ((m_Labels[neighborIndex] == InfiniteLabel) && (m_ResidualCapacities[6 * neighborIndex + 2 * axis] > 0))
+                {
+                    m_Labels[neighborIndex] = nextLabel;
+                    m_Queue[queueEnd++] = neighborIndex;
+                }
+            }
+        }
+    }
+
+    for (unsigned int region = 0;region < m_ActiveRegions.size();++region)
+    {
+        size_t startIndex = m_RegionStarts[region] * m_Strides[2];
+        size_t endIndex = m_RegionStarts[region + 1] * m_Strides[2];
+
+        m_ActiveRegions[region] = 0;
+        for (size_t i = startIndex;i < endIndex;++i)
+        {
+            if ((m_Excesses[i] > 0) && (m_Labels[i] != InfiniteLabel))
+            {
+                m_ActiveRegions[region] = 1;
+                break;
+            }
+        }
+    }
+}
+
+template <class TCapacity>
+bool GridGraph <TCapacity>::DischargeRegion(unsigned int region, size_t maximalRelabels)
+{
+    size_t startIndex = m_RegionStarts[region] * m_Strides[2];
+    size_t endIndex = m_RegionStarts[region + 1] * m_Strides[2];
+    size_t regionSize = endIndex - startIndex;
+
+    // Circular FIFO stored on the region part of the queue, each node being queued at most once
+    unsigned int *queue = m_Queue.data() + startIndex;
+    size_t queueHead = 0;
+    size_t numQueued = 0;
+
+    for (size_t i = startIndex;i < endIndex;++i)
+    {
+        if ((m_Excesses[i] > 0) && (m_Labels[i] != InfiniteLabel))
+        {
+            queue[numQueued++] = i;
+            m_QueuedNodes[i] = 1;
+        }
+    }
+
+    size_t numRelabels = 0;
+    while ((numQueued > 0) && (numRelabels < maximalRelabels))
+    {
+        size_t nodeIndex = queue[queueHead];
+        queueHead = (queueHead + 1) % regionSize;
+        --numQueued;
+        m_QueuedNodes[nodeIndex] = 0;
+
+        TCapacity excess = m_Excesses[nodeIndex];
+        unsigned int label = m_Labels[nodeIndex];
+        TCapacity *capacities = &m_ResidualCapacities[6 * nodeIndex];
+        TCapacity &sinkCapacity = m_SinkCapacities[nodeIndex];
+
+        while ((excess > 0) && (label != InfiniteLabel))
+        {
+            if ((label == 1) && (sinkCapacity > 0))
+            {
+                TCapacity flow = std::min(excess,sinkCapacity);
+                sinkCapacity -= flow;
+                excess -= flow;
+            }
+
+            // Edges only have a positive capacity if the neighbor is inside the grid
+            unsigned int minimalLabel = (sinkCapacity > 0) ? 0 : InfiniteLabel;
+            for (unsigned int d = 0;(d < 6) && (excess > 0);++d)
+            {
+                if (!(capacities[d] > 0))
+                    continue;
+
+                size_t neighborIndex = this->GetNeighborIndex(nodeIndex,d);
+                unsigned int neighborLabel = m_Labels[neighborIndex];
+                if (neighborLabel != label - 1)
+                {
+                    minimalLabel = std::min(minimalLabel,neighborLabel);
+                    continue;
+                }
+
+                TCapacity flow = std::min(excess,capacities[d]);
+                capacities[d] -= flow;
+                excess -= flow;
+                m_ResidualCapacities[6 * neighborIndex + (d ^ 1)] += flow;
+                m_Excesses[neighborIndex] += flow;
+
+                if ((neighborIndex < startIndex) || (neighborIndex >= endIndex))
+                {
+                    // Neighbor regions are idle, their labels stay fixed
+                    if (neighborIndex < startIndex)
+                        m_PushedToPreviousRegion[region] = 1;
+                    else
+                        m_PushedToNextRegion[region] = 1;
+                }
+                else if (!m_QueuedNodes[neighborIndex])
+                {
+                    queue[(queueHead + numQueued) % regionSize] = neighborIndex;
+                    ++numQueued;
+                    m_QueuedNodes[neighborIndex] = 1;
+                }
+
+                if (capacities[d] > 0)
+                    minimalLabel = std::min(minimalLabel,neighborLabel);
+            }
+
+            if (!(excess > 0))
+                break;
+
+            // No admissible edge left: relabel, the node keeps being discharged
+            label = (minimalLabel >= m_NumberOfNodes) ? InfiniteLabel : minimalLabel + 1;
+            ++numRelabels;
+        }
+
+        m_Excesses[nodeIndex] = excess;
+        m_Labels[nodeIndex] = label;
+    }
+
+    m_RegionWork[region] = regionSize + numRelabels;
+
+    // Interrupted for a global relabeling, remaining nodes are queued again by the next discharge
+    for (size_t i = 0;i < numQueued;++i)
+        m_QueuedNodes[queue[(queueHead + i) % regionSize]] = 0;
+
+    return (numQueued == 0);
+}
+
+} // end namespace anima
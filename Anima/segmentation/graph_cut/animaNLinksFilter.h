@@ -5,7 +5,7 @@
 #include <itkImageRegionConstIterator.h>
 #include <itkVariableSizeMatrix.h>
 #include <itkCSVArray2DFileReader.h>
-#include "animaGraph.h"
+#include "animaGridGraph.h"
 
 namespace anima
 {
@@ -18,6 +18,8 @@ namespace anima
  * T-links that bind each classical node to both the SOURCE and the SINK represent the probability
  * for the corresponding voxel to belong respectively to the object and to the background.
  *
+ * The graph is a compact grid graph on the bounding box of the mask, its n-links are computed in parallel
+ * and the max-flow is solved by its parallel push-relabel solver.
  */
 template <typename TInput, typename TOutput>
 class NLinksFilter :
@@ -63,7 +65,7 @@ public:
     typedef itk::ImageRegionIterator< TMask > MaskRegionIteratorType;
     typedef itk::ImageRegionConstIterator< TMask > MaskRegionConstIteratorType;
 
-    typedef Graph<double,double,double> GraphType;
+    typedef GridGraph <double> GraphType;
 
     typedef double NumericType;
     typedef itk::VariableSizeMatrix<NumericType> doubleVariableSizeMatrixType;
@@ -112,6 +114,9 @@ public:
     itkSetMacro(Verbose, bool)
     itkGetMacro(Verbose, bool)
 
+    //! Smallest region containing all non zero voxels of the mask (null size if the mask is empty)
+    static TMask::RegionType ComputeMaskBoundingBox(const TMask *mask);
+
 protected:
     NLinksFilter()
     {
@@ -127,6 +132,7 @@ protected:
         m_IndexImage1=m_NbMaxImage,m_IndexImage2=m_NbMaxImage,m_IndexImage3=m_NbMaxImage, m_IndexImage4=m_NbMaxImage,m_IndexImage5=m_NbMaxImage;
 
         m_Tol = 0.0001;
+        m_graph = ITK_NULLPTR;
 
         this->SetNumberOfRequiredOutputs(2);
         this->SetNumberOfRequiredInputs(4);
@@ -159,7 +165,6 @@ protected:
     void CheckSpectralGradient(void);
     void GenerateData() ITK_OVERRIDE;
     void SetGraph();
-    bool isInside (unsigned int x,unsigned int y,unsigned int z ) const;
     void CreateGraph();
     double computeNLink(int i1, int j1, int k1, int i2, int j2, int k2);
 
@@ -174,25 +179,22 @@ private:
      */
     double m_Sigma;
 
-    /** the created graph
+    /** the created graph, on the bounding box of the mask
      */
     GraphType *m_graph;
+    TMask::RegionType m_GraphRegion;
 
     /** transformation matrix (from im1,im2,im3 to e,el,ell)
      */
     std::string m_MatFilename;
     doubleVariableSizeMatrixType m_Matrix;
 
-    typename TOutput::SizeType m_size;
-
     /** input images: T1 T2 PD FLAIR etc
      */
     std::vector<InputImageConstPointer > m_ListImages;
 
     bool m_Verbose;
 
-    ImageTypeInt::Pointer pix;
-
     /** spectral derivatives (e,el,ell)
      */
     TSeedProba::Pointer m_e1, m_e2; // Precomputed spectral grad quantities (keep track of 2 images instead of 3...
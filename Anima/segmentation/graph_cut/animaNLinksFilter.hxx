@@ -263,9 +263,6 @@ NLinksFilter<TInput, TOutput>
         else
             std::cout << "NO using grad spec" << std::endl;
     }
-
-    m_size = this->GetMask()->GetLargestPossibleRegion().GetSize();
-
 }
 
 template <typename TInput, typename TOutput>
@@ -291,34 +288,37 @@ NLinksFilter<TInput, TOutput>
     this->CreateGraph();
     this->SetGraph();
 
-    m_graph -> maxflow();
-
-    int cpt=0;
-    MaskRegionConstIteratorType maskIt (this->GetMask(),this->GetMask()->GetLargestPossibleRegion());
-    OutputIteratorType outIt (output,output->GetLargestPossibleRegion() );
-    OutputIteratorType outBackgroundIt (outputBackground,outputBackground->GetLargestPossibleRegion() );
+    m_graph->ComputeMaxFlow();
 
-    while (!maskIt.IsAtEnd())
+    // Graph nodes are the voxels of the mask bounding box, in iteration order
+    if (m_GraphRegion.GetNumberOfPixels() != 0)
     {
-        outIt.Set(0);
-        if (maskIt.Get() != 0)
+        size_t nodeIndex = 0;
+        MaskRegionConstIteratorType maskIt (this->GetMask(),m_GraphRegion);
+        OutputIteratorType outIt (output,m_GraphRegion);
+        OutputIteratorType outBackgroundIt (outputBackground,m_GraphRegion);
+
+        while (!maskIt.IsAtEnd())
         {
-            int v = m_graph->what_segment(cpt);
-            unsigned char buff = (v == GraphType::SOURCE) ? 1 : 0;
-            outIt.Set(static_cast<OutputPixelType>(buff));
-            outBackgroundIt.Set(1-buff);
-            cpt++;
+            if (maskIt.Get() != 0)
+            {
+                unsigned char buff = (m_graph->GetSegment(nodeIndex) == GraphType::SOURCE) ? 1 : 0;
+                outIt.Set(static_cast<OutputPixelType>(buff));
+                outBackgroundIt.Set(1-buff);
+            }
+            ++nodeIndex;
+            ++maskIt;
+            ++outBackgroundIt;
+            ++outIt;
         }
-        ++maskIt;
-        ++outBackgroundIt;
-        ++outIt;
     }
 
     m_NbModalities = 0;
     m_NbInputs = 3;
     m_ListImages.clear();
-    if (m_graph) delete m_graph;
 
+    delete m_graph;
+    m_graph = ITK_NULLPTR;
 }
 
 
@@ -411,32 +411,61 @@ void NLinksFilter<TInput, TOutput>::CreateGraph()
 }
 
 template <typename TInput, typename TOutput>
-bool NLinksFilter<TInput, TOutput>::isInside (unsigned int x, unsigned int y, unsigned int z ) const
-{
-    return ( x < m_size[0] && y < m_size[1] && z < m_size[2] &&  x >= 0 && y >= 0 && z >= 0 );
-}
-
-template <typename TInput, typename TOutput>
-void NLinksFilter<TInput, TOutput>::SetGraph()
+itk::ImageRegion <3> NLinksFilter<TInput, TOutput>::ComputeMaskBoundingBox(const TMask *mask)
 {
-    // allocate only necessary memory
-    int nb_vox = 0;
+    TMask::IndexType minIndex, maxIndex;
+    minIndex.Fill(itk::NumericTraits<itk::IndexValueType>::max());
+    maxIndex.Fill(itk::NumericTraits<itk::IndexValueType>::NonpositiveMin());
+    bool emptyMask = true;
 
-    MaskRegionConstIteratorType maskIt (this->GetMask(),this->GetMask()->GetLargestPossibleRegion() );
+    MaskRegionConstIteratorType maskIt (mask,mask->GetLargestPossibleRegion());
     while (!maskIt.IsAtEnd())
     {
         if (maskIt.Get() != 0)
         {
-            nb_vox++;
+            TMask::IndexType index = maskIt.GetIndex();
+            for (unsigned int i = 0;i < 3;++i)
+            {
+                minIndex[i] = std::min(minIndex[i],index[i]);
+                maxIndex[i] = std::max(maxIndex[i],index[i]);
+            }
+            emptyMask = false;
         }
         ++maskIt;
     }
 
-    int nb_edges = 7*nb_vox;
+    TMask::RegionType boundingBox;
+    TMask::SizeType boxSize;
+    boxSize.Fill(0);
+    if (emptyMask)
+    {
+        boundingBox.SetIndex(mask->GetLargestPossibleRegion().GetIndex());
+        boundingBox.SetSize(boxSize);
+        return boundingBox;
+    }
+
+    for (unsigned int i = 0;i < 3;++i)
+        boxSize[i] = maxIndex[i] - minIndex[i] + 1;
+
+    boundingBox.SetIndex(minIndex);
+    boundingBox.SetSize(boxSize);
+    return boundingBox;
+}
+
+template <typename TInput, typename TOutput>
+void NLinksFilter<TInput, TOutput>::SetGraph()
+{
+    // allocate only necessary memory: a grid graph on the bounding box of the mask, nodes outside the mask stay isolated
+    m_GraphRegion = ComputeMaskBoundingBox(this->GetMask());
+
+    typename GraphType::SizeType graphSize;
+    for (unsigned int i = 0;i < 3;++i)
+        graphSize[i] = m_GraphRegion.GetSize()[i];
 
     try
     {
-        m_graph = new GraphType(nb_vox, nb_edges);
+        m_graph = new GraphType;
+        m_graph->Initialize(graphSize);
     }
     catch (std::bad_alloc& ba)
     {
@@ -444,98 +473,58 @@ void NLinksFilter<TInput, TOutput>::SetGraph()
         exit(-1);
     }
 
-    // Create the nodes of the graph and set the correspondences with the original image
-    int compt = 0;
-    ImageTypeInt::Pointer pix = ImageTypeInt::New();
-    pix->SetRegions(this->GetMask()->GetLargestPossibleRegion());
-    pix->CopyInformation(this->GetMask());
-    pix->Allocate();
-    pix->FillBuffer(-1);
+    m_graph->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
 
-    ImageIteratorTypeInt pixIt (pix,pix->GetLargestPossibleRegion());
+    if (m_GraphRegion.GetNumberOfPixels() == 0)
+        return;
 
-    maskIt.GoToBegin();
-    while (!maskIt.IsAtEnd())
+    // Create the t-links and n-links in parallel, each node sets its edges towards its +x, +y and +z neighbors
+    this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+    this->GetMultiThreader()->template ParallelizeImageRegion<3> (
+        m_GraphRegion,
+        [this](const TMask::RegionType &regionForThread)
     {
-        if (maskIt.Get() != 0)
-        {
-            m_graph -> add_node();
-            pixIt.Set(compt++);
-        }
-        ++maskIt;
-        ++pixIt;
-    }
-
+        TMask::ConstPointer mask = this->GetMask();
+        TSeedProba::ConstPointer sources = this->GetInputSeedProbaSources();
+        TSeedProba::ConstPointer sinks = this->GetInputSeedProbaSinks();
+        TMask::IndexType graphStart = m_GraphRegion.GetIndex();
 
-    maskIt.GoToBegin();
-    pixIt.GoToBegin();
-
-
-    // Create the t-links and n-links
-    while (!maskIt.IsAtEnd())
-    {
-        if(maskIt.Get() != 0)
+        MaskRegionConstIteratorType maskIt (mask,regionForThread);
+        while (!maskIt.IsAtEnd())
         {
-            pixelIndexInt index, index1;
-            index[0]=maskIt.GetIndex()[0];
-            index[1]=maskIt.GetIndex()[1];
-            index[2]=maskIt.GetIndex()[2];
-
-            int pix_ref = pix->GetPixel(index);
-            int pix_courant;
-            double cap, rcap;
-
-            // Compute the 6 n-links of each standard node (gradients between the current voxel and its neighbors)
-            index1[0]=index[0]+1;
-            index1[1]=index[1];
-            index1[2]=index[2];
-            if ( (isInside(index[0]+1, index[1] , index[2])) && (this->GetMask()->GetPixel(index1)!=0) )
+            if (maskIt.Get() == 0)
             {
-                pix_courant = pix->GetPixel(index1);
-                cap  = computeNLink(index[0]+1, index[1], index[2], index[0], index[1], index[2]);
-                rcap = cap;
-                if (!(cap >= 0))
-                    cap = rcap = 0;
-                m_graph -> add_edge(pix_ref, pix_courant, cap, rcap);
+                ++maskIt;
+                continue;
             }
 
+            pixelIndexInt index = maskIt.GetIndex();
+            unsigned int x = index[0] - graphStart[0];
+            unsigned int y = index[1] - graphStart[1];
+            unsigned int z = index[2] - graphStart[2];
 
-            index1[0]=index[0];
-            index1[1]=index[1]+1;
-            index1[2]=index[2];
-            if ( (isInside(index[0], index[1]+1 , index[2])) && (this->GetMask()->GetPixel(index1)!=0) )
+            // Compute the n-links (gradients between the current voxel and its neighbors)
+            for (unsigned int axis = 0;axis < 3;++axis)
             {
-                pix_courant = pix->GetPixel(index1);
-                cap  = computeNLink(index[0], index[1]+1, index[2], index[0], index[1], index[2]);
-                rcap = cap;
-                if (!(cap >= 0)) // eq cap < 0 ? no ???
-                    cap = rcap = 0;
-                m_graph -> add_edge(pix_ref, pix_courant, cap, rcap);
-            }
+                pixelIndexInt index1 = index;
+                ++index1[axis];
+                if ((!m_GraphRegion.IsInside(index1)) || (mask->GetPixel(index1) == 0))
+                    continue;
 
-            index1[0]=index[0];
-            index1[1]=index[1];
-            index1[2]=index[2]+1;
-            if ( (isInside(index[0], index[1] , index[2]+1)) && (this->GetMask()->GetPixel(index1)!=0) )
-            {
-                pix_courant = pix->GetPixel(index1);
-                cap  = computeNLink(index[0], index[1], index[2]+1, index[0], index[1], index[2]);
-                rcap = cap;
+                double cap = computeNLink(index1[0], index1[1], index1[2], index[0], index[1], index[2]);
                 if (!(cap >= 0))
-                    cap = rcap = 0;
-                m_graph -> add_edge(pix_ref, pix_courant, cap, rcap);
+                    cap = 0;
+                m_graph->SetNeighborCapacities(x, y, z, axis, cap, cap);
             }
 
             // Create the t-links to the source and the sink
-            double t_source = static_cast<double>(this->GetInputSeedProbaSources()->GetPixel(index));
-            double t_sink   = static_cast<double>(this->GetInputSeedProbaSinks()->GetPixel(index));
-            m_graph -> add_tweights(pix_ref, t_source, t_sink);
+            double t_source = static_cast<double>(sources->GetPixel(index));
+            double t_sink   = static_cast<double>(sinks->GetPixel(index));
+            m_graph->SetTerminalCapacities(m_graph->GetNodeIndex(x, y, z), t_source, t_sink);
 
+            ++maskIt;
         }
-
-        ++pixIt;
-        ++maskIt;
-    }
+    }, this);
 }
 
 } //end of namespace anima
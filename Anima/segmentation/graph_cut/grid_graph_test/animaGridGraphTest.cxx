@@ -0,0 +1,154 @@
+#include <animaGridGraph.h>
+#include <animaGraph.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Compares the minimum cut of the grid graph with the one of the reference Boykov-Kolmogorov graph
+// on random masked grids, for integer and real capacities and several numbers of threads
+bool compareGraphs(unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ, unsigned int seed,
+                   bool integerCapacities, unsigned int numThreads)
+{
+    typedef anima::GridGraph <double> GridGraphType;
+    typedef anima::Graph <double,double,double> ReferenceGraphType;
+
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution <double> uniformDistribution(0.0,1.0);
+
+    unsigned int gridSize[3] = {sizeX, sizeY, sizeZ};
+    size_t strides[3] = {1, sizeX, static_cast <size_t> (sizeX) * sizeY};
+    size_t numNodes = strides[2] * sizeZ;
+
+    // Spherical mask, smooth terminal capacities with noise, random neighbor capacities
+    std::vector <unsigned char> mask(numNodes);
+    std::vector <double> sourceCaps(numNodes), sinkCaps(numNodes);
+    std::vector <double> neighborCaps(3 * numNodes), reverseNeighborCaps(3 * numNodes);
+    double radius = 0.45 * std::min(sizeX, std::min(sizeY, sizeZ));
+
+    for (unsigned int z = 0;z < sizeZ;++z)
+    {
+        for (unsigned int y = 0;y < sizeY;++y)
+        {
+            for (unsigned int x = 0;x < sizeX;++x)
+            {
+                size_t i = x + strides[1] * y + strides[2] * z;
+                double dx = x - sizeX / 2.0;
+                double dy = y - sizeY / 2.0;
+                double dz = z - sizeZ / 2.0;
+                mask[i] = (dx * dx + dy * dy + dz * dz < radius * radius);
+
+                double proba = 0.5 + 0.4 * std::sin(0.3 * x) * std::cos(0.2 * y + 0.1 * z) + 0.3 * (uniformDistribution(generator) - 0.5);
+                proba = std::min(1.0, std::max(0.0, proba));
+                sourceCaps[i] = integerCapacities ? std::floor(10.0 * proba) : proba;
+                sinkCaps[i] = integerCapacities ? std::floor(10.0 * (1.0 - proba)) : 1.0 - proba;
+
+                for (unsigned int j = 0;j < 3;++j)
+                {
+                    neighborCaps[3 * i + j] = integerCapacities ? std::floor(4.0 * uniformDistribution(generator)) : 0.1 + 0.5 * uniformDistribution(generator);
+                    reverseNeighborCaps[3 * i + j] = integerCapacities ? std::floor(4.0 * uniformDistribution(generator)) : 0.1 + 0.5 * uniformDistribution(generator);
+                }
+            }
+        }
+    }
+
+    std::vector <int> nodeIds(numNodes,-1);
+    int numMaskNodes = 0;
+    for (size_t i = 0;i < numNodes;++i)
+    {
+        if (mask[i])
+            nodeIds[i] = numMaskNodes++;
+    }
+
+    ReferenceGraphType *referenceGraph = new ReferenceGraphType(numMaskNodes,3 * numMaskNodes);
+    referenceGraph->add_node(numMaskNodes);
+
+    GridGraphType gridGraph;
+    GridGraphType::SizeType graphSize;
+    for (unsigned int i = 0;i < 3;++i)
+        graphSize[i] = gridSize[i];
+
+    gridGraph.SetNumberOfWorkUnits(numThreads);
+    gridGraph.Initialize(graphSize);
+
+    for (unsigned int z = 0;z < sizeZ;++z)
+    {
+        for (unsigned int y = 0;y < sizeY;++y)
+        {
+            for (unsigned int x = 0;x < sizeX;++x)
+            {
+                size_t i = x + strides[1] * y + strides[2] * z;
+                if (!mask[i])
+                    continue;
+
+                unsigned int position[3] = {x, y, z};
+                for (unsigned int j = 0;j < 3;++j)
+                {
+                    if ((position[j] + 1 >= gridSize[j]) || (!mask[i + strides[j]]))
+                        continue;
+
+                    referenceGraph->add_edge(nodeIds[i],nodeIds[i + strides[j]],neighborCaps[3 * i + j],reverseNeighborCaps[3 * i + j]);
+                    gridGraph.SetNeighborCapacities(x,y,z,j,neighborCaps[3 * i + j],reverseNeighborCaps[3 * i + j]);
+                }
+
+                referenceGraph->add_tweights(nodeIds[i],sourceCaps[i],sinkCaps[i]);
+                gridGraph.SetTerminalCapacities(i,sourceCaps[i],sinkCaps[i]);
+            }
+        }
+    }
+
+    referenceGraph->maxflow();
+    gridGraph.ComputeMaxFlow();
+
+    unsigned int numDifferences = 0;
+    for (size_t i = 0;i < numNodes;++i)
+    {
+        if (!mask[i])
+            continue;
+
+        bool referenceSource = (referenceGraph->what_segment(nodeIds[i]) == ReferenceGraphType::SOURCE);
+        bool gridSource = (gridGraph.GetSegment(i) == GridGraphType::SOURCE);
+
+        if (referenceSource != gridSource)
+            ++numDifferences;
+    }
+
+    delete referenceGraph;
+
+    std::cout << "Grid " << sizeX << "x" << sizeY << "x" << sizeZ << ", seed " << seed
+              << (integerCapacities ? ", integer" : ", real") << " capacities, " << numThreads << " threads: "
+              << numDifferences << " differing nodes out of " << numMaskNodes << std::endl;
+
+    return (numDifferences == 0);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int gridSizes[3][3] = {{30, 25, 20}, {17, 40, 9}, {64, 64, 32}};
+    unsigned int threadNumbers[4] = {1, 2, 4, 8};
+
+    bool success = true;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        for (unsigned int j = 0;j < 4;++j)
+        {
+            for (unsigned int seed = 0;seed < 2;++seed)
+            {
+                success &= compareGraphs(gridSizes[i][0],gridSizes[i][1],gridSizes[i][2],seed,true,threadNumbers[j]);
+                success &= compareGraphs(gridSizes[i][0],gridSizes[i][1],gridSizes[i][2],seed,false,threadNumbers[j]);
+            }
+        }
+    }
+
+    if (!success)
+    {
+        std::cerr << "Grid graph and reference graph minimum cuts differ" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Grid graph and reference graph minimum cuts are identical" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -36,6 +36,7 @@ SegPerfApp::SegPerfApp(void)
     //////////////////////////////////////////////////////////////////////////
     // Distances metrics
     m_fHausdorffDist = std::numeric_limits<double>::quiet_NaN();
+    m_fHausdorff95Dist = std::numeric_limits<double>::quiet_NaN();
     m_fMeanDist = std::numeric_limits<double>::quiet_NaN();
     m_fAverageDist = std::numeric_limits<double>::quiet_NaN();
 
@@ -349,6 +350,7 @@ void SegPerfApp::processAnalyze(SegPerfCAnalyzer &pi_roAnalyzer, int pi_iIndex)
         if(m_bSurfaceEvaluation)
         {
             m_fHausdorffDist = pi_roAnalyzer.computeHausdorffDist();
+            m_fHausdorff95Dist = pi_roAnalyzer.computeHausdorff95Dist();
             m_fMeanDist = pi_roAnalyzer.computeMeanDist();
             m_fAverageDist = pi_roAnalyzer.computeAverageSurfaceDistance();
         }
@@ -417,6 +419,8 @@ void SegPerfApp::storeMetricsAndMarks(SegPerfResults&pi_roRes)
         pi_roRes.setContourMeanDist(m_fMeanDist);
         pi_roRes.activeMeasurementOutput(SegPerfResults::eMesureDistAverage);
         pi_roRes.setAverageSurfaceDist(m_fAverageDist);
+        pi_roRes.activeMeasurementOutput(SegPerfResults::eMesureDistHausdorff95);
+        pi_roRes.setHausdorff95Dist(m_fHausdorff95Dist);
     }
 
     //Lesion detection
@@ -476,6 +480,7 @@ void SegPerfApp::about()
     std::cout << "        RVE (Relative Volume Error) in percentage" << std::endl;
     std::cout << "    - SURFACE DISTANCE EVALUATION:" << std::endl;
     std::cout << "        Hausdorff distance" << std::endl;
+    std::cout << "        95th percentile Hausdorff distance" << std::endl;
     std::cout << "        Contour mean distance" << std::endl;
     std::cout << "        Average surface distance" << std::endl;
     std::cout << "    - DETECTION LESIONS EVALUATION:" << std::endl;
@@ -58,6 +58,7 @@ private:
     //////////////////////////////////////////////////////////////////////////
     // Distances metrics
     double m_fHausdorffDist;
+    double m_fHausdorff95Dist;
     double m_fMeanDist;
     double m_fAverageDist;
 
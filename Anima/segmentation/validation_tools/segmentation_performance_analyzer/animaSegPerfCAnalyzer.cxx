@@ -88,6 +88,7 @@ SegPerfCAnalyzer::SegPerfCAnalyzer(std::string &pi_pchImageTestName, std::string
 
     m_bValuesComputed = false;
     m_bContourDetected = false;
+    m_bSurfaceDistancesComputed = false;
 }
 
 /**
@@ -221,6 +222,10 @@ void SegPerfCAnalyzer::selectCluster(unsigned int iCluster)
             }
         }
         this->m_uiNbLabels = 2;
+
+        // Contours and distances have to be computed again for this cluster
+        m_bContourDetected = false;
+        m_bSurfaceDistancesComputed = false;
     }
 
     return;
@@ -630,75 +635,70 @@ void SegPerfCAnalyzer::formatLabels()
 }
 
 /**
-@brief  Compute Haussdorf distance
-@return hausdorffDistance in double
+@brief  Compute all surface distances at once: one distance map to each contour per label
 */
-double SegPerfCAnalyzer::computeHausdorffDist()
+void SegPerfCAnalyzer::computeSurfaceDistances()
 {
-    FilterType::RealType hausdorffDistance = std::numeric_limits<double>::quiet_NaN();
+    m_dfHausdorffDist = std::numeric_limits<double>::quiet_NaN();
+    m_dfHausdorff95Dist = std::numeric_limits<double>::quiet_NaN();
+    m_dfMeanDist = std::numeric_limits<double>::quiet_NaN();
+    m_dfAverageSurfaceDist = std::numeric_limits<double>::quiet_NaN();
 
-    if (m_uiNbLabels>1)
+    if (m_uiNbLabels > 1)
     {
-        // compute the Hausdorff distance
-        typedef itk::HausdorffDistanceImageFilter<ImageType, ImageType> FilterType;
-        FilterType::Pointer filter = FilterType::New();
-
-        filter->SetInput1(m_imageTest);
-        filter->SetInput2(m_imageRef);
-
-        try
-        {
-            filter->Update();
-        }
-        catch (itk::ExceptionObject& e)
-        {
-            std::cerr << "exception in filter " << std::endl;
-            std::cerr << e << std::endl;
-            return EXIT_FAILURE;
-        }
+        if (!this->m_bContourDetected)
+            this->contourDectection();
 
-        hausdorffDistance = filter->GetHausdorffDistance();
+        SegPerfSurfaceDistances surfaceDistances;
+        surfaceDistances.SetTestImages(m_imageTest, m_imageTestContour);
+        surfaceDistances.SetReferenceImages(m_imageRef, m_imageRefContour);
+        surfaceDistances.SetNumberOfLabels(m_uiNbLabels);
+        surfaceDistances.SetNumberOfWorkUnits(m_ThreadNb);
+        surfaceDistances.Update();
+
+        m_dfHausdorffDist = surfaceDistances.GetHausdorffDistance();
+        m_dfHausdorff95Dist = surfaceDistances.GetHausdorff95Distance();
+        m_dfMeanDist = surfaceDistances.GetContourMeanDistance();
+        m_dfAverageSurfaceDist = surfaceDistances.GetAverageSurfaceDistance();
     }
 
-    return hausdorffDistance;
+    m_bSurfaceDistancesComputed = true;
 }
 
 /**
-@brief   Compute mean distance
-@return  meanDistance
+@brief  Compute Haussdorf distance
+@return hausdorffDistance in double
 */
-double SegPerfCAnalyzer::computeMeanDist()
+double SegPerfCAnalyzer::computeHausdorffDist()
 {
-    FilterType::RealType meanDistance = std::numeric_limits<double>::quiet_NaN();
+    if (!m_bSurfaceDistancesComputed)
+        this->computeSurfaceDistances();
 
-    if (m_uiNbLabels > 1)
-    {
-        if (!this->m_bContourDetected)
-            this->contourDectection();
-
-        // compute the Hausdorff distance H(image1,image2)
-        typedef itk::ContourMeanDistanceImageFilter<ImageType, ImageType> FilterType;
-        FilterType::Pointer filter = FilterType::New();
-
-        filter->SetInput1(m_imageTestContour);
-        filter->SetInput2(m_imageRefContour);
+    return m_dfHausdorffDist;
+}
 
-        try
-        {
-            filter->Update();
-        }
+/**
+@brief  Compute 95th percentile Haussdorf distance (on contour voxels)
+@return hausdorff95Distance in double
+*/
+double SegPerfCAnalyzer::computeHausdorff95Dist()
+{
+    if (!m_bSurfaceDistancesComputed)
+        this->computeSurfaceDistances();
 
-        catch (itk::ExceptionObject& e)
-        {
-            std::cerr << "exception in filter " << std::endl;
-            std::cerr << e << std::endl;
-            return EXIT_FAILURE;
-        }
+    return m_dfHausdorff95Dist;
+}
 
-        meanDistance = filter->GetMeanDistance();
-    }
+/**
+@brief   Compute mean distance
+@return  meanDistance
+*/
+double SegPerfCAnalyzer::computeMeanDist()
+{
+    if (!m_bSurfaceDistancesComputed)
+        this->computeSurfaceDistances();
 
-    return meanDistance;
+    return m_dfMeanDist;
 }
 
 /**
@@ -707,86 +707,10 @@ double SegPerfCAnalyzer::computeMeanDist()
 */
 double SegPerfCAnalyzer::computeAverageSurfaceDistance()
 {
-    double meanDistance = std::numeric_limits<double>::quiet_NaN();
-
-    if (m_uiNbLabels > 1)
-    {
-        if (!this->m_bContourDetected)
-            this->contourDectection();
-
-        double sum_dist = 0;
-        double sum_size = 0;
-
-        for (int i = 1; i < m_uiNbLabels; i++)
-        {
-            std::vector <ImageType::PointType> coordRef;
-            coordRef.clear();
-            ImageIteratorType refContourIt(m_imageRefContour, m_imageRefContour->GetLargestPossibleRegion());
-
-            while (!refContourIt.IsAtEnd())
-            {
-                if (refContourIt.Get() == i)
-                {
-                    ImageType::IndexType oIndex = refContourIt.GetIndex();
-                    ImageType::PointType oPoint;
-                    m_imageRefContour->TransformIndexToPhysicalPoint(oIndex, oPoint);
-                    coordRef.push_back(oPoint);
-                }
-                ++refContourIt;
-            }
-
-            std::vector <ImageType::PointType> coordTest;
-            coordTest.clear();
-
-            ImageIteratorType testContourIt(m_imageTestContour, m_imageTestContour->GetLargestPossibleRegion());
+    if (!m_bSurfaceDistancesComputed)
+        this->computeSurfaceDistances();
 
-            while (!testContourIt.IsAtEnd())
-            {
-                if (testContourIt.Get() == i)
-                {
-                    ImageType::IndexType oIndex = testContourIt.GetIndex();
-                    ImageType::PointType oPoint;
-                    m_imageTestContour->TransformIndexToPhysicalPoint(oIndex, oPoint);
-                    coordTest.push_back(oPoint);
-                }
-                ++testContourIt;
-            }
-
-            std::vector <double> distance1, distance2;
-            double fDistanceTemp1 = 1000000, fDistanceTemp2 = 1000000;
-            double distanceValue = 0;
-            for (int m = 0; m < coordRef.size(); m++)
-            {
-                for (int n = 0; n < coordTest.size(); n++)
-                {
-                    distanceValue = sqrt(pow((double)(coordRef[m][0] - coordTest[n][0]), 2) + pow((double)(coordRef[m][1] - coordTest[n][1]), 2) + pow((double)(coordRef[m][2] - coordTest[n][2]), 2));
-                    if (distanceValue < fDistanceTemp1)
-                        fDistanceTemp1 = distanceValue;
-                }
-
-                distance1.push_back(fDistanceTemp1);
-            }
-
-            for (int m = 0; m < coordTest.size(); m++)
-            {
-                for (int n = 0; n < coordRef.size(); n++)
-                {
-                    distanceValue = sqrt(pow((double)(coordTest[m][0] - coordRef[n][0]), 2) + pow((double)(coordTest[m][1] - coordRef[n][1]), 2) + pow((double)(coordTest[m][2] - coordRef[n][2]), 2));
-
-                    if (distanceValue < fDistanceTemp2)
-                        fDistanceTemp2 = distanceValue;
-                }
-
-                distance2.push_back(fDistanceTemp2);
-            }
-
-            sum_dist = sum_dist + (double)accumulate(distance1.begin(), distance1.end(), 0.0) + (double)accumulate(distance2.begin(), distance2.end(), 0.0);
-            sum_size = sum_size + (double)distance1.size() + (double)distance2.size();
-        }
-
-        meanDistance = sum_dist / sum_size;
-    }
-    return meanDistance;
+    return m_dfAverageSurfaceDist;
 }
 
 /**
@@ -6,12 +6,10 @@
 #include <itkImageFileReader.h>
 #include <itkImageRegionConstIterator.h>
 #include <animaSegmentationMeasuresImageFilter.h>
+#include "animaSegPerfSurfaceDistances.h"
 #include <itkLabelContourImageFilter.h>
 #include <itkBinaryContourImageFilter.h>
 #include <itkSimpleFilterWatcher.h>
-#include <itkHausdorffDistanceImageFilter.h>
-#include <itkDirectedHausdorffDistanceImageFilter.h>
-#include <itkContourMeanDistanceImageFilter.h>
 #include <itkFlipImageFilter.h>
 #include <itkImageDuplicator.h>
 
@@ -54,6 +52,7 @@ public:
     }
 
     double computeHausdorffDist();
+    double computeHausdorff95Dist();
     double computeMeanDist();
     double computeAverageSurfaceDistance();
     void computeITKMeasures();
@@ -78,6 +77,7 @@ public:
 protected:
     void formatLabels();
     void contourDectection();
+    void computeSurfaceDistances();
     void checkNumberOfLabels(int, int);
 
     int getTruePositiveLesions(int pi_iNbLabelsRef, int pi_iNbLabelsTest, int **pi_ppiOverlapTab);
@@ -92,6 +92,12 @@ private:
     unsigned int m_uiNbLabels;   /*!<Number of Labels. */
     bool m_bValuesComputed;      /*!<Boolean to check if values have been computed. */
     bool m_bContourDetected;     /*!<Boolean to check if contour detection have been done. */
+    bool m_bSurfaceDistancesComputed; /*!<Boolean to check if surface distances have been computed. */
+
+    double m_dfHausdorffDist;
+    double m_dfHausdorff95Dist;
+    double m_dfMeanDist;
+    double m_dfAverageSurfaceDist;
 
     double m_dfDetectionThresholdAlpha;
     double m_dfDetectionThresholdBeta;
@@ -24,7 +24,8 @@ char const*const SegPerfResults::m_ppchMeasureNameTable[eMesureLast] =
     "SensL",
     "F1_score",
     "NbTestedLesions",
-    "VolTestedLesions"
+    "VolTestedLesions",
+    "Hausdorff95Distance"
 };
 
 /**
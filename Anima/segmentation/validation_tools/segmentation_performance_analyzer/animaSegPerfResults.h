@@ -28,6 +28,7 @@ public:
         eMesureF1Test,
         eMesureNbTestedLesions,
         eMesureVolTestedLesions,
+        eMesureDistHausdorff95,
         eMesureLast
     }eMesureName;
 
@@ -139,6 +140,15 @@ public:
         m_fResTab[eMesureDistHausdorff] = pi_fVal;
     }
 
+    /**
+      @brief    Set the result value of 95th percentile Hausdorff distance measure.
+      @param    [in] pi_fVal Measure result value.
+   */
+    void setHausdorff95Dist(double pi_fVal)
+    {
+        m_fResTab[eMesureDistHausdorff95] = pi_fVal;
+    }
+
     /**
       @brief    Set the result value of contour mean distance measure.
       @param    [in] pi_fVal Measure result value.
@@ -0,0 +1,346 @@
+#include "animaSegPerfSurfaceDistances.h"
+
+#include <itkMultiThreaderBase.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace anima
+{
+
+SegPerfSurfaceDistances::SegPerfSurfaceDistances()
+{
+    m_NumberOfLabels = 2;
+    m_NumberOfWorkUnits = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+
+    m_HausdorffDistance = std::numeric_limits<double>::quiet_NaN();
+    m_Hausdorff95Distance = std::numeric_limits<double>::quiet_NaN();
+    m_ContourMeanDistance = std::numeric_limits<double>::quiet_NaN();
+    m_AverageSurfaceDistance = std::numeric_limits<double>::quiet_NaN();
+}
+
+void SegPerfSurfaceDistances::SetTestImages(ImageType *image, ImageType *contourImage)
+{
+    m_TestImage = image;
+    m_TestContourImage = contourImage;
+}
+
+void SegPerfSurfaceDistances::SetReferenceImages(ImageType *image, ImageType *contourImage)
+{
+    m_ReferenceImage = image;
+    m_ReferenceContourImage = contourImage;
+}
+
+void SegPerfSurfaceDistances::Update()
+{
+    m_HausdorffDistance = std::numeric_limits<double>::quiet_NaN();
+    m_Hausdorff95Distance = std::numeric_limits<double>::quiet_NaN();
+    m_ContourMeanDistance = std::numeric_limits<double>::quiet_NaN();
+    m_AverageSurfaceDistance = std::numeric_limits<double>::quiet_NaN();
+
+    std::vector <RegionType> boundingBoxes;
+    this->ComputeLabelBoundingBoxes(boundingBoxes);
+
+    // Label 0 is the whole foreground, it is the only label for binary images
+    unsigned int numLabels = 1;
+    if (m_NumberOfLabels > 2)
+        numLabels = m_NumberOfLabels;
+
+    // One task per label and direction (test to reference, reference to test)
+    std::vector <DirectedDistances> directedDistances(2 * numLabels);
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfWorkUnits);
+    threader->ParallelizeArray(0, 2 * numLabels,
+                               [&](itk::SizeValueType i)
+    {
+        unsigned int label = i / 2;
+        bool testToReference = (i % 2 == 0);
+        this->ComputeDirectedDistances(label,testToReference,boundingBoxes[label],(label == 0),directedDistances[i]);
+    }, ITK_NULLPTR);
+
+    DirectedDistances &testToReference = directedDistances[0];
+    DirectedDistances &referenceToTest = directedDistances[1];
+
+    if (testToReference.validTarget && referenceToTest.validTarget)
+    {
+        m_HausdorffDistance = std::max(testToReference.maximalDistance,referenceToTest.maximalDistance);
+        m_ContourMeanDistance = std::max(testToReference.sumOfContourDistances / testToReference.numberOfContourVoxels,
+                                         referenceToTest.sumOfContourDistances / referenceToTest.numberOfContourVoxels);
+
+        std::vector <double> &contourDistances = testToReference.contourDistances;
+        contourDistances.insert(contourDistances.end(),referenceToTest.contourDistances.begin(),referenceToTest.contourDistances.end());
+
+        unsigned int rank = std::ceil(0.95 * contourDistances.size()) - 1;
+        std::nth_element(contourDistances.begin(),contourDistances.begin() + rank,contourDistances.end());
+        m_Hausdorff95Distance = contourDistances[rank];
+    }
+
+    double sumDistances = 0;
+    double numDistances = 0;
+    unsigned int firstLabel = (numLabels > 1) ? 1 : 0;
+    for (unsigned int i = firstLabel;i < numLabels;++i)
+    {
+        if (!directedDistances[2 * i].validTarget || !directedDistances[2 * i + 1].validTarget)
+            continue;
+
+        sumDistances += directedDistances[2 * i].sumOfContourDistances + directedDistances[2 * i + 1].sumOfContourDistances;
+        numDistances += directedDistances[2 * i].numberOfContourVoxels + directedDistances[2 * i + 1].numberOfContourVoxels;
+    }
+
+    if (numDistances > 0)
+        m_AverageSurfaceDistance = sumDistances / numDistances;
+}
+
+void SegPerfSurfaceDistances::ComputeLabelBoundingBoxes(std::vector <RegionType> &boundingBoxes)
+{
+    const unsigned int Dimension = ImageType::ImageDimension;
+    std::vector <ImageType::IndexType> minIndexes(m_NumberOfLabels), maxIndexes(m_NumberOfLabels);
+    std::vector <bool> labelFound(m_NumberOfLabels,false);
+
+    ImageType *images[2] = {m_TestImage, m_ReferenceImage};
+    for (unsigned int i = 0;i < 2;++i)
+    {
+        typedef itk::ImageRegionConstIteratorWithIndex <ImageType> IteratorType;
+        IteratorType imageItr(images[i],images[i]->GetLargestPossibleRegion());
+
+        while (!imageItr.IsAtEnd())
+        {
+            unsigned int value = imageItr.Get();
+            if (value == 0)
+            {
+                ++imageItr;
+                continue;
+            }
+
+            ImageType::IndexType index = imageItr.GetIndex();
+            unsigned int labels[2] = {0, value};
+            for (unsigned int j = 0;j < 2;++j)
+            {
+                unsigned int label = labels[j];
+                if (label >= m_NumberOfLabels)
+                    continue;
+
+                if (!labelFound[label])
+                {
+                    labelFound[label] = true;
+                    minIndexes[label] = index;
+                    maxIndexes[label] = index;
+                    continue;
+                }
+
+                for (unsigned int k = 0;k < Dimension;++k)
+                {
+                    minIndexes[label][k] = std::min(minIndexes[label][k],index[k]);
+                    maxIndexes[label][k] = std::max(maxIndexes[label][k],index[k]);
+                }
+            }
+
+            ++imageItr;
+        }
+    }
+
+    boundingBoxes.resize(m_NumberOfLabels);
+    for (unsigned int i = 0;i < m_NumberOfLabels;++i)
+    {
+        boundingBoxes[i].SetIndex(m_TestImage->GetLargestPossibleRegion().GetIndex());
+        for (unsigned int k = 0;k < Dimension;++k)
+            boundingBoxes[i].SetSize(k,0);
+
+        if (!labelFound[i])
+            continue;
+
+        boundingBoxes[i].SetIndex(minIndexes[i]);
+        for (unsigned int k = 0;k < Dimension;++k)
+            boundingBoxes[i].SetSize(k,maxIndexes[i][k] - minIndexes[i][k] + 1);
+    }
+}
+
+void SegPerfSurfaceDistances::ComputeDirectedDistances(unsigned int label, bool testToReference, const RegionType &boundingBox,
+                                                       bool keepContourDistances, DirectedDistances &result)
+{
+    const unsigned int Dimension = ImageType::ImageDimension;
+
+    result.validTarget = false;
+    result.maximalDistance = 0;
+    result.sumOfContourDistances = 0;
+    result.numberOfContourVoxels = 0;
+    result.contourDistances.clear();
+
+    ImageType *sourceImage = testToReference ? m_TestImage : m_ReferenceImage;
+    ImageType *sourceContourImage = testToReference ? m_TestContourImage : m_ReferenceContourImage;
+    ImageType *targetImage = testToReference ? m_ReferenceImage : m_TestImage;
+    ImageType *targetContourImage = testToReference ? m_ReferenceContourImage : m_TestContourImage;
+
+    unsigned int numVoxels = boundingBox.GetNumberOfPixels();
+    if (numVoxels == 0)
+        return;
+
+    // Squared distance map to the target contour, inside the bounding box only: all contour voxels lie in it
+    const double infiniteValue = std::numeric_limits<double>::infinity();
+    std::vector <double> squaredDistances(numVoxels,infiniteValue);
+
+    typedef itk::ImageRegionConstIteratorWithIndex <ImageType> IteratorType;
+    IteratorType targetContourItr(targetContourImage,boundingBox);
+    unsigned int pos = 0;
+    while (!targetContourItr.IsAtEnd())
+    {
+        if (this->IsInLabel(targetContourItr.Get(),label))
+        {
+            squaredDistances[pos] = 0;
+            result.validTarget = true;
+        }
+
+        ++targetContourItr;
+        ++pos;
+    }
+
+    if (!result.validTarget)
+        return;
+
+    // Separable exact transform: one pass of 1D lower envelopes per dimension
+    unsigned int boxStrides[Dimension];
+    unsigned int stride = 1;
+    for (unsigned int i = 0;i < Dimension;++i)
+    {
+        boxStrides[i] = stride;
+        stride *= boundingBox.GetSize()[i];
+    }
+
+    std::vector <double> lineValues, lineResult, boundaries;
+    std::vector <unsigned int> sites;
+    for (unsigned int d = 0;d < Dimension;++d)
+    {
+        unsigned int lineLength = boundingBox.GetSize()[d];
+        double spacing = targetImage->GetSpacing()[d];
+        lineValues.resize(lineLength);
+        lineResult.resize(lineLength);
+        sites.resize(lineLength);
+        boundaries.resize(lineLength + 1);
+
+        unsigned int numLines = numVoxels / lineLength;
+        for (unsigned int l = 0;l < numLines;++l)
+        {
+            // Line start: voxel with coordinate 0 along d, other coordinates given by l
+            unsigned int remainder = l;
+            unsigned int lineStart = 0;
+            for (unsigned int i = 0;i < Dimension;++i)
+            {
+                if (i == d)
+                    continue;
+
+                unsigned int size = boundingBox.GetSize()[i];
+                lineStart += (remainder % size) * boxStrides[i];
+                remainder /= size;
+            }
+
+            for (unsigned int i = 0;i < lineLength;++i)
+                lineValues[i] = squaredDistances[lineStart + i * boxStrides[d]];
+
+            ComputeSquaredDistanceLine(lineValues,spacing,sites,boundaries,lineResult);
+
+            for (unsigned int i = 0;i < lineLength;++i)
+                squaredDistances[lineStart + i * boxStrides[d]] = lineResult[i];
+        }
+    }
+
+    // Gather source distances
+    IteratorType sourceItr(sourceImage,boundingBox);
+    IteratorType sourceContourItr(sourceContourImage,boundingBox);
+    IteratorType targetItr(targetImage,boundingBox);
+    pos = 0;
+
+    if (keepContourDistances)
+        result.contourDistances.reserve(numVoxels / 4);
+
+    while (!sourceItr.IsAtEnd())
+    {
+        if (this->IsInLabel(sourceItr.Get(),label))
+        {
+            double contourDistance = std::sqrt(squaredDistances[pos]);
+
+            // Distance to the target label: zero inside it, distance to its contour outside
+            if (!this->IsInLabel(targetItr.Get(),label))
+                result.maximalDistance = std::max(result.maximalDistance,contourDistance);
+
+            if (this->IsInLabel(sourceContourItr.Get(),label))
+            {
+                result.sumOfContourDistances += contourDistance;
+                ++result.numberOfContourVoxels;
+                if (keepContourDistances)
+                    result.contourDistances.push_back(contourDistance);
+            }
+        }
+
+        ++sourceItr;
+        ++sourceContourItr;
+        ++targetItr;
+        ++pos;
+    }
+
+    if (result.numberOfContourVoxels == 0)
+        result.validTarget = false;
+}
+
+void SegPerfSurfaceDistances::ComputeSquaredDistanceLine(std::vector <double> &values, double spacing, std::vector <unsigned int> &sites,
+                                                         std::vector <double> &boundaries, std::vector <double> &lineResult)
+{
+    const double infiniteValue = std::numeric_limits<double>::infinity();
+    unsigned int lineLength = values.size();
+
+    // Lower envelope of parabolas rooted at finite values (Felzenszwalb and Huttenlocher)
+    int k = -1;
+    for (unsigned int q = 0;q < lineLength;++q)
+    {
+        if (values[q] == infiniteValue)
+            continue;
+
+        double qPosition = q * spacing;
+        if (k < 0)
+        {
+            k = 0;
+            sites[0] = q;
+            boundaries[0] = - infiniteValue;
+            boundaries[1] = infiniteValue;
+            continue;
+        }
+
+        double intersection = 0;
+        while (true)
+        {
+            double pPosition = sites[k] * spacing;
+            intersection = ((values[q] + qPosition * qPosition) - (values[sites[k]] + pPosition * pPosition)) / (2.0 * (qPosition - pPosition));
+
+            if ((intersection <= boundaries[k]) && (k > 0))
+                --k;
+            else
+                break;
+        }
+
+        ++k;
+        sites[k] = q;
+        boundaries[k] = intersection;
+        boundaries[k + 1] = infiniteValue;
+    }
+
+    if (k < 0)
+    {
+        std::fill(lineResult.begin(),lineResult.end(),infiniteValue);
+        return;
+    }
+
+    k = 0;
+    for (unsigned int q = 0;q < lineLength;++q)
+    {
+        double qPosition = q * spacing;
+        while (boundaries[k + 1] < qPosition)
+            ++k;
+
+        double diff = qPosition - sites[k] * spacing;
+        lineResult[q] = diff * diff + values[sites[k]];
+    }
+}
+
+} // end namespace anima
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <itkImage.h>
+#include <vector>
+
+namespace anima
+{
+
+/**
+* @class SegPerfSurfaceDistances
+* @brief Computes all surface distance measures between a tested and a reference label image at once.
+* @details For each label (and for the whole foreground), one exact euclidean distance transform to the contour
+* of each image is computed, restricted to the bounding box of the label in both images. Hausdorff, 95th percentile
+* Hausdorff, contour mean and average surface distances are then derived from these two distance maps.
+* Labels and directions are processed in parallel.
+*/
+class SegPerfSurfaceDistances
+{
+public:
+    typedef itk::Image <unsigned short, 3> ImageType;
+    typedef ImageType::RegionType RegionType;
+
+    SegPerfSurfaceDistances();
+    ~SegPerfSurfaceDistances() {}
+
+    //! Label image and its contour image (as computed by SegPerfCAnalyzer) for the tested segmentation
+    void SetTestImages(ImageType *image, ImageType *contourImage);
+    //! Label image and its contour image (as computed by SegPerfCAnalyzer) for the reference segmentation
+    void SetReferenceImages(ImageType *image, ImageType *contourImage);
+
+    //! Number of labels in the images, including background (labels are 0 to numLabels - 1)
+    void SetNumberOfLabels(unsigned int val) {m_NumberOfLabels = val;}
+    void SetNumberOfWorkUnits(unsigned int val) {m_NumberOfWorkUnits = val;}
+
+    void Update();
+
+    //! Symmetric Hausdorff distance between the foregrounds of both images
+    double GetHausdorffDistance() const {return m_HausdorffDistance;}
+    //! 95th percentile (nearest rank) of the pooled contour to contour distances, foreground of both images
+    double GetHausdorff95Distance() const {return m_Hausdorff95Distance;}
+    //! Maximum of the two directed mean contour to contour distances, foreground of both images
+    double GetContourMeanDistance() const {return m_ContourMeanDistance;}
+    //! Average over all labels of the contour to contour distances, in both directions
+    double GetAverageSurfaceDistance() const {return m_AverageSurfaceDistance;}
+
+protected:
+    //! Distances from one image (source) to the other one (target) for one label
+    struct DirectedDistances
+    {
+        //! False if the source or target label has no contour voxel, distances are then undefined
+        bool validTarget;
+        double maximalDistance;
+        double sumOfContourDistances;
+        unsigned int numberOfContourVoxels;
+        //! Individual contour distances, only kept when requested
+        std::vector <double> contourDistances;
+    };
+
+    //! Bounding boxes of each label in both images, label 0 being the whole foreground. Empty labels have a null size
+    void ComputeLabelBoundingBoxes(std::vector <RegionType> &boundingBoxes);
+
+    /**
+     * Computes the distance map to the target contour on the bounding box, and gathers distances of source voxels:
+     * maximal distance of any source voxel to the target label, and distances of source contour voxels to the target contour
+     */
+    void ComputeDirectedDistances(unsigned int label, bool testToReference, const RegionType &boundingBox,
+                                  bool keepContourDistances, DirectedDistances &result);
+
+    //! Squared distance transform along one line (lower envelope of parabolas), infinite values are non sites
+    static void ComputeSquaredDistanceLine(std::vector <double> &values, double spacing, std::vector <unsigned int> &sites,
+                                           std::vector <double> &boundaries, std::vector <double> &lineResult);
+
+    bool IsInLabel(unsigned short value, unsigned int label) const
+    {
+        if (label == 0)
+            return value != 0;
+
+        return value == label;
+    }
+
+private:
+    ImageType::Pointer m_TestImage, m_TestContourImage;
+    ImageType::Pointer m_ReferenceImage, m_ReferenceContourImage;
+
+    unsigned int m_NumberOfLabels;
+    unsigned int m_NumberOfWorkUnits;
+
+    double m_HausdorffDistance;
+    double m_Hausdorff95Distance;
+    double m_ContourMeanDistance;
+    double m_AverageSurfaceDistance;
+};
+
+} // end namespace anima